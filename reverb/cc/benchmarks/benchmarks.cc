@@ -0,0 +1,368 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks for the table hot paths: selector operations, table
+// inserts and sampling, and chunk store lookups.
+//
+// Run with e.g.
+//   bazel run -c opt //reverb/cc/benchmarks:benchmarks -- \
+//       --benchmark_filter=Selector
+// Hardware counters (cycles, instructions, cache misses...) are available
+// through google benchmark's built-in --benchmark_perf_counters flag when
+// the binary is built with libpfm support.
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include <cstdint>
+#include "absl/memory/memory.h"
+#include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/rate_limiter.h"
+#include "reverb/cc/selectors/alias.h"
+#include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/heap.h"
+#include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/selectors/lifo.h"
+#include "reverb/cc/selectors/prioritized.h"
+#include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/table.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+using SelectorFactory = std::function<std::unique_ptr<ItemSelector>()>;
+
+double Priority(uint64_t key) { return key % 128 + 1; }
+
+void Prefill(ItemSelector* selector, int64_t num_items) {
+  for (int64_t i = 0; i < num_items; i++) {
+    REVERB_CHECK_OK(selector->Insert(i, Priority(i)));
+  }
+}
+
+void BM_SelectorInsert(benchmark::State& state,
+                       const SelectorFactory& factory) {
+  auto selector = factory();
+  const int64_t num_items = state.range(0);
+  Prefill(selector.get(), num_items);
+  uint64_t key = num_items;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(selector->Insert(key, Priority(key)));
+    key++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_SelectorUpdate(benchmark::State& state,
+                       const SelectorFactory& factory) {
+  auto selector = factory();
+  const int64_t num_items = state.range(0);
+  Prefill(selector.get(), num_items);
+  uint64_t key = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        selector->Update(key, Priority(key + state.iterations())));
+    key = (key + 1) % num_items;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_SelectorSample(benchmark::State& state,
+                       const SelectorFactory& factory) {
+  auto selector = factory();
+  Prefill(selector.get(), state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(selector->Sample());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// 1k items fit in cache, 1M exercise the main memory path and 100M the TLB.
+void SelectorSizes(benchmark::internal::Benchmark* b) {
+  b->Arg(1000)->Arg(1000000)->Arg(100000000);
+}
+
+#define SELECTOR_BENCHMARK(op, name, factory)                \
+  BENCHMARK_CAPTURE(BM_Selector##op, name,                   \
+                    []() -> std::unique_ptr<ItemSelector> {  \
+                      return factory;                        \
+                    })                                       \
+      ->Apply(SelectorSizes)
+
+SELECTOR_BENCHMARK(Insert, uniform, absl::make_unique<UniformSelector>());
+SELECTOR_BENCHMARK(Insert, fifo, absl::make_unique<FifoSelector>());
+SELECTOR_BENCHMARK(Insert, lifo, absl::make_unique<LifoSelector>());
+SELECTOR_BENCHMARK(Insert, heap, absl::make_unique<HeapSelector>());
+SELECTOR_BENCHMARK(Insert, prioritized,
+                   absl::make_unique<PrioritizedSelector>(0.8));
+
+SELECTOR_BENCHMARK(Update, uniform, absl::make_unique<UniformSelector>());
+SELECTOR_BENCHMARK(Update, fifo, absl::make_unique<FifoSelector>());
+SELECTOR_BENCHMARK(Update, lifo, absl::make_unique<LifoSelector>());
+SELECTOR_BENCHMARK(Update, heap, absl::make_unique<HeapSelector>());
+SELECTOR_BENCHMARK(Update, prioritized,
+                   absl::make_unique<PrioritizedSelector>(0.8));
+
+SELECTOR_BENCHMARK(Sample, uniform, absl::make_unique<UniformSelector>());
+SELECTOR_BENCHMARK(Sample, fifo, absl::make_unique<FifoSelector>());
+SELECTOR_BENCHMARK(Sample, lifo, absl::make_unique<LifoSelector>());
+SELECTOR_BENCHMARK(Sample, heap, absl::make_unique<HeapSelector>());
+SELECTOR_BENCHMARK(Sample, prioritized,
+                   absl::make_unique<PrioritizedSelector>(0.8));
+SELECTOR_BENCHMARK(Sample, alias, absl::make_unique<AliasSelector>(0.8));
+
+std::unique_ptr<Table> MakeTable(int64_t max_size) {
+  return absl::make_unique<Table>(
+      "dist", std::make_shared<UniformSelector>(),
+      std::make_shared<FifoSelector>(), max_size,
+      /*max_times_sampled=*/0,
+      std::make_shared<RateLimiter>(1.0, 1, -DBL_MAX, DBL_MAX));
+}
+
+// All items share one chunk so that the benchmark measures the table and not
+// the allocation of payloads.
+TableItem MakeItem(uint64_t key, const std::shared_ptr<ChunkStore::Chunk>&
+                                     chunk) {
+  TableItem item;
+  item.chunks.push_back(chunk);
+  item.item = testing::MakePrioritizedItem(key, Priority(key),
+                                           {chunk->data()});
+  return item;
+}
+
+void BM_TableInsertOrAssign(benchmark::State& state) {
+  auto table = MakeTable(/*max_size=*/state.range(0));
+  auto chunk = std::make_shared<ChunkStore::Chunk>(
+      testing::MakeChunkData(1, testing::MakeSequenceRange(1, 0, 1)));
+  uint64_t key = 0;
+  for (auto _ : state) {
+    REVERB_CHECK_OK(table->InsertOrAssign(MakeItem(key++, chunk)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TableInsertOrAssign)->Arg(1000)->Arg(1000000);
+
+void BM_TableInsertOrAssignAsync(benchmark::State& state) {
+  auto table = MakeTable(/*max_size=*/state.range(0));
+  auto chunk = std::make_shared<ChunkStore::Chunk>(
+      testing::MakeChunkData(1, testing::MakeSequenceRange(1, 0, 1)));
+
+  absl::Mutex mu;
+  int64_t pending = 0;
+  auto insert_completed = std::make_shared<Table::InsertCallback>(
+      [&](uint64_t) {
+        absl::MutexLock lock(&mu);
+        pending--;
+      });
+
+  uint64_t key = 0;
+  for (auto _ : state) {
+    bool can_insert_more = false;
+    {
+      absl::MutexLock lock(&mu);
+      pending++;
+    }
+    REVERB_CHECK_OK(table->InsertOrAssignAsync(MakeItem(key++, chunk),
+                                               &can_insert_more,
+                                               insert_completed));
+    if (!can_insert_more) {
+      // The queue limit was hit; wait for the worker to drain some inserts
+      // like a real writer would.
+      absl::MutexLock lock(&mu);
+      mu.Await(absl::Condition(
+          +[](int64_t* pending) { return *pending < 100; }, &pending));
+    }
+  }
+  {
+    absl::MutexLock lock(&mu);
+    mu.Await(absl::Condition(
+        +[](int64_t* pending) { return *pending == 0; }, &pending));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TableInsertOrAssignAsync)->Arg(1000)->Arg(1000000);
+
+void BM_TableSampleFlexibleBatch(benchmark::State& state) {
+  const int64_t num_items = state.range(0);
+  const int batch_size = state.range(1);
+  auto table = MakeTable(/*max_size=*/num_items);
+  auto chunk = std::make_shared<ChunkStore::Chunk>(
+      testing::MakeChunkData(1, testing::MakeSequenceRange(1, 0, 1)));
+  for (int64_t i = 0; i < num_items; i++) {
+    REVERB_CHECK_OK(table->InsertOrAssign(MakeItem(i, chunk)));
+  }
+  for (auto _ : state) {
+    std::vector<Table::SampledItem> items;
+    REVERB_CHECK_OK(
+        table->SampleFlexibleBatch(&items, batch_size, absl::Seconds(10)));
+    benchmark::DoNotOptimize(items);
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_TableSampleFlexibleBatch)
+    ->ArgPair(1000, 1)
+    ->ArgPair(1000, 64)
+    ->ArgPair(1000000, 1)
+    ->ArgPair(1000000, 64);
+
+// Nanoseconds at quantile `q` of `latencies`. Partially sorts in place.
+double PercentileNs(std::vector<absl::Duration>* latencies, double q) {
+  if (latencies->empty()) return 0;
+  const size_t index =
+      std::min(latencies->size() - 1,
+               static_cast<size_t>(q * static_cast<double>(latencies->size())));
+  std::nth_element(latencies->begin(), latencies->begin() + index,
+                   latencies->end());
+  return absl::ToDoubleNanoseconds((*latencies)[index]);
+}
+
+// Measures the cost that an in-progress `Checkpoint` imposes on a saturated
+// table: one thread freezes copy-on-write checkpoints back to back, another
+// keeps inserting (evicting through the fifo remover), while the benchmark
+// thread samples. Reports sampling throughput relative to a baseline taken
+// without the checkpoint thread, plus Insert/Sample latency percentiles
+// recorded during the contended phase.
+//
+// The checkpoint isolation contract is enforced here: the run fails (via
+// SkipWithError) if concurrent checkpointing costs more than 5% sampling
+// throughput. Serializing a checkpoint must never be allowed to regress back
+// into holding the table lock for its duration.
+void BM_TableSampleDuringCheckpoint(benchmark::State& state) {
+  constexpr double kMaxOverheadPct = 5.0;
+  const int64_t num_items = state.range(0);
+  auto table = MakeTable(/*max_size=*/num_items);
+  auto chunk = std::make_shared<ChunkStore::Chunk>(
+      testing::MakeChunkData(1, testing::MakeSequenceRange(1, 0, 1)));
+  for (int64_t i = 0; i < num_items; i++) {
+    REVERB_CHECK_OK(table->InsertOrAssign(MakeItem(i, chunk)));
+  }
+
+  // Baseline sampling rate with the table idle; long enough to dominate
+  // cold-cache effects but cheap next to the benchmark itself.
+  const int64_t kBaselineSamples = 20000;
+  const absl::Time baseline_start = absl::Now();
+  for (int64_t i = 0; i < kBaselineSamples; i++) {
+    std::vector<Table::SampledItem> items;
+    REVERB_CHECK_OK(table->SampleFlexibleBatch(&items, 1, absl::Seconds(10)));
+  }
+  const double baseline_ns_per_sample =
+      absl::ToDoubleNanoseconds(absl::Now() - baseline_start) /
+      kBaselineSamples;
+
+  std::atomic<bool> stop(false);
+  std::atomic<int64_t> checkpoints(0);
+  auto checkpoint_thread = internal::StartThread("BenchCheckpoint", [&] {
+    while (!stop.load(std::memory_order_relaxed)) {
+      benchmark::DoNotOptimize(table->Checkpoint());
+      checkpoints.fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+
+  absl::Mutex insert_mu;
+  std::vector<absl::Duration> insert_latencies;
+  auto insert_thread = internal::StartThread("BenchInsert", [&] {
+    uint64_t key = num_items;
+    while (!stop.load(std::memory_order_relaxed)) {
+      const absl::Time insert_start = absl::Now();
+      REVERB_CHECK_OK(table->InsertOrAssign(MakeItem(key++, chunk)));
+      const absl::Duration latency = absl::Now() - insert_start;
+      absl::MutexLock lock(&insert_mu);
+      insert_latencies.push_back(latency);
+    }
+  });
+
+  std::vector<absl::Duration> sample_latencies;
+  const absl::Time contended_start = absl::Now();
+  for (auto _ : state) {
+    const absl::Time sample_start = absl::Now();
+    std::vector<Table::SampledItem> items;
+    REVERB_CHECK_OK(table->SampleFlexibleBatch(&items, 1, absl::Seconds(10)));
+    sample_latencies.push_back(absl::Now() - sample_start);
+  }
+  const absl::Duration contended = absl::Now() - contended_start;
+  stop = true;
+  checkpoint_thread = nullptr;
+  insert_thread = nullptr;
+
+  const double contended_ns_per_sample =
+      absl::ToDoubleNanoseconds(contended) / state.iterations();
+  const double overhead_pct =
+      100.0 * (contended_ns_per_sample / baseline_ns_per_sample - 1.0);
+  state.counters["checkpoints"] = checkpoints.load();
+  state.counters["overhead_pct"] = overhead_pct;
+  state.counters["sample_p50_ns"] = PercentileNs(&sample_latencies, 0.50);
+  state.counters["sample_p99_ns"] = PercentileNs(&sample_latencies, 0.99);
+  state.counters["sample_p999_ns"] = PercentileNs(&sample_latencies, 0.999);
+  state.counters["insert_p50_ns"] = PercentileNs(&insert_latencies, 0.50);
+  state.counters["insert_p99_ns"] = PercentileNs(&insert_latencies, 0.99);
+  state.counters["insert_p999_ns"] = PercentileNs(&insert_latencies, 0.999);
+  state.SetItemsProcessed(state.iterations());
+
+  // No checkpoint completed means the run was too short to say anything.
+  if (checkpoints.load() > 0 && overhead_pct > kMaxOverheadPct) {
+    state.SkipWithError(
+        absl::StrCat("Concurrent checkpointing cost ", overhead_pct,
+                     "% sampling throughput; the contract allows at most ",
+                     kMaxOverheadPct, "%.")
+            .c_str());
+  }
+}
+BENCHMARK(BM_TableSampleDuringCheckpoint)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->MinTime(5.0);
+
+void BM_ChunkStoreGet(benchmark::State& state) {
+  const int64_t num_chunks = state.range(0);
+  constexpr int kKeysPerGet = 64;
+  ChunkStore store;
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  chunks.reserve(num_chunks);
+  for (int64_t i = 0; i < num_chunks; i++) {
+    chunks.push_back(store.Insert(
+        testing::MakeChunkData(i, testing::MakeSequenceRange(i, 0, 1))));
+  }
+  absl::BitGen gen;
+  std::vector<ChunkStore::Key> keys(kKeysPerGet);
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> result;
+  for (auto _ : state) {
+    for (auto& key : keys) {
+      key = absl::Uniform<int64_t>(gen, 0, num_chunks);
+    }
+    REVERB_CHECK(store.Get(keys, &result).ok());
+  }
+  state.SetItemsProcessed(state.iterations() * kKeysPerGet);
+}
+BENCHMARK(BM_ChunkStoreGet)->Arg(1000)->Arg(1000000);
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
+
+BENCHMARK_MAIN();
@@ -48,6 +48,19 @@ class Checkpointer {
   virtual absl::Status LoadLatest(
       std::vector<std::shared_ptr<Table>>* tables) = 0;
 
+  // Imports a single named table from the checkpoint at `path` into the
+  // existing (potentially live and nonempty) `table`. Unlike `Load`, `table`
+  // is not replaced and does not take its configuration from the checkpoint;
+  // the checkpointed items are inserted through the regular insert path, so
+  // capacity limits and rate limiters of the destination table apply. Chunk
+  // keys that collide with different live chunks in `chunk_store`, and item
+  // keys already present in `table`, are remapped to fresh keys. The number
+  // of inserted items is returned in `num_items`.
+  virtual absl::Status ImportTable(absl::string_view path,
+                                   const std::string& table_name,
+                                   ChunkStore* chunk_store, Table* table,
+                                   int64_t* num_items) = 0;
+
   // Attempts to load a specific fallback checkpoint, if provided.
   virtual absl::Status LoadFallbackCheckpoint(
       std::vector<std::shared_ptr<Table>>* tables) = 0;
@@ -14,60 +14,411 @@
 
 #include "reverb/cc/chunk_store.h"
 
+#include <algorithm>
 #include <memory>
+#include <numeric>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include <cstdint>
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/tf_util.h"
 #include "reverb/cc/tensor_compression.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
 #include "tensorflow/core/lib/core/status.h"
 
 namespace deepmind {
 namespace reverb {
+namespace {
 
-ChunkStore::Chunk::Chunk(ChunkData data) : data_(std::move(data)) {}
+constexpr char kSpillFileName[] = "chunks.spill";
 
-uint64_t ChunkStore::Chunk::key() const { return data_.chunk_key(); }
+// Fingerprint of everything that defines the content of a chunk except its
+// key. Two chunks are only interchangeable if both the (compressed) payload
+// and the metadata required to interpret it (sequence range, delta encoding,
+// codec) are identical.
+uint64_t ContentFingerprint(const ChunkData& chunk) {
+  uint64_t fp = tensorflow::Fingerprint64(chunk.data().SerializeAsString());
+  fp = tensorflow::FingerprintCat64(fp, chunk.sequence_range().episode_id());
+  fp = tensorflow::FingerprintCat64(fp, chunk.sequence_range().start());
+  fp = tensorflow::FingerprintCat64(fp, chunk.sequence_range().end());
+  fp = tensorflow::FingerprintCat64(fp, chunk.sequence_range().sparse());
+  fp = tensorflow::FingerprintCat64(fp, chunk.delta_encoded());
+  fp = tensorflow::FingerprintCat64(fp, chunk.codec());
+  fp = tensorflow::FingerprintCat64(fp, chunk.delta_baseline_chunk_key());
+  for (const auto& stream : chunk.column_streams()) {
+    fp = tensorflow::FingerprintCat64(fp, stream.codec());
+    fp = tensorflow::FingerprintCat64(fp, stream.delta_encoded());
+  }
+  return fp;
+}
+
+}  // namespace
+
+namespace internal {
+
+absl::Status ChunkSpillFile::Create(const std::string& path,
+                                    std::shared_ptr<ChunkSpillFile>* file) {
+  std::unique_ptr<tensorflow::WritableFile> writer;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      tensorflow::Env::Default()->NewWritableFile(path, &writer)));
+  std::unique_ptr<tensorflow::RandomAccessFile> reader;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      tensorflow::Env::Default()->NewRandomAccessFile(path, &reader)));
+  *file = std::shared_ptr<ChunkSpillFile>(
+      new ChunkSpillFile(std::move(writer), std::move(reader)));
+  return absl::OkStatus();
+}
+
+absl::Status ChunkSpillFile::OpenForRead(const std::string& path,
+                                         std::shared_ptr<ChunkSpillFile>* file) {
+  std::unique_ptr<tensorflow::RandomAccessFile> reader;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      tensorflow::Env::Default()->NewRandomAccessFile(path, &reader)));
+  *file = std::shared_ptr<ChunkSpillFile>(
+      new ChunkSpillFile(nullptr, std::move(reader)));
+  return absl::OkStatus();
+}
+
+ChunkSpillFile::ChunkSpillFile(
+    std::unique_ptr<tensorflow::WritableFile> writer,
+    std::unique_ptr<tensorflow::RandomAccessFile> reader)
+    : writer_(std::move(writer)), reader_(std::move(reader)) {}
+
+absl::Status ChunkSpillFile::Append(absl::string_view payload,
+                                    uint64_t* offset) {
+  absl::MutexLock lock(&mu_);
+  if (writer_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "ChunkSpillFile was opened for reading only.");
+  }
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(writer_->Append(
+      tensorflow::StringPiece(payload.data(), payload.size()))));
+  // Flush so that the payload is visible to reads before the in-memory copy
+  // of the payload is released by the caller.
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(writer_->Flush()));
+  *offset = size_;
+  size_ += payload.size();
+  return absl::OkStatus();
+}
+
+absl::Status ChunkSpillFile::Read(uint64_t offset, size_t length,
+                                  std::string* payload) {
+  payload->resize(length);
+  tensorflow::StringPiece result;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      reader_->Read(offset, length, &result, &(*payload)[0])));
+  if (result.data() != payload->data()) {
+    payload->assign(result.data(), result.size());
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace internal
+
+ChunkStore::ChunkStore(Options options)
+    : deduplicate_by_content_(options.deduplicate_by_content) {
+  if (!options.spill_directory.empty()) {
+    REVERB_CHECK_OK(FromTensorflowStatus(
+        tensorflow::Env::Default()->RecursivelyCreateDir(
+            options.spill_directory)));
+    spill_ = absl::make_unique<SpillTier>();
+    spill_->max_hot_bytes = options.max_hot_bytes;
+    REVERB_CHECK_OK(internal::ChunkSpillFile::Create(
+        tensorflow::io::JoinPath(options.spill_directory, kSpillFileName),
+        &spill_->file));
+  }
+}
+
+ChunkStore::ChunkStore(bool deduplicate_by_content)
+    : ChunkStore(Options{deduplicate_by_content}) {}
+
+ChunkStore::Chunk::Chunk(ChunkData data)
+    : storage_(std::move(data)), data_(&storage_) {}
+
+ChunkStore::Chunk::Chunk(ChunkData* data,
+                         std::shared_ptr<google::protobuf::Arena> arena)
+    : data_(data), arena_(std::move(arena)) {
+  REVERB_CHECK(data_ != nullptr);
+  REVERB_CHECK_EQ(data_->GetArena(), arena_.get());
+}
+
+ChunkStore::Chunk::Chunk(ChunkData metadata,
+                         std::shared_ptr<internal::ChunkSpillFile> payload_file,
+                         uint64_t payload_offset, size_t payload_length,
+                         size_t full_byte_size)
+    : storage_(std::move(metadata)),
+      data_(&storage_),
+      spill_file_(std::move(payload_file)),
+      payload_length_(payload_length) {
+  // The byte size of the full proto cannot be computed while the payload is
+  // absent so it is taken from the checkpoint record.
+  absl::call_once(data_byte_size_once_,
+                  [this, full_byte_size] { data_byte_size_ = full_byte_size; });
+  payload_spilled_ = true;
+  payload_on_disk_ = true;
+  payload_offset_ = payload_offset;
+}
 
-const ChunkData& ChunkStore::Chunk::data() const { return data_; }
+uint64_t ChunkStore::Chunk::key() const { return data_->chunk_key(); }
+
+const ChunkData& ChunkStore::Chunk::data() const {
+  if (spill_file_ != nullptr) {
+    absl::MutexLock lock(&payload_mu_);
+    if (payload_spilled_) {
+      // An IO failure at this point cannot be propagated to the caller so it
+      // is treated as fatal, just like failing to allocate the payload would
+      // be.
+      REVERB_CHECK_OK(FaultInLocked());
+    }
+  }
+  return *data_;
+}
+
+bool ChunkStore::Chunk::spilled() const {
+  if (spill_file_ == nullptr) return false;
+  absl::MutexLock lock(&payload_mu_);
+  return payload_spilled_;
+}
+
+void ChunkStore::Chunk::PinPayload() {
+  if (spill_file_ == nullptr) return;
+  absl::MutexLock lock(&payload_mu_);
+  if (payload_spilled_) {
+    // See `data()` for why an IO failure is fatal here.
+    REVERB_CHECK_OK(FaultInLocked());
+  }
+  ++payload_pins_;
+}
+
+void ChunkStore::Chunk::UnpinPayload() {
+  if (spill_file_ == nullptr) return;
+  absl::MutexLock lock(&payload_mu_);
+  REVERB_CHECK_GT(payload_pins_, 0);
+  --payload_pins_;
+}
+
+void ChunkStore::Chunk::EnableUnpackedCaching(
+    std::shared_ptr<internal::UnpackedChunkCache> cache) {
+  absl::MutexLock lock(&unpacked_mu_);
+  if (unpacked_cache_ == nullptr) {
+    unpacked_cache_ = std::move(cache);
+  }
+}
+
+bool ChunkStore::Chunk::unpacked_cache_enabled() const {
+  absl::MutexLock lock(&unpacked_mu_);
+  return unpacked_cache_ != nullptr;
+}
+
+bool ChunkStore::Chunk::unpacked_cached() const {
+  absl::MutexLock lock(&unpacked_mu_);
+  return !unpacked_columns_.empty();
+}
+
+bool ChunkStore::Chunk::GetCachedColumn(int column, tensorflow::Tensor* out) {
+  std::shared_ptr<internal::UnpackedChunkCache> cache;
+  size_t bytes;
+  {
+    absl::MutexLock lock(&unpacked_mu_);
+    if (column < 0 || column >= static_cast<int>(unpacked_columns_.size())) {
+      return false;
+    }
+    *out = unpacked_columns_[column];
+    cache = unpacked_cache_;
+    bytes = unpacked_bytes_;
+  }
+  // The touch is made outside of `unpacked_mu_` so that no chunk mutex is
+  // ever held while the cache demotes (and thus locks) other chunks.
+  if (cache != nullptr) cache->Touch(shared_from_this(), bytes);
+  return true;
+}
+
+void ChunkStore::Chunk::CacheUnpackedColumns(
+    std::vector<tensorflow::Tensor> columns) {
+  std::shared_ptr<internal::UnpackedChunkCache> cache;
+  size_t bytes = 0;
+  {
+    absl::MutexLock lock(&unpacked_mu_);
+    if (unpacked_cache_ == nullptr || !unpacked_columns_.empty()) return;
+    for (const tensorflow::Tensor& column : columns) {
+      bytes += column.TotalBytes();
+    }
+    unpacked_columns_ = std::move(columns);
+    unpacked_bytes_ = bytes;
+    cache = unpacked_cache_;
+  }
+  // See `GetCachedColumn` for why the touch happens outside the lock.
+  cache->Touch(shared_from_this(), bytes);
+}
+
+void ChunkStore::Chunk::ReleaseUnpackedColumns() {
+  absl::MutexLock lock(&unpacked_mu_);
+  unpacked_columns_ = {};
+  unpacked_bytes_ = 0;
+}
+
+void ChunkStore::Chunk::EnableSpilling(
+    std::shared_ptr<internal::ChunkSpillFile> file) {
+  // Releasing the payload of an arena-owned chunk would not return any memory
+  // until the whole arena dies, so such chunks must not be spilled. They are
+  // never created by the store so this cannot happen in practice.
+  REVERB_CHECK(arena_ == nullptr);
+  spill_file_ = std::move(file);
+  payload_length_ = data_->data().ByteSizeLong();
+  // The size of the full proto is part of the hot set accounting so it must
+  // be computed before the payload can be released.
+  DataByteSizeLong();
+}
+
+absl::Status ChunkStore::Chunk::Spill() {
+  REVERB_CHECK(spill_file_ != nullptr);
+  absl::MutexLock lock(&payload_mu_);
+  if (payload_spilled_) return absl::OkStatus();
+  if (payload_pins_ > 0) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Payload of chunk ", key(), " is pinned."));
+  }
+  if (!payload_on_disk_) {
+    REVERB_RETURN_IF_ERROR(spill_file_->Append(
+        data_->data().SerializeAsString(), &payload_offset_));
+    payload_on_disk_ = true;
+  }
+  data_->mutable_data()->Clear();
+  payload_spilled_ = true;
+  return absl::OkStatus();
+}
+
+absl::Status ChunkStore::Chunk::FaultInLocked() const {
+  std::string payload;
+  REVERB_RETURN_IF_ERROR(
+      spill_file_->Read(payload_offset_, payload_length_, &payload));
+  if (!data_->mutable_data()->ParseFromString(payload)) {
+    return absl::DataLossError(absl::StrCat(
+        "Failed to parse spilled payload of chunk ", key(), "."));
+  }
+  payload_spilled_ = false;
+  return absl::OkStatus();
+}
 
 size_t ChunkStore::Chunk::DataByteSizeLong() const {
   absl::call_once(data_byte_size_once_,
-                  [this]() { data_byte_size_ = data_.ByteSizeLong(); });
+                  [this]() { data_byte_size_ = data_->ByteSizeLong(); });
   return data_byte_size_;
 }
 
 uint64_t ChunkStore::Chunk::episode_id() const {
-  return data_.sequence_range().episode_id();
+  return data_->sequence_range().episode_id();
 }
 
 int32_t ChunkStore::Chunk::num_rows() const {
-  return data_.sequence_range().end() - data_.sequence_range().start() + 1;
+  return data_->sequence_range().end() - data_->sequence_range().start() + 1;
+}
+
+int64_t ChunkStore::Chunk::uncompressed_byte_size() const {
+  return data_->data_uncompressed_size();
 }
 
 int ChunkStore::Chunk::num_columns() const {
   // Try to get number of columns without parsing lazy tensors field.
-  if (data_.data_tensors_len() != 0) {
-    return data_.data_tensors_len();
+  if (data_->data_tensors_len() != 0) {
+    return data_->data_tensors_len();
   }
-  return data_.data().tensors_size();
+  return data_->data().tensors_size();
 }
 
 std::shared_ptr<ChunkStore::Chunk> ChunkStore::Insert(ChunkData item) {
-  absl::WriterMutexLock lock(&mu_);
-  std::weak_ptr<Chunk>& wp = data_[item.chunk_key()];
-  std::shared_ptr<Chunk> sp = wp.lock();
-  if (sp == nullptr) {
-    wp = (sp = std::make_shared<Chunk>(std::move(item)));
+  uint64_t fingerprint = 0;
+  size_t payload_size = 0;
+  std::shared_ptr<Chunk> existing;
+  if (deduplicate_by_content_) {
+    fingerprint = ContentFingerprint(item);
+    payload_size = item.data().ByteSizeLong();
+    DedupStripe& dedup_stripe = dedup_stripes_[StripeIndex(fingerprint)];
+    absl::MutexLock lock(&dedup_stripe.mu);
+    const auto it = dedup_stripe.data.find(fingerprint);
+    if (it != dedup_stripe.data.end() &&
+        it->second.payload_size == payload_size) {
+      existing = it->second.chunk.lock();
+    }
+  }
+
+  std::shared_ptr<Chunk> sp;
+  bool created = false;
+  {
+    Stripe& stripe = stripes_[StripeIndex(item.chunk_key())];
+    absl::WriterMutexLock lock(&stripe.mu);
+    std::weak_ptr<Chunk>& wp = stripe.data[item.chunk_key()];
+    sp = wp.lock();
+    if (sp == nullptr) {
+      if (existing != nullptr) {
+        // Alias the new key to the content-identical live chunk instead of
+        // storing a duplicate.
+        wp = (sp = std::move(existing));
+      } else {
+        sp = std::make_shared<Chunk>(std::move(item));
+        if (spill_ != nullptr) {
+          sp->EnableSpilling(spill_->file);
+        }
+        wp = sp;
+        created = true;
+      }
+    }
+  }
+
+  if (spill_ != nullptr) {
+    TouchChunk(sp);
+  }
+
+  if (deduplicate_by_content_ && created) {
+    DedupStripe& dedup_stripe = dedup_stripes_[StripeIndex(fingerprint)];
+    absl::MutexLock lock(&dedup_stripe.mu);
+    DedupEntry& entry = dedup_stripe.data[fingerprint];
+    // If two inserts of the same content race then the last registration
+    // wins; deduplication is best effort.
+    if (entry.chunk.expired()) {
+      entry = {payload_size, sp};
+    }
+  }
+
+  return sp;
+}
+
+std::shared_ptr<ChunkStore::Chunk> ChunkStore::InsertLazy(
+    ChunkData metadata, std::shared_ptr<internal::ChunkSpillFile> payload_file,
+    uint64_t payload_offset, size_t payload_length, size_t full_byte_size) {
+  const Key key = metadata.chunk_key();
+  std::shared_ptr<Chunk> sp;
+  {
+    Stripe& stripe = stripes_[StripeIndex(key)];
+    absl::WriterMutexLock lock(&stripe.mu);
+    std::weak_ptr<Chunk>& wp = stripe.data[key];
+    sp = wp.lock();
+    if (sp == nullptr) {
+      // The payload file stays the chunk's backing store even when the store
+      // has its own spill tier; spilling the chunk again then simply releases
+      // the in-memory copy. The chunk is not touched into the hot set here so
+      // that loading remains metadata bound; it is admitted the first time it
+      // is fetched.
+      wp = (sp = std::shared_ptr<Chunk>(
+                new Chunk(std::move(metadata), std::move(payload_file),
+                          payload_offset, payload_length, full_byte_size)));
+    }
   }
   return sp;
 }
@@ -75,23 +426,128 @@ std::shared_ptr<ChunkStore::Chunk> ChunkStore::Insert(ChunkData item) {
 tensorflow::Status ChunkStore::Get(
     absl::Span<const ChunkStore::Key> keys,
     std::vector<std::shared_ptr<Chunk>>* chunks) {
-  absl::ReaderMutexLock lock(&mu_);
   chunks->clear();
-  chunks->reserve(keys.size());
-  for (int i = 0; i < keys.size(); i++) {
-    chunks->push_back(GetItem(keys[i]));
-    if (!chunks->at(i)) {
-      return tensorflow::errors::NotFound(
-          absl::StrCat("Chunk ", keys[i], " cannot be found."));
+  chunks->resize(keys.size());
+
+  // Order the positions by stripe so that each stripe's batch can be resolved
+  // under a single lock acquisition. The chunks are still returned in the
+  // order given in `keys`.
+  std::vector<int> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&keys](int a, int b) {
+    return StripeIndex(keys[a]) < StripeIndex(keys[b]);
+  });
+
+  for (size_t i = 0; i < order.size();) {
+    const size_t stripe_index = StripeIndex(keys[order[i]]);
+    const Stripe& stripe = stripes_[stripe_index];
+    absl::ReaderMutexLock lock(&stripe.mu);
+    for (; i < order.size() && StripeIndex(keys[order[i]]) == stripe_index;
+         i++) {
+      const int pos = order[i];
+      const auto it = stripe.data.find(keys[pos]);
+      std::shared_ptr<Chunk> chunk =
+          it == stripe.data.end() ? nullptr : it->second.lock();
+      if (chunk == nullptr) {
+        return tensorflow::errors::NotFound(
+            absl::StrCat("Chunk ", keys[pos], " cannot be found."));
+      }
+      (*chunks)[pos] = std::move(chunk);
+    }
+  }
+
+  if (spill_ != nullptr) {
+    for (const std::shared_ptr<Chunk>& chunk : *chunks) {
+      TouchChunk(chunk);
     }
   }
+
   return tensorflow::Status::OK();
 }
 
-std::shared_ptr<ChunkStore::Chunk> ChunkStore::GetItem(Key key) {
-  auto it = data_.find(key);
-  return it == data_.end() ? nullptr : it->second.lock();
+void ChunkStore::TouchChunk(const std::shared_ptr<Chunk>& chunk) {
+  absl::MutexLock lock(&spill_->mu);
+  const auto it = spill_->index.find(chunk->key());
+  if (it != spill_->index.end()) {
+    spill_->lru.splice(spill_->lru.end(), spill_->lru, it->second);
+    return;
+  }
+
+  // (Re)admit the chunk to the hot set. Faulting the payload in up front,
+  // rather than waiting for `data()` to do it lazily, keeps the hot set
+  // accounting in sync with what actually resides in memory.
+  if (chunk->spilled()) {
+    chunk->data();
+  }
+  spill_->lru.push_back({chunk->key(), chunk, chunk->payload_length_});
+  spill_->index[chunk->key()] = std::prev(spill_->lru.end());
+  spill_->hot_bytes += chunk->payload_length_;
+  TrimHotSetLocked();
 }
 
+void ChunkStore::TrimHotSetLocked() {
+  // Each iteration either drops the coldest entry or rotates a pinned one to
+  // the warm end, so the loop visits every entry at most once.
+  size_t attempts = spill_->lru.size();
+  while (spill_->hot_bytes > spill_->max_hot_bytes && spill_->lru.size() > 1 &&
+         attempts-- > 0) {
+    const HotChunk& cold = spill_->lru.front();
+    if (std::shared_ptr<Chunk> chunk = cold.chunk.lock()) {
+      const absl::Status status = chunk->Spill();
+      if (absl::IsFailedPrecondition(status)) {
+        // The payload is pinned by an in-flight sample response; treat the
+        // chunk as recently used and look for a colder victim instead.
+        // Splicing does not invalidate the iterator stored in the index.
+        spill_->lru.splice(spill_->lru.end(), spill_->lru,
+                           spill_->lru.begin());
+        continue;
+      }
+      if (!status.ok()) {
+        // If the spill file has gone bad then we keep the chunk in memory;
+        // there is no way to recover the payload once it has been released.
+        REVERB_LOG(REVERB_ERROR)
+            << "Failed to spill chunk " << cold.key << ": " << status;
+        return;
+      }
+    }
+    spill_->hot_bytes -= cold.payload_bytes;
+    spill_->index.erase(cold.key);
+    spill_->lru.pop_front();
+  }
+}
+
+namespace internal {
+
+UnpackedChunkCache::UnpackedChunkCache(size_t max_bytes)
+    : max_bytes_(max_bytes) {}
+
+void UnpackedChunkCache::Touch(const std::shared_ptr<ChunkStore::Chunk>& chunk,
+                               size_t bytes) {
+  absl::MutexLock lock(&mu_);
+  const auto it = index_.find(chunk->key());
+  if (it != index_.end()) {
+    lru_.splice(lru_.end(), lru_, it->second);
+    return;
+  }
+  lru_.push_back({chunk->key(), chunk, bytes});
+  index_[chunk->key()] = std::prev(lru_.end());
+  cached_bytes_ += bytes;
+  TrimLocked();
+}
+
+void UnpackedChunkCache::TrimLocked() {
+  while (cached_bytes_ > max_bytes_ && lru_.size() > 1) {
+    const CachedChunk& cold = lru_.front();
+    if (std::shared_ptr<ChunkStore::Chunk> chunk = cold.chunk.lock()) {
+      chunk->ReleaseUnpackedColumns();
+    }
+    cached_bytes_ -= cold.bytes;
+    index_.erase(cold.key);
+    lru_.pop_front();
+  }
+}
+
+}  // namespace internal
+
 }  // namespace reverb
 }  // namespace deepmind
@@ -15,23 +15,72 @@
 #ifndef REVERB_CC_CHUNK_STORE_H_
 #define REVERB_CC_CHUNK_STORE_H_
 
+#include <array>
+#include <list>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/base/call_once.h"
 #include <cstdint>
 #include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/types/span.h"
+#include "google/protobuf/arena.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/schema.pb.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
 
 namespace deepmind {
 namespace reverb {
+namespace internal {
+
+// Append-only file holding the serialized payloads of spilled chunks. A
+// payload is appended the first time its chunk is spilled and read back
+// whenever a spilled chunk is accessed. Since chunk payloads are immutable
+// the same region is reused by all later spills of the same chunk; space is
+// never reclaimed while the file is alive.
+class ChunkSpillFile {
+ public:
+  // Creates (or truncates) the file at `path`.
+  static absl::Status Create(const std::string& path,
+                             std::shared_ptr<ChunkSpillFile>* file);
+
+  // Opens an existing payload file (e.g. the payloads file of a lazy
+  // checkpoint) for reading only. `Append` fails on a file opened this way.
+  static absl::Status OpenForRead(const std::string& path,
+                                  std::shared_ptr<ChunkSpillFile>* file);
+
+  // Appends `payload` to the file and sets `offset` to the position it was
+  // written at. The payload is flushed before the call returns so that it can
+  // immediately be read back.
+  absl::Status Append(absl::string_view payload, uint64_t* offset);
+
+  // Reads `length` bytes starting at `offset` into `payload`.
+  absl::Status Read(uint64_t offset, size_t length, std::string* payload);
+
+ private:
+  ChunkSpillFile(std::unique_ptr<tensorflow::WritableFile> writer,
+                 std::unique_ptr<tensorflow::RandomAccessFile> reader);
+
+  absl::Mutex mu_;
+  std::unique_ptr<tensorflow::WritableFile> writer_ ABSL_GUARDED_BY(mu_);
+  uint64_t size_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Reads are positional and thus need no synchronization.
+  std::unique_ptr<tensorflow::RandomAccessFile> reader_;
+};
+
+// Defined after `ChunkStore`; declared here so chunks can hold a reference.
+class UnpackedChunkCache;
+
+}  // namespace internal
 
 // Maintains a bijection from chunk keys to Chunks. For inserting, the caller
 // passes ChunkData which contains a chunk key and the actual data. We use the
@@ -68,19 +117,79 @@ namespace reverb {
 // Insert() returns a shared pointer, as otherwise the Chunk would be destroyed
 // right away.
 //
+// The key space is sharded over a fixed number of lock stripes so that
+// concurrent inserts and lookups from many streams contend on a single mutex
+// only when their keys hash to the same stripe.
+//
+// The store can optionally maintain a spill tier (see `Options`) for tables
+// larger than RAM. Chunks that have not been inserted or fetched recently
+// have their payloads written to a spill file and released from memory; the
+// payload is read back the next time the chunk is accessed. Chunk metadata
+// and the lifetime scheme described above are unaffected by spilling.
+//
 // All public methods are thread safe.
 class ChunkStore {
  public:
   using Key = uint64_t;
 
-  class Chunk {
+  struct Options {
+    // If true then `Insert` fingerprints the chunk content and, when a live
+    // chunk with identical content already exists, aliases the new key to the
+    // existing chunk instead of storing a duplicate. See `Insert` for details.
+    //
+    // A deduplicating store must NOT back a `Table`: an aliased chunk keeps
+    // the key of the original chunk, while `Table` insert validation requires
+    // every chunk key referenced by an item's trajectory to equal the
+    // `key()` of the corresponding chunk, so items built around the inserted
+    // key are rejected with an InvalidArgument error. Callers that still want
+    // both must rewrite the trajectory chunk keys to `chunk->key()` before
+    // constructing the table item.
+    bool deduplicate_by_content = false;
+
+    // When non empty, the payloads of cold chunks (chunks that have not been
+    // inserted or fetched recently) are spilled to a file in this directory
+    // once the combined size of the in-memory payloads exceeds
+    // `max_hot_bytes`. Spilled payloads are transparently read back when the
+    // chunk is accessed again. The directory is created if it does not exist
+    // and any existing spill file in it is truncated.
+    std::string spill_directory;
+
+    // Soft limit on the combined byte size of in-memory chunk payloads. Only
+    // used when `spill_directory` is set. The most recently accessed chunks
+    // are kept in memory so sampling distributions with strong recency bias
+    // rarely touch the spill file.
+    size_t max_hot_bytes = 0;
+  };
+
+  explicit ChunkStore(Options options);
+
+  // Convenience overload; equivalent to `ChunkStore(Options{...})` without a
+  // spill tier.
+  explicit ChunkStore(bool deduplicate_by_content = false);
+
+  class Chunk : public std::enable_shared_from_this<Chunk> {
    public:
     explicit Chunk(ChunkData data);
 
+    // Constructs a chunk that references `data` owned by `arena`. The chunk
+    // shares ownership of the arena, which is freed once the last chunk
+    // referencing it goes away. This allows data to be served straight out of
+    // the buffer an incoming request was parsed into, without copying the
+    // payload. `data` must be allocated on `arena`. Note that the parse that
+    // fills the arena still copies the payload out of the network buffers;
+    // see the `request_arena_` comment in reverb_server_reactor.h for why
+    // that copy cannot currently be avoided.
+    Chunk(ChunkData* data, std::shared_ptr<google::protobuf::Arena> arena);
+
     // Unique identifier of the chunk.
     uint64_t key() const;
 
-    // Returns the proto data of the chunk.
+    // Returns the proto data of the chunk. If the payload has been spilled to
+    // disk then it is first faulted back in. Note that when spilling is
+    // enabled the payload read through a previously returned reference may be
+    // released once the chunk turns cold, so callers should extract the data
+    // they need rather than hold on to the reference across other store
+    // operations.
     const ChunkData& data() const;
 
     // (Potentially cached) size of `data`.
@@ -96,37 +205,294 @@ class ChunkStore {
     // Number of tensors in each step.
     int num_columns() const;
 
+    // Alias for `data().data_uncompressed_size()`: the bytes the chunk
+    // occupies once unpacked, or 0 for chunks written before the field
+    // existed. Metadata only; never faults in a spilled payload.
+    int64_t uncompressed_byte_size() const;
+
+    // True if the payload currently resides on disk.
+    bool spilled() const;
+
+    // Pins the payload in memory; the payload is faulted back in if it had
+    // been spilled and will not be spilled again until every pin has been
+    // released with `UnpinPayload`. This keeps zero-copy references obtained
+    // through `data()` (e.g. chunks attached to queued sample responses so
+    // that an immutable chunk is serialized straight from its single
+    // in-memory copy) valid for as long as the pin is held. Noop for chunks
+    // owned by a store without a spill tier.
+    void PinPayload();
+    void UnpinPayload();
+
+    // Attaches `cache` so that decompressed columns handed to
+    // `CacheUnpackedColumns` are kept on the chunk under the cache's byte
+    // budget. Called by tables with an uncompressed chunk cache (see
+    // `Table::EnableUncompressedChunkCache`) when an item referencing the
+    // chunk is inserted; for chunks shared between tables the first attached
+    // cache wins. Safe to call while the chunk is shared between threads.
+    void EnableUnpackedCaching(
+        std::shared_ptr<internal::UnpackedChunkCache> cache);
+
+    // True once a cache has been attached with `EnableUnpackedCaching`.
+    bool unpacked_cache_enabled() const;
+
+    // True while the decompressed columns are resident on the chunk.
+    bool unpacked_cached() const;
+
+    // Serves the decompressed tensor of `column` from the cache, touching the
+    // chunk to the hot end of the cache's LRU. Returns false when the columns
+    // are not currently resident; the caller should then decompress the chunk
+    // (see `internal::WarmUnpackedColumnCache`).
+    bool GetCachedColumn(int column, tensorflow::Tensor* out);
+
+    // Admits the decompressed `columns` of this chunk to the attached cache.
+    // Noop when no cache is attached or the columns are already resident. May
+    // synchronously demote the coldest cached chunks if the cache exceeds its
+    // budget afterwards.
+    void CacheUnpackedColumns(std::vector<tensorflow::Tensor> columns);
+
+    // Releases the cached decompressed columns, returning the chunk to
+    // compressed-only form. Called by the cache when the chunk is demoted.
+    void ReleaseUnpackedColumns();
+
    private:
-    ChunkData data_;
+    friend class ChunkStore;
+
+    // Constructs a chunk whose payload resides in `payload_file` and is only
+    // read once `data()` is first accessed. `metadata` must be the chunk's
+    // ChunkData with the payload cleared. Used by `ChunkStore::InsertLazy`.
+    Chunk(ChunkData metadata,
+          std::shared_ptr<internal::ChunkSpillFile> payload_file,
+          uint64_t payload_offset, size_t payload_length,
+          size_t full_byte_size);
+
+    // Called by the store before the chunk is shared with other threads when
+    // the store was created with a spill directory.
+    void EnableSpilling(std::shared_ptr<internal::ChunkSpillFile> file);
+
+    // Writes the payload to the spill file (unless an earlier spill already
+    // did) and releases the in-memory copy. Noop if already spilled. Returns
+    // `FailedPreconditionError` without releasing anything if the payload is
+    // pinned. Must not be called while another thread may be reading the
+    // payload.
+    absl::Status Spill();
+
+    // Reads the payload back from the spill file.
+    absl::Status FaultInLocked() const
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(payload_mu_);
+
+    // Backing storage when the chunk was constructed from a ChunkData value.
+    // Unused when the chunk references arena-owned data.
+    mutable ChunkData storage_;
+
+    // Points at `storage_` or at the arena-owned message. Only the payload
+    // (`data_->data()`) is ever released by `Spill`; all other fields stay
+    // resident so that the metadata accessors above never touch the spill
+    // file.
+    ChunkData* const data_;
+
+    // Keeps the arena of an arena-owned chunk alive. Null when the chunk is
+    // backed by `storage_`.
+    std::shared_ptr<google::protobuf::Arena> arena_;
+
     mutable size_t data_byte_size_;
     mutable absl::once_flag data_byte_size_once_;
+
+    // Null unless the owning store has a spill tier.
+    std::shared_ptr<internal::ChunkSpillFile> spill_file_;
+
+    // Serialized size of the payload. Set by `EnableSpilling`.
+    size_t payload_length_ = 0;
+
+    mutable absl::Mutex payload_mu_;
+    mutable bool payload_spilled_ ABSL_GUARDED_BY(payload_mu_) = false;
+
+    // Number of outstanding `PinPayload` calls. `Spill` refuses to release
+    // the payload while it is non zero.
+    int64_t payload_pins_ ABSL_GUARDED_BY(payload_mu_) = 0;
+
+    // Position of the payload within the spill file. Valid once
+    // `payload_on_disk_` is true; the payload is immutable so the region
+    // written by the first spill is reused by all later ones.
+    mutable bool payload_on_disk_ ABSL_GUARDED_BY(payload_mu_) = false;
+    mutable uint64_t payload_offset_ ABSL_GUARDED_BY(payload_mu_) = 0;
+
+    mutable absl::Mutex unpacked_mu_;
+
+    // Cache attached by `EnableUnpackedCaching`. Guarded since it is attached
+    // while the chunk may already be shared between threads.
+    std::shared_ptr<internal::UnpackedChunkCache> unpacked_cache_
+        ABSL_GUARDED_BY(unpacked_mu_);
+
+    // Decompressed tensors of all columns, and their combined byte size,
+    // while the chunk is resident in `unpacked_cache_`. Empty otherwise.
+    std::vector<tensorflow::Tensor> unpacked_columns_
+        ABSL_GUARDED_BY(unpacked_mu_);
+    size_t unpacked_bytes_ ABSL_GUARDED_BY(unpacked_mu_) = 0;
   };
 
   // Attempts to insert a Chunk into the map using the key inside `item`. If no
   // entry existed for the key, a new Chunk is created, inserted and returned.
-  // Otherwise, the existing chunk is returned.
-  std::shared_ptr<Chunk> Insert(ChunkData item) ABSL_LOCKS_EXCLUDED(mu_);
+  // Otherwise, the existing chunk is returned. Only locks the stripe that the
+  // key belongs to.
+  //
+  // When constructed with `deduplicate_by_content` and a live chunk with the
+  // same content fingerprint (and payload size) already exists, the existing
+  // chunk is registered under the new key and returned. Note that in this case
+  // the key of the returned chunk differs from `item.chunk_key()`; callers
+  // that forward the chunk key (e.g. in item trajectories) must use
+  // `chunk->key()` rather than the key they inserted with. In particular
+  // `Table` insert validation rejects items whose trajectory keys don't match
+  // the chunk keys; see the caveat on `Options::deduplicate_by_content`.
+  std::shared_ptr<Chunk> Insert(ChunkData item);
+
+  // Inserts a chunk whose payload resides at `payload_offset` of
+  // `payload_file` (e.g. the payloads file of a lazy checkpoint) without
+  // reading it. `metadata` must be the chunk's ChunkData with the payload
+  // (`data`) cleared and `full_byte_size` the byte size of the full proto.
+  // The payload is faulted in the first time `Chunk::data()` is accessed, so
+  // restoring a large store is bound by its metadata size rather than its
+  // payload size. The file must outlive every access to the returned chunk.
+  std::shared_ptr<Chunk> InsertLazy(
+      ChunkData metadata, std::shared_ptr<internal::ChunkSpillFile> payload_file,
+      uint64_t payload_offset, size_t payload_length, size_t full_byte_size);
 
   // Gets the Chunk for each given key. Returns an error if one of the items
   // does not exist or if `Close` has been called. On success, the returned
-  // items are in the same order as given in `keys`.
+  // items are in the same order as given in `keys`. Keys are grouped by lock
+  // stripe so each stripe's mutex is acquired at most once per call.
   tensorflow::Status Get(absl::Span<const Key> keys,
-                         std::vector<std::shared_ptr<Chunk>>* chunks)
-      ABSL_LOCKS_EXCLUDED(mu_);
+                         std::vector<std::shared_ptr<Chunk>>* chunks);
 
  private:
-  // Gets an item. Returns nullptr if the item does not exist.
-  std::shared_ptr<Chunk> GetItem(Key key) ABSL_SHARED_LOCKS_REQUIRED(mu_);
+  // Number of lock stripes the key space is sharded over. Must be a power of
+  // two.
+  static constexpr size_t kNumLockStripes = 64;
+
+  // A stripe holds the chunks whose keys hash to it. We only hold a weak
+  // pointer to the Chunk, which means that destruction and reference counting
+  // of the chunks happens independently of this map.
+  struct Stripe {
+    mutable absl::Mutex mu;
+    internal::flat_hash_map<Key, std::weak_ptr<Chunk>> data
+        ABSL_GUARDED_BY(mu);
+  };
 
-  // Holds the actual mapping of key to Chunk. We only hold a weak pointer to
-  // the Chunk, which means that destruction and reference counting of the
-  // chunks happens independently of this map.
-  internal::flat_hash_map<Key, std::weak_ptr<Chunk>> data_ ABSL_GUARDED_BY(mu_);
+  // A content fingerprint mapped to the live chunk that carries the content.
+  // The payload size is kept next to the weak pointer so that a (very
+  // unlikely) fingerprint collision at least requires matching sizes before a
+  // chunk is reused.
+  struct DedupEntry {
+    size_t payload_size;
+    std::weak_ptr<Chunk> chunk;
+  };
+
+  // The fingerprint space is sharded over the same number of lock stripes as
+  // the key space.
+  struct DedupStripe {
+    mutable absl::Mutex mu;
+    internal::flat_hash_map<uint64_t, DedupEntry> data ABSL_GUARDED_BY(mu);
+  };
+
+  // A member of the hot set, i.e. a chunk whose payload is resident in
+  // memory. The key and payload size are kept next to the weak pointer so
+  // that the entry can be unlinked even after the chunk has been destroyed.
+  struct HotChunk {
+    Key key;
+    std::weak_ptr<Chunk> chunk;
+    size_t payload_bytes;
+  };
+
+  // State of the spill tier. Only allocated when the store was created with a
+  // spill directory.
+  struct SpillTier {
+    std::shared_ptr<internal::ChunkSpillFile> file;
+    size_t max_hot_bytes;
+
+    absl::Mutex mu;
+
+    // Hot chunks in least recently used order (most recently used at the
+    // back), with an index from chunk key to LRU position.
+    std::list<HotChunk> lru ABSL_GUARDED_BY(mu);
+    internal::flat_hash_map<Key, std::list<HotChunk>::iterator> index
+        ABSL_GUARDED_BY(mu);
+
+    // Combined payload size of the chunks in `lru`. Approximate in that
+    // destroyed chunks contribute until their entry is trimmed.
+    size_t hot_bytes ABSL_GUARDED_BY(mu) = 0;
+  };
 
-  // Mutex protecting access to `data_`.
-  mutable absl::Mutex mu_;
+  // Moves `chunk` to the hot end of the LRU, faulting its payload back in and
+  // re-admitting it to the hot set if it had been spilled. Spills the coldest
+  // chunks if the hot set exceeds the budget afterwards. Must only be called
+  // when `spill_` is set.
+  void TouchChunk(const std::shared_ptr<Chunk>& chunk);
+
+  // Spills chunks from the cold end of the LRU until the hot set is back
+  // under `max_hot_bytes`. The most recently used chunk is never spilled.
+  void TrimHotSetLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(spill_->mu);
+
+  static size_t StripeIndex(Key key) { return key % kNumLockStripes; }
+
+  const bool deduplicate_by_content_;
+
+  std::array<Stripe, kNumLockStripes> stripes_;
+  std::array<DedupStripe, kNumLockStripes> dedup_stripes_;
+
+  std::unique_ptr<SpillTier> spill_;
 };
 
+namespace internal {
+
+// Byte budgeted LRU registry of the chunks whose decompressed columns are
+// currently resident (see `ChunkStore::Chunk::CacheUnpackedColumns`). Owned
+// by the table that enabled uncompressed chunk caching and shared with the
+// chunks of its items, since a chunk may outlive the table through in-flight
+// samples. Demoting a chunk only drops the cached tensors; the compressed
+// payload is always kept, so demotion never loses data.
+//
+// Thread safe.
+class UnpackedChunkCache {
+ public:
+  explicit UnpackedChunkCache(size_t max_bytes);
+
+  // Moves `chunk` to the hot end of the LRU, admitting it (with `bytes` of
+  // cached columns) if it is not currently a member, and then demotes chunks
+  // from the cold end while the combined size of the cached columns exceeds
+  // the budget.
+  void Touch(const std::shared_ptr<ChunkStore::Chunk>& chunk, size_t bytes);
+
+ private:
+  // A chunk with resident decompressed columns. The key and byte size are
+  // kept next to the weak pointer so that the entry can be unlinked even
+  // after the chunk has been destroyed.
+  struct CachedChunk {
+    ChunkStore::Key key;
+    std::weak_ptr<ChunkStore::Chunk> chunk;
+    size_t bytes;
+  };
+
+  // Drops cached columns from the cold end of the LRU until the cache is
+  // back under `max_bytes_`. The most recently touched chunk is never
+  // demoted so that a single chunk larger than the whole budget can still be
+  // served from the cache.
+  void TrimLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const size_t max_bytes_;
+
+  absl::Mutex mu_;
+
+  // Cached chunks in least recently used order (most recently used at the
+  // back), with an index from chunk key to LRU position. Approximate in that
+  // destroyed chunks contribute to `cached_bytes_` until their entry is
+  // trimmed.
+  std::list<CachedChunk> lru_ ABSL_GUARDED_BY(mu_);
+  flat_hash_map<ChunkStore::Key, std::list<CachedChunk>::iterator> index_
+      ABSL_GUARDED_BY(mu_);
+  size_t cached_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace internal
+
 }  // namespace reverb
 }  // namespace deepmind
 
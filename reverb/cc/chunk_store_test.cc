@@ -15,14 +15,20 @@
 #include "reverb/cc/chunk_store.h"
 
 #include <atomic>
+#include <cstdlib>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/arena.h"
 #include "reverb/cc/platform/thread.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/testing/proto_test_util.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 
@@ -80,6 +86,186 @@ TEST(ChunkStoreTest, InsertingTwiceSucceedsWhenChunkIsDestroyed) {
   EXPECT_NE(second, nullptr);
 }
 
+TEST(ChunkStoreTest, GetPreservesKeyOrderAcrossStripes) {
+  ChunkStore store;
+  std::vector<ChunkStore::Key> keys;
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> inserted;
+  // Spread the keys over (and wrap around) the lock stripes and request them
+  // in an order that interleaves stripes.
+  for (ChunkStore::Key i = 0; i < 200; i++) {
+    const ChunkStore::Key key = i * 37;
+    keys.push_back(key);
+    inserted.push_back(store.Insert(testing::MakeChunkData(key)));
+  }
+  ChunkVector chunks;
+  TF_ASSERT_OK(store.Get(keys, &chunks));
+  ASSERT_EQ(chunks.size(), keys.size());
+  for (int i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(chunks[i], inserted[i]);
+  }
+}
+
+TEST(ChunkStoreTest, DeduplicatesIdenticalContent) {
+  ChunkStore store(/*deduplicate_by_content=*/true);
+  const SequenceRange range = testing::MakeSequenceRange(100, 0, 1);
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1, range));
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2, range));
+
+  // The content only differs in the chunk key so the second insert must alias
+  // the first chunk.
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(second->key(), 1);
+
+  // Both keys must resolve to the shared chunk.
+  ChunkVector chunks;
+  TF_ASSERT_OK(store.Get({1, 2}, &chunks));
+  EXPECT_EQ(chunks[0], first);
+  EXPECT_EQ(chunks[1], first);
+}
+
+TEST(ChunkStoreTest, DoesNotDeduplicateDifferentContent) {
+  ChunkStore store(/*deduplicate_by_content=*/true);
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1));
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2));
+  EXPECT_NE(first, second);
+  EXPECT_EQ(second->key(), 2);
+}
+
+TEST(ChunkStoreTest, DoesNotDeduplicateExpiredChunks) {
+  ChunkStore store(/*deduplicate_by_content=*/true);
+  const SequenceRange range = testing::MakeSequenceRange(100, 0, 1);
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1, range));
+  first = nullptr;
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2, range));
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(second->key(), 2);
+}
+
+TEST(ChunkStoreTest, DeduplicationIsOffByDefault) {
+  ChunkStore store;
+  const SequenceRange range = testing::MakeSequenceRange(100, 0, 1);
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1, range));
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2, range));
+  EXPECT_NE(first, second);
+}
+
+ChunkStore::Options MakeSpillOptions(absl::string_view test_name,
+                                     size_t max_hot_bytes) {
+  ChunkStore::Options options;
+  options.spill_directory =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/chunk_store_", test_name);
+  options.max_hot_bytes = max_hot_bytes;
+  return options;
+}
+
+TEST(ChunkStoreTest, SpillsColdChunksAndFaultsThemBackIn) {
+  // A budget of a single byte forces everything but the most recently used
+  // chunk out of memory.
+  ChunkStore store(MakeSpillOptions("spill", 1));
+  const ChunkData original = testing::MakeChunkData(1);
+  std::shared_ptr<ChunkStore::Chunk> first = store.Insert(original);
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2));
+  EXPECT_TRUE(first->spilled());
+  EXPECT_FALSE(second->spilled());
+
+  // Metadata accessors must not touch the spill file.
+  EXPECT_EQ(first->num_rows(), 2);
+  EXPECT_EQ(first->episode_id(), 100);
+  EXPECT_TRUE(first->spilled());
+
+  // Accessing the data faults the payload back in, byte for byte.
+  EXPECT_EQ(first->data().data().SerializeAsString(),
+            original.data().SerializeAsString());
+  EXPECT_FALSE(first->spilled());
+}
+
+TEST(ChunkStoreTest, GetMovesChunkBackIntoHotSet) {
+  ChunkStore store(MakeSpillOptions("get_rehydrates", 1));
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1));
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2));
+  ASSERT_TRUE(first->spilled());
+
+  // Fetching the first chunk makes it the most recently used one and pushes
+  // the second chunk out instead.
+  ChunkVector chunks;
+  TF_ASSERT_OK(store.Get({1}, &chunks));
+  EXPECT_FALSE(first->spilled());
+  EXPECT_TRUE(second->spilled());
+}
+
+TEST(ChunkStoreTest, SpillsChunkAgainAfterItTurnsCold) {
+  ChunkStore store(MakeSpillOptions("respill", 1));
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1));
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2));
+
+  ChunkVector chunks;
+  for (int i = 0; i < 3; i++) {
+    TF_ASSERT_OK(store.Get({1}, &chunks));
+    EXPECT_FALSE(first->spilled());
+    EXPECT_TRUE(second->spilled());
+    TF_ASSERT_OK(store.Get({2}, &chunks));
+    EXPECT_TRUE(first->spilled());
+    EXPECT_FALSE(second->spilled());
+  }
+}
+
+TEST(ChunkStoreTest, PinnedChunkIsNotSpilled) {
+  ChunkStore store(MakeSpillOptions("pinned", 1));
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1));
+  first->PinPayload();
+
+  // Even though the first chunk is the coldest one, the pin keeps its payload
+  // in memory while later inserts push the hot set over budget.
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2));
+  std::shared_ptr<ChunkStore::Chunk> third =
+      store.Insert(testing::MakeChunkData(3));
+  EXPECT_FALSE(first->spilled());
+  EXPECT_TRUE(second->spilled());
+
+  // Once the pin is released the chunk can be spilled again.
+  first->UnpinPayload();
+  store.Insert(testing::MakeChunkData(4));
+  EXPECT_TRUE(first->spilled());
+}
+
+TEST(ChunkStoreTest, PinFaultsSpilledPayloadBackIn) {
+  ChunkStore store(MakeSpillOptions("pin_faults_in", 1));
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1));
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2));
+  ASSERT_TRUE(first->spilled());
+
+  first->PinPayload();
+  EXPECT_FALSE(first->spilled());
+  first->UnpinPayload();
+}
+
+TEST(ChunkStoreTest, SpillingIsOffByDefault) {
+  ChunkStore store;
+  std::shared_ptr<ChunkStore::Chunk> first =
+      store.Insert(testing::MakeChunkData(1));
+  std::shared_ptr<ChunkStore::Chunk> second =
+      store.Insert(testing::MakeChunkData(2));
+  EXPECT_FALSE(first->spilled());
+  EXPECT_FALSE(second->spilled());
+}
+
 TEST(ChunkStoreTest, ConcurrentCalls) {
   ChunkStore store;
   std::vector<std::unique_ptr<internal::Thread>> bundle;
@@ -100,6 +286,48 @@ TEST(ChunkStoreTest, ConcurrentCalls) {
   EXPECT_EQ(count, 1000);
 }
 
+TEST(ChunkTest, ArenaOwnedChunkKeepsArenaAlive) {
+  auto arena = std::make_shared<google::protobuf::Arena>();
+  auto* data = google::protobuf::Arena::CreateMessage<ChunkData>(arena.get());
+  *data = testing::MakeChunkData(5);
+
+  auto chunk = std::make_shared<ChunkStore::Chunk>(data, arena);
+  EXPECT_EQ(chunk->key(), 5);
+  EXPECT_EQ(chunk->num_rows(), 2);
+  EXPECT_EQ(&chunk->data(), data);
+
+  // The chunk must hold on to the arena that owns its data.
+  EXPECT_EQ(arena.use_count(), 2);
+  chunk = nullptr;
+  EXPECT_EQ(arena.use_count(), 1);
+}
+
+TEST(ChunkTest, UnpackedColumnCacheServesAndDemotes) {
+  auto cache = std::make_shared<internal::UnpackedChunkCache>(/*max_bytes=*/100);
+  auto first = std::make_shared<ChunkStore::Chunk>(testing::MakeChunkData(1));
+  auto second = std::make_shared<ChunkStore::Chunk>(testing::MakeChunkData(2));
+  first->EnableUnpackedCaching(cache);
+  second->EnableUnpackedCaching(cache);
+
+  tensorflow::Tensor column;
+  EXPECT_FALSE(first->GetCachedColumn(0, &column));
+
+  // A DT_INT32 tensor of 20 elements occupies 80 of the 100 budgeted bytes.
+  tensorflow::Tensor t(tensorflow::DT_INT32, {2, 10});
+  t.flat<int32_t>().setConstant(1);
+  first->CacheUnpackedColumns({t});
+  EXPECT_TRUE(first->unpacked_cached());
+  ASSERT_TRUE(first->GetCachedColumn(0, &column));
+  EXPECT_EQ(column.NumElements(), 20);
+
+  // Admitting the second chunk exceeds the budget, demoting the first back
+  // to compressed-only form.
+  second->CacheUnpackedColumns({t});
+  EXPECT_TRUE(second->unpacked_cached());
+  EXPECT_FALSE(first->unpacked_cached());
+  EXPECT_FALSE(first->GetCachedColumn(0, &column));
+}
+
 TEST(ChunkTest, Length) {
   ChunkData data;
   data.mutable_sequence_range()->set_start(5);
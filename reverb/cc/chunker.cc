@@ -15,6 +15,7 @@
 #include "reverb/cc/chunker.h"
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <memory>
 #include <numeric>
@@ -41,16 +42,26 @@ namespace reverb {
 namespace {
 
 int GetLength(const ChunkData& chunk) {
+  // Bit-packed columns store a flat tensor of packed words; the row count is
+  // recorded with the packing instead.
+  if (chunk.bit_packings_size() > 0 &&
+      !chunk.bit_packings(0).dictionary().empty()) {
+    return chunk.bit_packings(0).original_shape().dim(0).size();
+  }
   return chunk.data().tensors(0).tensor_shape().dim(0).size();
 }
 
+// Number of `CellRef` slots allocated at once. See `Chunker::CellRefBlock`.
+constexpr int kCellRefBlockCapacity = 64;
+
 }  // namespace
 
 CellRef::CellRef(std::weak_ptr<Chunker> chunker, uint64_t chunk_key, int offset,
-                 CellRef::EpisodeInfo episode_info)
+                 CellRef::EpisodeInfo episode_info, int chunk_column)
     : chunker_(std::move(chunker)),
       chunk_key_(chunk_key),
       offset_(offset),
+      chunk_column_(chunk_column),
       episode_info_(episode_info),
       chunk_(nullptr) {}
 
@@ -58,6 +69,8 @@ uint64_t CellRef::chunk_key() const { return chunk_key_; }
 
 int CellRef::offset() const { return offset_; }
 
+int CellRef::chunk_column() const { return chunk_column_; }
+
 bool CellRef::IsReady() const {
   absl::MutexLock lock(&mu_);
   return chunk_ != nullptr;
@@ -94,78 +107,117 @@ absl::Status CellRef::GetSpec(internal::TensorSpec* spec) const {
     return absl::InternalError(
         "Chunk not finalized and parent Chunker destroyed.");
   }
-  *spec = chunker_sp->spec();
+  *spec = chunker_sp->spec(chunk_column_);
   return absl::OkStatus();
 }
 
 Chunker::Chunker(internal::TensorSpec spec,
                  std::shared_ptr<ChunkerOptions> options)
-    : spec_(std::move(spec)),
+    : Chunker(std::vector<internal::TensorSpec>{std::move(spec)},
+              std::move(options)) {}
+
+Chunker::Chunker(std::vector<internal::TensorSpec> specs,
+                 std::shared_ptr<ChunkerOptions> options)
+    : specs_(std::move(specs)),
       options_(std::move(options)),
-      key_generator_(absl::make_unique<internal::UniformKeyGenerator>()) {
+      key_generator_(absl::make_unique<internal::ShardedKeyGenerator>()) {
+  REVERB_CHECK(!specs_.empty());
   REVERB_CHECK_GE(options_->GetNumKeepAliveRefs(),
                   options_->GetMaxChunkLength());
+  column_kernels_.reserve(specs_.size());
+  for (const internal::TensorSpec& spec : specs_) {
+    column_kernels_.push_back(&GetDeltaEncodingKernels(spec.dtype));
+  }
   Reset();
 }
 
-absl::Status Chunker::Append(const tensorflow::Tensor& tensor,
+absl::Status Chunker::Append(tensorflow::Tensor tensor,
                              const CellRef::EpisodeInfo& episode_info,
                              std::weak_ptr<CellRef>* ref) {
-  if (tensor.dtype() != spec_.dtype) {
-    return absl::InvalidArgumentError(absl::StrCat(
-        "Tensor of wrong dtype provided for column ", spec_.name, ". Got ",
-        tensorflow::DataTypeString(tensor.dtype()), " but expected ",
-        tensorflow::DataTypeString(spec_.dtype), "."));
-  }
-  if (!spec_.shape.IsCompatibleWith(tensor.shape())) {
+  REVERB_CHECK_EQ(specs_.size(), 1)
+      << "Chunker::Append called on a multi column chunker.";
+  std::vector<tensorflow::Tensor> tensors;
+  tensors.push_back(std::move(tensor));
+  std::vector<std::weak_ptr<CellRef>> refs;
+  REVERB_RETURN_IF_ERROR(AppendColumns(std::move(tensors), episode_info, &refs));
+  *ref = std::move(refs[0]);
+  return absl::OkStatus();
+}
+
+absl::Status Chunker::AppendColumns(std::vector<tensorflow::Tensor> tensors,
+                                    const CellRef::EpisodeInfo& episode_info,
+                                    std::vector<std::weak_ptr<CellRef>>* refs) {
+  if (tensors.size() != specs_.size()) {
     return absl::InvalidArgumentError(absl::StrCat(
-        "Tensor of incompatible shape provided for column ", spec_.name,
-        ". Got ", tensor.shape().DebugString(), " which is incompatible with ",
-        spec_.shape.DebugString(), "."));
+        "Chunker::AppendColumns called with ", tensors.size(),
+        " tensors but the chunker holds ", specs_.size(), " columns."));
+  }
+  for (int i = 0; i < tensors.size(); i++) {
+    if (tensors[i].dtype() != specs_[i].dtype) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Tensor of wrong dtype provided for column ", specs_[i].name,
+          ". Got ", tensorflow::DataTypeString(tensors[i].dtype()),
+          " but expected ", tensorflow::DataTypeString(specs_[i].dtype), "."));
+    }
+    if (!specs_[i].shape.IsCompatibleWith(tensors[i].shape())) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Tensor of incompatible shape provided for column ", specs_[i].name,
+          ". Got ", tensors[i].shape().DebugString(),
+          " which is incompatible with ", specs_[i].shape.DebugString(), "."));
+    }
   }
 
   absl::MutexLock lock(&mu_);
 
-  if (!buffer_.empty() &&
+  if (!buffer_[0].empty() &&
       active_refs_.back()->episode_id() != episode_info.episode_id) {
     return absl::FailedPreconditionError(
         "Chunker::Append called with new episode when buffer non empty.");
   }
-  if (!buffer_.empty() &&
+  if (!buffer_[0].empty() &&
       active_refs_.back()->episode_step() >= episode_info.step) {
     return absl::FailedPreconditionError(
         "Chunker::Append called with an episode step which was not greater "
         "than already observed.");
   }
 
-  active_refs_.push_back(
-      std::make_shared<CellRef>(std::weak_ptr<Chunker>(shared_from_this()),
-                                next_chunk_key_, offset_++, episode_info));
-
-  // Add a batch dim to the tensor before adding it to the buffer. This will
-  // prepare it for the concat op when the chunk is finalized.
-  tensorflow::TensorShape shape = tensor.shape();
-  shape.InsertDim(0, 1);
-
-  // This should never fail due to dtype or shape differences, because the dtype
-  // of tensors[j] is UNKNOWN and `shape` has the same number of elements as
-  // `item`.
-  tensorflow::Tensor batched_tensor(tensor.dtype(), shape);
-  REVERB_CHECK(batched_tensor.CopyFrom(tensor, shape));
-  buffer_.push_back(std::move(batched_tensor));
+  const int offset = offset_++;
+  refs->clear();
+  for (int i = 0; i < tensors.size(); i++) {
+    if (cell_ref_block_ == nullptr ||
+        cell_ref_block_->size == kCellRefBlockCapacity) {
+      cell_ref_block_ = std::make_shared<CellRefBlock>(kCellRefBlockCapacity);
+    }
+    absl::optional<CellRef>& slot =
+        cell_ref_block_->cells[cell_ref_block_->size++];
+    slot.emplace(weak_from_this(), next_chunk_key_, offset, episode_info,
+                 /*chunk_column=*/i);
+    active_refs_.push_back(std::shared_ptr<CellRef>(cell_ref_block_, &*slot));
+    refs->push_back(active_refs_.back());
+
+    // Add a batch dim to the tensor before adding it to the buffer. This will
+    // prepare it for the concat op when the chunk is finalized. `CopyFrom`
+    // only reshapes; the buffer of the tensor is shared, not copied, so no
+    // data is duplicated until the chunk is finalized.
+    tensorflow::TensorShape shape = tensors[i].shape();
+    shape.InsertDim(0, 1);
+    tensorflow::Tensor batched_tensor;
+    REVERB_CHECK(batched_tensor.CopyFrom(tensors[i], shape));
+    buffer_[i].push_back(std::move(batched_tensor));
+  }
 
   // Create the chunk if max buffer size reached.
-  if (buffer_.size() >= options_->GetMaxChunkLength()) {
+  if (buffer_[0].size() >= options_->GetMaxChunkLength()) {
     REVERB_RETURN_IF_ERROR(FlushLocked());
   }
 
-  // Delete references which which have exceeded their max age.
-  while (active_refs_.size() > options_->GetNumKeepAliveRefs()) {
+  // Delete references which which have exceeded their max age. References are
+  // trimmed in whole rows so all columns of a row expire together.
+  while (active_refs_.size() >
+         options_->GetNumKeepAliveRefs() * specs_.size()) {
     active_refs_.pop_front();
   }
 
-  *ref = active_refs_.back();
-
   return absl::OkStatus();
 }
 
@@ -186,28 +238,26 @@ absl::Status Chunker::Flush() {
 }
 
 absl::Status Chunker::FlushLocked() {
-  if (buffer_.empty()) return absl::OkStatus();
-
-  auto chunk = absl::make_unique<ChunkData>();
+  REVERB_RETURN_IF_ERROR(async_status_);
+  if (buffer_[0].empty()) return absl::OkStatus();
+
+  auto pending = std::make_shared<PendingChunk>();
+  pending->chunk = absl::make_unique<ChunkData>();
+  pending->delta_encode = options_->GetDeltaEncode();
+  pending->codec = options_->GetCompressionCodec();
+  pending->lossy_compression = options_->GetLossyCompression();
+  pending->bit_pack = options_->GetBitPack();
+  ChunkData* chunk = pending->chunk.get();
   chunk->set_chunk_key(next_chunk_key_);
 
-  tensorflow::Tensor batched;
-  REVERB_RETURN_IF_ERROR(
-      FromTensorflowStatus(tensorflow::tensor::Concat(buffer_, &batched)));
-
-  if (options_->GetDeltaEncode()) {
-    batched = DeltaEncode(batched, /*encode=*/true);
-    chunk->set_delta_encoded(true);
-  }
-
-  CompressTensorAsProto(batched, chunk->mutable_data()->add_tensors());
-  chunk->set_data_tensors_len(chunk->data().tensors_size());
-
-  // Set the sequence range of the chunk.
+  // Set the sequence range of the chunk. Only the first column is considered
+  // since all columns of a row share the episode step.
   for (const auto& ref : active_refs_) {
     // active_refs_ is sorted by insertion time. Iterate over the list until
     // the first cell belonging to the newly created chunk is found.
-    if (ref->chunk_key() != chunk->chunk_key()) continue;
+    if (ref->chunk_key() != chunk->chunk_key() || ref->chunk_column() != 0) {
+      continue;
+    }
 
     if (!chunk->has_sequence_range()) {
       // On the first ref belonging to this chunk, set the the episode ID and
@@ -247,36 +297,223 @@ absl::Status Chunker::FlushLocked() {
     }
   }
 
-  // Now the chunk has been finalized we can notify the `CellRef`s.
-  auto chunk_container = std::make_shared<ChunkDataContainer>(std::move(chunk));
+  // Collect the `CellRef`s to notify once the chunk content is complete.
   for (std::shared_ptr<CellRef>& ref : active_refs_) {
-    if (ref->chunk_key() == chunk_container->chunk->chunk_key()) {
-      ref->SetChunk(chunk_container);
+    if (ref->chunk_key() == chunk->chunk_key()) {
+      pending->refs.push_back(ref);
     }
   }
 
+  // Cross chunk delta encoding needs the last row of the preceding chunk of
+  // the same episode, and that chunk must itself be self contained so the
+  // decode dependency stays one chunk deep. Multi column chunks are always
+  // self contained.
+  pending->cross_chunk_delta =
+      specs_.size() == 1 && options_->GetCrossChunkDelta() &&
+      has_prev_chunk_ && !prev_chunk_cross_delta_ &&
+      prev_chunk_episode_id_ == chunk->sequence_range().episode_id() &&
+      column_kernels_[0]->Transforms(buffer_[0].back());
+  if (pending->cross_chunk_delta) {
+    pending->delta_baseline = prev_chunk_last_row_;
+    pending->delta_baseline_chunk_key = prev_chunk_key_;
+  }
+
+  // Retain the last row so the next chunk can be encoded against it.
+  if (specs_.size() == 1) {
+    prev_chunk_last_row_ = buffer_[0].back();
+    prev_chunk_key_ = chunk->chunk_key();
+    prev_chunk_episode_id_ = chunk->sequence_range().episode_id();
+    prev_chunk_cross_delta_ = pending->cross_chunk_delta;
+    has_prev_chunk_ = true;
+  }
+
+  pending->buffer = std::move(buffer_);
   buffer_.clear();
+  buffer_.resize(specs_.size());
+  for (auto& column_buffer : buffer_) {
+    column_buffer.reserve(options_->GetMaxChunkLength());
+  }
   next_chunk_key_ = key_generator_->Generate();
   offset_ = 0;
 
+  // Without an executor the chunk content is completed (and the `CellRef`s
+  // notified) before returning, exactly as before.
+  if (executor_ == nullptr) {
+    return CompleteChunk(pending.get());
+  }
+
+  // The expensive part (concat, delta encoding, compression) runs on the
+  // executor; rows of the pending chunk remain readable through
+  // `pending_chunks_` until the chunk has materialized.
+  pending_chunks_[chunk->chunk_key()] = pending;
+  executor_->Schedule(
+      [chunker = shared_from_this(), pending]() mutable {
+        chunker->RunPendingChunk(std::move(pending));
+      });
   return absl::OkStatus();
 }
 
+absl::Status Chunker::CompleteChunk(PendingChunk* pending) {
+  ChunkData* chunk = pending->chunk.get();
+  const int num_columns = pending->buffer.size();
+
+  // `lossy_transforms` and `bit_packings` are parallel to `data.tensors` so
+  // when a transform applies to a column with untransformed predecessors the
+  // repeated field is padded with no-op entries (type NONE respectively an
+  // empty dictionary) up to the column.
+  auto pad_lossy_transforms = [chunk](int column) {
+    while (chunk->lossy_transforms_size() < column) {
+      chunk->add_lossy_transforms();
+    }
+  };
+  auto pad_bit_packings = [chunk](int column) {
+    while (chunk->bit_packings_size() < column) {
+      chunk->add_bit_packings();
+    }
+  };
+
+  int64_t uncompressed_size = 0;
+  for (int col = 0; col < num_columns; col++) {
+    tensorflow::Tensor batched;
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        tensorflow::tensor::Concat(pending->buffer[col], &batched)));
+    // Recorded before any transform so the field reflects the bytes the
+    // chunk occupies once unpacked by a reader.
+    uncompressed_size += static_cast<int64_t>(batched.TotalBytes());
+
+    // Bit-packing replaces the column content entirely so the other
+    // transforms are skipped for columns it applies to.
+    bool bit_packed = false;
+    if (pending->bit_pack) {
+      ChunkData::BitPacking packing;
+      tensorflow::Tensor packed;
+      if (BitPackTensor(batched, &packing, &packed)) {
+        pad_bit_packings(col);
+        *chunk->add_bit_packings() = std::move(packing);
+        batched = std::move(packed);
+        bit_packed = true;
+      }
+    }
+    if (!bit_packed && pending->lossy_compression != LOSSY_COMPRESSION_NONE) {
+      ChunkData::LossyTransform transform;
+      batched = LossyCompress(batched, pending->lossy_compression, &transform);
+      if (transform.type() != LOSSY_COMPRESSION_NONE) {
+        pad_lossy_transforms(col);
+        *chunk->add_lossy_transforms() = std::move(transform);
+      }
+    }
+
+    // Delta kernels bound to the dtype of the column at construction; the
+    // dtype dispatch has already been resolved. A lossy transform may have
+    // changed the dtype (e.g float to int8 for the affine transform) in which
+    // case the table of the transformed dtype is looked up instead.
+    const DeltaEncodingKernels* kernels = column_kernels_[col];
+    if (batched.dtype() != specs_[col].dtype) {
+      kernels = &GetDeltaEncodingKernels(batched.dtype());
+    }
+
+    if (num_columns == 1) {
+      // Single column chunks are described by the chunk level fields, exactly
+      // as before the columnar layout existed.
+      if (!bit_packed && (pending->delta_encode || pending->cross_chunk_delta)) {
+        if (kernels->delta_encode != nullptr) {
+          batched = kernels->delta_encode(batched, /*encode=*/true);
+        }
+        chunk->set_delta_encoded(true);
+        if (pending->cross_chunk_delta) {
+          batched = kernels->cross_chunk_delta(batched, pending->delta_baseline,
+                                               /*encode=*/true);
+          chunk->set_delta_baseline_chunk_key(
+              pending->delta_baseline_chunk_key);
+        }
+      }
+      chunk->set_codec(CompressTensorAsProto(
+          batched, chunk->mutable_data()->add_tensors(), pending->codec));
+    } else {
+      // Each column of a combined chunk is stored as an independent stream
+      // with its own transform and codec tag, so mixed dtype rows are not
+      // limited to encoding choices that suit every column.
+      ChunkData::ColumnStream* stream = chunk->add_column_streams();
+      if (!bit_packed && pending->delta_encode &&
+          kernels->Transforms(batched)) {
+        batched = kernels->delta_encode(batched, /*encode=*/true);
+        stream->set_delta_encoded(true);
+      }
+      stream->set_codec(CompressTensorAsProto(
+          batched, chunk->mutable_data()->add_tensors(), pending->codec));
+    }
+  }
+  chunk->set_data_tensors_len(chunk->data().tensors_size());
+  chunk->set_data_uncompressed_size(uncompressed_size);
+
+  // Now the chunk has been finalized we can notify the `CellRef`s.
+  auto chunk_container =
+      std::make_shared<ChunkDataContainer>(std::move(pending->chunk));
+  for (std::shared_ptr<CellRef>& ref : pending->refs) {
+    ref->SetChunk(chunk_container);
+  }
+
+  return absl::OkStatus();
+}
+
+void Chunker::RunPendingChunk(std::shared_ptr<PendingChunk> pending) {
+  const uint64_t chunk_key = pending->chunk->chunk_key();
+  absl::Status status = CompleteChunk(pending.get());
+
+  // Notify before removing the pending entry so `WaitForPendingChunks` does
+  // not return while a callback is still running.
+  if (chunk_ready_) chunk_ready_();
+
+  absl::MutexLock lock(&mu_);
+  if (!status.ok() && async_status_.ok()) {
+    async_status_ = status;
+  }
+  pending_chunks_.erase(chunk_key);
+}
+
+void Chunker::EnableAsyncCompression(std::shared_ptr<TaskExecutor> executor,
+                                     std::function<void()> chunk_ready) {
+  absl::MutexLock lock(&mu_);
+  REVERB_CHECK(pending_chunks_.empty());
+  executor_ = std::move(executor);
+  chunk_ready_ = std::move(chunk_ready);
+}
+
+void Chunker::WaitForPendingChunks() {
+  absl::MutexLock lock(&mu_);
+  auto no_pending_chunks = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return pending_chunks_.empty();
+  };
+  mu_.Await(absl::Condition(&no_pending_chunks));
+}
+
 void Chunker::Reset() {
   absl::MutexLock lock(&mu_);
   buffer_.clear();
-  buffer_.reserve(options_->GetMaxChunkLength());
+  buffer_.resize(specs_.size());
+  for (auto& column_buffer : buffer_) {
+    column_buffer.reserve(options_->GetMaxChunkLength());
+  }
   offset_ = 0;
   next_chunk_key_ = key_generator_->Generate();
   active_refs_.clear();
+  has_prev_chunk_ = false;
+}
+
+const internal::TensorSpec& Chunker::spec() const { return specs_[0]; }
+
+const internal::TensorSpec& Chunker::spec(int column) const {
+  REVERB_CHECK_GE(column, 0);
+  REVERB_CHECK_LT(column, specs_.size());
+  return specs_[column];
 }
 
-const internal::TensorSpec& Chunker::spec() const { return spec_; }
+int Chunker::num_columns() const { return specs_.size(); }
 
 absl::Status Chunker::ApplyConfig(std::shared_ptr<ChunkerOptions> options) {
   absl::MutexLock lock(&mu_);
 
-  if (!buffer_.empty()) {
+  if (!buffer_[0].empty()) {
     return absl::FailedPreconditionError(
         "Flush must be called before ApplyConfig.");
   }
@@ -284,7 +521,8 @@ absl::Status Chunker::ApplyConfig(std::shared_ptr<ChunkerOptions> options) {
   REVERB_RETURN_IF_ERROR(ValidateChunkerOptions(options.get()));
   options_ = std::move(options);
 
-  while (active_refs_.size() > options_->GetNumKeepAliveRefs()) {
+  while (active_refs_.size() >
+         options_->GetNumKeepAliveRefs() * specs_.size()) {
     active_refs_.pop_front();
   }
 
@@ -297,9 +535,45 @@ absl::Status Chunker::CopyDataForCell(const CellRef* ref,
 
   // If the chunk has been finalized then we unpack it and slice out the data.
   if (ref->IsReady()) {
+    const ChunkData& chunk = *ref->GetChunk()->get();
     tensorflow::Tensor column;
-    REVERB_RETURN_IF_ERROR(
-        internal::UnpackChunkColumn(*ref->GetChunk()->get(), 0, &column));
+    if (chunk.delta_baseline_chunk_key() != 0) {
+      // The chunk can only be decoded together with its predecessor, which is
+      // still kept alive by `active_refs_` since it was cut more recently than
+      // `num_keep_alive_refs` steps ago.
+      tensorflow::Tensor baseline;
+      bool found = false;
+      for (const std::shared_ptr<CellRef>& active : active_refs_) {
+        if (active->chunk_key() == chunk.delta_baseline_chunk_key() &&
+            active->IsReady()) {
+          REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumn(
+              *active->GetChunk()->get(), 0, &baseline));
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        // The predecessor may still be on the compression executor; its rows
+        // are then available in the retained buffer.
+        if (const auto it =
+                pending_chunks_.find(chunk.delta_baseline_chunk_key());
+            it != pending_chunks_.end()) {
+          baseline = it->second->buffer[0].back();
+          found = true;
+        }
+      }
+      if (!found) {
+        return absl::InternalError(absl::StrCat(
+            "Chunk ", chunk.chunk_key(), " is delta encoded against chunk ",
+            chunk.delta_baseline_chunk_key(),
+            " which is no longer kept alive by the chunker."));
+      }
+      REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumnWithBaseline(
+          chunk, 0, baseline, &column));
+    } else {
+      REVERB_RETURN_IF_ERROR(
+          internal::UnpackChunkColumn(chunk, ref->chunk_column(), &column));
+    }
     *out = column.SubSlice(ref->offset());
     if (!out->IsAligned()) {
       *out = tensorflow::tensor::DeepCopy(*out);
@@ -307,26 +581,37 @@ absl::Status Chunker::CopyDataForCell(const CellRef* ref,
     return absl::OkStatus();
   }
 
-  // Since the chunk hasn't been finalized then the data should be in the
-  // buffer. We iterate backward over the active references until we find `ref`
-  // to determine which position in the buffer holds the data.
-  int negative_offset = 0;
-  for (auto it = active_refs_.crbegin(); it != active_refs_.crend(); it++) {
-    if (it->get() == ref) break;
-    negative_offset++;
+  // If the chunk has been cut but its content is still being completed on the
+  // compression executor then the data is read from the retained buffer.
+  if (const auto it = pending_chunks_.find(ref->chunk_key());
+      it != pending_chunks_.end()) {
+    const std::vector<tensorflow::Tensor>& pending_buffer =
+        it->second->buffer[ref->chunk_column()];
+    REVERB_CHECK_LT(ref->offset(), pending_buffer.size());
+    tensorflow::TensorShape shape = pending_buffer[ref->offset()].shape();
+    shape.RemoveDim(0);
+    if (!out->CopyFrom(pending_buffer[ref->offset()], shape)) {
+      return absl::InternalError("Unable to copy tensor from pending chunk.");
+    }
+    return absl::OkStatus();
   }
 
-  int buffer_index = buffer_.size() - negative_offset - 1;
-  if (buffer_index < 0) {
+  // Since the chunk hasn't been finalized then the data should be in the
+  // buffer. The offset of the cell is its row index within the next chunk,
+  // which is exactly its position in the column's buffer.
+  const std::vector<tensorflow::Tensor>& column_buffer =
+      buffer_[ref->chunk_column()];
+  if (ref->chunk_key() != next_chunk_key_ ||
+      ref->offset() >= column_buffer.size()) {
     return absl::InternalError(
         "Data could not be found in buffer nor in finalized chunk.");
   }
 
   // A batch dimension is added to the data before it is added to the buffer so
   // we strip that off before copying the content to the output tensor.
-  tensorflow::TensorShape shape = buffer_[buffer_index].shape();
+  tensorflow::TensorShape shape = column_buffer[ref->offset()].shape();
   shape.RemoveDim(0);
-  if (!out->CopyFrom(buffer_[buffer_index], shape)) {
+  if (!out->CopyFrom(column_buffer[ref->offset()], shape)) {
     return absl::InternalError("Unable to copy tensor from buffer.");
   }
 
@@ -374,12 +659,17 @@ absl::Status ValidateChunkerOptions(const ChunkerOptions* options) {
   return absl::OkStatus();
 }
 
-ConstantChunkerOptions::ConstantChunkerOptions(int max_chunk_length,
-                                               int num_keep_alive_refs,
-                                               bool delta_encode)
+ConstantChunkerOptions::ConstantChunkerOptions(
+    int max_chunk_length, int num_keep_alive_refs, bool delta_encode,
+    CompressionCodec codec, LossyCompressionType lossy_compression,
+    bool bit_pack, bool cross_chunk_delta)
     : max_chunk_length_(max_chunk_length),
       num_keep_alive_refs_(num_keep_alive_refs),
-      delta_encode_(delta_encode) {}
+      delta_encode_(delta_encode),
+      codec_(codec),
+      lossy_compression_(lossy_compression),
+      bit_pack_(bit_pack),
+      cross_chunk_delta_(cross_chunk_delta) {}
 
 int ConstantChunkerOptions::GetMaxChunkLength() const {
   return max_chunk_length_;
@@ -391,6 +681,20 @@ int ConstantChunkerOptions::GetNumKeepAliveRefs() const {
 
 bool ConstantChunkerOptions::GetDeltaEncode() const { return delta_encode_; }
 
+CompressionCodec ConstantChunkerOptions::GetCompressionCodec() const {
+  return codec_;
+}
+
+LossyCompressionType ConstantChunkerOptions::GetLossyCompression() const {
+  return lossy_compression_;
+}
+
+bool ConstantChunkerOptions::GetBitPack() const { return bit_pack_; }
+
+bool ConstantChunkerOptions::GetCrossChunkDelta() const {
+  return cross_chunk_delta_;
+}
+
 absl::Status ConstantChunkerOptions::OnItemFinalized(
     const PrioritizedItem& item,
     absl::Span<const std::shared_ptr<CellRef>> refs) {
@@ -398,15 +702,21 @@ absl::Status ConstantChunkerOptions::OnItemFinalized(
 }
 
 std::shared_ptr<ChunkerOptions> ConstantChunkerOptions::Clone() const {
-  return std::make_shared<ConstantChunkerOptions>(max_chunk_length_,
-                                                  num_keep_alive_refs_);
+  return std::make_shared<ConstantChunkerOptions>(
+      max_chunk_length_, num_keep_alive_refs_, delta_encode_, codec_,
+      lossy_compression_, bit_pack_, cross_chunk_delta_);
 }
 
-AutoTunedChunkerOptions::AutoTunedChunkerOptions(int num_keep_alive_refs,
-                                                 double throughput_weight,
-                                                 bool delta_encode)
+AutoTunedChunkerOptions::AutoTunedChunkerOptions(
+    int num_keep_alive_refs, double throughput_weight, bool delta_encode,
+    CompressionCodec codec, LossyCompressionType lossy_compression,
+    bool bit_pack, bool cross_chunk_delta)
     : num_keep_alive_refs_(num_keep_alive_refs),
       delta_encode_(delta_encode),
+      codec_(codec),
+      lossy_compression_(lossy_compression),
+      bit_pack_(bit_pack),
+      cross_chunk_delta_(cross_chunk_delta),
       throughput_weight_(throughput_weight),
       max_chunk_length_(1),
       prev_score_(Score{-1, -1}) {}
@@ -422,6 +732,20 @@ int AutoTunedChunkerOptions::GetNumKeepAliveRefs() const {
 
 bool AutoTunedChunkerOptions::GetDeltaEncode() const { return delta_encode_; }
 
+CompressionCodec AutoTunedChunkerOptions::GetCompressionCodec() const {
+  return codec_;
+}
+
+LossyCompressionType AutoTunedChunkerOptions::GetLossyCompression() const {
+  return lossy_compression_;
+}
+
+bool AutoTunedChunkerOptions::GetBitPack() const { return bit_pack_; }
+
+bool AutoTunedChunkerOptions::GetCrossChunkDelta() const {
+  return cross_chunk_delta_;
+}
+
 void AutoTunedChunkerOptions::PushItem(
     absl::Span<const std::shared_ptr<CellRef>> refs) {
   double total_bytes = 0;
@@ -567,8 +891,110 @@ void AutoTunedChunkerOptions::PushChunks(
 }
 
 std::shared_ptr<ChunkerOptions> AutoTunedChunkerOptions::Clone() const {
-  return std::make_shared<AutoTunedChunkerOptions>(num_keep_alive_refs_,
-                                                   throughput_weight_);
+  return std::make_shared<AutoTunedChunkerOptions>(
+      num_keep_alive_refs_, throughput_weight_, delta_encode_, codec_,
+      lossy_compression_, bit_pack_, cross_chunk_delta_);
+}
+
+TargetSizeChunkerOptions::TargetSizeChunkerOptions(
+    int num_keep_alive_refs, size_t target_chunk_size_bytes, bool delta_encode,
+    CompressionCodec codec, LossyCompressionType lossy_compression,
+    bool bit_pack, bool cross_chunk_delta)
+    : num_keep_alive_refs_(num_keep_alive_refs),
+      delta_encode_(delta_encode),
+      codec_(codec),
+      lossy_compression_(lossy_compression),
+      bit_pack_(bit_pack),
+      cross_chunk_delta_(cross_chunk_delta),
+      target_chunk_size_bytes_(target_chunk_size_bytes),
+      max_chunk_length_(1),
+      avg_bytes_per_step_(-1),
+      avg_item_length_(-1) {}
+
+int TargetSizeChunkerOptions::GetMaxChunkLength() const {
+  absl::MutexLock lock(&mu_);
+  return max_chunk_length_;
+}
+
+int TargetSizeChunkerOptions::GetNumKeepAliveRefs() const {
+  return num_keep_alive_refs_;
+}
+
+bool TargetSizeChunkerOptions::GetDeltaEncode() const { return delta_encode_; }
+
+CompressionCodec TargetSizeChunkerOptions::GetCompressionCodec() const {
+  return codec_;
+}
+
+LossyCompressionType TargetSizeChunkerOptions::GetLossyCompression() const {
+  return lossy_compression_;
+}
+
+bool TargetSizeChunkerOptions::GetBitPack() const { return bit_pack_; }
+
+bool TargetSizeChunkerOptions::GetCrossChunkDelta() const {
+  return cross_chunk_delta_;
+}
+
+absl::Status TargetSizeChunkerOptions::OnItemFinalized(
+    const PrioritizedItem& item,
+    absl::Span<const std::shared_ptr<CellRef>> refs) {
+  if (refs.empty()) {
+    return absl::InvalidArgumentError(
+        "TargetSizeChunkerOptions::OnItemFinalized: refs is empty");
+  }
+
+  absl::MutexLock lock(&mu_);
+
+  auto fold = [](double avg, double observation) {
+    return avg < 0 ? observation
+                   : kSmoothing * avg + (1 - kSmoothing) * observation;
+  };
+
+  avg_item_length_ = fold(avg_item_length_, refs.size());
+
+  for (const auto& ref : refs) {
+    // Chunks may not have materialized yet, e.g. when compression runs on an
+    // executor. These chunks will be observed with a later item instead.
+    std::shared_ptr<ChunkDataContainer> container = ref->GetChunk();
+    if (container == nullptr) continue;
+
+    const ChunkData& chunk = *container->get();
+    if (std::find(observed_chunk_keys_.begin(), observed_chunk_keys_.end(),
+                  chunk.chunk_key()) != observed_chunk_keys_.end()) {
+      continue;
+    }
+    observed_chunk_keys_.push_back(chunk.chunk_key());
+    while (observed_chunk_keys_.size() > num_keep_alive_refs_) {
+      observed_chunk_keys_.pop_front();
+    }
+
+    avg_bytes_per_step_ =
+        fold(avg_bytes_per_step_,
+             static_cast<double>(chunk.ByteSizeLong()) / GetLength(chunk));
+  }
+
+  if (avg_bytes_per_step_ <= 0) {
+    return absl::OkStatus();
+  }
+
+  // Length at which chunks are expected to compress to the target size,
+  // clipped so that chunks don't grow far beyond the trajectories that
+  // reference them.
+  double target_length = target_chunk_size_bytes_ / avg_bytes_per_step_;
+  if (avg_item_length_ > 0) {
+    target_length = std::min(target_length, std::ceil(avg_item_length_));
+  }
+  max_chunk_length_ = std::min<int>(
+      std::max<int>(static_cast<int>(target_length), 1), num_keep_alive_refs_);
+
+  return absl::OkStatus();
+}
+
+std::shared_ptr<ChunkerOptions> TargetSizeChunkerOptions::Clone() const {
+  return std::make_shared<TargetSizeChunkerOptions>(
+      num_keep_alive_refs_, target_chunk_size_bytes_, delta_encode_, codec_,
+      lossy_compression_, bit_pack_, cross_chunk_delta_);
 }
 
 }  // namespace reverb
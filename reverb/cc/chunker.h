@@ -16,6 +16,7 @@
 #define REVERB_CC_CHUNKER_H_
 
 #include <deque>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -29,6 +30,8 @@
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/support/key_generators.h"
 #include "reverb/cc/support/signature.h"
+#include "reverb/cc/support/task_executor.h"
+#include "reverb/cc/tensor_compression.h"
 #include "tensorflow/core/framework/tensor.h"
 
 namespace deepmind {
@@ -85,7 +88,7 @@ class CellRef {
   };
 
   CellRef(std::weak_ptr<Chunker> chunker, uint64_t chunk_key, int offset,
-          EpisodeInfo episode_info);
+          EpisodeInfo episode_info, int chunk_column = 0);
 
   // Key of the parent chunk.
   uint64_t chunk_key() const;
@@ -93,6 +96,11 @@ class CellRef {
   // Offset within the parent chunk.
   int offset() const;
 
+  // Index of the column's tensor within the parent chunk. Only combined
+  // (multi column) chunks hold more than one tensor per row so this is always
+  // 0 for cells created by a single column `Chunker`.
+  int chunk_column() const;
+
   // ID of the episode which the referenced data originated from.
   uint64_t episode_id() const;
 
@@ -138,6 +146,9 @@ class CellRef {
   // Offset of element within the parent chunk.
   int offset_;
 
+  // Index of the column's tensor within the parent chunk.
+  int chunk_column_;
+
   // The episode step that the referenced data was generated at.
   EpisodeInfo episode_info_;
 
@@ -157,27 +168,83 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
  public:
   Chunker(internal::TensorSpec spec, std::shared_ptr<ChunkerOptions> options);
 
+  // Creates a chunker which packs several columns into every chunk. Each row
+  // holds one tensor per spec and the cut chunks store the columns as
+  // independent streams (see `ChunkData.column_streams`), so readers project
+  // single columns through `FlatTrajectory::ChunkSlice.index` without
+  // decoding their neighbours. Combining columns with tiny payloads (rewards,
+  // discounts, done flags, ...) this way avoids cutting a chunk, whose
+  // metadata dwarfs the payload, per column.
+  Chunker(std::vector<internal::TensorSpec> specs,
+          std::shared_ptr<ChunkerOptions> options);
+
   // Validates `tensor` against `spec_` and `episode_info` against previous
   // calls, appends it to the active chunk and returns a reference to the new
   // row. If the active chunk now has `max_chunk_length` rows then it is
   // finalized and its `CellRef`s notified (including `ref`).
-  absl::Status Append(const tensorflow::Tensor& tensor,
+  //
+  // `tensor` is taken by value so callers which no longer need it can
+  // `std::move` it into the chunker and donate the underlying buffer. The
+  // buffer is never copied on append; it is held by reference in the active
+  // chunk until the chunk is finalized (concatenated and compressed). Callers
+  // must therefore not mutate the buffer after appending it.
+  //
+  // Requires that the chunker holds exactly one column; multi column chunkers
+  // append entire rows with `AppendColumns`.
+  absl::Status Append(tensorflow::Tensor tensor,
                       const CellRef::EpisodeInfo& episode_info,
                       std::weak_ptr<CellRef>* ref) ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Like `Append` but appends a full row of a multi (or single) column
+  // chunker. `tensors` must hold exactly one tensor per spec, in spec order.
+  // On success `refs` is cleared and populated with one reference per column,
+  // all sharing the same chunk key and offset.
+  absl::Status AppendColumns(std::vector<tensorflow::Tensor> tensors,
+                             const CellRef::EpisodeInfo& episode_info,
+                             std::vector<std::weak_ptr<CellRef>>* refs)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // Creates a chunk from the data in the buffer and calls `SetChunk` on its
-  // `CellRef`s.
+  // `CellRef`s. If asynchronous compression is enabled the chunk content is
+  // finalized on the executor and the `CellRef`s materialize once the
+  // scheduled task completes.
   absl::Status Flush() ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Offloads chunk finalization (concatenation, delta encoding and
+  // compression) to `executor` so callers of `Append` and `Flush` never block
+  // on compression. The `CellRef`s of a chunk become ready (`IsReady`) when
+  // the scheduled task completes; until then reads of their rows are served
+  // from the retained buffer. `chunk_ready` (if set) is called after a chunk
+  // has materialized, e.g. to wake up a stream worker awaiting the data.
+  //
+  // Objects referenced by `chunk_ready` must outlive all scheduled tasks; see
+  // `WaitForPendingChunks`.
+  void EnableAsyncCompression(std::shared_ptr<TaskExecutor> executor,
+                              std::function<void()> chunk_ready = nullptr)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Blocks until all chunks scheduled on the compression executor have
+  // materialized and their `chunk_ready` callbacks returned.
+  void WaitForPendingChunks() ABSL_LOCKS_EXCLUDED(mu_);
+
   // Clears buffers of both references and data not yet committed to a Chunk.
   void Reset();
 
   // Keys of the FINALIZED chunks referenced by `CellRef`s in `active_refs_`.
   std::vector<uint64_t> GetKeepKeys() const ABSL_LOCKS_EXCLUDED(mu_);
 
-  // Spec which appended tensors need to be compatible with.
+  // Spec which appended tensors need to be compatible with. For multi column
+  // chunkers this is the spec of the first column; use the `spec(int)`
+  // overload to address a specific column.
   const internal::TensorSpec& spec() const;
 
+  // Spec of the column stored at tensor index `column` of cut chunks.
+  const internal::TensorSpec& spec(int column) const;
+
+  // Number of columns packed into every chunk. 1 unless the chunker was
+  // created with multiple specs.
+  int num_columns() const;
+
   // Modify options on Chunker with an empty buffer (i.e newly created or
   // `Flush` just called.). Returns `InvalidArgumentError` if
   // `max_chunk_length > num_keep_alive_refs`  or if either is <= 0.
@@ -201,10 +268,52 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
                                tensorflow::Tensor* out) const;
 
  private:
+  // A chunk whose metadata has been finalized but whose content has not yet
+  // been concatenated and compressed.
+  struct PendingChunk {
+    // Chunk with everything but the tensor content set. Moved into a
+    // `ChunkDataContainer` by `CompleteChunk`.
+    std::unique_ptr<ChunkData> chunk;
+
+    // The buffered rows the chunk is built from, indexed [column][row].
+    std::vector<std::vector<tensorflow::Tensor>> buffer;
+
+    // The `CellRef`s to notify once the chunk content is complete.
+    std::vector<std::shared_ptr<CellRef>> refs;
+
+    // Options captured when the chunk was cut.
+    bool delta_encode;
+    CompressionCodec codec;
+    LossyCompressionType lossy_compression;
+    bool bit_pack;
+
+    // When true the first row is delta encoded against `delta_baseline`, the
+    // last row of the chunk with key `delta_baseline_chunk_key`.
+    bool cross_chunk_delta;
+    tensorflow::Tensor delta_baseline;
+    uint64_t delta_baseline_chunk_key;
+  };
+
   absl::Status FlushLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
-  // Spec which all data in `Append` must follow.
-  internal::TensorSpec spec_;
+  // Concatenates, (maybe) delta encodes and compresses `pending` and calls
+  // `SetChunk` on its `CellRef`s. Does not require `mu_` as it only touches
+  // data owned by `pending`.
+  absl::Status CompleteChunk(PendingChunk* pending);
+
+  // Runs `CompleteChunk` on the compression executor, invokes `chunk_ready_`
+  // and removes the entry from `pending_chunks_`.
+  void RunPendingChunk(std::shared_ptr<PendingChunk> pending)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Specs which all data in `AppendColumns` must follow, one per column.
+  std::vector<internal::TensorSpec> specs_;
+
+  // Delta encoding kernels specialized for the dtype of each column, parallel
+  // to `specs_`. Bound once at construction so chunk finalization dispatches
+  // with a single indirect call instead of switching on the dtype per chunk
+  // (see `GetDeltaEncodingKernels`).
+  std::vector<const DeltaEncodingKernels*> column_kernels_;
 
   // Provides max chunk length and the number of references to keep alive.
   // Values may change over time depending on the implementation.
@@ -212,8 +321,9 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
 
   mutable absl::Mutex mu_;
 
-  // Data waiting for the next chunk to be constructed.
-  std::vector<tensorflow::Tensor> buffer_ ABSL_GUARDED_BY(mu_);
+  // Data waiting for the next chunk to be constructed, indexed
+  // [column][row]. All columns always hold the same number of rows.
+  std::vector<std::vector<tensorflow::Tensor>> buffer_ ABSL_GUARDED_BY(mu_);
 
   // Offset within the chunk of the next appended item.
   int offset_ ABSL_GUARDED_BY(mu_);
@@ -221,6 +331,17 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
   // Key of the chunk that will be constructed from `buffer_`.
   uint64_t next_chunk_key_ ABSL_GUARDED_BY(mu_);
 
+  // Last row, key, episode and encoding of the most recently cut chunk,
+  // retained while cross chunk delta encoding (see
+  // `ChunkerOptions::GetCrossChunkDelta`) may reference it. Invalidated by
+  // `Reset`. Only maintained by single column chunkers; multi column chunks
+  // are always self contained.
+  tensorflow::Tensor prev_chunk_last_row_ ABSL_GUARDED_BY(mu_);
+  uint64_t prev_chunk_key_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t prev_chunk_episode_id_ ABSL_GUARDED_BY(mu_) = 0;
+  bool prev_chunk_cross_delta_ ABSL_GUARDED_BY(mu_) = false;
+  bool has_prev_chunk_ ABSL_GUARDED_BY(mu_) = false;
+
   // Used to generate chunk keys.
   std::unique_ptr<internal::KeyGenerator> key_generator_;
 
@@ -228,6 +349,41 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
   // When the size exceeds `num_keep_alive_refs_` then the oldest item is
   // removed.
   std::deque<std::shared_ptr<CellRef>> active_refs_ ABSL_GUARDED_BY(mu_);
+
+  // Backing storage for the `CellRef`s created by `Append`. Cells are
+  // allocated in fixed size blocks and handed out as aliasing `shared_ptr`s
+  // into the block, avoiding a separate control-block allocation (and its
+  // refcount) for every appended cell. A block is kept alive until the last
+  // reference into it has been dropped. `absl::optional` is used as the slot
+  // type since `CellRef` is neither default constructible nor movable.
+  struct CellRefBlock {
+    explicit CellRefBlock(int capacity)
+        : cells(new absl::optional<CellRef>[capacity]) {}
+
+    std::unique_ptr<absl::optional<CellRef>[]> cells;
+    int size = 0;
+  };
+
+  // Block which the next appended cell is allocated from. Replaced with a
+  // fresh block once full.
+  std::shared_ptr<CellRefBlock> cell_ref_block_ ABSL_GUARDED_BY(mu_);
+
+  // Executor chunk finalization is scheduled on. If nullptr (the default)
+  // chunks are compressed synchronously in `FlushLocked`.
+  std::shared_ptr<TaskExecutor> executor_ ABSL_GUARDED_BY(mu_);
+
+  // Invoked (without holding `mu_`) after an asynchronously scheduled chunk
+  // has materialized.
+  std::function<void()> chunk_ready_;
+
+  // Chunks cut from the buffer but not yet compressed, keyed by chunk key.
+  // Rows referenced by not-yet-ready `CellRef`s are read from here.
+  internal::flat_hash_map<uint64_t, std::shared_ptr<PendingChunk>>
+      pending_chunks_ ABSL_GUARDED_BY(mu_);
+
+  // First error encountered by an asynchronously completed chunk, surfaced on
+  // the next `Append` or `Flush` call.
+  absl::Status async_status_ ABSL_GUARDED_BY(mu_) = absl::OkStatus();
 };
 
 class ChunkerOptions {
@@ -250,6 +406,34 @@ class ChunkerOptions {
   // Get current recommendation of whether delta encoding should be used.
   virtual bool GetDeltaEncode() const = 0;
 
+  // Codec that finalized chunks should be compressed with. Defaults to
+  // snappy; implementations may expose it as a per table configuration.
+  virtual CompressionCodec GetCompressionCodec() const {
+    return COMPRESSION_SNAPPY;
+  }
+
+  // Lossy transform applied to float32 columns before delta encoding and the
+  // (lossless) codec. Chunks record the transform so readers transparently
+  // recover float32 tensors, at reduced precision. Defaults to exact storage.
+  virtual LossyCompressionType GetLossyCompression() const {
+    return LOSSY_COMPRESSION_NONE;
+  }
+
+  // Whether bool and integer columns with few distinct values (done flags,
+  // action masks, discrete actions, ...) should be dictionary bit-packed
+  // before the codec (see `BitPackTensor`). The transform is lossless and
+  // skipped for chunks whose data turns out not to shrink. Defaults to off.
+  virtual bool GetBitPack() const { return false; }
+
+  // Whether integer chunks should additionally be delta encoded against the
+  // last row of the preceding chunk of the same episode, so slowly-varying
+  // columns do not restart cold at every chunk boundary. Chunks encoded this
+  // way can only be decoded together with the preceding chunk, so items must
+  // reference trajectories that include it (e.g. trajectories spanning the
+  // episode from its start). Every other chunk stays self contained, keeping
+  // the decode dependency one chunk deep. Defaults to off.
+  virtual bool GetCrossChunkDelta() const { return false; }
+
   // Called by parent `Chunker` once an item is ready to be sent to the
   // server.
   //
@@ -279,8 +463,11 @@ class ChunkerOptions {
 // `OnItemFinalized` is a noop.
 class ConstantChunkerOptions : public ChunkerOptions {
  public:
-  ConstantChunkerOptions(int max_chunk_length, int num_keep_alive_refs,
-                         bool delta_encode = false);
+  ConstantChunkerOptions(
+      int max_chunk_length, int num_keep_alive_refs, bool delta_encode = false,
+      CompressionCodec codec = COMPRESSION_SNAPPY,
+      LossyCompressionType lossy_compression = LOSSY_COMPRESSION_NONE,
+      bool bit_pack = false, bool cross_chunk_delta = false);
 
   int GetMaxChunkLength() const override;
 
@@ -288,6 +475,14 @@ class ConstantChunkerOptions : public ChunkerOptions {
 
   bool GetDeltaEncode() const override;
 
+  CompressionCodec GetCompressionCodec() const override;
+
+  LossyCompressionType GetLossyCompression() const override;
+
+  bool GetBitPack() const override;
+
+  bool GetCrossChunkDelta() const override;
+
   absl::Status OnItemFinalized(
       const PrioritizedItem& item,
       absl::Span<const std::shared_ptr<CellRef>> refs) override;
@@ -298,6 +493,10 @@ class ConstantChunkerOptions : public ChunkerOptions {
   int max_chunk_length_;
   int num_keep_alive_refs_;
   bool delta_encode_;
+  CompressionCodec codec_;
+  LossyCompressionType lossy_compression_;
+  bool bit_pack_;
+  bool cross_chunk_delta_;
 };
 
 // Automatically tunes the `max_chunk_length` value within the range [1,
@@ -344,9 +543,11 @@ class AutoTunedChunkerOptions : public ChunkerOptions {
   static constexpr auto kMaxChunkLengthError = 0.25;
 
   // TODO(b/180278134): Remove delta_encode argument once it is auto selected.
-  explicit AutoTunedChunkerOptions(int num_keep_alive_ref,
-                                   double throughput_weight = 1.0,
-                                   bool delta_encode = false);
+  explicit AutoTunedChunkerOptions(
+      int num_keep_alive_ref, double throughput_weight = 1.0,
+      bool delta_encode = false, CompressionCodec codec = COMPRESSION_SNAPPY,
+      LossyCompressionType lossy_compression = LOSSY_COMPRESSION_NONE,
+      bool bit_pack = false, bool cross_chunk_delta = false);
 
   // Returns the recommendation of the maximum chunk length.
   int GetMaxChunkLength() const override;
@@ -357,6 +558,18 @@ class AutoTunedChunkerOptions : public ChunkerOptions {
   // Returns the (constant) delta encoding setting.
   bool GetDeltaEncode() const override;
 
+  // Returns the (constant) compression codec.
+  CompressionCodec GetCompressionCodec() const override;
+
+  // Returns the (constant) lossy transform.
+  LossyCompressionType GetLossyCompression() const override;
+
+  // Returns the (constant) bit-packing setting.
+  bool GetBitPack() const override;
+
+  // Returns the (constant) cross chunk delta setting.
+  bool GetCrossChunkDelta() const override;
+
   // Calculates performance statistics for the item and the chunks it
   // reference and uses thse to (potentially) update the result of
   // `GetMaxChunkLength`.
@@ -389,6 +602,19 @@ class AutoTunedChunkerOptions : public ChunkerOptions {
   // Whethr delta encoding should be used. This value is NOT tuned.
   bool delta_encode_;
 
+  // Codec chunks are compressed with. This value is NOT tuned.
+  CompressionCodec codec_;
+
+  // Lossy transform applied to chunks. This value is NOT tuned.
+  LossyCompressionType lossy_compression_;
+
+  // Whether chunks should be bit-packed. This value is NOT tuned.
+  bool bit_pack_;
+
+  // Whether cross chunk delta encoding should be used. This value is NOT
+  // tuned.
+  bool cross_chunk_delta_;
+
   // Weight to multiply the score contribution from `items_` with. A higher
   // value results in more emphasise on the amount of data sent per item (i.e
   // sample speed) and lower values results in lower memory usage on the server
@@ -432,6 +658,107 @@ class AutoTunedChunkerOptions : public ChunkerOptions {
   std::deque<Statistic> chunks_ ABSL_GUARDED_BY(mu_);
 };
 
+// Tunes `max_chunk_length` so that the realized (compressed) chunk size stays
+// close to `target_chunk_size_bytes`, the same way
+// `Table::kMaxSampleResponseSizeBytes` targets a response size rather than a
+// row count. Tiny chunks waste bytes on per-chunk proto overhead and inflate
+// the number of gRPC messages while huge chunks increase the read
+// amplification of sampling.
+//
+// The bytes-per-step of finalized chunks and the lengths of finalized items
+// are tracked with exponential moving averages. The recommended chunk length
+// is `target_chunk_size_bytes / avg_bytes_per_step`, clipped to
+// [1, `num_keep_alive_refs`] and to the average item length so that sampling
+// a trajectory does not require decompressing (much) more data than it
+// references.
+class TargetSizeChunkerOptions : public ChunkerOptions {
+ public:
+  // Byte size that chunks are tuned towards if none is provided.
+  static constexpr size_t kDefaultTargetChunkSizeBytes = 64 * 1024;  // 64kB.
+
+  // Weight of the existing average when a new observation is folded into an
+  // exponential moving average.
+  static constexpr double kSmoothing = 0.9;
+
+  explicit TargetSizeChunkerOptions(
+      int num_keep_alive_refs,
+      size_t target_chunk_size_bytes = kDefaultTargetChunkSizeBytes,
+      bool delta_encode = false, CompressionCodec codec = COMPRESSION_SNAPPY,
+      LossyCompressionType lossy_compression = LOSSY_COMPRESSION_NONE,
+      bool bit_pack = false, bool cross_chunk_delta = false);
+
+  // Returns the recommendation of the maximum chunk length.
+  int GetMaxChunkLength() const override;
+
+  // Returns the (constant) size of the reference buffer.
+  int GetNumKeepAliveRefs() const override;
+
+  // Returns the (constant) delta encoding setting.
+  bool GetDeltaEncode() const override;
+
+  // Returns the (constant) compression codec.
+  CompressionCodec GetCompressionCodec() const override;
+
+  // Returns the (constant) lossy transform.
+  LossyCompressionType GetLossyCompression() const override;
+
+  // Returns the (constant) bit-packing setting.
+  bool GetBitPack() const override;
+
+  // Returns the (constant) cross chunk delta setting.
+  bool GetCrossChunkDelta() const override;
+
+  // Folds the size of newly observed chunks and the length of the item into
+  // the moving averages and updates the result of `GetMaxChunkLength`.
+  absl::Status OnItemFinalized(
+      const PrioritizedItem& item,
+      absl::Span<const std::shared_ptr<CellRef>> refs) override;
+
+  std::shared_ptr<ChunkerOptions> Clone() const override;
+
+ private:
+  // The maximum number of CellRef to keep alive. This value is NOT tuned.
+  const int num_keep_alive_refs_;
+
+  // Whether delta encoding should be used. This value is NOT tuned.
+  const bool delta_encode_;
+
+  // Codec chunks are compressed with. This value is NOT tuned.
+  const CompressionCodec codec_;
+
+  // Lossy transform applied to chunks. This value is NOT tuned.
+  const LossyCompressionType lossy_compression_;
+
+  // Whether chunks should be bit-packed. This value is NOT tuned.
+  const bool bit_pack_;
+
+  // Whether cross chunk delta encoding should be used. This value is NOT
+  // tuned.
+  const bool cross_chunk_delta_;
+
+  // Compressed byte size that chunks are tuned towards.
+  const size_t target_chunk_size_bytes_;
+
+  mutable absl::Mutex mu_;
+
+  // Current recommendation returned by `GetMaxChunkLength`. Will always be in
+  // the range [1, num_keep_alive_refs_].
+  int max_chunk_length_ ABSL_GUARDED_BY(mu_);
+
+  // Exponential moving average of the compressed bytes per step of observed
+  // chunks. -1 until the first chunk has been observed.
+  double avg_bytes_per_step_ ABSL_GUARDED_BY(mu_);
+
+  // Exponential moving average of the number of steps (in this column)
+  // referenced by observed items. -1 until the first item has been observed.
+  double avg_item_length_ ABSL_GUARDED_BY(mu_);
+
+  // Keys of the most recently observed chunks so that a chunk referenced by
+  // multiple items is only counted once. Oldest keys are evicted when the
+  // deque exceeds `num_keep_alive_refs_`.
+  std::deque<uint64_t> observed_chunk_keys_ ABSL_GUARDED_BY(mu_);
+};
+
 }  // namespace reverb
 }  // namespace deepmind
 
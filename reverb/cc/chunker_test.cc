@@ -14,6 +14,7 @@
 
 #include "reverb/cc/chunker.h"
 
+#include <atomic>
 #include <deque>
 #include <memory>
 #include <string>
@@ -27,6 +28,7 @@
 #include "reverb/cc/platform/status_matchers.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/support/signature.h"
+#include "reverb/cc/support/task_executor.h"
 #include "reverb/cc/testing/proto_test_util.h"
 #include "reverb/cc/testing/tensor_testutil.h"
 #include "tensorflow/core/framework/tensor.h"
@@ -225,6 +227,48 @@ TEST(Chunker, AppendFlushesOnMaxChunkLength) {
   EXPECT_TRUE(second.lock()->IsReady());
 }
 
+TEST(Chunker, CellRefsRemainValidAcrossAllocationBlocks) {
+  auto chunker = MakeChunker(kIntSpec, /*max_chunk_length=*/2,
+                             /*num_keep_alive_refs=*/2);
+
+  // Append enough cells to span several of the internal allocation blocks and
+  // keep strong references to all of them even after they age out of the
+  // chunker.
+  std::vector<std::shared_ptr<CellRef>> held;
+  for (int i = 0; i < 200; i++) {
+    std::weak_ptr<CellRef> ref;
+    REVERB_ASSERT_OK(
+        chunker->Append(MakeZeroTensor<tensorflow::DT_INT32>(kIntSpec),
+                        {/*episode_id=*/1, /*step=*/i}, &ref));
+    held.push_back(ref.lock());
+  }
+
+  // The references (and the chunks they point to) must remain valid even
+  // after the chunker itself has been destroyed.
+  chunker = nullptr;
+  for (int i = 0; i < held.size(); i++) {
+    EXPECT_EQ(held[i]->episode_step(), i);
+    EXPECT_TRUE(held[i]->IsReady());
+  }
+}
+
+TEST(Chunker, AppendSharesBufferUntilChunkIsFinalized) {
+  internal::TensorSpec spec = {"0", tensorflow::DT_INT32, {3, 3}};
+  auto chunker = MakeChunker(spec, /*max_chunk_length=*/2,
+                             /*num_keep_alive_refs=*/2);
+
+  std::weak_ptr<CellRef> ref;
+  auto want = MakeConstantTensor<tensorflow::DT_INT32>({3, 3}, 5);
+  REVERB_ASSERT_OK(chunker->Append(want, {/*episode_id=*/1, /*step=*/0}, &ref));
+
+  // The buffer of the appended tensor is donated to the chunker so reading the
+  // cell back before the chunk is finalized must return the very same buffer
+  // rather than a copy of it.
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(ref.lock()->GetData(&got));
+  EXPECT_EQ(got.tensor_data().data(), want.tensor_data().data());
+}
+
 TEST(Chunker, Flush) {
   auto chunker = MakeChunker(kIntSpec, /*max_chunk_length=*/2,
                              /*num_keep_alive_refs=*/5);
@@ -688,6 +732,238 @@ TEST(Chunker, DeltaEncodeIsRespected) {
   EXPECT_TRUE(step.lock()->GetChunk()->get()->delta_encoded());
 }
 
+TEST(Chunker, LossyCompressionIsRecordedAndInverted) {
+  internal::TensorSpec spec = {"0", tensorflow::DT_FLOAT, {3, 3}};
+  auto chunker = std::make_shared<Chunker>(
+      spec, std::make_shared<ConstantChunkerOptions>(
+                /*max_chunk_length=*/1, /*num_keep_alive_refs=*/1,
+                /*delta_encode=*/false, COMPRESSION_SNAPPY,
+                LOSSY_COMPRESSION_FLOAT16));
+
+  std::weak_ptr<CellRef> step;
+  auto want = MakeConstantTensor<tensorflow::DT_FLOAT>({3, 3}, 5);
+  REVERB_ASSERT_OK(chunker->Append(want, {/*episode_id=*/1, /*step=*/0},
+                                   &step));
+
+  // The chunk must record the transform so readers can invert it.
+  ASSERT_EQ(step.lock()->GetChunk()->get()->lossy_transforms_size(), 1);
+  EXPECT_EQ(step.lock()->GetChunk()->get()->lossy_transforms(0).type(),
+            LOSSY_COMPRESSION_FLOAT16);
+
+  // Unpacking restores the float32 dtype (5.0 is exact in half precision).
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(step.lock()->GetData(&got));
+  test::ExpectTensorEqual<float>(got, want);
+}
+
+TEST(Chunker, BitPackIsRecordedAndInverted) {
+  internal::TensorSpec spec = {"0", tensorflow::DT_INT32, {8}};
+  auto chunker = std::make_shared<Chunker>(
+      spec, std::make_shared<ConstantChunkerOptions>(
+                /*max_chunk_length=*/2, /*num_keep_alive_refs=*/2,
+                /*delta_encode=*/false, COMPRESSION_SNAPPY,
+                LOSSY_COMPRESSION_NONE, /*bit_pack=*/true));
+
+  // An action-mask style column with only two distinct values.
+  std::weak_ptr<CellRef> first;
+  auto first_want = MakeConstantTensor<tensorflow::DT_INT32>({8}, 0);
+  REVERB_ASSERT_OK(
+      chunker->Append(first_want, {/*episode_id=*/1, /*step=*/0}, &first));
+
+  std::weak_ptr<CellRef> second;
+  auto second_want = MakeConstantTensor<tensorflow::DT_INT32>({8}, 1);
+  REVERB_ASSERT_OK(
+      chunker->Append(second_want, {/*episode_id=*/1, /*step=*/1}, &second));
+
+  // The chunk must record the packing so readers can invert it.
+  ASSERT_EQ(first.lock()->GetChunk()->get()->bit_packings_size(), 1);
+  EXPECT_EQ(first.lock()->GetChunk()->get()->bit_packings(0).bits(), 1);
+
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(first.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(got, first_want);
+  REVERB_ASSERT_OK(second.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(got, second_want);
+}
+
+TEST(Chunker, CrossChunkDeltaAlternatesAndIsInverted) {
+  auto chunker = std::make_shared<Chunker>(
+      kIntSpec, std::make_shared<ConstantChunkerOptions>(
+                    /*max_chunk_length=*/1, /*num_keep_alive_refs=*/3,
+                    /*delta_encode=*/false, COMPRESSION_SNAPPY,
+                    LOSSY_COMPRESSION_NONE, /*bit_pack=*/false,
+                    /*cross_chunk_delta=*/true));
+
+  std::weak_ptr<CellRef> first;
+  auto first_want = MakeConstantTensor<tensorflow::DT_INT32>({1}, 3);
+  REVERB_ASSERT_OK(
+      chunker->Append(first_want, {/*episode_id=*/1, /*step=*/0}, &first));
+
+  std::weak_ptr<CellRef> second;
+  auto second_want = MakeConstantTensor<tensorflow::DT_INT32>({1}, 5);
+  REVERB_ASSERT_OK(
+      chunker->Append(second_want, {/*episode_id=*/1, /*step=*/1}, &second));
+
+  std::weak_ptr<CellRef> third;
+  auto third_want = MakeConstantTensor<tensorflow::DT_INT32>({1}, 8);
+  REVERB_ASSERT_OK(
+      chunker->Append(third_want, {/*episode_id=*/1, /*step=*/2}, &third));
+
+  // The first chunk has no predecessor and the third chunk's predecessor is
+  // itself cross chunk encoded, so only the second chunk references a
+  // baseline. This keeps the decode dependency one chunk deep.
+  EXPECT_EQ(first.lock()->GetChunk()->get()->delta_baseline_chunk_key(), 0);
+  EXPECT_EQ(second.lock()->GetChunk()->get()->delta_baseline_chunk_key(),
+            first.lock()->chunk_key());
+  EXPECT_TRUE(second.lock()->GetChunk()->get()->delta_encoded());
+  EXPECT_EQ(third.lock()->GetChunk()->get()->delta_baseline_chunk_key(), 0);
+
+  // Reading the cross chunk encoded cell resolves the baseline from the
+  // chunker's kept alive references.
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(first.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(got, first_want);
+  REVERB_ASSERT_OK(second.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(got, second_want);
+  REVERB_ASSERT_OK(third.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(got, third_want);
+}
+
+TEST(Chunker, AsyncCompressionMaterializesRefs) {
+  auto executor = std::make_shared<TaskExecutor>(1, "ChunkerTest");
+  auto chunker = MakeChunker(kIntSpec, /*max_chunk_length=*/2,
+                             /*num_keep_alive_refs=*/2);
+
+  std::atomic<int> num_ready_callbacks(0);
+  chunker->EnableAsyncCompression(executor,
+                                  [&] { num_ready_callbacks++; });
+
+  std::weak_ptr<CellRef> first;
+  REVERB_ASSERT_OK(
+      chunker->Append(MakeConstantTensor<tensorflow::DT_INT32>({1}, 5),
+                      {/*episode_id=*/1, /*step=*/0}, &first));
+
+  // The chunk has not been cut yet so the data must be served from the active
+  // buffer.
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(first.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(
+      got, MakeConstantTensor<tensorflow::DT_INT32>({1}, 5));
+
+  // Appending a second step reaches `max_chunk_length` and hands the chunk to
+  // the executor. Once all pending chunks have completed the refs must be
+  // ready and the notification callback must have fired.
+  std::weak_ptr<CellRef> second;
+  REVERB_ASSERT_OK(
+      chunker->Append(MakeConstantTensor<tensorflow::DT_INT32>({1}, 6),
+                      {/*episode_id=*/1, /*step=*/1}, &second));
+  chunker->WaitForPendingChunks();
+
+  EXPECT_TRUE(first.lock()->IsReady());
+  EXPECT_TRUE(second.lock()->IsReady());
+  EXPECT_EQ(num_ready_callbacks, 1);
+
+  REVERB_ASSERT_OK(second.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(
+      got, MakeConstantTensor<tensorflow::DT_INT32>({1}, 6));
+
+  executor->Close();
+}
+
+TEST(Chunker, AppendColumnsPacksColumnsIntoOneChunk) {
+  std::vector<internal::TensorSpec> specs = {
+      {"0", tensorflow::DT_INT32, {1}},
+      {"1", tensorflow::DT_FLOAT, {1}},
+  };
+  auto chunker = std::make_shared<Chunker>(
+      specs, std::make_shared<ConstantChunkerOptions>(
+                 /*max_chunk_length=*/2, /*num_keep_alive_refs=*/2));
+
+  std::vector<std::weak_ptr<CellRef>> first;
+  REVERB_ASSERT_OK(chunker->AppendColumns(
+      {MakeConstantTensor<tensorflow::DT_INT32>({1}, 1),
+       MakeConstantTensor<tensorflow::DT_FLOAT>({1}, 2)},
+      {/*episode_id=*/1, /*step=*/0}, &first));
+
+  std::vector<std::weak_ptr<CellRef>> second;
+  REVERB_ASSERT_OK(chunker->AppendColumns(
+      {MakeConstantTensor<tensorflow::DT_INT32>({1}, 3),
+       MakeConstantTensor<tensorflow::DT_FLOAT>({1}, 4)},
+      {/*episode_id=*/1, /*step=*/1}, &second));
+
+  // Both columns of a row share the chunk key and offset but address
+  // different tensors within the chunk.
+  ASSERT_EQ(first.size(), 2);
+  EXPECT_EQ(first[0].lock()->chunk_key(), first[1].lock()->chunk_key());
+  EXPECT_EQ(first[0].lock()->offset(), first[1].lock()->offset());
+  EXPECT_EQ(first[0].lock()->chunk_column(), 0);
+  EXPECT_EQ(first[1].lock()->chunk_column(), 1);
+
+  // The chunk stores one stream per column.
+  ASSERT_TRUE(first[0].lock()->IsReady());
+  const ChunkData& chunk = *first[0].lock()->GetChunk()->get();
+  EXPECT_EQ(chunk.data().tensors_size(), 2);
+  EXPECT_EQ(chunk.data_tensors_len(), 2);
+  EXPECT_EQ(chunk.column_streams_size(), 2);
+
+  // Each cell reads back its own column.
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(second[0].lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(
+      got, MakeConstantTensor<tensorflow::DT_INT32>({1}, 3));
+  REVERB_ASSERT_OK(second[1].lock()->GetData(&got));
+  test::ExpectTensorEqual<float>(
+      got, MakeConstantTensor<tensorflow::DT_FLOAT>({1}, 4));
+
+  // And reports its own spec.
+  internal::TensorSpec spec;
+  REVERB_ASSERT_OK(first[1].lock()->GetSpec(&spec));
+  EXPECT_EQ(spec.dtype, tensorflow::DT_FLOAT);
+}
+
+TEST(Chunker, AppendColumnsReadsFromBufferBeforeFlush) {
+  std::vector<internal::TensorSpec> specs = {
+      {"0", tensorflow::DT_INT32, {1}},
+      {"1", tensorflow::DT_FLOAT, {1}},
+  };
+  auto chunker = std::make_shared<Chunker>(
+      specs, std::make_shared<ConstantChunkerOptions>(
+                 /*max_chunk_length=*/2, /*num_keep_alive_refs=*/2));
+
+  std::vector<std::weak_ptr<CellRef>> refs;
+  REVERB_ASSERT_OK(chunker->AppendColumns(
+      {MakeConstantTensor<tensorflow::DT_INT32>({1}, 1),
+       MakeConstantTensor<tensorflow::DT_FLOAT>({1}, 2)},
+      {/*episode_id=*/1, /*step=*/0}, &refs));
+
+  // Chunk is not finalized yet so reads are served from the buffer.
+  ASSERT_FALSE(refs[0].lock()->IsReady());
+
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(refs[0].lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(
+      got, MakeConstantTensor<tensorflow::DT_INT32>({1}, 1));
+  REVERB_ASSERT_OK(refs[1].lock()->GetData(&got));
+  test::ExpectTensorEqual<float>(
+      got, MakeConstantTensor<tensorflow::DT_FLOAT>({1}, 2));
+}
+
+TEST(Chunker, AppendColumnsValidatesTensorCount) {
+  std::vector<internal::TensorSpec> specs = {
+      {"0", tensorflow::DT_INT32, {1}},
+      {"1", tensorflow::DT_FLOAT, {1}},
+  };
+  auto chunker = std::make_shared<Chunker>(
+      specs, std::make_shared<ConstantChunkerOptions>(
+                 /*max_chunk_length=*/2, /*num_keep_alive_refs=*/2));
+
+  std::vector<std::weak_ptr<CellRef>> refs;
+  auto status =
+      chunker->AppendColumns({MakeConstantTensor<tensorflow::DT_INT32>({1}, 1)},
+                             {/*episode_id=*/1, /*step=*/0}, &refs);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+}
+
 TEST(ValidateChunkerOptions, Valid) {
   auto options =
       absl::make_unique<ConstantChunkerOptions>(/*max_chunk_length=*/2,
@@ -835,6 +1111,64 @@ TEST(AutoTunedChunkerOptions, ConstantNonOverlappingItems) {
   EXPECT_EQ(options->GetMaxChunkLength(), 10);
 }
 
+TEST(TargetSizeChunkerOptions, ConvergesTowardsTargetByteSize) {
+  // Random float rows of 100x100 compress to roughly 40kB each so with a
+  // target of 128kB and long items the chunk length should settle around 3.
+  auto options = std::make_shared<TargetSizeChunkerOptions>(
+      /*num_keep_alive_refs=*/10, /*target_chunk_size_bytes=*/128 * 1024);
+  auto chunker = std::make_shared<Chunker>(kLargeFloatSpec, options);
+
+  tensorflow::TensorShape shape;
+  ASSERT_TRUE(kLargeFloatSpec.shape.AsTensorShape(&shape));
+
+  std::deque<std::shared_ptr<CellRef>> last_10_refs;
+
+  for (int i = 0; i < 1000; i++) {
+    std::weak_ptr<CellRef> ref;
+    REVERB_EXPECT_OK(
+        chunker->Append(MakeRandomTensor<tensorflow::DT_FLOAT>(shape, 0, 1),
+                        {/*episode_id=*/1, /*step=*/i}, &ref));
+    last_10_refs.push_back(ref.lock());
+    if (last_10_refs.size() > 10) {
+      last_10_refs.pop_front();
+    }
+
+    if (std::all_of(last_10_refs.begin(), last_10_refs.end(),
+                    [](const auto& r) { return r->IsReady(); })) {
+      REVERB_EXPECT_OK(chunker->OnItemFinalized(
+          PrioritizedItem(), std::vector<std::shared_ptr<CellRef>>(
+                                 last_10_refs.begin(), last_10_refs.end())));
+    }
+  }
+
+  EXPECT_GE(options->GetMaxChunkLength(), 2);
+  EXPECT_LE(options->GetMaxChunkLength(), 4);
+}
+
+TEST(TargetSizeChunkerOptions, ClipsToItemLength) {
+  // Single step items cap the chunk length at 1 even though far larger chunks
+  // would be required to reach the byte size target.
+  auto options = std::make_shared<TargetSizeChunkerOptions>(
+      /*num_keep_alive_refs=*/10, /*target_chunk_size_bytes=*/1024 * 1024);
+  auto chunker = std::make_shared<Chunker>(kLargeFloatSpec, options);
+
+  tensorflow::TensorShape shape;
+  ASSERT_TRUE(kLargeFloatSpec.shape.AsTensorShape(&shape));
+
+  for (int i = 0; i < 100; i++) {
+    std::weak_ptr<CellRef> ref;
+    REVERB_EXPECT_OK(
+        chunker->Append(MakeRandomTensor<tensorflow::DT_FLOAT>(shape, 0, 1),
+                        {/*episode_id=*/1, /*step=*/i}, &ref));
+    if (ref.lock()->IsReady()) {
+      REVERB_EXPECT_OK(
+          chunker->OnItemFinalized(PrioritizedItem(), {ref.lock()}));
+    }
+  }
+
+  EXPECT_EQ(options->GetMaxChunkLength(), 1);
+}
+
 }  // namespace
 }  // namespace reverb
 }  // namespace deepmind
@@ -25,11 +25,15 @@
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "absl/types/optional.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
 #include "reverb/cc/chunker.h"
 #include "reverb/cc/patterns.pb.h"
 #include "reverb/cc/platform/grpc_utils.h"
+#include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/priority_update_buffer.h"
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/streaming_trajectory_writer.h"
@@ -51,8 +55,60 @@ grpc::ChannelArguments CreateChannelArguments() {
   return arguments;
 }
 
+// Process wide pool of channels shared by every `Client` (and the samplers
+// they create) connecting to the same target. gRPC multiplexes all streams of
+// a channel over one HTTP/2 connection, so pooling turns the many thin
+// connections of a process with dozens of samplers into a few fat ones whose
+// TCP handshake and slow start costs are paid once. A small fixed number of
+// channels is kept per target and handed out round robin so the streams
+// spread across connections and a single connection's concurrent stream limit
+// (and head of line blocking) does not become a bottleneck.
+class ChannelPool {
+ public:
+  // Channels kept per target. HTTP/2 servers typically allow ~100 concurrent
+  // streams per connection; four connections comfortably cover the stream
+  // fan-out of a process full of samplers while still amortizing connection
+  // setup.
+  static constexpr int kChannelsPerTarget = 4;
+
+  std::shared_ptr<grpc::ChannelInterface> GetChannel(absl::string_view target)
+      ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    TargetChannels& entry = channels_[std::string(target)];
+    if (entry.channels.empty()) {
+      entry.channels.reserve(kChannelsPerTarget);
+      for (int i = 0; i < kChannelsPerTarget; i++) {
+        grpc::ChannelArguments arguments = CreateChannelArguments();
+        // gRPC collapses channels with identical arguments onto shared
+        // subchannels (i.e. one connection); a distinct dummy argument per
+        // pool slot keeps the connections separate.
+        arguments.SetInt("reverb.channel_pool_index", i);
+        entry.channels.push_back(CreateCustomGrpcChannel(
+            target, MakeChannelCredentials(), arguments));
+      }
+    }
+    return entry.channels[entry.next_channel++ % kChannelsPerTarget];
+  }
+
+ private:
+  struct TargetChannels {
+    std::vector<std::shared_ptr<grpc::ChannelInterface>> channels;
+    size_t next_channel = 0;
+  };
+
+  absl::Mutex mu_;
+  internal::flat_hash_map<std::string, TargetChannels> channels_
+      ABSL_GUARDED_BY(mu_);
+};
+
 }  // namespace
 
+std::shared_ptr<grpc::ChannelInterface> GetPooledChannel(
+    absl::string_view target) {
+  static ChannelPool* pool = new ChannelPool();
+  return pool->GetChannel(target);
+}
+
 Client::Client(std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub)
     : stub_(std::move(stub)) {
   REVERB_CHECK(stub_ != nullptr);
@@ -60,8 +116,8 @@ Client::Client(std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stu
 
 Client::Client(absl::string_view server_address)
     : stub_(/* grpc_gen:: */ReverbService::NewStub(
-          CreateCustomGrpcChannel(server_address, MakeChannelCredentials(),
-                                  CreateChannelArguments()))) {}
+          GetPooledChannel(server_address))),
+      server_address_(server_address) {}
 
 absl::Status Client::MaybeUpdateServerInfoCache(
     absl::Duration timeout,
@@ -178,6 +234,49 @@ absl::Status Client::NewSampler(
   return absl::OkStatus();
 }
 
+absl::Status Client::NewReplicaSampler(
+    const std::string& table, const Sampler::Options& options,
+    const std::vector<std::string>& replica_addresses,
+    absl::Duration validation_timeout, std::unique_ptr<Sampler>* sampler) {
+  Sampler::Options replica_options = options;
+  replica_options.stubs_are_replicas = true;
+  REVERB_RETURN_IF_ERROR(replica_options.Validate());
+
+  internal::DtypesAndShapes dtypes_and_shapes;
+  auto status = GetDtypesAndShapesForSampler(table, validation_timeout,
+                                             &dtypes_and_shapes);
+  if (absl::IsDeadlineExceeded(status)) {
+    REVERB_LOG(REVERB_WARNING)
+        << "Unable to validate shapes and dtypes of new sampler for '" << table
+        << "' as server could not be reached in time (" << validation_timeout
+        << "). We were thus unable to fetch signature from server. The "
+           "sampler will be constructed without validating the dtypes "
+           "and shapes.";
+  }
+
+  std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+      stubs;
+  stubs.reserve(replica_addresses.size() + 1);
+  // When the target address is known, every sampler draws a fresh channel
+  // from the pool instead of piggybacking on the client's own channel, so
+  // the streams of many samplers spread round robin across the pooled
+  // connections.
+  if (!server_address_.empty()) {
+    stubs.push_back(/* grpc_gen:: */ReverbService::NewStub(
+        GetPooledChannel(server_address_)));
+  } else {
+    stubs.push_back(stub_);
+  }
+  for (const auto& address : replica_addresses) {
+    stubs.push_back(
+        /* grpc_gen:: */ReverbService::NewStub(GetPooledChannel(address)));
+  }
+  *sampler = absl::make_unique<Sampler>(std::move(stubs), table,
+                                        replica_options,
+                                        std::move(dtypes_and_shapes));
+  return absl::OkStatus();
+}
+
 absl::Status Client::NewSampler(const std::string& table,
                                 const Sampler::Options& options,
                                 absl::Duration validation_timeout,
@@ -225,11 +324,11 @@ absl::Status Client::GetDtypesAndShapesForSampler(
     // Found the table, but signature is empty.
     dtypes_and_shapes->reset();
   } else {
-    // Found the table, and found a signature.  Add the 4-element prefix for the
+    // Found the table, and found a signature.  Add the 7-element prefix for the
     // SampleInfo.
     const auto& old_dtypes_and_shapes = iter->second;
     std::vector<internal::TensorSpec> dtypes_and_shapes_vec;
-    dtypes_and_shapes_vec.reserve(4 + old_dtypes_and_shapes->size());
+    dtypes_and_shapes_vec.reserve(7 + old_dtypes_and_shapes->size());
     // First element of sampled signature is the key.
     dtypes_and_shapes_vec.push_back(
         {"key", tensorflow::DT_UINT64, tensorflow::PartialTensorShape({})});
@@ -242,6 +341,15 @@ absl::Status Client::GetDtypesAndShapesForSampler(
     // Fourth element of sampled signature is the priority value.
     dtypes_and_shapes_vec.push_back({"priority", tensorflow::DT_DOUBLE,
                                      tensorflow::PartialTensorShape({})});
+    // The remaining info elements are the server side timing breakdown.
+    dtypes_and_shapes_vec.push_back({"queued_for_secs", tensorflow::DT_DOUBLE,
+                                     tensorflow::PartialTensorShape({})});
+    dtypes_and_shapes_vec.push_back({"rate_limiter_wait_secs",
+                                     tensorflow::DT_DOUBLE,
+                                     tensorflow::PartialTensorShape({})});
+    dtypes_and_shapes_vec.push_back({"serialize_time_secs",
+                                     tensorflow::DT_DOUBLE,
+                                     tensorflow::PartialTensorShape({})});
     for (const auto& dtype_and_shape : *old_dtypes_and_shapes) {
       dtypes_and_shapes_vec.push_back(dtype_and_shape);
     }
@@ -337,6 +445,34 @@ absl::Status Client::ServerInfo(struct ServerInfo* info) {
   return ServerInfo(absl::InfiniteDuration(), info);
 }
 
+absl::Status Client::ServerInfoStream(
+    absl::Duration min_interval, const std::vector<std::string>& table_names,
+    std::function<bool(const ServerInfoStreamResponse&)> callback) {
+  grpc::ClientContext context;
+  context.set_wait_for_ready(true);
+
+  ServerInfoStreamRequest request;
+  request.set_min_interval_ms(absl::ToInt64Milliseconds(min_interval));
+  for (const auto& name : table_names) {
+    request.add_table_names(name);
+  }
+
+  auto stream = stub_->ServerInfoStream(&context, request);
+  ServerInfoStreamResponse response;
+  while (stream->Read(&response)) {
+    if (!callback(response)) {
+      context.TryCancel();
+      // Drain whatever the server pushed before observing the cancellation
+      // so `Finish` does not block on unread messages.
+      while (stream->Read(&response)) {
+      }
+      stream->Finish();
+      return absl::OkStatus();
+    }
+  }
+  return FromGrpcStatus(stream->Finish());
+}
+
 absl::Status Client::ServerInfo(absl::Duration timeout,
                                 struct ServerInfo* info) {
   struct ServerInfo local_info;
@@ -364,6 +500,31 @@ absl::Status Client::LockedUpdateServerInfoCache(
   return absl::OkStatus();
 }
 
+absl::Status Client::TableWatermarks(
+    const std::vector<std::string>& table_names, absl::Duration timeout,
+    std::vector<TableWatermark>* watermarks) {
+  grpc::ClientContext context;
+  context.set_wait_for_ready(true);
+  if (timeout != absl::InfiniteDuration()) {
+    context.set_deadline(std::chrono::system_clock::now() +
+                         absl::ToChronoSeconds(timeout));
+  }
+  TableWatermarksRequest request;
+  for (const auto& name : table_names) {
+    request.add_table_names(name);
+  }
+  TableWatermarksResponse response;
+  REVERB_RETURN_IF_ERROR(
+      FromGrpcStatus(stub_->TableWatermarks(&context, request, &response)));
+  watermarks->clear();
+  watermarks->reserve(response.watermarks_size());
+  for (const auto& watermark : response.watermarks()) {
+    watermarks->push_back({watermark.table_name(), watermark.current_size(),
+                           watermark.num_episodes()});
+  }
+  return absl::OkStatus();
+}
+
 absl::Status Client::Reset(const std::string& table) {
   grpc::ClientContext context;
   context.set_wait_for_ready(true);
@@ -373,6 +534,18 @@ absl::Status Client::Reset(const std::string& table) {
   return FromGrpcStatus(stub_->Reset(&context, request, &response));
 }
 
+absl::Status Client::SetPriorityExponent(const std::string& table,
+                                         double priority_exponent) {
+  grpc::ClientContext context;
+  context.set_wait_for_ready(true);
+  SetPriorityExponentRequest request;
+  request.set_table(table);
+  request.set_priority_exponent(priority_exponent);
+  SetPriorityExponentResponse response;
+  return FromGrpcStatus(
+      stub_->SetPriorityExponent(&context, request, &response));
+}
+
 absl::Status Client::Checkpoint(std::string* path) {
   grpc::ClientContext context;
   context.set_fail_fast(true);
@@ -384,6 +557,60 @@ absl::Status Client::Checkpoint(std::string* path) {
   return absl::OkStatus();
 }
 
+absl::Status Client::ImportCheckpoint(
+    const std::string& checkpoint_path,
+    const std::vector<std::string>& table_names,
+    std::map<std::string, int64_t>* num_items_per_table) {
+  grpc::ClientContext context;
+  context.set_fail_fast(true);
+  ImportCheckpointRequest request;
+  request.set_checkpoint_path(checkpoint_path);
+  for (const auto& table_name : table_names) {
+    request.add_table_names(table_name);
+  }
+  ImportCheckpointResponse response;
+  REVERB_RETURN_IF_ERROR(
+      FromGrpcStatus(stub_->ImportCheckpoint(&context, request, &response)));
+  num_items_per_table->clear();
+  for (const auto& imported : response.tables()) {
+    (*num_items_per_table)[imported.table_name()] = imported.num_items();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Client::ForkTable(const std::string& table,
+                               const std::string& new_table_name,
+                               int64_t* num_items) {
+  grpc::ClientContext context;
+  context.set_fail_fast(true);
+  ForkTableRequest request;
+  request.set_table(table);
+  request.set_new_table_name(new_table_name);
+  ForkTableResponse response;
+  REVERB_RETURN_IF_ERROR(
+      FromGrpcStatus(stub_->ForkTable(&context, request, &response)));
+  *num_items = response.num_items();
+  return absl::OkStatus();
+}
+
+absl::Status Client::MoveItems(const std::string& source_table,
+                               const std::string& target_table,
+                               uint64_t min_key, uint64_t max_key,
+                               int64_t* num_items) {
+  grpc::ClientContext context;
+  context.set_fail_fast(true);
+  MoveItemsRequest request;
+  request.set_source_table(source_table);
+  request.set_target_table(target_table);
+  request.set_min_key(min_key);
+  request.set_max_key(max_key);
+  MoveItemsResponse response;
+  REVERB_RETURN_IF_ERROR(
+      FromGrpcStatus(stub_->MoveItems(&context, request, &response)));
+  *num_items = response.num_items();
+  return absl::OkStatus();
+}
+
 absl::Status Client::GetLocalTablePtr(absl::string_view table_name,
                                       std::shared_ptr<Table>* out) {
   grpc::ClientContext context;
@@ -447,6 +674,14 @@ absl::Status Client::NewStreamingTrajectoryWriter(
   return absl::OkStatus();
 }
 
+absl::Status Client::NewPriorityUpdateBuffer(
+    const std::string& table, const PriorityUpdateBuffer::Options& options,
+    std::unique_ptr<PriorityUpdateBuffer>* buffer) {
+  REVERB_RETURN_IF_ERROR(options.Validate());
+  *buffer = absl::make_unique<PriorityUpdateBuffer>(stub_, table, options);
+  return absl::OkStatus();
+}
+
 absl::Status Client::NewStructuredWriter(
     std::vector<StructuredWriterConfig> configs,
     std::unique_ptr<StructuredWriter>* writer) {
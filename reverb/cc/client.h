@@ -17,6 +17,8 @@
 
 #include <stddef.h>
 
+#include <functional>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -29,6 +31,7 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "reverb/cc/patterns.pb.h"
+#include "reverb/cc/priority_update_buffer.h"
 #include "reverb/cc/reverb_service.grpc.pb.h"
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/sampler.h"
@@ -44,6 +47,14 @@ namespace reverb {
 
 class Writer;
 
+// Returns a channel to `target` from the process wide channel pool. Channels
+// to the same target are shared by all clients of the process: a small fixed
+// number of connections is kept per target and handed out round robin, so
+// many samplers multiplex their streams over a few fat HTTP/2 connections
+// instead of each opening a thin one.
+std::shared_ptr<grpc::ChannelInterface> GetPooledChannel(
+    absl::string_view target);
+
 // See ReverbService proto definition for documentation.
 class Client {
  public:
@@ -78,6 +89,20 @@ class Client {
                           absl::Duration validation_timeout,
                           std::unique_ptr<Sampler>* sampler);
 
+  // Upon successful return, `sampler` contains a Sampler which spreads its
+  // streams over this client's server and the servers at
+  // `replica_addresses`, all serving identical data (typically replicas of
+  // the same checkpoint). Streams are balanced by observed latency and may
+  // be hedged; see `Sampler::Options::stubs_are_replicas` and
+  // `Sampler::Options::replica_hedge_timeout`. Signature validation runs
+  // against this client's server only and honours `validation_timeout` like
+  // `NewSampler`.
+  absl::Status NewReplicaSampler(const std::string& table,
+                                 const Sampler::Options& options,
+                                 const std::vector<std::string>& replica_addresses,
+                                 absl::Duration validation_timeout,
+                                 std::unique_ptr<Sampler>* sampler);
+
   // Upon successful return, `sampler` will contain an instance of
   // Sampler which does not perform any validation of shapes and dtypes.
   absl::Status NewSamplerWithoutSignatureCheck(
@@ -122,13 +147,76 @@ class Client {
 
   absl::Status Reset(const std::string& table);
 
+  // Changes the priority exponent of `table`'s sampling selector. The server
+  // recomputes all sampling weights from its stored raw priorities, so this
+  // replaces a client-driven `MutatePriorities` sweep when annealing the
+  // exponent. Fails with `FailedPrecondition` if the table's selector does
+  // not apply a priority exponent.
+  absl::Status SetPriorityExponent(const std::string& table,
+                                   double priority_exponent);
+
   absl::Status Checkpoint(std::string* path);
 
+  // Imports tables from the checkpoint at `checkpoint_path` into the running
+  // server. When `table_names` is empty all tables present in both the
+  // checkpoint and the server are imported; otherwise every named table must
+  // exist in both. On success `num_items_per_table` maps each imported table
+  // to the number of inserted items.
+  absl::Status ImportCheckpoint(
+      const std::string& checkpoint_path,
+      const std::vector<std::string>& table_names,
+      std::map<std::string, int64_t>* num_items_per_table);
+
+  // Clones table `table` into a new table `new_table_name` on the server.
+  // The clone holds a consistent snapshot of the source table's items and
+  // shares all chunk data with it, so forking is cheap regardless of how
+  // much data the items reference. On success `num_items` is set to the
+  // number of items copied into the new table.
+  absl::Status ForkTable(const std::string& table,
+                         const std::string& new_table_name,
+                         int64_t* num_items);
+
+  // Moves every item whose key lies in the inclusive range [`min_key`,
+  // `max_key`] from `source_table` to `target_table` on the server. Only
+  // item metadata and selector entries are transferred; chunk payloads stay
+  // in the server's shared chunk store and are never copied or
+  // retransmitted. On success `num_items` is set to the number of items
+  // moved.
+  absl::Status MoveItems(const std::string& source_table,
+                         const std::string& target_table, uint64_t min_key,
+                         uint64_t max_key, int64_t* num_items);
+
   // Requests ServerInfo. Forces an update of internal signature caches.
   absl::Status ServerInfo(absl::Duration timeout, struct ServerInfo* info);
   // Waits indefinitely for server to respond.
   absl::Status ServerInfo(struct ServerInfo* info);
 
+  // Subscribes to incremental table metadata updates instead of polling
+  // `ServerInfo`. The server pushes the info of the tables whose state
+  // changed at most every `min_interval`; the first update contains all
+  // tables (or, when `table_names` is non-empty, the named ones). `callback`
+  // is invoked once per update and the call blocks until the callback returns
+  // false, in which case OK is returned, or the stream breaks.
+  absl::Status ServerInfoStream(
+      absl::Duration min_interval, const std::vector<std::string>& table_names,
+      std::function<bool(const ServerInfoStreamResponse&)> callback);
+
+  // Size watermarks of a single table; mirrors
+  // `TableWatermarksResponse.Watermark` in reverb_service.proto.
+  struct TableWatermark {
+    std::string table_name;
+    int64_t current_size;
+    int64_t num_episodes;
+  };
+
+  // Reads the size watermarks of the named tables (of all tables when
+  // `table_names` is empty). Backed by the lightweight `TableWatermarks` RPC
+  // which only reads atomically published counters, so unlike `ServerInfo`
+  // it is cheap enough for high frequency backpressure polling.
+  absl::Status TableWatermarks(const std::vector<std::string>& table_names,
+                               absl::Duration timeout,
+                               std::vector<TableWatermark>* watermarks);
+
   // Validates `options` and if valid, creates a new `TrajectoryWriter`.
   absl::Status NewTrajectoryWriter(const TrajectoryWriter::Options& options,
                                    std::unique_ptr<TrajectoryWriter>* writer);
@@ -153,9 +241,22 @@ class Client {
       const TrajectoryWriter::Options& options,
       std::unique_ptr<StreamingTrajectoryWriter>* writer);
 
+  // Validates `options` and if valid, creates a new `PriorityUpdateBuffer`
+  // which coalesces priority updates for `table` and sends them on a
+  // background thread. See `MutatePriorities` for the unbuffered
+  // alternative.
+  absl::Status NewPriorityUpdateBuffer(
+      const std::string& table, const PriorityUpdateBuffer::Options& options,
+      std::unique_ptr<PriorityUpdateBuffer>* buffer);
+
  private:
   const std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub_;
 
+  // Address the client was constructed with, or empty when an explicit stub
+  // was provided. When set, samplers draw their own channels from the process
+  // wide pool instead of sharing `stub_`.
+  const std::string server_address_;
+
   // Request direct access to Table managed by server. Result will only be
   // populated when the stub was created using a localhost address of a server
   // running in the same process.
@@ -154,6 +154,26 @@ TEST(ClientTest, ServerInfoRequestFilled) {
   EXPECT_THAT(info.table_info[0], testing::EqualsProto(expected_info));
 }
 
+TEST(ClientTest, ChannelPoolSharesChannelsPerTarget) {
+  // Channel creation is lazy so unreachable targets are fine here. The pool
+  // keeps a small fixed number of channels per target and hands them out
+  // round robin, so the cycle must repeat and targets must not share
+  // channels.
+  std::vector<std::shared_ptr<grpc::ChannelInterface>> first_cycle;
+  for (int i = 0; i < 4; i++) {
+    first_cycle.push_back(GetPooledChannel("localhost:11111"));
+  }
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(GetPooledChannel("localhost:11111"), first_cycle[i]);
+  }
+  for (int i = 1; i < 4; i++) {
+    EXPECT_NE(first_cycle[0], first_cycle[i]);
+  }
+  EXPECT_THAT(first_cycle,
+              ::testing::Not(::testing::Contains(
+                  GetPooledChannel("localhost:22222"))));
+}
+
 TEST(ClientTest, NewTrajectoryWriterValidatesOptions) {
   auto stub = std::make_shared<FakeStub>();
   Client client(stub);
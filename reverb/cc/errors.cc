@@ -14,7 +14,10 @@
 
 #include "reverb/cc/errors.h"
 
+#include "absl/status/status.h"
+#include "absl/strings/cord.h"
 #include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
 
 namespace deepmind {
 namespace reverb {
@@ -25,15 +28,65 @@ namespace {
 constexpr auto kTimeoutExceededErrorMessage =
     "Rate Limiter: Timeout exceeded before the right to insert was acquired.";
 
+constexpr auto kQueueClosedErrorMessage = "Queue is closed.";
+
+// Type URL of the payload identifying the control-flow condition a status
+// represents. The payload value is one of the constants below.
+constexpr absl::string_view kStatusPayloadUrl =
+    "type.googleapis.com/reverb.StatusCondition";
+
+constexpr absl::string_view kRateLimiterTimeoutCondition =
+    "rate_limiter_timeout";
+constexpr absl::string_view kQueueClosedCondition = "queue_closed";
+
+absl::Status MakeStatusWithCondition(absl::StatusCode code,
+                                     absl::string_view message,
+                                     absl::string_view condition) {
+  absl::Status status(code, message);
+  status.SetPayload(kStatusPayloadUrl, absl::Cord(condition));
+  return status;
+}
+
+// Returns true iff `status` carries `condition` as its typed payload, or,
+// for statuses whose payload was stripped by a gRPC round trip, iff the
+// message contains `message`.
+bool HasCondition(const absl::Status& status, absl::string_view condition,
+                  absl::string_view message) {
+  if (absl::optional<absl::Cord> payload =
+          status.GetPayload(kStatusPayloadUrl);
+      payload.has_value()) {
+    return *payload == condition;
+  }
+  return absl::StrContains(status.message(), message);
+}
+
 }  // namespace
 
 absl::Status RateLimiterTimeout() {
-  return absl::DeadlineExceededError(kTimeoutExceededErrorMessage);
+  static const absl::Status* singleton = new absl::Status(
+      MakeStatusWithCondition(absl::StatusCode::kDeadlineExceeded,
+                              kTimeoutExceededErrorMessage,
+                              kRateLimiterTimeoutCondition));
+  return *singleton;
 }
 
 bool IsRateLimiterTimeout(absl::Status status) {
   return absl::IsDeadlineExceeded(status) &&
-         absl::StrContains(status.message(), kTimeoutExceededErrorMessage);
+         HasCondition(status, kRateLimiterTimeoutCondition,
+                      kTimeoutExceededErrorMessage);
+}
+
+absl::Status QueueClosed() {
+  static const absl::Status* singleton = new absl::Status(
+      MakeStatusWithCondition(absl::StatusCode::kCancelled,
+                              kQueueClosedErrorMessage,
+                              kQueueClosedCondition));
+  return *singleton;
+}
+
+bool IsQueueClosed(absl::Status status) {
+  return absl::IsCancelled(status) &&
+         HasCondition(status, kQueueClosedCondition, kQueueClosedErrorMessage);
 }
 
 }  // namespace errors
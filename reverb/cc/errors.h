@@ -21,10 +21,27 @@ namespace deepmind {
 namespace reverb {
 namespace errors {
 
+// The statuses below signal common control-flow conditions (backpressure,
+// shutdown) rather than genuine failures, so they are created once and the
+// factories hand out copies of the singletons. Copying an `absl::Status`
+// only bumps a reference count, which means timing out a blocked call or
+// draining a closed queue allocates nothing even when it happens millions
+// of times. Each singleton carries a typed payload (see errors.cc) which
+// the `Is*` predicates branch on instead of matching message text; statuses
+// that crossed the gRPC boundary lose their payloads and fall back to the
+// message match.
+
+// Returned when a blocking call is terminated because the timeout was
+// exceeded before the rate limiter admitted the operation.
 absl::Status RateLimiterTimeout();
 
 bool IsRateLimiterTimeout(absl::Status status);
 
+// Returned by queue operations after the queue has been closed.
+absl::Status QueueClosed();
+
+bool IsQueueClosed(absl::Status status);
+
 }  // namespace errors
 }  // namespace reverb
 }  // namespace deepmind
@@ -0,0 +1,245 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Loadtest client which drives a running Reverb server with configurable
+// cohorts of writers and samplers and reports the achieved throughput and
+// latency percentiles.
+//
+// Each writer runs a `TrajectoryWriter` that appends episodes of
+// `--episode_length` steps with `--num_columns` float tensors of
+// `--column_elements` elements per step, creating one item per step. Each
+// sampler runs a `Sampler` with `--sampler_workers` worker threads calling
+// `GetNextTrajectory` in a loop. The target table must already exist on the
+// server, e.g. one started with reverb/server_executable.
+//
+// Example:
+//   bazel run -c opt //reverb/cc/loadtest:loadtest -- \
+//       --server_address=localhost:8000 --table=my_table \
+//       --num_writers=8 --num_samplers=4 --runtime_secs=60
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "reverb/cc/chunker.h"
+#include "reverb/cc/client.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/sampler.h"
+#include "reverb/cc/trajectory_writer.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.pb.h"
+
+ABSL_FLAG(std::string, server_address, "",
+          "Address of the Reverb server to drive, e.g. localhost:8000.");
+ABSL_FLAG(std::string, table, "", "Name of the table to write to and sample.");
+ABSL_FLAG(int, num_writers, 1, "Number of concurrent writer clients.");
+ABSL_FLAG(int, num_samplers, 1, "Number of concurrent sampler clients.");
+ABSL_FLAG(int, sampler_workers, 1,
+          "Number of worker threads used by each sampler client.");
+ABSL_FLAG(int, episode_length, 100, "Number of steps per written episode.");
+ABSL_FLAG(int, num_columns, 4, "Number of tensor columns per step.");
+ABSL_FLAG(int, column_elements, 128,
+          "Number of float elements in each column tensor.");
+ABSL_FLAG(int, runtime_secs, 60, "How long to generate load for.");
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// Thread safe recorder of operation latencies shared by a cohort of threads.
+// The loadtest runs for a bounded time so simply keeping all observations and
+// sorting at report time is affordable and gives exact percentiles.
+class LatencyRecorder {
+ public:
+  void Add(absl::Duration latency) {
+    absl::MutexLock lock(&mu_);
+    latencies_secs_.push_back(absl::ToDoubleSeconds(latency));
+  }
+
+  // Returns a human readable report of the throughput and latency
+  // percentiles. `items_per_op` scales operation count to item count (e.g.
+  // episode flushes confirm `episode_length` items each).
+  std::string Report(absl::string_view name, absl::Duration runtime,
+                     int items_per_op) {
+    absl::MutexLock lock(&mu_);
+    if (latencies_secs_.empty()) {
+      return absl::StrFormat("%s: no completed operations", name);
+    }
+    std::sort(latencies_secs_.begin(), latencies_secs_.end());
+    auto percentile = [this](double q) {
+      return latencies_secs_[std::min(
+          latencies_secs_.size() - 1,
+          static_cast<size_t>(q * latencies_secs_.size()))];
+    };
+    const double items = latencies_secs_.size() * items_per_op;
+    return absl::StrFormat(
+        "%s: %.0f items in %.1fs (%.1f items/s), latency p50=%.2fms "
+        "p90=%.2fms p99=%.2fms max=%.2fms",
+        name, items, absl::ToDoubleSeconds(runtime),
+        items / absl::ToDoubleSeconds(runtime), percentile(0.5) * 1000,
+        percentile(0.9) * 1000, percentile(0.99) * 1000,
+        latencies_secs_.back() * 1000);
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::vector<double> latencies_secs_ ABSL_GUARDED_BY(mu_);
+};
+
+// Writes episodes until `stop` is notified. Each `EndEpisode` call flushes
+// and confirms all items of the episode; its latency is recorded as the
+// insert latency.
+void RunWriter(const std::string& server_address, const std::string& table,
+               int episode_length, int num_columns, int column_elements,
+               const absl::Notification* stop, LatencyRecorder* recorder) {
+  Client client(server_address);
+
+  TrajectoryWriter::Options options;
+  options.chunker_options = std::make_shared<ConstantChunkerOptions>(
+      /*max_chunk_length=*/episode_length,
+      /*num_keep_alive_refs=*/episode_length);
+  std::unique_ptr<TrajectoryWriter> writer;
+  REVERB_CHECK_OK(client.NewTrajectoryWriter(options, &writer));
+
+  // The same (randomly initialised) tensors are appended on every step. The
+  // writer holds the buffers by reference so sharing them keeps the client
+  // side cost of the loadtest low.
+  absl::BitGen gen;
+  std::vector<tensorflow::Tensor> row;
+  for (int i = 0; i < num_columns; i++) {
+    tensorflow::Tensor tensor(tensorflow::DT_FLOAT, {column_elements});
+    for (int j = 0; j < tensor.NumElements(); j++) {
+      tensor.flat<float>()(j) = absl::Uniform<float>(gen, 0, 1);
+    }
+    row.push_back(std::move(tensor));
+  }
+
+  while (!stop->HasBeenNotified()) {
+    for (int step = 0; step < episode_length; step++) {
+      std::vector<absl::optional<tensorflow::Tensor>> data(row.begin(),
+                                                           row.end());
+      std::vector<absl::optional<std::weak_ptr<CellRef>>> refs;
+      REVERB_CHECK_OK(writer->Append(std::move(data), &refs));
+
+      std::vector<TrajectoryColumn> trajectory;
+      for (auto& ref : refs) {
+        trajectory.push_back(
+            TrajectoryColumn({ref.value()}, /*squeeze=*/false));
+      }
+      REVERB_CHECK_OK(writer->CreateItem(table, /*priority=*/1.0, trajectory));
+    }
+
+    const absl::Time start = absl::Now();
+    absl::Status status =
+        writer->EndEpisode(/*clear_buffers=*/true, absl::Seconds(60));
+    if (absl::IsDeadlineExceeded(status)) {
+      REVERB_LOG(REVERB_WARNING)
+          << "Writer blocked on the rate limiter for more than 60s.";
+      continue;
+    }
+    REVERB_CHECK_OK(status);
+    recorder->Add(absl::Now() - start);
+  }
+}
+
+// Samples trajectories until `stop` is notified. The rate limiter timeout is
+// kept short so that the thread notices the stop signal even when the table
+// cannot serve samples.
+void RunSampler(const std::string& server_address, const std::string& table,
+                int sampler_workers, const absl::Notification* stop,
+                LatencyRecorder* recorder) {
+  Client client(server_address);
+
+  Sampler::Options options;
+  options.num_workers = sampler_workers;
+  options.rate_limiter_timeout = absl::Seconds(1);
+  std::unique_ptr<Sampler> sampler;
+  REVERB_CHECK_OK(
+      client.NewSamplerWithoutSignatureCheck(table, options, &sampler));
+
+  while (!stop->HasBeenNotified()) {
+    std::vector<tensorflow::Tensor> trajectory;
+    const absl::Time start = absl::Now();
+    absl::Status status = sampler->GetNextTrajectory(&trajectory);
+    if (absl::IsDeadlineExceeded(status)) continue;
+    REVERB_CHECK_OK(status);
+    recorder->Add(absl::Now() - start);
+  }
+}
+
+int Loadtest() {
+  const std::string server_address = absl::GetFlag(FLAGS_server_address);
+  const std::string table = absl::GetFlag(FLAGS_table);
+  REVERB_CHECK(!server_address.empty()) << "--server_address must be set.";
+  REVERB_CHECK(!table.empty()) << "--table must be set.";
+  const int episode_length = absl::GetFlag(FLAGS_episode_length);
+
+  absl::Notification stop;
+  LatencyRecorder insert_recorder;
+  LatencyRecorder sample_recorder;
+
+  std::vector<std::unique_ptr<internal::Thread>> threads;
+  for (int i = 0; i < absl::GetFlag(FLAGS_num_writers); i++) {
+    threads.push_back(internal::StartThread(
+        absl::StrFormat("loadtest_writer_%d", i), [&, episode_length] {
+          RunWriter(server_address, table, episode_length,
+                    absl::GetFlag(FLAGS_num_columns),
+                    absl::GetFlag(FLAGS_column_elements), &stop,
+                    &insert_recorder);
+        }));
+  }
+  for (int i = 0; i < absl::GetFlag(FLAGS_num_samplers); i++) {
+    threads.push_back(internal::StartThread(
+        absl::StrFormat("loadtest_sampler_%d", i), [&] {
+          RunSampler(server_address, table,
+                     absl::GetFlag(FLAGS_sampler_workers), &stop,
+                     &sample_recorder);
+        }));
+  }
+
+  const absl::Duration runtime = absl::Seconds(absl::GetFlag(FLAGS_runtime_secs));
+  REVERB_LOG(REVERB_INFO) << "Generating load against " << server_address
+                          << " for " << runtime << ".";
+  absl::SleepFor(runtime);
+  stop.Notify();
+  threads.clear();  // Joins all writers and samplers.
+
+  REVERB_LOG(REVERB_INFO) << insert_recorder.Report("insert", runtime,
+                                                    episode_length);
+  REVERB_LOG(REVERB_INFO) << sample_recorder.Report("sample", runtime,
+                                                    /*items_per_op=*/1);
+  return 0;
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  return deepmind::reverb::Loadtest();
+}
@@ -0,0 +1,204 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/multicast_sample_group.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/support/trace.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// Number of items sampled from the table per produced batch. Batches that
+// exceed the table's maximum response size are split before delivery.
+constexpr int kMulticastSampleBatchSize = 64;
+
+constexpr absl::Duration kCallbackWaitTime = absl::Milliseconds(1);
+
+}  // namespace
+
+MulticastSampleBatch::MulticastSampleBatch(
+    std::vector<Table::SampledItem> samples) {
+  internal::ScopedTrace trace("chunk_gather");
+  const absl::Time serialize_started = absl::Now();
+  for (auto& sample : samples) {
+    auto& sample_item = sample.ref->item;
+    auto* entry = payload_.add_entries();
+    entry->set_end_of_sequence(true);
+    auto* item = entry->mutable_info()->mutable_item();
+    item->set_key(sample_item.key());
+    item->set_table(sample_item.table());
+    item->set_priority(sample.priority);
+    item->set_times_sampled(sample.times_sampled);
+    // The destructor releases these fields from the proto; they stay owned
+    // by the table item referenced from `items_`.
+    item->/*unsafe_arena_*/set_allocated_inserted_at(
+        sample_item.mutable_inserted_at());
+    item->/*unsafe_arena_*/set_allocated_flat_trajectory(
+        sample_item.mutable_flat_trajectory());
+    entry->mutable_info()->set_probability(sample.probability);
+    entry->mutable_info()->set_table_size(sample.table_size);
+    entry->mutable_info()->set_min_sampling_weight(sample.min_sampling_weight);
+    entry->mutable_info()->set_max_sampling_weight(sample.max_sampling_weight);
+    entry->mutable_info()->set_rate_limited(sample.rate_limited);
+    entry->mutable_info()->set_queued_for_secs(
+        absl::ToDoubleSeconds(sample.queued_for));
+    entry->mutable_info()->set_rate_limiter_wait_secs(
+        absl::ToDoubleSeconds(sample.rate_limiter_wait));
+    entry->mutable_info()->set_deterministic_sample_index(
+        sample.deterministic_sample_index);
+    entry->mutable_info()->set_chunk_compressed_bytes(
+        sample.chunk_compressed_bytes);
+    entry->mutable_info()->set_chunk_uncompressed_bytes(
+        sample.chunk_uncompressed_bytes);
+    for (const auto& chunk_ref : sample.ref->chunks) {
+      chunk_ref->PinPayload();
+      pinned_chunks_.push_back(chunk_ref);
+      entry->mutable_data()->UnsafeArenaAddAllocated(
+          const_cast<ChunkData*>(&chunk_ref->data()));
+    }
+    items_.push_back(std::move(sample.ref));
+  }
+  // Batch assembly is shared by all members of the group so every entry gets
+  // the same serialize time stamp.
+  const double serialize_time_secs =
+      absl::ToDoubleSeconds(absl::Now() - serialize_started);
+  for (auto& entry : *payload_.mutable_entries()) {
+    entry.mutable_info()->set_serialize_time_secs(serialize_time_secs);
+  }
+}
+
+MulticastSampleBatch::~MulticastSampleBatch() {
+  // The batch does not own the immutable parts of the payload. Make sure not
+  // to destroy them while destructing the payload.
+  for (auto& entry : *payload_.mutable_entries()) {
+    auto* item = entry.mutable_info()->mutable_item();
+    item->/*unsafe_arena_*/release_inserted_at();
+    item->/*unsafe_arena_*/release_flat_trajectory();
+    while (entry.data_size() != 0) {
+      entry.mutable_data()->UnsafeArenaReleaseLast();
+    }
+  }
+  for (auto& chunk : pinned_chunks_) {
+    chunk->UnpinPayload();
+  }
+}
+
+SampleStreamResponse* MulticastSampleBatch::mutable_payload() {
+  return &payload_;
+}
+
+int MulticastSampleBatch::num_samples() const { return payload_.entries_size(); }
+
+MulticastSampleGroup::MulticastSampleGroup(std::shared_ptr<Table> table)
+    : table_(std::move(table)),
+      sampling_done_(std::make_shared<Table::SamplingCallback>(
+          [this](Table::SampleRequest* request) { OnSamplesReady(request); })) {
+}
+
+MulticastSampleGroup::~MulticastSampleGroup() {
+  // As the callback references the group's memory make sure it can't be
+  // executed anymore.
+  std::weak_ptr<Table::SamplingCallback> weak_ptr = sampling_done_;
+  sampling_done_.reset();
+  while (weak_ptr.lock()) {
+    absl::SleepFor(kCallbackWaitTime);
+  }
+}
+
+void MulticastSampleGroup::Subscribe(std::shared_ptr<BatchCallback> subscriber) {
+  absl::MutexLock lock(&mu_);
+  subscribers_.push_back(std::move(subscriber));
+}
+
+void MulticastSampleGroup::Unsubscribe(
+    const std::shared_ptr<BatchCallback>& subscriber) {
+  absl::MutexLock lock(&mu_);
+  subscribers_.erase(
+      std::remove(subscribers_.begin(), subscribers_.end(), subscriber),
+      subscribers_.end());
+}
+
+void MulticastSampleGroup::RequestBatch() {
+  absl::MutexLock lock(&mu_);
+  if (sampling_in_flight_) {
+    return;
+  }
+  sampling_in_flight_ = true;
+  // The per-subscriber rate limiter timeout cannot apply to a pipeline shared
+  // by several streams so batches are produced without one.
+  table_->EnqueSampleRequest(kMulticastSampleBatchSize, sampling_done_,
+                             absl::InfiniteDuration());
+}
+
+void MulticastSampleGroup::OnSamplesReady(Table::SampleRequest* request) {
+  std::vector<std::shared_ptr<BatchCallback>> subscribers;
+  {
+    absl::MutexLock lock(&mu_);
+    // Cleared before delivery so that a subscriber which wants another batch
+    // can trigger its production straight from the callback.
+    sampling_in_flight_ = false;
+    subscribers = subscribers_;
+  }
+  if (!request->status.ok()) {
+    for (auto& subscriber : subscribers) {
+      (*subscriber)(request->status, nullptr);
+    }
+    return;
+  }
+
+  // Split the sampled items into batches no larger than the table's maximum
+  // response size (always keeping at least one item per batch).
+  const int64_t max_batch_size_bytes = table_->max_sample_response_size_bytes();
+  std::vector<Table::SampledItem> batch_samples;
+  int64_t batch_size_bytes = 0;
+  std::vector<std::shared_ptr<MulticastSampleBatch>> batches;
+  for (auto& sample : request->samples) {
+    int64_t sample_size_bytes = 0;
+    for (const auto& chunk : sample.ref->chunks) {
+      sample_size_bytes += chunk->DataByteSizeLong();
+    }
+    if (!batch_samples.empty() &&
+        batch_size_bytes + sample_size_bytes > max_batch_size_bytes) {
+      batches.push_back(
+          std::make_shared<MulticastSampleBatch>(std::move(batch_samples)));
+      batch_samples.clear();
+      batch_size_bytes = 0;
+    }
+    batch_samples.push_back(std::move(sample));
+    batch_size_bytes += sample_size_bytes;
+  }
+  if (!batch_samples.empty()) {
+    batches.push_back(
+        std::make_shared<MulticastSampleBatch>(std::move(batch_samples)));
+  }
+
+  for (auto& batch : batches) {
+    for (auto& subscriber : subscribers) {
+      (*subscriber)(absl::OkStatus(), batch);
+    }
+  }
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,114 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_MULTICAST_SAMPLE_GROUP_H_
+#define REVERB_CC_MULTICAST_SAMPLE_GROUP_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/reverb_service.pb.h"
+#include "reverb/cc/table.h"
+
+namespace deepmind {
+namespace reverb {
+
+// A batch of samples assembled into a `SampleStreamResponse` once and then
+// shared by every subscriber of a `MulticastSampleGroup`. Chunks are attached
+// to the payload by pointer (and pinned) exactly as in the per-stream sample
+// path; the borrowed fields are released and the chunks unpinned when the
+// last subscriber drops its reference.
+class MulticastSampleBatch {
+ public:
+  explicit MulticastSampleBatch(std::vector<Table::SampledItem> samples);
+  ~MulticastSampleBatch();
+
+  MulticastSampleBatch(const MulticastSampleBatch&) = delete;
+  MulticastSampleBatch& operator=(const MulticastSampleBatch&) = delete;
+
+  // Payload shared by the subscribing streams. Subscribers alias the entries
+  // with `UnsafeArenaAddAllocated` and must unlink them again before dropping
+  // their reference to the batch.
+  SampleStreamResponse* mutable_payload();
+
+  // Number of sampled items held by the batch.
+  int num_samples() const;
+
+ private:
+  SampleStreamResponse payload_;
+
+  // Keeps the sampled items (and thereby the protos borrowed by `payload_`)
+  // alive for the lifetime of the batch.
+  std::vector<std::shared_ptr<Table::Item>> items_;
+
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> pinned_chunks_;
+};
+
+// A sampling pipeline shared by a group of `SampleStream` calls that all draw
+// from the same table (e.g. data parallel learner replicas). The group
+// samples batches from the table on demand and delivers each batch to every
+// subscriber, so selector work and response assembly are paid once per batch
+// instead of once per replica. Sampled batches larger than the table's
+// maximum response size are split before delivery.
+//
+// Thread safe. Subscriber callbacks are invoked without any group lock held
+// and may call back into the group.
+class MulticastSampleGroup {
+ public:
+  // Called once per produced batch. `batch` is nullptr iff `status` is not
+  // ok, in which case the subscriber should terminate its stream.
+  using BatchCallback = std::function<void(
+      const absl::Status& status, std::shared_ptr<MulticastSampleBatch> batch)>;
+
+  explicit MulticastSampleGroup(std::shared_ptr<Table> table);
+
+  // Blocks until no callback owned by the table can be in flight anymore.
+  ~MulticastSampleGroup();
+
+  // Adds `subscriber` to the group. The subscriber receives every batch
+  // produced until it is removed with `Unsubscribe`.
+  void Subscribe(std::shared_ptr<BatchCallback> subscriber);
+
+  // Removes `subscriber` from the group. An already started delivery may
+  // still be in flight when this returns; callers that destroy the memory
+  // referenced by the callback must wait until they hold the only reference.
+  void Unsubscribe(const std::shared_ptr<BatchCallback>& subscriber);
+
+  // Requests production of another batch unless one is already in flight.
+  // Completed batches are delivered to every subscriber.
+  void RequestBatch();
+
+ private:
+  // Called by the table worker with the sampled batch.
+  void OnSamplesReady(Table::SampleRequest* request);
+
+  std::shared_ptr<Table> table_;
+
+  absl::Mutex mu_;
+  std::vector<std::shared_ptr<BatchCallback>> subscribers_ ABSL_GUARDED_BY(mu_);
+  bool sampling_in_flight_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Callback called by the table worker when a sampling batch is done.
+  std::shared_ptr<Table::SamplingCallback> sampling_done_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_MULTICAST_SAMPLE_GROUP_H_
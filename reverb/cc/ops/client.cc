@@ -19,7 +19,10 @@
 #include <vector>
 
 #include <cstdint>
+#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/server.h"
 #include "reverb/cc/support/tf_util.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -55,6 +58,9 @@ REGISTER_OP("ReverbClientSample")
     .Output("probability: double")
     .Output("table_size: int64")
     .Output("priority: double")
+    .Output("queued_for_secs: double")
+    .Output("rate_limiter_wait_secs: double")
+    .Output("serialize_time_secs: double")
     .Output("outputs: Toutput_list")
     .Doc(R"doc(
 Blocking call to sample a single item from table `table` using shared resource.
@@ -93,17 +99,27 @@ class ClientResource : public tensorflow::ResourceBase {
  public:
   explicit ClientResource(const std::string& server_address)
       : tensorflow::ResourceBase(),
-        client_(server_address),
-        server_address_(server_address) {}
+        client_(TryInProcessClient(server_address)),
+        server_address_(server_address) {
+    if (client_ != nullptr) {
+      REVERB_LOG(REVERB_INFO)
+          << "Replay server at " << server_address
+          << " runs in this process; using the in-process channel.";
+    } else {
+      client_ = absl::make_unique<Client>(server_address);
+    }
+  }
 
   std::string DebugString() const override {
     return absl::StrCat("Client with server address: ", server_address_);
   }
 
-  Client* client() { return &client_; }
+  Client* client() { return client_.get(); }
 
  private:
-  Client client_;
+  // Connected over the in-process channel when the address refers to a
+  // server hosted by this process, and over gRPC otherwise.
+  std::unique_ptr<Client> client_;
   std::string server_address_;
 
   TF_DISALLOW_COPY_AND_ASSIGN(ClientResource);
@@ -15,8 +15,10 @@
 #include "tensorflow/core/framework/dataset.h"
 
 #include "absl/strings/match.h"
+#include "absl/synchronization/mutex.h"
 #include "reverb/cc/client.h"
 #include "reverb/cc/errors.h"
+#include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/sampler.h"
 #include "reverb/cc/support/tf_util.h"
@@ -35,6 +37,45 @@ using ::tensorflow::errors::FailedPrecondition;
 using ::tensorflow::errors::InvalidArgument;
 using ::tensorflow::errors::Unimplemented;
 
+// Samplers shared by parallel iterator instances of datasets constructed
+// with a `shared_sampler_name` (e.g. through `num_parallel_calls`). Without
+// sharing, every iterator opens its own streams and prefetch queue,
+// multiplying the selector work on the server and defeating rate limiter
+// fairness; with sharing, all iterators pull from one pipeline and the
+// parallelism is spent on unpacking the pulled samples instead. Entries are
+// held by weak pointer so a shared sampler lives exactly as long as the
+// iterators using it and the name can be reused afterwards.
+class SharedSamplerRegistry {
+ public:
+  struct Entry {
+    // Serializes both the lazy creation of `sampler` and the consumer side
+    // of the `Sampler` API, which assumes a single threaded consumer.
+    absl::Mutex mu;
+
+    // Created under `mu` by the first iterator to initialize.
+    std::unique_ptr<Sampler> sampler;
+  };
+
+  // Returns the entry registered under `key`, creating it if there is no
+  // live entry with that key.
+  static std::shared_ptr<Entry> GetOrCreate(const std::string& key) {
+    static SharedSamplerRegistry* registry = new SharedSamplerRegistry();
+    absl::MutexLock lock(&registry->mu_);
+    auto& weak = registry->entries_[key];
+    auto entry = weak.lock();
+    if (entry == nullptr) {
+      entry = std::make_shared<Entry>();
+      weak = entry;
+    }
+    return entry;
+  }
+
+ private:
+  absl::Mutex mu_;
+  internal::flat_hash_map<std::string, std::weak_ptr<Entry>> entries_
+      ABSL_GUARDED_BY(mu_);
+};
+
 REGISTER_OP("ReverbDataset")
     .Input("server_address: string")
     .Input("table: string")
@@ -44,6 +85,8 @@ REGISTER_OP("ReverbDataset")
     .Attr("num_workers_per_iterator: int = -1")
     .Attr("max_samples_per_stream: int = -1")
     .Attr("rate_limiter_timeout_ms: int = -1")
+    .Attr("pin_outputs: bool = false")
+    .Attr("shared_sampler_name: string = ''")
     .Attr("dtypes: list(type) >= 1")
     .Attr("shapes: list(shape) >= 1")
     .Output("dataset: variant")
@@ -59,8 +102,9 @@ maintains their own `Sampler` (see ../sampler.h), allowing for multiple
 parallel streams using a single connection.
 
 `dtypes` and `shapes` must match the type and shape of a single "timestep"
-within sampled sequences. That is, (key, priority, table_size, ...data passed to
-`Writer::Append` at insertion time). This is the type and shape of
+within sampled sequences. That is, (key, probability, table_size, priority,
+queued_for_secs, rate_limiter_wait_secs, serialize_time_secs, ...data passed
+to `Writer::Append` at insertion time). This is the type and shape of
 tensors returned by `GetNextTimestep`.
 
 sequence_length: (Defaults to -1, i.e unknown) The number of timesteps in
@@ -97,6 +141,24 @@ Note that the timeout behavior depends on the Table's rate limiter. For example,
 the table may contain data, but the rate limiter may pause sampling - and this
 can cause a timeout to occur. Note also that when `num_workers_per_iterator >
 1`, a timeout on any given worker will cause a timeout for the dataset.
+
+`pin_outputs` (defaults to false) makes the iterator return its output tensors
+from TensorFlow's pooled GPU compatible host allocator. The returned buffers
+are page-locked so device transfers of the outputs run at full PCIe bandwidth,
+and the pool recycles the buffers between elements. Columns whose dtype cannot
+be copied with memcpy (e.g. strings) are unaffected. This has no effect in
+processes without a GPU device.
+
+`shared_sampler_name` (defaults to "", i.e. not shared) makes all iterators of
+datasets constructed with the same (server_address, table, name) triple in
+this process pull from a single shared `Sampler` -- one stream pool and one
+prefetch queue -- instead of each opening their own. Redundant per-iterator
+pipelines multiply selector work on the server and defeat rate limiter
+fairness; with sharing, consumers take turns popping from the shared queue
+while the sampler decodes the next sample in the background. Requires
+`emit_timesteps` to be false, since splitting a sample into timesteps cannot
+be interleaved across consumers. The shared sampler lives as long as any
+iterator is using it; the name can be reused once all of them are gone.
 )doc");
 
 class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
@@ -115,9 +177,18 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
     tensorflow::int64 rate_limiter_timeout_ms;
     OP_REQUIRES_OK(
         ctx, ctx->GetAttr("rate_limiter_timeout_ms", &rate_limiter_timeout_ms));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("pin_outputs", &pin_outputs_));
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("shared_sampler_name", &shared_sampler_name_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("shapes", &shapes_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("dtypes", &dtypes_));
 
+    OP_REQUIRES(ctx, shared_sampler_name_.empty() || !emit_timesteps_,
+                InvalidArgument(
+                    "shared_sampler_name requires emit_timesteps to be false "
+                    "as timesteps of a sample cannot be interleaved across "
+                    "the consumers of a shared sampler."));
+
     sampler_options_.rate_limiter_timeout =
         Int64MillisToNonnegativeDuration(rate_limiter_timeout_ms);
 
@@ -155,8 +226,10 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
                    tensorflow::data::ParseScalarArgument<tensorflow::tstring>(
                        ctx, "table", &table));
 
-    *output = new Dataset(ctx, server_address, dtypes_, shapes_, table,
-                          sampler_options_, sequence_length_, emit_timesteps_);
+    *output =
+        new Dataset(ctx, server_address, dtypes_, shapes_, table,
+                    sampler_options_, sequence_length_, emit_timesteps_,
+                    pin_outputs_, shared_sampler_name_);
   }
 
  private:
@@ -166,7 +239,8 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
             tensorflow::DataTypeVector dtypes,
             std::vector<tensorflow::PartialTensorShape> shapes,
             std::string table, const Sampler::Options& sampler_options,
-            int sequence_length, bool emit_timesteps)
+            int sequence_length, bool emit_timesteps, bool pin_outputs,
+            std::string shared_sampler_name)
         : tensorflow::data::DatasetBase(tensorflow::data::DatasetContext(ctx)),
           server_address_(std::move(server_address)),
           dtypes_(std::move(dtypes)),
@@ -175,15 +249,23 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
           sampler_options_(sampler_options),
           sequence_length_(sequence_length),
           emit_timesteps_(emit_timesteps),
+          pin_outputs_(pin_outputs),
+          shared_sampler_name_(std::move(shared_sampler_name)),
           client_(absl::make_unique<Client>(server_address_)) {}
 
     std::unique_ptr<tensorflow::data::IteratorBase> MakeIteratorInternal(
         const std::string& prefix) const override {
+      std::shared_ptr<SharedSamplerRegistry::Entry> shared_sampler;
+      if (!shared_sampler_name_.empty()) {
+        shared_sampler = SharedSamplerRegistry::GetOrCreate(absl::StrCat(
+            server_address_, "/", table_, "/", shared_sampler_name_));
+      }
       return absl::make_unique<Iterator>(
           tensorflow::data::DatasetIterator<Dataset>::Params{
               this, absl::StrCat(prefix, "::ReverbDataset")},
           client_.get(), table_, sampler_options_, sequence_length_,
-          emit_timesteps_, dtypes_, shapes_);
+          emit_timesteps_, pin_outputs_, dtypes_, shapes_,
+          std::move(shared_sampler));
     }
 
     const tensorflow::DataTypeVector& output_dtypes() const override {
@@ -219,6 +301,8 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
       tensorflow::AttrValue sequence_length_attr;
       tensorflow::AttrValue emit_timesteps_attr;
       tensorflow::AttrValue rate_limiter_timeout_ms_attr;
+      tensorflow::AttrValue pin_outputs_attr;
+      tensorflow::AttrValue shared_sampler_name_attr;
       tensorflow::AttrValue dtypes_attr;
       tensorflow::AttrValue shapes_attr;
 
@@ -239,6 +323,8 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
           &rate_limiter_timeout_ms_attr);
       b->BuildAttrValue(sequence_length_, &sequence_length_attr);
       b->BuildAttrValue(emit_timesteps_, &emit_timesteps_attr);
+      b->BuildAttrValue(pin_outputs_, &pin_outputs_attr);
+      b->BuildAttrValue(shared_sampler_name_, &shared_sampler_name_attr);
       b->BuildAttrValue(dtypes_, &dtypes_attr);
       b->BuildAttrValue(shapes_, &shapes_attr);
 
@@ -254,6 +340,8 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
               {"sequence_length", sequence_length_attr},
               {"emit_timesteps", emit_timesteps_attr},
               {"rate_limiter_timeout_ms", rate_limiter_timeout_ms_attr},
+              {"pin_outputs", pin_outputs_attr},
+              {"shared_sampler_name", shared_sampler_name_attr},
               {"dtypes", dtypes_attr},
               {"shapes", shapes_attr},
           },
@@ -268,21 +356,50 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
       explicit Iterator(
           const Params& params, Client* client, const std::string& table,
           const Sampler::Options& sampler_options, int sequence_length,
-          bool emit_timesteps, const tensorflow::DataTypeVector& dtypes,
-          const std::vector<tensorflow::PartialTensorShape>& shapes)
+          bool emit_timesteps, bool pin_outputs,
+          const tensorflow::DataTypeVector& dtypes,
+          const std::vector<tensorflow::PartialTensorShape>& shapes,
+          std::shared_ptr<SharedSamplerRegistry::Entry> shared_sampler)
           : DatasetIterator<Dataset>(params),
             client_(client),
             table_(table),
             sampler_options_(sampler_options),
             sequence_length_(sequence_length),
             emit_timesteps_(emit_timesteps),
+            pin_outputs_(pin_outputs),
             dtypes_(dtypes),
             shapes_(shapes),
+            shared_sampler_(std::move(shared_sampler)),
             step_within_sample_(0),
             rate_limited_(false) {}
 
       tensorflow::Status Initialize(
           tensorflow::data::IteratorContext* ctx) override {
+        if (pin_outputs_) {
+          // The pooled GPU compatible host allocator hands out page-locked
+          // buffers and recycles them between elements, so device transfers
+          // of the outputs run at full PCIe bandwidth and the allocator stays
+          // out of the per-step profile. Without a GPU in the process this
+          // resolves to the default CPU allocator.
+          tensorflow::AllocatorAttributes attrs;
+          attrs.set_on_host(true);
+          attrs.set_gpu_compatible(true);
+          sampler_options_.output_allocator = ctx->allocator(attrs);
+        }
+
+        if (shared_sampler_ != nullptr) {
+          // The first iterator to initialize creates the shared sampler;
+          // later ones simply attach to it.
+          absl::MutexLock lock(&shared_sampler_->mu);
+          if (shared_sampler_->sampler != nullptr) {
+            return tensorflow::Status::OK();
+          }
+          return MakeSampler(&shared_sampler_->sampler);
+        }
+        return MakeSampler(&sampler_);
+      }
+
+      tensorflow::Status MakeSampler(std::unique_ptr<Sampler>* sampler) {
         // If sequences are emitted then the all shapes will start with the
         // sequence length. The validation expects the shapes of a single
         // timestep so if sequences are emitted then we need to trim the leading
@@ -298,7 +415,7 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
         auto status = client_->NewSampler(table_, sampler_options_,
                                           /*validation_dtypes=*/dtypes_,
                                           validation_shapes, kValidationTimeout,
-                                          &sampler_);
+                                          sampler);
         if (absl::IsDeadlineExceeded(status)) {
           REVERB_LOG(REVERB_WARNING)
               << "Unable to validate shapes and dtypes of new sampler for '"
@@ -311,7 +428,7 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
           // which causes it to skip the validation and return an OK status.
           return ToTensorflowStatus(client_->NewSampler(
               table_, sampler_options_,
-              /*validation_timeout=*/-absl::InfiniteDuration(), &sampler_));
+              /*validation_timeout=*/-absl::InfiniteDuration(), sampler));
         }
         return ToTensorflowStatus(status);
       }
@@ -320,19 +437,28 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
           tensorflow::data::IteratorContext* ctx,
           std::vector<tensorflow::Tensor>* out_tensors,
           bool* end_of_sequence) override {
-        REVERB_CHECK(sampler_.get() != nullptr) << "Initialize was not called?";
+        // The consumer side of `Sampler` assumes a single threaded consumer,
+        // so parallel iterators of a shared sampler serialize on the entry
+        // mutex. The sampler's own background prematerialization keeps chunk
+        // decoding overlapped with the emission done under the lock.
+        absl::MutexLockMaybe shared_lock(
+            shared_sampler_ != nullptr ? &shared_sampler_->mu : nullptr);
+        Sampler* sampler = shared_sampler_ != nullptr
+                               ? shared_sampler_->sampler.get()
+                               : sampler_.get();
+        REVERB_CHECK(sampler != nullptr) << "Initialize was not called?";
 
         auto token = ctx->cancellation_manager()->get_cancellation_token();
         bool registered = ctx->cancellation_manager()->RegisterCallback(
-            token, [&] { sampler_->Close(); });
+            token, [&] { sampler->Close(); });
         if (!registered) {
-          sampler_->Close();
+          sampler->Close();
         }
 
         tensorflow::Status status;
         if (emit_timesteps_) {
           bool last_timestep = false;
-          status = ToTensorflowStatus(sampler_->GetNextTimestep(
+          status = ToTensorflowStatus(sampler->GetNextTimestep(
               out_tensors, &last_timestep, &rate_limited_));
 
           step_within_sample_++;
@@ -354,7 +480,7 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
           }
         } else {
           status = ToTensorflowStatus(
-              sampler_->GetNextSample(out_tensors, &rate_limited_));
+              sampler->GetNextSample(out_tensors, &rate_limited_));
         }
 
         if (registered &&
@@ -395,11 +521,17 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
      private:
       Client* client_;
       const std::string& table_;
-      const Sampler::Options sampler_options_;
+      Sampler::Options sampler_options_;
       const int sequence_length_;
       const bool emit_timesteps_;
+      const bool pin_outputs_;
       const tensorflow::DataTypeVector& dtypes_;
       const std::vector<tensorflow::PartialTensorShape>& shapes_;
+
+      // Set when the dataset was constructed with a `shared_sampler_name`;
+      // the shared sampler then lives in the entry and `sampler_` stays
+      // null.
+      const std::shared_ptr<SharedSamplerRegistry::Entry> shared_sampler_;
       std::unique_ptr<Sampler> sampler_;
       int step_within_sample_;
 
@@ -414,12 +546,16 @@ class ReverbDatasetOp : public tensorflow::data::DatasetOpKernel {
     const Sampler::Options sampler_options_;
     const int sequence_length_;
     const bool emit_timesteps_;
+    const bool pin_outputs_;
+    const std::string shared_sampler_name_;
     std::unique_ptr<Client> client_;
   };  // Dataset.
 
   Sampler::Options sampler_options_;
   int sequence_length_;
   bool emit_timesteps_;
+  bool pin_outputs_;
+  std::string shared_sampler_name_;
   tensorflow::DataTypeVector dtypes_;
   std::vector<tensorflow::PartialTensorShape> shapes_;
 
@@ -25,9 +25,17 @@
 namespace deepmind {
 namespace reverb {
 
+// When `incremental` is set checkpoints only persist chunks added since the
+// previous checkpoint. When `num_chunk_shards` is larger than one the chunk
+// data is split across that many record files written and read in parallel.
+// When `lazy_chunks` is set chunks are stored as metadata records plus a page
+// aligned payloads file so that loading only parses the metadata and payloads
+// are faulted in on demand (see TFRecordCheckpointer for details).
 std::unique_ptr<Checkpointer> CreateDefaultCheckpointer(
     std::string root_dir, std::string group = "",
-    absl::optional<std::string> fallback_checkpoint_path = absl::nullopt);
+    absl::optional<std::string> fallback_checkpoint_path = absl::nullopt,
+    bool incremental = false, int num_chunk_shards = 1,
+    bool lazy_chunks = false);
 
 }  // namespace reverb
 }  // namespace deepmind
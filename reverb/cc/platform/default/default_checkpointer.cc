@@ -20,10 +20,12 @@ namespace reverb {
 
 std::unique_ptr<Checkpointer> CreateDefaultCheckpointer(
     std::string root_dir, std::string group,
-    absl::optional<std::string> fallback_checkpoint_path) {
+    absl::optional<std::string> fallback_checkpoint_path, bool incremental,
+    int num_chunk_shards, bool lazy_chunks) {
   return absl::make_unique<TFRecordCheckpointer>(
       std::move(root_dir), std::move(group),
-      std::move(fallback_checkpoint_path));
+      std::move(fallback_checkpoint_path), incremental, num_chunk_shards,
+      lazy_chunks);
 }
 
 }  // namespace reverb
@@ -0,0 +1,294 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/platform/metrics.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/trace.h"
+#include "reverb/cc/table.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// Histogram bucket upper bounds in seconds for the hot-path stage latency
+// histograms. Powers of four from 1us to ~4s cover everything from a
+// selector draw to a rate limiter stall.
+constexpr double kLatencyBuckets[] = {
+    1e-6,      4e-6,     1.6e-5,   6.4e-5,   2.56e-4,  1.024e-3,
+    4.096e-3,  1.6384e-2, 6.5536e-2, 0.262144, 1.048576, 4.194304,
+};
+constexpr int kNumLatencyBuckets =
+    sizeof(kLatencyBuckets) / sizeof(kLatencyBuckets[0]);
+
+// Cumulative histogram of the durations of one trace stage. The +Inf bucket
+// is implicit (it equals `count`).
+struct StageHistogram {
+  int64_t buckets[kNumLatencyBuckets] = {};
+  int64_t count = 0;
+  double sum = 0;
+
+  void Add(double seconds) {
+    for (int i = 0; i < kNumLatencyBuckets; i++) {
+      if (seconds <= kLatencyBuckets[i]) {
+        buckets[i]++;
+      }
+    }
+    count++;
+    sum += seconds;
+  }
+};
+
+class MetricsExporterImpl : public MetricsExporter {
+ public:
+  MetricsExporterImpl(std::vector<std::shared_ptr<Table>> tables, int fd)
+      : tables_(std::move(tables)),
+        fd_(fd),
+        worker_(internal::StartThread("reverb_metrics", [this] { Serve(); })) {}
+
+  ~MetricsExporterImpl() override {
+    // Closing the listening socket makes accept(2) fail which stops the
+    // serving loop.
+    stop_ = true;
+    shutdown(fd_, SHUT_RDWR);
+    worker_ = nullptr;  // Joins the thread.
+    close(fd_);
+  }
+
+ private:
+  void Serve() {
+    while (!stop_) {
+      const int conn = accept(fd_, nullptr, nullptr);
+      if (conn < 0) {
+        if (stop_) return;
+        REVERB_LOG(REVERB_ERROR) << "accept() failed: " << strerror(errno);
+        continue;
+      }
+      // The request line and headers are irrelevant; everything served from
+      // this port is the metrics page. Drain what has already arrived so the
+      // peer does not see a reset, then respond and close.
+      char buf[1024];
+      while (recv(conn, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+      }
+      const std::string body = BuildMetricsPage();
+      const std::string response = absl::StrCat(
+          "HTTP/1.0 200 OK\r\n"
+          "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+          "Content-Length: ",
+          body.size(), "\r\n\r\n", body);
+      size_t offset = 0;
+      while (offset < response.size()) {
+        // MSG_NOSIGNAL: a scraper that closes early must surface as EPIPE
+        // here, not raise SIGPIPE and kill the embedding process.
+        const ssize_t n = send(conn, response.data() + offset,
+                               response.size() - offset, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        offset += n;
+      }
+      close(conn);
+    }
+  }
+
+  std::string BuildMetricsPage() {
+    std::string out;
+    auto gauge = [&out](absl::string_view name, absl::string_view help) {
+      absl::StrAppend(&out, "# HELP ", name, " ", help, "\n# TYPE ", name,
+                      " gauge\n");
+    };
+    auto counter = [&out](absl::string_view name, absl::string_view help) {
+      absl::StrAppend(&out, "# HELP ", name, " ", help, "\n# TYPE ", name,
+                      " counter\n");
+    };
+
+    std::vector<TableInfo> infos;
+    infos.reserve(tables_.size());
+    for (const auto& table : tables_) {
+      infos.push_back(table->info());
+    }
+
+    gauge("reverb_table_current_size", "Number of items in the table.");
+    for (const auto& info : infos) {
+      absl::StrAppend(&out, "reverb_table_current_size{table=\"", info.name(),
+                      "\"} ", info.current_size(), "\n");
+    }
+    gauge("reverb_table_num_episodes",
+          "Number of episodes referenced by items in the table.");
+    for (const auto& info : infos) {
+      absl::StrAppend(&out, "reverb_table_num_episodes{table=\"", info.name(),
+                      "\"} ", info.num_episodes(), "\n");
+    }
+    counter("reverb_table_num_deleted_episodes_total",
+            "Number of episodes that are no longer referenced by the table.");
+    for (const auto& info : infos) {
+      absl::StrAppend(&out, "reverb_table_num_deleted_episodes_total{table=\"",
+                      info.name(), "\"} ", info.num_deleted_episodes(), "\n");
+    }
+    counter("reverb_table_num_unique_samples_total",
+            "Number of unique items sampled since the last reset.");
+    for (const auto& info : infos) {
+      absl::StrAppend(&out, "reverb_table_num_unique_samples_total{table=\"",
+                      info.name(), "\"} ", info.num_unique_samples(), "\n");
+    }
+    counter("reverb_table_rate_limiter_calls_total",
+            "Insert and sample calls admitted by the rate limiter.");
+    for (const auto& info : infos) {
+      absl::StrAppend(
+          &out, "reverb_table_rate_limiter_calls_total{table=\"", info.name(),
+          "\",call=\"insert\"} ",
+          info.rate_limiter_info().insert_stats().completed(), "\n");
+      absl::StrAppend(
+          &out, "reverb_table_rate_limiter_calls_total{table=\"", info.name(),
+          "\",call=\"sample\"} ",
+          info.rate_limiter_info().sample_stats().completed(), "\n");
+    }
+    counter("reverb_table_worker_seconds_total",
+            "Time the table worker has spent in each state. The waiting "
+            "states measure time blocked by the rate limiter.");
+    for (const auto& info : infos) {
+      const auto& t = info.table_worker_time();
+      const std::pair<const char*, int64_t> states[] = {
+          {"running", t.running_ms()},
+          {"sampling", t.sampling_ms()},
+          {"inserting", t.inserting_ms()},
+          {"sleeping", t.sleeping_ms()},
+          {"waiting_for_sampling", t.waiting_for_sampling_ms()},
+          {"waiting_for_inserts", t.waiting_for_inserts_ms()},
+      };
+      for (const auto& state : states) {
+        absl::StrAppend(&out, "reverb_table_worker_seconds_total{table=\"",
+                        info.name(), "\",state=\"", state.first, "\"} ",
+                        state.second / 1000.0, "\n");
+      }
+    }
+    gauge("reverb_table_pending_requests",
+          "Queued insert/sample requests not yet picked up by the table "
+          "worker.");
+    for (const auto& table : tables_) {
+      absl::StrAppend(&out, "reverb_table_pending_requests{table=\"",
+                      table->name(), "\",call=\"insert\"} ",
+                      table->num_pending_async_insert_requests(), "\n");
+      absl::StrAppend(&out, "reverb_table_pending_requests{table=\"",
+                      table->name(), "\",call=\"sample\"} ",
+                      table->num_pending_async_sample_requests(), "\n");
+    }
+
+    UpdateStageHistograms();
+    absl::StrAppend(
+        &out,
+        "# HELP reverb_stage_duration_seconds Latency of hot-path stages "
+        "recorded by the trace rings.\n"
+        "# TYPE reverb_stage_duration_seconds histogram\n");
+    for (const auto& entry : stage_histograms_) {
+      const StageHistogram& histogram = entry.second;
+      for (int i = 0; i < kNumLatencyBuckets; i++) {
+        absl::StrAppend(&out, "reverb_stage_duration_seconds_bucket{stage=\"",
+                        entry.first, "\",le=\"", kLatencyBuckets[i], "\"} ",
+                        histogram.buckets[i], "\n");
+      }
+      absl::StrAppend(&out, "reverb_stage_duration_seconds_bucket{stage=\"",
+                      entry.first, "\",le=\"+Inf\"} ", histogram.count, "\n");
+      absl::StrAppend(&out, "reverb_stage_duration_seconds_sum{stage=\"",
+                      entry.first, "\"} ", histogram.sum, "\n");
+      absl::StrAppend(&out, "reverb_stage_duration_seconds_count{stage=\"",
+                      entry.first, "\"} ", histogram.count, "\n");
+    }
+    return out;
+  }
+
+  // Folds trace events recorded since the previous scrape into the
+  // cumulative per stage histograms. Events are ordered by end time within
+  // each thread's ring, so a per thread watermark on the end timestamp
+  // separates new events from ones already counted. Events that are
+  // overwritten between scrapes (the rings are bounded) are simply missed;
+  // scraping at a normal monitoring cadence keeps that negligible.
+  void UpdateStageHistograms() {
+    for (const auto& thread : internal::SnapshotTraceEvents()) {
+      int64_t& watermark = end_cycles_watermark_[thread.thread_id];
+      for (const auto& event : thread.events) {
+        if (event.end_cycles <= watermark) continue;
+        stage_histograms_[event.stage].Add(internal::TraceCyclesToSeconds(
+            event.end_cycles - event.start_cycles));
+      }
+      if (!thread.events.empty()) {
+        watermark = thread.events.back().end_cycles;
+      }
+    }
+  }
+
+  const std::vector<std::shared_ptr<Table>> tables_;
+  const int fd_;
+  std::atomic<bool> stop_{false};
+
+  // Only touched by `worker_`.
+  std::map<std::string, StageHistogram> stage_histograms_;
+  internal::flat_hash_map<int64_t, int64_t> end_cycles_watermark_;
+
+  std::unique_ptr<internal::Thread> worker_;
+};
+
+}  // namespace
+
+absl::Status StartMetricsExporter(std::vector<std::shared_ptr<Table>> tables,
+                                  int port,
+                                  std::unique_ptr<MetricsExporter>* exporter) {
+  if (port <= 0 || port > 65535) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid metrics port: ", port));
+  }
+  const int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    return absl::InternalError(
+        absl::StrCat("socket() failed: ", strerror(errno)));
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      listen(fd, /*backlog=*/8) < 0) {
+    const std::string error = strerror(errno);
+    close(fd);
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Failed to bind metrics endpoint to port ", port, ": ", error));
+  }
+  *exporter = absl::make_unique<MetricsExporterImpl>(std::move(tables), fd);
+  return absl::OkStatus();
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,129 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/platform/numa.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+#if defined(__linux__)
+
+namespace {
+
+// Memory policy mode from <linux/mempolicy.h>; we invoke the syscall
+// directly to avoid a dependency on libnuma.
+constexpr int kMpolPreferred = 1;
+
+// Parses a sysfs cpulist such as "0-15,32-47" into individual CPU ids.
+// Returns false if the file is missing or malformed.
+bool ReadCpuList(const std::string& path, std::vector<int>* cpus) {
+  std::ifstream file(path);
+  if (!file.is_open()) return false;
+  std::string content;
+  std::getline(file, content);
+  for (absl::string_view range :
+       absl::StrSplit(content, ',', absl::SkipEmpty())) {
+    std::pair<absl::string_view, absl::string_view> bounds =
+        absl::StrSplit(range, absl::MaxSplits('-', 1));
+    int first, last;
+    if (!absl::SimpleAtoi(bounds.first, &first)) return false;
+    if (bounds.second.empty()) {
+      last = first;
+    } else if (!absl::SimpleAtoi(bounds.second, &last)) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus->push_back(cpu);
+    }
+  }
+  return !cpus->empty();
+}
+
+}  // namespace
+
+int NumNumaNodes() {
+  int num_nodes = 0;
+  while (std::ifstream(absl::StrCat("/sys/devices/system/node/node",
+                                    num_nodes, "/cpulist"))
+             .is_open()) {
+    num_nodes++;
+  }
+  return num_nodes > 0 ? num_nodes : 1;
+}
+
+absl::Status BindCurrentThreadToNumaNode(int node) {
+  if (node < 0 || node >= NumNumaNodes()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "NUMA node ", node, " does not exist; the host has ", NumNumaNodes(),
+        " node(s)."));
+  }
+  std::vector<int> cpus;
+  if (!ReadCpuList(
+          absl::StrCat("/sys/devices/system/node/node", node, "/cpulist"),
+          &cpus)) {
+    return absl::InternalError(
+        absl::StrCat("Failed to read the CPU list of NUMA node ", node, "."));
+  }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &cpu_set);
+  }
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    return absl::InternalError(absl::StrCat(
+        "Failed to set the CPU affinity for NUMA node ", node, "."));
+  }
+  // Prefer (rather than require) pages from the node so allocations fall back
+  // to remote memory instead of failing when the node is full.
+  uint64_t node_mask = uint64_t{1} << node;
+  if (syscall(SYS_set_mempolicy, kMpolPreferred, &node_mask,
+              sizeof(node_mask) * 8) != 0) {
+    return absl::InternalError(absl::StrCat(
+        "Failed to set the memory policy for NUMA node ", node, "."));
+  }
+  return absl::OkStatus();
+}
+
+#else  // !defined(__linux__)
+
+int NumNumaNodes() { return 1; }
+
+absl::Status BindCurrentThreadToNumaNode(int node) {
+  return absl::UnimplementedError(
+      "NUMA placement is only supported on Linux.");
+}
+
+#endif  // defined(__linux__)
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
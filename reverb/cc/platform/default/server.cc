@@ -16,18 +16,36 @@
 
 #include <chrono>  // NOLINT(build/c++11) - grpc API requires it.
 #include <csignal>
+#include <map>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "grpcpp/server_builder.h"
+#include "absl/flags/flag.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "reverb/cc/checkpointing/interface.h"
 #include "reverb/cc/client.h"
 #include "reverb/cc/platform/grpc_utils.h"
 #include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/metrics.h"
+#include "reverb/cc/platform/numa.h"
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/reverb_service_impl.h"
 #include "reverb/cc/support/periodic_closure.h"
 
+ABSL_FLAG(int, reverb_metrics_http_port, 0,
+          "When nonzero, the server additionally serves Prometheus metrics "
+          "over HTTP on this port (GET /metrics): per table sizes and rate "
+          "limiter stats, request queue depths and hot-path stage latency "
+          "histograms.");
+
 namespace deepmind {
 namespace reverb {
 namespace {
@@ -39,36 +57,118 @@ void signal_handler(int signal) {
   stop_server_fn();
 }
 
+class ServerImpl;
+
+// Process-wide registry of running servers keyed by TCP port, backing
+// `TryInProcessClient`. Servers register themselves once serving starts and
+// unregister at the top of `Stop`, before taking their own lock, so a server
+// found while holding the registry lock is still running and can safely hand
+// out an in-process client.
+absl::Mutex* LocalServersMu() {
+  static absl::Mutex* mu = new absl::Mutex();
+  return mu;
+}
+
+std::map<int, ServerImpl*>* LocalServers() {
+  static auto* servers = new std::map<int, ServerImpl*>();
+  return servers;
+}
+
+// Hosts that refer to the local machine for the purpose of matching a server
+// started in this process. The wildcard hosts count since such servers
+// accept loopback connections.
+bool IsLocalhostAddress(absl::string_view host) {
+  return host.empty() || host == "localhost" || host == "127.0.0.1" ||
+         host == "0.0.0.0" || host == "[::]" || host == "[::1]";
+}
+
 class ServerImpl : public Server {
  public:
-  ServerImpl(int port)
+  ServerImpl(int port, std::string unix_address, int num_instances,
+             ServerTransportOptions transport_options)
       : port_(port),
+        unix_address_(std::move(unix_address)),
+        num_instances_(num_instances),
+        transport_options_(transport_options),
+        // The poll backs off to 1s while no signal is pending (the handler
+        // only sets a flag so it cannot wake the closure itself), trading a
+        // bounded SIGINT response delay for fewer idle wakeups.
         signal_worker_(
-            [this] {
+            [this]() -> bool {
               if (stop_signalled_) {
                 Stop();
+                return true;
               }
+              return false;
             },
-            absl::Milliseconds(250)) {}
+            absl::Milliseconds(250), absl::Seconds(1)) {}
 
   absl::Status Initialize(std::vector<std::shared_ptr<Table>> tables,
                           std::shared_ptr<Checkpointer> checkpointer) {
     absl::WriterMutexLock lock(&mu_);
     REVERB_CHECK(!running_) << "Initialize() called twice?";
+    const int metrics_port = absl::GetFlag(FLAGS_reverb_metrics_http_port);
+    if (metrics_port != 0) {
+      REVERB_RETURN_IF_ERROR(
+          StartMetricsExporter(tables, metrics_port, &metrics_exporter_));
+      REVERB_LOG(REVERB_INFO)
+          << "Serving metrics on port " << metrics_port << " (/metrics)";
+    }
     REVERB_RETURN_IF_ERROR(ReverbServiceImpl::Create(
         std::move(tables), std::move(checkpointer), &reverb_service_));
-    server_ = grpc::ServerBuilder()
-                  .AddListeningPort(absl::StrCat("[::]:", port_),
-                                    MakeServerCredentials())
-                  .RegisterService(reverb_service_.get())
-                  .SetMaxSendMessageSize(kMaxMessageSize)
-                  .SetMaxReceiveMessageSize(kMaxMessageSize)
-                  .BuildAndStart();
-    if (!server_) {
-      return absl::InvalidArgumentError("Failed to BuildAndStart gRPC server");
+
+    // All instances register the same service so they serve the same tables
+    // and chunk data; SO_REUSEPORT (on by default in gRPC) lets them bind the
+    // same port and makes the kernel spread incoming connections across
+    // their accept paths.
+    for (int i = 0; i < num_instances_; i++) {
+      grpc::ServerBuilder builder;
+      builder
+          .AddListeningPort(absl::StrCat("[::]:", port_),
+                            MakeServerCredentials())
+          .RegisterService(reverb_service_.get())
+          .SetMaxSendMessageSize(kMaxMessageSize)
+          .SetMaxReceiveMessageSize(kMaxMessageSize);
+      if (transport_options_.http2_stream_window_bytes > 0) {
+        builder.AddChannelArgument(
+            GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+            transport_options_.http2_stream_window_bytes);
+        // BDP probing autotunes the window and would override the forced
+        // value.
+        builder.AddChannelArgument(GRPC_ARG_HTTP2_BDP_PROBE, 0);
+      }
+      if (transport_options_.http2_write_buffer_bytes > 0) {
+        builder.AddChannelArgument(
+            GRPC_ARG_HTTP2_WRITE_BUFFER_SIZE,
+            transport_options_.http2_write_buffer_bytes);
+      }
+      if (i == 0 && !unix_address_.empty()) {
+        // gRPC understands `unix:` targets natively so clients on the same
+        // host can connect to the socket path and skip the TCP stack. Unix
+        // sockets cannot be shared with SO_REUSEPORT so only the first
+        // instance binds it.
+        builder.AddListeningPort(unix_address_, MakeServerCredentials());
+      }
+      auto server = builder.BuildAndStart();
+      if (!server) {
+        return absl::InvalidArgumentError(
+            "Failed to BuildAndStart gRPC server");
+      }
+      servers_.push_back(std::move(server));
     }
     running_ = true;
-    REVERB_LOG(REVERB_INFO) << "Started replay server on port " << port_;
+    if (port_ > 0) {
+      absl::MutexLock registry_lock(LocalServersMu());
+      LocalServers()->emplace(port_, this);
+    }
+    REVERB_LOG(REVERB_INFO) << "Started replay server on port " << port_
+                            << (unix_address_.empty()
+                                    ? ""
+                                    : absl::StrCat(" and ", unix_address_))
+                            << (num_instances_ == 1
+                                    ? ""
+                                    : absl::StrCat(" with ", num_instances_,
+                                                   " server instances"));
     REVERB_RETURN_IF_ERROR(signal_worker_.Start());
     return absl::OkStatus();
   }
@@ -79,6 +179,13 @@ class ServerImpl : public Server {
   }
 
   void Stop() override {
+    {
+      absl::MutexLock registry_lock(LocalServersMu());
+      auto it = LocalServers()->find(port_);
+      if (it != LocalServers()->end() && it->second == this) {
+        LocalServers()->erase(it);
+      }
+    }
     absl::WriterMutexLock lock(&mu_);
     if (!running_) return;
     REVERB_LOG(REVERB_INFO) << "Shutting down replay server";
@@ -86,8 +193,12 @@ class ServerImpl : public Server {
     reverb_service_->Close();
 
     // Set a deadline as the sampler streams never closes by themselves.
-    server_->Shutdown(std::chrono::system_clock::now() +
-                      std::chrono::seconds(5));
+    const auto deadline =
+        std::chrono::system_clock::now() + std::chrono::seconds(5);
+    for (auto &server : servers_) {
+      server->Shutdown(deadline);
+    }
+    metrics_exporter_ = nullptr;
 
     running_ = false;
   }
@@ -102,7 +213,9 @@ class ServerImpl : public Server {
     stop_server_fn = [server_ptr = this] { server_ptr->SignalStop(); };
     std::signal(SIGINT, signal_handler);
 
-    server_->Wait();
+    for (auto &server : servers_) {
+      server->Wait();
+    }
 
     // Disable the signal handler by removing the callback.
     stop_server_fn = []() {};
@@ -111,17 +224,52 @@ class ServerImpl : public Server {
   }
 
   std::string DebugString() const override {
-    return absl::StrCat("Server(port=", port_,
-                        ", reverb_service=", reverb_service_->DebugString(),
-                        ")");
+    return absl::StrCat(
+        "Server(port=", port_,
+        unix_address_.empty() ? ""
+                              : absl::StrCat(", unix_address=", unix_address_),
+        num_instances_ == 1
+            ? ""
+            : absl::StrCat(", num_server_instances=", num_instances_),
+        ", reverb_service=", reverb_service_->DebugString(), ")");
+  }
+
+  std::unique_ptr<Client> InProcessClient() override {
+    grpc::ChannelArguments arguments;
+    arguments.SetMaxReceiveMessageSize(kMaxMessageSize);
+    absl::WriterMutexLock lock(&mu_);
+    REVERB_CHECK(running_)
+        << "InProcessClient called after the server was stopped.";
+    return absl::make_unique<Client>(/* grpc_gen:: */ReverbService::NewStub(
+        servers_.front()->InProcessChannel(arguments)));
   }
 
   void SignalStop() { stop_signalled_ = true; }
 
+  // The unix domain socket address the server listens on, in gRPC form
+  // ("unix:<path>"), or an empty string. Used by `TryInProcessClient` to
+  // match address strings against local servers.
+  const std::string& unix_address() const { return unix_address_; }
+
  private:
   int port_;
+
+  // Address of the unix domain socket the server also listens on, in gRPC
+  // form ("unix:<path>"). Empty if only TCP is used.
+  std::string unix_address_;
+
+  // Number of gRPC server instances sharing `port` through SO_REUSEPORT. All
+  // instances serve `reverb_service_`.
+  int num_instances_;
+
+  // HTTP/2 flow-control and write buffer tuning applied to every instance.
+  ServerTransportOptions transport_options_;
+
   std::unique_ptr<ReverbServiceImpl> reverb_service_;
-  std::unique_ptr<grpc::Server> server_ = nullptr;
+  std::vector<std::unique_ptr<grpc::Server>> servers_;
+
+  // Serves the Prometheus endpoint when --reverb_metrics_http_port is set.
+  std::unique_ptr<MetricsExporter> metrics_exporter_ ABSL_GUARDED_BY(mu_);
 
   absl::Mutex mu_;
   bool running_ ABSL_GUARDED_BY(mu_) = false;
@@ -141,12 +289,147 @@ class ServerImpl : public Server {
 absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
                          std::shared_ptr<Checkpointer> checkpointer,
                          std::unique_ptr<Server> *server) {
-  auto s = absl::make_unique<ServerImpl>(port);
+  return StartServer(std::move(tables), port, /*unix_address=*/"",
+                     std::move(checkpointer), server);
+}
+
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         absl::string_view unix_address,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         std::unique_ptr<Server> *server) {
+  std::string address(unix_address);
+  if (!address.empty() && !absl::StartsWith(address, "unix:")) {
+    address = absl::StrCat("unix:", address);
+  }
+  auto s = absl::make_unique<ServerImpl>(port, std::move(address),
+                                         /*num_instances=*/1,
+                                         ServerTransportOptions());
+  REVERB_RETURN_IF_ERROR(
+      s->Initialize(std::move(tables), std::move(checkpointer)));
+  *server = std::move(s);
+  return absl::OkStatus();
+}
+
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         absl::string_view unix_address,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         const std::map<std::string, int> &numa_placement,
+                         std::unique_ptr<Server> *server) {
+  const int num_nodes = internal::NumNumaNodes();
+  for (const auto &placement : numa_placement) {
+    if (placement.second < 0 || placement.second >= num_nodes) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Invalid NUMA placement: node ", placement.second, " of table ",
+          placement.first, " does not exist; the host has ", num_nodes,
+          " node(s)."));
+    }
+    bool found = false;
+    for (const auto &table : tables) {
+      if (table->name() == placement.first) {
+        table->SetNumaNode(placement.second);
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid NUMA placement: no table named ",
+                       placement.first, " is hosted by the server."));
+    }
+  }
+  return StartServer(std::move(tables), port, unix_address,
+                     std::move(checkpointer), server);
+}
+
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         absl::string_view unix_address,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         const std::map<std::string, int> &numa_placement,
+                         int num_server_instances,
+                         std::unique_ptr<Server> *server) {
+  return StartServer(std::move(tables), port, unix_address,
+                     std::move(checkpointer), numa_placement,
+                     num_server_instances, ServerTransportOptions(), server);
+}
+
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         absl::string_view unix_address,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         const std::map<std::string, int> &numa_placement,
+                         int num_server_instances,
+                         const ServerTransportOptions &transport_options,
+                         std::unique_ptr<Server> *server) {
+  if (transport_options.http2_stream_window_bytes < 0 ||
+      transport_options.http2_write_buffer_bytes < 0) {
+    return absl::InvalidArgumentError(
+        "ServerTransportOptions values must not be negative.");
+  }
+  if (num_server_instances < 1) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "num_server_instances (", num_server_instances, ") must be >= 1"));
+  }
+  if (num_server_instances > 1 && port <= 0) {
+    return absl::InvalidArgumentError(
+        "An explicit port must be provided when more than one server "
+        "instance is requested as all instances must bind the same port.");
+  }
+  const int num_nodes = internal::NumNumaNodes();
+  for (const auto &placement : numa_placement) {
+    if (placement.second < 0 || placement.second >= num_nodes) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Invalid NUMA placement: node ", placement.second, " of table ",
+          placement.first, " does not exist; the host has ", num_nodes,
+          " node(s)."));
+    }
+    bool found = false;
+    for (const auto &table : tables) {
+      if (table->name() == placement.first) {
+        table->SetNumaNode(placement.second);
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid NUMA placement: no table named ",
+                       placement.first, " is hosted by the server."));
+    }
+  }
+  std::string address(unix_address);
+  if (!address.empty() && !absl::StartsWith(address, "unix:")) {
+    address = absl::StrCat("unix:", address);
+  }
+  auto s = absl::make_unique<ServerImpl>(port, std::move(address),
+                                         num_server_instances,
+                                         transport_options);
   REVERB_RETURN_IF_ERROR(
       s->Initialize(std::move(tables), std::move(checkpointer)));
   *server = std::move(s);
   return absl::OkStatus();
 }
 
+std::unique_ptr<Client> TryInProcessClient(absl::string_view server_address) {
+  if (absl::StartsWith(server_address, "unix:")) {
+    absl::MutexLock registry_lock(LocalServersMu());
+    for (auto& entry : *LocalServers()) {
+      if (entry.second->unix_address() == server_address) {
+        return entry.second->InProcessClient();
+      }
+    }
+    return nullptr;
+  }
+  auto pos = server_address.rfind(':');
+  if (pos == absl::string_view::npos) return nullptr;
+  int port = 0;
+  if (!absl::SimpleAtoi(server_address.substr(pos + 1), &port)) {
+    return nullptr;
+  }
+  if (!IsLocalhostAddress(server_address.substr(0, pos))) return nullptr;
+  absl::MutexLock registry_lock(LocalServersMu());
+  auto it = LocalServers()->find(port);
+  if (it == LocalServers()->end()) return nullptr;
+  return it->second->InProcessClient();
+}
+
 }  // namespace reverb
 }  // namespace deepmind
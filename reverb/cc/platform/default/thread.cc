@@ -14,15 +14,72 @@
 
 #include "reverb/cc/platform/thread.h"
 
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
+#include <utility>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
 
 #include "absl/memory/memory.h"
+#include "reverb/cc/platform/logging.h"
 
 namespace deepmind {
 namespace reverb {
 namespace internal {
 namespace {
 
+// Applies `options` to the calling thread. Failures (insufficient privileges,
+// invalid CPU indices, unsupported platform) are logged and skipped so that
+// misconfigured scheduling attributes degrade to default scheduling instead
+// of losing the thread.
+void ApplyThreadOptions(const std::string& name, const ThreadOptions& options) {
+#if defined(__linux__)
+  if (!options.cpu_affinity.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : options.cpu_affinity) {
+      CPU_SET(cpu, &cpu_set);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) !=
+        0) {
+      REVERB_LOG(REVERB_WARNING)
+          << "Failed to set the CPU affinity of thread " << name
+          << "; it runs with the inherited mask.";
+    }
+  }
+  if (options.realtime) {
+    sched_param param;
+    param.sched_priority = options.realtime_priority;
+    if (pthread_setschedparam(pthread_self(), SCHED_RR, &param) != 0) {
+      REVERB_LOG(REVERB_WARNING)
+          << "Failed to move thread " << name
+          << " to the real-time class (priority " << options.realtime_priority
+          << "); it runs with normal scheduling. This typically requires "
+          << "CAP_SYS_NICE or a matching RLIMIT_RTPRIO.";
+    }
+  } else if (options.nice != 0) {
+    if (setpriority(PRIO_PROCESS, /*who=*/0, options.nice) != 0) {
+      REVERB_LOG(REVERB_WARNING)
+          << "Failed to set the nice value of thread " << name << " to "
+          << options.nice
+          << "; it runs at the inherited priority. Lowering the value below "
+          << "0 requires CAP_SYS_NICE.";
+    }
+  }
+#else
+  if (!options.cpu_affinity.empty() || options.nice != 0 || options.realtime) {
+    REVERB_LOG(REVERB_WARNING)
+        << "Thread scheduling options of thread " << name
+        << " are not supported on this platform and were ignored.";
+  }
+#endif
+}
+
 class StdThread : public Thread {
  public:
   explicit StdThread(std::function<void()> fn) : thread_(std::move(fn)) {}
@@ -40,6 +97,16 @@ std::unique_ptr<Thread> StartThread(absl::string_view name,
   return {absl::make_unique<StdThread>(std::move(fn))};
 }
 
+std::unique_ptr<Thread> StartThread(absl::string_view name,
+                                    const ThreadOptions& options,
+                                    std::function<void()> fn) {
+  return {absl::make_unique<StdThread>(
+      [name = std::string(name), options, fn = std::move(fn)] {
+        ApplyThreadOptions(name, options);
+        fn();
+      })};
+}
+
 }  // namespace internal
 }  // namespace reverb
 }  // namespace deepmind
@@ -0,0 +1,52 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_PLATFORM_METRICS_H_
+#define REVERB_CC_PLATFORM_METRICS_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "reverb/cc/table.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Embedded HTTP endpoint exporting server statistics in the Prometheus text
+// exposition format so that standard scrape based monitoring can observe
+// replay health without going through the `ServerInfo` RPC.
+//
+// Exported metrics include per table sizes, episode counts, rate limiter
+// call counts, table worker time per state, request queue depths, and
+// latency histograms of the hot-path stages recorded by
+// `reverb/cc/support/trace.h` (rate limiter waits, selector draws, chunk
+// gathering and response writes).
+//
+// The exporter serves `GET /metrics` until destroyed.
+class MetricsExporter {
+ public:
+  virtual ~MetricsExporter() = default;
+};
+
+// Starts an exporter listening on `port` (all interfaces) and serving
+// metrics for `tables`. Returns an error if the port cannot be bound.
+absl::Status StartMetricsExporter(std::vector<std::shared_ptr<Table>> tables,
+                                  int port,
+                                  std::unique_ptr<MetricsExporter>* exporter);
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_PLATFORM_METRICS_H_
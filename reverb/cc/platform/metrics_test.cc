@@ -0,0 +1,97 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/platform/metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/net.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/rate_limiter.h"
+#include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/table.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+std::shared_ptr<Table> MakeTable(const std::string& name) {
+  return std::make_shared<Table>(
+      name, std::make_shared<UniformSelector>(),
+      std::make_shared<UniformSelector>(),
+      /*max_size=*/1000,
+      /*max_times_sampled=*/0,
+      std::make_shared<RateLimiter>(
+          /*samples_per_insert=*/1.0, /*min_size_to_sample=*/1,
+          /*min_diff=*/-1000, /*max_diff=*/1000));
+}
+
+// Fetches http://localhost:port/metrics with a raw socket.
+std::string Scrape(int port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  REVERB_CHECK_GE(fd, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  REVERB_CHECK_EQ(
+      connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+  const absl::string_view request = "GET /metrics HTTP/1.0\r\n\r\n";
+  REVERB_CHECK_EQ(send(fd, request.data(), request.size(), 0),
+                  static_cast<ssize_t>(request.size()));
+  std::string response;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    response.append(buf, n);
+  }
+  close(fd);
+  return response;
+}
+
+TEST(MetricsTest, ServesTableMetrics) {
+  const int port = internal::PickUnusedPortOrDie();
+  std::unique_ptr<MetricsExporter> exporter;
+  REVERB_ASSERT_OK(
+      StartMetricsExporter({MakeTable("dist")}, port, &exporter));
+  const std::string response = Scrape(port);
+  EXPECT_THAT(response, ::testing::HasSubstr("200 OK"));
+  EXPECT_THAT(response, ::testing::HasSubstr(
+                            "reverb_table_current_size{table=\"dist\"} 0"));
+  EXPECT_THAT(response,
+              ::testing::HasSubstr("reverb_stage_duration_seconds"));
+}
+
+TEST(MetricsTest, ErrorOnInvalidPort) {
+  std::unique_ptr<MetricsExporter> exporter;
+  EXPECT_EQ(StartMetricsExporter({}, -1, &exporter).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
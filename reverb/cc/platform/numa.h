@@ -0,0 +1,42 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Used to switch between different NUMA placement implementations. The
+// default implementation uses the Linux sysfs topology and scheduler APIs and
+// degrades to a single node on platforms without NUMA support.
+
+#ifndef REVERB_CC_PLATFORM_NUMA_H_
+#define REVERB_CC_PLATFORM_NUMA_H_
+
+#include "absl/status/status.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Number of NUMA nodes on the host. Returns 1 when the platform does not
+// expose a memory topology.
+int NumNumaNodes();
+
+// Restricts the calling thread to the CPUs of `node` and makes the node the
+// preferred target for the thread's future page allocations. Returns an error
+// when the node does not exist or the platform does not support NUMA
+// placement.
+absl::Status BindCurrentThreadToNumaNode(int node);
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_PLATFORM_NUMA_H_
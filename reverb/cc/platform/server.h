@@ -15,10 +15,13 @@
 #ifndef REVERB_CC_PLATFORM_SERVER_H_
 #define REVERB_CC_PLATFORM_SERVER_H_
 
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "reverb/cc/checkpointing/interface.h"
 #include "reverb/cc/client.h"
 #include "reverb/cc/table.h"
@@ -29,6 +32,24 @@ namespace reverb {
 // Unlimited.
 constexpr int kMaxMessageSize = -1;
 
+// HTTP/2 transport tuning for the gRPC servers started by `StartServer`.
+// The defaults leave gRPC's own settings (including BDP based window
+// autotuning) untouched; they are the right choice for most deployments.
+// Cross-zone links with a large bandwidth-delay product are the typical
+// reason to force larger values. The `response_write_stall` stage on the
+// metrics endpoint shows how much time streams spend blocked on the
+// transport and is the signal to tune against.
+struct ServerTransportOptions {
+  // When positive, the per-stream flow-control window in bytes offered to
+  // peers. Forcing a window also disables gRPC's BDP probing, which would
+  // otherwise override it.
+  int http2_stream_window_bytes = 0;
+
+  // When positive, the number of bytes the transport may buffer per write
+  // before blocking the sender.
+  int http2_write_buffer_bytes = 0;
+};
+
 class Server {
  public:
   virtual ~Server() = default;
@@ -43,12 +64,75 @@ class Server {
 
   // Returns a summary string description.
   virtual std::string DebugString() const = 0;
+
+  // Creates a client that communicates with the server over an in-process
+  // channel, bypassing the network stack entirely. This is by far the
+  // cheapest transport for clients living in the same process as the server.
+  // Must not be called after `Stop`.
+  virtual std::unique_ptr<Client> InProcessClient() = 0;
 };
 
 absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
                          std::shared_ptr<Checkpointer> checkpointer,
                          std::unique_ptr<Server> *server);
 
+// As above but, when `unix_address` is non empty, the server also listens on
+// a unix domain socket (e.g. "unix:/tmp/reverb.sock"; the "unix:" prefix is
+// added if missing). Clients colocated on the same host can connect to the
+// socket path instead of TCP loopback, which avoids the TCP stack overhead.
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         absl::string_view unix_address,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         std::unique_ptr<Server> *server);
+
+// As above but additionally places tables on NUMA nodes before serving
+// starts. `numa_placement` maps table names to node indices; each named
+// table's worker threads, and through the threads' memory policy the pages
+// they allocate, are pinned to the node so tables can be split across the
+// sockets of a multi socket host deliberately. Returns an error when a name
+// does not match any of `tables` or a node does not exist on the host.
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         absl::string_view unix_address,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         const std::map<std::string, int> &numa_placement,
+                         std::unique_ptr<Server> *server);
+
+// As above but starts `num_server_instances` gRPC server instances instead of
+// one. All instances serve the same service and therefore the same tables and
+// chunk data; they listen on the same `port` via SO_REUSEPORT so the kernel
+// spreads incoming connections across their accept paths and completion
+// queues. This provides the accept-path parallelism of running several
+// servers per host without duplicating any data between them. `port` must be
+// an explicit port (not 0) when more than one instance is requested, and the
+// unix domain socket, if any, is only bound by the first instance. Returns an
+// error when `num_server_instances < 1`.
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         absl::string_view unix_address,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         const std::map<std::string, int> &numa_placement,
+                         int num_server_instances,
+                         std::unique_ptr<Server> *server);
+
+// As above but additionally applies `transport_options` to every server
+// instance. Returns an error when an option is negative.
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         absl::string_view unix_address,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         const std::map<std::string, int> &numa_placement,
+                         int num_server_instances,
+                         const ServerTransportOptions &transport_options,
+                         std::unique_ptr<Server> *server);
+
+// Returns a client connected over the in-process channel of a server started
+// by this process that listens on the port of `server_address`, or nullptr
+// when no such server is running. Only addresses that refer to the local
+// host ("localhost:<port>", "127.0.0.1:<port>", "[::]:<port>" and the like,
+// or the exact unix domain socket address of a local server) can match. This
+// lets code that only holds an address string, such as the TF op resources,
+// pick up the cheap in-process transport when client and server happen to
+// share a process.
+std::unique_ptr<Client> TryInProcessClient(absl::string_view server_address);
+
 }  // namespace reverb
 }  // namespace deepmind
 
@@ -46,6 +46,96 @@ TEST(ServerTest, ErrorOnUnavailablePort) {
               ::testing::HasSubstr("Failed to BuildAndStart gRPC server"));
 }
 
+TEST(ServerTest, ErrorOnNumaPlacementForUnknownTable) {
+  int port = internal::PickUnusedPortOrDie();
+  std::unique_ptr<Server> server;
+  auto status = StartServer(/*tables=*/{},
+                            /*port=*/port, /*unix_address=*/"",
+                            /*checkpointer=*/nullptr,
+                            /*numa_placement=*/{{"no_such_table", 0}}, &server);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(std::string(status.message()),
+              ::testing::HasSubstr("no table named no_such_table"));
+}
+
+TEST(ServerTest, ErrorOnNumaPlacementForUnknownNode) {
+  int port = internal::PickUnusedPortOrDie();
+  std::unique_ptr<Server> server;
+  auto status =
+      StartServer(/*tables=*/{},
+                  /*port=*/port, /*unix_address=*/"",
+                  /*checkpointer=*/nullptr,
+                  /*numa_placement=*/{{"table", 1 << 20}}, &server);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(std::string(status.message()),
+              ::testing::HasSubstr("does not exist"));
+}
+
+TEST(ServerTest, StartServerWithMultipleInstances) {
+  int port = internal::PickUnusedPortOrDie();
+  std::unique_ptr<Server> server;
+  REVERB_EXPECT_OK(StartServer(/*tables=*/{},
+                               /*port=*/port, /*unix_address=*/"",
+                               /*checkpointer=*/nullptr,
+                               /*numa_placement=*/{},
+                               /*num_server_instances=*/2, &server));
+}
+
+TEST(ServerTest, ErrorOnMultipleInstancesWithoutExplicitPort) {
+  std::unique_ptr<Server> server;
+  auto status = StartServer(/*tables=*/{},
+                            /*port=*/0, /*unix_address=*/"",
+                            /*checkpointer=*/nullptr,
+                            /*numa_placement=*/{},
+                            /*num_server_instances=*/2, &server);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(std::string(status.message()),
+              ::testing::HasSubstr("explicit port"));
+}
+
+TEST(ServerTest, StartServerWithTransportOptions) {
+  int port = internal::PickUnusedPortOrDie();
+  std::unique_ptr<Server> server;
+  ServerTransportOptions transport_options;
+  transport_options.http2_stream_window_bytes = 8 * 1024 * 1024;
+  transport_options.http2_write_buffer_bytes = 1024 * 1024;
+  REVERB_EXPECT_OK(StartServer(/*tables=*/{},
+                               /*port=*/port, /*unix_address=*/"",
+                               /*checkpointer=*/nullptr,
+                               /*numa_placement=*/{},
+                               /*num_server_instances=*/1, transport_options,
+                               &server));
+}
+
+TEST(ServerTest, ErrorOnNegativeTransportOptions) {
+  int port = internal::PickUnusedPortOrDie();
+  std::unique_ptr<Server> server;
+  ServerTransportOptions transport_options;
+  transport_options.http2_stream_window_bytes = -1;
+  auto status = StartServer(/*tables=*/{},
+                            /*port=*/port, /*unix_address=*/"",
+                            /*checkpointer=*/nullptr,
+                            /*numa_placement=*/{},
+                            /*num_server_instances=*/1, transport_options,
+                            &server);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(std::string(status.message()),
+              ::testing::HasSubstr("must not be negative"));
+}
+
+TEST(ServerTest, ErrorOnNonPositiveNumServerInstances) {
+  int port = internal::PickUnusedPortOrDie();
+  std::unique_ptr<Server> server;
+  auto status = StartServer(/*tables=*/{},
+                            /*port=*/port, /*unix_address=*/"",
+                            /*checkpointer=*/nullptr,
+                            /*numa_placement=*/{},
+                            /*num_server_instances=*/0, &server);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(std::string(status.message()),
+              ::testing::HasSubstr("must be >= 1"));
+}
+
 }  // namespace
 }  // namespace reverb
 }  // namespace deepmind
@@ -15,6 +15,7 @@
 #include "reverb/cc/platform/tfrecord_checkpointer.h"
 
 #include <algorithm>
+#include <functional>
 #include <iterator>
 #include <memory>
 #include <string>
@@ -23,9 +24,12 @@
 
 #include <cstdint>
 #include "absl/memory/memory.h"
+#include "absl/random/random.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
@@ -34,14 +38,11 @@
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/hash_set.h"
 #include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/platform/thread.h"
 #include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/schema.pb.h"
-#include "reverb/cc/selectors/fifo.h"
-#include "reverb/cc/selectors/heap.h"
 #include "reverb/cc/selectors/interface.h"
-#include "reverb/cc/selectors/lifo.h"
-#include "reverb/cc/selectors/prioritized.h"
-#include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/selectors/make_selector.h"
 #include "reverb/cc/support/tf_util.h"
 #include "reverb/cc/support/trajectory_util.h"
 #include "reverb/cc/table.h"
@@ -58,7 +59,19 @@ namespace {
 
 constexpr char kTablesFileName[] = "tables.tfrecord";
 constexpr char kChunksFileName[] = "chunks.tfrecord";
+constexpr char kLazyChunksFileName[] = "chunks.index.tfrecord";
+constexpr char kPayloadsFileName[] = "chunks.payloads";
 constexpr char kDoneFileName[] = "DONE";
+constexpr char kManifestFileName[] = "MANIFEST";
+
+// Payloads in a lazy checkpoint are aligned to this boundary so that demand
+// faults after a restore read whole pages.
+constexpr uint64_t kPayloadAlignment = 4096;
+
+// Maximum number of prior generations an incremental checkpoint may
+// reference. Once the manifest would grow beyond this the next save rewrites
+// all chunks, which compacts the chain and lets stale generations be deleted.
+constexpr int kMaxGenerationChain = 10;
 
 using RecordWriterUniquePtr =
     std::unique_ptr<tensorflow::io::RecordWriter,
@@ -109,25 +122,266 @@ inline bool HasDone(const std::string& path) {
       .ok();
 }
 
-std::unique_ptr<ItemSelector> MakeDistribution(
-    const KeyDistributionOptions& options) {
-  switch (options.distribution_case()) {
-    case KeyDistributionOptions::kFifo:
-      return absl::make_unique<FifoSelector>();
-    case KeyDistributionOptions::kLifo:
-      return absl::make_unique<LifoSelector>();
-    case KeyDistributionOptions::kUniform:
-      return absl::make_unique<UniformSelector>();
-    case KeyDistributionOptions::kPrioritized:
-      return absl::make_unique<PrioritizedSelector>(
-          options.prioritized().priority_exponent());
-    case KeyDistributionOptions::kHeap:
-      return absl::make_unique<HeapSelector>(options.heap().min_heap());
-    case KeyDistributionOptions::DISTRIBUTION_NOT_SET:
-      REVERB_LOG(REVERB_FATAL) << "Selector not set";
-    default:
-      REVERB_LOG(REVERB_FATAL) << "Selector not supported";
+// True if the checkpoint directory holds chunks in the lazy layout.
+bool HasLazyChunks(const std::string& path) {
+  std::vector<std::string> paths;
+  return tensorflow::Env::Default()
+             ->GetMatchingPaths(
+                 tensorflow::io::JoinPath(
+                     path, absl::StrCat(kLazyChunksFileName, "*")),
+                 &paths)
+             .ok() &&
+         !paths.empty();
+}
+
+absl::Status WriteManifest(const std::string& dir_path,
+                           const std::vector<std::string>& generations) {
+  std::unique_ptr<tensorflow::WritableFile> file;
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(tensorflow::Env::Default()->NewWritableFile(
+          tensorflow::io::JoinPath(dir_path, kManifestFileName), &file)));
+  for (const auto& generation : generations) {
+    REVERB_RETURN_IF_ERROR(
+        FromTensorflowStatus(file->Append(absl::StrCat(generation, "\n"))));
+  }
+  return FromTensorflowStatus(file->Close());
+}
+
+// Populates `generations` with the basenames listed in the MANIFEST of the
+// checkpoint at `dir_path`. A checkpoint without a manifest is self contained
+// and leaves `generations` untouched.
+absl::Status ReadManifest(const std::string& dir_path,
+                          std::vector<std::string>* generations) {
+  const std::string manifest_path =
+      tensorflow::io::JoinPath(dir_path, kManifestFileName);
+  if (!tensorflow::Env::Default()->FileExists(manifest_path).ok()) {
+    return absl::OkStatus();
+  }
+  std::string contents;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(tensorflow::ReadFileToString(
+      tensorflow::Env::Default(), manifest_path, &contents)));
+  for (absl::string_view line :
+       absl::StrSplit(contents, '\n', absl::SkipEmpty())) {
+    generations->push_back(std::string(line));
   }
+  return absl::OkStatus();
+}
+
+// Returns the file name of shard `shard` of the file family `base`.
+// Unsharded checkpoints keep the plain file name so that they can be read by
+// older binaries.
+std::string ShardFileName(absl::string_view base, int shard, int num_shards) {
+  if (num_shards == 1) {
+    return std::string(base);
+  }
+  return absl::StrFormat("%s-%05d-of-%05d", base, shard, num_shards);
+}
+
+// Writes the records of a single chunk shard file.
+absl::Status WriteChunkShard(const std::string& file_path,
+                             const std::vector<const ChunkStore::Chunk*>& chunks) {
+  RecordWriterUniquePtr chunk_writer;
+  REVERB_RETURN_IF_ERROR(OpenWriter(file_path, &chunk_writer));
+  for (const auto* chunk : chunks) {
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        chunk_writer->WriteRecord(chunk->data().SerializeAsString())));
+  }
+  return FromTensorflowStatus(chunk_writer->Close());
+}
+
+// Writes the records and payloads of a single lazy chunk shard. The metadata
+// of each chunk is written as a `LazyChunkRecord` to `index_path` while its
+// serialized payload is appended page-aligned to `payloads_path`.
+absl::Status WriteLazyChunkShard(
+    const std::string& index_path, const std::string& payloads_path,
+    const std::vector<const ChunkStore::Chunk*>& chunks) {
+  RecordWriterUniquePtr index_writer;
+  REVERB_RETURN_IF_ERROR(OpenWriter(index_path, &index_writer));
+  std::unique_ptr<tensorflow::WritableFile> payloads;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      tensorflow::Env::Default()->NewWritableFile(payloads_path, &payloads)));
+
+  uint64_t offset = 0;
+  for (const auto* chunk : chunks) {
+    const uint64_t aligned =
+        (offset + kPayloadAlignment - 1) / kPayloadAlignment * kPayloadAlignment;
+    if (aligned > offset) {
+      REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+          payloads->Append(std::string(aligned - offset, '\0'))));
+      offset = aligned;
+    }
+
+    const ChunkData& data = chunk->data();
+    const std::string payload = data.data().SerializeAsString();
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(payloads->Append(payload)));
+
+    LazyChunkRecord record;
+    *record.mutable_chunk() = data;
+    record.mutable_chunk()->mutable_data()->Clear();
+    record.set_payload_offset(offset);
+    record.set_payload_length(payload.size());
+    record.set_full_byte_size(data.ByteSizeLong());
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        index_writer->WriteRecord(record.SerializeAsString())));
+
+    offset += payload.size();
+  }
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(payloads->Close()));
+  return FromTensorflowStatus(index_writer->Close());
+}
+
+// Registers every chunk recorded in the lazy shard at `index_path` with
+// `chunk_store` without reading any payloads; the chunks fault their payloads
+// in from `payloads_path` on first access.
+absl::Status LoadLazyChunkFile(
+    const std::string& index_path, const std::string& payloads_path,
+    ChunkStore* chunk_store,
+    internal::flat_hash_map<ChunkStore::Key, std::shared_ptr<ChunkStore::Chunk>>*
+        chunk_by_key) {
+  std::shared_ptr<internal::ChunkSpillFile> payloads;
+  REVERB_RETURN_IF_ERROR(
+      internal::ChunkSpillFile::OpenForRead(payloads_path, &payloads));
+  RecordReaderUniquePtr index_reader;
+  REVERB_RETURN_IF_ERROR(OpenReader(index_path, &index_reader));
+
+  LazyChunkRecord record;
+  absl::Status record_status;
+  tensorflow::uint64 record_offset = 0;
+  tensorflow::tstring record_data;
+  do {
+    record_status = FromTensorflowStatus(
+        index_reader->ReadRecord(&record_offset, &record_data));
+    if (!record_status.ok()) break;
+    if (!record.ParseFromArray(record_data.data(), record_data.size())) {
+      return absl::DataLossError(
+          absl::StrCat("Could not parse TFRecord as LazyChunkRecord: '",
+                       absl::string_view(record_data), "'"));
+    }
+    const ChunkStore::Key key = record.chunk().chunk_key();
+    (*chunk_by_key)[key] = chunk_store->InsertLazy(
+        std::move(*record.mutable_chunk()), payloads, record.payload_offset(),
+        record.payload_length(), record.full_byte_size());
+  } while (record_status.ok());
+  if (!absl::IsOutOfRange(record_status)) {
+    return record_status;
+  }
+  return absl::OkStatus();
+}
+
+// Inserts every chunk stored in the record file at `file_path` into
+// `chunk_store` and records it in `chunk_by_key`.
+absl::Status LoadChunkFile(
+    const std::string& file_path, ChunkStore* chunk_store,
+    internal::flat_hash_map<ChunkStore::Key, std::shared_ptr<ChunkStore::Chunk>>*
+        chunk_by_key) {
+  RecordReaderUniquePtr chunk_reader;
+  REVERB_RETURN_IF_ERROR(OpenReader(file_path, &chunk_reader));
+
+  ChunkData chunk_data;
+  absl::Status chunk_status;
+  tensorflow::uint64 chunk_offset = 0;
+  tensorflow::tstring chunk_record;
+  do {
+    chunk_status = FromTensorflowStatus(
+        chunk_reader->ReadRecord(&chunk_offset, &chunk_record));
+    if (!chunk_status.ok()) break;
+    if (!chunk_data.ParseFromArray(chunk_record.data(), chunk_record.size())) {
+      return absl::DataLossError(
+          absl::StrCat("Could not parse TFRecord as ChunkData: '",
+                       absl::string_view(chunk_record), "'"));
+    }
+    if (chunk_data.deprecated_data_size()) {
+      if (!chunk_data.data().tensors().empty()) {
+        return absl::InternalError(
+            absl::StrCat("Checkpoint ChunkData at offset: ", chunk_offset,
+                         " has both data and deprecated_data."));
+      }
+      chunk_data.mutable_data()->mutable_tensors()->Swap(
+          chunk_data.mutable_deprecated_data());
+    }
+    (*chunk_by_key)[chunk_data.chunk_key()] = chunk_store->Insert(chunk_data);
+  } while (chunk_status.ok());
+  if (!absl::IsOutOfRange(chunk_status)) {
+    return chunk_status;
+  }
+  return absl::OkStatus();
+}
+
+using ChunkMap =
+    internal::flat_hash_map<ChunkStore::Key, std::shared_ptr<ChunkStore::Chunk>>;
+
+// Runs `load_file` for every path in `file_paths` with one thread per file.
+// `ChunkStore` mutations are thread safe but the output map is not; each
+// thread fills its own map and the results are merged after the join.
+absl::Status LoadChunkFilesInParallel(
+    const std::vector<std::string>& file_paths,
+    const std::function<absl::Status(const std::string&, ChunkMap*)>& load_file,
+    ChunkMap* chunk_by_key) {
+  if (file_paths.size() == 1) {
+    return load_file(file_paths[0], chunk_by_key);
+  }
+  std::vector<ChunkMap> shard_chunks(file_paths.size());
+  std::vector<absl::Status> statuses(file_paths.size());
+  {
+    std::vector<std::unique_ptr<internal::Thread>> threads;
+    for (int i = 0; i < file_paths.size(); i++) {
+      threads.push_back(
+          internal::StartThread(absl::StrCat("load_chunks_", i), [&, i] {
+            statuses[i] = load_file(file_paths[i], &shard_chunks[i]);
+          }));
+    }
+  }  // Joins the threads.
+  for (int i = 0; i < file_paths.size(); i++) {
+    REVERB_RETURN_IF_ERROR(statuses[i]);
+    chunk_by_key->insert(shard_chunks[i].begin(), shard_chunks[i].end());
+  }
+  return absl::OkStatus();
+}
+
+// Loads every chunk file of the checkpoint directory `path`, reading shard
+// files in parallel with one thread each. The layout (lazy or full records,
+// sharded or not) is detected from the files present.
+absl::Status LoadChunks(const std::string& path, ChunkStore* chunk_store,
+                        ChunkMap* chunk_by_key) {
+  std::vector<std::string> lazy_paths;
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
+          tensorflow::io::JoinPath(path,
+                                   absl::StrCat(kLazyChunksFileName, "*")),
+          &lazy_paths)));
+  if (!lazy_paths.empty()) {
+    return LoadChunkFilesInParallel(
+        lazy_paths,
+        [&path, chunk_store](const std::string& index_path, ChunkMap* chunks) {
+          // The payloads file of a shard carries the same shard suffix as its
+          // index file.
+          const std::string suffix(
+              absl::string_view(tensorflow::io::Basename(index_path))
+                  .substr(sizeof(kLazyChunksFileName) - 1));
+          return LoadLazyChunkFile(
+              index_path,
+              tensorflow::io::JoinPath(path,
+                                       absl::StrCat(kPayloadsFileName, suffix)),
+              chunk_store, chunks);
+        },
+        chunk_by_key);
+  }
+
+  std::vector<std::string> shard_paths;
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
+          tensorflow::io::JoinPath(path, absl::StrCat(kChunksFileName, "*")),
+          &shard_paths)));
+  if (shard_paths.empty()) {
+    return absl::NotFoundError(
+        absl::StrCat("No chunk files found in checkpoint directory ", path));
+  }
+  return LoadChunkFilesInParallel(
+      shard_paths,
+      [chunk_store](const std::string& file_path, ChunkMap* chunks) {
+        return LoadChunkFile(file_path, chunk_store, chunks);
+      },
+      chunk_by_key);
 }
 
 inline size_t find_table_index(
@@ -143,10 +397,14 @@ inline size_t find_table_index(
 
 TFRecordCheckpointer::TFRecordCheckpointer(
     std::string root_dir, std::string group,
-    absl::optional<std::string> fallback_checkpoint_path)
+    absl::optional<std::string> fallback_checkpoint_path, bool incremental,
+    int num_chunk_shards, bool lazy_chunks)
     : root_dir_(std::move(root_dir)),
       group_(std::move(group)),
-      fallback_checkpoint_path_(std::move(fallback_checkpoint_path)) {
+      fallback_checkpoint_path_(std::move(fallback_checkpoint_path)),
+      incremental_(incremental),
+      num_chunk_shards_(std::max(1, num_chunk_shards)),
+      lazy_chunks_(lazy_chunks) {
   REVERB_LOG(REVERB_INFO) << " Initializing TFRecordCheckpointer in "
                           << root_dir_
                           << (fallback_checkpoint_path_.has_value()
@@ -167,8 +425,11 @@ absl::Status TFRecordCheckpointer::Save(std::vector<Table*> tables,
         "Setting non-empty group is not supported");
   }
 
+  absl::MutexLock lock(&mu_);
+
   std::string dir_path =
       tensorflow::io::JoinPath(root_dir_, absl::FormatTime(absl::Now()));
+  const std::string generation(tensorflow::io::Basename(dir_path));
   REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
       tensorflow::Env::Default()->RecursivelyCreateDir(dir_path)));
 
@@ -187,36 +448,124 @@ absl::Status TFRecordCheckpointer::Save(std::vector<Table*> tables,
   REVERB_RETURN_IF_ERROR(FromTensorflowStatus(table_writer->Close()));
   table_writer = nullptr;
 
-  RecordWriterUniquePtr chunk_writer;
-  REVERB_RETURN_IF_ERROR(OpenWriter(
-      tensorflow::io::JoinPath(dir_path, kChunksFileName), &chunk_writer));
+  // Partition the chunks into those that must be written with this checkpoint
+  // and those already persisted by a retained prior generation. The chain of
+  // referenced generations is bounded; once it grows too long all chunks are
+  // rewritten which compacts the chain.
+  std::vector<const ChunkStore::Chunk*> chunks_to_write;
+  internal::flat_hash_set<std::string> referenced_generations;
+  bool full_save = true;
+  if (incremental_) {
+    std::vector<const ChunkStore::Chunk*> new_chunks;
+    for (const auto& chunk : chunks) {
+      auto it = persisted_chunk_generation_.find(chunk->key());
+      if (it == persisted_chunk_generation_.end()) {
+        new_chunks.push_back(chunk.get());
+      } else {
+        referenced_generations.insert(it->second);
+      }
+    }
+    if (referenced_generations.size() <= kMaxGenerationChain) {
+      full_save = false;
+      chunks_to_write = std::move(new_chunks);
+    }
+  }
+  if (full_save) {
+    referenced_generations.clear();
+    chunks_to_write.reserve(chunks.size());
+    for (const auto& chunk : chunks) {
+      chunks_to_write.push_back(chunk.get());
+    }
+  }
 
-  for (const auto& chunk : chunks) {
-    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
-        chunk_writer->WriteRecord(chunk->data().SerializeAsString())));
+  // Partition the chunks across the shard files by key and write the shards
+  // in parallel. Chunk keys are drawn uniformly at random so the shards are
+  // balanced.
+  std::vector<std::vector<const ChunkStore::Chunk*>> sharded_chunks(
+      num_chunk_shards_);
+  for (const auto* chunk : chunks_to_write) {
+    sharded_chunks[chunk->key() % num_chunk_shards_].push_back(chunk);
+  }
+  std::vector<absl::Status> shard_statuses(num_chunk_shards_);
+  {
+    std::vector<std::unique_ptr<internal::Thread>> threads;
+    for (int shard = 0; shard < num_chunk_shards_; shard++) {
+      threads.push_back(
+          internal::StartThread(absl::StrCat("save_chunks_", shard), [&, shard] {
+            if (lazy_chunks_) {
+              shard_statuses[shard] = WriteLazyChunkShard(
+                  tensorflow::io::JoinPath(
+                      dir_path, ShardFileName(kLazyChunksFileName, shard,
+                                              num_chunk_shards_)),
+                  tensorflow::io::JoinPath(
+                      dir_path, ShardFileName(kPayloadsFileName, shard,
+                                              num_chunk_shards_)),
+                  sharded_chunks[shard]);
+            } else {
+              shard_statuses[shard] = WriteChunkShard(
+                  tensorflow::io::JoinPath(
+                      dir_path, ShardFileName(kChunksFileName, shard,
+                                              num_chunk_shards_)),
+                  sharded_chunks[shard]);
+            }
+          }));
+    }
+  }  // Joins the threads.
+  for (const auto& status : shard_statuses) {
+    REVERB_RETURN_IF_ERROR(status);
+  }
+
+  if (!referenced_generations.empty()) {
+    std::vector<std::string> sorted_generations(referenced_generations.begin(),
+                                                referenced_generations.end());
+    std::sort(sorted_generations.begin(), sorted_generations.end());
+    REVERB_RETURN_IF_ERROR(WriteManifest(dir_path, sorted_generations));
   }
-  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(chunk_writer->Close()));
-  chunk_writer = nullptr;
 
   // Both chunks and table checkpoint has now been written so we can proceed to
   // add the DONE-file.
   REVERB_RETURN_IF_ERROR(WriteDone(dir_path));
 
-  // Delete the older checkpoints.
+  if (incremental_) {
+    // Rebuild the index so it holds exactly the chunks of this checkpoint.
+    // Chunks written now live in this generation; previously persisted chunks
+    // keep the generation that holds them (unless everything was rewritten).
+    internal::flat_hash_map<uint64_t, std::string> new_index;
+    new_index.reserve(chunks.size());
+    for (const auto& chunk : chunks) {
+      auto it = persisted_chunk_generation_.find(chunk->key());
+      new_index[chunk->key()] =
+          full_save || it == persisted_chunk_generation_.end() ? generation
+                                                               : it->second;
+    }
+    persisted_chunk_generation_ = std::move(new_index);
+  }
+
+  // Delete the older checkpoints, except for generations that a retained
+  // incremental checkpoint still references through its manifest.
   std::vector<std::string> filenames;
   REVERB_RETURN_IF_ERROR(
       FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
           tensorflow::io::JoinPath(root_dir_, "*"), &filenames)));
   std::sort(filenames.begin(), filenames.end());
+  internal::flat_hash_set<std::string> retained = lazy_loaded_generations_;
   int history_counter = 0;
   for (auto it = filenames.rbegin(); it != filenames.rend(); it++) {
-    if (++history_counter > keep_latest) {
-      tensorflow::int64 undeleted_files;
-      tensorflow::int64 undeleted_dirs;
-      REVERB_RETURN_IF_ERROR(
-          FromTensorflowStatus(tensorflow::Env::Default()->DeleteRecursively(
-              *it, &undeleted_files, &undeleted_dirs)));
+    if (++history_counter > keep_latest) break;
+    retained.insert(std::string(tensorflow::io::Basename(*it)));
+    std::vector<std::string> manifest;
+    REVERB_RETURN_IF_ERROR(ReadManifest(*it, &manifest));
+    retained.insert(manifest.begin(), manifest.end());
+  }
+  for (const auto& filename : filenames) {
+    if (retained.contains(std::string(tensorflow::io::Basename(filename)))) {
+      continue;
     }
+    tensorflow::int64 undeleted_files;
+    tensorflow::int64 undeleted_dirs;
+    REVERB_RETURN_IF_ERROR(
+        FromTensorflowStatus(tensorflow::Env::Default()->DeleteRecursively(
+            filename, &undeleted_files, &undeleted_dirs)));
   }
 
   *path = std::move(dir_path);
@@ -234,41 +583,39 @@ absl::Status TFRecordCheckpointer::Load(
   // Insert data first to ensure that all data referenced by the tables
   // exists. Keep the map of chunks around so that none of the chunks are
   // cleaned up before all the tables have been loaded.
+  //
+  // An incremental checkpoint references chunks persisted by prior
+  // generations through its manifest; those are loaded before the
+  // checkpoint's own chunks.
   internal::flat_hash_map<ChunkStore::Key, std::shared_ptr<ChunkStore::Chunk>>
       chunk_by_key;
+  std::vector<std::string> referenced_generations;
+  REVERB_RETURN_IF_ERROR(
+      ReadManifest(std::string(path), &referenced_generations));
+  for (const auto& generation : referenced_generations) {
+    REVERB_RETURN_IF_ERROR(LoadChunks(
+        tensorflow::io::JoinPath(
+            tensorflow::io::Dirname(std::string(path)), generation),
+        chunk_store, &chunk_by_key));
+  }
+  REVERB_RETURN_IF_ERROR(
+      LoadChunks(std::string(path), chunk_store, &chunk_by_key));
+
+  // Generations whose payload files now back lazily loaded chunks must
+  // survive the `keep_latest` cleanup for as long as this process may fault
+  // payloads in from them.
   {
-    RecordReaderUniquePtr chunk_reader;
-    REVERB_RETURN_IF_ERROR(
-        OpenReader(tensorflow::io::JoinPath(std::string(path), kChunksFileName),
-                   &chunk_reader));
-
-    ChunkData chunk_data;
-    absl::Status chunk_status;
-    tensorflow::uint64 chunk_offset = 0;
-    tensorflow::tstring chunk_record;
-    do {
-      chunk_status = FromTensorflowStatus(
-          chunk_reader->ReadRecord(&chunk_offset, &chunk_record));
-      if (!chunk_status.ok()) break;
-      if (!chunk_data.ParseFromArray(chunk_record.data(),
-                                     chunk_record.size())) {
-        return absl::DataLossError(
-            absl::StrCat("Could not parse TFRecord as ChunkData: '",
-                         absl::string_view(chunk_record), "'"));
-      }
-      if (chunk_data.deprecated_data_size()) {
-        if (!chunk_data.data().tensors().empty()) {
-          return absl::InternalError(
-              absl::StrCat("Checkpoint ChunkData at offset: ", chunk_offset,
-              " has both data and deprecated_data."));
-        }
-        chunk_data.mutable_data()->mutable_tensors()->Swap(
-            chunk_data.mutable_deprecated_data());
+    absl::MutexLock lock(&mu_);
+    std::vector<std::string> loaded_dirs = {std::string(path)};
+    for (const auto& generation : referenced_generations) {
+      loaded_dirs.push_back(tensorflow::io::JoinPath(
+          tensorflow::io::Dirname(std::string(path)), generation));
+    }
+    for (const auto& dir : loaded_dirs) {
+      if (HasLazyChunks(dir)) {
+        lazy_loaded_generations_.insert(
+            std::string(tensorflow::io::Basename(dir)));
       }
-      chunk_by_key[chunk_data.chunk_key()] = chunk_store->Insert(chunk_data);
-    } while (chunk_status.ok());
-    if (!absl::IsOutOfRange(chunk_status)) {
-      return chunk_status;
     }
   }
 
@@ -304,8 +651,8 @@ absl::Status TFRecordCheckpointer::Load(
           absl::StrJoin(table_names, ", "), "]"));
     }
 
-    auto sampler = MakeDistribution(checkpoint.sampler());
-    auto remover = MakeDistribution(checkpoint.remover());
+    auto sampler = MakeSelectorFromOptions(checkpoint.sampler());
+    auto remover = MakeSelectorFromOptions(checkpoint.remover());
     auto rate_limiter =
         std::make_shared<RateLimiter>(checkpoint.rate_limiter());
     auto extensions = tables->at(index)->UnsafeClearExtensions();
@@ -328,6 +675,8 @@ absl::Status TFRecordCheckpointer::Load(
     table->set_num_unique_samples_from_checkpoint(
         checkpoint.num_unique_samples());
 
+    std::vector<Table::Item> insert_items;
+    insert_items.reserve(checkpoint.items_size());
     for (const auto& checkpoint_item : checkpoint.items()) {
       Table::Item insert_item;
       insert_item.item = checkpoint_item;
@@ -365,12 +714,15 @@ absl::Status TFRecordCheckpointer::Load(
         insert_item.chunks.push_back(chunk_by_key[key]);
       }
 
-      // The original table has already been destroyed so if this fails then
-      // there is way to recover.
-      REVERB_RETURN_IF_ERROR(
-          table->InsertCheckpointItem(std::move(insert_item)));
+      insert_items.push_back(std::move(insert_item));
     }
 
+    // Insert the whole batch at once so the selectors can build their
+    // internal structures bottom-up. The original table has already been
+    // destroyed so if this fails then there is no way to recover.
+    REVERB_RETURN_IF_ERROR(
+        table->BulkInsertCheckpointItems(std::move(insert_items)));
+
     tables->at(index).swap(table);
   } while (table_status.ok());
 
@@ -380,6 +732,169 @@ absl::Status TFRecordCheckpointer::Load(
   return absl::OkStatus();
 }
 
+absl::Status TFRecordCheckpointer::ImportTable(absl::string_view path,
+                                               const std::string& table_name,
+                                               ChunkStore* chunk_store,
+                                               Table* table,
+                                               int64_t* num_items) {
+  REVERB_LOG(REVERB_INFO) << "Importing table " << table_name
+                          << " from checkpoint " << std::string(path);
+  *num_items = 0;
+  if (!HasDone(std::string(path))) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "ImportTable called with invalid checkpoint path: ",
+        std::string(path)));
+  }
+
+  // The chunks are staged in a private store so that colliding keys can be
+  // resolved before anything is registered in `chunk_store`. The checkpoint
+  // may reference chunks persisted by prior generations through its manifest.
+  ChunkStore staging;
+  internal::flat_hash_map<ChunkStore::Key, std::shared_ptr<ChunkStore::Chunk>>
+      chunk_by_key;
+  std::vector<std::string> referenced_generations;
+  REVERB_RETURN_IF_ERROR(
+      ReadManifest(std::string(path), &referenced_generations));
+  for (const auto& generation : referenced_generations) {
+    REVERB_RETURN_IF_ERROR(LoadChunks(
+        tensorflow::io::JoinPath(
+            tensorflow::io::Dirname(std::string(path)), generation),
+        &staging, &chunk_by_key));
+  }
+  REVERB_RETURN_IF_ERROR(LoadChunks(std::string(path), &staging, &chunk_by_key));
+
+  RecordReaderUniquePtr table_reader;
+  REVERB_RETURN_IF_ERROR(
+      OpenReader(tensorflow::io::JoinPath(std::string(path), kTablesFileName),
+                 &table_reader));
+
+  PriorityTableCheckpoint checkpoint;
+  absl::Status table_status;
+  tensorflow::uint64 table_offset = 0;
+  tensorflow::tstring table_record;
+  bool found = false;
+  do {
+    table_status = FromTensorflowStatus(
+        table_reader->ReadRecord(&table_offset, &table_record));
+    if (!table_status.ok()) break;
+    if (!checkpoint.ParseFromArray(table_record.data(), table_record.size())) {
+      return absl::DataLossError(
+          absl::StrCat("Could not parse TFRecord as Checkpoint: '",
+                       absl::string_view(table_record), "'"));
+    }
+    if (checkpoint.table_name() != table_name) continue;
+    found = true;
+
+    // Chunk keys of the checkpoint mapped to the chunk to use in the
+    // destination. Keys that collide with a different live chunk in
+    // `chunk_store` are remapped to a fresh key.
+    internal::flat_hash_map<ChunkStore::Key,
+                            std::shared_ptr<ChunkStore::Chunk>>
+        resolved;
+    absl::BitGen gen;
+    auto resolve_chunk =
+        [&](ChunkStore::Key key,
+            std::shared_ptr<ChunkStore::Chunk>* chunk) -> absl::Status {
+      auto it = resolved.find(key);
+      if (it != resolved.end()) {
+        *chunk = it->second;
+        return absl::OkStatus();
+      }
+      auto staged_it = chunk_by_key.find(key);
+      if (staged_it == chunk_by_key.end()) {
+        return absl::DataLossError(absl::StrCat(
+            "TFRecordCheckpointer::ImportTable: checkpoint does not contain "
+            "chunk with key: ",
+            key));
+      }
+      ChunkData data = staged_it->second->data();
+      std::vector<std::shared_ptr<ChunkStore::Chunk>> existing;
+      if (chunk_store->Get({key}, &existing).ok()) {
+        if (existing[0]->data().SerializeAsString() ==
+            data.SerializeAsString()) {
+          // The destination already holds this exact chunk; share it.
+          *chunk = std::move(existing[0]);
+          resolved[key] = *chunk;
+          return absl::OkStatus();
+        }
+        // A different live chunk occupies the key; remap to a fresh one.
+        ChunkStore::Key fresh;
+        std::vector<std::shared_ptr<ChunkStore::Chunk>> occupied;
+        do {
+          fresh = absl::Uniform<uint64_t>(gen);
+        } while (chunk_store->Get({fresh}, &occupied).ok());
+        data.set_chunk_key(fresh);
+      }
+      *chunk = chunk_store->Insert(std::move(data));
+      resolved[key] = *chunk;
+      return absl::OkStatus();
+    };
+
+    for (const auto& checkpoint_item : checkpoint.items()) {
+      Table::Item insert_item;
+      insert_item.item = checkpoint_item;
+
+      if (insert_item.item.has_deprecated_sequence_range() &&
+          insert_item.item.has_flat_trajectory()) {
+        return absl::InternalError(
+            absl::StrCat("Item ", insert_item.item.key(),
+                         " has both deprecated and new trajectory format: ",
+                         insert_item.item.DebugString(), "."));
+      }
+
+      if (insert_item.item.has_deprecated_sequence_range()) {
+        std::vector<std::shared_ptr<ChunkStore::Chunk>> trajectory_chunks;
+        REVERB_RETURN_IF_ERROR(FromTensorflowStatus(staging.Get(
+            insert_item.item.deprecated_chunk_keys(), &trajectory_chunks)));
+
+        *insert_item.item.mutable_flat_trajectory() =
+            internal::FlatTimestepTrajectory(
+                trajectory_chunks,
+                insert_item.item.deprecated_sequence_range().offset(),
+                insert_item.item.deprecated_sequence_range().length());
+
+        insert_item.item.clear_deprecated_sequence_range();
+        insert_item.item.clear_deprecated_chunk_keys();
+      }
+
+      // Rewrite the trajectory with the resolved keys and attach each
+      // referenced chunk once, in slice order.
+      internal::flat_hash_set<ChunkStore::Key> attached;
+      for (auto& column :
+           *insert_item.item.mutable_flat_trajectory()->mutable_columns()) {
+        for (auto& slice : *column.mutable_chunk_slices()) {
+          std::shared_ptr<ChunkStore::Chunk> chunk;
+          REVERB_RETURN_IF_ERROR(resolve_chunk(slice.chunk_key(), &chunk));
+          slice.set_chunk_key(chunk->key());
+          if (attached.insert(chunk->key()).second) {
+            insert_item.chunks.push_back(std::move(chunk));
+          }
+        }
+      }
+
+      // Remap item keys that are already taken in the destination table.
+      Table::Item occupied_item;
+      while (table->Get(insert_item.item.key(), &occupied_item)) {
+        insert_item.item.set_key(absl::Uniform<uint64_t>(gen));
+      }
+
+      REVERB_RETURN_IF_ERROR(table->InsertOrAssign(std::move(insert_item)));
+      ++(*num_items);
+    }
+    break;
+  } while (table_status.ok());
+
+  if (!table_status.ok() && !absl::IsOutOfRange(table_status)) {
+    return table_status;
+  }
+  if (!found) {
+    return absl::NotFoundError(
+        absl::StrCat("ImportTable: checkpoint at ", std::string(path),
+                     " does not contain table ", table_name));
+  }
+  return absl::OkStatus();
+}
+
 absl::Status TFRecordCheckpointer::LoadLatest(
     std::vector<std::shared_ptr<Table>>* tables) {
   ChunkStore chunk_store;
@@ -415,7 +930,10 @@ absl::Status TFRecordCheckpointer::LoadFallbackCheckpoint(
 
 std::string TFRecordCheckpointer::DebugString() const {
   return absl::StrCat("TFRecordCheckpointer(root_dir=", root_dir_,
-                      ", group=", group_, ")");
+                      ", group=", group_,
+                      ", incremental=", incremental_ ? "true" : "false",
+                      ", num_chunk_shards=", num_chunk_shards_,
+                      ", lazy_chunks=", lazy_chunks_ ? "true" : "false", ")");
 }
 
 }  // namespace reverb
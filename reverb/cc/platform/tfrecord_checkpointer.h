@@ -19,11 +19,16 @@
 #include <string>
 #include <vector>
 
+#include <cstdint>
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "reverb/cc/checkpointing/interface.h"
 #include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/hash_set.h"
 #include "reverb/cc/table.h"
 
 namespace deepmind {
@@ -58,6 +63,37 @@ namespace reverb {
 // The most recent checkpoint can therefore be inferred from the name of the
 // directories within `root_dir`.
 //
+// When constructed with `incremental` set, `Save` only writes chunks that
+// have not been persisted by an earlier checkpoint of this process. The
+// directory then also contains a MANIFEST file listing the prior generations
+// (directory basenames, one per line) whose chunk files the checkpoint still
+// references; `Load` reads the chunks of every listed generation before the
+// checkpoint's own. The manifest is flat - it names every generation holding
+// referenced chunks, so loading never has to chase manifests recursively.
+// Once the manifest would grow beyond a small limit the next save rewrites
+// all chunks, compacting the chain and letting stale generations be deleted.
+// Referenced generations are excluded from the `keep_latest` cleanup for as
+// long as a retained checkpoint lists them.
+//
+// When `lazy_chunks` is set the chunk files are written in a lazily loadable
+// layout: a record file of `LazyChunkRecord` protos holding only the chunk
+// metadata, next to a payloads file in which each serialized payload is
+// stored page-aligned. `Load` then only parses the metadata and registers
+// chunks whose payloads are faulted in on demand from the payloads file (see
+// `ChunkStore::InsertLazy`), so restore time is bound by the metadata size
+// rather than the payload size. Generations that back the lazily loaded
+// chunks of this process are excluded from the `keep_latest` cleanup for the
+// lifetime of the checkpointer. `Load` detects the layout from the files
+// present, so both layouts can be read regardless of configuration.
+//
+// When `num_chunk_shards` is larger than one the chunk data is partitioned by
+// chunk key across `chunks.tfrecord-<shard>-of-<num_shards>` files which are
+// written and read back by one thread per shard. Sharding raises the
+// throughput on storage that a single record stream cannot saturate. `Load`
+// detects the layout from the files present, so sharded and unsharded
+// checkpoints can be read regardless of how the loading checkpointer was
+// configured.
+//
 // If `group` is nonempty then the directory containing the checkpoint will be
 // created with `group` as group.
 //
@@ -69,7 +105,9 @@ class TFRecordCheckpointer : public Checkpointer {
  public:
   explicit TFRecordCheckpointer(
       std::string root_dir, std::string group = "",
-      absl::optional<std::string> fallback_checkpoint_path = absl::nullopt);
+      absl::optional<std::string> fallback_checkpoint_path = absl::nullopt,
+      bool incremental = false, int num_chunk_shards = 1,
+      bool lazy_chunks = false);
 
   // Save a new checkpoint for every table in `tables` in sub directory
   // inside `root_dir_`. If the call is successful, the ABSOLUTE path to the
@@ -96,6 +134,19 @@ class TFRecordCheckpointer : public Checkpointer {
   // Finds the most recent checkpoint within `root_dir_` and calls `Load`.
   absl::Status LoadLatest(std::vector<std::shared_ptr<Table>>* tables) override;
 
+  // Imports the named table from the checkpoint at `path` into the existing
+  // `table`. The checkpoint does not have to come from `root_dir_`, so this
+  // can be used to warm start a single table (e.g. expert demonstrations)
+  // from a checkpoint written by a different server with different companion
+  // tables. Chunk keys that collide with different live chunks in
+  // `chunk_store` and item keys already present in `table` are remapped to
+  // fresh keys; items are inserted through `Table::InsertOrAssign` so the
+  // destination table's capacity and rate limiter apply.
+  absl::Status ImportTable(absl::string_view path,
+                           const std::string& table_name,
+                           ChunkStore* chunk_store, Table* table,
+                           int64_t* num_items) override;
+
   // Attempts to load the fallback checkpoint. If no fallback_checkpoint_path
   // was set or if the no checkpoint found then `NotFoundError` is returned.
   absl::Status LoadFallbackCheckpoint(
@@ -112,6 +163,33 @@ class TFRecordCheckpointer : public Checkpointer {
   const std::string root_dir_;
   const std::string group_;
   absl::optional<std::string> fallback_checkpoint_path_;
+
+  // Whether `Save` may reference chunks persisted by earlier checkpoints
+  // instead of rewriting them.
+  const bool incremental_;
+
+  // Number of chunk record files written per checkpoint. Shards are written
+  // in parallel by one thread each.
+  const int num_chunk_shards_;
+
+  // Whether `Save` writes chunks in the lazily loadable layout (metadata
+  // records plus a page aligned payloads file).
+  const bool lazy_chunks_;
+
+  // Basenames of the generations whose payload files back lazily loaded
+  // chunks of this process. Retained by the `keep_latest` cleanup since live
+  // chunks fault their payloads in from these files.
+  internal::flat_hash_set<std::string> lazy_loaded_generations_
+      ABSL_GUARDED_BY(mu_);
+
+  // Serializes saves and protects the incremental bookkeeping.
+  absl::Mutex mu_;
+
+  // Basename of the checkpoint generation that persisted each live chunk.
+  // Rebuilt on every save to hold exactly the chunks of the newest
+  // checkpoint. Always empty when `incremental_` is false.
+  internal::flat_hash_map<uint64_t, std::string> persisted_chunk_generation_
+      ABSL_GUARDED_BY(mu_);
 };
 
 }  // namespace reverb
@@ -165,6 +165,233 @@ TEST(TFRecordCheckpointerTest, SaveAndLoad) {
   }
 }
 
+TEST(TFRecordCheckpointerTest, IncrementalSaveAndLoad) {
+  ChunkStore chunk_store;
+
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+
+  std::vector<ChunkStore::Key> chunk_keys;
+  auto insert_items = [&](int start, int end) {
+    for (int i = start; i < end; i++) {
+      chunk_keys.push_back(1000 + i);
+      auto chunk =
+          chunk_store.Insert(testing::MakeChunkData(chunk_keys.back()));
+      REVERB_EXPECT_OK(tables[0]->InsertOrAssign(
+          {testing::MakePrioritizedItem(i, i, {chunk->data()}), {chunk}}));
+    }
+  };
+  insert_items(0, 10);
+
+  TFRecordCheckpointer checkpointer(MakeRoot(), "", absl::nullopt,
+                                    /*incremental=*/true);
+  std::string first_path;
+  REVERB_ASSERT_OK(checkpointer.Save({tables[0].get()}, 1, &first_path));
+
+  // Add more items and save again. The second checkpoint only contains the
+  // new chunks and references the first generation through its manifest.
+  insert_items(10, 20);
+  std::string second_path;
+  REVERB_ASSERT_OK(checkpointer.Save({tables[0].get()}, 1, &second_path));
+
+  auto* env = tensorflow::Env::Default();
+  REVERB_EXPECT_OK(FromTensorflowStatus(
+      env->FileExists(tensorflow::io::JoinPath(second_path, "MANIFEST"))));
+
+  // The first generation must be retained despite keep_latest = 1 as the
+  // second checkpoint still references its chunks.
+  REVERB_EXPECT_OK(FromTensorflowStatus(env->FileExists(first_path)));
+
+  ChunkStore loaded_chunk_store;
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  REVERB_ASSERT_OK(
+      checkpointer.Load(second_path, &loaded_chunk_store, &loaded_tables));
+
+  // All chunks, including the ones persisted by the first generation, must be
+  // available after loading the second checkpoint.
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  REVERB_EXPECT_OK(
+      FromTensorflowStatus(loaded_chunk_store.Get(chunk_keys, &chunks)));
+  EXPECT_EQ(loaded_tables[0]->size(), tables[0]->size());
+}
+
+TEST(TFRecordCheckpointerTest, ShardedSaveAndLoad) {
+  ChunkStore chunk_store;
+
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+
+  std::vector<ChunkStore::Key> chunk_keys;
+  for (int i = 0; i < 100; i++) {
+    chunk_keys.push_back(1000 + i);
+    auto chunk = chunk_store.Insert(testing::MakeChunkData(chunk_keys.back()));
+    REVERB_EXPECT_OK(tables[0]->InsertOrAssign(
+        {testing::MakePrioritizedItem(i, i, {chunk->data()}), {chunk}}));
+  }
+
+  TFRecordCheckpointer checkpointer(MakeRoot(), "", absl::nullopt,
+                                    /*incremental=*/false,
+                                    /*num_chunk_shards=*/4);
+  std::string path;
+  REVERB_ASSERT_OK(checkpointer.Save({tables[0].get()}, 1, &path));
+
+  // The chunks must be spread over one record file per shard.
+  std::vector<std::string> shard_paths;
+  REVERB_EXPECT_OK(FromTensorflowStatus(
+      tensorflow::Env::Default()->GetMatchingPaths(
+          tensorflow::io::JoinPath(path, "chunks.tfrecord*"), &shard_paths)));
+  EXPECT_EQ(shard_paths.size(), 4);
+
+  ChunkStore loaded_chunk_store;
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  REVERB_ASSERT_OK(
+      checkpointer.Load(path, &loaded_chunk_store, &loaded_tables));
+
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  REVERB_EXPECT_OK(
+      FromTensorflowStatus(loaded_chunk_store.Get(chunk_keys, &chunks)));
+  EXPECT_EQ(loaded_tables[0]->size(), tables[0]->size());
+}
+
+TEST(TFRecordCheckpointerTest, LazySaveAndLoad) {
+  ChunkStore chunk_store;
+
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+
+  std::vector<ChunkStore::Key> chunk_keys;
+  for (int i = 0; i < 50; i++) {
+    chunk_keys.push_back(1000 + i);
+    auto chunk = chunk_store.Insert(testing::MakeChunkData(chunk_keys.back()));
+    REVERB_EXPECT_OK(tables[0]->InsertOrAssign(
+        {testing::MakePrioritizedItem(i, i, {chunk->data()}), {chunk}}));
+  }
+
+  TFRecordCheckpointer checkpointer(MakeRoot(), "", absl::nullopt,
+                                    /*incremental=*/false,
+                                    /*num_chunk_shards=*/1,
+                                    /*lazy_chunks=*/true);
+  std::string path;
+  REVERB_ASSERT_OK(checkpointer.Save({tables[0].get()}, 1, &path));
+
+  // The lazy layout stores the metadata records and the payloads in separate
+  // files instead of a full chunk record file.
+  auto* env = tensorflow::Env::Default();
+  REVERB_EXPECT_OK(FromTensorflowStatus(env->FileExists(
+      tensorflow::io::JoinPath(path, "chunks.index.tfrecord"))));
+  REVERB_EXPECT_OK(FromTensorflowStatus(
+      env->FileExists(tensorflow::io::JoinPath(path, "chunks.payloads"))));
+  EXPECT_FALSE(
+      env->FileExists(tensorflow::io::JoinPath(path, "chunks.tfrecord")).ok());
+
+  ChunkStore loaded_chunk_store;
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  REVERB_ASSERT_OK(
+      checkpointer.Load(path, &loaded_chunk_store, &loaded_tables));
+  EXPECT_EQ(loaded_tables[0]->size(), tables[0]->size());
+
+  // Accessing the data of a loaded chunk faults the payload in from the
+  // payloads file; the result must match what was saved.
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> original_chunks;
+  REVERB_EXPECT_OK(
+      FromTensorflowStatus(loaded_chunk_store.Get(chunk_keys, &chunks)));
+  REVERB_EXPECT_OK(
+      FromTensorflowStatus(chunk_store.Get(chunk_keys, &original_chunks)));
+  for (int i = 0; i < chunks.size(); i++) {
+    EXPECT_THAT(chunks[i]->data(), EqualsProto(original_chunks[i]->data()));
+  }
+}
+
+TEST(TFRecordCheckpointerTest, ImportTableRestoresNamedSubset) {
+  ChunkStore chunk_store;
+
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  tables.push_back(MakePrioritizedTable("prioritized", 0.5));
+
+  for (int i = 0; i < 50; i++) {
+    for (int j = 0; j < tables.size(); j++) {
+      auto chunk =
+          chunk_store.Insert(testing::MakeChunkData((j + 1) * 1000 + i));
+      REVERB_EXPECT_OK(tables[j]->InsertOrAssign(
+          {testing::MakePrioritizedItem(i, i, {chunk->data()}), {chunk}}));
+    }
+  }
+
+  TFRecordCheckpointer checkpointer(MakeRoot());
+  std::string path;
+  REVERB_ASSERT_OK(
+      checkpointer.Save({tables[0].get(), tables[1].get()}, 1, &path));
+
+  // Import only the uniform table into a fresh server with a different
+  // companion table.
+  ChunkStore import_chunk_store;
+  auto destination = MakeUniformTable("uniform");
+  int64_t num_items = 0;
+  REVERB_ASSERT_OK(checkpointer.ImportTable(
+      path, "uniform", &import_chunk_store, destination.get(), &num_items));
+  EXPECT_EQ(num_items, tables[0]->size());
+  EXPECT_EQ(destination->size(), tables[0]->size());
+
+  // Importing a table that the checkpoint does not contain fails.
+  auto missing = MakeUniformTable("missing");
+  EXPECT_TRUE(absl::IsNotFound(checkpointer.ImportTable(
+      path, "missing", &import_chunk_store, missing.get(), &num_items)));
+}
+
+TEST(TFRecordCheckpointerTest, ImportTableRemapsCollidingKeys) {
+  ChunkStore chunk_store;
+
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  for (int i = 0; i < 10; i++) {
+    auto chunk = chunk_store.Insert(testing::MakeChunkData(1000 + i));
+    REVERB_EXPECT_OK(tables[0]->InsertOrAssign(
+        {testing::MakePrioritizedItem(i, i, {chunk->data()}), {chunk}}));
+  }
+
+  TFRecordCheckpointer checkpointer(MakeRoot());
+  std::string path;
+  REVERB_ASSERT_OK(checkpointer.Save({tables[0].get()}, 1, &path));
+
+  // The destination already holds an item with key 0 whose chunk occupies
+  // key 1000 with different content.
+  ChunkStore import_chunk_store;
+  auto destination = MakeUniformTable("uniform");
+  auto colliding_chunk = import_chunk_store.Insert(testing::MakeChunkData(
+      1000, testing::MakeSequenceRange(999, 5, 10)));
+  REVERB_EXPECT_OK(destination->InsertOrAssign(
+      {testing::MakePrioritizedItem(0, 123, {colliding_chunk->data()}),
+       {colliding_chunk}}));
+
+  int64_t num_items = 0;
+  REVERB_ASSERT_OK(checkpointer.ImportTable(
+      path, "uniform", &import_chunk_store, destination.get(), &num_items));
+  EXPECT_EQ(num_items, 10);
+  EXPECT_EQ(destination->size(), 11);
+
+  // The pre-existing item must be untouched and the imported item that
+  // collided with it must have been remapped to fresh item and chunk keys.
+  Table::Item existing;
+  ASSERT_TRUE(destination->Get(0, &existing));
+  EXPECT_EQ(existing.item.priority(), 123);
+  ASSERT_EQ(existing.chunks.size(), 1);
+  EXPECT_THAT(existing.chunks[0]->data(),
+              EqualsProto(colliding_chunk->data()));
+  for (const auto& item : destination->Copy()) {
+    if (item.item.key() == 0) continue;
+    for (const auto& chunk : item.chunks) {
+      if (chunk->key() == 1000) {
+        EXPECT_THAT(chunk->data(), EqualsProto(colliding_chunk->data()));
+      }
+    }
+  }
+}
+
 TEST(TFRecordCheckpointerTest, SaveDeletesOldData) {
   ChunkStore chunk_store;
 
@@ -20,6 +20,7 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "absl/strings/string_view.h"
 
@@ -27,6 +28,30 @@ namespace deepmind {
 namespace reverb {
 namespace internal {
 
+// Scheduling attributes applied to a thread right after it starts. Fields
+// that keep their default are not touched, so a default constructed instance
+// inherits everything from the parent thread. Attributes that cannot be
+// applied (unsupported platform, insufficient privileges) are logged as
+// warnings and skipped; the thread still runs.
+struct ThreadOptions {
+  // CPUs the thread may be scheduled on. Empty inherits the parent's mask.
+  // Pinning e.g. sampler threads and insert threads to disjoint sets keeps
+  // them from evicting each other's caches without external cgroup setups.
+  std::vector<int> cpu_affinity;
+
+  // Nice value in [-20, 19]; lower runs at higher priority. 0 leaves the
+  // default. Negative values require CAP_SYS_NICE.
+  int nice = 0;
+
+  // When true the thread runs under the round-robin real-time class at
+  // `realtime_priority` (1..99), ahead of every normal thread. Requires
+  // CAP_SYS_NICE (or an appropriate RLIMIT_RTPRIO). Reserve this for small
+  // latency critical pools; a spinning real-time thread can starve the rest
+  // of the process.
+  bool realtime = false;
+  int realtime_priority = 1;
+};
+
 // The `Thread` class can be subclassed to hold an object that invokes a
 // method in a separate thread. A `Thread` is considered to be active after
 // construction until the execution terminates. Calling the destructor of this
@@ -51,6 +76,12 @@ class Thread {
 std::unique_ptr<Thread> StartThread(absl::string_view name_prefix,
                                     std::function<void()> fn);
 
+// Same as above but additionally applies `options` to the new thread before
+// `fn` runs.
+std::unique_ptr<Thread> StartThread(absl::string_view name_prefix,
+                                    const ThreadOptions& options,
+                                    std::function<void()> fn);
+
 }  // namespace internal
 }  // namespace reverb
 }  // namespace deepmind
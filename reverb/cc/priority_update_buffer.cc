@@ -0,0 +1,184 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/priority_update_buffer.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "grpcpp/client_context.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/hash_set.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/reverb_service.pb.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/grpc_util.h"
+
+namespace deepmind {
+namespace reverb {
+
+absl::Status PriorityUpdateBuffer::Options::Validate() const {
+  if (flush_interval <= absl::ZeroDuration()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("flush_interval must be a positive duration but got ",
+                     absl::FormatDuration(flush_interval), "."));
+  }
+  if (max_ops_per_request < 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("max_ops_per_request must be a positive integer but got ",
+                     max_ops_per_request, "."));
+  }
+  return absl::OkStatus();
+}
+
+PriorityUpdateBuffer::PriorityUpdateBuffer(
+    std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub,
+    std::string table, const Options& options)
+    : stub_(std::move(stub)),
+      table_(std::move(table)),
+      options_(options),
+      periodic_flush_(
+          [this] {
+            absl::MutexLock lock(&rpc_mu_);
+            absl::Status status = SendBufferedOps(absl::InfiniteDuration());
+            if (!status.ok()) {
+              absl::MutexLock buffer_lock(&mu_);
+              background_flush_status_ = status;
+            }
+          },
+          options.flush_interval, "PriorityUpdateBuffer") {
+  REVERB_CHECK_OK(options_.Validate());
+  REVERB_CHECK_OK(periodic_flush_.Start());
+}
+
+PriorityUpdateBuffer::~PriorityUpdateBuffer() {
+  REVERB_CHECK_OK(periodic_flush_.Stop());
+
+  // Make a final attempt to deliver any remaining operations.
+  absl::MutexLock lock(&rpc_mu_);
+  absl::Status status = SendBufferedOps(absl::InfiniteDuration());
+  REVERB_LOG_IF(REVERB_ERROR, !status.ok())
+      << "Failed to flush remaining priority updates: " << status;
+}
+
+absl::Status PriorityUpdateBuffer::Enqueue(
+    absl::Span<const KeyWithPriority> updates,
+    absl::Span<const uint64_t> deletes) {
+  absl::MutexLock lock(&mu_);
+
+  for (const KeyWithPriority& update : updates) {
+    // The item is going away so there is no point in updating its priority.
+    if (deletes_.contains(update.key())) continue;
+    updates_[update.key()] = update.priority();
+  }
+  for (uint64_t key : deletes) {
+    updates_.erase(key);
+    deletes_.insert(key);
+  }
+
+  absl::Status status = background_flush_status_;
+  background_flush_status_ = absl::OkStatus();
+  return status;
+}
+
+absl::Status PriorityUpdateBuffer::Flush(absl::Duration timeout) {
+  absl::MutexLock lock(&rpc_mu_);
+  absl::Status status = SendBufferedOps(timeout);
+
+  absl::MutexLock buffer_lock(&mu_);
+  if (status.ok()) {
+    status = background_flush_status_;
+  }
+  background_flush_status_ = absl::OkStatus();
+  return status;
+}
+
+absl::Status PriorityUpdateBuffer::SendBufferedOps(absl::Duration timeout) {
+  internal::flat_hash_map<uint64_t, double> updates;
+  internal::flat_hash_set<uint64_t> deletes;
+  {
+    absl::MutexLock lock(&mu_);
+    updates.swap(updates_);
+    deletes.swap(deletes_);
+  }
+  if (updates.empty() && deletes.empty()) return absl::OkStatus();
+
+  const absl::Time deadline = absl::Now() + timeout;
+
+  // Shard the operations over requests of at most `max_ops_per_request`
+  // operations each.
+  std::vector<MutatePrioritiesRequest> requests;
+  requests.emplace_back();
+  requests.back().set_table(table_);
+  int ops_in_request = 0;
+  auto maybe_start_new_request = [&]() {
+    if (ops_in_request == options_.max_ops_per_request) {
+      requests.emplace_back();
+      requests.back().set_table(table_);
+      ops_in_request = 0;
+    }
+  };
+  for (const auto& [key, priority] : updates) {
+    maybe_start_new_request();
+    KeyWithPriority* update = requests.back().add_updates();
+    update->set_key(key);
+    update->set_priority(priority);
+    ++ops_in_request;
+  }
+  for (uint64_t key : deletes) {
+    maybe_start_new_request();
+    requests.back().add_delete_keys(key);
+    ++ops_in_request;
+  }
+
+  for (int i = 0; i < requests.size(); ++i) {
+    grpc::ClientContext context;
+    if (timeout != absl::InfiniteDuration()) {
+      context.set_deadline(absl::ToChronoTime(deadline));
+    }
+    MutatePrioritiesResponse response;
+    absl::Status status = FromGrpcStatus(
+        stub_->MutatePriorities(&context, requests[i], &response));
+    if (status.ok()) continue;
+
+    // Merge the operations of the failed request, and of all requests that
+    // have not been sent yet, back into the buffer so that they are retried
+    // by the next flush. Operations enqueued since the flush started are
+    // newer and take precedence.
+    absl::MutexLock lock(&mu_);
+    for (int j = i; j < requests.size(); ++j) {
+      for (const KeyWithPriority& update : requests[j].updates()) {
+        if (deletes_.contains(update.key())) continue;
+        updates_.insert({update.key(), update.priority()});
+      }
+      for (uint64_t key : requests[j].delete_keys()) {
+        deletes_.insert(key);
+      }
+    }
+    return status;
+  }
+
+  return absl::OkStatus();
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,146 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_PRIORITY_UPDATE_BUFFER_H_
+#define REVERB_CC_PRIORITY_UPDATE_BUFFER_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/hash_set.h"
+#include "reverb/cc/reverb_service.grpc.pb.h"
+#include "reverb/cc/reverb_service.pb.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/periodic_closure.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Client side buffer which coalesces priority updates before sending them to
+// the server.
+//
+// Learners typically call `Client::MutatePriorities` once per training batch
+// and many item keys repeat across adjacent batches. This buffer merges
+// updates of the same key (the most recently provided priority wins), lets a
+// delete cancel a pending update of the same key, and ships the accumulated
+// operations on a background thread once per `Options::flush_interval`. This
+// reduces the RPC count and lets the server apply larger, deduplicated
+// batches.
+//
+// Since updates are buffered, the priorities observed by the server lag the
+// ones provided by up to `Options::flush_interval` (plus the time of the RPC
+// itself). Call `Flush` to push all buffered operations immediately, e.g.
+// before a checkpoint.
+//
+// This class is thread-safe.
+class PriorityUpdateBuffer {
+ public:
+  struct Options {
+    // The time window over which operations are accumulated before the
+    // background thread sends them to the server.
+    absl::Duration flush_interval = absl::Milliseconds(50);
+
+    // Maximum number of operations (updates plus deletes) packed into a
+    // single `MutatePriorities` call. If the buffer holds more operations
+    // than this when it is flushed then the flush is sharded over multiple
+    // calls.
+    int max_ops_per_request = 10000;
+
+    // Checks that the values are valid and returns `InvalidArgumentError` if
+    // any of them is not.
+    absl::Status Validate() const;
+  };
+
+  PriorityUpdateBuffer(
+      std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub,
+      std::string table, const Options& options);
+
+  // Stops the background thread and makes a final attempt to flush any
+  // remaining operations. Failures to do so are logged but otherwise ignored;
+  // call `Flush` before destroying the buffer if delivery must be confirmed.
+  ~PriorityUpdateBuffer();
+
+  // Merges `updates` and `deletes` into the buffer. Within the buffer the
+  // most recent priority provided for a key wins, a delete cancels a pending
+  // update of the same key and updates of keys with a pending delete are
+  // dropped.
+  //
+  // Returns the status of the most recent failed background flush, if any
+  // failure occurred since the last call to `Enqueue` or `Flush`. The
+  // operations are buffered even when an error is returned; failed flushes
+  // put their operations back into the buffer so they are retried by
+  // subsequent flushes.
+  absl::Status Enqueue(absl::Span<const KeyWithPriority> updates,
+                       absl::Span<const uint64_t> deletes);
+
+  // Sends all buffered operations without waiting for the background thread
+  // and blocks until the server has responded. If `timeout` is exceeded then
+  // `DeadlineExceededError` is returned and the unsent operations remain in
+  // the buffer.
+  absl::Status Flush(absl::Duration timeout = absl::InfiniteDuration());
+
+ private:
+  // Sends all currently buffered operations, sharding over multiple requests
+  // if their number exceeds `Options::max_ops_per_request`. If a request
+  // fails then its operations, and any not yet sent, are merged back into the
+  // buffer (without overriding operations enqueued in the meantime) and the
+  // error is returned. Called by the background thread and by `Flush`;
+  // `rpc_mu_` serializes the calls so that updates are applied by the server
+  // in the order they were buffered.
+  absl::Status SendBufferedOps(absl::Duration timeout)
+      ABSL_LOCKS_EXCLUDED(mu_) ABSL_EXCLUSIVE_LOCKS_REQUIRED(rpc_mu_);
+
+  // Stub used to send `MutatePriorities` calls.
+  const std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub_;
+
+  // Name of the table which the operations apply to.
+  const std::string table_;
+
+  // Configuration options.
+  const Options options_;
+
+  absl::Mutex mu_;
+
+  // Pending priority updates keyed by item key. Enqueueing an update of a key
+  // that is already present simply overwrites the priority.
+  internal::flat_hash_map<uint64_t, double> updates_ ABSL_GUARDED_BY(mu_);
+
+  // Pending deletes.
+  internal::flat_hash_set<uint64_t> deletes_ ABSL_GUARDED_BY(mu_);
+
+  // Status of the most recent failed background flush. Reset once reported
+  // through `Enqueue` or `Flush`.
+  absl::Status background_flush_status_ ABSL_GUARDED_BY(mu_);
+
+  // Serializes `SendBufferedOps` calls made by the background thread and by
+  // `Flush`.
+  absl::Mutex rpc_mu_ ABSL_ACQUIRED_BEFORE(mu_);
+
+  // Background thread that periodically flushes the buffer. Started by the
+  // constructor and stopped by the destructor.
+  internal::PeriodicClosure periodic_flush_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_PRIORITY_UPDATE_BUFFER_H_
@@ -0,0 +1,219 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/priority_update_buffer.h"
+
+#include <memory>
+#include <vector>
+
+#include "grpcpp/impl/codegen/status.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/reverb_service.pb.h"
+#include "reverb/cc/reverb_service_mock.grpc.pb.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Pair;
+using ::testing::Return;
+using ::testing::SizeIs;
+using ::testing::UnorderedElementsAre;
+
+KeyWithPriority MakeUpdate(uint64_t key, double priority) {
+  KeyWithPriority update;
+  update.set_key(key);
+  update.set_priority(priority);
+  return update;
+}
+
+// Captures all `MutatePriorities` requests sent through the stub. The buffer
+// sends from a background thread so access is synchronized.
+class RequestRecorder {
+ public:
+  grpc::Status Record(const MutatePrioritiesRequest& request) {
+    absl::MutexLock lock(&mu_);
+    requests_.push_back(request);
+    return grpc::Status::OK;
+  }
+
+  std::vector<MutatePrioritiesRequest> requests() const {
+    absl::MutexLock lock(&mu_);
+    return requests_;
+  }
+
+ private:
+  mutable absl::Mutex mu_;
+  std::vector<MutatePrioritiesRequest> requests_ ABSL_GUARDED_BY(mu_);
+};
+
+std::vector<std::pair<uint64_t, double>> GetUpdates(
+    const MutatePrioritiesRequest& request) {
+  std::vector<std::pair<uint64_t, double>> updates;
+  for (const KeyWithPriority& update : request.updates()) {
+    updates.push_back({update.key(), update.priority()});
+  }
+  return updates;
+}
+
+inline PriorityUpdateBuffer::Options MakeOptions(
+    absl::Duration flush_interval = absl::Hours(1),
+    int max_ops_per_request = 10000) {
+  return PriorityUpdateBuffer::Options{
+      .flush_interval = flush_interval,
+      .max_ops_per_request = max_ops_per_request,
+  };
+}
+
+TEST(PriorityUpdateBuffer, CoalescesRepeatedKeys) {
+  RequestRecorder recorder;
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, MutatePriorities(_, _, _))
+      .WillRepeatedly(Invoke([&](grpc::ClientContext*,
+                                 const MutatePrioritiesRequest& request,
+                                 MutatePrioritiesResponse*) {
+        return recorder.Record(request);
+      }));
+
+  PriorityUpdateBuffer buffer(stub, "table", MakeOptions());
+
+  REVERB_EXPECT_OK(
+      buffer.Enqueue({MakeUpdate(1, 1.0), MakeUpdate(2, 2.0)}, {}));
+  REVERB_EXPECT_OK(buffer.Enqueue({MakeUpdate(1, 3.0)}, {}));
+  REVERB_EXPECT_OK(buffer.Flush());
+
+  ASSERT_THAT(recorder.requests(), SizeIs(1));
+  EXPECT_EQ(recorder.requests()[0].table(), "table");
+  EXPECT_THAT(GetUpdates(recorder.requests()[0]),
+              UnorderedElementsAre(Pair(1, 3.0), Pair(2, 2.0)));
+}
+
+TEST(PriorityUpdateBuffer, DeleteCancelsPendingUpdate) {
+  RequestRecorder recorder;
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, MutatePriorities(_, _, _))
+      .WillRepeatedly(Invoke([&](grpc::ClientContext*,
+                                 const MutatePrioritiesRequest& request,
+                                 MutatePrioritiesResponse*) {
+        return recorder.Record(request);
+      }));
+
+  PriorityUpdateBuffer buffer(stub, "table", MakeOptions());
+
+  REVERB_EXPECT_OK(buffer.Enqueue({MakeUpdate(1, 1.0)}, {}));
+  REVERB_EXPECT_OK(buffer.Enqueue({}, {1, 2}));
+
+  // Updates of keys with a pending delete are dropped.
+  REVERB_EXPECT_OK(buffer.Enqueue({MakeUpdate(2, 2.0)}, {}));
+  REVERB_EXPECT_OK(buffer.Flush());
+
+  ASSERT_THAT(recorder.requests(), SizeIs(1));
+  EXPECT_EQ(recorder.requests()[0].updates_size(), 0);
+  EXPECT_THAT(recorder.requests()[0].delete_keys(),
+              UnorderedElementsAre(1, 2));
+}
+
+TEST(PriorityUpdateBuffer, ShardsLargeFlushes) {
+  RequestRecorder recorder;
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, MutatePriorities(_, _, _))
+      .WillRepeatedly(Invoke([&](grpc::ClientContext*,
+                                 const MutatePrioritiesRequest& request,
+                                 MutatePrioritiesResponse*) {
+        return recorder.Record(request);
+      }));
+
+  PriorityUpdateBuffer buffer(
+      stub, "table", MakeOptions(absl::Hours(1), /*max_ops_per_request=*/2));
+
+  REVERB_EXPECT_OK(buffer.Enqueue(
+      {MakeUpdate(1, 1.0), MakeUpdate(2, 2.0), MakeUpdate(3, 3.0)}, {}));
+  REVERB_EXPECT_OK(buffer.Flush());
+
+  ASSERT_THAT(recorder.requests(), SizeIs(2));
+  EXPECT_EQ(recorder.requests()[0].table(), "table");
+  EXPECT_EQ(recorder.requests()[1].table(), "table");
+  EXPECT_EQ(recorder.requests()[0].updates_size() +
+                recorder.requests()[1].updates_size(),
+            3);
+}
+
+TEST(PriorityUpdateBuffer, BackgroundThreadFlushesPeriodically) {
+  absl::Notification sent;
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, MutatePriorities(_, _, _))
+      .WillRepeatedly(Invoke([&](grpc::ClientContext*,
+                                 const MutatePrioritiesRequest& request,
+                                 MutatePrioritiesResponse*) {
+        if (!sent.HasBeenNotified()) sent.Notify();
+        return grpc::Status::OK;
+      }));
+
+  PriorityUpdateBuffer buffer(
+      stub, "table", MakeOptions(/*flush_interval=*/absl::Milliseconds(1)));
+
+  REVERB_EXPECT_OK(buffer.Enqueue({MakeUpdate(1, 1.0)}, {}));
+
+  // The update reaches the server without `Flush` being called.
+  sent.WaitForNotification();
+}
+
+TEST(PriorityUpdateBuffer, FailedFlushRetainsOps) {
+  RequestRecorder recorder;
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, MutatePriorities(_, _, _))
+      .WillOnce(Return(grpc::Status(grpc::StatusCode::UNAVAILABLE, "")))
+      .WillRepeatedly(Invoke([&](grpc::ClientContext*,
+                                 const MutatePrioritiesRequest& request,
+                                 MutatePrioritiesResponse*) {
+        return recorder.Record(request);
+      }));
+
+  PriorityUpdateBuffer buffer(stub, "table", MakeOptions());
+
+  REVERB_EXPECT_OK(buffer.Enqueue({MakeUpdate(1, 1.0)}, {}));
+  EXPECT_EQ(buffer.Flush().code(), absl::StatusCode::kUnavailable);
+
+  // The failed operations were put back and are delivered by the next flush.
+  REVERB_EXPECT_OK(buffer.Flush());
+  ASSERT_THAT(recorder.requests(), SizeIs(1));
+  EXPECT_THAT(GetUpdates(recorder.requests()[0]),
+              UnorderedElementsAre(Pair(1, 1.0)));
+}
+
+TEST(PriorityUpdateBufferOptions, ValidateRejectsInvalidValues) {
+  PriorityUpdateBuffer::Options options;
+  REVERB_EXPECT_OK(options.Validate());
+
+  options.flush_interval = absl::ZeroDuration();
+  EXPECT_EQ(options.Validate().code(), absl::StatusCode::kInvalidArgument);
+  options.flush_interval = absl::Milliseconds(50);
+
+  options.max_ops_per_request = 0;
+  EXPECT_EQ(options.Validate().code(), absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -15,6 +15,7 @@
 #include "reverb/cc/rate_limiter.h"
 
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 
@@ -48,15 +49,23 @@ inline void EncodeAsDurationProto(const absl::Duration& d,
 }  // namespace
 
 RateLimiter::RateLimiter(double samples_per_insert, int64_t min_size_to_sample,
-                         double min_diff, double max_diff)
+                         double min_diff, double max_diff,
+                         double burst_capacity)
     : samples_per_insert_(samples_per_insert),
       min_diff_(min_diff),
       max_diff_(max_diff),
       min_size_to_sample_(min_size_to_sample),
+      burst_capacity_(burst_capacity),
+      bucket_micros_(0),
       inserts_(0),
       samples_(0),
-      deletes_(0) {
+      deletes_(0),
+      wait_count_(0) {
   REVERB_CHECK_GT(min_size_to_sample, 0);
+  REVERB_CHECK_GE(burst_capacity, 0);
+  for (auto& bucket : wait_histogram_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
 }
 
 RateLimiter::RateLimiter(const RateLimiterCheckpoint& checkpoint)
@@ -64,10 +73,13 @@ RateLimiter::RateLimiter(const RateLimiterCheckpoint& checkpoint)
                   /*min_size_to_sample=*/
                   checkpoint.min_size_to_sample(),
                   /*min_diff=*/checkpoint.min_diff(),
-                  /*max_diff=*/checkpoint.max_diff()) {
+                  /*max_diff=*/checkpoint.max_diff(),
+                  /*burst_capacity=*/checkpoint.burst_capacity()) {
   inserts_ = checkpoint.insert_count();
   samples_ = checkpoint.sample_count();
   deletes_ = checkpoint.delete_count();
+  bucket_micros_ = static_cast<int64_t>(checkpoint.bucket_tokens() *
+                                        static_cast<double>(kTokenMicros));
 }
 
 absl::Status RateLimiter::RegisterTable(Table* table) {
@@ -91,44 +103,178 @@ void RateLimiter::UnregisterTable(absl::Mutex* mu, Table* table) {
 }
 
 void RateLimiter::Insert(absl::Mutex* mu) {
-  inserts_++;
+  inserts_.fetch_add(1, std::memory_order_relaxed);
+  if (BucketMode()) {
+    const int64_t deposit = static_cast<int64_t>(
+        samples_per_insert_ * static_cast<double>(kTokenMicros));
+    const int64_t cap = static_cast<int64_t>(
+        burst_capacity_ * static_cast<double>(kTokenMicros));
+    int64_t current = bucket_micros_.load(std::memory_order_relaxed);
+    while (!bucket_micros_.compare_exchange_weak(
+        current, std::min(current + deposit, cap), std::memory_order_relaxed)) {
+    }
+  }
 }
 
 void RateLimiter::Delete(absl::Mutex* mu) {
-  deletes_++;
+  deletes_.fetch_add(1, std::memory_order_relaxed);
 }
 
 void RateLimiter::Reset(absl::Mutex* mu) {
-  inserts_ = 0;
-  samples_ = 0;
-  deletes_ = 0;
+  inserts_.store(0, std::memory_order_relaxed);
+  samples_.store(0, std::memory_order_relaxed);
+  deletes_.store(0, std::memory_order_relaxed);
+  bucket_micros_.store(0, std::memory_order_relaxed);
 }
 
 bool RateLimiter::CanSample(absl::Mutex*, int num_samples) const {
+  return CanSampleWithoutLock(num_samples);
+}
+
+bool RateLimiter::CanSampleWithoutLock(int num_samples) const {
   REVERB_CHECK_GT(num_samples, 0);
-  if (inserts_ - deletes_ < min_size_to_sample_) {
+  const int64_t inserts = inserts_.load(std::memory_order_relaxed);
+  const int64_t deletes = deletes_.load(std::memory_order_relaxed);
+  const int64_t samples = samples_.load(std::memory_order_relaxed);
+  if (inserts - deletes < min_size_to_sample_) {
     return false;
   }
-  double diff = inserts_ * samples_per_insert_ - samples_ - num_samples;
+  if (BucketMode()) {
+    return bucket_micros_.load(std::memory_order_relaxed) >=
+           num_samples * kTokenMicros;
+  }
+  double diff = inserts * samples_per_insert_ - samples - num_samples;
   return diff >= min_diff_;
 }
 
 bool RateLimiter::MaybeCommitSample(absl::Mutex* mu) {
-  if (!CanSample(mu, 1)) {
+  return MaybeCommitSamples(mu, 1) == 1;
+}
+
+int RateLimiter::MaybeCommitSamples(absl::Mutex* mu, int max_samples) {
+  if (max_samples <= 0) {
+    return 0;
+  }
+  const int64_t inserts = inserts_.load(std::memory_order_relaxed);
+  const int64_t deletes = deletes_.load(std::memory_order_relaxed);
+  const int64_t samples = samples_.load(std::memory_order_relaxed);
+  if (inserts - deletes < min_size_to_sample_) {
+    return 0;
+  }
+  if (BucketMode()) {
+    // Spend as many whole tokens as the bucket holds, up to `max_samples`.
+    // The CAS loop keeps the spend exact against concurrent deposits and
+    // lock-free commits.
+    int64_t current = bucket_micros_.load(std::memory_order_relaxed);
+    int granted;
+    do {
+      granted = static_cast<int>(
+          std::min<int64_t>(current / kTokenMicros, max_samples));
+      if (granted == 0) {
+        return 0;
+      }
+    } while (!bucket_micros_.compare_exchange_weak(
+        current, current - granted * kTokenMicros, std::memory_order_relaxed));
+    samples_.fetch_add(granted, std::memory_order_relaxed);
+    return granted;
+  }
+  // `CanSample(n)` holds iff `inserts * samples_per_insert_ - samples - n` is
+  // at least `min_diff_`; grant the largest such n up to `max_samples`.
+  const double headroom = inserts * samples_per_insert_ - samples - min_diff_;
+  if (headroom < 1) {
+    return 0;
+  }
+  const int granted = static_cast<int>(std::min<double>(headroom, max_samples));
+  samples_.fetch_add(granted, std::memory_order_relaxed);
+  return granted;
+}
+
+void RateLimiter::RollbackSamples(int num_samples) {
+  if (num_samples > 0) {
+    samples_.fetch_sub(num_samples, std::memory_order_relaxed);
+    if (BucketMode()) {
+      RefundTokens(num_samples * kTokenMicros);
+    }
+  }
+}
+
+void RateLimiter::RefundTokens(int64_t refund_micros) {
+  const int64_t cap = static_cast<int64_t>(
+      burst_capacity_ * static_cast<double>(kTokenMicros));
+  int64_t current = bucket_micros_.load(std::memory_order_relaxed);
+  while (!bucket_micros_.compare_exchange_weak(
+      current, std::min(current + refund_micros, cap),
+      std::memory_order_relaxed)) {
+  }
+}
+
+bool RateLimiter::MinSizeSatisfied() const {
+  return inserts_.load(std::memory_order_relaxed) -
+             deletes_.load(std::memory_order_relaxed) >=
+         min_size_to_sample_;
+}
+
+bool RateLimiter::TryCommitSampleFastPath() {
+  const int64_t inserts = inserts_.load(std::memory_order_relaxed);
+  const int64_t deletes = deletes_.load(std::memory_order_relaxed);
+  const int64_t samples = samples_.load(std::memory_order_relaxed);
+
+  // Only admit when the state is so far away from the boundaries that up to
+  // `kFastPathSlack` concurrent commits (or deletes) cannot push it past
+  // them. Calls near the boundary return false and take the exact, mutex
+  // protected path instead.
+  if (inserts - deletes < min_size_to_sample_ + kFastPathSlack) {
     return false;
   }
-  samples_++;
+  if (BucketMode()) {
+    // The bucket is spent with a CAS so no slack is needed on the fill
+    // itself; only the size check above relies on the slack.
+    int64_t current = bucket_micros_.load(std::memory_order_relaxed);
+    do {
+      if (current < kTokenMicros) {
+        return false;
+      }
+    } while (!bucket_micros_.compare_exchange_weak(
+        current, current - kTokenMicros, std::memory_order_relaxed));
+    samples_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  const double diff =
+      inserts * samples_per_insert_ - samples - 1 - kFastPathSlack;
+  if (diff < min_diff_) {
+    return false;
+  }
+  samples_.fetch_add(1, std::memory_order_relaxed);
   return true;
 }
 
+void RateLimiter::RollbackSample() {
+  samples_.fetch_sub(1, std::memory_order_relaxed);
+  if (BucketMode()) {
+    RefundTokens(kTokenMicros);
+  }
+}
+
 bool RateLimiter::CanInsert(absl::Mutex*, int num_inserts) const {
+  return CanInsertWithoutLock(num_inserts);
+}
+
+bool RateLimiter::CanInsertWithoutLock(int num_inserts) const {
   REVERB_CHECK_GT(num_inserts, 0);
+  // In bucket mode inserts never block; deposits beyond the burst capacity
+  // are simply forfeited.
+  if (BucketMode()) {
+    return true;
+  }
+  const int64_t inserts = inserts_.load(std::memory_order_relaxed);
+  const int64_t deletes = deletes_.load(std::memory_order_relaxed);
+  const int64_t samples = samples_.load(std::memory_order_relaxed);
   // Until the min size is reached inserts are free to progress.
-  if (inserts_ + num_inserts - deletes_ <= min_size_to_sample_) {
+  if (inserts + num_inserts - deletes <= min_size_to_sample_) {
     return true;
   }
 
-  double diff = (num_inserts + inserts_) * samples_per_insert_ - samples_;
+  double diff = (num_inserts + inserts) * samples_per_insert_ - samples;
   return diff <= max_diff_;
 }
 
@@ -141,14 +287,69 @@ RateLimiterCheckpoint RateLimiter::CheckpointReader(absl::Mutex*) const {
   checkpoint.set_sample_count(samples_);
   checkpoint.set_insert_count(inserts_);
   checkpoint.set_delete_count(deletes_);
+  checkpoint.set_burst_capacity(burst_capacity_);
+  checkpoint.set_bucket_tokens(
+      static_cast<double>(bucket_micros_.load(std::memory_order_relaxed)) /
+      static_cast<double>(kTokenMicros));
 
   return checkpoint;
 }
 
-RateLimiterInfo RateLimiter::Info(absl::Mutex* mu) const {
+void RateLimiter::RecordWait(absl::Duration wait) {
+  const int64_t micros = absl::ToInt64Microseconds(wait);
+  int bucket = 0;
+  for (int64_t remaining = micros; remaining > 1; remaining >>= 1) {
+    bucket++;
+  }
+  bucket = std::min(bucket, kWaitHistogramBuckets - 1);
+  wait_histogram_[bucket].fetch_add(1, std::memory_order_relaxed);
+  wait_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+absl::Duration RateLimiter::WaitTimePercentile(double quantile) const {
+  // The buckets are snapshotted up front so concurrent `RecordWait` calls
+  // during the scan cannot make the cumulative counts inconsistent.
+  int64_t counts[kWaitHistogramBuckets];
+  int64_t total = 0;
+  for (int i = 0; i < kWaitHistogramBuckets; i++) {
+    counts[i] = wait_histogram_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) return absl::ZeroDuration();
+  const int64_t rank = std::max<int64_t>(
+      1, static_cast<int64_t>(
+             std::ceil(quantile * static_cast<double>(total))));
+  int64_t seen = 0;
+  for (int i = 0; i < kWaitHistogramBuckets; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      // Upper boundary of the bucket: waits in bucket `i` are < 2^(i+1) us.
+      return absl::Microseconds(int64_t{1} << (i + 1));
+    }
+  }
+  return absl::Microseconds(int64_t{1} << kWaitHistogramBuckets);
+}
+
+absl::Duration RateLimiter::AdaptiveTimeout() const {
+  if (wait_count_.load(std::memory_order_relaxed) < kMinAdaptiveTimeoutWaits) {
+    return absl::InfiniteDuration();
+  }
+  return std::max(kAdaptiveTimeoutFloor,
+                  WaitTimePercentile(0.999) * kAdaptiveTimeoutMargin);
+}
+
+RateLimiterInfo RateLimiter::Info() const {
   RateLimiterInfo info_proto = InfoWithoutCallStats();
   info_proto.mutable_insert_stats()->set_completed(inserts_);
   info_proto.mutable_sample_stats()->set_completed(samples_);
+  info_proto.set_sample_wait_p50_ms(
+      absl::ToInt64Milliseconds(WaitTimePercentile(0.5)));
+  info_proto.set_sample_wait_p999_ms(
+      absl::ToInt64Milliseconds(WaitTimePercentile(0.999)));
+  const absl::Duration adaptive = AdaptiveTimeout();
+  info_proto.set_adaptive_timeout_ms(
+      adaptive == absl::InfiniteDuration() ? -1
+                                           : absl::ToInt64Milliseconds(adaptive));
   return info_proto;
 }
 
@@ -158,10 +359,16 @@ RateLimiterInfo RateLimiter::InfoWithoutCallStats() const {
   info_proto.set_min_diff(min_diff_);
   info_proto.set_max_diff(max_diff_);
   info_proto.set_min_size_to_sample(min_size_to_sample_);
+  info_proto.set_burst_capacity(burst_capacity_);
   return info_proto;
 }
 
 std::string RateLimiter::DebugString() const {
+  if (BucketMode()) {
+    return absl::StrCat("RateLimiter(samples_per_insert=", samples_per_insert_,
+                        ", burst_capacity=", burst_capacity_,
+                        ", min_size_to_sample=", min_size_to_sample_, ")");
+  }
   return absl::StrCat("RateLimiter(samples_per_insert=", samples_per_insert_,
                       ", min_diff_=", min_diff_, ", max_diff=", max_diff_,
                       ", min_size_to_sample=", min_size_to_sample_, ")");
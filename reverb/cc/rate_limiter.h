@@ -15,6 +15,7 @@
 #ifndef REVERB_CC_RATE_LIMITER_H_
 #define REVERB_CC_RATE_LIMITER_H_
 
+#include <atomic>
 #include <string>
 
 #include <cstdint>
@@ -34,6 +35,12 @@ class Table;
 
 constexpr absl::Duration kDefaultTimeout = absl::InfiniteDuration();
 
+// Sentinel timeout resolved by the table against the wait time distribution
+// observed by its rate limiter (see `RateLimiter::AdaptiveTimeout`). The
+// value matches the `-2` encoding of the `Timeout` proto so it survives the
+// millisecond round trip between client and server.
+constexpr absl::Duration kAdaptiveTimeout = -absl::Milliseconds(2);
+
 // Details about the waiting time for a call to the RateLimiter.
 struct RateLimiterEvent {
   // Unique identifier of the call. The ID is created by incrementing the most
@@ -47,10 +54,19 @@ struct RateLimiterEvent {
 // RateLimiter manages the data throughput for a `Table` by blocking
 // sample or insert calls if the ratio between the two deviates too much from
 // the ratio specified by `samples_per_insert`.
+//
+// When constructed with a positive `burst_capacity` the limiter instead runs
+// as a token bucket: each insert deposits `samples_per_insert` tokens, each
+// sample spends one, and the bucket holds at most `burst_capacity` tokens
+// (deposits beyond the cap are forfeited). Inserts are never blocked in this
+// mode; sampling is blocked only when the bucket is empty (or the table holds
+// fewer than `min_size_to_sample` items), so credit accumulated during a
+// sampling pause can be spent in a full speed burst afterwards while the
+// long-run ratio still cannot exceed `samples_per_insert`.
 class RateLimiter {
  public:
   RateLimiter(double samples_per_insert, int64_t min_size_to_sample,
-              double min_diff, double max_diff);
+              double min_diff, double max_diff, double burst_capacity = 0);
 
   // Construct and restore a RateLimiter from a previous checkpoint.
   explicit RateLimiter(const RateLimiterCheckpoint& checkpoint);
@@ -76,6 +92,42 @@ class RateLimiter {
   // is supposed to perform a single item sampling.
   bool MaybeCommitSample(absl::Mutex* mu) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu);
 
+  // Variant of `MaybeCommitSample` that commits up to `max_samples` samples
+  // in one operation, amortizing the admission arithmetic over the batch.
+  // Returns the number of samples admitted by the current state (possibly 0);
+  // the caller is supposed to perform that many sampling operations.
+  int MaybeCommitSamples(absl::Mutex* mu, int max_samples)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  // Undoes `num_samples` commits made through `MaybeCommitSamples` whose
+  // samples could not be fulfilled.
+  void RollbackSamples(int num_samples);
+
+  // Returns true iff the table currently holds at least `min_size_to_sample`
+  // items. Used to revalidate credits granted by `MaybeCommitSamples` after
+  // items have been deleted mid batch.
+  bool MinSizeSatisfied() const;
+
+  // Lock-free variant of `MaybeCommitSample` that can be called without
+  // holding the table mutex. The sample is only admitted when the state is at
+  // least `kFastPathSlack` operations away from the limiter's boundaries, so
+  // the margin absorbs concurrent commits racing on the atomic counters.
+  // Returns false when close to a boundary, in which case the caller must
+  // fall back to the mutex protected path (or reject the operation).
+  bool TryCommitSampleFastPath();
+
+  // Undoes a commit made through `TryCommitSampleFastPath` whose sample could
+  // not be fulfilled.
+  void RollbackSample();
+
+  // Lock-free variants of `CanSample`/`CanInsert`. The counters are read
+  // atomically so the result is exact at the time of reading, but it may be
+  // outdated by the time the caller acts on it; this is no different from the
+  // mutex protected variants which also cannot hold their result beyond the
+  // critical section.
+  bool CanSampleWithoutLock(int num_samples) const;
+  bool CanInsertWithoutLock(int num_inserts) const;
+
   // Returns true iff the current state would allow for `num_inserts` to be
   // inserted. Dies if `num_inserts` is < 1.
   bool CanInsert(absl::Mutex* mu, int num_inserts) const
@@ -85,8 +137,27 @@ class RateLimiter {
   RateLimiterCheckpoint CheckpointReader(absl::Mutex* mu) const
       ABSL_SHARED_LOCKS_REQUIRED(mu);
 
-  // Configuration and call stats of the limiter.
-  RateLimiterInfo Info(absl::Mutex* mu) const ABSL_SHARED_LOCKS_REQUIRED(mu);
+  // Records the queueing delay of a successfully completed sample request.
+  // The delays feed a histogram from which `AdaptiveTimeout` and the wait
+  // percentiles reported by `Info` are derived. Lock-free.
+  void RecordWait(absl::Duration wait);
+
+  // Returns an upper bound of the `quantile` (in [0, 1]) of the recorded wait
+  // times, rounded up to the histogram's bucket boundary. Zero when no waits
+  // have been recorded yet.
+  absl::Duration WaitTimePercentile(double quantile) const;
+
+  // Timeout derived from the recorded wait distribution: the p99.9 wait times
+  // a safety margin, never below a one second floor. Returns
+  // `absl::InfiniteDuration()` until enough waits have been recorded for the
+  // percentile to be meaningful, so cold tables never fail spuriously.
+  // `kAdaptiveTimeout` passed to the table's sample and insert calls is
+  // resolved through this method.
+  absl::Duration AdaptiveTimeout() const;
+
+  // Configuration and call stats of the limiter. Only reads the atomic
+  // counters so it can be called without locking the parent table.
+  RateLimiterInfo Info() const;
 
   // Same as Info but without call stats. Can be called without locking parent
   // table.
@@ -122,14 +193,62 @@ class RateLimiter {
   // to be allowed.
   const int64_t min_size_to_sample_;
 
-  // Total number of items inserted into table.
-  int64_t inserts_;
+  // Maximum number of sample tokens the bucket can hold. Zero disables the
+  // token bucket mode and the strict `min_diff_`/`max_diff_` window above
+  // applies instead.
+  const double burst_capacity_;
+
+  // Whether this limiter runs as a token bucket.
+  bool BucketMode() const { return burst_capacity_ > 0; }
+
+  // Returns `refund_micros` worth of tokens to the bucket, clamped to
+  // `burst_capacity_`. Used by the rollback paths in bucket mode.
+  void RefundTokens(int64_t refund_micros);
+
+  // Tokens are tracked in millionths so that fractional
+  // `samples_per_insert_` deposits accumulate exactly in an atomic integer.
+  static constexpr int64_t kTokenMicros = 1000000;
+
+  // Current bucket fill in millionths of a token. Only used in bucket mode;
+  // mutated with CAS loops so the lock-free sample path can race with
+  // deposits without the fill escaping [0, burst_capacity_].
+  std::atomic<int64_t> bucket_micros_;
+
+  // Number of operations of headroom required for lock-free admission; see
+  // `TryCommitSampleFastPath`.
+  static constexpr int64_t kFastPathSlack = 64;
+
+  // Total number of items inserted into table. The counters are atomic so
+  // admission checks can run without the table mutex; all mutations happen
+  // either while holding the table mutex or through the explicitly
+  // synchronized fast path.
+  std::atomic<int64_t> inserts_;
 
   // Total number of times any item has been sampled from the table.
-  int64_t samples_;
+  std::atomic<int64_t> samples_;
 
   // Total number of items that has been deleted from the table.
-  int64_t deletes_;
+  std::atomic<int64_t> deletes_;
+
+  // Histogram of the waits recorded through `RecordWait`, bucketed by the
+  // floor of the base-2 logarithm of the wait in microseconds. 40 buckets
+  // cover waits up to ~2^39 us (roughly six days); longer waits land in the
+  // last bucket. Log-scale buckets keep the memory constant while the
+  // relative error of any percentile stays below a factor of two, which is
+  // dwarfed by the safety margin applied on top.
+  static constexpr int kWaitHistogramBuckets = 40;
+
+  // Number of recorded waits required before `AdaptiveTimeout` trusts the
+  // percentile instead of returning an infinite timeout.
+  static constexpr int64_t kMinAdaptiveTimeoutWaits = 1000;
+
+  // Safety margin multiplied onto the p99.9 wait and the lowest timeout the
+  // adaptive policy will ever produce.
+  static constexpr double kAdaptiveTimeoutMargin = 2.0;
+  static constexpr absl::Duration kAdaptiveTimeoutFloor = absl::Seconds(1);
+
+  std::atomic<int64_t> wait_histogram_[kWaitHistogramBuckets];
+  std::atomic<int64_t> wait_count_;
 };
 
 }  // namespace reverb
@@ -126,6 +126,46 @@ TEST(RateLimiterTest, BlocksCallsThatExceedsTheMinMaxLimits) {
   limiter->Insert(&mu);
 }
 
+TEST(RateLimiterTest, TokenBucketAllowsBurstsUpToCapacity) {
+  auto limiter = std::make_shared<RateLimiter>(
+      /*samples_per_insert=*/0.5, /*min_size_to_sample=*/1,
+      /*min_diff=*/-10000.0, /*max_diff=*/10000.0, /*burst_capacity=*/10.0);
+  auto table = MakeTable("table", limiter);
+  absl::Mutex mu;
+  absl::WriterMutexLock lock(&mu);
+
+  // No tokens have been deposited yet.
+  EXPECT_FALSE(limiter->MaybeCommitSample(&mu));
+
+  // One insert deposits half a token which is not enough for a sample.
+  limiter->Insert(&mu);
+  EXPECT_FALSE(limiter->MaybeCommitSample(&mu));
+
+  // The second insert completes the token.
+  limiter->Insert(&mu);
+  EXPECT_TRUE(limiter->MaybeCommitSample(&mu));
+  EXPECT_FALSE(limiter->MaybeCommitSample(&mu));
+
+  // A long insert-only phase fills the bucket but deposits beyond the burst
+  // capacity are forfeited; inserts are never blocked.
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(limiter->CanInsert(&mu, 1));
+    limiter->Insert(&mu);
+  }
+  EXPECT_EQ(limiter->MaybeCommitSamples(&mu, 100), 10);
+
+  // The bucket is empty again so sampling falls back to the sustained rate.
+  EXPECT_FALSE(limiter->MaybeCommitSample(&mu));
+  limiter->Insert(&mu);
+  limiter->Insert(&mu);
+  EXPECT_TRUE(limiter->MaybeCommitSample(&mu));
+
+  // Rolled back samples return their tokens to the bucket.
+  limiter->RollbackSamples(1);
+  EXPECT_TRUE(limiter->MaybeCommitSample(&mu));
+  EXPECT_FALSE(limiter->MaybeCommitSample(&mu));
+}
+
 TEST(RateLimiterTest, CanSample) {
   auto limiter =
       std::make_shared<RateLimiter>(/*samples_per_insert=*/1.0,
@@ -170,6 +210,73 @@ TEST(RateLimiterTest, MaybeCommitSample) {
   EXPECT_FALSE(limiter->MaybeCommitSample(&mu));  // diff = -2.0.
 }
 
+TEST(RateLimiterTest, MaybeCommitSamplesGrantsUpToHeadroom) {
+  auto limiter =
+      std::make_shared<RateLimiter>(/*samples_per_insert=*/1.0,
+                                    /*min_size_to_sample=*/1, /*min_diff=*/-2.0,
+                                    /*max_diff=*/10.0);
+  auto table = MakeTable("table", limiter);
+  absl::Mutex mu;
+  absl::WriterMutexLock lock(&mu);
+
+  // Min size should not have been reached so no credits should be granted.
+  EXPECT_EQ(limiter->MaybeCommitSamples(&mu, 4), 0);
+
+  // Insert a single item.
+  EXPECT_TRUE(limiter->CanInsert(&mu, 1));
+  limiter->Insert(&mu);
+
+  // The headroom allows for at most three samples; asking for more should cap
+  // the grant rather than refuse it.
+  EXPECT_EQ(limiter->MaybeCommitSamples(&mu, 4), 3);  // diff = -2.0.
+  EXPECT_EQ(limiter->MaybeCommitSamples(&mu, 4), 0);  // diff = -3.0.
+
+  // A request smaller than the headroom is granted in full.
+  limiter->Insert(&mu);
+  EXPECT_EQ(limiter->MaybeCommitSamples(&mu, 1), 1);  // diff = -2.0.
+}
+
+TEST(RateLimiterTest, RollbackSamplesRestoresCredits) {
+  auto limiter =
+      std::make_shared<RateLimiter>(/*samples_per_insert=*/1.0,
+                                    /*min_size_to_sample=*/1, /*min_diff=*/-2.0,
+                                    /*max_diff=*/10.0);
+  auto table = MakeTable("table", limiter);
+  absl::Mutex mu;
+  absl::WriterMutexLock lock(&mu);
+
+  EXPECT_TRUE(limiter->CanInsert(&mu, 1));
+  limiter->Insert(&mu);
+
+  // Reserve all three credits but only fulfill one of them.
+  EXPECT_EQ(limiter->MaybeCommitSamples(&mu, 3), 3);
+  limiter->RollbackSamples(2);
+  EXPECT_EQ(limiter->CheckpointReader(&mu).sample_count(), 1);
+
+  // The returned credits can be reserved again.
+  EXPECT_EQ(limiter->MaybeCommitSamples(&mu, 3), 2);
+}
+
+TEST(RateLimiterTest, MinSizeSatisfied) {
+  auto limiter =
+      std::make_shared<RateLimiter>(/*samples_per_insert=*/1.0,
+                                    /*min_size_to_sample=*/2, /*min_diff=*/-5.0,
+                                    /*max_diff=*/10.0);
+  auto table = MakeTable("table", limiter);
+  absl::Mutex mu;
+  absl::WriterMutexLock lock(&mu);
+
+  EXPECT_FALSE(limiter->MinSizeSatisfied());
+  limiter->Insert(&mu);
+  EXPECT_FALSE(limiter->MinSizeSatisfied());
+  limiter->Insert(&mu);
+  EXPECT_TRUE(limiter->MinSizeSatisfied());
+
+  // A delete brings the size back below the min size.
+  limiter->Delete(&mu);
+  EXPECT_FALSE(limiter->MinSizeSatisfied());
+}
+
 TEST(RateLimiterTest, CanInsert) {
   auto limiter =
       std::make_shared<RateLimiter>(/*samples_per_insert=*/1.5,
@@ -349,10 +456,7 @@ TEST(RateLimiterTest, BlocksSamplesIfDeleteBringsSizeBelowMinSize) {
 }
 
 TEST(RateLimiterTest, Info) {
-  absl::Mutex mu;
-  absl::ReaderMutexLock lock(&mu);
-
-  EXPECT_THAT(RateLimiter(1, 1, 0, 5).Info(&mu),
+  EXPECT_THAT(RateLimiter(1, 1, 0, 5).Info(),
               EqualsProto("samples_per_insert: 1 "
                           "min_size_to_sample: 1 "
                           "min_diff: 0 "
@@ -360,8 +464,9 @@ TEST(RateLimiterTest, Info) {
                           "insert_stats: { "
                           "} "
                           "sample_stats: { "
-                          "}"));
-  EXPECT_THAT(RateLimiter(1.5, 14, -10, 5.3).Info(&mu),
+                          "} "
+                          "adaptive_timeout_ms: -1"));
+  EXPECT_THAT(RateLimiter(1.5, 14, -10, 5.3).Info(),
               EqualsProto("samples_per_insert: 1.5 "
                           "min_size_to_sample: 14 "
                           "min_diff: -10 "
@@ -369,7 +474,84 @@ TEST(RateLimiterTest, Info) {
                           "insert_stats: { "
                           "} "
                           "sample_stats: { "
-                          "}"));
+                          "} "
+                          "adaptive_timeout_ms: -1"));
+}
+
+TEST(RateLimiterTest, WaitTimePercentileBoundsRecordedWaits) {
+  RateLimiter limiter(1, 1, 0, 5);
+  EXPECT_EQ(limiter.WaitTimePercentile(0.999), absl::ZeroDuration());
+
+  for (int i = 0; i < 99; i++) {
+    limiter.RecordWait(absl::Milliseconds(1));
+  }
+  limiter.RecordWait(absl::Seconds(1));
+
+  // The percentile is an upper bound rounded to the next power-of-two bucket
+  // boundary: p50 of the 1 ms waits is at most 2 ms and the p99.9 must cover
+  // the single 1 s outlier.
+  EXPECT_LE(limiter.WaitTimePercentile(0.5), absl::Milliseconds(2));
+  EXPECT_GE(limiter.WaitTimePercentile(0.999), absl::Seconds(1));
+}
+
+TEST(RateLimiterTest, AdaptiveTimeoutRequiresEnoughObservations) {
+  RateLimiter limiter(1, 1, 0, 5);
+  EXPECT_EQ(limiter.AdaptiveTimeout(), absl::InfiniteDuration());
+
+  for (int i = 0; i < 1000; i++) {
+    limiter.RecordWait(absl::Milliseconds(10));
+  }
+  const absl::Duration timeout = limiter.AdaptiveTimeout();
+  EXPECT_LT(timeout, absl::InfiniteDuration());
+  // The margin and the one second floor keep the timeout well above the
+  // observed waits.
+  EXPECT_GE(timeout, absl::Seconds(1));
+  EXPECT_EQ(limiter.Info().adaptive_timeout_ms(),
+            absl::ToInt64Milliseconds(timeout));
+}
+
+TEST(RateLimiterTest, FastPathOnlyAdmitsWithHeadroom) {
+  absl::Mutex mu;
+  absl::WriterMutexLock lock(&mu);
+
+  // Tight bounds: the state is always close to the admission boundary so the
+  // fast path must refuse and defer to the exact path.
+  RateLimiter tight(/*samples_per_insert=*/1.0, /*min_size_to_sample=*/1,
+                    /*min_diff=*/-10, /*max_diff=*/10);
+  tight.Insert(&mu);
+  EXPECT_TRUE(tight.CanSampleWithoutLock(1));
+  EXPECT_FALSE(tight.TryCommitSampleFastPath());
+  EXPECT_TRUE(tight.MaybeCommitSample(&mu));
+
+  // With plenty of headroom the fast path admits without the mutex.
+  RateLimiter loose(/*samples_per_insert=*/1.0, /*min_size_to_sample=*/1,
+                    /*min_diff=*/-10000, /*max_diff=*/10000);
+  for (int i = 0; i < 1000; i++) loose.Insert(&mu);
+  EXPECT_TRUE(loose.TryCommitSampleFastPath());
+
+  // Rolling back restores the previous state.
+  const auto before = loose.CheckpointReader(&mu).sample_count();
+  EXPECT_TRUE(loose.TryCommitSampleFastPath());
+  loose.RollbackSample();
+  EXPECT_EQ(loose.CheckpointReader(&mu).sample_count(), before);
+}
+
+TEST(RateLimiterTest, LockFreeQueriesMatchLockedOnes) {
+  absl::Mutex mu;
+  absl::WriterMutexLock lock(&mu);
+
+  RateLimiter limiter(/*samples_per_insert=*/1.0, /*min_size_to_sample=*/2,
+                      /*min_diff=*/0, /*max_diff=*/5);
+  for (int num = 1; num <= 8; num++) {
+    EXPECT_EQ(limiter.CanSample(&mu, num), limiter.CanSampleWithoutLock(num));
+    EXPECT_EQ(limiter.CanInsert(&mu, num), limiter.CanInsertWithoutLock(num));
+  }
+  limiter.Insert(&mu);
+  limiter.Insert(&mu);
+  for (int num = 1; num <= 8; num++) {
+    EXPECT_EQ(limiter.CanSample(&mu, num), limiter.CanSampleWithoutLock(num));
+    EXPECT_EQ(limiter.CanInsert(&mu, num), limiter.CanInsertWithoutLock(num));
+  }
 }
 
 TEST(RateLimiterDeathTest, DiesIfMinSizeToSampleNonPositive) {
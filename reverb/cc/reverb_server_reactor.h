@@ -15,6 +15,7 @@
 #ifndef REVERB_CC_REVERB_SERVER_REACTOR_H_
 #define REVERB_CC_REVERB_SERVER_REACTOR_H_
 
+#include <memory>
 #include <queue>
 #include <type_traits>
 
@@ -22,9 +23,13 @@
 #include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "google/protobuf/arena.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/support/grpc_util.h"
+#include "reverb/cc/support/trace.h"
 #include "reverb/cc/task_worker.h"
 
 namespace deepmind {
@@ -95,8 +100,35 @@ class ReverbServerReactor
   // only by OnRead are thus thread safe and require no additional mutex to
   // control access.
 
-  // Message where new requests are unpacked to.
-  Request request_;
+  // Arenas that have grown beyond this are released rather than recycled
+  // between messages.
+  static constexpr size_t kMaxRequestArenaBytes = 4 * 1024 * 1024;
+
+  // Upper bound on response bytes handed to gRPC with the buffer hint before
+  // a flushing write is forced. Bounds both the transport-buffered memory per
+  // stream and how long a coalesced response can linger in the buffer.
+  static constexpr size_t kMaxBufferedResponseBytes = 4 * 1024 * 1024;
+
+  // Arena backing `request_`. Incoming messages are parsed straight into
+  // arena-owned memory so that handling a request does not pay one heap
+  // allocation per submessage. Subclasses that retain parts of a request
+  // beyond `ProcessIncomingRequest` (e.g. chunks referenced by future items)
+  // can share ownership of the arena instead of copying the data out;
+  // `MaybeStartRead` then hands the arena over to them and backs the next
+  // message with a fresh one. An unshared arena is recycled between messages.
+  //
+  // With this in place the only remaining payload copy at ingest is the
+  // protobuf parse itself, which moves the bytes from the gRPC receive
+  // slices into the request message. Eliminating that copy too (slice backed
+  // `absl::Cord` storage) would require a Cord-typed payload field, but
+  // chunk payloads live in `tensorflow.TensorProto.tensor_content` which
+  // this project does not own and cannot annotate.
+  std::shared_ptr<google::protobuf::Arena> request_arena_ =
+      std::make_shared<google::protobuf::Arena>();
+
+  // Message where new requests are unpacked to. Owned by `request_arena_`.
+  Request* request_ =
+      google::protobuf::Arena::CreateMessage<Request>(request_arena_.get());
 
   absl::Mutex mu_;
 
@@ -113,6 +145,25 @@ class ReverbServerReactor
 
   // Is there a GRPC read in flight.
   bool read_in_flight_ ABSL_GUARDED_BY(mu_) = false;
+
+  // When the write currently in flight (if any) was started. Subclasses can
+  // use it in `OnWriteDone` to observe how long the write took.
+  absl::Time write_started_ ABSL_GUARDED_BY(mu_) = absl::InfinitePast();
+
+  // Cycle counter counterpart of `write_started_`, used to record a
+  // "response_serialize" trace event covering serialization and transmission
+  // of the in-flight response. For buffered (coalesced) writes the span ends
+  // when gRPC accepts the message rather than when it reaches the wire.
+  int64_t write_started_cycles_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // True when the write currently in flight was handed to gRPC without the
+  // buffer hint, i.e. its completion waits for the transport to actually send
+  // the message. See `MaybeSendNextResponse`.
+  bool write_is_flushing_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Bytes handed to gRPC with the buffer hint since the last flushing write.
+  // See `MaybeSendNextResponse`.
+  size_t buffered_response_bytes_ ABSL_GUARDED_BY(mu_) = 0;
 };
 
 /*****************************************************************************
@@ -126,6 +177,26 @@ void ReverbServerReactor<Request, Response,
   }
   grpc::WriteOptions options;
   options.set_no_compression();
+  // The reactor API allows only one outstanding write, so on high-RTT links
+  // waiting for each message to reach the wire leaves the stream idle between
+  // completions. When more responses are already queued the write is handed
+  // to gRPC with the buffer hint: completion fires as soon as the transport
+  // has accepted the message, which keeps the pipeline full and lets gRPC
+  // coalesce small responses into fewer frames. The last queued response (or
+  // reaching the per-stream byte cap) forces a flushing write.
+  const size_t payload_bytes =
+      responses_to_send_.front().payload.ByteSizeLong();
+  if (responses_to_send_.size() > 1 &&
+      buffered_response_bytes_ + payload_bytes < kMaxBufferedResponseBytes) {
+    options.set_buffer_hint();
+    buffered_response_bytes_ += payload_bytes;
+    write_is_flushing_ = false;
+  } else {
+    buffered_response_bytes_ = 0;
+    write_is_flushing_ = true;
+  }
+  write_started_ = absl::Now();
+  write_started_cycles_ = internal::TraceNowCycles();
   grpc::ServerBidiReactor<Request, Response>::StartWrite(
       &responses_to_send_.front().payload, options);
 }
@@ -153,7 +224,7 @@ void ReverbServerReactor<Request, Response, ResponseCtx>::OnReadDone(
     return;
   }
 
-  GRPC_CALL_AND_RETURN_IF_ERROR(ProcessIncomingRequest(&request_),
+  GRPC_CALL_AND_RETURN_IF_ERROR(ProcessIncomingRequest(request_),
                                 SetReactorAsFinished);
 }
 
@@ -174,7 +245,18 @@ void ReverbServerReactor<Request, Response, ResponseCtx>::OnWriteDone(
     SetReactorAsFinished(status);
     return;
   }
-  // Message was successfully sent.
+  // Message was successfully sent. The recorded span covers gRPC serializing
+  // the response and writing it to the wire.
+  internal::RecordTraceEvent("response_serialize", write_started_cycles_);
+  // A flushing write that completed while more responses were already queued
+  // behind it held up the stream for its whole duration: the transport could
+  // not accept further data until HTTP/2 flow-control and socket buffers
+  // drained. Recording these spans as their own stage makes time lost to
+  // flow-control visible on the metrics endpoint (it includes serialization
+  // and wire time of the blocking message, so treat it as an upper bound).
+  if (write_is_flushing_ && responses_to_send_.size() > 1) {
+    internal::RecordTraceEvent("response_write_stall", write_started_cycles_);
+  }
   responses_to_send_.pop();
 
   // There are no pending writes so if we are no longer reading from the
@@ -212,7 +294,23 @@ void ReverbServerReactor<Request, Response, ResponseCtx>::MaybeStartRead()
     ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
   if (!read_in_flight_ && still_reading_ && !is_finished_) {
     read_in_flight_ = true;
-    grpc::ServerBidiReactor<Request, Response>::StartRead(&request_);
+    if (request_arena_.use_count() > 1) {
+      // Parts of the previous message are still referenced so the arena is
+      // handed over to the referees and the next message is backed by a fresh
+      // arena.
+      request_arena_ = std::make_shared<google::protobuf::Arena>();
+      request_ = google::protobuf::Arena::CreateMessage<Request>(
+          request_arena_.get());
+    } else if (request_arena_->SpaceAllocated() > kMaxRequestArenaBytes) {
+      // Recycling the arena indefinitely would pin the memory high-water mark
+      // of the stream, so large arenas are released between messages.
+      request_arena_->Reset();
+      request_ = google::protobuf::Arena::CreateMessage<Request>(
+          request_arena_.get());
+    } else {
+      request_->Clear();
+    }
+    grpc::ServerBidiReactor<Request, Response>::StartRead(request_);
   }
 }
 
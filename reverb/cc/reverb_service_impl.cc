@@ -14,6 +14,8 @@
 
 #include "reverb/cc/reverb_service_impl.h"
 
+#include <unistd.h>
+
 #include <algorithm>
 #include <limits>
 #include <list>
@@ -24,14 +26,19 @@
 #include "absl/base/thread_annotations.h"
 #include "absl/flags/flag.h"
 #include "absl/memory/memory.h"
+#include "absl/random/random.h"
 #include "absl/status/status.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "reverb/cc/checkpointing/interface.h"
+#include "reverb/cc/multicast_sample_group.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/hash_set.h"
 #include "reverb/cc/platform/logging.h"
@@ -41,28 +48,62 @@
 #include "reverb/cc/reverb_service.grpc.pb.h"
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/sampler.h"
+#include "reverb/cc/support/chunk_format.h"
 #include "reverb/cc/support/cleanup.h"
 #include "reverb/cc/support/grpc_util.h"
+#include "reverb/cc/support/shm_arena.h"
+#include "reverb/cc/support/trace.h"
 #include "reverb/cc/support/trajectory_util.h"
 #include "reverb/cc/support/uint128.h"
 #include "reverb/cc/support/unbounded_queue.h"
+#include "reverb/cc/tensor_compression.h"
+#include "tensorflow/core/framework/tensor.h"
 
 ABSL_FLAG(size_t, reverb_callback_executor_num_threads, 32,
           "Number of threads in the callback executor thread pool.");
 
+ABSL_FLAG(size_t, reverb_insert_callback_executor_num_threads, 0,
+          "Number of threads in the executor dedicated to insert completion "
+          "callbacks. When 0 (the default) insert completions share the "
+          "callback executor with sampling responses; setting it isolates "
+          "insert traffic so that sampling storms can not starve actors.");
+
+ABSL_FLAG(std::string, reverb_callback_executor_cpu_affinity, "",
+          "Comma separated list of CPU indices the callback executor threads "
+          "are pinned to (e.g. \"0,1,2,3\"). Empty (the default) inherits the "
+          "process affinity mask. Applies to both the sampling and, when "
+          "enabled, the insert callback executor.");
+
+ABSL_FLAG(int, reverb_callback_executor_nice, 0,
+          "Nice value applied to callback executor threads. Negative values "
+          "raise priority and typically require CAP_SYS_NICE.");
+
+ABSL_FLAG(size_t, reverb_writer_chunk_cache_bytes, 256 * 1024 * 1024,
+          "Combined size of recently received chunks the server keeps cached "
+          "per writer identity so that writers reconnecting after a broken "
+          "stream can skip retransmitting them. 0 effectively disables the "
+          "cache.");
+
 namespace deepmind {
 namespace reverb {
 namespace {
 
-// Multiple `ChunkData` can be sent with the same `SampleStreamResponseCtx`. If
-// the size of the message exceeds this value then the request is sent and the
-// remaining chunks are sent with other messages. The value is set to twice the
-// size of the table's sample response to avoid a situation when table's
-// response slightly exceeding the size limit will be split into 2 messages (one
-// close to the limit and one tiny). That could happen otherwise, as table has
-// per-item size resolution while the message - per chunk.
-static constexpr int64_t kMaxSampleResponseSizeBytes =
-    2 * Table::kMaxSampleResponseSizeBytes;
+// Multiple `ChunkData` can be sent with the same `SampleStreamResponseCtx`.
+// If the size of the message exceeds the stream's flush threshold then the
+// request is sent and the remaining chunks are sent with other messages. The
+// threshold starts at (and is capped to) twice the table's sample response
+// size to avoid a situation when table's response slightly exceeding the size
+// limit will be split into 2 messages (one close to the limit and one tiny).
+// That could happen otherwise, as table has per-item size resolution while
+// the message - per chunk. The threshold then adapts per stream so that each
+// write stays within `kSampleFlushLatencyBudget` (see
+// `AdaptFlushThreshold`); it never drops below this floor.
+static constexpr int64_t kMinSampleFlushSizeBytes = 64 * 1024;  // 64kB.
+
+// Target duration of a single response write. Writes completing well below
+// the budget indicate the stream can absorb larger (and thus fewer) messages
+// while writes exceeding it indicate head-of-line blocking.
+constexpr absl::Duration kSampleFlushLatencyBudget = absl::Milliseconds(20);
 
 // Initial sampling batch size (adjusted on each iteration later on). It is
 // relatively high to limit the number of small response round trips. The cost
@@ -74,6 +115,23 @@ constexpr int64_t kInitialGrpcSampleBatchSize = 64;
 // reactor.
 constexpr absl::Duration kCallbackWaitTime = absl::Milliseconds(1);
 
+// Size of the shared memory arena used for out of band chunk transport (see
+// `SampleStreamRequest.shm_transport`). The arena is a ring, so it must hold
+// several seconds of peak sampling throughput for blocks to stay valid until
+// the (same host) client has read them.
+constexpr int64_t kShmArenaBytes = 256 * 1024 * 1024;  // 256MB.
+
+// Prefetches the control structures of `chunk`. An item's chunk pointers are
+// stored contiguously in trajectory order but the `Chunk` objects themselves
+// are scattered across the heap, so walking a large episodic item during
+// response assembly takes a cache miss per chunk unless the next chunk is
+// requested while the current one is being attached.
+inline void PrefetchChunk(const ChunkStore::Chunk* chunk) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(chunk, /*rw=*/0, /*locality=*/3);
+#endif
+}
+
 inline grpc::Status TableNotFound(absl::string_view name) {
   return grpc::Status(grpc::StatusCode::NOT_FOUND,
                       absl::StrCat("Priority table ", name, " was not found"));
@@ -86,7 +144,9 @@ inline grpc::Status Internal(const std::string& message) {
 }  // namespace
 
 ReverbServiceImpl::ReverbServiceImpl(std::shared_ptr<Checkpointer> checkpointer)
-    : checkpointer_(std::move(checkpointer)) {}
+    : checkpointer_(std::move(checkpointer)),
+      writer_chunk_cache_(
+          absl::GetFlag(FLAGS_reverb_writer_chunk_cache_bytes)) {}
 
 absl::Status ReverbServiceImpl::Create(
     std::vector<std::shared_ptr<Table>> tables,
@@ -133,16 +193,41 @@ absl::Status ReverbServiceImpl::Initialize(
     }
   }
 
+  internal::ThreadOptions executor_thread_options;
+  executor_thread_options.nice = absl::GetFlag(FLAGS_reverb_callback_executor_nice);
+  for (absl::string_view cpu : absl::StrSplit(
+           absl::GetFlag(FLAGS_reverb_callback_executor_cpu_affinity), ',',
+           absl::SkipEmpty())) {
+    int index;
+    if (absl::SimpleAtoi(cpu, &index)) {
+      executor_thread_options.cpu_affinity.push_back(index);
+    } else {
+      REVERB_LOG(REVERB_WARNING)
+          << "Ignoring invalid CPU index '" << cpu
+          << "' in --reverb_callback_executor_cpu_affinity.";
+    }
+  }
+  callback_executor_ = std::make_shared<TaskExecutor>(
+      absl::GetFlag(FLAGS_reverb_callback_executor_num_threads),
+      "TableCallbackExecutor", executor_thread_options);
+  const size_t insert_executor_threads =
+      absl::GetFlag(FLAGS_reverb_insert_callback_executor_num_threads);
+  if (insert_executor_threads > 0) {
+    insert_callback_executor_ = std::make_shared<TaskExecutor>(
+        insert_executor_threads, "InsertCallbackExecutor",
+        executor_thread_options);
+  }
+
+  absl::MutexLock lock(&tables_mu_);
   for (auto& table : tables) {
     std::string name = table->name();
     tables_[name] = std::move(table);
   }
-
-  auto executor = std::make_shared<TaskExecutor>(
-      absl::GetFlag(FLAGS_reverb_callback_executor_num_threads),
-      "TableCallbackExecutor");
   for (auto& table : tables_) {
-    table.second->SetCallbackExecutor(executor);
+    table.second->SetCallbackExecutor(callback_executor_);
+    if (insert_callback_executor_ != nullptr) {
+      table.second->SetInsertCallbackExecutor(insert_callback_executor_);
+    }
   }
 
   tables_state_id_ = absl::MakeUint128(absl::Uniform<uint64_t>(rnd_),
@@ -163,8 +248,11 @@ grpc::ServerUnaryReactor* ReverbServiceImpl::Checkpoint(
   }
 
   std::vector<Table*> tables;
-  for (auto& table : tables_) {
-    tables.push_back(table.second.get());
+  {
+    absl::ReaderMutexLock lock(&tables_mu_);
+    for (auto& table : tables_) {
+      tables.push_back(table.second.get());
+    }
   }
 
   auto status = checkpointer_->Save(std::move(tables), 1,
@@ -175,6 +263,160 @@ grpc::ServerUnaryReactor* ReverbServiceImpl::Checkpoint(
   return reactor;
 }
 
+grpc::ServerUnaryReactor* ReverbServiceImpl::ImportCheckpoint(
+    grpc::CallbackServerContext* context,
+    const ImportCheckpointRequest* request,
+    ImportCheckpointResponse* response) {
+  grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  if (checkpointer_ == nullptr) {
+    reactor->Finish(
+        grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                     "no Checkpointer configured for the replay service."));
+    return reactor;
+  }
+
+  // When no names are provided every server table that exists in the
+  // checkpoint is imported; names of tables absent from the checkpoint are
+  // then skipped rather than rejected.
+  const bool explicit_names = !request->table_names().empty();
+  std::vector<std::string> table_names(request->table_names().begin(),
+                                       request->table_names().end());
+  if (!explicit_names) {
+    absl::ReaderMutexLock lock(&tables_mu_);
+    for (const auto& table : tables_) {
+      table_names.push_back(table.first);
+    }
+    std::sort(table_names.begin(), table_names.end());
+  }
+
+  // The store only has to keep the imported chunks alive until the items
+  // holding references to them have been inserted into the tables.
+  ChunkStore chunk_store;
+  for (const auto& table_name : table_names) {
+    auto table = TableByName(table_name);
+    if (table == nullptr) {
+      reactor->Finish(grpc::Status(
+          grpc::StatusCode::NOT_FOUND,
+          absl::StrCat("ImportCheckpoint called for unknown table ",
+                       table_name, ".")));
+      return reactor;
+    }
+    int64_t num_items = 0;
+    auto status = checkpointer_->ImportTable(request->checkpoint_path(),
+                                             table_name, &chunk_store,
+                                             table.get(), &num_items);
+    if (absl::IsNotFound(status) && !explicit_names) {
+      continue;
+    }
+    if (!status.ok()) {
+      reactor->Finish(ToGrpcStatus(status));
+      return reactor;
+    }
+    auto* imported = response->add_tables();
+    imported->set_table_name(table_name);
+    imported->set_num_items(num_items);
+    REVERB_LOG(REVERB_INFO) << "Imported " << num_items << " items into table "
+                            << table_name << " from checkpoint "
+                            << request->checkpoint_path();
+  }
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* ReverbServiceImpl::ForkTable(
+    grpc::CallbackServerContext* context, const ForkTableRequest* request,
+    ForkTableResponse* response) {
+  grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  if (request->new_table_name().empty()) {
+    reactor->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                 "new_table_name must be nonempty."));
+    return reactor;
+  }
+
+  std::shared_ptr<Table> table = TableByName(request->table());
+  if (table == nullptr) {
+    reactor->Finish(TableNotFound(request->table()));
+    return reactor;
+  }
+
+  // The fork is built outside the lock; only the registration of the
+  // completed table has to exclude concurrent lookups. Concurrent forks to
+  // the same name are resolved at registration time below.
+  std::shared_ptr<Table> forked;
+  if (auto status = table->Fork(request->new_table_name(), &forked);
+      !status.ok()) {
+    reactor->Finish(ToGrpcStatus(status));
+    return reactor;
+  }
+  forked->SetCallbackExecutor(callback_executor_);
+  if (insert_callback_executor_ != nullptr) {
+    forked->SetInsertCallbackExecutor(insert_callback_executor_);
+  }
+
+  {
+    absl::MutexLock lock(&tables_mu_);
+    if (!tables_.emplace(request->new_table_name(), forked).second) {
+      reactor->Finish(
+          grpc::Status(grpc::StatusCode::ALREADY_EXISTS,
+                       absl::StrCat("Priority table ",
+                                    request->new_table_name(),
+                                    " already exists.")));
+      return reactor;
+    }
+    tables_state_id_ = absl::MakeUint128(absl::Uniform<uint64_t>(rnd_),
+                                         absl::Uniform<uint64_t>(rnd_));
+  }
+
+  response->set_num_items(forked->size());
+  REVERB_LOG(REVERB_INFO) << "Forked table " << request->table() << " into "
+                          << request->new_table_name() << " ("
+                          << response->num_items() << " items).";
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* ReverbServiceImpl::MoveItems(
+    grpc::CallbackServerContext* context, const MoveItemsRequest* request,
+    MoveItemsResponse* response) {
+  grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  if (request->source_table() == request->target_table()) {
+    reactor->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                 "source_table and target_table must differ."));
+    return reactor;
+  }
+  if (request->max_key() < request->min_key()) {
+    reactor->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                 "max_key must not be smaller than min_key."));
+    return reactor;
+  }
+
+  std::shared_ptr<Table> source = TableByName(request->source_table());
+  if (source == nullptr) {
+    reactor->Finish(TableNotFound(request->source_table()));
+    return reactor;
+  }
+  std::shared_ptr<Table> target = TableByName(request->target_table());
+  if (target == nullptr) {
+    reactor->Finish(TableNotFound(request->target_table()));
+    return reactor;
+  }
+
+  int64_t num_moved = 0;
+  if (auto status = source->MoveItemsTo(target.get(), request->min_key(),
+                                        request->max_key(), &num_moved);
+      !status.ok()) {
+    reactor->Finish(ToGrpcStatus(status));
+    return reactor;
+  }
+
+  response->set_num_items(num_moved);
+  REVERB_LOG(REVERB_INFO) << "Moved " << num_moved << " items from table "
+                          << request->source_table() << " to "
+                          << request->target_table() << ".";
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
 grpc::ServerBidiReactor<InsertStreamRequest, InsertStreamResponse>*
 ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
   struct InsertStreamResponseCtx {
@@ -199,6 +441,16 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
                     responses_to_send_.emplace();
                   }
                   responses_to_send_.back().payload.add_keys(key);
+                  if (auto it = item_sequence_numbers_.find(key);
+                      it != item_sequence_numbers_.end()) {
+                    last_confirmed_sequence_ =
+                        std::max(last_confirmed_sequence_, it->second);
+                    item_sequence_numbers_.erase(it);
+                  }
+                  if (last_confirmed_sequence_ != 0) {
+                    responses_to_send_.back().payload.set_last_sequence_number(
+                        last_confirmed_sequence_);
+                  }
                   if (responses_to_send_.size() == 1) {
                     MaybeSendNextResponse();
                   }
@@ -227,6 +479,16 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
                          "and item.  Request: ",
                          request->ShortDebugString()));
       }
+      if (writer_id_ == 0 && request->writer_id() != 0) {
+        writer_id_ = request->writer_id();
+        // Seed the stream with chunks received on previous streams of the
+        // same writer so that items may reference chunks the writer decided
+        // not to retransmit after reconnecting.
+        for (auto& chunk : server_->writer_chunk_cache_.GetChunks(writer_id_)) {
+          ChunkStore::Key key = chunk->key();
+          chunks_.emplace(key, std::move(chunk));
+        }
+      }
       if (auto status = SaveChunks(request); !status.ok()) {
         return status;
       }
@@ -235,7 +497,34 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
         MaybeStartRead();
         return grpc::Status::OK;
       }
+      if (request->item_sequence_numbers_size() == request->items_size()) {
+        for (int i = 0; i < request->items_size(); ++i) {
+          item_sequence_numbers_[request->items(i).key()] =
+              request->item_sequence_numbers(i);
+        }
+      }
       bool can_insert = true;
+      const int admission_class = request->admission_class();
+      // Consecutive items that target the same table are inserted as one
+      // batch so that a burst produced at an episode boundary is enqueued
+      // under a single lock acquisition.
+      std::shared_ptr<Table> batch_table;
+      std::vector<Table::Item> batch;
+      auto flush_batch = [&]() {
+        absl::Status status;
+        if (batch.size() == 1) {
+          status = batch_table->InsertOrAssignAsync(
+              std::move(batch.front()), &can_insert, insert_completed_,
+              admission_class);
+        } else if (!batch.empty()) {
+          status = batch_table->InsertOrAssignBatch(std::move(batch),
+                                                    &can_insert,
+                                                    insert_completed_,
+                                                    admission_class);
+        }
+        batch.clear();
+        return status.ok() ? grpc::Status::OK : ToGrpcStatus(status);
+      };
       for (auto& request_item : *request->mutable_items()) {
         Table::Item item;
         if (auto status = GetItemWithChunks(&item, &request_item);
@@ -248,11 +537,16 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
         if (table == nullptr) {
           return TableNotFound(table_name);
         }
-        if (auto status = table->InsertOrAssignAsync(
-                std::move(item), &can_insert, insert_completed_);
-            !status.ok()) {
-          return ToGrpcStatus(status);
+        if (table != batch_table) {
+          if (auto status = flush_batch(); !status.ok()) {
+            return status;
+          }
+          batch_table = std::move(table);
         }
+        batch.push_back(std::move(item));
+      }
+      if (auto status = flush_batch(); !status.ok()) {
+        return status;
       }
       if (auto status = ReleaseOutOfRangeChunks(request->keep_chunk_keys());
           !status.ok()) {
@@ -268,10 +562,18 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
 
    private:
     grpc::Status SaveChunks(InsertStreamRequest* request) {
-      for (auto& chunk : *request->mutable_chunks()) {
-        ChunkStore::Key key = chunk.chunk_key();
+      while (request->chunks_size() > 0) {
+        // The chunk stays owned by the arena the request was parsed into; the
+        // Chunk shares ownership of the arena so the payload is served
+        // without ever being copied out of the parse buffer.
+        ChunkData* chunk = request->mutable_chunks()->UnsafeArenaReleaseLast();
+        ChunkStore::Key key = chunk->chunk_key();
         if (!chunks_.contains(key)) {
-          chunks_[key] = std::make_shared<ChunkStore::Chunk>(std::move(chunk));
+          chunks_[key] =
+              std::make_shared<ChunkStore::Chunk>(chunk, request_arena_);
+        }
+        if (writer_id_ != 0) {
+          server_->writer_chunk_cache_.Put(writer_id_, chunks_[key]);
         }
       }
 
@@ -323,6 +625,7 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
     //
     // The following fields are ONLY accessed by OnRead (and subcalls):
     //  - chunks_
+    //  - writer_id_
 
     // Chunks that may be referenced by items not yet received. The ChunkStore
     // itself only maintains weak pointers to the chunk so until an item that
@@ -331,8 +634,26 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
     internal::flat_hash_map<ChunkStore::Key, std::shared_ptr<ChunkStore::Chunk>>
         chunks_;
 
-    // Used to lookup tables when inserting items.
-    const ReverbServiceImpl* server_;
+    // Identity of the writer behind this stream, taken from the first request
+    // that carries a nonzero `writer_id`. When set, received chunks are also
+    // registered in the server's writer chunk cache and the stream is seeded
+    // with the chunks cached for the writer.
+    uint64_t writer_id_ = 0;
+
+    // Writer assigned sequence numbers of items that have been received but
+    // not yet confirmed, keyed by item key. Only populated if the writer sets
+    // `item_sequence_numbers` on its requests.
+    internal::flat_hash_map<uint64_t, uint64_t> item_sequence_numbers_
+        ABSL_GUARDED_BY(mu_);
+
+    // Highest sequence number among confirmed items. Echoed on responses (see
+    // `InsertStreamResponse.last_sequence_number`) so that the writer can
+    // drop its copies of acknowledged items.
+    uint64_t last_confirmed_sequence_ ABSL_GUARDED_BY(mu_) = 0;
+
+    // Used to lookup tables when inserting items and to reach the writer
+    // chunk cache.
+    ReverbServiceImpl* server_;
 
     // Callback called by the table when insert operation is completed.
     std::shared_ptr<Table::InsertCallback> insert_completed_;
@@ -341,6 +662,26 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
   return new WorkerlessInsertReactor(this);
 }
 
+grpc::ServerUnaryReactor* ReverbServiceImpl::QueryReceivedChunks(
+    grpc::CallbackServerContext* context,
+    const QueryReceivedChunksRequest* request,
+    QueryReceivedChunksResponse* response) {
+  grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  if (request->writer_id() == 0) {
+    reactor->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                 "writer_id must be nonzero."));
+    return reactor;
+  }
+  for (uint64_t key : writer_chunk_cache_.Query(
+           request->writer_id(),
+           absl::MakeConstSpan(request->chunk_keys().data(),
+                               request->chunk_keys().size()))) {
+    response->add_chunk_keys(key);
+  }
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
 grpc::ServerBidiReactor<InitializeConnectionRequest,
                         InitializeConnectionResponse>*
 ReverbServiceImpl::InitializeConnection(grpc::CallbackServerContext* context) {
@@ -467,6 +808,21 @@ grpc::ServerUnaryReactor* ReverbServiceImpl::Reset(
   return reactor;
 }
 
+grpc::ServerUnaryReactor* ReverbServiceImpl::SetPriorityExponent(
+    grpc::CallbackServerContext* context,
+    const SetPriorityExponentRequest* request,
+    SetPriorityExponentResponse* response) {
+  grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  std::shared_ptr<Table> table = TableByName(request->table());
+  if (table == nullptr) {
+    reactor->Finish(TableNotFound(request->table()));
+    return reactor;
+  }
+  auto status = table->SetPriorityExponent(request->priority_exponent());
+  reactor->Finish(ToGrpcStatus(status));
+  return reactor;
+}
+
 grpc::ServerBidiReactor<SampleStreamRequest, SampleStreamResponse>*
 ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
   struct SampleStreamResponseCtx {
@@ -477,7 +833,24 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
     SampleStreamResponseCtx& operator=(SampleStreamResponseCtx&& response) =
         default;
 
+    // Response aliasing the entries of a batch shared by a multicast group.
+    explicit SampleStreamResponseCtx(
+        std::shared_ptr<MulticastSampleBatch> batch)
+        : shared_batch(std::move(batch)) {
+      for (auto& entry : *shared_batch->mutable_payload()->mutable_entries()) {
+        payload.mutable_entries()->UnsafeArenaAddAllocated(&entry);
+      }
+    }
+
     ~SampleStreamResponseCtx() {
+      if (shared_batch != nullptr) {
+        // The entries (and everything they borrow) are owned by the shared
+        // batch; only the aliases have to be unlinked here.
+        while (payload.entries_size() != 0) {
+          payload.mutable_entries()->UnsafeArenaReleaseLast();
+        }
+        return;
+      }
       // SampleStreamResponseCtx does not own immutable parts of the payload.
       // We need to make sure not to destroy them while destructing the payload.
       for (auto& entry : *payload.mutable_entries()) {
@@ -490,14 +863,40 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
           entry.mutable_data()->UnsafeArenaReleaseLast();
         }
       }
+      for (auto& chunk : pinned_chunks) {
+        chunk->UnpinPayload();
+      }
     }
 
     void AddTableItem(std::shared_ptr<TableItem> item) {
       table_items.push_back(std::move(item));
     }
 
+    // Pins the payload of `chunk` in memory until the response has been sent
+    // (or abandoned). The payload is attached to the response by pointer, so
+    // it must stay resident while gRPC may still serialize it; without the
+    // pin a chunk store with a spill tier could release it in the meantime.
+    void PinChunk(const std::shared_ptr<ChunkStore::Chunk>& chunk) {
+      chunk->PinPayload();
+      pinned_chunks.push_back(chunk);
+    }
+
     SampleStreamResponse payload;
     std::vector<std::shared_ptr<TableItem>> table_items;
+    std::vector<std::shared_ptr<ChunkStore::Chunk>> pinned_chunks;
+
+    // Bare chunk references (`payload_cached` stubs) sent in place of chunks
+    // the client's stream cache still holds. Attached to the payload by
+    // pointer like the full chunks, but owned by the response.
+    std::vector<std::unique_ptr<ChunkData>> reference_chunks;
+
+    // Rewritten trajectories (subsequence windows and column projections).
+    // Unlike the item owned trajectories, which are attached by pointer and
+    // released above, these are built per sample and owned by the response.
+    std::vector<std::unique_ptr<FlatTrajectory>> owned_trajectories;
+
+    // Set iff the response aliases the entries of a shared multicast batch.
+    std::shared_ptr<MulticastSampleBatch> shared_batch;
   };
 
   // Maximal number of queued SampleStreamResponse-messages waiting to be send
@@ -544,13 +943,61 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
               })),
           waiting_for_enqueued_sample_(false) {
       task_info_.last_batch_size = kInitialGrpcSampleBatchSize;
+      task_info_.subsequence_length = 0;
+      task_info_.nstep_num_steps = 0;
+      task_info_.nstep_reward_column = 0;
+      task_info_.nstep_discount = 1;
+      batch_ready_ = std::make_shared<MulticastSampleGroup::BatchCallback>(
+          [&](const absl::Status& status,
+              std::shared_ptr<MulticastSampleBatch> batch) {
+            absl::MutexLock lock(&mu_);
+            if (is_finished_) {
+              return;
+            }
+            if (!status.ok()) {
+              SetReactorAsFinished(ToGrpcStatus(status));
+              return;
+            }
+            if (task_info_.fetched_samples >= task_info_.requested_samples ||
+                responses_to_send_.size() >= kMaxQueuedResponses) {
+              // Not expecting more samples right now; the batch is skipped
+              // rather than buffered unboundedly. The group keeps producing
+              // for the other subscribers and later batches are picked up
+              // again.
+              return;
+            }
+            task_info_.fetched_samples += batch->num_samples();
+            bool already_writing = !responses_to_send_.empty();
+            responses_to_send_.emplace(std::move(batch));
+            if (!already_writing) {
+              MaybeSendNextResponse();
+            }
+            if (task_info_.fetched_samples >= task_info_.requested_samples) {
+              // Current request is finalized, ask for another one.
+              MaybeStartRead();
+            } else {
+              multicast_group_->RequestBatch();
+            }
+          });
       absl::MutexLock lock(&mu_);
       MaybeStartRead();
     }
 
     ~WorkerlessSampleReactor() {
-      // As callback references Reactor's memory make sure it can't be executed
-      // anymore.
+      {
+        absl::MutexLock lock(&mu_);
+        if (multicast_group_ != nullptr) {
+          multicast_group_->Unsubscribe(batch_ready_);
+        }
+      }
+      // As the callbacks reference Reactor's memory make sure they can't be
+      // executed anymore.
+      std::weak_ptr<MulticastSampleGroup::BatchCallback> weak_batch_ready =
+          batch_ready_;
+      batch_ready_.reset();
+      while (weak_batch_ready.lock()) {
+        absl::SleepFor(kCallbackWaitTime);
+      }
       std::weak_ptr<SamplingCallback> weak_ptr = sampling_done_;
       sampling_done_.reset();
       while (weak_ptr.lock()) {
@@ -559,8 +1006,16 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
     }
 
     void OnWriteDone(bool ok) override {
+      absl::Duration write_duration;
+      {
+        absl::MutexLock lock(&mu_);
+        write_duration = absl::Now() - write_started_;
+      }
       ReverbServerReactor::OnWriteDone(ok);
       absl::MutexLock lock(&mu_);
+      if (ok) {
+        AdaptFlushThreshold(write_duration);
+      }
       MaybeStartSampling();
     }
 
@@ -575,14 +1030,151 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
           request->rate_limiter_timeout().milliseconds() > 0) {
         task_info_.timeout =
             absl::Milliseconds(request->rate_limiter_timeout().milliseconds());
+      } else if (request->has_rate_limiter_timeout() &&
+                 request->rate_limiter_timeout().milliseconds() == -2) {
+        // Sentinel resolved by the table against the wait time distribution
+        // observed by its rate limiter.
+        task_info_.timeout = kAdaptiveTimeout;
       } else {
         task_info_.timeout = absl::InfiniteDuration();
       }
+      if (request->has_subsequence()) {
+        if (request->subsequence().length() <= 0) {
+          return grpc::Status(
+              grpc::StatusCode::INVALID_ARGUMENT,
+              absl::StrCat("`subsequence.length` must be > 0 (got ",
+                           request->subsequence().length(), ")."));
+        }
+        task_info_.subsequence_length = request->subsequence().length();
+      } else {
+        task_info_.subsequence_length = 0;
+      }
+      if (request->has_nstep()) {
+        if (request->nstep().num_steps() <= 0) {
+          return grpc::Status(
+              grpc::StatusCode::INVALID_ARGUMENT,
+              absl::StrCat("`nstep.num_steps` must be > 0 (got ",
+                           request->nstep().num_steps(), ")."));
+        }
+        if (request->nstep().reward_column() < 0) {
+          return grpc::Status(
+              grpc::StatusCode::INVALID_ARGUMENT,
+              absl::StrCat("`nstep.reward_column` must be >= 0 (got ",
+                           request->nstep().reward_column(), ")."));
+        }
+        if (request->nstep().discount() < 0 ||
+            request->nstep().discount() > 1) {
+          return grpc::Status(
+              grpc::StatusCode::INVALID_ARGUMENT,
+              absl::StrCat("`nstep.discount` must be in [0, 1] (got ",
+                           request->nstep().discount(), ")."));
+        }
+        if (request->has_subsequence() || !request->columns().empty() ||
+            !request->multicast_group().empty()) {
+          return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                              "`nstep` cannot be combined with `subsequence`, "
+                              "`columns` or `multicast_group`.");
+        }
+        task_info_.nstep_num_steps = request->nstep().num_steps();
+        task_info_.nstep_reward_column = request->nstep().reward_column();
+        task_info_.nstep_discount =
+            request->nstep().discount() == 0 ? 1 : request->nstep().discount();
+      } else {
+        task_info_.nstep_num_steps = 0;
+      }
+      task_info_.columns.clear();
+      for (int column : request->columns()) {
+        if (column < 0) {
+          return grpc::Status(
+              grpc::StatusCode::INVALID_ARGUMENT,
+              absl::StrCat("`columns` must not contain negative indices (got ",
+                           column, ")."));
+        }
+        task_info_.columns.push_back(column);
+      }
+      if (request->multicast_group().empty()) {
+        if (multicast_group_ != nullptr) {
+          return grpc::Status(
+              grpc::StatusCode::INVALID_ARGUMENT,
+              "`multicast_group` must not change within a stream.");
+        }
+      } else if (request->has_subsequence() || !request->columns().empty()) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "`multicast_group` cannot be combined with "
+                            "`subsequence` or `columns`.");
+      }
+      if (request->chunk_cache_size() < 0) {
+        return grpc::Status(
+            grpc::StatusCode::INVALID_ARGUMENT,
+            absl::StrCat("`chunk_cache_size` must be >= 0 (got ",
+                         request->chunk_cache_size(), ")."));
+      }
+      if (request->chunk_cache_size() > 0 &&
+          !request->multicast_group().empty()) {
+        // Multicast batches are shared across streams so they cannot refer to
+        // the state of any single stream's cache.
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "`chunk_cache_size` cannot be combined with "
+                            "`multicast_group`.");
+      }
+      if (!request->disk_cached_chunk_keys().empty() &&
+          !request->multicast_group().empty()) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "`disk_cached_chunk_keys` cannot be combined with "
+                            "`multicast_group`.");
+      }
+      if (request->shm_transport()) {
+        if (!request->multicast_group().empty()) {
+          // Multicast batches are serialized once for the whole group, which
+          // may span remote subscribers.
+          return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                              "`shm_transport` cannot be combined with "
+                              "`multicast_group`.");
+        }
+        if (shm_arena_ == nullptr) {
+          // nullptr when the arena cannot be created on this platform, in
+          // which case the stream degrades to inline payloads.
+          shm_arena_ = server_->GetOrCreateShmArena();
+        }
+      }
+      for (uint64_t key : request->disk_cached_chunk_keys()) {
+        disk_cached_chunk_keys_.insert(key);
+      }
+      if (chunk_cache_size_ < 0) {
+        chunk_cache_size_ = request->chunk_cache_size();
+      } else if (chunk_cache_size_ != request->chunk_cache_size()) {
+        // The caches on both ends mirror each other for the lifetime of the
+        // stream, so resizing mid-stream would desynchronize them.
+        return grpc::Status(
+            grpc::StatusCode::INVALID_ARGUMENT,
+            "`chunk_cache_size` must not change within a stream.");
+      }
 
       task_info_.table = server_->TableByName(request->table());
       if (task_info_.table == nullptr) {
         return TableNotFound(request->table());
       }
+      // The cap follows the table's (possibly overridden) response size while
+      // the adapted threshold itself is carried over between requests of the
+      // stream.
+      max_flush_threshold_bytes_ =
+          2 * task_info_.table->max_sample_response_size_bytes();
+      flush_threshold_bytes_ =
+          std::min(flush_threshold_bytes_, max_flush_threshold_bytes_);
+      if (!request->multicast_group().empty()) {
+        const std::string group_key =
+            absl::StrCat(request->table(), "/", request->multicast_group());
+        if (multicast_group_ == nullptr) {
+          multicast_group_key_ = group_key;
+          multicast_group_ =
+              server_->GetOrCreateSampleGroup(group_key, task_info_.table);
+          multicast_group_->Subscribe(batch_ready_);
+        } else if (group_key != multicast_group_key_) {
+          return grpc::Status(
+              grpc::StatusCode::INVALID_ARGUMENT,
+              "`multicast_group` must not change within a stream.");
+        }
+      }
       task_info_.fetched_samples = 0;
       task_info_.requested_samples = request->num_samples();
       MaybeStartSampling();
@@ -591,6 +1183,15 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
 
    private:
     void MaybeStartSampling() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (multicast_group_ != nullptr) {
+        // Sampling is delegated to the shared group; batches arrive through
+        // `batch_ready_`.
+        if (task_info_.fetched_samples < task_info_.requested_samples &&
+            responses_to_send_.size() < kMaxQueuedResponses) {
+          multicast_group_->RequestBatch();
+        }
+        return;
+      }
       // We start with a batch size of `kInitialGrpcSampleBatchSize` to not
       // pre-allocate too long response vector if there is not enough items in
       // the table. Each time batch size doubles. Response size is limited by
@@ -621,20 +1222,136 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
         ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       if (responses_to_send_.empty() ||
           (responses_to_send_.size() == 1 && write_in_flight) ||
-          current_response_size_bytes_ > kMaxSampleResponseSizeBytes) {
+          current_response_size_bytes_ > flush_threshold_bytes_) {
         // We need a new response as there is no previous one / is already in
         // flight or too big.
         responses_to_send_.emplace();
         current_response_size_bytes_ = 0;
       }
       SampleStreamResponseCtx* response = &responses_to_send_.back();
+      auto& sample_item = sample->ref->item;
+
+      // When the stream requests a column projection and/or subsequences the
+      // item's trajectory is rewritten so that only the chunks it still
+      // references are streamed. The projection is applied first; projections
+      // that keep no columns, and windows over items that are too short (or
+      // whose trajectory is not a plain timestep sequence), are skipped so
+      // that such items are returned whole.
+      std::unique_ptr<FlatTrajectory> rewritten;
+      const FlatTrajectory* trajectory = &sample_item.flat_trajectory();
+      if (!task_info_.columns.empty()) {
+        FlatTrajectory projected =
+            internal::ProjectTrajectory(*trajectory, task_info_.columns);
+        if (!projected.columns().empty()) {
+          rewritten = absl::make_unique<FlatTrajectory>(std::move(projected));
+          trajectory = rewritten.get();
+        }
+      }
+      if (task_info_.subsequence_length > 0 &&
+          internal::IsTimestepTrajectory(*trajectory) &&
+          internal::TimestepTrajectoryLength(*trajectory) >
+              task_info_.subsequence_length) {
+        const int episode_length =
+            internal::TimestepTrajectoryLength(*trajectory);
+        const int start = absl::Uniform<int>(
+            bit_gen_, 0, episode_length - task_info_.subsequence_length + 1);
+        rewritten = absl::make_unique<FlatTrajectory>(
+            internal::SliceTimestepTrajectory(*trajectory, start,
+                                              task_info_.subsequence_length));
+        trajectory = rewritten.get();
+      }
+      // N-step transitions: a start step t is drawn uniformly, the discounted
+      // rewards of [t, t+N) are folded into a single return and the item is
+      // rewritten to reference only steps t and t+N plus a synthesized one
+      // row chunk holding the return. Items that are too short, not plain
+      // timestep sequences or whose reward column cannot be decoded (e.g.
+      // delta encoded across chunks) are returned whole, as are items holding
+      // nothing but the reward column (the rewrite would otherwise reference
+      // no stored chunk at all).
+      std::unique_ptr<ChunkData> synthesized_chunk;
+      if (task_info_.nstep_num_steps > 0 && trajectory->columns_size() > 1 &&
+          internal::IsTimestepTrajectory(*trajectory) &&
+          internal::TimestepTrajectoryLength(*trajectory) >
+              task_info_.nstep_num_steps) {
+        const int episode_length =
+            internal::TimestepTrajectoryLength(*trajectory);
+        const int start = absl::Uniform<int>(
+            bit_gen_, 0, episode_length - task_info_.nstep_num_steps);
+        double reward = 0;
+        tensorflow::DataType reward_dtype = tensorflow::DT_INVALID;
+        if (internal::AccumulateNStepReward(
+                *trajectory, sample->ref->chunks,
+                task_info_.nstep_reward_column, start,
+                task_info_.nstep_num_steps, task_info_.nstep_discount, &reward,
+                &reward_dtype)
+                .ok()) {
+          auto transition =
+              absl::make_unique<FlatTrajectory>(internal::NStepTransitionTrajectory(
+                  *trajectory, start, task_info_.nstep_num_steps));
+          // The return replaces the reward column; its chunk does not exist in
+          // the table so it is synthesized and attached to the response below.
+          tensorflow::Tensor return_tensor(reward_dtype, {1});
+          if (reward_dtype == tensorflow::DT_FLOAT) {
+            return_tensor.flat<float>()(0) = static_cast<float>(reward);
+          } else {
+            return_tensor.flat<double>()(0) = reward;
+          }
+          synthesized_chunk = absl::make_unique<ChunkData>();
+          synthesized_chunk->set_chunk_key(absl::Uniform<uint64_t>(bit_gen_));
+          CompressTensorAsProto(
+              return_tensor, synthesized_chunk->mutable_data()->add_tensors());
+          synthesized_chunk->set_data_tensors_len(1);
+          auto* reward_col =
+              transition->mutable_columns(task_info_.nstep_reward_column);
+          reward_col->clear_chunk_slices();
+          auto* slice = reward_col->add_chunk_slices();
+          slice->set_chunk_key(synthesized_chunk->chunk_key());
+          slice->set_index(0);
+          slice->set_offset(0);
+          slice->set_length(1);
+          rewritten = std::move(transition);
+          trajectory = rewritten.get();
+        }
+      }
+
+      // Covers selecting the item's chunks and attaching them to the
+      // response(s) below.
+      internal::ScopedTrace chunk_gather_trace("chunk_gather");
+      const absl::Time serialize_started = absl::Now();
+
+      // Indices of the item's chunks included in the response; all of them
+      // unless the trajectory was rewritten.
+      std::vector<int> chunk_indices;
+      chunk_indices.reserve(sample->ref->chunks.size());
+      if (rewritten != nullptr) {
+        internal::flat_hash_set<uint64_t> kept_keys;
+        for (uint64_t key : internal::GetChunkKeys(*rewritten)) {
+          kept_keys.insert(key);
+        }
+        for (int i = 0; i < sample->ref->chunks.size(); i++) {
+          if (kept_keys.contains(sample->ref->chunks[i]->key())) {
+            chunk_indices.push_back(i);
+          }
+        }
+      } else {
+        for (int i = 0; i < sample->ref->chunks.size(); i++) {
+          chunk_indices.push_back(i);
+        }
+      }
+
       auto* entry = response->payload.add_entries();
-      for (int i = 0; i < sample->ref->chunks.size(); i++) {
-        entry->set_end_of_sequence(i + 1 == sample->ref->chunks.size());
+      SampleInfo* info_proto = nullptr;
+      for (int i = 0; i < chunk_indices.size(); i++) {
+        if (i + 1 < chunk_indices.size()) {
+          // Overlap fetching the next chunk's memory with attaching the
+          // current one so the walk streams instead of pointer-chasing.
+          PrefetchChunk(sample->ref->chunks[chunk_indices[i + 1]].get());
+        }
+        entry->set_end_of_sequence(i + 1 == chunk_indices.size() &&
+                                   synthesized_chunk == nullptr);
         // Attach the info to the first message.
         if (i == 0) {
           auto* item = entry->mutable_info()->mutable_item();
-          auto& sample_item = sample->ref->item;
           item->set_key(sample_item.key());
           item->set_table(sample_item.table());
           item->set_priority(sample->priority);
@@ -643,18 +1360,68 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
           // upon destruction of the item.
           item->/*unsafe_arena_*/set_allocated_inserted_at(
               sample_item.mutable_inserted_at());
-          item->/*unsafe_arena_*/set_allocated_flat_trajectory(
-              sample_item.mutable_flat_trajectory());
+          if (rewritten != nullptr) {
+            // The released pointer stays owned by `owned_trajectories`.
+            item->/*unsafe_arena_*/set_allocated_flat_trajectory(
+                rewritten.get());
+            response->owned_trajectories.push_back(std::move(rewritten));
+          } else {
+            item->/*unsafe_arena_*/set_allocated_flat_trajectory(
+                sample_item.mutable_flat_trajectory());
+          }
           entry->mutable_info()->set_probability(sample->probability);
           entry->mutable_info()->set_table_size(sample->table_size);
+          entry->mutable_info()->set_min_sampling_weight(
+              sample->min_sampling_weight);
+          entry->mutable_info()->set_max_sampling_weight(
+              sample->max_sampling_weight);
           entry->mutable_info()->set_rate_limited(sample->rate_limited);
+          entry->mutable_info()->set_queued_for_secs(
+              absl::ToDoubleSeconds(sample->queued_for));
+          entry->mutable_info()->set_rate_limiter_wait_secs(
+              absl::ToDoubleSeconds(sample->rate_limiter_wait));
+          entry->mutable_info()->set_deterministic_sample_index(
+              sample->deterministic_sample_index);
+          entry->mutable_info()->set_chunk_compressed_bytes(
+              sample->chunk_compressed_bytes);
+          entry->mutable_info()->set_chunk_uncompressed_bytes(
+              sample->chunk_uncompressed_bytes);
+          info_proto = entry->mutable_info();
+        }
+        const std::shared_ptr<ChunkStore::Chunk>& chunk_ref =
+            sample->ref->chunks[chunk_indices[i]];
+        // The disk cache is checked first and skips the stream cache updates
+        // entirely; the client applies the same precedence so the mirrored
+        // stream caches stay in lockstep.
+        if (disk_cached_chunk_keys_.contains(chunk_ref->key()) ||
+            (chunk_cache_size_ > 0 && TouchSentChunk(chunk_ref->key()))) {
+          // The client holds this chunk, either in its persistent disk cache
+          // or in its half of the stream cache (the caches on both ends apply
+          // identical updates in stream order), so a bare reference replaces
+          // the payload.
+          auto reference = absl::make_unique<ChunkData>();
+          reference->set_chunk_key(chunk_ref->key());
+          reference->set_payload_cached(true);
+          entry->mutable_data()->UnsafeArenaAddAllocated(reference.get());
+          response->reference_chunks.push_back(std::move(reference));
+        } else if (shm_arena_ != nullptr &&
+                   PlaceChunkInShmArena(chunk_ref, response, entry)) {
+          // The payload was placed in the shared memory arena; the entry
+          // carries only a block reference and the client reads the bytes at
+          // memory speed. Falls through to the inline path when the arena
+          // rejects the chunk (e.g. larger than the arena).
+        } else {
+          response->PinChunk(chunk_ref);
+          // The chunk is attached by pointer rather than copied, so gRPC
+          // serializes the single stored copy of the (immutable) payload
+          // straight onto the wire. Its size is computed once per chunk and
+          // reused for every sample that references it.
+          ChunkData* chunk = const_cast<ChunkData*>(&chunk_ref->data());
+          current_response_size_bytes_ += chunk_ref->DataByteSizeLong();
+          entry->mutable_data()->UnsafeArenaAddAllocated(chunk);
         }
-        ChunkData* chunk =
-            const_cast<ChunkData*>(&sample->ref->chunks[i]->data());
-        current_response_size_bytes_ += chunk->ByteSizeLong();
-        entry->mutable_data()->UnsafeArenaAddAllocated(chunk);
-        if (i < sample->ref->chunks.size() - 1 &&
-            current_response_size_bytes_ > kMaxSampleResponseSizeBytes) {
+        if (i < chunk_indices.size() - 1 &&
+            current_response_size_bytes_ > flush_threshold_bytes_) {
           // Current response is too big, start a new one.
           responses_to_send_.emplace();
           current_response_size_bytes_ = 0;
@@ -662,17 +1429,140 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
           entry = response->payload.add_entries();
         }
       }
+      if (synthesized_chunk != nullptr) {
+        // The synthesized return chunk rides in the last message of the
+        // sample; like the reference chunks above it is owned by the response
+        // rather than the arena.
+        entry->set_end_of_sequence(true);
+        current_response_size_bytes_ += synthesized_chunk->ByteSizeLong();
+        entry->mutable_data()->UnsafeArenaAddAllocated(
+            synthesized_chunk.get());
+        response->reference_chunks.push_back(std::move(synthesized_chunk));
+      }
+      // The write itself is asynchronous so this covers assembling the
+      // response; the trace ring's "response_serialize" stage covers the
+      // remaining time inside gRPC.
+      info_proto->set_serialize_time_secs(
+          absl::ToDoubleSeconds(absl::Now() - serialize_started));
       // Reference sample only in the last response containing it, so it is
       // released when fully sent to the client.
       response->AddTableItem(sample->ref);
     }
 
+    // Returns true if `key` is recorded as held by the client's stream cache
+    // and refreshes its recency. Otherwise records it, evicting the least
+    // recently sent key once the cache is full, and returns false. The
+    // client applies the mirrored update on receipt, so the two caches stay
+    // in lockstep.
+    bool TouchSentChunk(uint64_t key) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (auto it = sent_chunks_index_.find(key);
+          it != sent_chunks_index_.end()) {
+        sent_chunks_lru_.splice(sent_chunks_lru_.begin(), sent_chunks_lru_,
+                                it->second);
+        return true;
+      }
+      sent_chunks_lru_.push_front(key);
+      sent_chunks_index_[key] = sent_chunks_lru_.begin();
+      if (sent_chunks_index_.size() >
+          static_cast<size_t>(chunk_cache_size_)) {
+        sent_chunks_index_.erase(sent_chunks_lru_.back());
+        sent_chunks_lru_.pop_back();
+      }
+      return false;
+    }
+
+    // Serializes the chunk into the stream's shared memory arena and
+    // attaches a block reference (`ChunkData.shm_ref`) to `entry` instead of
+    // the payload. Returns false without attaching anything when the chunk
+    // cannot be placed in the arena (e.g. it is larger than the arena), in
+    // which case the caller inlines the payload.
+    bool PlaceChunkInShmArena(
+        const std::shared_ptr<ChunkStore::Chunk>& chunk_ref,
+        SampleStreamResponseCtx* response,
+        SampleStreamResponse::SampleEntry* entry)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      // The packed layout puts the hot fields (chunk key, sequence range,
+      // per column offsets and codecs) at fixed offsets so the client avoids
+      // a general protobuf decode of the payload; see support/chunk_format.h.
+      if (!internal::PackChunk(chunk_ref->data(), &shm_scratch_).ok()) {
+        return false;
+      }
+      internal::ShmArena::BlockRef block;
+      if (!shm_arena_->Write(shm_scratch_, &block).ok()) {
+        return false;
+      }
+      auto reference = absl::make_unique<ChunkData>();
+      reference->set_chunk_key(chunk_ref->key());
+      auto* shm_ref = reference->mutable_shm_ref();
+      shm_ref->set_offset(block.offset);
+      shm_ref->set_length(block.length);
+      shm_ref->set_sequence(block.sequence);
+      current_response_size_bytes_ += reference->ByteSizeLong();
+      response->payload.set_shm_arena(shm_arena_->name());
+      entry->mutable_data()->UnsafeArenaAddAllocated(reference.get());
+      response->reference_chunks.push_back(std::move(reference));
+      return true;
+    }
+
+    // Adapts the per stream flush threshold towards keeping each response
+    // write within `kSampleFlushLatencyBudget`. Writes completing well below
+    // the budget double the threshold (bounded by twice the table's response
+    // size) so that small items are coalesced into fewer messages; writes
+    // exceeding the budget halve it (bounded by `kMinSampleFlushSizeBytes`)
+    // so that jumbo responses stop blocking the stream.
+    void AdaptFlushThreshold(absl::Duration write_duration)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (write_duration < kSampleFlushLatencyBudget / 2) {
+        flush_threshold_bytes_ =
+            std::min(flush_threshold_bytes_ * 2, max_flush_threshold_bytes_);
+      } else if (write_duration > kSampleFlushLatencyBudget) {
+        flush_threshold_bytes_ =
+            std::max(flush_threshold_bytes_ / 2, kMinSampleFlushSizeBytes);
+      }
+    }
+
     // Used to lookup tables when inserting items.
     const ReverbServiceImpl* server_;
 
     // Context of the current sample request.
     SampleTaskInfo task_info_ ABSL_GUARDED_BY(mu_);
 
+    // Used for drawing subsequence window offsets, N-step transition starts
+    // and synthesized chunk keys, not thread-safe.
+    absl::BitGen bit_gen_ ABSL_GUARDED_BY(mu_);
+
+    // Chunk keys the client holds in its persistent disk cache (see
+    // `SampleStreamRequest.disk_cached_chunk_keys`). These chunks are always
+    // sent as bare references.
+    internal::flat_hash_set<uint64_t> disk_cached_chunk_keys_
+        ABSL_GUARDED_BY(mu_);
+
+    // Negotiated through `SampleStreamRequest.chunk_cache_size`; -1 until
+    // the first request has been seen, fixed for the remainder of the stream.
+    int chunk_cache_size_ ABSL_GUARDED_BY(mu_) = -1;
+
+    // Keys of the chunks the client's stream cache holds, most recently sent
+    // first, with an index for O(1) lookup. See `TouchSentChunk`.
+    std::list<uint64_t> sent_chunks_lru_ ABSL_GUARDED_BY(mu_);
+    internal::flat_hash_map<uint64_t, std::list<uint64_t>::iterator>
+        sent_chunks_index_ ABSL_GUARDED_BY(mu_);
+
+    // Arena chunk payloads are placed in when the stream requested out of
+    // band transport (see `SampleStreamRequest.shm_transport`); nullptr when
+    // the stream did not (or the arena could not be created), in which case
+    // payloads are inlined. Scratch buffer reused for serializing chunks
+    // into the arena.
+    std::shared_ptr<internal::ShmArena> shm_arena_ ABSL_GUARDED_BY(mu_);
+    std::string shm_scratch_ ABSL_GUARDED_BY(mu_);
+
+    // Set on the first request when it names a multicast group; fixed for the
+    // remainder of the stream.
+    std::shared_ptr<MulticastSampleGroup> multicast_group_ ABSL_GUARDED_BY(mu_);
+    std::string multicast_group_key_ ABSL_GUARDED_BY(mu_);
+
+    // Callback called by the multicast group when a shared batch is ready.
+    std::shared_ptr<MulticastSampleGroup::BatchCallback> batch_ready_;
+
     // Callback called by the table worker when current sampling batch is done.
     std::shared_ptr<SamplingCallback> sampling_done_;
 
@@ -680,6 +1570,14 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
     // currently being constructed.
     int64_t current_response_size_bytes_ ABSL_GUARDED_BY(mu_);
 
+    // Response size at which the response is cut and flushed to the stream.
+    // Adapted per stream by `AdaptFlushThreshold` and capped to twice the
+    // sampled table's response size.
+    int64_t flush_threshold_bytes_ ABSL_GUARDED_BY(mu_) =
+        2 * Table::kMaxSampleResponseSizeBytes;
+    int64_t max_flush_threshold_bytes_ ABSL_GUARDED_BY(mu_) =
+        2 * Table::kMaxSampleResponseSizeBytes;
+
     // True if the reactor is awaiting the result of a sampling request already
     // enqueued in the target table.
     bool waiting_for_enqueued_sample_ ABSL_GUARDED_BY(mu_);
@@ -690,12 +1588,53 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
 
 std::shared_ptr<Table> ReverbServiceImpl::TableByName(
     absl::string_view name) const {
+  absl::ReaderMutexLock lock(&tables_mu_);
   auto it = tables_.find(name);
   if (it == tables_.end()) return nullptr;
   return it->second;
 }
 
+std::shared_ptr<MulticastSampleGroup> ReverbServiceImpl::GetOrCreateSampleGroup(
+    const std::string& key, std::shared_ptr<Table> table) const {
+  absl::MutexLock lock(&sample_groups_mu_);
+  auto it = sample_groups_.find(key);
+  if (it == sample_groups_.end()) {
+    it = sample_groups_
+             .emplace(key,
+                      std::make_shared<MulticastSampleGroup>(std::move(table)))
+             .first;
+  }
+  return it->second;
+}
+
+std::shared_ptr<internal::ShmArena> ReverbServiceImpl::GetOrCreateShmArena()
+    const {
+  absl::MutexLock lock(&shm_mu_);
+  if (shm_arena_ != nullptr || shm_arena_failed_) {
+    return shm_arena_;
+  }
+  // The name is unique per server instance so restarted servers never
+  // collide with an arena a lingering client still has mapped.
+  absl::BitGen gen;
+  const std::string name = absl::StrCat("/reverb_shm_", getpid(), "_",
+                                        absl::Uniform<uint64_t>(gen));
+  std::unique_ptr<internal::ShmArena> arena;
+  if (absl::Status status =
+          internal::ShmArena::Create(name, kShmArenaBytes, &arena);
+      !status.ok()) {
+    REVERB_LOG(REVERB_WARNING)
+        << "Failed to create shared memory arena; sample streams requesting "
+           "out of band transport will fall back to inline payloads: "
+        << status.ToString();
+    shm_arena_failed_ = true;
+    return nullptr;
+  }
+  shm_arena_ = std::move(arena);
+  return shm_arena_;
+}
+
 void ReverbServiceImpl::Close() {
+  absl::ReaderMutexLock lock(&tables_mu_);
   for (auto& table : tables_) {
     table.second->Close();
   }
@@ -703,6 +1642,7 @@ void ReverbServiceImpl::Close() {
 
 std::string ReverbServiceImpl::DebugString() const {
   std::string str = "ReverbServiceAsync(tables=[";
+  absl::ReaderMutexLock lock(&tables_mu_);
   for (auto iter = tables_.cbegin(); iter != tables_.cend(); ++iter) {
     if (iter != tables_.cbegin()) {
       absl::StrAppend(&str, ", ");
@@ -719,6 +1659,7 @@ grpc::ServerUnaryReactor* ReverbServiceImpl::ServerInfo(
     grpc::CallbackServerContext* context, const ServerInfoRequest* request,
     ServerInfoResponse* response) {
   grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  absl::ReaderMutexLock lock(&tables_mu_);
   for (const auto& iter : tables_) {
     *response->add_table_info() = iter.second->info();
   }
@@ -727,8 +1668,190 @@ grpc::ServerUnaryReactor* ReverbServiceImpl::ServerInfo(
   return reactor;
 }
 
+namespace {
+
+// Pushes incremental `TableInfo` diffs to one `ServerInfoStream` subscriber.
+// The reactor owns a thread which wakes up at the requested cadence, reads
+// the atomically published info of every subscribed table and writes a
+// response when anything changed. Changes are detected by comparing the
+// serialized info against the last pushed version, so watching an idle table
+// costs a serialization per tick and no bytes on the wire.
+class ServerInfoStreamReactor
+    : public grpc::ServerWriteReactor<ServerInfoStreamResponse> {
+ public:
+  ServerInfoStreamReactor(std::vector<std::shared_ptr<Table>> tables,
+                          absl::uint128 tables_state_id,
+                          absl::Duration interval)
+      : tables_(std::move(tables)),
+        tables_state_id_(tables_state_id),
+        interval_(interval) {
+    worker_ = internal::StartThread("ServerInfoStream", [this] { Run(); });
+  }
+
+  ~ServerInfoStreamReactor() override {
+    // Join the push thread before the members it reads are destroyed.
+    worker_ = nullptr;
+  }
+
+  void OnWriteDone(bool ok) override {
+    absl::MutexLock lock(&mu_);
+    write_ok_ = ok;
+    write_done_ = true;
+  }
+
+  void OnCancel() override {
+    absl::MutexLock lock(&mu_);
+    cancelled_ = true;
+  }
+
+  void OnDone() override { delete this; }
+
+ private:
+  void Run() {
+    std::vector<std::string> last_sent(tables_.size());
+    while (true) {
+      response_.Clear();
+      for (size_t i = 0; i < tables_.size(); i++) {
+        TableInfo info = tables_[i]->info();
+        std::string serialized = info.SerializeAsString();
+        if (serialized != last_sent[i]) {
+          last_sent[i] = std::move(serialized);
+          *response_.add_table_info() = std::move(info);
+        }
+      }
+      if (!response_.table_info().empty()) {
+        *response_.mutable_tables_state_id() =
+            Uint128ToMessage(tables_state_id_);
+        {
+          absl::MutexLock lock(&mu_);
+          write_done_ = false;
+        }
+        StartWrite(&response_);
+        absl::MutexLock lock(&mu_);
+        // A cancelled stream completes the pending write with `ok == false`
+        // so waiting for the write alone cannot hang.
+        mu_.Await(absl::Condition(&write_done_));
+        if (!write_ok_) break;
+      }
+      absl::MutexLock lock(&mu_);
+      if (mu_.AwaitWithTimeout(absl::Condition(&cancelled_), interval_)) {
+        break;
+      }
+    }
+    // Subscriptions only end when the subscriber goes away.
+    Finish(grpc::Status::CANCELLED);
+  }
+
+  const std::vector<std::shared_ptr<Table>> tables_;
+  const absl::uint128 tables_state_id_;
+  const absl::Duration interval_;
+
+  // Response currently handed to `StartWrite`. Only touched by the push
+  // thread while no write is in flight.
+  ServerInfoStreamResponse response_;
+
+  absl::Mutex mu_;
+  bool write_done_ ABSL_GUARDED_BY(mu_) = false;
+  bool write_ok_ ABSL_GUARDED_BY(mu_) = true;
+  bool cancelled_ ABSL_GUARDED_BY(mu_) = false;
+
+  std::unique_ptr<internal::Thread> worker_;
+};
+
+}  // namespace
+
+grpc::ServerWriteReactor<ServerInfoStreamResponse>*
+ReverbServiceImpl::ServerInfoStream(grpc::CallbackServerContext* context,
+                                    const ServerInfoStreamRequest* request) {
+  std::vector<std::shared_ptr<Table>> tables;
+  if (request->table_names().empty()) {
+    absl::ReaderMutexLock lock(&tables_mu_);
+    tables.reserve(tables_.size());
+    for (const auto& entry : tables_) {
+      tables.push_back(entry.second);
+    }
+  } else {
+    for (const auto& name : request->table_names()) {
+      auto table = TableByName(name);
+      if (table == nullptr) {
+        class FailedReactor
+            : public grpc::ServerWriteReactor<ServerInfoStreamResponse> {
+         public:
+          explicit FailedReactor(grpc::Status status) {
+            Finish(std::move(status));
+          }
+          void OnDone() override { delete this; }
+        };
+        return new FailedReactor(TableNotFound(name));
+      }
+      tables.push_back(std::move(table));
+    }
+  }
+  const absl::Duration interval =
+      request->min_interval_ms() > 0
+          ? absl::Milliseconds(request->min_interval_ms())
+          : absl::Seconds(1);
+  absl::ReaderMutexLock lock(&tables_mu_);
+  return new ServerInfoStreamReactor(std::move(tables), tables_state_id_,
+                                     interval);
+}
+
+grpc::ServerUnaryReactor* ReverbServiceImpl::TableWatermarks(
+    grpc::CallbackServerContext* context, const TableWatermarksRequest* request,
+    TableWatermarksResponse* response) {
+  grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  if (request->table_names().empty()) {
+    absl::ReaderMutexLock lock(&tables_mu_);
+    for (const auto& entry : tables_) {
+      auto* watermark = response->add_watermarks();
+      watermark->set_table_name(entry.first);
+      watermark->set_current_size(entry.second->size());
+      watermark->set_num_episodes(entry.second->num_episodes());
+    }
+  } else {
+    for (const auto& name : request->table_names()) {
+      std::shared_ptr<Table> table = TableByName(name);
+      if (table == nullptr) {
+        reactor->Finish(TableNotFound(name));
+        return reactor;
+      }
+      auto* watermark = response->add_watermarks();
+      watermark->set_table_name(name);
+      watermark->set_current_size(table->size());
+      watermark->set_num_episodes(table->num_episodes());
+    }
+  }
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* ReverbServiceImpl::TraceDump(
+    grpc::CallbackServerContext* context, const TraceDumpRequest* request,
+    TraceDumpResponse* response) {
+  grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  // Timestamps are recorded in cycle counter ticks; convert them to seconds
+  // relative to "now" so the client does not have to know the tick rate.
+  const int64_t now_cycles = internal::TraceNowCycles();
+  for (const auto& thread : internal::SnapshotTraceEvents()) {
+    auto* thread_proto = response->add_threads();
+    thread_proto->set_thread_id(thread.thread_id);
+    for (const auto& event : thread.events) {
+      auto* event_proto = thread_proto->add_events();
+      event_proto->set_stage(event.stage);
+      event_proto->set_start_time(
+          internal::TraceCyclesToSeconds(event.start_cycles - now_cycles));
+      event_proto->set_duration(
+          internal::TraceCyclesToSeconds(event.end_cycles -
+                                         event.start_cycles));
+    }
+  }
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
 internal::flat_hash_map<std::string, std::shared_ptr<Table>>
 ReverbServiceImpl::tables() const {
+  absl::ReaderMutexLock lock(&tables_mu_);
   return tables_;
 }
 
@@ -18,10 +18,12 @@
 #include <memory>
 
 #include "grpcpp/grpcpp.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/numeric/int128.h"
 #include "absl/random/random.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "reverb/cc/checkpointing/interface.h"
 #include "reverb/cc/task_worker.h"
@@ -30,12 +32,17 @@
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/support/periodic_closure.h"
+#include "reverb/cc/support/shm_arena.h"
+#include "reverb/cc/support/task_executor.h"
 #include "reverb/cc/support/unbounded_queue.h"
 #include "reverb/cc/table.h"
+#include "reverb/cc/writer_chunk_cache.h"
 
 namespace deepmind {
 namespace reverb {
 
+class MulticastSampleGroup;
+
 // Implements ReverbService asynchronously. See reverb_service.proto for
 // documentation.
 class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService {
@@ -53,37 +60,58 @@ class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService
                                        const CheckpointRequest* request,
                                        CheckpointResponse* response) override;
 
-  // The InsertStream call schedules items to be inserted and to send back
-  // confirmation when requested.
-  // 1. The Reactor starts waiting to read
-  // 2. Once the read has arrived, OnReadDone either adds a chunk or schedules
-  // an item to be inserted.
-  // 3. After a read is done, it will start a new read if the number of pending
-  // tasks in the InsertWorker is below max_queue_size_to_warn. Reads will be
-  // resumed once an insertion task is completed if there are no reads
-  // in-flight and there is enough free space in the InsertWorker queue.
-  //
-  // Once an insertion task is completed, the reactor writes confirmations of
-  // inserted messages.
+  grpc::ServerUnaryReactor* ImportCheckpoint(
+      grpc::CallbackServerContext* context,
+      const ImportCheckpointRequest* request,
+      ImportCheckpointResponse* response) override;
+
+  // Clones a live table into a new table hosted by this server. The clone
+  // shares all chunk data with the source (see `Table::Fork`), so only item
+  // metadata and selector state are copied.
+  grpc::ServerUnaryReactor* ForkTable(grpc::CallbackServerContext* context,
+                                      const ForkTableRequest* request,
+                                      ForkTableResponse* response) override;
+
+  // Moves the items of a key range from one table to another without copying
+  // chunk data (see `Table::MoveItemsTo`).
+  grpc::ServerUnaryReactor* MoveItems(grpc::CallbackServerContext* context,
+                                      const MoveItemsRequest* request,
+                                      MoveItemsResponse* response) override;
+
+  // The InsertStream call stores incoming chunks and enqueues items onto the
+  // target tables, sending back confirmations as the inserts complete. The
+  // whole call runs on the gRPC callback API, so an open stream costs a small
+  // reactor object rather than a dedicated thread; thousands of idle or
+  // reconnecting actors only consume memory proportional to their queued
+  // work.
+  // 1. The reactor starts waiting to read.
+  // 2. Once a message arrives, OnReadDone stores its chunks and enqueues its
+  // items onto the target tables (consecutive items for the same table as one
+  // batch). The tables apply the inserts on their own workers.
+  // 3. A new read is started right away if the table reports that its pending
+  // insert queue has space left (`can_insert_more`). Otherwise reads resume
+  // from the insert-completed callback once queued inserts have drained, so a
+  // slow table exerts backpressure on its writers instead of buffering
+  // unboundedly.
   //
-  // Once the reactor is done, it waits for all the items to be inserted before
-  // destroying itself. If the reactor is cancelled, pending items won't be
-  // inserted but we still need to wait for the insert worker to dequeue them
-  // from its tasks list.
+  // The insert-completed callback also appends the key of each inserted item
+  // to the next confirmation response, writing whenever no other write is in
+  // flight.
   //
-  // Note on blocking reads when the Worker queue is almost full:
-  // 1. We cannot block a new reactor because it is unaware of the InsertWorker
-  // state until it has scheduled its first insertion (after which, it will stor
-  // reading until there is empty space).
-  // 2. When reads are blocked, inserting new chunks gets blocked as well. This
-  // is intended as it limits the memory usage when we have many (blocked)
-  // connections and pending items to be inserted.
-  // 3. When the last scheduled insertion runs, we reactivate the reads even if
-  // the number of items in the queue exceeds max_queue_size_to_read as it is
-  // the last opportunity we have to resume reads.
+  // When the reactor is done it waits until no insert-completed callback can
+  // be in flight anymore before destroying itself; inserts that were already
+  // enqueued on a table complete on the table worker regardless.
   grpc::ServerBidiReactor<InsertStreamRequest, InsertStreamResponse>*
   InsertStream(grpc::CallbackServerContext* context) override;
 
+  // Answers which of the provided chunk keys are still held in the per-writer
+  // cache of recently received chunks, so a writer that reconnects after a
+  // broken stream can skip retransmitting them.
+  grpc::ServerUnaryReactor* QueryReceivedChunks(
+      grpc::CallbackServerContext* context,
+      const QueryReceivedChunksRequest* request,
+      QueryReceivedChunksResponse* response) override;
+
   grpc::ServerUnaryReactor* MutatePriorities(
       grpc::CallbackServerContext* context,
       const MutatePrioritiesRequest* request,
@@ -93,6 +121,11 @@ class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService
                                   const ResetRequest* request,
                                   ResetResponse* response) override;
 
+  grpc::ServerUnaryReactor* SetPriorityExponent(
+      grpc::CallbackServerContext* context,
+      const SetPriorityExponentRequest* request,
+      SetPriorityExponentResponse* response) override;
+
   // The SampleStream call preserves the behavior of the synchronous
   // implementation.
   // 1. The Reactor starts waiting for a request.
@@ -113,6 +146,28 @@ class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService
                                        const ServerInfoRequest* request,
                                        ServerInfoResponse* response) override;
 
+  // Pushes incremental `TableInfo` diffs at the cadence requested by the
+  // subscriber; see `ServerInfoStreamRequest`. Each subscription is served by
+  // a small dedicated thread reading the atomically published table
+  // statistics, so open subscriptions never contend with the data path.
+  grpc::ServerWriteReactor<ServerInfoStreamResponse>* ServerInfoStream(
+      grpc::CallbackServerContext* context,
+      const ServerInfoStreamRequest* request) override;
+
+  // Reads the wait-free size watermarks of the requested tables; see
+  // `TableWatermarksRequest`. Only touches atomically published counters so
+  // high frequency polling never contends with the data path.
+  grpc::ServerUnaryReactor* TableWatermarks(
+      grpc::CallbackServerContext* context,
+      const TableWatermarksRequest* request,
+      TableWatermarksResponse* response) override;
+
+  // Dumps the per-thread trace rings of hot-path stage timings. See
+  // `reverb/cc/support/trace.h` for the instrumentation itself.
+  grpc::ServerUnaryReactor* TraceDump(grpc::CallbackServerContext* context,
+                                      const TraceDumpRequest* request,
+                                      TraceDumpResponse* response) override;
+
   grpc::ServerBidiReactor<InitializeConnectionRequest,
                           InitializeConnectionResponse>*
   InitializeConnection(grpc::CallbackServerContext* context) override;
@@ -135,19 +190,62 @@ class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService
   // Lookups the table for a given name. Returns nullptr if not found.
   std::shared_ptr<Table> TableByName(absl::string_view name) const;
 
+  // Returns the shared sampling pipeline registered under `key`, creating it
+  // if this is the first subscriber. Groups live for the remainder of the
+  // server's lifetime; an idle group holds no sampled data.
+  std::shared_ptr<MulticastSampleGroup> GetOrCreateSampleGroup(
+      const std::string& key, std::shared_ptr<Table> table) const;
+
+  // Returns the server's shared memory arena for out of band chunk
+  // transport (see `SampleStreamRequest.shm_transport`), creating it on
+  // first use. Returns nullptr when the arena cannot be created (e.g. the
+  // platform lacks POSIX shared memory); the failure is logged once and
+  // such streams fall back to inline payloads.
+  std::shared_ptr<internal::ShmArena> GetOrCreateShmArena() const;
+
   // Checkpointer used to restore state in the constructor and to save data
   // when `Checkpoint` is called. Note that if `checkpointer_` is nullptr then
   // `Checkpoint` will return an `InvalidArgumentError`.
   std::shared_ptr<Checkpointer> checkpointer_;
 
-  // Priority tables.
-  internal::flat_hash_map<std::string, std::shared_ptr<Table>> tables_;
+  // Priority tables. Only `ForkTable` mutates the map after initialization,
+  // so lookups on the data path pay a reader lock at stream setup and
+  // nothing per message.
+  mutable absl::Mutex tables_mu_;
+  internal::flat_hash_map<std::string, std::shared_ptr<Table>> tables_
+      ABSL_GUARDED_BY(tables_mu_);
+
+  // Callback executors shared by all tables. Kept so that tables created
+  // after initialization (`ForkTable`) get the same executors as the tables
+  // the server started with.
+  std::shared_ptr<TaskExecutor> callback_executor_;
+  std::shared_ptr<TaskExecutor> insert_callback_executor_;
+
+  // Sampling pipelines shared by groups of `SampleStream` calls, keyed by
+  // "<table>/<group>". See `SampleStreamRequest.multicast_group`.
+  mutable absl::Mutex sample_groups_mu_;
+  mutable internal::flat_hash_map<std::string,
+                                  std::shared_ptr<MulticastSampleGroup>>
+      sample_groups_ ABSL_GUARDED_BY(sample_groups_mu_);
+
+  // Chunks recently received on `InsertStream` calls, keyed by writer
+  // identity. Lets a writer that reconnects after a broken stream skip
+  // retransmitting chunks the server still holds.
+  WriterChunkCache writer_chunk_cache_;
+
+  // Shared memory arena holding chunk payloads shipped out of band to same
+  // host clients; created lazily by `GetOrCreateShmArena`. Shared by all
+  // `SampleStream` calls that request shm transport.
+  mutable absl::Mutex shm_mu_;
+  mutable std::shared_ptr<internal::ShmArena> shm_arena_
+      ABSL_GUARDED_BY(shm_mu_);
+  mutable bool shm_arena_failed_ ABSL_GUARDED_BY(shm_mu_) = false;
 
   absl::BitGen rnd_;
 
   // A new id must be generated whenever a table is added, deleted, or has its
   // signature modified.
-  absl::uint128 tables_state_id_;
+  absl::uint128 tables_state_id_ ABSL_GUARDED_BY(tables_mu_);
 };
 
 
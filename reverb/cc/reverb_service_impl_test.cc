@@ -14,6 +14,7 @@
 
 #include "reverb/cc/reverb_service_impl.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cstddef>
 #include <list>
@@ -45,7 +46,10 @@
 #include "reverb/cc/selectors/fifo.h"
 #include "reverb/cc/selectors/interface.h"
 #include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/support/trajectory_util.h"
+#include "reverb/cc/tensor_compression.h"
 #include "reverb/cc/testing/proto_test_util.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/protobuf/struct.pb.h"
@@ -83,6 +87,8 @@ class FakeSelector : public ItemSelector {
 
   KeyWithProbability Sample() override { return {1, 1}; }
 
+  double TotalWeight() const override { return 1; }
+
   void Clear() override{};
 
   KeyDistributionOptions options() const override {
@@ -244,6 +250,13 @@ TEST(ReverbServiceImplTest, SampleAfterInsertWorks) {
         ->mutable_info()
         ->mutable_item()
         ->set_times_sampled(2 * i + 2);
+    // The server side timing fields are wall clock measurements and thus not
+    // deterministic across entries.
+    for (auto& entry : *sample_response.mutable_entries()) {
+      entry.mutable_info()->clear_queued_for_secs();
+      entry.mutable_info()->clear_rate_limiter_wait_secs();
+      entry.mutable_info()->clear_serialize_time_secs();
+    }
     EXPECT_THAT(sample_response.entries(0),
                 testing::EqualsProto(sample_response.entries(1)));
     SampleInfo info = sample_response.entries(0).info();
@@ -262,6 +275,434 @@ TEST(ReverbServiceImplTest, SampleAfterInsertWorks) {
   }
 }
 
+TEST(ReverbServiceImplTest, SampleChunkCacheSendsRepeatedChunksAsReferences) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+  ASSERT_TRUE(insert_stream->Write(InsertMultiChunkRequest({1, 2})));
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Write(InsertChunkRequest(3)));
+  ASSERT_TRUE(insert_stream->Write(InsertItemRequest("dist", {2, 3})));
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  grpc::ClientContext sample_context;
+  auto sample_stream = stub.SampleStream(&sample_context);
+  SampleStreamRequest sample_request = SampleRequest("dist", 2);
+  sample_request.set_chunk_cache_size(4);
+  SampleStreamResponse sample_response;
+  sample_stream->Write(sample_request);
+  sample_stream->WritesDone();
+  ASSERT_TRUE(sample_stream->Read(&sample_response));
+  REVERB_EXPECT_OK(sample_stream->Finish());
+
+  ASSERT_EQ(sample_response.entries_size(), 2);
+  // The first sample carries the chunk payloads and seeds both caches.
+  ASSERT_EQ(sample_response.entries(0).data_size(), 2);
+  for (const auto& chunk : sample_response.entries(0).data()) {
+    EXPECT_FALSE(chunk.payload_cached());
+  }
+  // The second sample references the same chunks so only bare references are
+  // streamed.
+  ASSERT_EQ(sample_response.entries(1).data_size(), 2);
+  for (int i = 0; i < 2; i++) {
+    EXPECT_TRUE(sample_response.entries(1).data(i).payload_cached());
+    EXPECT_EQ(sample_response.entries(1).data(i).chunk_key(),
+              sample_response.entries(0).data(i).chunk_key());
+  }
+}
+
+TEST(ReverbServiceImplTest, SampleDiskCachedChunksSentAsReferences) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+  ASSERT_TRUE(insert_stream->Write(InsertMultiChunkRequest({1, 2})));
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Write(InsertChunkRequest(3)));
+  ASSERT_TRUE(insert_stream->Write(InsertItemRequest("dist", {2, 3})));
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  grpc::ClientContext sample_context;
+  auto sample_stream = stub.SampleStream(&sample_context);
+  SampleStreamRequest sample_request = SampleRequest("dist", 1);
+  // The client announces that it holds chunk 2 on disk; chunk 3 is unknown.
+  sample_request.add_disk_cached_chunk_keys(2);
+  SampleStreamResponse sample_response;
+  sample_stream->Write(sample_request);
+  sample_stream->WritesDone();
+  ASSERT_TRUE(sample_stream->Read(&sample_response));
+  REVERB_EXPECT_OK(sample_stream->Finish());
+
+  ASSERT_EQ(sample_response.entries_size(), 1);
+  ASSERT_EQ(sample_response.entries(0).data_size(), 2);
+  // The disk cached chunk arrives as a bare reference while the unknown one
+  // carries its payload.
+  EXPECT_EQ(sample_response.entries(0).data(0).chunk_key(), 2);
+  EXPECT_TRUE(sample_response.entries(0).data(0).payload_cached());
+  EXPECT_EQ(sample_response.entries(0).data(1).chunk_key(), 3);
+  EXPECT_FALSE(sample_response.entries(0).data(1).payload_cached());
+  // The item metadata is transmitted fresh even though a payload was not.
+  EXPECT_TRUE(sample_response.entries(0).info().has_item());
+}
+
+TEST(ReverbServiceImplTest, SampleChunkCacheCannotChangeWithinStream) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+  ASSERT_TRUE(insert_stream->Write(InsertChunkRequest(1)));
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Write(InsertItemRequest("dist", {1})));
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  grpc::ClientContext sample_context;
+  auto sample_stream = stub.SampleStream(&sample_context);
+  SampleStreamRequest sample_request = SampleRequest("dist", 1);
+  sample_request.set_chunk_cache_size(4);
+  ASSERT_TRUE(sample_stream->Write(sample_request));
+  SampleStreamResponse sample_response;
+  ASSERT_TRUE(sample_stream->Read(&sample_response));
+  // Resizing the cache mid-stream would desynchronize the two ends.
+  sample_request.set_chunk_cache_size(8);
+  sample_stream->Write(sample_request);
+  EXPECT_EQ(sample_stream->Finish().error_code(),
+            grpc::StatusCode::INVALID_ARGUMENT);
+}
+
+TEST(ReverbServiceImplTest, SampleSubsequenceReturnsRandomWindow) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+  ASSERT_TRUE(insert_stream->Write(InsertMultiChunkRequest({1, 2})));
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Write(InsertChunkRequest(3)));
+
+  // The inserted episode spans 100 steps split over two chunks of 50.
+  InsertStreamRequest insert_request = InsertItemRequest("dist", {2, 3});
+  ASSERT_TRUE(insert_stream->Write(insert_request));
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  for (int i = 0; i < 10; i++) {
+    grpc::ClientContext sample_context;
+    auto sample_stream = stub.SampleStream(&sample_context);
+    SampleStreamRequest sample_request = SampleRequest("dist", 1);
+    sample_request.mutable_subsequence()->set_length(10);
+    SampleStreamResponse sample_response;
+    sample_stream->Write(sample_request);
+    sample_stream->WritesDone();
+    ASSERT_TRUE(sample_stream->Read(&sample_response));
+    REVERB_EXPECT_OK(sample_stream->Finish());
+
+    // The returned trajectory references exactly the requested window.
+    const auto& trajectory =
+        sample_response.entries(0).info().item().flat_trajectory();
+    ASSERT_TRUE(internal::IsTimestepTrajectory(trajectory));
+    EXPECT_EQ(internal::TimestepTrajectoryLength(trajectory), 10);
+
+    // Only the chunks overlapping the window are streamed.
+    const std::vector<uint64_t> window_keys =
+        internal::GetChunkKeys(trajectory);
+    ASSERT_EQ(sample_response.entries(0).data_size(), window_keys.size());
+    for (int j = 0; j < window_keys.size(); j++) {
+      EXPECT_EQ(sample_response.entries(0).data(j).chunk_key(),
+                window_keys[j]);
+    }
+  }
+}
+
+TEST(ReverbServiceImplTest, SampleWithColumnProjectionStreamsOnlyKeptChunks) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+  ASSERT_TRUE(insert_stream->Write(InsertMultiChunkRequest({1, 2})));
+
+  // Item with two columns stored in separate chunks: column 0 in chunk 1 and
+  // column 1 in chunk 2.
+  InsertStreamRequest insert_request;
+  PrioritizedItem* item = insert_request.add_items();
+  item->set_key(nextId++);
+  item->set_table("dist");
+  for (int column = 0; column < 2; column++) {
+    auto* slice =
+        item->mutable_flat_trajectory()->add_columns()->add_chunk_slices();
+    slice->set_chunk_key(column + 1);
+    slice->set_index(column);
+    slice->set_offset(0);
+    slice->set_length(100);
+  }
+  ASSERT_TRUE(insert_stream->Write(insert_request));
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  {
+    grpc::ClientContext sample_context;
+    auto sample_stream = stub.SampleStream(&sample_context);
+    SampleStreamRequest sample_request = SampleRequest("dist", 1);
+    sample_request.add_columns(1);
+    SampleStreamResponse sample_response;
+    sample_stream->Write(sample_request);
+    sample_stream->WritesDone();
+    ASSERT_TRUE(sample_stream->Read(&sample_response));
+    REVERB_EXPECT_OK(sample_stream->Finish());
+
+    // Only column 1 and the single chunk it references are returned.
+    const auto& trajectory =
+        sample_response.entries(0).info().item().flat_trajectory();
+    ASSERT_EQ(trajectory.columns_size(), 1);
+    EXPECT_EQ(trajectory.columns(0).chunk_slices(0).index(), 1);
+    ASSERT_EQ(sample_response.entries(0).data_size(), 1);
+    EXPECT_EQ(sample_response.entries(0).data(0).chunk_key(), 2);
+  }
+
+  {
+    grpc::ClientContext sample_context;
+    auto sample_stream = stub.SampleStream(&sample_context);
+    SampleStreamRequest sample_request = SampleRequest("dist", 1);
+    sample_request.add_columns(7);
+    SampleStreamResponse sample_response;
+    sample_stream->Write(sample_request);
+    sample_stream->WritesDone();
+    ASSERT_TRUE(sample_stream->Read(&sample_response));
+    REVERB_EXPECT_OK(sample_stream->Finish());
+
+    // None of the requested columns exist so the item is returned whole.
+    EXPECT_EQ(
+        sample_response.entries(0).info().item().flat_trajectory()
+            .columns_size(),
+        2);
+    EXPECT_EQ(sample_response.entries(0).data_size(), 2);
+  }
+}
+
+TEST(ReverbServiceImplTest, SampleSubsequenceLongerThanItemReturnsWholeItem) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+  ASSERT_TRUE(insert_stream->Write(InsertMultiChunkRequest({1, 2})));
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Write(InsertChunkRequest(3)));
+
+  InsertStreamRequest insert_request = InsertItemRequest("dist", {2, 3});
+  ASSERT_TRUE(insert_stream->Write(insert_request));
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  grpc::ClientContext sample_context;
+  auto sample_stream = stub.SampleStream(&sample_context);
+  SampleStreamRequest sample_request = SampleRequest("dist", 1);
+  sample_request.mutable_subsequence()->set_length(1000);
+  SampleStreamResponse sample_response;
+  sample_stream->Write(sample_request);
+  sample_stream->WritesDone();
+  ASSERT_TRUE(sample_stream->Read(&sample_response));
+  REVERB_EXPECT_OK(sample_stream->Finish());
+
+  // The episode is shorter than the window so it is returned whole.
+  const auto& trajectory =
+      sample_response.entries(0).info().item().flat_trajectory();
+  EXPECT_EQ(internal::TimestepTrajectoryLength(trajectory), 100);
+  EXPECT_EQ(sample_response.entries(0).data_size(), 2);
+}
+
+TEST(ReverbServiceImplTest, SampleNStepReturnsTransitionWithFoldedReward) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+
+  // A five step episode with an observation column and a scalar reward
+  // column, both stored in a single chunk.
+  tensorflow::Tensor observations(tensorflow::DT_FLOAT, {5});
+  tensorflow::Tensor rewards(tensorflow::DT_FLOAT, {5});
+  for (int i = 0; i < 5; i++) {
+    observations.flat<float>()(i) = 10 * (i + 1);
+    rewards.flat<float>()(i) = i + 1;
+  }
+  InsertStreamRequest chunk_request;
+  auto* chunk = chunk_request.add_chunks();
+  chunk->set_chunk_key(1);
+  CompressTensorAsProto(observations, chunk->mutable_data()->add_tensors());
+  CompressTensorAsProto(rewards, chunk->mutable_data()->add_tensors());
+  chunk->set_data_tensors_len(2);
+  ASSERT_TRUE(insert_stream->Write(chunk_request));
+
+  InsertStreamRequest insert_request;
+  PrioritizedItem* item = insert_request.add_items();
+  item->set_key(nextId++);
+  item->set_table("dist");
+  for (int column = 0; column < 2; column++) {
+    auto* slice =
+        item->mutable_flat_trajectory()->add_columns()->add_chunk_slices();
+    slice->set_chunk_key(1);
+    slice->set_index(column);
+    slice->set_offset(0);
+    slice->set_length(5);
+  }
+  ASSERT_TRUE(insert_stream->Write(insert_request));
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  for (int i = 0; i < 10; i++) {
+    grpc::ClientContext sample_context;
+    auto sample_stream = stub.SampleStream(&sample_context);
+    SampleStreamRequest sample_request = SampleRequest("dist", 1);
+    sample_request.mutable_nstep()->set_num_steps(2);
+    sample_request.mutable_nstep()->set_reward_column(1);
+    sample_request.mutable_nstep()->set_discount(0.5);
+    SampleStreamResponse sample_response;
+    sample_stream->Write(sample_request);
+    sample_stream->WritesDone();
+    ASSERT_TRUE(sample_stream->Read(&sample_response));
+    REVERB_EXPECT_OK(sample_stream->Finish());
+
+    // The observation column references exactly steps t and t+2 while the
+    // reward column was replaced by a single synthesized step.
+    const auto& trajectory =
+        sample_response.entries(0).info().item().flat_trajectory();
+    ASSERT_EQ(trajectory.columns_size(), 2);
+    ASSERT_EQ(trajectory.columns(0).chunk_slices_size(), 2);
+    const int start = trajectory.columns(0).chunk_slices(0).offset();
+    EXPECT_GE(start, 0);
+    EXPECT_LE(start, 2);
+    EXPECT_EQ(trajectory.columns(0).chunk_slices(0).length(), 1);
+    EXPECT_EQ(trajectory.columns(0).chunk_slices(1).offset(), start + 2);
+    EXPECT_EQ(trajectory.columns(0).chunk_slices(1).length(), 1);
+    ASSERT_EQ(trajectory.columns(1).chunk_slices_size(), 1);
+    EXPECT_EQ(trajectory.columns(1).chunk_slices(0).length(), 1);
+
+    // The stored chunk is followed by the synthesized return chunk, keyed to
+    // match the rewritten reward column.
+    ASSERT_EQ(sample_response.entries_size(), 1);
+    ASSERT_EQ(sample_response.entries(0).data_size(), 2);
+    EXPECT_EQ(sample_response.entries(0).data(0).chunk_key(), 1);
+    const auto& synthesized = sample_response.entries(0).data(1);
+    EXPECT_EQ(synthesized.chunk_key(),
+              trajectory.columns(1).chunk_slices(0).chunk_key());
+    ASSERT_EQ(synthesized.data().tensors_size(), 1);
+    tensorflow::Tensor returns =
+        DecompressTensorFromProto(synthesized.data().tensors(0));
+    ASSERT_EQ(returns.NumElements(), 1);
+    EXPECT_FLOAT_EQ(returns.flat<float>()(0),
+                    rewards.flat<float>()(start) +
+                        0.5 * rewards.flat<float>()(start + 1));
+  }
+}
+
+TEST(ReverbServiceImplTest, SampleNStepCannotBeCombinedWithSubsequence) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  grpc::ClientContext sample_context;
+  auto sample_stream = stub.SampleStream(&sample_context);
+  SampleStreamRequest sample_request = SampleRequest("dist", 1);
+  sample_request.mutable_nstep()->set_num_steps(2);
+  sample_request.mutable_subsequence()->set_length(10);
+  sample_stream->Write(sample_request);
+  EXPECT_EQ(sample_stream->Finish().error_code(),
+            grpc::StatusCode::INVALID_ARGUMENT);
+}
+
+TEST(ReverbServiceImplTest, MulticastGroupStreamsReceiveSharedBatches) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+  ASSERT_TRUE(insert_stream->Write(InsertChunkRequest(1)));
+  InsertStreamRequest insert_request = InsertItemRequest("dist", {1});
+  ASSERT_TRUE(insert_stream->Write(insert_request));
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  // Every subscriber of the group receives whole shared batches, so each
+  // stream sees at least the number of samples it asked for.
+  for (int replica = 0; replica < 2; replica++) {
+    grpc::ClientContext sample_context;
+    auto sample_stream = stub.SampleStream(&sample_context);
+    SampleStreamRequest sample_request = SampleRequest("dist", 1);
+    sample_request.set_multicast_group("replicas");
+    SampleStreamResponse sample_response;
+    sample_stream->Write(sample_request);
+    sample_stream->WritesDone();
+    ASSERT_TRUE(sample_stream->Read(&sample_response));
+    REVERB_EXPECT_OK(sample_stream->Finish());
+
+    ASSERT_GE(sample_response.entries_size(), 1);
+    for (const auto& entry : sample_response.entries()) {
+      EXPECT_EQ(entry.info().item().key(),
+                insert_request.items(0).key());
+      ASSERT_EQ(entry.data_size(), 1);
+      EXPECT_EQ(entry.data(0).chunk_key(), 1);
+      EXPECT_TRUE(entry.end_of_sequence());
+    }
+  }
+}
+
+TEST(ReverbServiceImplTest, MulticastGroupCannotBeCombinedWithProjection) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  grpc::ClientContext sample_context;
+  auto sample_stream = stub.SampleStream(&sample_context);
+  SampleStreamRequest sample_request = SampleRequest("dist", 1);
+  sample_request.set_multicast_group("replicas");
+  sample_request.add_columns(0);
+  SampleStreamResponse sample_response;
+  sample_stream->Write(sample_request);
+  sample_stream->WritesDone();
+  EXPECT_FALSE(sample_stream->Read(&sample_response));
+  EXPECT_EQ(sample_stream->Finish().error_code(),
+            grpc::StatusCode::INVALID_ARGUMENT);
+}
+
 TEST(ReverbServiceImplTest, InsertChunksWithoutItemWorks) {
   std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
   std::unique_ptr<grpc::Server> server(
@@ -404,6 +845,36 @@ TEST(ReverbServiceImplTest, InsertStreamRespondsWithItemKeys) {
   EXPECT_EQ(responses[1].keys(0), first_id + 1);
 }
 
+TEST(ReverbServiceImplTest, InsertStreamAcksSequenceNumbers) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  grpc::ClientContext context;
+  auto stream = stub.InsertStream(&context);
+  ASSERT_TRUE(stream->Write(InsertChunkRequest(1)));
+
+  InsertStreamRequest first_request = InsertItemRequest("dist", {1}, {1});
+  first_request.add_item_sequence_numbers(1);
+  ASSERT_TRUE(stream->Write(first_request));
+
+  InsertStreamRequest second_request = InsertItemRequest("dist", {1}, {});
+  second_request.add_item_sequence_numbers(2);
+  ASSERT_TRUE(stream->Write(second_request));
+
+  InsertStreamResponse responses[3];
+  ASSERT_TRUE(stream->Read(&responses[0]));
+  ASSERT_TRUE(stream->Read(&responses[1]));
+  ASSERT_TRUE(stream->WritesDone());
+  ASSERT_FALSE(stream->Read(&responses[2]));
+  REVERB_EXPECT_OK(stream->Finish());
+
+  EXPECT_EQ(responses[0].last_sequence_number(), 1);
+  EXPECT_EQ(responses[1].last_sequence_number(), 2);
+}
+
 TEST(ReverbServiceImplTest, SampleBlocksUntilEnoughInserts) {
   std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
   std::unique_ptr<grpc::Server> server(
@@ -526,6 +997,177 @@ TEST(ReverbServiceImplTest, ResetWorks) {
   EXPECT_EQ(service->tables()["dist"]->size(), 0);
 }
 
+TEST(ReverbServiceImplTest, SetPriorityExponentErrors) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  SetPriorityExponentRequest request;
+  SetPriorityExponentResponse response;
+
+  // Unknown tables are reported as such.
+  grpc::ClientContext not_found_context;
+  request.set_table("invalid");
+  request.set_priority_exponent(0.5);
+  EXPECT_EQ(
+      stub.SetPriorityExponent(&not_found_context, request, &response)
+          .error_code(),
+      grpc::StatusCode::NOT_FOUND);
+
+  // The test tables sample uniformly so they do not apply an exponent.
+  grpc::ClientContext failed_precondition_context;
+  request.set_table("dist");
+  EXPECT_EQ(
+      stub.SetPriorityExponent(&failed_precondition_context, request, &response)
+          .error_code(),
+      grpc::StatusCode::FAILED_PRECONDITION);
+}
+
+TEST(ReverbServiceImplTest, ForkTableSharesChunksWithSource) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  grpc::ClientContext context;
+  auto stream = stub.InsertStream(&context);
+  ASSERT_TRUE(stream->Write(InsertChunkRequest(1)));
+  ASSERT_TRUE(stream->Write(InsertItemRequest("dist", {1})));
+  InsertStreamResponse response;
+  ASSERT_TRUE(stream->Read(&response));
+  ASSERT_TRUE(stream->WritesDone());
+  REVERB_EXPECT_OK(stream->Finish());
+
+  WaitForTableSize(service->tables()["dist"].get(), 1);
+
+  ForkTableRequest fork_request;
+  fork_request.set_table("dist");
+  fork_request.set_new_table_name("dist_fork");
+  ForkTableResponse fork_response;
+  grpc::ClientContext fork_context;
+  REVERB_ASSERT_OK(stub.ForkTable(&fork_context, fork_request, &fork_response));
+  EXPECT_EQ(fork_response.num_items(), 1);
+
+  // The fork holds its own copy of the item but references the same chunk
+  // object as the source table.
+  auto tables = service->tables();
+  ASSERT_EQ(tables.count("dist_fork"), 1);
+  auto source_items = tables["dist"]->Copy();
+  auto forked_items = tables["dist_fork"]->Copy();
+  ASSERT_EQ(forked_items.size(), 1);
+  EXPECT_EQ(forked_items[0].item.key(), source_items[0].item.key());
+  ASSERT_EQ(forked_items[0].chunks.size(), 1);
+  EXPECT_EQ(forked_items[0].chunks[0].get(), source_items[0].chunks[0].get());
+
+  // The fork is served like any other table.
+  grpc::ClientContext sample_context;
+  auto sample_stream = stub.SampleStream(&sample_context);
+  ASSERT_TRUE(sample_stream->Write(SampleRequest("dist_fork", 1)));
+  ASSERT_TRUE(sample_stream->WritesDone());
+  SampleStreamResponse sample_response;
+  ASSERT_TRUE(sample_stream->Read(&sample_response));
+  EXPECT_EQ(sample_response.entries(0).info().item().key(),
+            source_items[0].item.key());
+  REVERB_EXPECT_OK(sample_stream->Finish());
+
+  // Forking to an existing name or from an unknown table fails.
+  ForkTableResponse failed_response;
+  grpc::ClientContext collision_context;
+  EXPECT_EQ(
+      stub.ForkTable(&collision_context, fork_request, &failed_response)
+          .error_code(),
+      grpc::StatusCode::ALREADY_EXISTS);
+  fork_request.set_table("invalid");
+  fork_request.set_new_table_name("another_fork");
+  grpc::ClientContext invalid_context;
+  EXPECT_EQ(stub.ForkTable(&invalid_context, fork_request, &failed_response)
+                .error_code(),
+            grpc::StatusCode::NOT_FOUND);
+}
+
+TEST(ReverbServiceImplTest, MoveItemsTransfersKeyRangeWithoutCopyingChunks) {
+  std::vector<std::shared_ptr<Table>> extra_tables;
+  extra_tables.push_back(std::make_shared<Table>(
+      /*name=*/"dist2",
+      /*sampler=*/absl::make_unique<UniformSelector>(),
+      /*remover=*/absl::make_unique<FifoSelector>(),
+      /*max_size=*/10,
+      /*max_times_sampled=*/0,
+      /*rate_limiter=*/MakeLimiter(),
+      /*extensions=*/std::vector<std::shared_ptr<TableExtension>>(),
+      /*signature=*/absl::make_optional(MakeSignature())));
+  std::unique_ptr<ReverbServiceImpl> service =
+      MakeService(10, nullptr, std::move(extra_tables));
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  grpc::ClientContext context;
+  auto stream = stub.InsertStream(&context);
+  ASSERT_TRUE(stream->Write(InsertChunkRequest(1)));
+  InsertStreamResponse response;
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(stream->Write(InsertItemRequest("dist", {1}, {1})));
+    ASSERT_TRUE(stream->Read(&response));
+  }
+  ASSERT_TRUE(stream->WritesDone());
+  REVERB_EXPECT_OK(stream->Finish());
+
+  WaitForTableSize(service->tables()["dist"].get(), 3);
+
+  auto source_items = service->tables()["dist"]->Copy();
+  std::vector<uint64_t> keys;
+  for (const auto& item : source_items) {
+    keys.push_back(item.item.key());
+  }
+  std::sort(keys.begin(), keys.end());
+
+  // Move the two lowest keys; the highest key lies outside the range and must
+  // stay behind.
+  MoveItemsRequest move_request;
+  move_request.set_source_table("dist");
+  move_request.set_target_table("dist2");
+  move_request.set_min_key(keys[0]);
+  move_request.set_max_key(keys[1]);
+  MoveItemsResponse move_response;
+  grpc::ClientContext move_context;
+  REVERB_ASSERT_OK(stub.MoveItems(&move_context, move_request, &move_response));
+  EXPECT_EQ(move_response.num_items(), 2);
+
+  auto tables = service->tables();
+  EXPECT_EQ(tables["dist"]->size(), 1);
+  auto moved_items = tables["dist2"]->Copy();
+  ASSERT_EQ(moved_items.size(), 2);
+
+  // The moved items reference the same chunk objects as before the move; only
+  // metadata crossed tables.
+  for (const auto& moved : moved_items) {
+    for (const auto& source : source_items) {
+      if (source.item.key() == moved.item.key()) {
+        ASSERT_EQ(moved.chunks.size(), source.chunks.size());
+        EXPECT_EQ(moved.chunks[0].get(), source.chunks[0].get());
+      }
+    }
+  }
+
+  // Moving a table onto itself or from an unknown table fails.
+  MoveItemsResponse failed_response;
+  move_request.set_target_table("dist");
+  grpc::ClientContext same_table_context;
+  EXPECT_EQ(stub.MoveItems(&same_table_context, move_request, &failed_response)
+                .error_code(),
+            grpc::StatusCode::INVALID_ARGUMENT);
+  move_request.set_source_table("invalid");
+  grpc::ClientContext invalid_context;
+  EXPECT_EQ(stub.MoveItems(&invalid_context, move_request, &failed_response)
+                .error_code(),
+            grpc::StatusCode::NOT_FOUND);
+}
+
 TEST(ReverbServiceImplTest, ServerInfoWorks) {
   auto service = MakeService(10);
   grpc::CallbackServerContext context;
@@ -564,12 +1206,106 @@ TEST(ReverbServiceImplTest, ServerInfoWorks) {
   rate_limiter->set_max_diff(kMaxDiff);
   rate_limiter->mutable_insert_stats();
   rate_limiter->mutable_sample_stats();
+  rate_limiter->set_adaptive_timeout_ms(-1);
   table_info.clear_table_worker_time();
   *expected_table_info.mutable_signature() = MakeSignature();
 
   EXPECT_THAT(table_info, testing::EqualsProto(expected_table_info));
 }
 
+TEST(ReverbServiceImplTest, TableWatermarksWorks) {
+  auto service = MakeService(10);
+
+  {
+    // An empty request returns the watermarks of every table.
+    grpc::CallbackServerContext context;
+    grpc::testing::DefaultReactorTestPeer peer(&context);
+    TableWatermarksRequest request;
+    TableWatermarksResponse response;
+    grpc::ServerUnaryReactor* reactor =
+        service->TableWatermarks(&context, &request, &response);
+    ASSERT_EQ(reactor, peer.reactor());
+    ASSERT_TRUE(peer.test_status_set());
+    REVERB_ASSERT_OK(peer.test_status());
+    EXPECT_THAT(response, testing::EqualsProto(
+                              "watermarks: { table_name: 'dist' }"));
+  }
+
+  {
+    // Named tables must exist.
+    grpc::CallbackServerContext context;
+    grpc::testing::DefaultReactorTestPeer peer(&context);
+    TableWatermarksRequest request;
+    request.add_table_names("does_not_exist");
+    TableWatermarksResponse response;
+    service->TableWatermarks(&context, &request, &response);
+    ASSERT_TRUE(peer.test_status_set());
+    EXPECT_EQ(peer.test_status().error_code(), grpc::StatusCode::NOT_FOUND);
+  }
+}
+
+TEST(ReverbServiceImplTest, ServerInfoStreamPushesDiffs) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  grpc::ClientContext context;
+  ServerInfoStreamRequest request;
+  request.set_min_interval_ms(10);
+  auto stream = stub.ServerInfoStream(&context, request);
+
+  // The first response contains the full table info.
+  ServerInfoStreamResponse response;
+  ASSERT_TRUE(stream->Read(&response));
+  ASSERT_EQ(response.table_info_size(), 1);
+  EXPECT_EQ(response.table_info(0).name(), "dist");
+  EXPECT_EQ(response.table_info(0).current_size(), 0);
+
+  // Inserting an item changes the table state, which must eventually be
+  // pushed as a diff.
+  {
+    grpc::ClientContext insert_context;
+    auto insert_stream = stub.InsertStream(&insert_context);
+    ASSERT_TRUE(insert_stream->Write(InsertChunkRequest(1)));
+    ASSERT_TRUE(insert_stream->Write(InsertItemRequest("dist", {1})));
+    InsertStreamResponse insert_response;
+    ASSERT_TRUE(insert_stream->Read(&insert_response));
+    ASSERT_TRUE(insert_stream->WritesDone());
+    REVERB_EXPECT_OK(insert_stream->Finish());
+  }
+
+  // Intermediate diffs may only carry worker timing changes, so read until
+  // the insert is reflected.
+  do {
+    ASSERT_TRUE(stream->Read(&response));
+    ASSERT_EQ(response.table_info_size(), 1);
+  } while (response.table_info(0).current_size() != 1);
+
+  context.TryCancel();
+  while (stream->Read(&response)) {
+  }
+  EXPECT_EQ(stream->Finish().error_code(), grpc::StatusCode::CANCELLED);
+}
+
+TEST(ReverbServiceImplTest, ServerInfoStreamUnknownTableFails) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  grpc::ClientContext context;
+  ServerInfoStreamRequest request;
+  request.add_table_names("unknown");
+  auto stream = stub.ServerInfoStream(&context, request);
+
+  ServerInfoStreamResponse response;
+  EXPECT_FALSE(stream->Read(&response));
+  EXPECT_EQ(stream->Finish().error_code(), grpc::StatusCode::NOT_FOUND);
+}
+
 TEST(ReverbServiceImplTest, CheckpointCalledWithoutCheckpointer) {
   auto service = MakeService(10);
   grpc::CallbackServerContext context;
@@ -731,6 +1467,59 @@ TEST(InsertWorkerTest, InsertWorkerReturnsCorrectStats) {
   EXPECT_EQ(stats[0].current_task_id, 1);
   EXPECT_EQ(stats[0].num_tasks_processed, 2);
   EXPECT_THAT(stats[0].current_task_info, ::testing::HasSubstr("my_table"));
+  EXPECT_GE(stats[0].busy_duration, absl::ZeroDuration());
+}
+
+TEST(InsertWorkerTest, InsertWorkerReturnsUtilizationStats) {
+  auto insert_worker = absl::make_unique<InsertWorker>(
+      /*num_threads=*/1, /*max_queue_size_to_warn=*/3, "TestWorker");
+  Table::Item item;
+  item.item.set_table("my_table");
+  absl::BlockingCounter counter(1);
+  InsertTaskInfo task_info;
+  task_info.item = item;
+  insert_worker->Schedule(
+      task_info,
+      [&counter](InsertTaskInfo task_info, const absl::Status& status,
+                 bool enough_queue_slots) { counter.DecrementCount(); });
+  counter.Wait();
+
+  auto utilization = insert_worker->GetUtilizationStats();
+  EXPECT_EQ(utilization.target_num_threads, 1);
+  ASSERT_THAT(utilization.current_task_ages, ::testing::SizeIs(1));
+  // The busy fractions and queue depth history are only populated once the
+  // monitor has run, which is too slow to wait for in a unit test.
+}
+
+TEST(InsertWorkerTest, ScalingInsertWorkerProcessesAllTasks) {
+  auto insert_worker = absl::make_unique<ScalingInsertWorker>(
+      /*num_threads=*/1, /*max_queue_size_to_warn=*/3, "TestWorker",
+      /*max_threads=*/4);
+  Table::Item item;
+  item.item.set_table("my_table");
+  absl::BlockingCounter counter(8);
+  for (int i = 0; i < 8; i++) {
+    InsertTaskInfo task_info;
+    task_info.item = item;
+    insert_worker->Schedule(
+        task_info,
+        [&counter](InsertTaskInfo task_info, const absl::Status& status,
+                   bool enough_queue_slots) { counter.DecrementCount(); });
+  }
+  counter.Wait();
+
+  // All threads are spawned upfront but only the first one may pick up tasks
+  // until the monitor raises the target, which is too slow to wait for in a
+  // unit test.
+  auto utilization = insert_worker->GetUtilizationStats();
+  EXPECT_EQ(utilization.target_num_threads, 1);
+  ASSERT_THAT(utilization.current_task_ages, ::testing::SizeIs(4));
+
+  int64_t processed = 0;
+  for (const auto& stats : insert_worker->GetThreadStats()) {
+    processed += stats.num_tasks_processed;
+  }
+  EXPECT_EQ(processed, 8);
 }
 
 }  // namespace
@@ -15,7 +15,10 @@
 #include "reverb/cc/sampler.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <deque>
+#include <list>
 #include <memory>
 #include <string>
 #include <vector>
@@ -23,11 +26,16 @@
 #include "grpcpp/impl/codegen/client_context.h"
 #include "grpcpp/impl/codegen/sync_stream.h"
 #include "absl/memory/memory.h"
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "reverb/cc/chunk_store.h"
 #include "reverb/cc/errors.h"
 #include "reverb/cc/platform/hash_map.h"
@@ -38,7 +46,10 @@
 #include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/chunk_disk_cache.h"
+#include "reverb/cc/support/chunk_format.h"
 #include "reverb/cc/support/grpc_util.h"
+#include "reverb/cc/support/shm_arena.h"
 #include "reverb/cc/support/tf_util.h"
 #include "reverb/cc/support/trajectory_util.h"
 #include "reverb/cc/table.h"
@@ -58,6 +69,15 @@ constexpr int64_t kInitialSampleBatchSize = 8;
 constexpr absl::Duration kResetBackoffThreshold = absl::Seconds(2);
 constexpr absl::Duration kMinRetryBackoff = absl::Milliseconds(1);
 constexpr absl::Duration kMaxRetryBackoff = absl::Seconds(1);
+// Maximum number of completed samples moved from the worker queue to the
+// consumer in one batched pop. Bounds how much the consumer front-runs the
+// `returned_` bookkeeping, while still amortizing the queue lock over bursts.
+constexpr int kMaxPrefetchedSamples = 64;
+
+// Number of pops between adjustments of the in-flight budget when
+// `Options::adaptive_in_flight_samples` is set. Large enough that a single
+// bursty pop does not flip the budget back and forth.
+constexpr int64_t kAdaptationWindow = 64;
 
 template <typename T>
 tensorflow::Tensor InitializeTensor(T value, int64_t length) {
@@ -78,32 +98,68 @@ tensorflow::Tensor ScalarTensor(T value) {
   return tensor;
 }
 
-absl::Status AsSample(std::vector<SampleStreamResponse::SampleEntry> responses,
-                      std::unique_ptr<Sample>* sample) {
-  const auto& info = responses.front().info();
-  internal::flat_hash_map<uint64_t, std::unique_ptr<ChunkData>> chunks;
-  for (auto& response : responses) {
-    while (response.data_size() != 0) {
-      auto* chunk = response.mutable_data()->ReleaseLast();
-      chunks[chunk->chunk_key()] = absl::WrapUnique<ChunkData>(chunk);
-    }
+// Copies `tensor` into memory from `allocator` (e.g. a pooled pinned host
+// allocator) so that device transfers of the outputs run from page-locked
+// memory. Noop for dtypes that cannot be copied with memcpy (e.g. strings).
+void CopyToOutputAllocator(tensorflow::Allocator* allocator,
+                           tensorflow::Tensor* tensor) {
+  if (!tensorflow::DataTypeCanUseMemcpy(tensor->dtype())) return;
+  tensorflow::Tensor copy(allocator, tensor->dtype(), tensor->shape());
+  const auto src = tensor->tensor_data();
+  std::memcpy(const_cast<char*>(copy.tensor_data().data()), src.data(),
+              src.size());
+  *tensor = std::move(copy);
+}
+
+// Applies the above to every tensor of `data`.
+void CopyToOutputAllocator(tensorflow::Allocator* allocator,
+                           std::vector<tensorflow::Tensor>* data) {
+  for (auto& tensor : *data) {
+    CopyToOutputAllocator(allocator, &tensor);
   }
+}
 
-  // Count the number of times each chunk is referenced in the column slices.
-  // This allows us to check if the chunk is needed anymore after every use. If
-  // all the references have been handled then the memory of the chunk can be
-  // freed thus reducing total memory usage.
-  internal::flat_hash_map<uint64_t, int> chunk_ref_count;
-  for (const auto& column : info.item().flat_trajectory().columns()) {
-    for (const auto& slice : column.chunk_slices()) {
-      chunk_ref_count[slice.chunk_key()]++;
+// Resolves the `baseline_chunk` of slices whose chunk was delta encoded
+// against its predecessor (`ChunkData.delta_baseline_chunk_key` is set).
+// Returns `InvalidArgumentError` if the referenced chunk is not part of the
+// sampled trajectory; such chunks cannot be decoded on their own.
+absl::Status ResolveDeltaBaselines(
+    const internal::flat_hash_map<uint64_t, std::shared_ptr<const ChunkData>>&
+        chunks,
+    std::vector<std::deque<Sample::ColumnChunk>>* column_chunks) {
+  for (std::deque<Sample::ColumnChunk>& column : *column_chunks) {
+    for (Sample::ColumnChunk& slice : column) {
+      const uint64_t baseline_key =
+          slice.chunk_data->delta_baseline_chunk_key();
+      if (baseline_key == 0) continue;
+      auto it = chunks.find(baseline_key);
+      if (it == chunks.end()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Chunk ", slice.chunk_data->chunk_key(),
+            " is delta encoded against chunk ", baseline_key,
+            " which is not part of the sampled trajectory."));
+      }
+      slice.baseline_chunk = it->second;
     }
   }
+  return absl::OkStatus();
+}
+
+// Builds a `Sample` from the stream entries of one sampled item and the
+// chunks resolved for it by the caller (detached from the entries and, when
+// the stream's chunk cache is enabled, fetched from the cache). The chunks
+// are shared between the column slices that reference them and unpacked
+// lazily; the memory of a chunk is released once the last slice referencing
+// it has been materialized.
+absl::Status AsSample(
+    std::vector<SampleStreamResponse::SampleEntry> responses,
+    internal::flat_hash_map<uint64_t, std::shared_ptr<const ChunkData>> chunks,
+    std::unique_ptr<Sample>* sample) {
+  const auto& info = responses.front().info();
 
-  // Extract all chunks belonging to this sample.
   const auto& columns = info.item().flat_trajectory().columns();
 
-  std::vector<std::vector<tensorflow::Tensor>> column_chunks(columns.size());
+  std::vector<std::deque<Sample::ColumnChunk>> column_chunks(columns.size());
   std::vector<bool> squeeze_columns(columns.size());
 
   for (int i = 0; i < columns.size(); i++) {
@@ -116,75 +172,209 @@ absl::Status AsSample(std::vector<SampleStreamResponse::SampleEntry> responses,
                          " could not be found when unpacking item ",
                          info.item().key(), "."));
       }
-
-      column_chunks[i].emplace_back();
-      REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumnAndSlice(
-          *it->second, slice, &column_chunks[i].back()));
-
-      // If this was the last time the chunk is referenced the we can release
-      // its memory.
-      if (--chunk_ref_count[slice.chunk_key()] == 0) {
-        chunks.erase(it);
-      }
+      column_chunks[i].push_back({absl::nullopt, it->second, nullptr, slice});
     }
   }
 
+  REVERB_RETURN_IF_ERROR(ResolveDeltaBaselines(chunks, &column_chunks));
+
+  Sample::ServerTiming timing;
+  timing.queued_for_secs = info.queued_for_secs();
+  timing.rate_limiter_wait_secs = info.rate_limiter_wait_secs();
+  timing.serialize_time_secs = info.serialize_time_secs();
+
   *sample = absl::make_unique<Sample>(
       info.item().key(), info.probability(), info.table_size(),
-      info.item().priority(), info.rate_limited(), std::move(column_chunks),
-      std::move(squeeze_columns));
+      info.item().priority(), info.rate_limited(), timing,
+      std::move(column_chunks), std::move(squeeze_columns));
+  (*sample)->SetChunkByteSizes(info.chunk_compressed_bytes(),
+                               info.chunk_uncompressed_bytes());
 
   return absl::OkStatus();
 }
 
 absl::Status AsSample(const Table::SampledItem& sampled_item,
                       std::unique_ptr<Sample>* sample) {
-  internal::flat_hash_map<uint64_t, std::shared_ptr<ChunkStore::Chunk>> chunks(
+  internal::flat_hash_map<uint64_t, std::shared_ptr<const ChunkData>> chunks(
       sampled_item.ref->chunks.size());
+  internal::flat_hash_map<uint64_t, std::shared_ptr<ChunkStore::Chunk>>
+      cached_chunks;
   for (auto& chunk : sampled_item.ref->chunks) {
-    chunks[chunk->key()] = chunk;
+    // The aliasing constructor keeps the `ChunkStore::Chunk` alive for as
+    // long as any unmaterialized slice references its data.
+    chunks[chunk->key()] =
+        std::shared_ptr<const ChunkData>(chunk, &chunk->data());
+    if (chunk->unpacked_cache_enabled()) {
+      cached_chunks[chunk->key()] = chunk;
+    }
   }
 
-  std::vector<std::vector<tensorflow::Tensor>> column_chunks;
+  std::vector<std::deque<Sample::ColumnChunk>> column_chunks;
   column_chunks.reserve(
       sampled_item.ref->item.flat_trajectory().columns_size());
 
   for (const auto& column :
        sampled_item.ref->item.flat_trajectory().columns()) {
-    std::vector<tensorflow::Tensor> unpacked_chunks;
-
+    std::deque<Sample::ColumnChunk> slices;
     for (const auto& slice : column.chunk_slices()) {
-      unpacked_chunks.emplace_back();
-      REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumnAndSlice(
-          chunks[slice.chunk_key()]->data(), slice, &unpacked_chunks.back()));
+      slices.push_back(
+          {absl::nullopt, chunks[slice.chunk_key()], nullptr, slice});
+      if (!cached_chunks.empty()) {
+        const auto it = cached_chunks.find(slice.chunk_key());
+        if (it != cached_chunks.end()) {
+          slices.back().store_chunk = it->second;
+        }
+      }
     }
-
-    column_chunks.push_back(std::move(unpacked_chunks));
+    column_chunks.push_back(std::move(slices));
   }
 
+  REVERB_RETURN_IF_ERROR(ResolveDeltaBaselines(chunks, &column_chunks));
+
   std::vector<bool> squeeze_columns;
   for (const auto& col : sampled_item.ref->item.flat_trajectory().columns()) {
     squeeze_columns.push_back(col.squeeze());
   }
+  Sample::ServerTiming timing;
+  timing.queued_for_secs = absl::ToDoubleSeconds(sampled_item.queued_for);
+  timing.rate_limiter_wait_secs =
+      absl::ToDoubleSeconds(sampled_item.rate_limiter_wait);
+
   *sample = absl::make_unique<deepmind::reverb::Sample>(
       sampled_item.ref->item.key(), sampled_item.probability,
       sampled_item.table_size, sampled_item.priority, sampled_item.rate_limited,
-      std::move(column_chunks), std::move(squeeze_columns));
+      timing, std::move(column_chunks), std::move(squeeze_columns));
+  (*sample)->SetChunkByteSizes(sampled_item.chunk_compressed_bytes,
+                               sampled_item.chunk_uncompressed_bytes);
 
   return absl::OkStatus();
 }
 
+// Tracks the observed latency of a set of replica servers and picks the
+// replica for each new stream with power of two choices (see
+// `Sampler::Options::stubs_are_replicas`). Shared by all workers of a
+// sampler so the load estimate covers every open stream.
+class ReplicaSelector {
+ public:
+  explicit ReplicaSelector(
+      std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+          stubs) {
+    REVERB_CHECK(!stubs.empty());
+    replicas_.reserve(stubs.size());
+    for (auto& stub : stubs) {
+      replicas_.push_back({std::move(stub)});
+    }
+  }
+
+  // Draws two distinct replicas at random and orders them by score (lowest
+  // first). `*primary` is the replica the stream should go to; `*alternate`
+  // is the fallback should the primary be hedged away from. With a single
+  // replica both are 0.
+  void PickPair(int* primary, int* alternate) {
+    absl::MutexLock lock(&mu_);
+    if (replicas_.size() == 1) {
+      *primary = 0;
+      *alternate = 0;
+      return;
+    }
+    int a = absl::Uniform<int>(gen_, 0, replicas_.size());
+    int b = absl::Uniform<int>(gen_, 0, replicas_.size() - 1);
+    if (b >= a) b++;
+    if (Score(replicas_[b]) < Score(replicas_[a])) std::swap(a, b);
+    *primary = a;
+    *alternate = b;
+  }
+
+  std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub(
+      int replica) const {
+    return replicas_[replica].stub;
+  }
+
+  void StreamStarted(int replica) {
+    absl::MutexLock lock(&mu_);
+    replicas_[replica].open_streams++;
+  }
+
+  // Records the outcome of a finished stream. Streams which delivered
+  // samples fold their per sample latency into the replica's moving
+  // average; streams which failed (or were hedged away from) without
+  // delivering anything double the average instead so a struggling replica
+  // is quickly steered around and successful streams pull it back in.
+  void StreamFinished(int replica, absl::Duration elapsed,
+                      int64_t num_samples, bool ok) {
+    absl::MutexLock lock(&mu_);
+    Replica& state = replicas_[replica];
+    state.open_streams--;
+    if (num_samples > 0) {
+      const double observed_ms =
+          absl::ToDoubleMilliseconds(elapsed) / num_samples;
+      state.ema_ms = state.ema_ms == 0.
+                         ? observed_ms
+                         : kEmaDecay * state.ema_ms +
+                               (1. - kEmaDecay) * observed_ms;
+    } else if (!ok) {
+      state.ema_ms = std::max(2. * state.ema_ms, 1.);
+    }
+  }
+
+ private:
+  struct Replica {
+    std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub;
+
+    // Exponential moving average of the per sample latency of finished
+    // streams, in milliseconds; 0 until the first stream finishes.
+    double ema_ms = 0;
+
+    int open_streams = 0;
+  };
+
+  // Weight of the history when folding a new observation into `ema_ms`.
+  static constexpr double kEmaDecay = 0.8;
+
+  // Expected latency cost of a new stream on the replica: replicas without
+  // history score 0 and are tried first; ties fall to the replica with
+  // fewer open streams.
+  static double Score(const Replica& replica) {
+    return replica.ema_ms * (replica.open_streams + 1) +
+           replica.open_streams * 1e-6;
+  }
+
+  mutable absl::Mutex mu_;
+  absl::BitGen gen_ ABSL_GUARDED_BY(mu_);
+  std::vector<Replica> replicas_ ABSL_GUARDED_BY(mu_);
+};
+
 class GrpcSamplerWorker : public SamplerWorker {
  public:
   // Constructs a new worker without creating a stream to a server.
   GrpcSamplerWorker(
       std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub,
-      std::string table_name, int64_t samples_per_request)
+      std::string table_name, int64_t samples_per_request,
+      int chunk_cache_size,
+      std::shared_ptr<internal::ChunkDiskCache> disk_cache,
+      bool shm_transport,
+      std::shared_ptr<TaskExecutor> fetch_executor = nullptr,
+      std::shared_ptr<ReplicaSelector> replicas = nullptr,
+      absl::Duration hedge_timeout = absl::InfiniteDuration())
       : stub_(std::move(stub)),
         table_name_(std::move(table_name)),
+        max_samples_per_request_(samples_per_request),
         samples_per_request_(samples_per_request),
+        chunk_cache_size_(chunk_cache_size),
+        disk_cache_(std::move(disk_cache)),
+        shm_transport_(shm_transport),
+        fetch_executor_(std::move(fetch_executor)),
+        replicas_(std::move(replicas)),
+        hedge_timeout_(hedge_timeout),
         reserved_slots_(0) {}
 
+  void SetMaxInFlightSamples(int64_t max_in_flight_samples) override {
+    samples_per_request_.store(
+        std::max<int64_t>(
+            1, std::min(max_in_flight_samples, max_samples_per_request_)),
+        std::memory_order_relaxed);
+  }
+
   // Cancels the stream and marks the worker as closed. Active and future
   // calls to `OpenStreamAndFetch` will return status `CANCELLED`.
   void Cancel() override {
@@ -200,9 +390,111 @@ class GrpcSamplerWorker : public SamplerWorker {
   // closed and the number of samples pushed to `queue` is returned together
   // with the status of the stream.  A timeout will cause the Status type
   // DeadlineExceeded to be returned.
+  //
+  // When the worker targets a set of replicas the stream goes to the
+  // replica picked by the selector; should the hedge timeout elapse before
+  // the first response the attempt is cancelled and retried once on the
+  // alternate replica of the draw (see
+  // `Sampler::Options::replica_hedge_timeout`).
   std::pair<int64_t, absl::Status> FetchSamples(
       internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
       absl::Duration rate_limiter_timeout) override {
+    bool hedged = false;
+    if (replicas_ == nullptr) {
+      return FetchSamplesFromStub(stub_, absl::InfiniteDuration(), &hedged,
+                                  queue, num_samples, rate_limiter_timeout);
+    }
+    int primary;
+    int alternate;
+    replicas_->PickPair(&primary, &alternate);
+    absl::Time start = absl::Now();
+    replicas_->StreamStarted(primary);
+    auto result = FetchSamplesFromStub(
+        replicas_->stub(primary),
+        alternate != primary ? hedge_timeout_ : absl::InfiniteDuration(),
+        &hedged, queue, num_samples, rate_limiter_timeout);
+    replicas_->StreamFinished(primary, absl::Now() - start, result.first,
+                              result.second.ok() && !hedged);
+    if (!hedged || result.second.ok()) {
+      return result;
+    }
+    // The primary did not deliver a first response within the hedge timeout;
+    // run the remainder of the fetch on the alternate replica right away and
+    // without further hedging.
+    start = absl::Now();
+    replicas_->StreamStarted(alternate);
+    auto retry = FetchSamplesFromStub(
+        replicas_->stub(alternate), absl::InfiniteDuration(), &hedged, queue,
+        num_samples - result.first, rate_limiter_timeout);
+    replicas_->StreamFinished(alternate, absl::Now() - start, retry.first,
+                              retry.second.ok());
+    retry.first += result.first;
+    return retry;
+  }
+
+  // Like `FetchSamples` but built on the gRPC callback API: the stream is
+  // driven as a reactor state machine (see `SampleStreamReactor`) so no
+  // thread is occupied while the fetch waits on the network. `done` is
+  // invoked from a gRPC callback thread once the fetch has completed. Falls
+  // back to the blocking implementation when the worker was constructed
+  // without a fetch executor (required to keep queue backpressure waits off
+  // the gRPC callback threads).
+  void FetchSamplesAsync(internal::Queue<std::unique_ptr<Sample>>* queue,
+                         int64_t num_samples,
+                         absl::Duration rate_limiter_timeout,
+                         FetchDoneCallback done) override;
+
+ private:
+  using ChunkCacheList = std::list<std::shared_ptr<const ChunkData>>;
+
+  class SampleStreamReactor;
+
+  // State which lives for the duration of a single `SampleStream` stream.
+  // Shared between the blocking and the reactor based fetch paths.
+  struct StreamState {
+    // Client half of the per stream chunk cache (see
+    // `SampleStreamRequest.chunk_cache_size`), most recently received first.
+    // It mirrors the updates the server applies when deciding which chunks
+    // to resend and lives as long as the stream.
+    ChunkCacheList chunk_cache;
+    internal::flat_hash_map<uint64_t, ChunkCacheList::iterator>
+        chunk_cache_index;
+
+    // Disk cache keys announced to the server on this stream so far. Incoming
+    // `payload_cached` references are interpreted against exactly this set
+    // (and not the live cache content, which other workers keep extending) so
+    // both ends agree on which references resolve to disk entries and which
+    // to the stream cache.
+    internal::flat_hash_set<uint64_t> announced_disk_keys;
+
+    // Entries of the sample currently being assembled and the chunks they
+    // reference.
+    std::vector<SampleStreamResponse::SampleEntry> parts_of_next_sample;
+    internal::flat_hash_map<uint64_t, std::shared_ptr<const ChunkData>>
+        next_sample_chunks;
+
+    // Vector of completed samples, reused between queue pushes to avoid
+    // reallocation.
+    std::vector<std::unique_ptr<Sample>> samples;
+
+    // Total number of samples pushed to the queue over the lifetime of the
+    // stream.
+    int64_t num_samples_returned = 0;
+
+    // Number of samples received for the currently outstanding request.
+    int64_t sampled = 0;
+  };
+
+  // Opens one `SampleStream` to the server behind `stub` and runs the whole
+  // fetch on it (see `FetchSamples`). When `first_response_timeout` is
+  // finite a watchdog thread cancels the stream should the first response
+  // not have arrived in time; `*hedged` is then set so the caller can retry
+  // on another replica.
+  std::pair<int64_t, absl::Status> FetchSamplesFromStub(
+      const std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>& stub,
+      absl::Duration first_response_timeout, bool* hedged,
+      internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
+      absl::Duration rate_limiter_timeout) {
     std::unique_ptr<grpc::ClientReaderWriterInterface<SampleStreamRequest,
                                                       SampleStreamResponse>>
         stream;
@@ -213,107 +505,334 @@ class GrpcSamplerWorker : public SamplerWorker {
       }
       context_ = absl::make_unique<grpc::ClientContext>();
       context_->set_wait_for_ready(false);
-      stream = stub_->SampleStream(context_.get());
+      stream = stub->SampleStream(context_.get());
     }
 
-    int64_t num_samples_returned = 0;
-    SampleStreamResponse response;
-    // Vector of samples allocated in the first iteration and then reused.
-    std::vector<std::unique_ptr<Sample>> samples;
-    while (num_samples_returned < num_samples) {
-      // TODO(b/190237214): Ignore timeouts when data is not being requested.
+    absl::Notification first_response;
+    std::unique_ptr<internal::Thread> watchdog;
+    if (first_response_timeout < absl::InfiniteDuration()) {
+      watchdog = internal::StartThread(
+          "SamplerHedge",
+          [this, &first_response, first_response_timeout, hedged] {
+            if (first_response.WaitForNotificationWithTimeout(
+                    first_response_timeout)) {
+              return;
+            }
+            absl::MutexLock lock(&mu_);
+            if (closed_ || context_ == nullptr) return;
+            *hedged = true;
+            context_->TryCancel();
+          });
+    }
+
+    auto result = [&]() -> std::pair<int64_t, absl::Status> {
+      StreamState state;
       SampleStreamRequest request;
-      request.set_table(table_name_);
-      request.set_num_samples(
-          std::min(samples_per_request_, num_samples - num_samples_returned));
-      request.mutable_rate_limiter_timeout()->set_milliseconds(
-          NonnegativeDurationToInt64Millis(rate_limiter_timeout));
-      // Reservation can be negative if previously reserved slots are being
-      // returned.
-      if (!queue->Reserve(request.num_samples() - reserved_slots_)) {
-          return {num_samples_returned,
+      SampleStreamResponse response;
+      while (state.num_samples_returned < num_samples) {
+        if (!PrepareNextRequest(&state, queue, num_samples,
+                                rate_limiter_timeout, &request)) {
+          return {state.num_samples_returned,
                   absl::CancelledError("`Close` called on Sampler")};
+        }
+
+        if (!stream->Write(request)) {
+          return {state.num_samples_returned, FromGrpcStatus(stream->Finish())};
+        }
+
+        while (state.sampled < request.num_samples()) {
+          if (!stream->Read(&response)) {
+            auto status = FromGrpcStatus(stream->Finish());
+            if (errors::IsRateLimiterTimeout(status) &&
+                queue->num_waiting_to_pop() < 1) {
+              // The rate limiter timed out but no one is waiting for new
+              // data, so we can exit with an OkStatus and get restarted with
+              // a new stream.
+              return {state.num_samples_returned, absl::OkStatus()};
+            } else {
+              return {state.num_samples_returned, status};
+            }
+          }
+          if (!first_response.HasBeenNotified()) first_response.Notify();
+          if (auto status = ConsumeResponse(&response, &state, queue);
+              !status.ok()) {
+            return {state.num_samples_returned, status};
+          }
+        }
+        if (!state.parts_of_next_sample.empty()) {
+          return {state.num_samples_returned,
+                  absl::InternalError(
+                      "Streamed responses included unattributed SampleEntry.")};
+        }
       }
-      reserved_slots_ = request.num_samples();
 
-      if (!stream->Write(request)) {
-        return {num_samples_returned, FromGrpcStatus(stream->Finish())};
+      if (state.num_samples_returned != num_samples) {
+        return {state.num_samples_returned,
+                absl::InternalError(
+                    absl::StrCat("num_samples_returned != num_samples (",
+                                 state.num_samples_returned, " vs. ",
+                                 num_samples))};
       }
+      return {state.num_samples_returned, absl::OkStatus()};
+    }();
 
-      std::vector<SampleStreamResponse::SampleEntry> parts_of_next_sample;
-      for (int64_t sampled = 0; sampled < request.num_samples();) {
-        if (!stream->Read(&response)) {
-          auto status = FromGrpcStatus(stream->Finish());
-          if (errors::IsRateLimiterTimeout(status) &&
-              queue->num_waiting_to_pop() < 1) {
-            // The rate limiter timed out but no one is waiting for new data,
-            // so we can exit with an OkStatus and get restarted with a new
-            // stream.
-            return {num_samples_returned, absl::OkStatus()};
-          } else {
-            return {num_samples_returned, status};
-          }
+    if (watchdog != nullptr) {
+      if (!first_response.HasBeenNotified()) first_response.Notify();
+      // Joining the watchdog makes its write of `*hedged` visible here.
+      watchdog = nullptr;
+    }
+    return result;
+  }
+
+  // Populates `request` for the next batch of the stream described by `state`
+  // and reserves the queue slots the batch needs. The reservation blocks
+  // while the queue lacks space; returns false if the queue was closed.
+  bool PrepareNextRequest(StreamState* state,
+                          internal::Queue<std::unique_ptr<Sample>>* queue,
+                          int64_t num_samples,
+                          absl::Duration rate_limiter_timeout,
+                          SampleStreamRequest* request) {
+    // TODO(b/190237214): Ignore timeouts when data is not being requested.
+    request->Clear();
+    request->set_table(table_name_);
+    request->set_num_samples(
+        std::min(samples_per_request_.load(std::memory_order_relaxed),
+                 num_samples - state->num_samples_returned));
+    request->mutable_rate_limiter_timeout()->set_milliseconds(
+        NonnegativeDurationToInt64Millis(rate_limiter_timeout));
+    request->set_chunk_cache_size(chunk_cache_size_);
+    request->set_shm_transport(shm_transport_);
+    if (disk_cache_ != nullptr) {
+      // The first request announces the whole cache; later requests only
+      // the chunks persisted since, so long streams benefit from payloads
+      // they just stored.
+      for (uint64_t key : disk_cache_->Keys()) {
+        if (state->announced_disk_keys.insert(key).second) {
+          request->add_disk_cached_chunk_keys(key);
         }
-        for (auto& entry : response.entries()) {
-          parts_of_next_sample.push_back(std::move(entry));
-          // Continue grabbing entries until the current sample is complete.
-          if (!parts_of_next_sample.back().end_of_sequence()) {
-            continue;
-          }
+      }
+    }
+    // Reservation can be negative if previously reserved slots are being
+    // returned.
+    if (!queue->Reserve(request->num_samples() - reserved_slots_)) {
+      return false;
+    }
+    reserved_slots_ = request->num_samples();
+    state->sampled = 0;
+    return true;
+  }
+
+  // Consumes one response of the stream described by `state`, pushing the
+  // samples it completes to `queue`.
+  absl::Status ConsumeResponse(SampleStreamResponse* response,
+                               StreamState* state,
+                               internal::Queue<std::unique_ptr<Sample>>* queue) {
+    for (auto& entry : *response->mutable_entries()) {
+      // Chunks are detached (and the stream cache updates applied) in
+      // arrival order before the entries are regrouped per sample.
+      REVERB_RETURN_IF_ERROR(CollectEntryChunks(
+          &entry, response->shm_arena(), &state->chunk_cache,
+          &state->chunk_cache_index, state->announced_disk_keys,
+          &state->next_sample_chunks));
+      state->parts_of_next_sample.push_back(std::move(entry));
+      // Continue grabbing entries until the current sample is complete.
+      if (!state->parts_of_next_sample.back().end_of_sequence()) {
+        continue;
+      }
+
+      // We have received everything we need to unpack the next sample so
+      // let's push it to the queue. We don't expect AsSample to ever fail
+      // but it will be closed if the Sampler has been closed.
+      std::unique_ptr<Sample> sample;
+      auto status = AsSample(std::move(state->parts_of_next_sample),
+                             std::move(state->next_sample_chunks), &sample);
+      state->parts_of_next_sample.clear();
+      state->next_sample_chunks.clear();
+      REVERB_RETURN_IF_ERROR(status);
+      state->samples.push_back(std::move(sample));
+      // The sample was successfully received from the stream.
+      // There might still be more samples, or partial samples,
+      // in the same SampleStreamResponse so we'll continue reading the
+      // remaining entries into the next sample.
+      ++state->num_samples_returned;
+      ++state->sampled;
+    }
+    reserved_slots_ -= state->samples.size();
+    if (reserved_slots_ < 0) {
+      return absl::InternalError(
+          "This should never happen. Please file a bug to the "
+          "Reverb team if you encounter this error.");
+    }
+    // PushBatch call calls `.clear()` on the input vector, so that vector
+    // can be reused without memory reallocation.
+    queue->PushBatch(&state->samples);
+    return absl::OkStatus();
+  }
 
-          // We have received everything we need to unpack the next sample so
-          // let's push it to the queue. We don't expect AsSample to ever fail
-          // but it will be closed if the Sampler has been closed.
-          std::unique_ptr<Sample> sample;
-          auto status = AsSample(std::move(parts_of_next_sample), &sample);
-          parts_of_next_sample.clear();
-          if (!status.ok()) {
-            return {num_samples_returned, status};
+  // Detaches the chunks of `entry` in arrival order, applies the stream
+  // cache updates mirroring the server's (see
+  // `SampleStreamRequest.chunk_cache_size`) and stores the resolved chunks
+  // in `chunks`. Chunks arriving as bare `payload_cached` references are
+  // resolved against the disk cache when their key is in
+  // `announced_disk_keys` and against the stream cache otherwise; full
+  // payloads are written through to the disk cache. Chunks arriving as
+  // shared memory references (`ChunkData.shm_ref`) are first resolved
+  // against the arena `shm_arena` and then treated as full payloads.
+  absl::Status CollectEntryChunks(
+      SampleStreamResponse::SampleEntry* entry, const std::string& shm_arena,
+      ChunkCacheList* cache,
+      internal::flat_hash_map<uint64_t, ChunkCacheList::iterator>* cache_index,
+      const internal::flat_hash_set<uint64_t>& announced_disk_keys,
+      internal::flat_hash_map<uint64_t, std::shared_ptr<const ChunkData>>*
+          chunks) {
+    // `ReleaseLast` hands the chunks out backwards; the cache updates must
+    // be applied in arrival order to stay in lockstep with the server.
+    std::vector<ChunkData*> arrived;
+    arrived.reserve(entry->data_size());
+    while (entry->data_size() != 0) {
+      arrived.push_back(entry->mutable_data()->ReleaseLast());
+    }
+    std::reverse(arrived.begin(), arrived.end());
+    for (ChunkData* released : arrived) {
+      std::shared_ptr<const ChunkData> chunk = absl::WrapUnique(released);
+      if (chunk->has_shm_ref()) {
+        std::shared_ptr<ChunkData> resolved;
+        REVERB_RETURN_IF_ERROR(ResolveShmChunk(shm_arena, *chunk, &resolved));
+        chunk = std::move(resolved);
+      }
+      const uint64_t key = chunk->chunk_key();
+      if (chunk->payload_cached()) {
+        // Disk references take precedence and leave the stream cache
+        // untouched, mirroring the order the server applies.
+        if (disk_cache_ != nullptr && announced_disk_keys.contains(key)) {
+          std::shared_ptr<ChunkData> cached;
+          if (auto status = disk_cache_->Get(key, &cached); !status.ok()) {
+            return status;
           }
-          samples.push_back(std::move(sample));
-          // The sample was successfully received from the stream.
-          // There might still be more samples, or partial samples,
-          // in the same SampleStreamResponse so we'll continue reading the
-          // remaining entries into the next sample.
-          ++num_samples_returned;
-          ++sampled;
+          (*chunks)[key] = std::move(cached);
+          continue;
         }
-        reserved_slots_ -= samples.size();
-        if (reserved_slots_ < 0) {
-            return {num_samples_returned,
-                    absl::InternalError(
-                        "This should never happen. Please file a bug to the "
-                        "Reverb team if you encounter this error.")};
+        auto it = cache_index->find(key);
+        if (it == cache_index->end()) {
+          return absl::InternalError(
+              absl::StrCat("Chunk ", key,
+                           " was sent as a cached reference but is not "
+                           "present in the stream's chunk cache."));
         }
-        // PushBatch call calls `.clear()` on the input vector, so that vector
-        // can be reused without memory reallocation.
-        queue->PushBatch(&samples);
+        cache->splice(cache->begin(), *cache, it->second);
+        (*chunks)[key] = *it->second;
+        continue;
       }
-      if (!parts_of_next_sample.empty()) {
-        return {num_samples_returned,
-                absl::InternalError(
-                    "Streamed responses included unattributed SampleEntry.")};
+      (*chunks)[key] = chunk;
+      if (disk_cache_ != nullptr) {
+        // A failed write only costs the future transfer savings, never the
+        // sample itself.
+        if (auto status = disk_cache_->Put(*chunk); !status.ok()) {
+          REVERB_LOG(REVERB_WARNING)
+              << "Failed to persist chunk " << key
+              << " to the sample disk cache: " << status.ToString();
+        }
+      }
+      if (chunk_cache_size_ > 0) {
+        cache->push_front(std::move(chunk));
+        (*cache_index)[key] = cache->begin();
+        if (cache_index->size() > static_cast<size_t>(chunk_cache_size_)) {
+          cache_index->erase(cache->back()->chunk_key());
+          cache->pop_back();
+        }
       }
     }
+    return absl::OkStatus();
+  }
 
-    if (num_samples_returned != num_samples) {
-      return {num_samples_returned,
-              absl::InternalError(
-                  absl::StrCat("num_samples_returned != num_samples (",
-                               num_samples_returned, " vs. ", num_samples))};
+  // Resolves a chunk whose payload was placed in the server's shared memory
+  // arena (see `ChunkData.shm_ref`), attaching the arena read only on first
+  // use. The payload stays valid in the arena only until the server's ring
+  // allocator recycles the block, so it is copied out (and parsed) right
+  // away; a recycled block surfaces as `DataLossError`.
+  absl::Status ResolveShmChunk(const std::string& arena_name,
+                               const ChunkData& reference,
+                               std::shared_ptr<ChunkData>* chunk) {
+    if (arena_name.empty()) {
+      return absl::InternalError(absl::StrCat(
+          "Chunk ", reference.chunk_key(),
+          " arrived as a shm reference but the response named no arena."));
     }
-    return {num_samples_returned, absl::OkStatus()};
+    if (shm_arena_ == nullptr || shm_arena_->name() != arena_name) {
+      std::unique_ptr<internal::ShmArena> arena;
+      REVERB_RETURN_IF_ERROR(internal::ShmArena::Attach(arena_name, &arena));
+      shm_arena_ = std::move(arena);
+    }
+    internal::ShmArena::BlockRef block;
+    block.offset = reference.shm_ref().offset();
+    block.length = reference.shm_ref().length();
+    block.sequence = reference.shm_ref().sequence();
+    std::string payload;
+    REVERB_RETURN_IF_ERROR(shm_arena_->Read(block, &payload));
+    // The payload uses the packed layout (see support/chunk_format.h) whose
+    // fixed-offset header is validated before any protobuf decoding.
+    internal::PackedChunkView view;
+    if (auto status = internal::PackedChunkView::Wrap(payload, &view);
+        !status.ok()) {
+      return absl::DataLossError(
+          absl::StrCat("Chunk ", reference.chunk_key(), " read from shm arena '",
+                       arena_name, "' is not a packed chunk: ",
+                       status.ToString()));
+    }
+    auto resolved = std::make_shared<ChunkData>();
+    REVERB_RETURN_IF_ERROR(view.Unpack(resolved.get()));
+    *chunk = std::move(resolved);
+    return absl::OkStatus();
   }
 
- private:
   // Stub used to open `SampleStream`-streams to a server.
   std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub_;
 
   // Name of the `Table` to sample from.
   const std::string table_name_;
 
-  // The maximum number of samples to request in a "batch".
-  const int64_t samples_per_request_;
+  // Upper bound for `samples_per_request_`; the value the worker was
+  // constructed with.
+  const int64_t max_samples_per_request_;
+
+  // The maximum number of samples to request in a "batch". May be lowered at
+  // runtime through `SetMaxInFlightSamples`.
+  std::atomic<int64_t> samples_per_request_;
+
+  // Number of chunks each end of a stream caches; 0 disables the cache. See
+  // `Sampler::Options::chunk_cache_size`.
+  const int chunk_cache_size_;
+
+  // Persistent chunk cache shared by the workers of the sampler; nullptr
+  // unless `Sampler::Options::disk_cache_dir` was set. See
+  // `SampleStreamRequest.disk_cached_chunk_keys`.
+  const std::shared_ptr<internal::ChunkDiskCache> disk_cache_;
+
+  // Whether chunk payloads are requested out of band through shared memory.
+  // See `Sampler::Options::shm_transport`.
+  const bool shm_transport_;
+
+  // Server arena mapped read only; attached lazily when the first shm chunk
+  // reference arrives. Only accessed while consuming stream responses, which
+  // happens on one thread at a time per worker.
+  std::unique_ptr<internal::ShmArena> shm_arena_;
+
+  // Executor that the reactor based fetch path runs its potentially blocking
+  // steps on; nullptr unless `Sampler::Options::fetch_executor` was set.
+  // `FetchSamplesAsync` falls back to the blocking implementation when
+  // nullptr.
+  const std::shared_ptr<TaskExecutor> fetch_executor_;
+
+  // Selector shared by the workers of the sampler when the stubs are
+  // replicas of the same data; nullptr otherwise. When set, every stream
+  // picks its stub through the selector instead of using `stub_`. See
+  // `Sampler::Options::stubs_are_replicas`.
+  const std::shared_ptr<ReplicaSelector> replicas_;
+
+  // Time a fresh stream may go without a first response before being
+  // retried on the alternate replica. See
+  // `Sampler::Options::replica_hedge_timeout`.
+  const absl::Duration hedge_timeout_;
 
   // Number of reserved slots in the queue;
   int64_t reserved_slots_;
@@ -327,15 +846,215 @@ class GrpcSamplerWorker : public SamplerWorker {
   absl::Mutex mu_;
 };
 
+// Runs a single fetch (one `SampleStream` stream) of a `GrpcSamplerWorker` as
+// a state machine on the gRPC callback API. Message processing runs on gRPC's
+// callback threads while the steps that may block on queue backpressure
+// (reserving slots before requesting the next batch) are scheduled on the
+// worker's fetch executor, so hundreds of open streams are driven by a
+// handful of threads. The worker only keeps the `ClientContext` of the stream
+// so that `Cancel` can abort it; the reactor destroys itself once the final
+// result has been delivered through `done`.
+class GrpcSamplerWorker::SampleStreamReactor
+    : public grpc::ClientBidiReactor<SampleStreamRequest,
+                                     SampleStreamResponse> {
+ public:
+  SampleStreamReactor(GrpcSamplerWorker* worker,
+                      internal::Queue<std::unique_ptr<Sample>>* queue,
+                      int64_t num_samples, absl::Duration rate_limiter_timeout,
+                      SamplerWorker::FetchDoneCallback done)
+      : worker_(worker),
+        queue_(queue),
+        num_samples_(num_samples),
+        rate_limiter_timeout_(rate_limiter_timeout),
+        done_(std::move(done)) {}
+
+  // Reserves the queue slots of the first batch and starts the call. Called
+  // from the fetch executor so the reservation may block. The reactor may be
+  // destroyed before this returns; the caller must not touch it afterwards.
+  void Start() {
+    grpc::ClientContext* context = nullptr;
+    {
+      absl::MutexLock lock(&worker_->mu_);
+      if (!worker_->closed_) {
+        worker_->context_ = absl::make_unique<grpc::ClientContext>();
+        worker_->context_->set_wait_for_ready(false);
+        context = worker_->context_.get();
+      }
+    }
+    if (context == nullptr) {
+      FinishWithoutCall(absl::CancelledError("`Close` called on Sampler."));
+      return;
+    }
+    if (!worker_->PrepareNextRequest(&state_, queue_, num_samples_,
+                                     rate_limiter_timeout_, &request_)) {
+      FinishWithoutCall(absl::CancelledError("`Close` called on Sampler"));
+      return;
+    }
+    worker_->stub_->async()->SampleStream(context, this);
+    // A hold is required since the writes of follow-up batches are started
+    // from the fetch executor rather than from a reaction.
+    AddHold();
+    StartWrite(&request_);
+    StartRead(&response_);
+    StartCall();
+  }
+
+  void OnWriteDone(bool ok) override {
+    // Reads drive the state machine; a failed write surfaces as a failed
+    // read followed by `OnDone`.
+  }
+
+  void OnReadDone(bool ok) override {
+    if (!ok) {
+      // The stream was closed by the server, by a connection failure or by
+      // `Cancel`; the final status arrives in `OnDone`.
+      RemoveHold();
+      return;
+    }
+    if (auto status = worker_->ConsumeResponse(&response_, &state_, queue_);
+        !status.ok()) {
+      Terminate(std::move(status));
+      return;
+    }
+    if (state_.sampled < request_.num_samples()) {
+      StartRead(&response_);
+      return;
+    }
+    if (!state_.parts_of_next_sample.empty()) {
+      Terminate(absl::InternalError(
+          "Streamed responses included unattributed SampleEntry."));
+      return;
+    }
+    if (state_.num_samples_returned == num_samples_) {
+      // All requested samples have been received. Drop the stream just like
+      // the blocking worker does instead of waiting for the server to
+      // acknowledge a graceful shutdown.
+      Terminate(absl::OkStatus());
+      return;
+    }
+    // Reserving the slots of the next batch can block on queue backpressure
+    // so it runs on the fetch executor instead of a gRPC callback thread.
+    worker_->fetch_executor_->Schedule([this] { StartNextBatch(); });
+  }
+
+  void OnDone(const grpc::Status& status) override {
+    absl::Status result;
+    if (result_.has_value()) {
+      result = *result_;
+    } else {
+      result = FromGrpcStatus(status);
+      if (errors::IsRateLimiterTimeout(result) &&
+          queue_->num_waiting_to_pop() < 1) {
+        // The rate limiter timed out but no one is waiting for new data, so
+        // we can exit with an OkStatus and get restarted with a new stream.
+        result = absl::OkStatus();
+      }
+    }
+    const int64_t num_samples_returned = state_.num_samples_returned;
+    auto done = std::move(done_);
+    delete this;
+    done(num_samples_returned, std::move(result));
+  }
+
+ private:
+  // Reserves the slots of the next batch and starts its write and the next
+  // read. Runs on the fetch executor; the pending hold keeps `OnDone` from
+  // being delivered while no operation is in flight.
+  void StartNextBatch() {
+    if (!worker_->PrepareNextRequest(&state_, queue_, num_samples_,
+                                     rate_limiter_timeout_, &request_)) {
+      Terminate(absl::CancelledError("`Close` called on Sampler"));
+      return;
+    }
+    StartWrite(&request_);
+    StartRead(&response_);
+  }
+
+  // Ends the fetch with `result`, overriding whatever status the aborted
+  // stream itself produces.
+  void Terminate(absl::Status result) {
+    result_ = std::move(result);
+    {
+      absl::MutexLock lock(&worker_->mu_);
+      if (worker_->context_ != nullptr) worker_->context_->TryCancel();
+    }
+    RemoveHold();
+  }
+
+  // Delivers `result` without the call having been started. Only valid
+  // before `StartCall`; `OnDone` will never run so the reactor destroys
+  // itself here.
+  void FinishWithoutCall(absl::Status result) {
+    const int64_t num_samples_returned = state_.num_samples_returned;
+    auto done = std::move(done_);
+    delete this;
+    done(num_samples_returned, std::move(result));
+  }
+
+  GrpcSamplerWorker* const worker_;
+  internal::Queue<std::unique_ptr<Sample>>* const queue_;
+  const int64_t num_samples_;
+  const absl::Duration rate_limiter_timeout_;
+  SamplerWorker::FetchDoneCallback done_;
+
+  // Per stream state shared with the blocking fetch path.
+  StreamState state_;
+  SampleStreamRequest request_;
+  SampleStreamResponse response_;
+
+  // Set when the fetch is terminated from the client side; overrides the
+  // status of the (then cancelled) stream in `OnDone`.
+  absl::optional<absl::Status> result_;
+};
+
+void GrpcSamplerWorker::FetchSamplesAsync(
+    internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
+    absl::Duration rate_limiter_timeout, FetchDoneCallback done) {
+  if (fetch_executor_ == nullptr) {
+    SamplerWorker::FetchSamplesAsync(queue, num_samples, rate_limiter_timeout,
+                                     std::move(done));
+    return;
+  }
+  if (replicas_ != nullptr) {
+    // A worker drives at most one fetch at a time so the stub of the stream
+    // can simply be swapped in before the reactor starts. The fetch latency
+    // is folded back into the selector when the reactor delivers its result.
+    int replica;
+    int alternate;
+    replicas_->PickPair(&replica, &alternate);
+    replicas_->StreamStarted(replica);
+    stub_ = replicas_->stub(replica);
+    done = [this, replica, start = absl::Now(), done = std::move(done)](
+               int64_t num_samples_returned, absl::Status status) {
+      replicas_->StreamFinished(replica, absl::Now() - start,
+                                num_samples_returned, status.ok());
+      done(num_samples_returned, std::move(status));
+    };
+  }
+  // The reactor owns itself; it is destroyed once `done` has been invoked.
+  auto* reactor = new SampleStreamReactor(this, queue, num_samples,
+                                          rate_limiter_timeout,
+                                          std::move(done));
+  reactor->Start();
+}
+
 class LocalSamplerWorker : public SamplerWorker {
  public:
   // Constructs a new worker without creating a stream to a server.
   LocalSamplerWorker(std::shared_ptr<Table> table,
                      int max_in_flight_samples)
       : table_(table),
+        hard_max_in_flight_samples_(max_in_flight_samples),
         max_in_flight_samples_(max_in_flight_samples),
         reserved_slots_(0) {
-    REVERB_CHECK_GE(max_in_flight_samples_, 1);
+    REVERB_CHECK_GE(hard_max_in_flight_samples_, 1);
+  }
+
+  void SetMaxInFlightSamples(int64_t max_in_flight_samples) override {
+    max_in_flight_samples_.store(
+        std::max<int64_t>(
+            1, std::min(max_in_flight_samples, hard_max_in_flight_samples_)),
+        std::memory_order_relaxed);
   }
 
   void Cancel() override {
@@ -370,10 +1089,10 @@ class LocalSamplerWorker : public SamplerWorker {
 
       // Try to double previously returned response batch size while not
       // exceeding the limits.
-      auto batch_size =
-          std::min<int64_t>(max_in_flight_samples_,
-                          std::min<int64_t>(2 * prev_batch_size,
-                                          num_samples - num_samples_returned));
+      auto batch_size = std::min<int64_t>(
+          max_in_flight_samples_.load(std::memory_order_relaxed),
+          std::min<int64_t>(2 * prev_batch_size,
+                            num_samples - num_samples_returned));
       // Reservation can be negative if previously reserved slots are being
       // returned.
       if (!queue->Reserve(batch_size - reserved_slots_)) {
@@ -440,7 +1159,14 @@ class LocalSamplerWorker : public SamplerWorker {
 
  private:
   std::shared_ptr<Table> table_;
-  const int64_t max_in_flight_samples_;
+
+  // Upper bound for `max_in_flight_samples_`; the value the worker was
+  // constructed with.
+  const int64_t hard_max_in_flight_samples_;
+
+  // May be lowered at runtime through `SetMaxInFlightSamples`.
+  std::atomic<int64_t> max_in_flight_samples_;
+
   int64_t reserved_slots_;
   bool closed_ ABSL_GUARDED_BY(mu_) = false;
   absl::Mutex mu_;
@@ -462,16 +1188,91 @@ int64_t GetNumWorkers(const Sampler::Options& options) {
                       max_samples / options.max_in_flight_samples_per_worker));
 }
 
+// Opens the disk cache configured in `options`. Returns nullptr if the cache
+// is disabled or cannot be opened; sampling then proceeds without it.
+std::shared_ptr<internal::ChunkDiskCache> MaybeOpenDiskCache(
+    const Sampler::Options& options) {
+  if (options.disk_cache_dir.empty()) return nullptr;
+  std::unique_ptr<internal::ChunkDiskCache> cache;
+  if (absl::Status status =
+          internal::ChunkDiskCache::Open(options.disk_cache_dir, &cache);
+      !status.ok()) {
+    REVERB_LOG(REVERB_WARNING)
+        << "Failed to open sample disk cache at " << options.disk_cache_dir
+        << ": " << status.ToString() << ". Sampling proceeds without it.";
+    return nullptr;
+  }
+  return cache;
+}
+
 std::vector<std::unique_ptr<SamplerWorker>> MakeGrpcWorkers(
     std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub,
     const std::string& table_name, const Sampler::Options& options) {
   int64_t num_workers = GetNumWorkers(options);
   REVERB_CHECK_GE(num_workers, 1);
+  std::shared_ptr<internal::ChunkDiskCache> disk_cache =
+      MaybeOpenDiskCache(options);
+  std::vector<std::unique_ptr<SamplerWorker>> workers;
+  workers.reserve(num_workers);
+  for (int i = 0; i < num_workers; i++) {
+    workers.push_back(absl::make_unique<GrpcSamplerWorker>(
+        stub, table_name, options.max_in_flight_samples_per_worker,
+        options.chunk_cache_size, disk_cache, options.shm_transport,
+        options.fetch_executor));
+  }
+
+  return workers;
+}
+
+// Returns `options` with `num_workers` defaulted to one worker per stub.
+Sampler::Options ShardedOptions(Sampler::Options options, size_t num_stubs) {
+  if (options.num_workers == Sampler::kAutoSelectValue) {
+    options.num_workers = num_stubs;
+  }
+  return options;
+}
+
+std::vector<std::unique_ptr<SamplerWorker>> MakeShardedGrpcWorkers(
+    const std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>&
+        stubs,
+    const std::string& table_name, const Sampler::Options& options) {
+  REVERB_CHECK(!stubs.empty());
+  int64_t num_workers = GetNumWorkers(options);
+  REVERB_CHECK_GE(num_workers, 1);
+  std::shared_ptr<internal::ChunkDiskCache> disk_cache =
+      MaybeOpenDiskCache(options);
+  std::vector<std::unique_ptr<SamplerWorker>> workers;
+  workers.reserve(num_workers);
+  for (int i = 0; i < num_workers; i++) {
+    workers.push_back(absl::make_unique<GrpcSamplerWorker>(
+        stubs[i % stubs.size()], table_name,
+        options.max_in_flight_samples_per_worker, options.chunk_cache_size,
+        disk_cache, options.shm_transport, options.fetch_executor));
+  }
+
+  return workers;
+}
+
+std::vector<std::unique_ptr<SamplerWorker>> MakeReplicatedGrpcWorkers(
+    std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+        stubs,
+    const std::string& table_name, const Sampler::Options& options) {
+  REVERB_CHECK(!stubs.empty());
+  int64_t num_workers = GetNumWorkers(options);
+  REVERB_CHECK_GE(num_workers, 1);
+  std::shared_ptr<internal::ChunkDiskCache> disk_cache =
+      MaybeOpenDiskCache(options);
+  // All workers share the selector so the load estimate covers every open
+  // stream of the sampler.
+  auto replicas = std::make_shared<ReplicaSelector>(std::move(stubs));
   std::vector<std::unique_ptr<SamplerWorker>> workers;
   workers.reserve(num_workers);
   for (int i = 0; i < num_workers; i++) {
     workers.push_back(absl::make_unique<GrpcSamplerWorker>(
-        stub, table_name, options.max_in_flight_samples_per_worker));
+        replicas->stub(0), table_name,
+        options.max_in_flight_samples_per_worker, options.chunk_cache_size,
+        disk_cache, options.shm_transport, options.fetch_executor, replicas,
+        options.replica_hedge_timeout));
   }
 
   return workers;
@@ -493,12 +1294,31 @@ std::vector<std::unique_ptr<SamplerWorker>> MakeLocalWorkers(
 
 }  // namespace
 
+void SamplerWorker::FetchSamplesAsync(
+    internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
+    absl::Duration rate_limiter_timeout, FetchDoneCallback done) {
+  auto result = FetchSamples(queue, num_samples, rate_limiter_timeout);
+  done(result.first, std::move(result.second));
+}
+
 Sampler::Sampler(std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub,
                  const std::string& table_name, const Options& options,
                  internal::DtypesAndShapes dtypes_and_shapes)
     : Sampler(MakeGrpcWorkers(std::move(stub), table_name, options), table_name,
               options, std::move(dtypes_and_shapes)) {}
 
+Sampler::Sampler(
+    std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>> stubs,
+    const std::string& table_name, const Options& options,
+    internal::DtypesAndShapes dtypes_and_shapes)
+    : Sampler(options.stubs_are_replicas
+                  ? MakeReplicatedGrpcWorkers(
+                        stubs, table_name, ShardedOptions(options, stubs.size()))
+                  : MakeShardedGrpcWorkers(
+                        stubs, table_name, ShardedOptions(options, stubs.size())),
+              table_name, ShardedOptions(options, stubs.size()),
+              std::move(dtypes_and_shapes)) {}
+
 Sampler::Sampler(std::vector<std::unique_ptr<SamplerWorker>> workers,
                  const std::string& table, const Options& options,
                  internal::DtypesAndShapes dtypes_and_shapes)
@@ -514,15 +1334,36 @@ Sampler::Sampler(std::vector<std::unique_ptr<SamplerWorker>> workers,
       active_sample_(nullptr),
       samples_(options.max_in_flight_samples_per_worker *
                GetNumWorkers(options)),
-      dtypes_and_shapes_(std::move(dtypes_and_shapes)) {
+      dtypes_and_shapes_(std::move(dtypes_and_shapes)),
+      compiled_signature_(internal::CompileSignature(dtypes_and_shapes_)),
+      unpack_executor_(options.unpack_executor),
+      output_allocator_(options.output_allocator),
+      fetch_executor_(options.fetch_executor),
+      adaptive_in_flight_samples_(options.adaptive_in_flight_samples),
+      max_in_flight_samples_per_worker_(
+          options.max_in_flight_samples_per_worker),
+      target_buffer_fill_(std::max<int64_t>(
+          1, options.target_buffer_fill *
+                 options.max_in_flight_samples_per_worker *
+                 GetNumWorkers(options))),
+      in_flight_budget_(options.max_in_flight_samples_per_worker),
+      max_in_flight_bytes_per_worker_(options.max_in_flight_bytes_per_worker) {
   REVERB_CHECK_GT(max_samples_, 0);
   REVERB_CHECK_GT(options.max_in_flight_samples_per_worker, 0);
   REVERB_CHECK(options.num_workers == kAutoSelectValue ||
                options.num_workers > 0);
 
+  if (fetch_executor_ != nullptr) {
+    absl::WriterMutexLock lock(&mu_);
+    for (auto& worker : workers_) {
+      ScheduleFetchRound(worker.get(), kMinRetryBackoff);
+    }
+    return;
+  }
+
   for (int i = 0; i < workers_.size(); i++) {
     worker_threads_.push_back(internal::StartThread(
-        absl::StrCat("SamplerWorker_", i),
+        absl::StrCat("SamplerWorker_", i), options.worker_thread_options,
         [this, worker = workers_[i].get()] { RunWorker(worker); }));
   }
 }
@@ -532,11 +1373,19 @@ Sampler::Sampler(std::shared_ptr<Table> table, const Options& options,
     : Sampler(MakeLocalWorkers(table, options), table->name(), options,
               std::move(dtypes_and_shapes)) {}
 
-Sampler::~Sampler() { Close(); }
+Sampler::~Sampler() {
+  Close();
+  // A pending background prematerialization references a sample owned by
+  // `prefetched_samples_`; join it before the buffer is destroyed.
+  if (prematerializing_sample_ != nullptr) {
+    prematerializing_sample_->WaitForPrematerialization();
+  }
+}
 
 absl::Status Sampler::GetNextTimestep(std::vector<tensorflow::Tensor>* data,
                                       bool* end_of_sequence,
-                                      bool* rate_limited) {
+                                      bool* rate_limited,
+                                      Sample::ServerTiming* server_timing) {
   REVERB_RETURN_IF_ERROR(MaybeSampleNext());
   if (!active_sample_->is_composed_of_timesteps()) {
     return absl::InvalidArgumentError(
@@ -546,6 +1395,9 @@ absl::Status Sampler::GetNextTimestep(std::vector<tensorflow::Tensor>* data,
   if (rate_limited != nullptr) {
     *rate_limited = active_sample_->rate_limited();
   }
+  if (server_timing != nullptr) {
+    *server_timing = active_sample_->server_timing();
+  }
 
   *data = active_sample_->GetNextTimestep();
   REVERB_RETURN_IF_ERROR(
@@ -564,7 +1416,8 @@ absl::Status Sampler::GetNextTimestep(std::vector<tensorflow::Tensor>* data,
 }
 
 absl::Status Sampler::GetNextSample(std::vector<tensorflow::Tensor>* data,
-                                    bool* rate_limited) {
+                                    bool* rate_limited,
+                                    Sample::ServerTiming* server_timing) {
   std::unique_ptr<Sample> sample;
   REVERB_RETURN_IF_ERROR(PopNextSample(&sample));
   REVERB_RETURN_IF_ERROR(sample->AsBatchedTimesteps(data));
@@ -574,6 +1427,9 @@ absl::Status Sampler::GetNextSample(std::vector<tensorflow::Tensor>* data,
   if (rate_limited != nullptr) {
     *rate_limited = sample->rate_limited();
   }
+  if (server_timing != nullptr) {
+    *server_timing = sample->server_timing();
+  }
 
   absl::WriterMutexLock lock(&mu_);
   if (++returned_ == max_samples_) samples_.Close();
@@ -581,7 +1437,8 @@ absl::Status Sampler::GetNextSample(std::vector<tensorflow::Tensor>* data,
 }
 
 absl::Status Sampler::GetNextTrajectory(std::vector<tensorflow::Tensor>* data,
-                                        bool* rate_limited) {
+                                        bool* rate_limited,
+                                        Sample::ServerTiming* server_timing) {
   std::unique_ptr<Sample> sample;
   REVERB_RETURN_IF_ERROR(PopNextSample(&sample));
   REVERB_RETURN_IF_ERROR(sample->AsTrajectory(data));
@@ -591,12 +1448,97 @@ absl::Status Sampler::GetNextTrajectory(std::vector<tensorflow::Tensor>* data,
   if (rate_limited != nullptr) {
     *rate_limited = sample->rate_limited();
   }
+  if (server_timing != nullptr) {
+    *server_timing = sample->server_timing();
+  }
 
   absl::WriterMutexLock lock(&mu_);
   if (++returned_ == max_samples_) samples_.Close();
   return absl::OkStatus();
 }
 
+absl::Status Sampler::GetNextTrajectoryBatch(
+    int num_samples, std::vector<tensorflow::Tensor>* data,
+    bool* rate_limited) {
+  if (num_samples < 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("num_samples (", num_samples, ") must be >= 1"));
+  }
+
+  std::vector<std::vector<tensorflow::Tensor>> trajectories;
+  trajectories.reserve(num_samples);
+  bool batch_rate_limited = false;
+
+  for (int i = 0; i < num_samples; i++) {
+    std::unique_ptr<Sample> sample;
+    if (auto status = PopNextSample(&sample); !status.ok()) {
+      // Return the partial batch; a persistent error resurfaces on the next
+      // call.
+      if (!trajectories.empty()) break;
+      return status;
+    }
+    batch_rate_limited |= sample->rate_limited();
+
+    // The batch is stacked into freshly allocated tensors below so copying
+    // the individual trajectories into the output allocator first would be
+    // wasted work; the allocator is instead applied to the stacked columns.
+    sample->SetOutputAllocator(nullptr);
+
+    std::vector<tensorflow::Tensor> trajectory;
+    REVERB_RETURN_IF_ERROR(sample->AsTrajectory(&trajectory));
+    REVERB_RETURN_IF_ERROR(
+        ValidateAgainstOutputSpec(trajectory, ValidationMode::kTrajectory));
+    trajectories.push_back(std::move(trajectory));
+
+    absl::WriterMutexLock lock(&mu_);
+    if (++returned_ == max_samples_) samples_.Close();
+  }
+
+  const int num_columns = trajectories.front().size();
+  data->clear();
+  data->reserve(num_columns);
+
+  std::vector<tensorflow::Tensor> column;
+  column.reserve(trajectories.size());
+  for (int i = 0; i < num_columns; i++) {
+    const tensorflow::Tensor& first = trajectories.front()[i];
+    tensorflow::TensorShape expanded_shape = first.shape();
+    expanded_shape.InsertDim(0, 1);
+
+    column.clear();
+    for (auto& trajectory : trajectories) {
+      tensorflow::Tensor& tensor = trajectory[i];
+      if (tensor.dtype() != first.dtype() || tensor.shape() != first.shape()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Cannot stack sampled trajectories as column ", i,
+            " has (dtype, shape): (", tensorflow::DataTypeString(first.dtype()),
+            ", ", first.shape().DebugString(), ") in one trajectory and (",
+            tensorflow::DataTypeString(tensor.dtype()), ", ",
+            tensor.shape().DebugString(), ") in another."));
+      }
+      // Only the shape changes so the buffer is shared rather than copied.
+      tensorflow::Tensor expanded;
+      REVERB_CHECK(expanded.CopyFrom(tensor, expanded_shape));
+      column.push_back(std::move(expanded));
+    }
+
+    tensorflow::Tensor stacked;
+    REVERB_RETURN_IF_ERROR(
+        FromTensorflowStatus(tensorflow::tensor::Concat(column, &stacked)));
+    data->push_back(std::move(stacked));
+  }
+
+  if (output_allocator_ != nullptr) {
+    CopyToOutputAllocator(output_allocator_, data);
+  }
+
+  if (rate_limited != nullptr) {
+    *rate_limited = batch_rate_limited;
+  }
+
+  return absl::OkStatus();
+}
+
 absl::Status Sampler::ValidateAgainstOutputSpec(
     const std::vector<tensorflow::Tensor>& data, Sampler::ValidationMode mode) {
   if (!dtypes_and_shapes_) {
@@ -614,30 +1556,31 @@ absl::Status Sampler::ValidateAgainstOutputSpec(
         internal::DtypesShapesString(internal::SpecsFromTensors(data))));
   }
 
-  for (int i = 4; i < data.size(); ++i) {
-    tensorflow::TensorShape elem_shape;
-    if (mode == ValidationMode::kBatchedTimestep) {
-      // Remove the outer dimension from data[i].shape() so we can properly
-      // compare against the spec (which doesn't have the sequence dimension).
-      elem_shape = data[i].shape();
-      if (elem_shape.dims() == 0) {
-        return absl::InvalidArgumentError(
-            absl::StrCat("Invalid tensor shape received from table '", table_,
-                         "'.  "
-                         "time_step is false but data[",
-                         i,
-                         "] has scalar shape "
-                         "(no time dimension)."));
-      }
-      elem_shape.RemoveDim(0);
+  const bool skip_leading_dim = mode == ValidationMode::kBatchedTimestep;
+  const std::vector<internal::CompiledColumnSpec>& columns =
+      *compiled_signature_;
+  for (int i = Sample::kNumInfoTensors; i < data.size(); ++i) {
+    if (skip_leading_dim && data[i].shape().dims() == 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid tensor shape received from table '", table_,
+                       "'.  "
+                       "time_step is false but data[",
+                       i,
+                       "] has scalar shape "
+                       "(no time dimension)."));
     }
 
-    auto* shape_ptr =
-        mode == ValidationMode::kTimestep || mode == ValidationMode::kTrajectory
-            ? &(data[i].shape())
-            : &elem_shape;
-    if (data[i].dtype() != dtypes_and_shapes_->at(i).dtype ||
-        !dtypes_and_shapes_->at(i).shape.IsCompatibleWith(*shape_ptr)) {
+    if (!internal::TensorMatchesColumnSpec(data[i], columns[i],
+                                           skip_leading_dim)) {
+      // Only the error message needs the shape objects, so they are
+      // materialised here and not on the hot path.
+      tensorflow::TensorShape elem_shape = data[i].shape();
+      if (skip_leading_dim) {
+        // Remove the outer dimension from data[i].shape() so we can properly
+        // report it against the spec (which doesn't have the sequence
+        // dimension).
+        elem_shape.RemoveDim(0);
+      }
       return absl::InvalidArgumentError(absl::StrCat(
           "Received incompatible tensor at flattened index ", i,
           " from table '", table_, "'.  Specification has (dtype, shape): (",
@@ -645,7 +1588,7 @@ absl::Status Sampler::ValidateAgainstOutputSpec(
           dtypes_and_shapes_->at(i).shape.DebugString(),
           ").  Tensor has (dtype, shape): (",
           tensorflow::DataTypeString(data[i].dtype()), ", ",
-          shape_ptr->DebugString(), ").\nTable signature: ",
+          elem_shape.DebugString(), ").\nTable signature: ",
           internal::DtypesShapesString(*dtypes_and_shapes_)));
     }
   }
@@ -669,6 +1612,17 @@ void Sampler::Close() {
 
   samples_.Close();
   worker_threads_.clear();  // Joins worker threads.
+
+  if (fetch_executor_ != nullptr) {
+    // Wait for fetch rounds scheduled on the shared executor to observe the
+    // cancellation and retire. Parked workers hold no active round so they
+    // are simply never rescheduled.
+    absl::WriterMutexLock lock(&mu_);
+    auto all_retired = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return active_fetches_ == 0;
+    };
+    mu_.Await(absl::Condition(&all_retired));
+  }
 }
 
 absl::Status Sampler::MaybeSampleNext() {
@@ -680,7 +1634,40 @@ absl::Status Sampler::MaybeSampleNext() {
 }
 
 absl::Status Sampler::PopNextSample(std::unique_ptr<Sample>* sample) {
-  if (samples_.Pop(sample)) return absl::OkStatus();
+  if (prefetched_index_ == prefetched_samples_.size()) {
+    prefetched_samples_.clear();
+    prefetched_index_ = 0;
+    samples_.PopBatchUpTo(kMaxPrefetchedSamples, &prefetched_samples_);
+  }
+  if (prefetched_index_ < prefetched_samples_.size()) {
+    *sample = std::move(prefetched_samples_[prefetched_index_++]);
+    if (sample->get() == prematerializing_sample_) {
+      (*sample)->WaitForPrematerialization();
+      prematerializing_sample_ = nullptr;
+    }
+    if (adaptive_in_flight_samples_) {
+      AdaptInFlightSamples(**sample);
+    } else if (max_in_flight_bytes_per_worker_ > 0) {
+      AdaptInFlightBytes(**sample);
+    }
+    if (unpack_executor_ != nullptr) {
+      (*sample)->EnableParallelUnpacking(unpack_executor_);
+    }
+    if (output_allocator_ != nullptr) {
+      (*sample)->SetOutputAllocator(output_allocator_);
+    }
+    // While the caller consumes the sample just popped, decompress the next
+    // sample's chunks in the background so chunk decoding overlaps with
+    // emission instead of alternating with it. Only one sample is
+    // prematerialized ahead, bounding the extra memory by a single
+    // uncompressed sample.
+    if (unpack_executor_ != nullptr &&
+        prefetched_index_ < prefetched_samples_.size()) {
+      prematerializing_sample_ = prefetched_samples_[prefetched_index_].get();
+      prematerializing_sample_->PrematerializeAsync(unpack_executor_.get());
+    }
+    return absl::OkStatus();
+  }
 
   absl::ReaderMutexLock lock(&mu_);
   if (returned_ == max_samples_) {
@@ -692,6 +1679,69 @@ absl::Status Sampler::PopNextSample(std::unique_ptr<Sample>* sample) {
   return worker_status_;
 }
 
+void Sampler::AdaptInFlightSamples(const Sample& sample) {
+  occupancy_sum_ +=
+      samples_.size() +
+      static_cast<int64_t>(prefetched_samples_.size() - prefetched_index_);
+  rate_limited_in_window_ |= sample.rate_limited();
+  if (++adaptation_pops_ < kAdaptationWindow) {
+    return;
+  }
+
+  const int64_t average_occupancy = occupancy_sum_ / adaptation_pops_;
+  int64_t budget = in_flight_budget_;
+  if (average_occupancy > target_buffer_fill_) {
+    // The buffer runs above target so samples are fetched faster than the
+    // consumer absorbs them. Oversampling needlessly consumes rate limiter
+    // budget (and memory) so back off.
+    budget = std::max<int64_t>(1, budget / 2);
+  } else if (average_occupancy < target_buffer_fill_ / 2 &&
+             !rate_limited_in_window_) {
+    // The buffer runs dry even though the table is not blocking samples, so
+    // the workers are the bottleneck. Allow more samples in flight. If the
+    // window saw rate limited samples then fetching is gated by the table
+    // and a bigger budget would not fill the buffer any faster.
+    budget = std::min(max_in_flight_samples_per_worker_, 2 * budget);
+  }
+
+  if (budget != in_flight_budget_) {
+    in_flight_budget_ = budget;
+    for (auto& worker : workers_) {
+      worker->SetMaxInFlightSamples(budget);
+    }
+  }
+
+  occupancy_sum_ = 0;
+  adaptation_pops_ = 0;
+  rate_limited_in_window_ = false;
+}
+
+void Sampler::AdaptInFlightBytes(const Sample& sample) {
+  // Samples without size information (servers or chunks predating the
+  // SampleInfo byte fields) leave the estimate untouched; until the first
+  // sized sample arrives the count-based bound applies unchanged.
+  const int64_t bytes = sample.chunk_compressed_bytes();
+  if (bytes <= 0) return;
+
+  // An EMA over ~64 samples: stable against single outliers but quick to
+  // follow a shift in the sampled item-size distribution.
+  constexpr double kAlpha = 1.0 / 64;
+  bytes_per_sample_ = bytes_per_sample_ == 0
+                          ? static_cast<double>(bytes)
+                          : (1 - kAlpha) * bytes_per_sample_ + kAlpha * bytes;
+
+  const int64_t budget = std::min(
+      max_in_flight_samples_per_worker_,
+      std::max<int64_t>(1, static_cast<int64_t>(max_in_flight_bytes_per_worker_ /
+                                                bytes_per_sample_)));
+  if (budget != in_flight_budget_) {
+    in_flight_budget_ = budget;
+    for (auto& worker : workers_) {
+      worker->SetMaxInFlightSamples(budget);
+    }
+  }
+}
+
 void Sampler::RunWorker(SamplerWorker* worker) {
   auto progress_trigger = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
     return should_stop_workers() || requested_ < max_samples_;
@@ -745,8 +1795,118 @@ void Sampler::RunWorker(SamplerWorker* worker) {
   }
 }
 
+void Sampler::ScheduleFetchRound(SamplerWorker* worker,
+                                 absl::Duration retry_backoff) {
+  active_fetches_++;
+  fetch_executor_->Schedule([this, worker, retry_backoff] {
+    FetchRound(worker, retry_backoff);
+  });
+}
+
+void Sampler::FetchRound(SamplerWorker* worker, absl::Duration retry_backoff) {
+  absl::Time start_time = absl::Now();
+  int64_t samples_to_stream;
+  {
+    absl::WriterMutexLock lock(&mu_);
+    if (retry_backoff > kMinRetryBackoff) {
+      // The previous round of the worker failed transiently. Use exponential
+      // backoff to avoid burning CPU cycles when the server is not
+      // available. This briefly occupies an executor thread but is bounded
+      // by `kMaxRetryBackoff`.
+      mu_.AwaitWithTimeout(absl::Condition(this, &Sampler::should_stop_workers),
+                           retry_backoff);
+    }
+    if (should_stop_workers()) {
+      active_fetches_--;
+      return;
+    }
+    if (requested_ >= max_samples_) {
+      // All remaining samples have been requested by other fetch rounds. Park
+      // the worker; it is rescheduled if `requested_` backtracks.
+      parked_workers_.push_back({worker, retry_backoff});
+      active_fetches_--;
+      return;
+    }
+
+    samples_to_stream =
+        std::min<int64_t>(max_samples_per_stream_, max_samples_ - requested_);
+    requested_ += samples_to_stream;
+  }
+
+  // The round completes through `FinishFetchRound`, possibly on a gRPC
+  // callback thread; `active_fetches_` stays incremented until then so that
+  // `Close` waits for in-flight streams.
+  worker->FetchSamplesAsync(
+      &samples_, samples_to_stream, rate_limiter_timeout_,
+      [this, worker, retry_backoff, start_time, samples_to_stream](
+          int64_t num_returned, absl::Status status) {
+        FinishFetchRound(worker, retry_backoff, start_time, samples_to_stream,
+                         num_returned, std::move(status));
+      });
+}
+
+void Sampler::FinishFetchRound(SamplerWorker* worker,
+                               absl::Duration retry_backoff,
+                               absl::Time start_time,
+                               int64_t samples_to_stream, int64_t num_returned,
+                               absl::Status status) {
+  absl::WriterMutexLock lock(&mu_);
+
+  // If the stream was closed prematurely then we need to reduce the number
+  // of requested samples by the difference of the expected number and the
+  // actual.
+  requested_ -= samples_to_stream - num_returned;
+
+  // If `requested_` backtracked then progress became possible again for
+  // workers that were parked when all remaining samples were accounted for.
+  if (num_returned < samples_to_stream && !parked_workers_.empty()) {
+    for (const auto& parked : parked_workers_) {
+      ScheduleFetchRound(parked.first, parked.second);
+    }
+    parked_workers_.clear();
+  }
+
+  // Overwrite the final status only if it wasn't already an error.
+  if (!status.ok() && worker_status_.ok() && !absl::IsUnavailable(status) &&
+      !absl::IsCancelled(status)) {
+    worker_status_ = status;
+    samples_.Close();
+    active_fetches_--;
+    return;
+  }
+
+  if (absl::IsUnavailable(status) || absl::IsCancelled(status)) {
+    // The next round backs off before opening a new stream. The wait happens
+    // at the start of the round since this method may run on a gRPC callback
+    // thread which must not block.
+    retry_backoff = absl::Now() - start_time < kResetBackoffThreshold
+                        ? kMinRetryBackoff
+                        : std::min(kMaxRetryBackoff, 2 * retry_backoff);
+  } else {
+    retry_backoff = kMinRetryBackoff;
+  }
+
+  if (should_stop_workers()) {
+    active_fetches_--;
+    return;
+  }
+
+  // Hand the thread back to the executor between rounds so that other
+  // samplers sharing it get their turn.
+  active_fetches_--;
+  ScheduleFetchRound(worker, retry_backoff);
+}
+
+int64_t Sample::ColumnChunk::num_rows() const {
+  // Note that we can safely assume that the tensor is not a scalar since a
+  // batch dimension is always added when building a chunk. A scalar would
+  // thus be represented as a tensor of shape [1].
+  return tensor.has_value() ? tensor->dim_size(0) : slice.length();
+}
+
 Sample::Sample(tensorflow::uint64 key, double probability,
                tensorflow::int64 table_size, double priority, bool rate_limited,
+               ServerTiming server_timing,
                std::vector<std::vector<tensorflow::Tensor>> column_chunks,
                std::vector<bool> squeeze_columns)
     : key_(key),
@@ -754,6 +1914,7 @@ Sample::Sample(tensorflow::uint64 key, double probability,
       table_size_(table_size),
       priority_(priority),
       rate_limited_(rate_limited),
+      server_timing_(server_timing),
       num_timesteps_(-1),
       squeeze_columns_(std::move(squeeze_columns)),
       next_timestep_called_(false) {
@@ -765,7 +1926,7 @@ Sample::Sample(tensorflow::uint64 key, double probability,
   for (auto& chunks : column_chunks) {
     std::deque<ColumnChunk> slices;
     for (auto& chunk : chunks) {
-      slices.push_back({std::move(chunk), 0});
+      slices.push_back({std::move(chunk), nullptr, {}});
     }
     columns_.push_back(std::move(slices));
   }
@@ -773,12 +1934,118 @@ Sample::Sample(tensorflow::uint64 key, double probability,
   if (is_composed_of_timesteps()) {
     num_timesteps_ = 0;
     for (const auto& column_slice : columns_.front()) {
-      // Note that we can safely assume that the tensor is not a scalar since a
-      // batch dimension is always added when building a chunk. A scalar would
-      // thus be represented as a tensor of shape [1].
-      num_timesteps_ += column_slice.tensor.dim_size(0);
+      num_timesteps_ += column_slice.num_rows();
+    }
+  }
+}
+
+Sample::Sample(tensorflow::uint64 key, double probability,
+               tensorflow::int64 table_size, double priority, bool rate_limited,
+               ServerTiming server_timing,
+               std::vector<std::deque<ColumnChunk>> columns,
+               std::vector<bool> squeeze_columns)
+    : key_(key),
+      probability_(probability),
+      table_size_(table_size),
+      priority_(priority),
+      rate_limited_(rate_limited),
+      server_timing_(server_timing),
+      num_timesteps_(-1),
+      columns_(std::move(columns)),
+      squeeze_columns_(std::move(squeeze_columns)),
+      next_timestep_called_(false) {
+  REVERB_CHECK(!columns_.empty()) << "Must provide at least one column.";
+  REVERB_CHECK(!columns_.front().empty())
+      << "Columns must hold at least one chunk slice.";
+
+  if (is_composed_of_timesteps()) {
+    num_timesteps_ = 0;
+    for (const auto& column_slice : columns_.front()) {
+      num_timesteps_ += column_slice.num_rows();
+    }
+  }
+}
+
+absl::Status Sample::Materialize(ColumnChunk* chunk) {
+  if (chunk->tensor.has_value()) return absl::OkStatus();
+  REVERB_CHECK(chunk->chunk_data != nullptr);
+  chunk->tensor.emplace();
+  // Chunks that were delta encoded against their predecessor can only be
+  // unpacked together with the predecessor's column, which was resolved when
+  // the sample was constructed.
+  if (chunk->baseline_chunk != nullptr) {
+    tensorflow::Tensor baseline;
+    REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumn(
+        *chunk->baseline_chunk, chunk->slice.index(), &baseline));
+    tensorflow::Tensor column;
+    REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumnWithBaseline(
+        *chunk->chunk_data, chunk->slice.index(), baseline, &column));
+    if (chunk->slice.offset() < 0 ||
+        chunk->slice.offset() + chunk->slice.length() >
+            column.shape().dim_size(0)) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Cannot slice (", chunk->slice.offset(), ", ",
+          chunk->slice.offset() + chunk->slice.length(),
+          ") out of tensor with shape ", column.shape().DebugString(), "."));
+    }
+    *chunk->tensor = column.Slice(
+        chunk->slice.offset(), chunk->slice.offset() + chunk->slice.length());
+    if (!chunk->tensor->IsAligned()) {
+      *chunk->tensor = tensorflow::tensor::DeepCopy(*chunk->tensor);
+    }
+    chunk->chunk_data = nullptr;
+    chunk->baseline_chunk = nullptr;
+    return absl::OkStatus();
+  }
+  // Chunks attached to a table level uncompressed cache (see
+  // `Table::EnableUncompressedChunkCache`) are served from the cache; on a
+  // miss the whole chunk is decompressed once and admitted so that later
+  // samples of the same chunk skip the decompression entirely.
+  if (chunk->store_chunk != nullptr) {
+    tensorflow::Tensor column;
+    bool hit = chunk->store_chunk->GetCachedColumn(chunk->slice.index(),
+                                                   &column);
+    if (!hit) {
+      REVERB_RETURN_IF_ERROR(
+          internal::WarmUnpackedColumnCache(chunk->store_chunk));
+      hit = chunk->store_chunk->GetCachedColumn(chunk->slice.index(), &column);
+    }
+    chunk->store_chunk = nullptr;
+    if (hit) {
+      if (chunk->slice.offset() < 0 ||
+          chunk->slice.offset() + chunk->slice.length() >
+              column.shape().dim_size(0)) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Cannot slice (", chunk->slice.offset(), ", ",
+            chunk->slice.offset() + chunk->slice.length(),
+            ") out of tensor with shape ", column.shape().DebugString(), "."));
+      }
+      *chunk->tensor = column.Slice(
+          chunk->slice.offset(),
+          chunk->slice.offset() + chunk->slice.length());
+      if (!chunk->tensor->IsAligned()) {
+        *chunk->tensor = tensorflow::tensor::DeepCopy(*chunk->tensor);
+      }
+      chunk->chunk_data = nullptr;
+      return absl::OkStatus();
     }
+    // The chunk could not be cached (e.g. it was demoted before the column
+    // could be read back); fall through and unpack the slice directly.
+  }
+  // When the slice spans an entire uncompressed chunk the tensor can alias
+  // the chunk's buffer instead of copying it. The tensor then keeps the chunk
+  // alive on its own.
+  if (internal::AliasChunkColumnAndSlice(chunk->chunk_data, chunk->slice,
+                                         &chunk->tensor.value())) {
+    chunk->chunk_data = nullptr;
+    return absl::OkStatus();
   }
+  REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumnAndSlice(
+      *chunk->chunk_data, chunk->slice, &chunk->tensor.value()));
+  // Release the reference to the compressed chunk so its memory can be freed
+  // once the last slice referencing it has been unpacked.
+  chunk->chunk_data = nullptr;
+  return absl::OkStatus();
 }
 
 std::vector<tensorflow::Tensor> Sample::GetNextTimestep() {
@@ -789,24 +2056,32 @@ std::vector<tensorflow::Tensor> Sample::GetNextTimestep() {
 
   // Construct the output tensors.
   std::vector<tensorflow::Tensor> result;
-  result.reserve(columns_.size() + 4);
+  result.reserve(columns_.size() + kNumInfoTensors);
   result.push_back(ScalarTensor(key_));
   result.push_back(ScalarTensor(probability_));
   result.push_back(ScalarTensor(table_size_));
   result.push_back(ScalarTensor(priority_));
+  result.push_back(ScalarTensor(server_timing_.queued_for_secs));
+  result.push_back(ScalarTensor(server_timing_.rate_limiter_wait_secs));
+  result.push_back(ScalarTensor(server_timing_.serialize_time_secs));
 
   for (auto& col : columns_) {
-    auto slice = col.front().tensor.SubSlice(col.front().offset++);
+    REVERB_CHECK_OK(Materialize(&col.front()));
+    auto slice = col.front().tensor->SubSlice(col.front().offset++);
     if (!slice.IsAligned()) {
       slice = tensorflow::tensor::DeepCopy(slice);
     }
     result.push_back(std::move(slice));
 
-    if (col.front().offset == col.front().tensor.dim_size(0)) {
+    if (col.front().offset == col.front().num_rows()) {
       col.pop_front();
     }
   }
 
+  if (output_allocator_ != nullptr) {
+    CopyToOutputAllocator(output_allocator_, &result);
+  }
+
   return result;
 }
 
@@ -820,10 +2095,7 @@ bool Sample::is_composed_of_timesteps() const {
   for (const auto& col : columns_) {
     int column_length = 0;
     for (const auto& column_slice : col) {
-      // Note that we can safely assume that the tensor is not a scalar since a
-      // batch dimension is always added when building a chunk. A scalar would
-      // thus be represented as a tensor of shape [1].
-      column_length += column_slice.tensor.dim_size(0);
+      column_length += column_slice.num_rows();
     }
 
     if (prev_column_length != -1 && prev_column_length != column_length) {
@@ -836,6 +2108,10 @@ bool Sample::is_composed_of_timesteps() const {
 
 bool Sample::rate_limited() const { return rate_limited_; }
 
+const Sample::ServerTiming& Sample::server_timing() const {
+  return server_timing_;
+}
+
 absl::Status Sample::AsBatchedTimesteps(std::vector<tensorflow::Tensor>* data) {
   if (next_timestep_called_) {
     return absl::DataLossError(
@@ -847,17 +2123,32 @@ absl::Status Sample::AsBatchedTimesteps(std::vector<tensorflow::Tensor>* data) {
         "timesteps.");
   }
 
-  std::vector<tensorflow::Tensor> sequences(columns_.size() + 4);
+  std::vector<tensorflow::Tensor> sequences(columns_.size() + kNumInfoTensors);
 
-  // Initialize the first three items with the key, probability and table size.
+  // Initialize the info items with the key, probability, table size, priority
+  // and the server side timing breakdown.
   sequences[0] = InitializeTensor(key_, num_timesteps_);
   sequences[1] = InitializeTensor(probability_, num_timesteps_);
   sequences[2] = InitializeTensor(table_size_, num_timesteps_);
   sequences[3] = InitializeTensor(priority_, num_timesteps_);
-
-  // Unpack the data columns.
+  sequences[4] = InitializeTensor(server_timing_.queued_for_secs,
+                                  num_timesteps_);
+  sequences[5] = InitializeTensor(server_timing_.rate_limiter_wait_secs,
+                                  num_timesteps_);
+  sequences[6] = InitializeTensor(server_timing_.serialize_time_secs,
+                                  num_timesteps_);
+
+  // Unpack the data columns. `UnpackColumns` already assembles them from
+  // `output_allocator_` when it is set, so only the info tensors still have
+  // to be copied over below.
   REVERB_RETURN_IF_ERROR(UnpackColumns(&sequences));
 
+  if (output_allocator_ != nullptr) {
+    for (int i = 0; i < kNumInfoTensors; i++) {
+      CopyToOutputAllocator(output_allocator_, &sequences[i]);
+    }
+  }
+
   std::swap(sequences, *data);
 
   return absl::OkStatus();
@@ -868,14 +2159,17 @@ absl::Status Sample::AsTrajectory(std::vector<tensorflow::Tensor>* data) {
     return absl::DataLossError(
         "Sample::AsBatchedTimesteps: Some time steps have been lost.");
   }
-  std::vector<tensorflow::Tensor> sequences(columns_.size() + 4);
+  std::vector<tensorflow::Tensor> sequences(columns_.size() + kNumInfoTensors);
 
-  // Initialize the first four items with the key, probability, table size and
-  // priority.
+  // Initialize the info items with the key, probability, table size, priority
+  // and the server side timing breakdown.
   sequences[0] = ScalarTensor(key_);
   sequences[1] = ScalarTensor(probability_);
   sequences[2] = ScalarTensor(table_size_);
   sequences[3] = ScalarTensor(priority_);
+  sequences[4] = ScalarTensor(server_timing_.queued_for_secs);
+  sequences[5] = ScalarTensor(server_timing_.rate_limiter_wait_secs);
+  sequences[6] = ScalarTensor(server_timing_.serialize_time_secs);
 
   // Unpack the data columns.
   REVERB_RETURN_IF_ERROR(UnpackColumns(&sequences));
@@ -883,14 +2177,24 @@ absl::Status Sample::AsTrajectory(std::vector<tensorflow::Tensor>* data) {
   // Remove batch dimension from squeezed columns.
   for (int i = 0; i < squeeze_columns_.size(); i++) {
     if (!squeeze_columns_[i]) continue;
-    if (int batch_dim = sequences[i + 4].shape().dim_size(0); batch_dim != 1) {
+    tensorflow::Tensor& column = sequences[i + kNumInfoTensors];
+    if (int batch_dim = column.shape().dim_size(0); batch_dim != 1) {
       return absl::InternalError(absl::StrCat(
           "Tried to squeeze column with batch size ", batch_dim, "."));
     }
 
-    sequences[i + 4] = sequences[i + 4].SubSlice(0);
-    if (!sequences[i + 4].IsAligned()) {
-      sequences[i + 4] = tensorflow::tensor::DeepCopy(sequences[i + 4]);
+    column = column.SubSlice(0);
+    if (!column.IsAligned()) {
+      column = tensorflow::tensor::DeepCopy(column);
+    }
+  }
+
+  if (output_allocator_ != nullptr) {
+    // The data columns were assembled from the allocator by `UnpackColumns`
+    // (squeezing above shares the buffer); only the info tensors still live
+    // in default allocator memory.
+    for (int i = 0; i < kNumInfoTensors; i++) {
+      CopyToOutputAllocator(output_allocator_, &sequences[i]);
     }
   }
 
@@ -899,26 +2203,146 @@ absl::Status Sample::AsTrajectory(std::vector<tensorflow::Tensor>* data) {
   return absl::OkStatus();
 }
 
-absl::Status Sample::UnpackColumns(std::vector<tensorflow::Tensor>* data) {
-  REVERB_CHECK_EQ(data->size(), columns_.size() + 4);
-
-  int64_t i = 4;
-  for (const auto& column : columns_) {
-    // If the column is made up of a single batched tensor then there will be no
-    // need for concatenation so we can save ourselves a copy by simply moving
-    // the one (unpacked) chunk into sequences.
-    if (column.size() == 1) {
-      data->at(i++) = std::move(column.front().tensor);
-    } else {
-      std::vector<tensorflow::Tensor> column_tensors;
-      column_tensors.reserve(column.size());
-      for (auto& slice : column) {
-        column_tensors.push_back(std::move(slice.tensor));
+void Sample::EnableParallelUnpacking(std::shared_ptr<TaskExecutor> executor) {
+  unpack_executor_ = std::move(executor);
+}
+
+void Sample::PrematerializeAsync(TaskExecutor* executor) {
+  REVERB_CHECK(!prematerialize_done_.has_value());
+  prematerialize_done_.emplace();
+  executor->Schedule([this] {
+    for (auto& column : columns_) {
+      for (ColumnChunk& slice : column) {
+        if (slice.tensor.has_value()) continue;
+        if (!Materialize(&slice).ok()) {
+          // Restore the compressed state so the consumer's own
+          // materialization retries the decode and surfaces the error.
+          slice.tensor = absl::nullopt;
+        }
       }
+    }
+    prematerialize_done_->Notify();
+  });
+}
+
+void Sample::WaitForPrematerialization() {
+  if (!prematerialize_done_.has_value()) return;
+  prematerialize_done_->WaitForNotification();
+  prematerialize_done_ = absl::nullopt;
+}
+
+void Sample::SetOutputAllocator(tensorflow::Allocator* allocator) {
+  output_allocator_ = allocator;
+}
+
+absl::Status Sample::UnpackColumn(std::deque<ColumnChunk>* column,
+                                  tensorflow::Allocator* allocator,
+                                  tensorflow::Tensor* out) {
+  // If the column is made up of a single batched tensor then there will be no
+  // need for concatenation so we can save ourselves a copy by simply moving
+  // the one (unpacked) chunk into sequences.
+  if (column->size() == 1) {
+    REVERB_RETURN_IF_ERROR(Materialize(&column->front()));
+    *out = *std::move(column->front().tensor);
+    if (allocator != nullptr) {
+      CopyToOutputAllocator(allocator, out);
+    }
+    return absl::OkStatus();
+  }
+
+  // The first slice provides the dtype and the per row shape; the total
+  // number of rows is known without unpacking anything.
+  REVERB_RETURN_IF_ERROR(Materialize(&column->front()));
+  const tensorflow::Tensor& front = *column->front().tensor;
 
-      REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
-          tensorflow::tensor::Concat(column_tensors, &data->at(i++))));
+  if (tensorflow::DataTypeCanUseMemcpy(front.dtype())) {
+    int64_t num_rows = 0;
+    for (const auto& slice : *column) {
+      num_rows += slice.num_rows();
+    }
+    tensorflow::TensorShape shape = front.shape();
+    shape.set_dim(0, num_rows);
+
+    // Gather the slices chunk by chunk straight into the output tensor. The
+    // assembled bytes are written exactly once (no intermediate concat pass)
+    // and each materialized slice is released before the next one is
+    // unpacked, so peak memory is the output plus a single chunk. Allocating
+    // from `allocator` means a pooled allocator (see `SetOutputAllocator`)
+    // recycles the buffer across consecutive samples of the same shape.
+    *out = allocator == nullptr
+               ? tensorflow::Tensor(front.dtype(), shape)
+               : tensorflow::Tensor(allocator, front.dtype(), shape);
+    char* dst = const_cast<char*>(out->tensor_data().data());
+    char* const dst_end = dst + out->tensor_data().size();
+    while (!column->empty()) {
+      REVERB_RETURN_IF_ERROR(Materialize(&column->front()));
+      const tensorflow::Tensor& tensor = *column->front().tensor;
+      if (tensor.dtype() != front.dtype() ||
+          tensor.tensor_data().size() >
+              static_cast<size_t>(dst_end - dst)) {
+        return absl::InternalError(absl::StrCat(
+            "Column slice of dtype ",
+            tensorflow::DataTypeString(tensor.dtype()), " and shape ",
+            tensor.shape().DebugString(),
+            " does not fit the concatenated column of dtype ",
+            tensorflow::DataTypeString(front.dtype()), " and shape ",
+            shape.DebugString(), "."));
+      }
+      const auto src = tensor.tensor_data();
+      std::memcpy(dst, src.data(), src.size());
+      dst += src.size();
+      column->pop_front();
+    }
+    if (dst != dst_end) {
+      return absl::InternalError(
+          "Column slices do not add up to the concatenated column shape.");
     }
+    return absl::OkStatus();
+  }
+
+  // Dtypes that cannot be copied with memcpy (e.g. strings) go through the
+  // generic concat.
+  std::vector<tensorflow::Tensor> column_tensors;
+  column_tensors.reserve(column->size());
+  for (auto& slice : *column) {
+    REVERB_RETURN_IF_ERROR(Materialize(&slice));
+    column_tensors.push_back(*std::move(slice.tensor));
+  }
+
+  return FromTensorflowStatus(tensorflow::tensor::Concat(column_tensors, out));
+}
+
+absl::Status Sample::UnpackColumns(std::vector<tensorflow::Tensor>* data) {
+  REVERB_CHECK_EQ(data->size(), columns_.size() + kNumInfoTensors);
+
+  if (unpack_executor_ != nullptr &&
+      columns_.size() >= kMinColumnsToUnpackInParallel) {
+    // Fan the per column decompression out over the executor and join. The
+    // statuses and the counter outlive the scheduled tasks since we block
+    // until all of them have completed.
+    std::vector<absl::Status> statuses(columns_.size());
+    absl::BlockingCounter counter(columns_.size());
+    for (int i = 0; i < columns_.size(); i++) {
+      std::deque<ColumnChunk>* column = &columns_[i];
+      tensorflow::Tensor* out = &data->at(i + kNumInfoTensors);
+      absl::Status* status = &statuses[i];
+      tensorflow::Allocator* allocator = output_allocator_;
+      unpack_executor_->Schedule([column, allocator, out, status, &counter] {
+        *status = UnpackColumn(column, allocator, out);
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+
+    for (absl::Status& status : statuses) {
+      REVERB_RETURN_IF_ERROR(status);
+    }
+    return absl::OkStatus();
+  }
+
+  for (int i = 0; i < columns_.size(); i++) {
+    REVERB_RETURN_IF_ERROR(UnpackColumn(&columns_[i], output_allocator_,
+                                        &data->at(i + kNumInfoTensors)));
   }
   return absl::OkStatus();
 }
@@ -950,6 +2374,34 @@ absl::Status Sampler::Options::Validate() const {
         "rate_limiter_timeout (", absl::FormatDuration(rate_limiter_timeout),
         ") must not be negative."));
   }
+  if (adaptive_in_flight_samples &&
+      (target_buffer_fill <= 0 || target_buffer_fill > 1)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("target_buffer_fill (", target_buffer_fill,
+                     ") must be in (0, 1]."));
+  }
+  if (max_in_flight_bytes_per_worker < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("max_in_flight_bytes_per_worker (",
+                     max_in_flight_bytes_per_worker,
+                     ") must not be negative."));
+  }
+  if (max_in_flight_bytes_per_worker > 0 && adaptive_in_flight_samples) {
+    return absl::InvalidArgumentError(
+        "max_in_flight_bytes_per_worker and adaptive_in_flight_samples "
+        "cannot be combined; the byte bound replaces the occupancy "
+        "controller.");
+  }
+  if (chunk_cache_size < 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "chunk_cache_size (", chunk_cache_size, ") must not be negative."));
+  }
+  if (replica_hedge_timeout <= absl::ZeroDuration()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("replica_hedge_timeout (",
+                     absl::FormatDuration(replica_hedge_timeout),
+                     ") must be positive."));
+  }
   return absl::OkStatus();
 }
 
@@ -18,19 +18,25 @@
 #include <stddef.h>
 
 #include <deque>
+#include <functional>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/base/attributes.h"
 #include <cstdint>
 #include "absl/status/status.h"
+#include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "reverb/cc/platform/thread.h"
 #include "reverb/cc/reverb_service.grpc.pb.h"
 #include "reverb/cc/support/queue.h"
 #include "reverb/cc/support/signature.h"
+#include "reverb/cc/support/task_executor.h"
 #include "reverb/cc/table.h"
+#include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/tensor.h"
 
 namespace deepmind {
@@ -53,11 +59,65 @@ inline absl::Duration Int64MillisToNonnegativeDuration(int64_t milliseconds) {
 // A sample from the replay buffer.
 class Sample {
  public:
+  // A slice of a single column of the sampled trajectory. The compressed
+  // chunk is kept around and only unpacked once the slice is actually
+  // materialized into an output tensor; columns (or row ranges) that the
+  // caller never touches are thus never decompressed.
+  struct ColumnChunk {
+    // Unpacked, and potentially sliced, chunk content. Empty until the slice
+    // has been materialized from `chunk_data`.
+    absl::optional<tensorflow::Tensor> tensor;
+
+    // Compressed chunk which the slice refers to. Shared between the slices
+    // referencing the chunk so the memory is released once the last of them
+    // has been unpacked. nullptr if `tensor` was provided up front.
+    std::shared_ptr<const ChunkData> chunk_data;
+
+    // Chunk which `chunk_data` was delta encoded against
+    // (`ChunkData.delta_baseline_chunk_key`), resolved when the sample is
+    // constructed. nullptr for self contained chunks.
+    std::shared_ptr<const ChunkData> baseline_chunk;
+
+    // Describes the row range and column index within `chunk_data`.
+    FlatTrajectory::ChunkSlice slice;
+
+    // Chunk object backing `chunk_data` when sampling in process from a
+    // table with an uncompressed chunk cache (see
+    // `Table::EnableUncompressedChunkCache`); the column is then served
+    // from, and admitted to, the chunk's cache instead of being unpacked per
+    // sample. nullptr when sampling over the wire or the cache is disabled.
+    std::shared_ptr<ChunkStore::Chunk> store_chunk;
+
+    // Index of the next sub slice to return when emitting timesteps.
+    int offset = 0;
+
+    // Number of rows in the slice. Known without unpacking the chunk.
+    int64_t num_rows() const;
+  };
+
+  // Server side breakdown of the delay between the sample request arriving
+  // at the table and the response being handed to gRPC. See `SampleInfo` in
+  // schema.proto for the semantics of the individual fields.
+  struct ServerTiming {
+    double queued_for_secs = 0;
+    double rate_limiter_wait_secs = 0;
+    double serialize_time_secs = 0;
+  };
+
   Sample(tensorflow::uint64 key, double probability,
          tensorflow::int64 table_size, double priority, bool rate_limited,
+         ServerTiming server_timing,
          std::vector<std::vector<tensorflow::Tensor>> column_chunks,
          std::vector<bool> squeeze_columns);
 
+  // Constructs a sample that holds on to the compressed chunks and defers
+  // unpacking until the columns are materialized.
+  Sample(tensorflow::uint64 key, double probability,
+         tensorflow::int64 table_size, double priority, bool rate_limited,
+         ServerTiming server_timing,
+         std::vector<std::deque<ColumnChunk>> columns,
+         std::vector<bool> squeeze_columns);
+
   // Returns the next time step from this sample as a flat sequence of tensors.
   // CHECK-fails if the entire sample has already been returned.
   std::vector<tensorflow::Tensor> GetNextTimestep();
@@ -70,11 +130,12 @@ class Sample {
   // timestpes.
   //
   // Return:
-  //   K+4 tensors each having a leading dimension of size N (= sample
-  //   length). The first four tensors are 1D (length N) tensors representing
-  //   the key, sample probability, table size and priority respectively. The
-  //   last K tensors holds the actual timestep data batched into a tensor of
-  //   shape [N, ...original_shape].
+  //   K+7 tensors each having a leading dimension of size N (= sample
+  //   length). The first seven tensors are 1D (length N) tensors representing
+  //   the key, sample probability, table size, priority and the server side
+  //   timing breakdown (queueing delay, rate limiter wait and serialize
+  //   time) respectively. The last K tensors holds the actual timestep data
+  //   batched into a tensor of shape [N, ...original_shape].
   absl::Status AsBatchedTimesteps(std::vector<tensorflow::Tensor>* data);
 
   // Returns the entire sample as a flat sequence of batched tensors.
@@ -83,9 +144,11 @@ class Sample {
   // on this sample.
   //
   // Return:
-  //   K+4 tensors. The first four tensors are scalar tensors representing
-  //   the key, sample probability, table size and priority respectively. The
-  //   last K tensors holds the actual trajectory data.
+  //   K+7 tensors. The first seven tensors are scalar tensors representing
+  //   the key, sample probability, table size, priority and the server side
+  //   timing breakdown (queueing delay, rate limiter wait and serialize
+  //   time) respectively. The last K tensors holds the actual trajectory
+  //   data.
   absl::Status AsTrajectory(std::vector<tensorflow::Tensor>* data);
 
   // Returns true if the end of the sample has been reached.
@@ -97,11 +160,73 @@ class Sample {
   // Whether the sample was delayed due to rate limiting or not.
   bool rate_limited() const;
 
+  // Server side breakdown of where the time producing this sample went.
+  const ServerTiming& server_timing() const;
+
+  // Total byte sizes of the chunks the item references, as stamped on the
+  // sample response by the server (see `SampleInfo` in schema.proto): the
+  // serialized (compressed) size and the unpacked size. Both are 0 when the
+  // server predates the fields; `chunk_uncompressed_bytes` is additionally 0
+  // for chunks written before `ChunkData.data_uncompressed_size` existed.
+  int64_t chunk_compressed_bytes() const { return chunk_compressed_bytes_; }
+  int64_t chunk_uncompressed_bytes() const { return chunk_uncompressed_bytes_; }
+  void SetChunkByteSizes(int64_t compressed, int64_t uncompressed) {
+    chunk_compressed_bytes_ = compressed;
+    chunk_uncompressed_bytes_ = uncompressed;
+  }
+
+  // Fans the per column unpacking of `AsTrajectory` and `AsBatchedTimesteps`
+  // out over `executor` instead of decoding the columns serially. Samples
+  // with fewer than `kMinColumnsToUnpackInParallel` columns keep the serial
+  // path as the fan out overhead would exceed the decode cost.
+  void EnableParallelUnpacking(std::shared_ptr<TaskExecutor> executor);
+
+  // Schedules decompression of every chunk slice of the sample on `executor`
+  // so that the consumer later finds the columns already materialized. At
+  // most one prematerialization may be pending per sample and
+  // `WaitForPrematerialization` must be called before the sample is used or
+  // destroyed. Decode failures leave the affected slice compressed and
+  // resurface when the consumer materializes it itself.
+  void PrematerializeAsync(TaskExecutor* executor);
+
+  // Blocks until a pending `PrematerializeAsync` has completed. Noop if none
+  // was scheduled.
+  void WaitForPrematerialization();
+
+  // Returns the tensors produced by `GetNextTimestep`, `AsBatchedTimesteps`
+  // and `AsTrajectory` from `allocator` (e.g. a pooled pinned host allocator)
+  // instead of the default CPU allocator. Columns whose dtype cannot be
+  // copied with memcpy keep the default allocator.
+  void SetOutputAllocator(tensorflow::Allocator* allocator);
+
+  // Minimum number of columns before `UnpackColumns` fans out over the
+  // executor provided to `EnableParallelUnpacking`.
+  static constexpr int kMinColumnsToUnpackInParallel = 4;
+
+  // Number of info tensors prepended to the data columns by
+  // `GetNextTimestep`, `AsBatchedTimesteps` and `AsTrajectory`.
+  static constexpr int kNumInfoTensors = 7;
+
  private:
-  // Concatenates content of column `i` into `data[i+4]`, i.e ofset by info
-  // columns.
+  // Concatenates content of column `i` into `data[i+kNumInfoTensors]`, i.e
+  // ofset by info columns.
   absl::Status UnpackColumns(std::vector<tensorflow::Tensor>* data);
 
+  // Materializes and concatenates the slices of `column` into `out`. Columns
+  // with more than one slice and a memcpy-able dtype are gathered chunk by
+  // chunk straight into a single output tensor allocated from `allocator`
+  // (the default CPU allocator when nullptr), so the assembled bytes are
+  // written exactly once and at most one materialized slice is held alongside
+  // the output at any time. Other columns fall back to
+  // `tensorflow::tensor::Concat`.
+  static absl::Status UnpackColumn(std::deque<ColumnChunk>* column,
+                                   tensorflow::Allocator* allocator,
+                                   tensorflow::Tensor* out);
+
+  // Unpacks `chunk->slice` into `chunk->tensor` and releases the reference to
+  // the compressed chunk. Noop if the slice is already materialized.
+  static absl::Status Materialize(ColumnChunk* chunk);
+
   // The key of the replay item this time step was sampled from.
   tensorflow::uint64 key_;
 
@@ -118,18 +243,17 @@ class Sample {
   // Whether the sample was delayed due to rate limiting or not.
   bool rate_limited_;
 
+  // Server side timing breakdown stamped on the sample response.
+  ServerTiming server_timing_;
+
+  // Chunk byte sizes stamped on the sample response; see the accessors.
+  int64_t chunk_compressed_bytes_ = 0;
+  int64_t chunk_uncompressed_bytes_ = 0;
+
   // Total number of time steps in this sample. Only set when
   // `is_timestep_sample()` is true.
   int64_t num_timesteps_;
 
-  struct ColumnChunk {
-    // Unpacked chunk, and potentially sliced, chunk content.
-    tensorflow::Tensor tensor;
-
-    // Index of the next sub slice to return when emitting timesteps.
-    int offset = 0;
-  };
-
   // Flat trajectory data. Each column uses a deque so the batched tensor can be
   // deallocated as soon as all its content has been emitted through
   // `GetNextTimestep`. If the data is retrieved with `AsBatchedTimesteps` or
@@ -146,11 +270,27 @@ class Sample {
 
   // True if GetNextTimestep() has been called on this sample.
   bool next_timestep_called_;
+
+  // If set then `UnpackColumns` decodes the columns of wide samples in
+  // parallel on the executor. nullptr (the default) keeps the serial path.
+  std::shared_ptr<TaskExecutor> unpack_executor_;
+
+  // Set while a `PrematerializeAsync` task is pending or finished but not
+  // yet joined through `WaitForPrematerialization`.
+  absl::optional<absl::Notification> prematerialize_done_;
+
+  // If set then output tensors are copied into memory from this allocator
+  // before being returned. nullptr (the default) keeps the default allocator.
+  tensorflow::Allocator* output_allocator_ = nullptr;
 };
 
 // SamplerWorker implements strategy for fetching samples from table.
 class SamplerWorker {
  public:
+  // Signature of the completion callback of `FetchSamplesAsync`. Receives the
+  // number of samples pushed to the queue and the final status of the fetch.
+  using FetchDoneCallback = std::function<void(int64_t, absl::Status)>;
+
   virtual ~SamplerWorker() = default;
 
   // When called, future calls to FetchSampes must return CancelledError.
@@ -161,6 +301,22 @@ class SamplerWorker {
   virtual std::pair<int64_t, absl::Status> FetchSamples(
       internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
       absl::Duration rate_limiter_timeout) = 0;
+
+  // Asynchronous version of `FetchSamples`. `done` is invoked exactly once
+  // with the result of the fetch, from an unspecified thread (possibly inline
+  // before this call returns). The default implementation simply runs the
+  // blocking `FetchSamples` and invokes `done` before returning; workers that
+  // support it override this so that no thread is occupied while the fetch
+  // waits on the network.
+  virtual void FetchSamplesAsync(
+      internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
+      absl::Duration rate_limiter_timeout, FetchDoneCallback done);
+
+  // Adjusts the maximum number of samples the worker keeps in flight at any
+  // point in time. Thread safe; the new value takes effect with the next
+  // batch. The value is clamped to the maximum the worker was constructed
+  // with.
+  virtual void SetMaxInFlightSamples(int64_t max_in_flight_samples) = 0;
 };
 
 // The `Sampler` class should be used to retrieve samples from a
@@ -255,8 +411,142 @@ class Sampler {
     //
     // The default is to wait forever - or until the connection closes, or
     // `Close` is called, whichever comes first.
+    //
+    // Setting this to `kAdaptiveTimeout` asks the server to derive the
+    // timeout from the wait time distribution of the table's rate limiter
+    // (p99.9 of recent successful waits plus margin), so the timeout tracks
+    // the actual behaviour of the table instead of a static guess. The
+    // chosen value is visible as `RateLimiterInfo.adaptive_timeout_ms` in
+    // the table info.
     absl::Duration rate_limiter_timeout = absl::InfiniteDuration();
 
+    // If set then the columns of wide samples (see
+    // `Sample::kMinColumnsToUnpackInParallel`) are decompressed and unpacked
+    // in parallel on this executor when samples are materialized. The executor
+    // can be shared between many `Sampler` instances. When null (the default)
+    // columns are unpacked serially on the calling thread.
+    std::shared_ptr<TaskExecutor> unpack_executor = nullptr;
+
+    // If set then the tensors returned by `GetNextTimestep`, `GetNextSample`,
+    // `GetNextTrajectory` and `GetNextTrajectoryBatch` are copied into memory
+    // from this allocator
+    // instead of being returned from the default CPU allocator. Intended to
+    // be TensorFlow's pooled GPU compatible host allocator so that outputs
+    // live in page-locked memory and device transfers of them run at full
+    // PCIe bandwidth. Columns whose dtype cannot be copied with memcpy (e.g.
+    // strings) keep the default allocator. The allocator must outlive the
+    // sampler. When null (the default) outputs are not copied.
+    tensorflow::Allocator* output_allocator = nullptr;
+
+    // If set then no dedicated worker threads are spawned; fetch rounds are
+    // instead scheduled on this executor which can be shared between many
+    // `Sampler` instances. `num_workers` then acts as the per sampler
+    // concurrency limit, i.e. the maximum number of concurrent fetch rounds
+    // of a single sampler. This keeps the process wide thread count
+    // proportional to the actual sample parallelism instead of the number of
+    // `Sampler` instances. gRPC backed workers additionally run their
+    // streams on the gRPC callback API in this mode, so an open stream is a
+    // small state machine driven by gRPC's own threads rather than a blocked
+    // executor thread; executor threads only run round bookkeeping and waits
+    // on queue backpressure. The executor must outlive the sampler. When
+    // null (the default) each worker runs on its own thread.
+    std::shared_ptr<TaskExecutor> fetch_executor = nullptr;
+
+    // If true then the number of in-flight sample requests per worker is
+    // adapted at runtime instead of always being
+    // `max_in_flight_samples_per_worker` (which then acts as the upper
+    // bound). The controller watches the occupancy of the internal sample
+    // buffer on the consumer side: if the buffer runs persistently below
+    // `target_buffer_fill` while the table is not rate limited then the
+    // in-flight budget is doubled; if it runs above the target then the
+    // budget is halved so the sampler does not request (and thereby remove
+    // rate limiter budget for) more samples than the consumer absorbs.
+    bool adaptive_in_flight_samples = false;
+
+    // Fraction of the internal sample buffer that the adaptive controller
+    // tries to keep filled. Must be in (0, 1]. Only used when
+    // `adaptive_in_flight_samples` is set.
+    double target_buffer_fill = 0.5;
+
+    // When > 0, the number of samples each worker keeps in flight is bounded
+    // by bytes rather than by a fixed count: the sampler tracks the
+    // (compressed) chunk byte size stamped on incoming samples (see
+    // `SampleInfo.chunk_compressed_bytes`) and continuously converts this
+    // byte budget into a per-worker sample budget, with
+    // `max_in_flight_samples_per_worker` acting as the upper bound. Use this
+    // when item sizes vary by orders of magnitude and a count-based bound
+    // either OOMs on large items or under-buffers on small ones. Mutually
+    // exclusive with `adaptive_in_flight_samples`. 0 (the default) keeps the
+    // count-based bound.
+    int64_t max_in_flight_bytes_per_worker = 0;
+
+    // Scheduling attributes (CPU affinity, nice value, real-time class)
+    // applied to the dedicated worker threads. Lets e.g. a colocated learner
+    // pin its sampler threads away from the actor's insert threads without
+    // external cgroup setups. Ignored when `fetch_executor` is set; apply
+    // the attributes to the executor's pool instead. Defaults to inheriting
+    // everything from the spawning thread.
+    internal::ThreadOptions worker_thread_options;
+
+    // When > 0, each `SampleStream` keeps a cache of the last
+    // `chunk_cache_size` chunks received on the stream, mirrored by the
+    // server, so chunks shared between successive samples (overlapping
+    // windows, items from the same episode) are sent as bare references
+    // instead of being retransmitted. The cache holds compressed chunks, so
+    // the client-side memory cost is bounded by `chunk_cache_size` times the
+    // (compressed) chunk size. Has no effect on local (in process) sampling,
+    // which shares chunk memory with the table already. Must not be negative;
+    // 0 (the default) disables the cache.
+    int chunk_cache_size = 0;
+
+    // When non-empty, compressed chunks received from the server are
+    // persisted in a content-addressed cache rooted at this directory and
+    // the server is told to send chunks the cache already holds as bare
+    // references instead of retransmitting their payloads. Sample metadata
+    // (key, priority, times_sampled, trajectory) is always fetched fresh
+    // from the server; only the immutable chunk payloads are served from
+    // disk. Intended for evaluation jobs that repeatedly sample the same
+    // held-out items across restarts. The directory is created if needed
+    // and may be shared by samplers of different tables; if it cannot be
+    // opened a warning is logged and sampling proceeds without the cache.
+    // Has no effect on local (in process) sampling. Empty (the default)
+    // disables the cache.
+    std::string disk_cache_dir;
+
+    // When true, the server is asked to place chunk payloads in a shared
+    // memory arena instead of inlining them in the stream responses: the
+    // sampler maps the arena read only and resolves the payloads at memory
+    // speed while sample metadata stays on gRPC. Only valid when the client
+    // runs on the same host as the server (e.g. a colocated learner
+    // connected over a unix domain socket); sampling fails otherwise. Has no
+    // effect on local (in process) sampling, which shares chunk memory with
+    // the table already. See `SampleStreamRequest.shm_transport`.
+    bool shm_transport = false;
+
+    // When true, the stubs passed to the multi server constructor are
+    // treated as replicas serving identical data rather than as independent
+    // shards. Instead of a fixed round robin assignment, every stream then
+    // selects its replica with power of two choices: two replicas are drawn
+    // at random and the stream goes to the one with the lower score, where
+    // the score is an exponential moving average of the observed per sample
+    // latency scaled by the number of streams the replica already serves.
+    // A slow replica thereby receives fewer new streams instead of capping
+    // the throughput of the workers pinned to it. Has no effect on the
+    // single stub and local table constructors.
+    bool stubs_are_replicas = false;
+
+    // When set together with `stubs_are_replicas`, a fresh stream which has
+    // not delivered its first response within this duration is cancelled
+    // and the fetch is retried immediately on the alternate replica of its
+    // power of two draw (once per fetch, without backoff). This bounds the
+    // stream startup tail a single slow replica can impose; slowness after
+    // the first response is handled by the load balancing steering later
+    // streams away. Only applies to the thread per worker fetch path; the
+    // executor driven path (see `fetch_executor`) relies on the load
+    // balancing alone. Must be positive. `InfiniteDuration` (the default)
+    // disables hedging.
+    absl::Duration replica_hedge_timeout = absl::InfiniteDuration();
+
     // Checks that field values are valid and returns `InvalidArgument` if any
     // field value invalid.
     absl::Status Validate() const;
@@ -272,6 +562,24 @@ class Sampler {
           const std::string& table_name, const Options& options,
           internal::DtypesAndShapes dtypes_and_shapes = absl::nullopt);
 
+  // Constructs a new `Sampler` which fetches from multiple servers. By
+  // default the servers are treated as independent shards: workers are
+  // assigned to the stubs round robin so the combined sample throughput
+  // scales with the number of servers. When `options.stubs_are_replicas` is
+  // set the servers are instead treated as replicas of the same data and
+  // every stream picks its replica by load (see
+  // `Options::stubs_are_replicas`). When `options.num_workers` is
+  // `kAutoSelectValue` one worker is created per stub.
+  //
+  // `stubs` are connected gRPC stubs, one per server. Must be non empty.
+  // `table_name` is the name of the `Table` to sample from on every server.
+  // `options` defines details of how to samples.
+  // `dtypes_and_shapes` describes the output signature (if any) to expect.
+  Sampler(std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+              stubs,
+          const std::string& table_name, const Options& options,
+          internal::DtypesAndShapes dtypes_and_shapes = absl::nullopt);
+
   // Constructs a new `Sampler` which samples directly from local `table`.
   //
   // `table` is the table to sample from.
@@ -284,10 +592,13 @@ class Sampler {
   ~Sampler();
 
   // Blocks until a timestep has been retrieved or until a non transient error
-  // is encountered or `Close` has been called.
+  // is encountered or `Close` has been called. When set, `server_timing` is
+  // populated with the server side timing breakdown of the sample the
+  // timestep belongs to.
   absl::Status GetNextTimestep(std::vector<tensorflow::Tensor>* data,
                                bool* end_of_sequence,
-                               bool* rate_limited = nullptr);
+                               bool* rate_limited = nullptr,
+                               Sample::ServerTiming* server_timing = nullptr);
 
   // Blocks until a complete (timestep sequence) sample has been retrieved or
   // until a non transient error is encountered or `Close` has been called.
@@ -299,20 +610,41 @@ class Sampler {
   //
   // TODO(b/179118872): Remove this method and just use GetNextTrajectory.
   absl::Status GetNextSample(std::vector<tensorflow::Tensor>* data,
-                             bool* rate_limited = nullptr);
+                             bool* rate_limited = nullptr,
+                             Sample::ServerTiming* server_timing = nullptr);
 
   // Blocks until a complete sample has been retrieved or until a non transient
   // error is encountered or `Close` has been called.
   //
-  // Once the sample has been retrieved then the sample is unpacked into 4+K
-  // tensors. The first 4 tensors are scalars representig the key, probability,
-  // table size and priority of the sample. The remaining K tensors are the
-  // columns of the flattened trajectory.
+  // Once the sample has been retrieved then the sample is unpacked into 7+K
+  // tensors. The first 7 tensors are scalars representig the key, probability,
+  // table size, priority and server side timing breakdown of the sample. The
+  // remaining K tensors are the columns of the flattened trajectory.
   //
   // TODO(b/179118872): Rename this to GetNextSample once the existing method
   //   has been deleted.
   absl::Status GetNextTrajectory(std::vector<tensorflow::Tensor>* data,
-                                 bool* rate_limited = nullptr);
+                                 bool* rate_limited = nullptr,
+                                 Sample::ServerTiming* server_timing = nullptr);
+
+  // Blocks until `num_samples` complete samples have been retrieved or until
+  // a non transient error is encountered or `Close` has been called.
+  //
+  // The samples are unpacked like in `GetNextTrajectory` and then stacked
+  // column wise: the result is 7+K tensors where tensor i holds the values of
+  // column i of all sampled trajectories behind a new leading batch
+  // dimension. All trajectories in the batch must therefore agree on the
+  // dtype and shape of every column; `InvalidArgument` is returned otherwise.
+  // The internal queue is drained in bulk so per sample synchronization is
+  // paid once per batch instead of once per trajectory.
+  //
+  // If `max_samples` is exhausted mid batch then the partial batch (with a
+  // smaller leading dimension) is returned and the next call returns
+  // `OutOfRange`. `rate_limited` is set if any sample in the batch was rate
+  // limited.
+  absl::Status GetNextTrajectoryBatch(int num_samples,
+                                      std::vector<tensorflow::Tensor>* data,
+                                      bool* rate_limited = nullptr);
 
   // Cancels all workers and joins their threads. Any blocking or future call
   // to `GetNextTimestep` or `GetNextSample` will return CancelledError without
@@ -346,10 +678,46 @@ class Sampler {
 
   void RunWorker(SamplerWorker* worker) ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Schedules a single fetch round for `worker` on `fetch_executor_`.
+  // `retry_backoff` is the backoff to apply if the round fails with a
+  // transient error; it is threaded through the rounds since a worker has no
+  // dedicated thread to keep the state on.
+  void ScheduleFetchRound(SamplerWorker* worker, absl::Duration retry_backoff)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Starts one fetch round (a single `FetchSamplesAsync` call) for `worker`
+  // or parks the worker until progress becomes possible again. If
+  // `retry_backoff` indicates that the previous round failed transiently the
+  // round first backs off. The round completes through `FinishFetchRound`.
+  void FetchRound(SamplerWorker* worker, absl::Duration retry_backoff)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Completion of a fetch round started by `FetchRound`; applies the result
+  // to the sample accounting and either reschedules the worker or retires it.
+  // Together with `FetchRound` this is equivalent to one iteration of the
+  // loop in `RunWorker`. Runs on whatever thread completed the fetch (an
+  // executor thread or a gRPC callback thread) and must not block.
+  void FinishFetchRound(SamplerWorker* worker, absl::Duration retry_backoff,
+                        absl::Time start_time, int64_t samples_to_stream,
+                        int64_t num_returned, absl::Status status)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // If `active_sample_` has been read, blocks until a sample has been retrieved
   // (popped from `samples_`) and populates `active_sample_`.
   absl::Status MaybeSampleNext();
 
+  // Records the buffer occupancy and rate limiter signal observed by
+  // `PopNextSample` and periodically adjusts the in-flight budget of the
+  // workers. Only called from the (single threaded) consumer side so the
+  // counters need no mutex.
+  void AdaptInFlightSamples(const Sample& sample);
+
+  // Folds the chunk byte size of a popped sample into `bytes_per_sample_`
+  // and adjusts the workers' sample budget so that roughly
+  // `max_in_flight_bytes_per_worker_` bytes are in flight per worker. Only
+  // called from the (single threaded) consumer side.
+  void AdaptInFlightBytes(const Sample& sample);
+
   // Blocks until a complete sample has been retrieved or until a non transient
   // error is encountered or `Close` has been called. Note that this method does
   // NOT increment `returned_`. This is left to `GetNextTimestep` and
@@ -395,6 +763,21 @@ class Sampler {
   std::vector<std::unique_ptr<SamplerWorker>> workers_;
   std::vector<std::unique_ptr<internal::Thread>> worker_threads_;
 
+  // Shared executor that fetch rounds run on instead of `worker_threads_`.
+  // nullptr unless `Options::fetch_executor` was set.
+  const std::shared_ptr<TaskExecutor> fetch_executor_;
+
+  // Number of fetch rounds currently scheduled on, or running on,
+  // `fetch_executor_`. `Close` blocks until it reaches zero.
+  int active_fetches_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Workers without an active fetch round because no progress was possible
+  // when their last round finished (all remaining samples were already
+  // requested). They are rescheduled if `requested_` backtracks after a
+  // prematurely closed stream.
+  std::vector<std::pair<SamplerWorker*, absl::Duration>> parked_workers_
+      ABSL_GUARDED_BY(mu_);
+
   // OK or the first non transient error encountered by a worker.
   absl::Status worker_status_ ABSL_GUARDED_BY(mu_);
 
@@ -406,12 +789,67 @@ class Sampler {
   // Queue of complete samples (timesteps batched up by into sequence).
   internal::Queue<std::unique_ptr<Sample>> samples_;
 
+  // Samples drained from `samples_` in a batch but not yet handed to the
+  // caller. Popping bursts through `PopBatchUpTo` costs one queue lock
+  // acquisition per burst instead of one per sample. Like `active_sample_`,
+  // not protected by a mutex as the consumer side is single threaded.
+  std::vector<std::unique_ptr<Sample>> prefetched_samples_;
+
+  // Index into `prefetched_samples_` of the next sample to return.
+  size_t prefetched_index_ = 0;
+
+  // Sample in `prefetched_samples_` whose chunks are being decompressed in
+  // the background (see `Sample::PrematerializeAsync`), or nullptr when no
+  // prematerialization is pending. Since scheduling always targets the next
+  // sample to be popped, the pending sample is joined when it is popped and
+  // never outlives the buffer. Like `active_sample_`, only touched by the
+  // single threaded consumer side.
+  Sample* prematerializing_sample_ = nullptr;
+
+  // Whether `AdaptInFlightSamples` is active.
+  const bool adaptive_in_flight_samples_;
+
+  // Upper bound of the adaptive in-flight budget; the value of
+  // `Options::max_in_flight_samples_per_worker`.
+  const int64_t max_in_flight_samples_per_worker_;
+
+  // Number of buffered samples the adaptive controller aims for. Derived
+  // from `Options::target_buffer_fill` and the capacity of `samples_`.
+  const int64_t target_buffer_fill_;
+
+  // State of the adaptive controller. Like `active_sample_`, only touched by
+  // the single threaded consumer side.
+  int64_t in_flight_budget_;
+  int64_t occupancy_sum_ = 0;
+  int64_t adaptation_pops_ = 0;
+  bool rate_limited_in_window_ = false;
+
+  // Byte-based flow control (`Options::max_in_flight_bytes_per_worker`); 0
+  // when disabled. `bytes_per_sample_` is an exponential moving average of
+  // the compressed chunk bytes of popped samples, used to convert the byte
+  // budget into the sample-count budget handed to the workers. Only touched
+  // by the single threaded consumer side.
+  const int64_t max_in_flight_bytes_per_worker_;
+  double bytes_per_sample_ = 0;
+
   // The dtypes and shapes users expect from either `GetNextTimestep` or
   // `GetNextSample` (whichever they plan to call).  May be absl::nullopt,
   // meaning unknown.
   const internal::DtypesAndShapes dtypes_and_shapes_;
   const internal::DtypesAndShapes dtypes_and_shapes_for_sequence_;
 
+  // `dtypes_and_shapes_` compiled into per-column integer specs once at
+  // construction. The per-sample validation checks against this plan and only
+  // falls back to `dtypes_and_shapes_` to format error messages.
+  const internal::CompiledSignature compiled_signature_;
+
+  // Executor that popped samples unpack wide trajectories on. May be nullptr.
+  const std::shared_ptr<TaskExecutor> unpack_executor_;
+
+  // Allocator that popped samples return their output tensors from. May be
+  // nullptr.
+  tensorflow::Allocator* const output_allocator_;
+
   // Set if `Close` called.
   bool closed_ ABSL_GUARDED_BY(mu_) = false;
 
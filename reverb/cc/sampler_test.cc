@@ -14,6 +14,7 @@
 
 #include "reverb/cc/sampler.h"
 
+#include <deque>
 #include <list>
 #include <vector>
 
@@ -29,9 +30,11 @@
 #include "absl/time/time.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/platform/thread.h"
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/reverb_service_mock.grpc.pb.h"
 #include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/support/task_executor.h"
 #include "reverb/cc/support/tf_util.h"
 #include "reverb/cc/tensor_compression.h"
 #include "reverb/cc/testing/proto_test_util.h"
@@ -148,6 +151,211 @@ std::shared_ptr<FakeStub> MakeGoodStub(
   return MakeFlakyStub(std::move(responses), /*errors=*/{});
 }
 
+// Callback API counterpart of `FakeStream`, used to exercise the reactor
+// based fetch path (`Options::fetch_executor` with a gRPC stub). Operations
+// started before `StartCall` are buffered like in the real transport and the
+// reactions run inline; the final status is delivered from a separate thread
+// once the reactor removes its hold, mirroring how gRPC delivers `OnDone`.
+class FakeCallbackStream
+    : public grpc::ClientCallbackReaderWriter<SampleStreamRequest,
+                                              SampleStreamResponse> {
+ public:
+  FakeCallbackStream(std::function<void(const SampleStreamRequest&)> on_write,
+                     std::vector<SampleStreamResponse> responses,
+                     grpc::Status status)
+      : on_write_(std::move(on_write)),
+        responses_(std::move(responses)),
+        status_(std::move(status)) {}
+
+  void Bind(grpc::ClientBidiReactor<SampleStreamRequest,
+                                    SampleStreamResponse>* reactor) {
+    reactor_ = reactor;
+    BindReactor(reactor);
+  }
+
+  void StartCall() override {
+    started_ = true;
+    if (const SampleStreamRequest* request = pending_write_) {
+      pending_write_ = nullptr;
+      Write(request, grpc::WriteOptions());
+    }
+    if (SampleStreamResponse* response = pending_read_) {
+      pending_read_ = nullptr;
+      Read(response);
+    }
+  }
+
+  void Write(const SampleStreamRequest* request,
+             grpc::WriteOptions options) override {
+    if (!started_) {
+      pending_write_ = request;
+      return;
+    }
+    on_write_(*request);
+    reactor_->OnWriteDone(status_.ok());
+  }
+
+  void Read(SampleStreamResponse* response) override {
+    if (!started_) {
+      pending_read_ = response;
+      return;
+    }
+    if (responses_.empty() || !status_.ok()) {
+      reactor_->OnReadDone(false);
+      return;
+    }
+    *response = responses_.front();
+    responses_.erase(responses_.begin());
+    reactor_->OnReadDone(true);
+  }
+
+  void WritesDone() override {}
+
+  void AddHold(int holds) override {}
+
+  void RemoveHold() override {
+    on_done_thread_ = internal::StartThread(
+        "OnDoneAsync", [this] { reactor_->OnDone(status_); });
+  }
+
+ private:
+  std::function<void(const SampleStreamRequest&)> on_write_;
+  std::vector<SampleStreamResponse> responses_;
+  grpc::Status status_;
+  grpc::ClientBidiReactor<SampleStreamRequest, SampleStreamResponse>*
+      reactor_ = nullptr;
+  bool started_ = false;
+  const SampleStreamRequest* pending_write_ = nullptr;
+  SampleStreamResponse* pending_read_ = nullptr;
+  std::unique_ptr<internal::Thread> on_done_thread_;
+};
+
+// Callback API analogue of `FakeStub`; `async()` serves `SampleStream` calls
+// from the streams added with `AddStream`.
+class FakeAsyncStub : public /* grpc_gen:: */MockReverbServiceStub {
+ public:
+  FakeAsyncStub() : async_(this) {}
+
+  /* grpc_gen:: */ReverbService::StubInterface::async_interface* async()
+      override {
+    return &async_;
+  }
+
+  void AddStream(std::vector<SampleStreamResponse> responses,
+                 grpc::Status status = grpc::Status::OK) {
+    absl::WriterMutexLock lock(&mu_);
+    streams_.push_back(absl::make_unique<FakeCallbackStream>(
+        [this](const SampleStreamRequest& request) {
+          absl::WriterMutexLock lock(&mu_);
+          requests_.push_back(request);
+        },
+        std::move(responses), std::move(status)));
+  }
+
+  std::vector<SampleStreamRequest> requests() const {
+    absl::ReaderMutexLock lock(&mu_);
+    return requests_;
+  }
+
+ private:
+  class AsyncInterface : public /* grpc_gen:: */ReverbService::StubInterface::
+                             async_interface {
+   public:
+    explicit AsyncInterface(FakeAsyncStub* stub) : stub_(stub) {}
+
+    void SampleStream(
+        ::grpc::ClientContext* context,
+        ::grpc::ClientBidiReactor<SampleStreamRequest, SampleStreamResponse>*
+            reactor) override {
+      stub_->NextStream()->Bind(reactor);
+    }
+
+    MOCK_METHOD(void, Checkpoint,
+                (::grpc::ClientContext*, const CheckpointRequest*,
+                 CheckpointResponse*, std::function<void(::grpc::Status)>));
+    MOCK_METHOD(void, Checkpoint,
+                (::grpc::ClientContext*, const CheckpointRequest*,
+                 CheckpointResponse*, ::grpc::ClientUnaryReactor*));
+    MOCK_METHOD(void, ImportCheckpoint,
+                (::grpc::ClientContext*, const ImportCheckpointRequest*,
+                 ImportCheckpointResponse*,
+                 std::function<void(::grpc::Status)>));
+    MOCK_METHOD(void, ImportCheckpoint,
+                (::grpc::ClientContext*, const ImportCheckpointRequest*,
+                 ImportCheckpointResponse*, ::grpc::ClientUnaryReactor*));
+    MOCK_METHOD(void, ForkTable,
+                (::grpc::ClientContext*, const ForkTableRequest*,
+                 ForkTableResponse*, std::function<void(::grpc::Status)>));
+    MOCK_METHOD(void, ForkTable,
+                (::grpc::ClientContext*, const ForkTableRequest*,
+                 ForkTableResponse*, ::grpc::ClientUnaryReactor*));
+    MOCK_METHOD(void, InsertStream,
+                ((::grpc::ClientContext*),
+                 (::grpc::ClientBidiReactor<InsertStreamRequest,
+                                            InsertStreamResponse>*)));
+    MOCK_METHOD(void, QueryReceivedChunks,
+                (::grpc::ClientContext*, const QueryReceivedChunksRequest*,
+                 QueryReceivedChunksResponse*,
+                 std::function<void(::grpc::Status)>));
+    MOCK_METHOD(void, QueryReceivedChunks,
+                (::grpc::ClientContext*, const QueryReceivedChunksRequest*,
+                 QueryReceivedChunksResponse*, ::grpc::ClientUnaryReactor*));
+    MOCK_METHOD(void, MutatePriorities,
+                (::grpc::ClientContext*, const MutatePrioritiesRequest*,
+                 MutatePrioritiesResponse*,
+                 std::function<void(::grpc::Status)>));
+    MOCK_METHOD(void, MutatePriorities,
+                (::grpc::ClientContext*, const MutatePrioritiesRequest*,
+                 MutatePrioritiesResponse*, ::grpc::ClientUnaryReactor*));
+    MOCK_METHOD(void, Reset,
+                (::grpc::ClientContext*, const ResetRequest*, ResetResponse*,
+                 std::function<void(::grpc::Status)>));
+    MOCK_METHOD(void, Reset,
+                (::grpc::ClientContext*, const ResetRequest*, ResetResponse*,
+                 ::grpc::ClientUnaryReactor*));
+    MOCK_METHOD(void, ServerInfo,
+                (::grpc::ClientContext*, const ServerInfoRequest*,
+                 ServerInfoResponse*, std::function<void(::grpc::Status)>));
+    MOCK_METHOD(void, ServerInfo,
+                (::grpc::ClientContext*, const ServerInfoRequest*,
+                 ServerInfoResponse*, ::grpc::ClientUnaryReactor*));
+    MOCK_METHOD(void, ServerInfoStream,
+                ((::grpc::ClientContext*), (const ServerInfoStreamRequest*),
+                 (::grpc::ClientReadReactor<ServerInfoStreamResponse>*)));
+    MOCK_METHOD(void, TraceDump,
+                (::grpc::ClientContext*, const TraceDumpRequest*,
+                 TraceDumpResponse*, std::function<void(::grpc::Status)>));
+    MOCK_METHOD(void, TraceDump,
+                (::grpc::ClientContext*, const TraceDumpRequest*,
+                 TraceDumpResponse*, ::grpc::ClientUnaryReactor*));
+    MOCK_METHOD(void, InitializeConnection,
+                ((::grpc::ClientContext*),
+                 (::grpc::ClientBidiReactor<InitializeConnectionRequest,
+                                            InitializeConnectionResponse>*)));
+
+   private:
+    FakeAsyncStub* const stub_;
+  };
+
+  FakeCallbackStream* NextStream() {
+    absl::WriterMutexLock lock(&mu_);
+    REVERB_CHECK(!streams_.empty());
+    // Finished streams are kept alive until the stub is destroyed since the
+    // `OnDone` delivery thread they own may still be running when the fetch
+    // round completes.
+    active_streams_.push_back(std::move(streams_.front()));
+    streams_.pop_front();
+    return active_streams_.back().get();
+  }
+
+  AsyncInterface async_;
+  std::list<std::unique_ptr<FakeCallbackStream>> streams_ ABSL_GUARDED_BY(mu_);
+  std::vector<std::unique_ptr<FakeCallbackStream>> active_streams_
+      ABSL_GUARDED_BY(mu_);
+  std::vector<SampleStreamRequest> requests_ ABSL_GUARDED_BY(mu_);
+  mutable absl::Mutex mu_;
+};
+
 tensorflow::Tensor MakeTensor(int length) {
   tensorflow::TensorShape shape({length, 2});
   tensorflow::Tensor tensor(tensorflow::DT_UINT64, shape);
@@ -292,6 +500,7 @@ TEST(SampleTest, IsComposedOfTimesteps) {
       /*table_size=*/2,
       /*priority=*/1,
       /*rate_limited=*/false,
+      /*server_timing=*/{},
       /*column_chunks=*/{{MakeTensor(5)}, {MakeTensor(5)}},
       /*squeeze_columns=*/{false});
   EXPECT_TRUE(timestep_sample.is_composed_of_timesteps());
@@ -302,6 +511,7 @@ TEST(SampleTest, IsComposedOfTimesteps) {
       /*table_size=*/2,
       /*priority=*/1,
       /*rate_limited=*/false,
+      /*server_timing=*/{},
       /*column_chunks=*/{{MakeTensor(5)}, {MakeTensor(10)}},
       /*squeeze_columns=*/{false});
   EXPECT_FALSE(non_timestep_sample.is_composed_of_timesteps());
@@ -315,12 +525,178 @@ TEST(SampleTest, RateLimited) {
         /*table_size=*/2,
         /*priority=*/1,
         /*rate_limited=*/rate_limited,
+        /*server_timing=*/{},
         /*column_chunks=*/{{MakeTensor(5)}, {MakeTensor(5)}},
         /*squeeze_columns=*/{false});
     EXPECT_EQ(sample.rate_limited(), rate_limited);
   }
 }
 
+TEST(SampleTest, LazilyUnpacksChunks) {
+  const auto range = MakeSequenceRange(100, 0, 4);
+  auto chunk =
+      std::make_shared<const ChunkData>(MakeChunkData(/*key=*/1, range));
+
+  FlatTrajectory::ChunkSlice slice;
+  slice.set_chunk_key(1);
+  slice.set_offset(1);
+  slice.set_length(3);
+  slice.set_index(0);
+
+  std::vector<std::deque<Sample::ColumnChunk>> columns(1);
+  columns[0].push_back({absl::nullopt, chunk, nullptr, slice});
+
+  Sample sample(
+      /*key=*/100,
+      /*probability=*/0.5,
+      /*table_size=*/2,
+      /*priority=*/1,
+      /*rate_limited=*/false,
+      /*server_timing=*/{},
+      /*columns=*/std::move(columns),
+      /*squeeze_columns=*/{false});
+
+  // The number of rows is known from the slice without decompressing.
+  EXPECT_TRUE(sample.is_composed_of_timesteps());
+  EXPECT_EQ(chunk.use_count(), 2);
+
+  // Materializing the trajectory decompresses the chunk and releases the
+  // sample's reference to the compressed data.
+  std::vector<tensorflow::Tensor> data;
+  REVERB_EXPECT_OK(sample.AsTrajectory(&data));
+  ASSERT_THAT(data, SizeIs(1 + Sample::kNumInfoTensors));
+  test::ExpectTensorEqual<tensorflow::uint64>(
+      data[7], tensorflow::tensor::DeepCopy(MakeTensor(5).Slice(1, 4)));
+  EXPECT_EQ(chunk.use_count(), 1);
+}
+
+TEST(SampleTest, PrematerializeDecompressesChunksInTheBackground) {
+  auto executor = std::make_shared<TaskExecutor>(1, "SampleTest");
+
+  const auto range = MakeSequenceRange(100, 0, 4);
+  auto chunk =
+      std::make_shared<const ChunkData>(MakeChunkData(/*key=*/1, range));
+
+  FlatTrajectory::ChunkSlice slice;
+  slice.set_chunk_key(1);
+  slice.set_offset(1);
+  slice.set_length(3);
+  slice.set_index(0);
+
+  std::vector<std::deque<Sample::ColumnChunk>> columns(1);
+  columns[0].push_back({absl::nullopt, chunk, nullptr, slice});
+
+  Sample sample(
+      /*key=*/100,
+      /*probability=*/0.5,
+      /*table_size=*/2,
+      /*priority=*/1,
+      /*rate_limited=*/false,
+      /*server_timing=*/{},
+      /*columns=*/std::move(columns),
+      /*squeeze_columns=*/{false});
+
+  // Once the background task has run, the chunk has been decompressed and
+  // the sample's reference to the compressed data released.
+  sample.PrematerializeAsync(executor.get());
+  sample.WaitForPrematerialization();
+  EXPECT_EQ(chunk.use_count(), 1);
+
+  std::vector<tensorflow::Tensor> data;
+  REVERB_EXPECT_OK(sample.AsTrajectory(&data));
+  ASSERT_THAT(data, SizeIs(1 + Sample::kNumInfoTensors));
+  test::ExpectTensorEqual<tensorflow::uint64>(
+      data[Sample::kNumInfoTensors],
+      tensorflow::tensor::DeepCopy(MakeTensor(5).Slice(1, 4)));
+
+  executor->Close();
+}
+
+TEST(SampleTest, AsBatchedTimestepsGathersMultiChunkColumns) {
+  // Two chunks of 5 rows each; the slices trim the first chunk's head and the
+  // second chunk's tail so the gather has to honour the slice offsets.
+  std::vector<std::deque<Sample::ColumnChunk>> columns(1);
+  auto first = std::make_shared<const ChunkData>(
+      MakeChunkData(/*key=*/1, MakeSequenceRange(100, 0, 4)));
+  FlatTrajectory::ChunkSlice first_slice;
+  first_slice.set_chunk_key(1);
+  first_slice.set_offset(2);
+  first_slice.set_length(3);
+  first_slice.set_index(0);
+  columns[0].push_back({absl::nullopt, std::move(first), nullptr, first_slice});
+
+  auto second = std::make_shared<const ChunkData>(
+      MakeChunkData(/*key=*/2, MakeSequenceRange(100, 5, 9)));
+  FlatTrajectory::ChunkSlice second_slice;
+  second_slice.set_chunk_key(2);
+  second_slice.set_offset(0);
+  second_slice.set_length(4);
+  second_slice.set_index(0);
+  columns[0].push_back(
+      {absl::nullopt, std::move(second), nullptr, second_slice});
+
+  Sample sample(
+      /*key=*/100,
+      /*probability=*/0.5,
+      /*table_size=*/2,
+      /*priority=*/1,
+      /*rate_limited=*/false,
+      /*server_timing=*/{},
+      /*columns=*/std::move(columns),
+      /*squeeze_columns=*/{false});
+
+  std::vector<tensorflow::Tensor> data;
+  REVERB_EXPECT_OK(sample.AsBatchedTimesteps(&data));
+  ASSERT_THAT(data, SizeIs(1 + Sample::kNumInfoTensors));
+
+  std::vector<tensorflow::Tensor> expected_parts = {
+      tensorflow::tensor::DeepCopy(MakeTensor(5).Slice(2, 5)),
+      tensorflow::tensor::DeepCopy(MakeTensor(5).Slice(0, 4))};
+  tensorflow::Tensor expected;
+  ASSERT_TRUE(tensorflow::tensor::Concat(expected_parts, &expected).ok());
+  test::ExpectTensorEqual<tensorflow::uint64>(data[Sample::kNumInfoTensors],
+                                              expected);
+}
+
+TEST(SampleTest, UnpacksWideSamplesInParallel) {
+  auto executor = std::make_shared<TaskExecutor>(2, "SampleTest");
+
+  const int num_columns = Sample::kMinColumnsToUnpackInParallel;
+  const auto range = MakeSequenceRange(100, 0, 4);
+
+  std::vector<std::deque<Sample::ColumnChunk>> columns(num_columns);
+  for (int i = 0; i < num_columns; i++) {
+    auto chunk =
+        std::make_shared<const ChunkData>(MakeChunkData(/*key=*/i, range));
+    FlatTrajectory::ChunkSlice slice;
+    slice.set_chunk_key(i);
+    slice.set_offset(0);
+    slice.set_length(5);
+    slice.set_index(0);
+    columns[i].push_back({absl::nullopt, std::move(chunk), nullptr, slice});
+  }
+
+  Sample sample(
+      /*key=*/100,
+      /*probability=*/0.5,
+      /*table_size=*/2,
+      /*priority=*/1,
+      /*rate_limited=*/false,
+      /*server_timing=*/{},
+      /*columns=*/std::move(columns),
+      /*squeeze_columns=*/std::vector<bool>(num_columns, false));
+  sample.EnableParallelUnpacking(executor);
+
+  std::vector<tensorflow::Tensor> data;
+  REVERB_EXPECT_OK(sample.AsTrajectory(&data));
+  ASSERT_THAT(data, SizeIs(num_columns + Sample::kNumInfoTensors));
+  for (int i = 0; i < num_columns; i++) {
+    test::ExpectTensorEqual<tensorflow::uint64>(data[i + Sample::kNumInfoTensors], MakeTensor(5));
+  }
+
+  executor->Close();
+}
+
 TEST(GrpcSamplerTest, SendsFirstRequest) {
   auto stub = MakeGoodStub({MakeResponse(1)});
   Sampler sampler(stub, "table", {1, 1, 1});
@@ -391,14 +767,14 @@ TEST(GrpcSamplerTest, GetNextSampleReturnsPriority) {
   std::vector<tensorflow::Tensor> first;
   REVERB_EXPECT_OK(sampler.GetNextSample(&first));
   EXPECT_THAT(first,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<double>(
       first[3], MakeConstantTensor<tensorflow::DT_DOUBLE>({5}, 100.0));
 
   std::vector<tensorflow::Tensor> second;
   REVERB_EXPECT_OK(sampler.GetNextSample(&second));
   EXPECT_THAT(second,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<double>(
       second[3], MakeConstantTensor<tensorflow::DT_DOUBLE>({3}, 101.0));
 }
@@ -415,14 +791,14 @@ TEST(LocalSamplerTest, GetNextSampleReturnsPriority) {
   std::vector<tensorflow::Tensor> first;
   REVERB_EXPECT_OK(sampler.GetNextSample(&first));
   EXPECT_THAT(first,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<double>(
       first[3], MakeConstantTensor<tensorflow::DT_DOUBLE>({5}, 100.0));
 
   std::vector<tensorflow::Tensor> second;
   REVERB_EXPECT_OK(sampler.GetNextSample(&second));
   EXPECT_THAT(second,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<double>(
       second[3], MakeConstantTensor<tensorflow::DT_DOUBLE>({3}, 101.0));
 }
@@ -434,14 +810,14 @@ TEST(GrpcSamplerTest, GetNextSampleReturnsWholeSequence) {
   std::vector<tensorflow::Tensor> first;
   REVERB_EXPECT_OK(sampler.GetNextSample(&first));
   EXPECT_THAT(first,
-              SizeIs(5));  // ID, probability, table size, priority, data.
-  ExpectTensorEqual<tensorflow::uint64>(first[4], MakeTensor(5));
+              SizeIs(8));  // Info tensors followed by the data column.
+  ExpectTensorEqual<tensorflow::uint64>(first[7], MakeTensor(5));
 
   std::vector<tensorflow::Tensor> second;
   REVERB_EXPECT_OK(sampler.GetNextSample(&second));
   EXPECT_THAT(second,
-              SizeIs(5));  // ID, probability, table size, priority, data.
-  ExpectTensorEqual<tensorflow::uint64>(second[4], MakeTensor(3));
+              SizeIs(8));  // Info tensors followed by the data column.
+  ExpectTensorEqual<tensorflow::uint64>(second[7], MakeTensor(3));
 }
 
 TEST(LocalSamplerTest, GetNextSampleReturnsWholeSequence) {
@@ -454,14 +830,14 @@ TEST(LocalSamplerTest, GetNextSampleReturnsWholeSequence) {
   std::vector<tensorflow::Tensor> first;
   REVERB_EXPECT_OK(sampler.GetNextSample(&first));
   EXPECT_THAT(first,
-              SizeIs(5));  // ID, probability, table size, priority, data.
-  ExpectTensorEqual<tensorflow::uint64>(first[4], MakeTensor(5));
+              SizeIs(8));  // Info tensors followed by the data column.
+  ExpectTensorEqual<tensorflow::uint64>(first[7], MakeTensor(5));
 
   std::vector<tensorflow::Tensor> second;
   REVERB_EXPECT_OK(sampler.GetNextSample(&second));
   EXPECT_THAT(second,
-              SizeIs(5));  // ID, probability, table size, priority, data.
-  ExpectTensorEqual<tensorflow::uint64>(second[4], MakeTensor(3));
+              SizeIs(8));  // Info tensors followed by the data column.
+  ExpectTensorEqual<tensorflow::uint64>(second[7], MakeTensor(3));
 }
 
 TEST(GrpcSamplerTest, GetNextSampleTrimsSequence) {
@@ -475,24 +851,24 @@ TEST(GrpcSamplerTest, GetNextSampleTrimsSequence) {
   std::vector<tensorflow::Tensor> start_trimmed;
   REVERB_EXPECT_OK(sampler.GetNextSample(&start_trimmed));
   ASSERT_THAT(start_trimmed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<tensorflow::uint64>(
-      start_trimmed[4],
+      start_trimmed[7],
       tensorflow::tensor::DeepCopy(MakeTensor(6).Slice(1, 6)));
 
   std::vector<tensorflow::Tensor> end_trimmed;
   REVERB_EXPECT_OK(sampler.GetNextSample(&end_trimmed));
   ASSERT_THAT(end_trimmed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
-  ExpectTensorEqual<tensorflow::uint64>(end_trimmed[4],
+              SizeIs(8));  // Info tensors followed by the data column.
+  ExpectTensorEqual<tensorflow::uint64>(end_trimmed[7],
                                         MakeTensor(4).Slice(0, 3));
 
   std::vector<tensorflow::Tensor> start_and_end_trimmed;
   REVERB_EXPECT_OK(sampler.GetNextSample(&start_and_end_trimmed));
   ASSERT_THAT(start_and_end_trimmed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<tensorflow::uint64>(
-      start_and_end_trimmed[4],
+      start_and_end_trimmed[7],
       tensorflow::tensor::DeepCopy(MakeTensor(10).Slice(1, 3)));
 }
 
@@ -507,22 +883,22 @@ TEST(LocalSamplerTest, GetNextSampleTrimsSequence) {
   std::vector<tensorflow::Tensor> start_trimmed;
   REVERB_EXPECT_OK(sampler.GetNextSample(&start_trimmed));
   ASSERT_THAT(start_trimmed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<tensorflow::uint64>(
-      start_trimmed[4],
+      start_trimmed[7],
       tensorflow::tensor::DeepCopy(MakeTensor(5).Slice(1, 5)));
 
   std::vector<tensorflow::Tensor> end_trimmed;
   REVERB_EXPECT_OK(sampler.GetNextSample(&end_trimmed));
   ASSERT_THAT(end_trimmed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
-  ExpectTensorEqual<tensorflow::uint64>(end_trimmed[4],
+              SizeIs(8));  // Info tensors followed by the data column.
+  ExpectTensorEqual<tensorflow::uint64>(end_trimmed[7],
                                         MakeTensor(3).Slice(0, 2));
 
   std::vector<tensorflow::Tensor> start_and_end_trimmed;
   REVERB_EXPECT_OK(sampler.GetNextSample(&start_and_end_trimmed));
   ASSERT_THAT(start_and_end_trimmed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
 
   tensorflow::Tensor start_and_end_trimmer_want;
   REVERB_EXPECT_OK(FromTensorflowStatus(tensorflow::tensor::Concat(
@@ -532,7 +908,7 @@ TEST(LocalSamplerTest, GetNextSampleTrimsSequence) {
       },
       &start_and_end_trimmer_want)));
 
-  ExpectTensorEqual<tensorflow::uint64>(start_and_end_trimmed[4],
+  ExpectTensorEqual<tensorflow::uint64>(start_and_end_trimmed[7],
                                         start_and_end_trimmer_want);
 }
 
@@ -556,16 +932,16 @@ TEST(GrpcSamplerTest, GetNextTrajectorySqueezesColumnsIfSet) {
   std::vector<tensorflow::Tensor> squeezed;
   REVERB_EXPECT_OK(sampler.GetNextTrajectory(&squeezed));
   ASSERT_THAT(squeezed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<tensorflow::uint64>(
-      squeezed[4], tensorflow::tensor::DeepCopy(MakeTensor(4).SubSlice(1)));
+      squeezed[7], tensorflow::tensor::DeepCopy(MakeTensor(4).SubSlice(1)));
 
   std::vector<tensorflow::Tensor> not_squeezed;
   REVERB_EXPECT_OK(sampler.GetNextTrajectory(&not_squeezed));
   ASSERT_THAT(not_squeezed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<tensorflow::uint64>(
-      not_squeezed[4], tensorflow::tensor::DeepCopy(MakeTensor(4).Slice(1, 2)));
+      not_squeezed[7], tensorflow::tensor::DeepCopy(MakeTensor(4).Slice(1, 2)));
 }
 
 TEST(LocalSamplerTest, GetNextTrajectorySqueezesColumnsIfSet) {
@@ -593,16 +969,74 @@ TEST(LocalSamplerTest, GetNextTrajectorySqueezesColumnsIfSet) {
   std::vector<tensorflow::Tensor> squeezed;
   REVERB_EXPECT_OK(sampler.GetNextTrajectory(&squeezed));
   ASSERT_THAT(squeezed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<tensorflow::uint64>(
-      squeezed[4], tensorflow::tensor::DeepCopy(MakeTensor(4).SubSlice(2)));
+      squeezed[7], tensorflow::tensor::DeepCopy(MakeTensor(4).SubSlice(2)));
 
   std::vector<tensorflow::Tensor> not_squeezed;
   REVERB_EXPECT_OK(sampler.GetNextTrajectory(&not_squeezed));
   ASSERT_THAT(not_squeezed,
-              SizeIs(5));  // ID, probability, table size, priority, data.
+              SizeIs(8));  // Info tensors followed by the data column.
   ExpectTensorEqual<tensorflow::uint64>(
-      not_squeezed[4], tensorflow::tensor::DeepCopy(MakeTensor(4).Slice(2, 3)));
+      not_squeezed[7], tensorflow::tensor::DeepCopy(MakeTensor(4).Slice(2, 3)));
+}
+
+TEST(LocalSamplerTest, GetNextTrajectoryBatchStacksTrajectories) {
+  auto table = MakeTable();
+  InsertItem(table.get(), 1, 1.0, {5});
+  InsertItem(table.get(), 2, 1.0, {5});
+
+  Sampler sampler(table, {2});
+
+  std::vector<tensorflow::Tensor> batch;
+  REVERB_EXPECT_OK(sampler.GetNextTrajectoryBatch(2, &batch));
+  EXPECT_THAT(batch,
+              SizeIs(8));  // Info tensors followed by the data column.
+
+  // The scalar metadata columns are stacked into vectors and the data column
+  // gets a leading batch dimension.
+  EXPECT_EQ(batch[0].shape(), tensorflow::TensorShape({2}));
+  EXPECT_EQ(batch[7].shape(), tensorflow::TensorShape({2, 5, 2}));
+
+  // Each row of the stacked data column must hold a whole trajectory.
+  auto expected = MakeTensor(5);
+  ExpectTensorEqual<tensorflow::uint64>(batch[7].SubSlice(0), expected);
+  ExpectTensorEqual<tensorflow::uint64>(batch[7].SubSlice(1), expected);
+}
+
+TEST(LocalSamplerTest, GetNextTrajectoryBatchReturnsPartialBatchAtEnd) {
+  auto table = MakeTable();
+  InsertItem(table.get(), 1, 1.0, {5});
+
+  Sampler::Options options;
+  options.max_samples = 1;
+  Sampler sampler(table, options);
+
+  // Only a single sample can be returned so the batch is truncated.
+  std::vector<tensorflow::Tensor> batch;
+  REVERB_EXPECT_OK(sampler.GetNextTrajectoryBatch(3, &batch));
+  EXPECT_THAT(batch, SizeIs(8));
+  EXPECT_EQ(batch[7].shape(), tensorflow::TensorShape({1, 5, 2}));
+
+  EXPECT_EQ(sampler.GetNextTrajectoryBatch(3, &batch).code(),
+            absl::StatusCode::kOutOfRange);
+}
+
+TEST(LocalSamplerTest, GetNextTrajectoryBatchRejectsMismatchingShapes) {
+  auto table = MakeTable();
+  InsertItem(table.get(), 1, 1.0, {5});
+  InsertItem(table.get(), 2, 1.0, {3});
+
+  Sampler::Options options;
+  options.max_samples = 2;
+  // A single worker keeps the sample order deterministic.
+  options.num_workers = 1;
+  Sampler sampler(table, options);
+
+  // The trajectories have lengths 5 and 3 and can thus not be stacked.
+  std::vector<tensorflow::Tensor> batch;
+  EXPECT_EQ(sampler.GetNextTrajectoryBatch(2, &batch).code(),
+            absl::StatusCode::kInvalidArgument);
 }
 
 TEST(LocalSamplerTest, RespectsMaxInFlightItems) {
@@ -648,6 +1082,92 @@ TEST(LocalSamplerTest, Close) {
   EXPECT_EQ(sampler.GetNextSample(&third).code(), absl::StatusCode::kCancelled);
 }
 
+TEST(LocalSamplerTest, SharedFetchExecutorDeliversAllSamples) {
+  const int kMaxSamples = 100;
+  auto executor = std::make_shared<TaskExecutor>(4, "SamplerFetch");
+
+  auto first_table = MakeTable(kMaxSamples);
+  auto second_table = MakeTable(kMaxSamples);
+  for (int i = 0; i < kMaxSamples; i++) {
+    InsertItem(first_table.get(), i + 1, 1.0, {1});
+    InsertItem(second_table.get(), i + 1, 1.0, {1});
+  }
+
+  Sampler::Options options;
+  options.max_samples = kMaxSamples;
+  options.num_workers = 2;
+  options.fetch_executor = executor;
+
+  Sampler first(first_table, options);
+  Sampler second(second_table, options);
+
+  for (int i = 0; i < kMaxSamples; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    bool end_of_sequence;
+    REVERB_EXPECT_OK(first.GetNextTimestep(&sample, &end_of_sequence));
+    REVERB_EXPECT_OK(second.GetNextTimestep(&sample, &end_of_sequence));
+  }
+
+  // Both samplers should have exhausted their max samples.
+  std::vector<tensorflow::Tensor> sample;
+  bool end_of_sequence;
+  EXPECT_EQ(first.GetNextTimestep(&sample, &end_of_sequence).code(),
+            absl::StatusCode::kOutOfRange);
+  EXPECT_EQ(second.GetNextTimestep(&sample, &end_of_sequence).code(),
+            absl::StatusCode::kOutOfRange);
+
+  first.Close();
+  second.Close();
+  executor->Close();
+}
+
+TEST(LocalSamplerTest, AdaptiveInFlightSamplesDeliversAllSamples) {
+  // More samples than the adaptation window so the controller adjusts the
+  // budget at least a few times while sampling.
+  const int kMaxSamples = 500;
+
+  auto table = MakeTable(kMaxSamples);
+  for (int i = 0; i < kMaxSamples; i++) {
+    InsertItem(table.get(), i + 1, 1.0, {1});
+  }
+
+  Sampler::Options options;
+  options.max_samples = kMaxSamples;
+  options.adaptive_in_flight_samples = true;
+  Sampler sampler(table, options);
+
+  for (int i = 0; i < kMaxSamples; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    bool end_of_sequence;
+    REVERB_EXPECT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+  }
+
+  std::vector<tensorflow::Tensor> sample;
+  bool end_of_sequence;
+  EXPECT_EQ(sampler.GetNextTimestep(&sample, &end_of_sequence).code(),
+            absl::StatusCode::kOutOfRange);
+}
+
+TEST(LocalSamplerTest, CloseUnblocksSharedFetchExecutorRounds) {
+  auto executor = std::make_shared<TaskExecutor>(2, "SamplerFetch");
+
+  // The table is empty so the fetch round blocks on the rate limiter until
+  // the sampler is closed.
+  auto table = MakeTable();
+
+  Sampler::Options options;
+  options.fetch_executor = executor;
+  Sampler sampler(table, options);
+
+  sampler.Close();
+
+  std::vector<tensorflow::Tensor> sample;
+  bool end_of_sequence;
+  EXPECT_EQ(sampler.GetNextTimestep(&sample, &end_of_sequence).code(),
+            absl::StatusCode::kCancelled);
+  executor->Close();
+}
+
 TEST(GrpcSamplerTest, RespectsBufferSizeAndMaxSamples) {
   const int kMaxSamples = 20;
   const int kMaxInFlightSamplesPerWorker = 11;
@@ -1016,6 +1536,163 @@ TEST(GrpcSamplerTest, StressTestWithTransientErrors) {
             absl::StatusCode::kOutOfRange);
 }
 
+TEST(GrpcSamplerTest, AsyncFetchDeliversAllSamplesThroughSharedExecutor) {
+  const int kMaxSamples = 3;
+  auto executor = std::make_shared<TaskExecutor>(2, "SamplerFetch");
+  auto stub = std::make_shared<FakeAsyncStub>();
+  stub->AddStream({MakeResponse(1), MakeResponse(1), MakeResponse(1)});
+
+  Sampler::Options options;
+  options.max_samples = kMaxSamples;
+  options.fetch_executor = executor;
+  Sampler sampler(stub, "table", options);
+
+  for (int i = 0; i < kMaxSamples; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    bool end_of_sequence;
+    REVERB_EXPECT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+    EXPECT_TRUE(end_of_sequence);
+  }
+
+  std::vector<tensorflow::Tensor> sample;
+  bool end_of_sequence;
+  EXPECT_EQ(sampler.GetNextTimestep(&sample, &end_of_sequence).code(),
+            absl::StatusCode::kOutOfRange);
+
+  // The whole fetch fits in a single request on a single stream.
+  EXPECT_THAT(stub->requests(), SizeIs(1));
+  EXPECT_EQ(stub->requests()[0].num_samples(), kMaxSamples);
+
+  sampler.Close();
+  executor->Close();
+}
+
+TEST(GrpcSamplerTest, AsyncFetchRequestsFollowUpBatchesOnTheSameStream) {
+  const int kMaxSamples = 3;
+  auto executor = std::make_shared<TaskExecutor>(2, "SamplerFetch");
+  auto stub = std::make_shared<FakeAsyncStub>();
+  stub->AddStream({MakeResponse(1), MakeResponse(1), MakeResponse(1)});
+
+  Sampler::Options options;
+  options.max_samples = kMaxSamples;
+  options.max_in_flight_samples_per_worker = 1;
+  options.fetch_executor = executor;
+  Sampler sampler(stub, "table", options);
+
+  for (int i = 0; i < kMaxSamples; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    bool end_of_sequence;
+    REVERB_EXPECT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+  }
+
+  // The in flight budget allows a single sample per request so the fetch is
+  // split into one request per sample, all on the same stream.
+  EXPECT_THAT(stub->requests(), SizeIs(kMaxSamples));
+  for (const auto& request : stub->requests()) {
+    EXPECT_EQ(request.num_samples(), 1);
+  }
+
+  sampler.Close();
+  executor->Close();
+}
+
+TEST(GrpcSamplerTest, AsyncFetchRetriesTransientErrors) {
+  auto executor = std::make_shared<TaskExecutor>(2, "SamplerFetch");
+  auto stub = std::make_shared<FakeAsyncStub>();
+  stub->AddStream({}, grpc::Status(grpc::StatusCode::UNAVAILABLE, ""));
+  stub->AddStream({MakeResponse(1)});
+
+  Sampler::Options options;
+  options.max_samples = 1;
+  options.fetch_executor = executor;
+  Sampler sampler(stub, "table", options);
+
+  std::vector<tensorflow::Tensor> sample;
+  bool end_of_sequence;
+  REVERB_EXPECT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+
+  sampler.Close();
+  executor->Close();
+}
+
+TEST(GrpcSamplerTest, AsyncFetchForwardsFatalServerError) {
+  auto executor = std::make_shared<TaskExecutor>(2, "SamplerFetch");
+  auto stub = std::make_shared<FakeAsyncStub>();
+  stub->AddStream({}, grpc::Status(grpc::StatusCode::INTERNAL, ""));
+
+  Sampler::Options options;
+  options.max_samples = 1;
+  options.fetch_executor = executor;
+  Sampler sampler(stub, "table", options);
+
+  std::vector<tensorflow::Tensor> sample;
+  bool end_of_sequence;
+  EXPECT_EQ(sampler.GetNextTimestep(&sample, &end_of_sequence).code(),
+            absl::StatusCode::kInternal);
+
+  sampler.Close();
+  executor->Close();
+}
+
+TEST(GrpcSamplerTest, ReplicatedStubsDeliverAllSamples) {
+  const int kMaxSamples = 4;
+  auto replica_a = std::make_shared<FakeStub>();
+  auto replica_b = std::make_shared<FakeStub>();
+  for (int i = 0; i < kMaxSamples; i++) {
+    replica_a->AddStream(
+        {MakeResponse(1), MakeResponse(1), MakeResponse(1), MakeResponse(1)});
+    replica_b->AddStream(
+        {MakeResponse(1), MakeResponse(1), MakeResponse(1), MakeResponse(1)});
+  }
+
+  Sampler::Options options;
+  options.max_samples = kMaxSamples;
+  options.stubs_are_replicas = true;
+  Sampler sampler({replica_a, replica_b}, "table", options);
+
+  for (int i = 0; i < kMaxSamples; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    bool end_of_sequence;
+    REVERB_EXPECT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+  }
+
+  // There should be no more samples left.
+  std::vector<tensorflow::Tensor> sample;
+  bool end_of_sequence;
+  EXPECT_EQ(sampler.GetNextTimestep(&sample, &end_of_sequence).code(),
+            absl::StatusCode::kOutOfRange);
+
+  EXPECT_GE(replica_a->requests().size() + replica_b->requests().size(), 1);
+}
+
+TEST(GrpcSamplerTest, ReplicatedStubsRouteAroundFailingReplica) {
+  const int kMaxSamples = 3;
+  auto healthy = std::make_shared<FakeStub>();
+  for (int i = 0; i < 10; i++) {
+    healthy->AddStream({MakeResponse(1), MakeResponse(1), MakeResponse(1)});
+  }
+  // Streams to the failing replica are rejected with a transient error; the
+  // selector penalises it so the healthy replica ends up serving the fetch.
+  auto failing = std::make_shared<FakeStub>();
+  for (int i = 0; i < 100; i++) {
+    failing->AddStream({}, grpc::Status(grpc::StatusCode::UNAVAILABLE, ""));
+  }
+
+  Sampler::Options options;
+  options.max_samples = kMaxSamples;
+  options.num_workers = 1;
+  options.stubs_are_replicas = true;
+  Sampler sampler({failing, healthy}, "table", options);
+
+  for (int i = 0; i < kMaxSamples; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    bool end_of_sequence;
+    REVERB_EXPECT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+  }
+
+  EXPECT_GE(healthy->requests().size(), 1);
+}
+
 TEST(SamplerDeathTest, DiesIfMaxInFlightSamplesPerWorkerIsNonPositive) {
   Sampler::Options options;
 
@@ -1095,6 +1772,23 @@ TEST(SamplerOptionsTest, ValidateChecksMaxSamplesPerStream) {
   EXPECT_EQ(options.Validate().code(), absl::StatusCode::kInvalidArgument);
 }
 
+TEST(SamplerOptionsTest, ValidateChecksTargetBufferFill) {
+  Sampler::Options options;
+  options.adaptive_in_flight_samples = true;
+  REVERB_EXPECT_OK(options.Validate());
+  options.target_buffer_fill = 0;
+  EXPECT_EQ(options.Validate().code(), absl::StatusCode::kInvalidArgument);
+  options.target_buffer_fill = 1.5;
+  EXPECT_EQ(options.Validate().code(), absl::StatusCode::kInvalidArgument);
+  options.target_buffer_fill = 1.0;
+  REVERB_EXPECT_OK(options.Validate());
+
+  // The target is ignored when the adaptive controller is disabled.
+  options.adaptive_in_flight_samples = false;
+  options.target_buffer_fill = 0;
+  REVERB_EXPECT_OK(options.Validate());
+}
+
 TEST(SamplerOptionsTest, ValidateChecksRateLimiterTimeout) {
   Sampler::Options options;
   options.rate_limiter_timeout = -absl::Seconds(1);
@@ -1103,6 +1797,16 @@ TEST(SamplerOptionsTest, ValidateChecksRateLimiterTimeout) {
   REVERB_EXPECT_OK(options.Validate());
 }
 
+TEST(SamplerOptionsTest, ValidateChecksReplicaHedgeTimeout) {
+  Sampler::Options options;
+  options.replica_hedge_timeout = absl::ZeroDuration();
+  EXPECT_EQ(options.Validate().code(), absl::StatusCode::kInvalidArgument);
+  options.replica_hedge_timeout = -absl::Seconds(1);
+  EXPECT_EQ(options.Validate().code(), absl::StatusCode::kInvalidArgument);
+  options.replica_hedge_timeout = absl::Milliseconds(50);
+  REVERB_EXPECT_OK(options.Validate());
+}
+
 }  // namespace
 }  // namespace reverb
 }  // namespace deepmind
@@ -0,0 +1,286 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/alias.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// Rebuild regardless of the sqrt(n) bound once the delta set reaches this
+// size, and never rebuild below it; avoids pathological rebuild cadences for
+// tiny tables.
+constexpr size_t kMinStaleKeysForRebuild = 32;
+
+// Number of stale alias draws tolerated in a single `Sample` before forcing a
+// rebuild. With at most half of the built mass stale the probability of ever
+// hitting this is ~2^-64.
+constexpr int kMaxStaleDraws = 64;
+
+// A priority of zero should correspond to zero probability, even if the
+// priority exponent is zero. So this modified version of std::pow is used to
+// turn priorities into weights. Expects base and exponent to be non-negative.
+inline double power(double base, double exponent) {
+  return base == 0. ? 0. : std::pow(base, exponent);
+}
+
+absl::Status CheckValidPriority(double priority) {
+  if (std::isnan(priority))
+    return absl::InvalidArgumentError("Priority must not be NaN.");
+  if (priority < 0)
+    return absl::InvalidArgumentError("Priority must not be negative.");
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+AliasSelector::AliasSelector(double priority_exponent, absl::BitGen bit_gen)
+    : priority_exponent_(priority_exponent), bit_gen_(std::move(bit_gen)) {
+  REVERB_CHECK_GE(priority_exponent_, 0);
+}
+
+absl::Status AliasSelector::Delete(Key key) {
+  const auto it = weights_.find(key);
+  if (it == weights_.end())
+    return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
+  weights_.erase(it);
+
+  const bool is_built = built_index_.find(key) != built_index_.end();
+  const auto delta_it = delta_.find(key);
+  if (delta_it != delta_.end()) {
+    delta_total_ = std::max(0., delta_total_ - delta_it->second);
+    if (is_built) {
+      // Keep a zero weight entry so stale alias draws of this key are
+      // rejected.
+      delta_it->second = 0;
+    } else {
+      delta_.erase(delta_it);
+    }
+  } else {
+    // The key was untouched since the last build.
+    built_remaining_ =
+        std::max(0., built_remaining_ - built_weights_[built_index_[key]]);
+    delta_[key] = 0;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status AliasSelector::Insert(Key key, double priority) {
+  REVERB_RETURN_IF_ERROR(CheckValidPriority(priority));
+  const double weight = power(priority, priority_exponent_);
+  if (!weights_.try_emplace(key, weight).second)
+    return absl::InvalidArgumentError(
+        absl::StrCat("Key ", key, " already inserted."));
+
+  // A previously deleted built key may still have a (zero weight) delta entry.
+  const auto delta_it = delta_.find(key);
+  if (delta_it != delta_.end()) {
+    delta_total_ += weight - delta_it->second;
+    delta_it->second = weight;
+  } else {
+    delta_[key] = weight;
+    delta_total_ += weight;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status AliasSelector::Update(Key key, double priority) {
+  REVERB_RETURN_IF_ERROR(CheckValidPriority(priority));
+  const auto it = weights_.find(key);
+  if (it == weights_.end())
+    return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
+  const double weight = power(priority, priority_exponent_);
+  it->second = weight;
+
+  const auto delta_it = delta_.find(key);
+  if (delta_it != delta_.end()) {
+    delta_total_ += weight - delta_it->second;
+    delta_it->second = weight;
+  } else {
+    // The key moves from the clean built mass into the delta set.
+    built_remaining_ =
+        std::max(0., built_remaining_ - built_weights_[built_index_[key]]);
+    delta_[key] = weight;
+    delta_total_ += weight;
+  }
+  delta_total_ = std::max(0., delta_total_);
+  return absl::OkStatus();
+}
+
+ItemSelector::KeyWithProbability AliasSelector::Sample() {
+  REVERB_CHECK(!weights_.empty());
+  if (RebuildNeeded()) Rebuild();
+
+  const double total = built_remaining_ + delta_total_;
+
+  // All live keys have zero weight so treat as if uniformly sampling. After a
+  // rebuild the built arrays hold exactly the live keys.
+  if (total == 0) {
+    if (!delta_.empty()) Rebuild();
+    const size_t pos = absl::Uniform<size_t>(bit_gen_, 0, built_keys_.size());
+    return {built_keys_[pos], 1. / built_keys_.size()};
+  }
+
+  double target = absl::Uniform<double>(bit_gen_, 0, total);
+
+  // Keys touched since the last build are resolved by scanning the delta set.
+  if (target < delta_total_) {
+    Key last_positive = 0;
+    double last_weight = 0;
+    for (const auto& entry : delta_) {
+      if (entry.second > 0) {
+        if (target < entry.second) return {entry.first, entry.second / total};
+        last_positive = entry.first;
+        last_weight = entry.second;
+      }
+      target -= entry.second;
+    }
+    // Rounding pushed the target past the delta mass; fall back to the last
+    // key that could have been picked.
+    if (last_weight > 0) return {last_positive, last_weight / total};
+  }
+
+  // Unchanged keys are resolved by an O(1) alias draw; draws that land on a
+  // key in the delta set carry stale mass and are rejected. At most half of
+  // the built mass is stale (see RebuildNeeded) so this accepts quickly.
+  for (int attempt = 0; attempt < kMaxStaleDraws; ++attempt) {
+    const size_t slot = absl::Uniform<size_t>(bit_gen_, 0, built_keys_.size());
+    const size_t index =
+        absl::Uniform<double>(bit_gen_, 0, 1) < accept_prob_[slot]
+            ? slot
+            : alias_[slot];
+    const Key key = built_keys_[index];
+    if (delta_.find(key) == delta_.end()) {
+      return {key, built_weights_[index] / total};
+    }
+  }
+
+  // Statistically (next to) impossible unless the bookkeeping drifted; start
+  // over from a fresh table.
+  Rebuild();
+  return Sample();
+}
+
+double AliasSelector::TotalWeight() const {
+  return built_remaining_ + delta_total_;
+}
+
+void AliasSelector::ExportSamplingWeights(
+    std::vector<std::pair<Key, double>>* weights) const {
+  weights->reserve(weights->size() + weights_.size());
+  for (const auto& entry : weights_) {
+    weights->push_back({entry.first, entry.second});
+  }
+}
+
+void AliasSelector::Clear() {
+  weights_.clear();
+  built_keys_.clear();
+  built_weights_.clear();
+  built_index_.clear();
+  accept_prob_.clear();
+  alias_.clear();
+  built_total_ = 0;
+  built_remaining_ = 0;
+  delta_.clear();
+  delta_total_ = 0;
+}
+
+KeyDistributionOptions AliasSelector::options() const {
+  KeyDistributionOptions options;
+  options.mutable_alias()->set_priority_exponent(priority_exponent_);
+  options.set_is_deterministic(false);
+  return options;
+}
+
+std::string AliasSelector::DebugString() const {
+  return absl::StrCat("AliasSelector(priority_exponent=", priority_exponent_,
+                      ")");
+}
+
+bool AliasSelector::RebuildNeeded() const {
+  if (built_keys_.empty()) return true;
+  if (delta_.size() >= kMinStaleKeysForRebuild &&
+      delta_.size() * delta_.size() > weights_.size()) {
+    return true;
+  }
+  // More than half of the built mass is stale; alias draws would reject too
+  // often.
+  return built_total_ > 0 && built_remaining_ < built_total_ / 2;
+}
+
+void AliasSelector::Rebuild() {
+  const size_t n = weights_.size();
+  built_keys_.clear();
+  built_weights_.clear();
+  built_index_.clear();
+  delta_.clear();
+  delta_total_ = 0;
+
+  built_keys_.reserve(n);
+  built_weights_.reserve(n);
+  built_index_.reserve(n);
+  built_total_ = 0;
+  for (const auto& entry : weights_) {
+    built_index_[entry.first] = built_keys_.size();
+    built_keys_.push_back(entry.first);
+    built_weights_.push_back(entry.second);
+    built_total_ += entry.second;
+  }
+  built_remaining_ = built_total_;
+
+  accept_prob_.assign(n, 1.0);
+  alias_.resize(n);
+  for (size_t i = 0; i < n; ++i) alias_[i] = i;
+  if (n == 0 || built_total_ == 0) return;
+
+  // Vose's algorithm: pair each slot with scaled weight below 1 with one
+  // above 1 so every slot resolves between exactly two keys.
+  std::vector<double> scaled(n);
+  std::vector<size_t> small;
+  std::vector<size_t> large;
+  for (size_t i = 0; i < n; ++i) {
+    scaled[i] = built_weights_[i] * n / built_total_;
+    (scaled[i] < 1 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    const size_t s = small.back();
+    small.pop_back();
+    const size_t l = large.back();
+    large.pop_back();
+    accept_prob_[s] = scaled[s];
+    alias_[s] = l;
+    scaled[l] = (scaled[l] + scaled[s]) - 1;
+    (scaled[l] < 1 ? small : large).push_back(l);
+  }
+  // Leftovers on either side have scaled weight 1 up to rounding.
+  for (const size_t i : large) accept_prob_[i] = 1;
+  for (const size_t i : small) accept_prob_[i] = 1;
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,127 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SELECTORS_ALIAS_H_
+#define REVERB_CC_SELECTORS_ALIAS_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/selectors/interface.h"
+
+namespace deepmind {
+namespace reverb {
+
+// AliasSelector samples keys with probability proportional to their priority
+// raised to a configurable exponent, like PrioritizedSelector, but is
+// optimized for distributions that barely change: tables that are loaded once
+// and then sampled many times with only occasional priority updates.
+//
+// Sampling uses Walker's alias method which draws in O(1) time from an O(n)
+// table built with Vose's algorithm. Mutations do not rebuild the table
+// eagerly. Instead, keys whose weight differs from the value captured by the
+// last build are tracked in a small "delta" set together with their current
+// weight. A sample first splits the draw between the delta mass and the
+// unchanged built mass; delta keys are resolved by a linear scan of the delta
+// set and unchanged keys by an alias draw that rejects (and redraws) stale
+// keys. The result is exact at all times, O(1) when the delta set is empty
+// and O(|delta|) in the worst case otherwise. The table is rebuilt, at O(n)
+// cost, once the delta set grows past roughly sqrt(n) keys or more than half
+// of the built mass has gone stale, which keeps both the scan and the
+// expected number of rejected draws bounded.
+//
+// See ItemSelector for documentation of the public methods.
+class AliasSelector : public ItemSelector {
+ public:
+  explicit AliasSelector(double priority_exponent,
+                         absl::BitGen bit_gen = absl::BitGen());
+
+  // O(1) time; marks the key stale for the next rebuild.
+  absl::Status Delete(Key key) override;
+
+  // O(1) time; the key lives in the delta set until the next rebuild.
+  absl::Status Insert(Key key, double priority) override;
+
+  // O(1) time; the key lives in the delta set until the next rebuild.
+  absl::Status Update(Key key, double priority) override;
+
+  // O(1) time when no mutations happened since the last rebuild, otherwise
+  // O(|delta|) worst case. Triggers an O(n) rebuild when the delta set has
+  // outgrown its bound.
+  KeyWithProbability Sample() override;
+
+  double TotalWeight() const override;
+
+  void ExportSamplingWeights(
+      std::vector<std::pair<Key, double>>* weights) const override;
+
+  void Clear() override;
+
+  KeyDistributionOptions options() const override;
+
+  std::string DebugString() const override;
+
+  // Number of keys whose weight differs from the last built alias table. Test
+  // only.
+  size_t NumStaleKeysTestingOnly() const { return delta_.size(); }
+
+ private:
+  // Rebuilds the alias table from `weights_` and empties the delta set.
+  void Rebuild();
+
+  // Whether the delta set has grown past the point where sampling from the
+  // stale table is no longer cheap.
+  bool RebuildNeeded() const;
+
+  const double priority_exponent_;
+
+  // Current weight (exponentiated priority) of every live key. This is the
+  // source of truth; everything below is derived.
+  internal::flat_hash_map<Key, double> weights_;
+
+  // Keys, their weights and positions as captured by the last `Rebuild`.
+  std::vector<Key> built_keys_;
+  std::vector<double> built_weights_;
+  internal::flat_hash_map<Key, size_t> built_index_;
+
+  // Alias table over `built_keys_`: slot `i` resolves to `built_keys_[i]`
+  // with probability `accept_prob_[i]` and to `built_keys_[alias_[i]]`
+  // otherwise.
+  std::vector<double> accept_prob_;
+  std::vector<size_t> alias_;
+
+  // Total built weight and the part of it belonging to keys that are still
+  // unchanged (i.e. not in `delta_`).
+  double built_total_ = 0;
+  double built_remaining_ = 0;
+
+  // Current weight of every key that differs from its built state: updated
+  // keys, keys inserted since the build, and (with weight zero) deleted built
+  // keys which must be rejected when drawn from the stale table.
+  internal::flat_hash_map<Key, double> delta_;
+  double delta_total_ = 0;
+
+  // Used for sampling, not thread-safe.
+  absl::BitGen bit_gen_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SELECTORS_ALIAS_H_
@@ -0,0 +1,175 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/alias.h"
+
+#include <cmath>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+const double kInitialPriorityExponent = 1;
+
+TEST(AliasSelectorTest, ReturnValueSanityChecks) {
+  AliasSelector alias(kInitialPriorityExponent);
+
+  // Non existent keys cannot be deleted or updated.
+  EXPECT_EQ(alias.Delete(123).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(alias.Update(123, 4).code(), absl::StatusCode::kInvalidArgument);
+
+  // Keys cannot be inserted twice.
+  REVERB_EXPECT_OK(alias.Insert(123, 4));
+  EXPECT_EQ(alias.Insert(123, 4).code(), absl::StatusCode::kInvalidArgument);
+
+  // Existing keys can be updated and sampled.
+  REVERB_EXPECT_OK(alias.Update(123, 5));
+  EXPECT_EQ(alias.Sample().key, 123);
+
+  // Negative priorities are not allowed.
+  EXPECT_EQ(alias.Update(123, -1).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(alias.Insert(456, -1).code(), absl::StatusCode::kInvalidArgument);
+
+  // NAN priorites are not allowed.
+  EXPECT_EQ(alias.Update(123, NAN).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(alias.Insert(456, NAN).code(), absl::StatusCode::kInvalidArgument);
+
+  // Existing keys cannot be deleted twice.
+  REVERB_EXPECT_OK(alias.Delete(123));
+  EXPECT_EQ(alias.Delete(123).code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(AliasSelectorTest, SamplesProportionallyToPriority) {
+  const int64_t kItems = 100;
+  const int64_t kSamples = 1000000;
+
+  AliasSelector alias(kInitialPriorityExponent);
+  double sum = 0;
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(alias.Insert(i, i));
+    sum += i;
+  }
+
+  std::vector<int64_t> counts(kItems);
+  for (int i = 0; i < kSamples; i++) {
+    ItemSelector::KeyWithProbability sample = alias.Sample();
+    EXPECT_NEAR(sample.probability, sample.key / sum, 1e-9);
+    counts[sample.key]++;
+  }
+  for (int i = 0; i < kItems; i++) {
+    EXPECT_NEAR(static_cast<double>(counts[i]) / kSamples, i / sum, 0.002);
+  }
+}
+
+TEST(AliasSelectorTest, AllZeroPrioritiesResultsInUniformSampling) {
+  const int64_t kItems = 100;
+  const int64_t kSamples = 1000000;
+  const double expected_probability = 1. / static_cast<double>(kItems);
+
+  AliasSelector alias(kInitialPriorityExponent);
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(alias.Insert(i, 0));
+  }
+  std::vector<int64_t> counts(kItems);
+  for (int i = 0; i < kSamples; i++) {
+    ItemSelector::KeyWithProbability sample = alias.Sample();
+    EXPECT_EQ(sample.probability, expected_probability);
+    counts[sample.key]++;
+  }
+  for (int64_t count : counts) {
+    EXPECT_NEAR(static_cast<double>(count) / kSamples, expected_probability,
+                0.05 * expected_probability);
+  }
+}
+
+TEST(AliasSelectorTest, MutationsAfterBuildAreSampledExactly) {
+  const int64_t kItems = 1000;
+  const int64_t kSamples = 1000000;
+
+  AliasSelector alias(kInitialPriorityExponent);
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(alias.Insert(i, 1));
+  }
+  // Build the alias table.
+  alias.Sample();
+  EXPECT_EQ(alias.NumStaleKeysTestingOnly(), 0);
+
+  // A few mutations that must not trigger a rebuild: one boosted key, one
+  // deleted key and one key inserted after the build.
+  REVERB_EXPECT_OK(alias.Update(0, 100));
+  REVERB_EXPECT_OK(alias.Delete(1));
+  REVERB_EXPECT_OK(alias.Insert(kItems, 50));
+  EXPECT_EQ(alias.NumStaleKeysTestingOnly(), 3);
+
+  const double sum = 100 + 50 + (kItems - 2);
+  internal::flat_hash_map<ItemSelector::Key, int64_t> counts;
+  for (int i = 0; i < kSamples; i++) {
+    ItemSelector::KeyWithProbability sample = alias.Sample();
+    EXPECT_NE(sample.key, 1);
+    counts[sample.key]++;
+  }
+  // Sampling remained exact without a rebuild.
+  EXPECT_EQ(alias.NumStaleKeysTestingOnly(), 3);
+  EXPECT_NEAR(static_cast<double>(counts[0]) / kSamples, 100 / sum, 0.002);
+  EXPECT_NEAR(static_cast<double>(counts[kItems]) / kSamples, 50 / sum, 0.002);
+  EXPECT_NEAR(static_cast<double>(counts[2]) / kSamples, 1 / sum, 0.001);
+}
+
+TEST(AliasSelectorTest, LargeDeltaSetTriggersRebuild) {
+  const int64_t kItems = 100;
+
+  AliasSelector alias(kInitialPriorityExponent);
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(alias.Insert(i, 1));
+  }
+  alias.Sample();
+
+  // Touch more than sqrt(kItems) keys (and more than the minimum rebuild
+  // size) so the next sample rebuilds the table.
+  for (int i = 0; i < 50; i++) {
+    REVERB_EXPECT_OK(alias.Update(i, 2));
+  }
+  EXPECT_EQ(alias.NumStaleKeysTestingOnly(), 50);
+  alias.Sample();
+  EXPECT_EQ(alias.NumStaleKeysTestingOnly(), 0);
+}
+
+TEST(AliasSelectorTest, SetsAliasOptions) {
+  AliasSelector alias(0.7);
+  EXPECT_THAT(alias.options(),
+              testing::EqualsProto("alias: { priority_exponent: 0.7 } "
+                                   "is_deterministic: false"));
+}
+
+TEST(AliasSelectorDeathTest, ClearThenSample) {
+  AliasSelector alias(kInitialPriorityExponent);
+  for (int i = 0; i < 100; i++) {
+    REVERB_EXPECT_OK(alias.Insert(i, i));
+  }
+  alias.Sample();
+  alias.Clear();
+  EXPECT_DEATH(alias.Sample(), "");
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
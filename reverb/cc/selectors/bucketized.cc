@@ -0,0 +1,355 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/bucketized.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// A priority of zero should correspond to zero probability, even if the
+// priority exponent is zero. See PrioritizedSelector.
+inline double power(double base, double exponent) {
+  return base == 0. ? 0. : std::pow(base, exponent);
+}
+
+absl::Status CheckValidPriority(double priority) {
+  if (std::isnan(priority))
+    return absl::InvalidArgumentError("Priority must not be NaN.");
+  if (priority < 0)
+    return absl::InvalidArgumentError("Priority must not be negative.");
+  return absl::OkStatus();
+}
+
+// Returns the offset of the child within the `size` contiguous `children`
+// that contains `target`, subtracting the weight of the skipped children from
+// `target`. Falls back to the last non-empty child if rounding errors pushed
+// `target` past the total weight of the block.
+inline size_t DescendBlock(const double* children, size_t size,
+                           double* target) {
+  size_t last_non_empty = 0;
+  for (size_t k = 0; k < size; ++k) {
+    const double weight = children[k];
+    if (weight > 0) {
+      if (*target < weight) return k;
+      last_non_empty = k;
+    }
+    *target -= weight;
+  }
+  return last_non_empty;
+}
+
+}  // namespace
+
+BucketizedSelector::BucketizedSelector(double priority_exponent,
+                                       absl::BitGen bit_gen)
+    : priority_exponent_(priority_exponent),
+      capacity_(0),
+      bit_gen_(std::move(bit_gen)) {
+  REVERB_CHECK_GE(priority_exponent_, 0);
+  Grow(128 * kBucketSize);
+}
+
+absl::Status BucketizedSelector::Delete(Key key) {
+  const size_t last_index = key_to_index_.size() - 1;
+  const auto it = key_to_index_.find(key);
+  if (it == key_to_index_.end())
+    return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
+  const size_t index = it->second;
+
+  if (index != last_index) {
+    // Replace the element that we want to remove with the last element so the
+    // buckets stay densely packed.
+    values_[index] = values_[last_index];
+    keys_[index] = keys_[last_index];
+    key_to_index_[keys_[index]] = index;
+  }
+
+  values_[last_index] = 0;
+  keys_.pop_back();
+  key_to_index_.erase(it);
+
+  RecomputeBucket(index / kBucketSize);
+  if (index / kBucketSize != last_index / kBucketSize) {
+    RecomputeBucket(last_index / kBucketSize);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status BucketizedSelector::Insert(Key key, double priority) {
+  REVERB_RETURN_IF_ERROR(CheckValidPriority(priority));
+  const size_t index = key_to_index_.size();
+  if (index == capacity_) {
+    Grow(2 * capacity_);
+  }
+  if (!key_to_index_.try_emplace(key, index).second) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Key ", key, " already inserted."));
+  }
+  keys_.push_back(key);
+  values_[index] = power(priority, priority_exponent_);
+  RecomputeBucket(index / kBucketSize);
+  return absl::OkStatus();
+}
+
+absl::Status BucketizedSelector::BulkInsert(
+    absl::Span<const std::pair<Key, double>> items) {
+  if (items.empty()) return absl::OkStatus();
+
+  // Claim the keys before touching any leaf or sum so an invalid entry can be
+  // unwound with map erases alone.
+  const size_t first_index = key_to_index_.size();
+  for (size_t i = 0; i < items.size(); ++i) {
+    absl::Status status = CheckValidPriority(items[i].second);
+    if (status.ok() &&
+        !key_to_index_.try_emplace(items[i].first, first_index + i).second) {
+      status = absl::InvalidArgumentError(
+          absl::StrCat("Key ", items[i].first, " already inserted."));
+    }
+    if (!status.ok()) {
+      for (size_t j = 0; j < i; ++j) key_to_index_.erase(items[j].first);
+      return status;
+    }
+  }
+
+  const size_t size = first_index + items.size();
+  if (size > capacity_) {
+    size_t capacity = 2 * capacity_;
+    while (capacity < size) capacity *= 2;
+    Grow(capacity);
+  }
+
+  for (const auto& item : items) {
+    values_[keys_.size()] = power(item.second, priority_exponent_);
+    keys_.push_back(item.first);
+  }
+
+  // The new leaves are consecutive, so one pass over the contiguous range of
+  // affected buckets followed by a bottom-up repair of the top tree costs
+  // O(n) overall.
+  size_t first = first_index / kBucketSize;
+  size_t last = (size - 1) / kBucketSize;
+  for (size_t bucket = first; bucket <= last; ++bucket) {
+    double sum = 0;
+    const double* leaves = values_.data() + bucket * kBucketSize;
+    for (size_t k = 0; k < kBucketSize; ++k) sum += leaves[k];
+    bucket_sums_[bucket] = sum;
+  }
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    first /= kFanout;
+    last /= kFanout;
+    for (size_t node = first; node <= last; ++node) RecomputeNode(level, node);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status BucketizedSelector::Update(Key key, double priority) {
+  REVERB_RETURN_IF_ERROR(CheckValidPriority(priority));
+  const auto it = key_to_index_.find(key);
+  if (it == key_to_index_.end()) {
+    return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
+  }
+  values_[it->second] = power(priority, priority_exponent_);
+  RecomputeBucket(it->second / kBucketSize);
+  return absl::OkStatus();
+}
+
+absl::Status BucketizedSelector::BulkUpdate(
+    absl::Span<const std::pair<Key, double>> updates) {
+  // Resolve and validate the whole batch before mutating anything so an
+  // invalid entry does not leave the structure partially updated.
+  std::vector<std::pair<size_t, double>> indexed;
+  indexed.reserve(updates.size());
+  for (const auto& update : updates) {
+    REVERB_RETURN_IF_ERROR(CheckValidPriority(update.second));
+    const auto it = key_to_index_.find(update.first);
+    if (it == key_to_index_.end()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Key ", update.first, " not found."));
+    }
+    indexed.push_back({it->second, update.second});
+  }
+
+  // Apply all leaf updates and remember the affected buckets; each dirty
+  // bucket is rescanned once no matter how many updates landed in it.
+  std::vector<size_t> dirty;
+  dirty.reserve(indexed.size());
+  for (const auto& update : indexed) {
+    values_[update.first] = power(update.second, priority_exponent_);
+    dirty.push_back(update.first / kBucketSize);
+  }
+  std::sort(dirty.begin(), dirty.end());
+  dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+  for (size_t bucket : dirty) {
+    double sum = 0;
+    const double* leaves = values_.data() + bucket * kBucketSize;
+    for (size_t k = 0; k < kBucketSize; ++k) sum += leaves[k];
+    bucket_sums_[bucket] = sum;
+  }
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    for (auto& node : dirty) node /= kFanout;
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    for (size_t node : dirty) RecomputeNode(level, node);
+  }
+  return absl::OkStatus();
+}
+
+ItemSelector::KeyWithProbability BucketizedSelector::Sample() {
+  const size_t size = key_to_index_.size();
+  REVERB_CHECK_NE(size, 0);
+
+  // This should never be called concurrently from multiple threads.
+  const double target = absl::Uniform<double>(bit_gen_, 0, 1);
+  const double total_weight = TotalWeight();
+
+  // All keys have zero priority so treat as if uniformly sampling.
+  if (total_weight == 0) {
+    const size_t pos = static_cast<size_t>(target * size);
+    return {keys_[pos], 1. / size};
+  }
+
+  // Descend the top tree to a bucket; every step scans one block of `kFanout`
+  // contiguous sums.
+  double target_weight = target * total_weight;
+  size_t node = 0;
+  for (int level = static_cast<int>(level_sums_.size()) - 2; level >= 0;
+       --level) {
+    node = node * kFanout +
+           DescendBlock(level_sums_[level].data() + node * kFanout, kFanout,
+                        &target_weight);
+  }
+  const size_t bucket =
+      node * kFanout + DescendBlock(bucket_sums_.data() + node * kFanout,
+                                    kFanout, &target_weight);
+
+  // Resolve the key with a linear scan of the bucket's flat weight array.
+  const size_t index =
+      bucket * kBucketSize + DescendBlock(values_.data() + bucket * kBucketSize,
+                                          kBucketSize, &target_weight);
+  REVERB_CHECK_LT(index, size);
+
+  const double picked_weight = values_[index];
+  REVERB_LOG_IF(REVERB_ERROR, target_weight >= picked_weight)
+      << "Target weight should be smaller than picked weight (target_weight: "
+      << target_weight << " >= picked_weight:" << picked_weight << ").";
+  return {keys_[index], picked_weight / total_weight};
+}
+
+double BucketizedSelector::TotalWeight() const {
+  return level_sums_.back()[0];
+}
+
+void BucketizedSelector::ExportSamplingWeights(
+    std::vector<std::pair<Key, double>>* weights) const {
+  const size_t size = key_to_index_.size();
+  weights->reserve(weights->size() + size);
+  for (size_t i = 0; i < size; ++i) {
+    weights->push_back({keys_[i], values_[i]});
+  }
+}
+
+void BucketizedSelector::Clear() {
+  std::fill(values_.begin(), values_.end(), 0.0);
+  std::fill(bucket_sums_.begin(), bucket_sums_.end(), 0.0);
+  for (auto& level : level_sums_) {
+    std::fill(level.begin(), level.end(), 0.0);
+  }
+  keys_.clear();
+  key_to_index_.clear();
+}
+
+KeyDistributionOptions BucketizedSelector::options() const {
+  KeyDistributionOptions options;
+  options.mutable_bucketized()->set_priority_exponent(priority_exponent_);
+  options.set_is_deterministic(false);
+  return options;
+}
+
+std::string BucketizedSelector::DebugString() const {
+  return absl::StrCat(
+      "BucketizedSelector(priority_exponent=", priority_exponent_, ")");
+}
+
+void BucketizedSelector::RecomputeBucket(size_t bucket) {
+  double sum = 0;
+  const double* leaves = values_.data() + bucket * kBucketSize;
+  for (size_t k = 0; k < kBucketSize; ++k) sum += leaves[k];
+  bucket_sums_[bucket] = sum;
+
+  size_t node = bucket;
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    node /= kFanout;
+    RecomputeNode(level, node);
+  }
+}
+
+void BucketizedSelector::RecomputeNode(size_t level, size_t node) {
+  const double* children =
+      (level == 0 ? bucket_sums_.data() : level_sums_[level - 1].data()) +
+      node * kFanout;
+  double sum = 0;
+  for (size_t k = 0; k < kFanout; ++k) sum += children[k];
+  level_sums_[level][node] = sum;
+}
+
+void BucketizedSelector::Grow(size_t capacity) {
+  capacity_ = (capacity + kBucketSize - 1) / kBucketSize * kBucketSize;
+  values_.resize(capacity_, 0.0);
+  keys_.reserve(capacity_);
+
+  // Rebuild the top-tree level structure over the bucket totals. Every level
+  // is padded with zeros to a multiple of `kFanout` so a parent always sums a
+  // full block of children.
+  const size_t num_buckets = capacity_ / kBucketSize;
+  bucket_sums_.resize((num_buckets + kFanout - 1) / kFanout * kFanout, 0.0);
+  level_sums_.clear();
+  size_t num_nodes = bucket_sums_.size() / kFanout;
+  while (num_nodes > 1) {
+    level_sums_.emplace_back((num_nodes + kFanout - 1) / kFanout * kFanout,
+                             0.0);
+    num_nodes = level_sums_.back().size() / kFanout;
+  }
+  level_sums_.emplace_back(1, 0.0);
+
+  // Recompute all sums from the buckets to the root.
+  for (size_t bucket = 0; bucket < num_buckets; ++bucket) {
+    double sum = 0;
+    const double* leaves = values_.data() + bucket * kBucketSize;
+    for (size_t k = 0; k < kBucketSize; ++k) sum += leaves[k];
+    bucket_sums_[bucket] = sum;
+  }
+  size_t nodes = bucket_sums_.size() / kFanout;
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    for (size_t i = 0; i < nodes; ++i) RecomputeNode(level, i);
+    nodes = level_sums_[level].size() / kFanout;
+  }
+}
+
+}  // namespace reverb
+}  // namespace deepmind
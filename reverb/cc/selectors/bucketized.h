@@ -0,0 +1,149 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SELECTORS_BUCKETIZED_H_
+#define REVERB_CC_SELECTORS_BUCKETIZED_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/selectors/interface.h"
+
+namespace deepmind {
+namespace reverb {
+
+// BucketizedSelector samples keys proportionally to their priority raised to
+// a configurable exponent, like PrioritizedSelector, but is laid out for
+// tables in the hundred-million to billion item range where even a 16-wide
+// sum tree is deep enough that every operation takes a cache miss per level.
+//
+// Keys are grouped by insertion order into fixed-size buckets of
+// `kBucketSize` contiguous weights, and a small 16-wide sum tree is kept over
+// the per-bucket totals only. The structure therefore has two levels: a top
+// tree that is ~kBucketSize times smaller than a flat sum tree over the keys
+// (it stays cache resident even for a billion keys), and flat weight arrays
+// within buckets whose scans and summations vectorize.
+//
+// An insert or update rewrites one leaf, recomputes the owning bucket's total
+// with a single linear pass over the bucket — so the total is always an exact
+// sum of the leaves and rounding errors cannot accumulate — and repairs the
+// short path through the top tree. Sampling descends the top tree to a bucket
+// and then scans that bucket's weights linearly; both phases walk contiguous
+// memory.
+//
+// See ItemSelector for documentation of the public methods.
+class BucketizedSelector : public ItemSelector {
+ public:
+  explicit BucketizedSelector(double priority_exponent,
+                              absl::BitGen bit_gen = absl::BitGen());
+
+  // O(kBucketSize) time: rescans the affected bucket(s) and repairs the top
+  // tree path.
+  absl::Status Delete(Key key) override;
+
+  // The priority must be non-negative. O(kBucketSize) time.
+  absl::Status Insert(Key key, double priority) override;
+
+  // Assigns the batch consecutive leaf indices and repairs buckets and tree
+  // with one bottom-up pass, so restoring n keys costs O(n).
+  absl::Status BulkInsert(
+      absl::Span<const std::pair<Key, double>> items) override;
+
+  // The priority must be non-negative. O(kBucketSize) time.
+  absl::Status Update(Key key, double priority) override;
+
+  // Applies all leaf updates first, then rescans every affected bucket once
+  // and repairs the top tree in a single bottom-up pass.
+  absl::Status BulkUpdate(
+      absl::Span<const std::pair<Key, double>> updates) override;
+
+  // O(kBucketSize + log16(num buckets)) time.
+  KeyWithProbability Sample() override;
+
+  // O(1) time. Returns the sum of the exponentiated priorities of all keys.
+  double TotalWeight() const override;
+
+  // O(n) time. Exports the exponentiated priorities.
+  void ExportSamplingWeights(
+      std::vector<std::pair<Key, double>>* weights) const override;
+
+  // O(n) time.
+  void Clear() override;
+
+  KeyDistributionOptions options() const override;
+
+  std::string DebugString() const override;
+
+ private:
+  // Number of keys per bucket. Each bucket's weights occupy 8 KiB of
+  // contiguous memory; summing or prefix-scanning a bucket compiles down to
+  // vector instructions and touches no pointers.
+  static constexpr size_t kBucketSize = 1024;
+
+  // Fanout of the top-level tree over bucket totals, matching the block width
+  // used by PrioritizedSelector.
+  static constexpr size_t kFanout = 16;
+
+  // Recomputes `bucket_sums_[bucket]` from the bucket's leaves and repairs
+  // the top tree on the path above it.
+  void RecomputeBucket(size_t bucket);
+
+  // Recomputes node `node` of top-tree level `level` from its children.
+  void RecomputeNode(size_t level, size_t node);
+
+  // Grows the leaf array to hold `capacity` keys (rounded up to whole
+  // buckets) and rebuilds the top-tree level structure and all sums.
+  void Grow(size_t capacity);
+
+  // Controls the degree of prioritization; priorities are raised to this
+  // exponent before entering the distribution as weights.
+  const double priority_exponent_;
+
+  // Capacity of the leaf array. Always a multiple of `kBucketSize`.
+  size_t capacity_;
+
+  // Exponentiated priority of each key, bucket-major: leaf `i` lives in
+  // bucket `i / kBucketSize`. Keys are densely packed in insertion order
+  // (deletes swap in the last key), so only the newest bucket is partially
+  // full and unused slots hold zero.
+  std::vector<double> values_;
+
+  // Maps the leaf index to the key stored there.
+  std::vector<Key> keys_;
+
+  // Total weight of each bucket, always an exact sum of its leaves.
+  std::vector<double> bucket_sums_;
+
+  // Internal levels of the top tree over `bucket_sums_`, from the parents of
+  // the buckets (`level_sums_[0]`) up to the root level (a single node).
+  // Every level is padded with zeros to a multiple of `kFanout`.
+  std::vector<std::vector<double>> level_sums_;
+
+  // Maps a key to the index where this key can be found in `values_`.
+  internal::flat_hash_map<Key, size_t> key_to_index_;
+
+  // Used for sampling, not thread-safe.
+  absl::BitGen bit_gen_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SELECTORS_BUCKETIZED_H_
@@ -0,0 +1,154 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/bucketized.h"
+
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// More keys than one bucket holds, so tests exercise the top tree too.
+const int64_t kManyItems = 5000;
+
+TEST(BucketizedSelectorTest, ReturnValueSanityChecks) {
+  BucketizedSelector selector(1.0);
+
+  // Non existent keys cannot be deleted or updated.
+  EXPECT_EQ(selector.Delete(123).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(selector.Update(123, 4).code(), absl::StatusCode::kInvalidArgument);
+
+  // Keys cannot be inserted twice.
+  REVERB_EXPECT_OK(selector.Insert(123, 4));
+  EXPECT_EQ(selector.Insert(123, 4).code(), absl::StatusCode::kInvalidArgument);
+
+  // Invalid priorities are rejected.
+  EXPECT_EQ(selector.Insert(456, -1).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(selector.Update(123, -1).code(), absl::StatusCode::kInvalidArgument);
+
+  // Existing keys can be updated and sampled.
+  REVERB_EXPECT_OK(selector.Update(123, 5));
+  EXPECT_EQ(selector.Sample().key, 123);
+
+  // Existing keys cannot be deleted twice.
+  REVERB_EXPECT_OK(selector.Delete(123));
+  EXPECT_EQ(selector.Delete(123).code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(BucketizedSelectorTest, MatchesPrioritizedDistribution) {
+  const int64_t kSamples = 1000000;
+
+  // Two keys per value in {1, 2, 3}, spread across many buckets by padding
+  // with zero-priority keys between them.
+  BucketizedSelector selector(1.0);
+  std::vector<uint64_t> weighted_keys;
+  uint64_t next_key = 0;
+  for (int weight = 1; weight <= 3; weight++) {
+    for (int copy = 0; copy < 2; copy++) {
+      weighted_keys.push_back(next_key);
+      REVERB_EXPECT_OK(selector.Insert(next_key++, weight));
+      for (int pad = 0; pad < 2000; pad++) {
+        REVERB_EXPECT_OK(selector.Insert(next_key++, 0));
+      }
+    }
+  }
+  EXPECT_DOUBLE_EQ(selector.TotalWeight(), 12.0);
+
+  std::vector<int64_t> counts(weighted_keys.size());
+  for (int i = 0; i < kSamples; i++) {
+    ItemSelector::KeyWithProbability sample = selector.Sample();
+    for (size_t j = 0; j < weighted_keys.size(); j++) {
+      if (sample.key == weighted_keys[j]) {
+        EXPECT_NEAR(sample.probability, (j / 2 + 1) / 12.0, 1e-9);
+        counts[j]++;
+      }
+    }
+  }
+  for (size_t j = 0; j < counts.size(); j++) {
+    EXPECT_NEAR(static_cast<double>(counts[j]) / kSamples, (j / 2 + 1) / 12.0,
+                0.01);
+  }
+}
+
+TEST(BucketizedSelectorTest, DeleteAcrossBucketsKeepsTotalExact) {
+  BucketizedSelector selector(1.0);
+  for (int64_t i = 0; i < kManyItems; i++) {
+    REVERB_EXPECT_OK(selector.Insert(i, 1));
+  }
+  EXPECT_DOUBLE_EQ(selector.TotalWeight(), kManyItems);
+
+  // Deleting keys from early buckets swaps in keys from the newest bucket.
+  for (int64_t i = 0; i < kManyItems / 2; i++) {
+    REVERB_EXPECT_OK(selector.Delete(i));
+  }
+  EXPECT_DOUBLE_EQ(selector.TotalWeight(), kManyItems / 2);
+
+  // Every remaining key is still sampleable.
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_GE(selector.Sample().key, kManyItems / 2);
+  }
+}
+
+TEST(BucketizedSelectorTest, BulkInsertMatchesRepeatedInsert) {
+  std::vector<std::pair<ItemSelector::Key, double>> items;
+  for (int64_t i = 0; i < kManyItems; i++) {
+    items.push_back({i, static_cast<double>(i % 7)});
+  }
+
+  BucketizedSelector bulk(1.0);
+  REVERB_EXPECT_OK(bulk.BulkInsert(items));
+  BucketizedSelector repeated(1.0);
+  for (const auto& item : items) {
+    REVERB_EXPECT_OK(repeated.Insert(item.first, item.second));
+  }
+  EXPECT_DOUBLE_EQ(bulk.TotalWeight(), repeated.TotalWeight());
+}
+
+TEST(BucketizedSelectorTest, BulkUpdateMatchesRepeatedUpdate) {
+  BucketizedSelector selector(1.0);
+  std::vector<std::pair<ItemSelector::Key, double>> updates;
+  for (int64_t i = 0; i < kManyItems; i++) {
+    REVERB_EXPECT_OK(selector.Insert(i, 1));
+    if (i % 3 == 0) updates.push_back({i, 10.0});
+  }
+  REVERB_EXPECT_OK(selector.BulkUpdate(updates));
+  EXPECT_DOUBLE_EQ(selector.TotalWeight(),
+                   kManyItems + updates.size() * 9.0);
+
+  // A missing key fails the whole batch without applying anything after
+  // validation.
+  EXPECT_EQ(
+      selector.BulkUpdate({{kManyItems + 1, 1.0}, {0, 1.0}}).code(),
+      absl::StatusCode::kInvalidArgument);
+}
+
+TEST(BucketizedSelectorTest, Options) {
+  BucketizedSelector selector(0.5);
+  EXPECT_THAT(selector.options(),
+              testing::EqualsProto("bucketized: { priority_exponent: 0.5 } "
+                                   "is_deterministic: false"));
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,89 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/clock.h"
+
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/selectors/interface.h"
+
+namespace deepmind {
+namespace reverb {
+
+absl::Status ClockSelector::Delete(ItemSelector::Key key) {
+  auto it = key_to_iterator_.find(key);
+  if (it == key_to_iterator_.end())
+    return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
+  ring_.erase(it->second);
+  key_to_iterator_.erase(it);
+  return absl::OkStatus();
+}
+
+absl::Status ClockSelector::Insert(ItemSelector::Key key, double priority) {
+  if (key_to_iterator_.find(key) != key_to_iterator_.end()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Key ", key, " already inserted."));
+  }
+  key_to_iterator_.emplace(key, ring_.emplace(ring_.end(), Entry{key}));
+  return absl::OkStatus();
+}
+
+absl::Status ClockSelector::Update(ItemSelector::Key key, double priority) {
+  if (key_to_iterator_.find(key) == key_to_iterator_.end()) {
+    return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
+  }
+  return absl::OkStatus();
+}
+
+void ClockSelector::MarkSampled(ItemSelector::Key key) {
+  auto it = key_to_iterator_.find(key);
+  if (it != key_to_iterator_.end()) {
+    it->second->referenced = true;
+  }
+}
+
+ItemSelector::KeyWithProbability ClockSelector::Sample() {
+  REVERB_CHECK(!ring_.empty());
+  // Every iteration clears a bit that a MarkSampled call set, so the total
+  // sweep work is bounded by the number of marks granted and each call
+  // amortizes to O(1).
+  while (ring_.front().referenced) {
+    ring_.front().referenced = false;
+    ring_.splice(ring_.end(), ring_, ring_.begin());
+  }
+  return {ring_.front().key, 1.};
+}
+
+double ClockSelector::TotalWeight() const {
+  return static_cast<double>(ring_.size());
+}
+
+void ClockSelector::Clear() {
+  ring_.clear();
+  key_to_iterator_.clear();
+}
+
+KeyDistributionOptions ClockSelector::options() const {
+  KeyDistributionOptions options;
+  options.set_clock(true);
+  options.set_is_deterministic(true);
+  return options;
+}
+
+std::string ClockSelector::DebugString() const { return "ClockSelector"; }
+
+}  // namespace reverb
+}  // namespace deepmind
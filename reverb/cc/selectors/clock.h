@@ -0,0 +1,74 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SELECTORS_CLOCK_H_
+#define REVERB_CC_SELECTORS_CLOCK_H_
+
+#include <list>
+
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/selectors/interface.h"
+
+namespace deepmind {
+namespace reverb {
+
+// CLOCK (second chance) selection. We ignore all priority values in the
+// calls. Sample() returns the oldest key whose reference bit is clear; keys
+// that have been marked as sampled since the last sweep have their bit
+// cleared and move to the back of the ring instead of being returned. All
+// operations take O(1) amortized time. Intended as a remover: unlike fifo it
+// is scan resistant, so rarely inserted but regularly sampled items survive
+// bulk churn of never sampled ones. See ItemSelector for documentation about
+// the methods.
+class ClockSelector : public ItemSelector {
+ public:
+  absl::Status Delete(Key key) override;
+
+  // The priority is ignored.
+  absl::Status Insert(Key key, double priority) override;
+
+  // This is a no-op but will return an error if the key does not exist.
+  absl::Status Update(Key key, double priority) override;
+
+  // Sets the reference bit of `key`, protecting it from the next sweep.
+  void MarkSampled(Key key) override;
+
+  KeyWithProbability Sample() override;
+
+  // O(1) time.
+  double TotalWeight() const override;
+
+  void Clear() override;
+
+  KeyDistributionOptions options() const override;
+
+  std::string DebugString() const override;
+
+ private:
+  struct Entry {
+    Key key;
+    bool referenced = false;
+  };
+
+  // Keys in sweep order: the eviction hand is the front, keys granted a
+  // second chance rejoin at the back.
+  std::list<Entry> ring_;
+  internal::flat_hash_map<Key, std::list<Entry>::iterator> key_to_iterator_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SELECTORS_CLOCK_H_
@@ -0,0 +1,122 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/clock.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+TEST(ClockSelectorTest, ReturnValueSantiyChecks) {
+  ClockSelector clock;
+
+  // Non existent keys cannot be deleted or updated.
+  EXPECT_EQ(clock.Delete(123).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(clock.Update(123, 4).code(), absl::StatusCode::kInvalidArgument);
+
+  // Keys cannot be inserted twice.
+  REVERB_EXPECT_OK(clock.Insert(123, 4));
+  EXPECT_THAT(clock.Insert(123, 4).code(), absl::StatusCode::kInvalidArgument);
+
+  // Existing keys can be updated and sampled.
+  REVERB_EXPECT_OK(clock.Update(123, 5));
+  EXPECT_EQ(clock.Sample().key, 123);
+
+  // Existing keys cannot be deleted twice.
+  REVERB_EXPECT_OK(clock.Delete(123));
+  EXPECT_THAT(clock.Delete(123).code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ClockSelectorTest, MatchesFifoOrderingWithoutMarks) {
+  int64_t kItems = 100;
+
+  ClockSelector clock;
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(clock.Insert(i, 0));
+  }
+
+  for (int i = 0; i < kItems; i++) {
+    ItemSelector::KeyWithProbability sample = clock.Sample();
+    EXPECT_EQ(sample.key, i);
+    EXPECT_EQ(sample.probability, 1);
+    REVERB_EXPECT_OK(clock.Delete(sample.key));
+  }
+}
+
+TEST(ClockSelectorTest, MarkedKeysGetASecondChance) {
+  ClockSelector clock;
+  for (int i = 0; i < 4; i++) {
+    REVERB_EXPECT_OK(clock.Insert(i, 0));
+  }
+
+  // The oldest key has been sampled recently, so the sweep passes it and
+  // evicts the second oldest.
+  clock.MarkSampled(0);
+  EXPECT_EQ(clock.Sample().key, 1);
+  REVERB_EXPECT_OK(clock.Delete(1));
+
+  // Its reference bit was consumed; without a new mark the key is next.
+  EXPECT_EQ(clock.Sample().key, 2);
+  REVERB_EXPECT_OK(clock.Delete(2));
+  EXPECT_EQ(clock.Sample().key, 3);
+  REVERB_EXPECT_OK(clock.Delete(3));
+  EXPECT_EQ(clock.Sample().key, 0);
+}
+
+TEST(ClockSelectorTest, SweepTerminatesWhenAllKeysAreMarked) {
+  ClockSelector clock;
+  for (int i = 0; i < 3; i++) {
+    REVERB_EXPECT_OK(clock.Insert(i, 0));
+    clock.MarkSampled(i);
+  }
+
+  // One full sweep clears every bit and returns to the oldest key.
+  EXPECT_EQ(clock.Sample().key, 0);
+}
+
+TEST(ClockSelectorTest, MarkingUnknownKeysIsANoOp) {
+  ClockSelector clock;
+  REVERB_EXPECT_OK(clock.Insert(1, 0));
+  clock.MarkSampled(999);
+  EXPECT_EQ(clock.Sample().key, 1);
+}
+
+TEST(ClockSelectorTest, Options) {
+  ClockSelector clock;
+  EXPECT_THAT(clock.options(),
+              testing::EqualsProto("clock: true is_deterministic: true"));
+}
+
+TEST(ClockDeathTest, ClearThenSample) {
+  ClockSelector clock;
+  for (int i = 0; i < 100; i++) {
+    REVERB_EXPECT_OK(clock.Insert(i, i));
+  }
+  clock.Sample();
+  clock.Clear();
+  EXPECT_DEATH(clock.Sample(), "");
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
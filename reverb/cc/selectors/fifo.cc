@@ -53,6 +53,10 @@ ItemSelector::KeyWithProbability FifoSelector::Sample() {
   return {keys_.front(), 1.};
 }
 
+double FifoSelector::TotalWeight() const {
+  return static_cast<double>(keys_.size());
+}
+
 void FifoSelector::Clear() {
   keys_.clear();
   key_to_iterator_.clear();
@@ -40,6 +40,9 @@ class FifoSelector : public ItemSelector {
 
   KeyWithProbability Sample() override;
 
+  // O(1) time.
+  double TotalWeight() const override;
+
   void Clear() override;
 
   KeyDistributionOptions options() const override;
@@ -14,6 +14,10 @@
 
 #include "reverb/cc/selectors/heap.h"
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 #include "absl/strings/str_cat.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
 #include "reverb/cc/schema.pb.h"
@@ -22,14 +26,21 @@
 namespace deepmind {
 namespace reverb {
 
-HeapSelector::HeapSelector(bool min_heap)
-    : sign_(min_heap ? 1 : -1), update_count_(0) {}
+HeapSelector::HeapSelector(bool min_heap, int max_deferred_updates)
+    : sign_(min_heap ? 1 : -1),
+      update_count_(0),
+      max_deferred_updates_(max_deferred_updates) {}
 
 absl::Status HeapSelector::Delete(ItemSelector::Key key) {
   auto it = nodes_.find(key);
   if (it == nodes_.end()) {
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
   }
+  if (it->second->pending) {
+    pending_updates_.erase(std::find(pending_updates_.begin(),
+                                     pending_updates_.end(),
+                                     it->second.get()));
+  }
   heap_.Remove(it->second.get());
   nodes_.erase(it);
   return absl::OkStatus();
@@ -46,24 +57,81 @@ absl::Status HeapSelector::Insert(ItemSelector::Key key, double priority) {
   return absl::OkStatus();
 }
 
+absl::Status HeapSelector::BulkInsert(
+    absl::Span<const std::pair<Key, double>> items) {
+  std::vector<HeapNode*> added;
+  added.reserve(items.size());
+  for (const auto& item : items) {
+    auto node = absl::make_unique<HeapNode>(item.first, item.second * sign_,
+                                            update_count_);
+    auto result = nodes_.emplace(item.first, std::move(node));
+    if (!result.second) {
+      // Nothing has been pushed onto the heap yet so unwinding the batch only
+      // requires dropping the nodes it created.
+      for (const HeapNode* added_node : added) nodes_.erase(added_node->key);
+      return absl::InvalidArgumentError(
+          absl::StrCat("Key ", item.first, " already inserted."));
+    }
+    update_count_++;
+    added.push_back(result.first->second.get());
+  }
+  heap_.BulkPush(added);
+  return absl::OkStatus();
+}
+
 absl::Status HeapSelector::Update(ItemSelector::Key key, double priority) {
-  if (!nodes_.contains(key)) {
+  auto it = nodes_.find(key);
+  if (it == nodes_.end()) {
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
   }
-  nodes_[key]->priority = priority * sign_;
-  nodes_[key]->update_number = update_count_++;
-  heap_.Adjust(nodes_[key].get());
+  HeapNode* node = it->second.get();
+  // Updates which do not change the priority are common (e.g. tables that
+  // mutate priorities in bulk after every learner step) and the heap position
+  // is already correct, so they are served without a sift.
+  if (node->priority == priority * sign_) {
+    return absl::OkStatus();
+  }
+  node->priority = priority * sign_;
+  node->update_number = update_count_++;
+  if (max_deferred_updates_ == 0) {
+    heap_.Adjust(node);
+    return absl::OkStatus();
+  }
+  if (!node->pending) {
+    node->pending = true;
+    pending_updates_.push_back(node);
+  }
+  if (pending_updates_.size() >= static_cast<size_t>(max_deferred_updates_)) {
+    FlushPendingUpdates();
+  }
   return absl::OkStatus();
 }
 
+void HeapSelector::FlushPendingUpdates() {
+  for (HeapNode* node : pending_updates_) {
+    node->pending = false;
+    heap_.Adjust(node);
+  }
+  pending_updates_.clear();
+}
+
 ItemSelector::KeyWithProbability HeapSelector::Sample() {
   REVERB_CHECK(!nodes_.empty());
+  // Sampling must observe every preceding update.
+  if (!pending_updates_.empty()) {
+    FlushPendingUpdates();
+  }
   return {heap_.top()->key, 1.};
 }
 
+double HeapSelector::TotalWeight() const {
+  return static_cast<double>(nodes_.size());
+}
+
 void HeapSelector::Clear() {
   nodes_.clear();
   heap_.Clear();
+  pending_updates_.clear();
 }
 
 
@@ -16,6 +16,9 @@
 #define REVERB_CC_SELECTORS_HEAP_H_
 
 #include <cstdint>
+#include <utility>
+#include <vector>
+
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/selectors/interface.h"
 #include "reverb/cc/support/intrusive_heap.h"
@@ -25,10 +28,18 @@ namespace reverb {
 
 // HeapSelector always samples the item with the lowest or highest priority
 // (controlled by `min_heap`). If multiple items share the same priority then
-// the least recently inserted or updated key is sampled.
+// the least recently inserted key, or the key whose priority changed least
+// recently, is sampled. Updates that do not change the priority are complete
+// no-ops: they neither sift the heap nor refresh the tie breaking order.
 class HeapSelector : public ItemSelector {
  public:
-  explicit HeapSelector(bool min_heap = true);
+  // If `max_deferred_updates` > 0 then priority changing updates only record
+  // the new priority on the node and the heap position is fixed lazily: once
+  // that many updates are pending, or before the next `Sample`, whichever
+  // comes first. Batching the sifts this way keeps update heavy tables (e.g.
+  // eviction heaps receiving large `MutatePriorities` batches) from paying a
+  // full sift per mutation while sampling still observes every update.
+  explicit HeapSelector(bool min_heap = true, int max_deferred_updates = 0);
 
   // O(log n) time.
   absl::Status Delete(Key key) override;
@@ -36,12 +47,22 @@ class HeapSelector : public ItemSelector {
   // O(log n) time.
   absl::Status Insert(Key key, double priority) override;
 
-  // O(log n) time.
+  // Creates all nodes first and restores the heap invariant with a single
+  // bottom-up heapify sweep, so inserting a batch of k keys costs O(n + k)
+  // instead of the O(k log n) of repeated `Insert` calls. Intended for
+  // restoring a selector from a checkpoint.
+  absl::Status BulkInsert(
+      absl::Span<const std::pair<Key, double>> items) override;
+
+  // O(1) time if the priority is unchanged or the sift is deferred,
+  // O(log n) otherwise.
   absl::Status Update(Key key, double priority) override;
 
-  // O(1) time.
+  // O(1) time, plus the cost of applying any pending deferred updates.
   KeyWithProbability Sample() override;
 
+  double TotalWeight() const override;
+
   // O(n) time.
   void Clear() override;
 
@@ -56,16 +77,23 @@ class HeapSelector : public ItemSelector {
     IntrusiveHeapLink heap;
     uint64_t update_number;
 
+    // True if the node is in `pending_updates_`, i.e. its heap position has
+    // not yet caught up with `priority`.
+    bool pending = false;
+
     HeapNode(Key key, double priority, uint64_t update_number)
         : key(key), priority(priority), update_number(update_number) {}
   };
 
-  struct HeapNodeCompare {
-    bool operator()(const HeapNode* a, const HeapNode* b) const {
-      // Lexicographic ordering by (priority, update_number).
-      return (a->priority < b->priority) ||
-             ((a->priority == b->priority) &&
-              (a->update_number < b->update_number));
+  // Sifts the nodes in `pending_updates_` to their correct heap positions.
+  void FlushPendingUpdates();
+
+  // Lexicographic ordering by (priority, update_number).
+  using HeapNodeKey = std::pair<double, uint64_t>;
+
+  struct HeapNodeKeyAccess {
+    HeapNodeKey Get(const HeapNode* node) const {
+      return std::make_pair(node->priority, node->update_number);
     }
   };
 
@@ -74,8 +102,9 @@ class HeapSelector : public ItemSelector {
   const double sign_;
 
   // Heap where the top item is the one with the lowest/highest priority in the
-  // distribution.
-  IntrusiveHeap<HeapNode, HeapNodeCompare> heap_;
+  // distribution. The flat heap keeps the sort keys packed in its own array so
+  // reprioritizations do not chase a node pointer per heap level.
+  FlatIntrusiveHeap<HeapNode, HeapNodeKey, HeapNodeKeyAccess> heap_;
 
   // `IntrusiveHeap` does not manage the memory of its nodes so they are stored
   // in `nodes_`. The content of nodes_ and heap_ are always kept in sync.
@@ -83,6 +112,14 @@ class HeapSelector : public ItemSelector {
 
   // Keep track of the number of inserts/updates for most-recent tie-breaking.
   uint64_t update_count_;
+
+  // Number of deferred updates to accumulate before fixing the heap. 0 means
+  // updates sift immediately.
+  const int max_deferred_updates_;
+
+  // Nodes whose priority changed since their heap position was last fixed.
+  // Always empty when `max_deferred_updates_` is 0.
+  std::vector<HeapNode*> pending_updates_;
 };
 
 }  // namespace reverb
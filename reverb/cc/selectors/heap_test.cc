@@ -80,17 +80,47 @@ TEST(HeapSelectorTest, BreakTiesByInsertionOrder) {
   }
 }
 
+TEST(HeapSelectorTest, BulkInsertMatchesSequentialInserts) {
+  HeapSelector heap;
+
+  // Mix bulk batches with a regular insert; the removal order must respect
+  // both the priorities and the insertion order of tied keys, exactly as if
+  // every key had been inserted individually.
+  REVERB_EXPECT_OK(heap.BulkInsert({{0, 1}, {3, 20}, {1, 1}}));
+  REVERB_EXPECT_OK(heap.Insert(4, 20));
+  REVERB_EXPECT_OK(heap.BulkInsert({{2, 1}, {5, 300}}));
+
+  for (auto i = 0; i < 6; i++) {
+    EXPECT_EQ(heap.Sample().key, i);
+    REVERB_EXPECT_OK(heap.Delete(i));
+  }
+}
+
+TEST(HeapSelectorTest, BulkInsertRejectsDuplicateKeys) {
+  HeapSelector heap;
+  REVERB_EXPECT_OK(heap.Insert(123, 2));
+
+  // An already inserted key rejects the batch without inserting anything.
+  EXPECT_EQ(heap.BulkInsert({{124, 1}, {123, 3}}).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(heap.Delete(124).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(heap.Sample().key, 123);
+}
+
 TEST(HeapSelectorTest, BreakTiesByUpdateOrder) {
   HeapSelector heap;
 
-  REVERB_EXPECT_OK(heap.Insert(2, 1));
   REVERB_EXPECT_OK(heap.Insert(0, 1));
+  REVERB_EXPECT_OK(heap.Insert(2, 1));
   REVERB_EXPECT_OK(heap.Insert(1, 1));
 
-  // Removing keys at this point would result in the order [2, 0, 1]
-  // by LRU because the priorites are equal.
-  // This update does not change the priority, but does increase the update
-  // recency, resulting in the new order [0, 1, 2] which we verify.
+  // Removing keys at this point would result in the order [0, 2, 1]
+  // by LRU because the priorities are equal. An update which does not change
+  // the priority is a no-op and does not refresh the recency of its key.
+  REVERB_EXPECT_OK(heap.Update(2, 1));
+  // Updates which do change the priority make their key the most recent one:
+  // moving key 2 away and back demotes it behind 1, giving [0, 1, 2].
+  REVERB_EXPECT_OK(heap.Update(2, 2));
   REVERB_EXPECT_OK(heap.Update(2, 1));
   for (auto i = 0; i < 3; i++) {
     EXPECT_EQ(heap.Sample().key, i);
@@ -98,6 +128,37 @@ TEST(HeapSelectorTest, BreakTiesByUpdateOrder) {
   }
 }
 
+TEST(HeapSelectorTest, DeferredUpdatesAreObservedBySample) {
+  HeapSelector heap(true, /*max_deferred_updates=*/10);
+
+  REVERB_EXPECT_OK(heap.Insert(123, 2));
+  REVERB_EXPECT_OK(heap.Insert(124, 1));
+  REVERB_EXPECT_OK(heap.Insert(125, 3));
+
+  // The sifts are still pending but sampling must observe the updates.
+  REVERB_EXPECT_OK(heap.Update(124, 5));
+  REVERB_EXPECT_OK(heap.Update(125, 0.5));
+  EXPECT_EQ(heap.Sample().key, 125);
+
+  // Deleting a key with a pending update must not leave the update behind.
+  REVERB_EXPECT_OK(heap.Update(123, 0.1));
+  REVERB_EXPECT_OK(heap.Delete(123));
+  EXPECT_EQ(heap.Sample().key, 125);
+}
+
+TEST(HeapSelectorTest, DeferredUpdatesFlushWhenBatchIsFull) {
+  HeapSelector heap(true, /*max_deferred_updates=*/2);
+
+  REVERB_EXPECT_OK(heap.Insert(123, 2));
+  REVERB_EXPECT_OK(heap.Insert(124, 1));
+  REVERB_EXPECT_OK(heap.Insert(125, 3));
+
+  // The second priority changing update fills the batch and applies both.
+  REVERB_EXPECT_OK(heap.Update(124, 5));
+  REVERB_EXPECT_OK(heap.Update(125, 0.5));
+  EXPECT_EQ(heap.Sample().key, 125);
+}
+
 TEST(HeapSelectorTest, SampleMaxPriorityWhenMinHeapFalse) {
   HeapSelector heap(false);
 
@@ -16,7 +16,11 @@
 #define REVERB_CC_SELECTORS_INTERFACE_H_
 
 #include <cstdint>
+#include <utility>
+#include <vector>
+
 #include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
 
 namespace deepmind {
@@ -35,6 +39,12 @@ class ItemSelector {
   struct KeyWithProbability {
     Key key;
     double probability;
+    // One plus the index of the draw within the selector's deterministic
+    // sampling sequence, or 0 when the selector was not constructed with a
+    // seed (see `DeterministicDrawSequence`). Recorded in
+    // `SampleInfo.deterministic_sample_index` so individual samples of a run
+    // can be replayed.
+    uint64_t deterministic_sample_index = 0;
   };
 
   virtual ~ItemSelector() = default;
@@ -47,13 +57,82 @@ class ItemSelector {
   // if the key already exists.
   virtual absl::Status Insert(Key key, double priority) = 0;
 
+  // Inserts a batch of new keys. Equivalent to calling `Insert` for every
+  // element of `items` in order, but implementations may build their internal
+  // structures bottom-up in O(n) instead of paying the per-key insertion cost
+  // n times. Intended for restoring a selector from a checkpoint. Errors if a
+  // key already exists or a priority is invalid; the base implementation may
+  // have applied a prefix of the batch when an error is returned.
+  virtual absl::Status BulkInsert(
+      absl::Span<const std::pair<Key, double>> items) {
+    for (const auto& item : items) {
+      absl::Status status = Insert(item.first, item.second);
+      if (!status.ok()) return status;
+    }
+    return absl::OkStatus();
+  }
+
   // Updates a key and associated priority. Returns an error if the key does
   // not exist.
   virtual absl::Status Update(Key key, double priority) = 0;
 
+  // Applies a batch of priority updates. Equivalent to calling `Update` for
+  // every element of `updates` in order, but implementations may amortize the
+  // maintenance of their internal structures across the whole batch. Errors
+  // if a key does not exist or a priority is invalid; the base implementation
+  // may have applied a prefix of the batch when an error is returned.
+  virtual absl::Status BulkUpdate(
+      absl::Span<const std::pair<Key, double>> updates) {
+    for (const auto& update : updates) {
+      absl::Status status = Update(update.first, update.second);
+      if (!status.ok()) return status;
+    }
+    return absl::OkStatus();
+  }
+
+  // Changes the exponent applied when turning raw priorities into sampling
+  // weights and recomputes the weights of the stored keys accordingly. Only
+  // meaningful for selectors that exponentiate priorities (see
+  // `PrioritizedSelector`); the base implementation returns
+  // `FailedPrecondition`.
+  virtual absl::Status SetPriorityExponent(double priority_exponent) {
+    return absl::FailedPreconditionError(
+        "Selector does not apply a priority exponent.");
+  }
+
+  // Informs the selector that `key` was just returned by the table's
+  // *sampling* selector. Removers may use the signal to protect recently
+  // sampled items from eviction (see `ClockSelector`); most selectors ignore
+  // it. Must not fail when the key does not exist.
+  virtual void MarkSampled(Key key) {}
+
   // Samples a key. Must contain keys when this is called.
   virtual KeyWithProbability Sample() = 0;
 
+  // Appends one (key, sampling weight) pair per key to `weights`. Intended
+  // for building immutable snapshots that can be sampled without synchronizing
+  // with the live selector. Selectors where sampling is deterministic (e.g.
+  // fifo) do not support snapshots and leave `weights` untouched; callers
+  // must handle an empty export by falling back to `Sample`.
+  virtual void ExportSamplingWeights(
+      std::vector<std::pair<Key, double>>* weights) const {}
+
+  // The total weight of the distribution, i.e. the sum of the (potentially
+  // transformed) priorities of all keys. For selectors where sampling is not
+  // proportional to priority this is simply the number of keys. The value can
+  // be used to weigh selectors against each other, e.g. when partitioning a
+  // key space across multiple selectors.
+  virtual double TotalWeight() const = 0;
+
+  // The smallest and largest sampling weight of any key in the distribution,
+  // or 0 if the distribution is empty or the selector does not sample
+  // proportionally to a per-key weight. Keys with zero weight can never be
+  // sampled and are excluded from the min. Together with `TotalWeight` these
+  // give the exact extreme sampling probabilities, e.g. for normalizing
+  // importance sampling weights without scanning the table.
+  virtual double MinWeight() const { return 0; }
+  virtual double MaxWeight() const { return 0; }
+
   // Clear the distribution of all data.
   virtual void Clear() = 0;
 
@@ -65,6 +144,41 @@ class ItemSelector {
   virtual std::string DebugString() const = 0;
 };
 
+// Counter based random sequence backing the deterministic sampling mode of
+// `UniformSelector` and `PrioritizedSelector`. Draw `i` is a pure function of
+// `(seed, i)` (a splitmix64 style finalizer over the keyed counter), stable
+// across platforms and processes. Given the seed recorded in the table's
+// `KeyDistributionOptions` and the per-sample index recorded in `SampleInfo`,
+// any individual sample of a run can be reproduced exactly without logging
+// the sampled keys.
+class DeterministicDrawSequence {
+ public:
+  explicit DeterministicDrawSequence(uint64_t seed, uint64_t next_index = 0)
+      : seed_(seed), next_index_(next_index) {}
+
+  uint64_t seed() const { return seed_; }
+
+  // Index that the next call to `NextDouble` will consume.
+  uint64_t next_index() const { return next_index_; }
+
+  // The draw with index `index`: a double in [0, 1).
+  double Draw(uint64_t index) const {
+    uint64_t z = seed_ + (index + 1) * uint64_t{0x9E3779B97F4A7C15};
+    z = (z ^ (z >> 30)) * uint64_t{0xBF58476D1CE4E5B9};
+    z = (z ^ (z >> 27)) * uint64_t{0x94D049BB133111EB};
+    z ^= z >> 31;
+    // The top 53 bits scaled by 2^-53 cover [0, 1) without rounding to 1.
+    return static_cast<double>(z >> 11) * 0x1.0p-53;
+  }
+
+  // Returns the next draw of the sequence and advances the counter.
+  double NextDouble() { return Draw(next_index_++); }
+
+ private:
+  const uint64_t seed_;
+  uint64_t next_index_;
+};
+
 }  // namespace reverb
 }  // namespace deepmind
 
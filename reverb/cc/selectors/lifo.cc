@@ -52,6 +52,10 @@ ItemSelector::KeyWithProbability LifoSelector::Sample() {
   return {keys_.front(), 1.};
 }
 
+double LifoSelector::TotalWeight() const {
+  return static_cast<double>(keys_.size());
+}
+
 void LifoSelector::Clear() {
   keys_.clear();
   key_to_iterator_.clear();
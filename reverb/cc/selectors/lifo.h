@@ -41,6 +41,9 @@ class LifoSelector : public ItemSelector {
 
   KeyWithProbability Sample() override;
 
+  // O(1) time.
+  double TotalWeight() const override;
+
   void Clear() override;
 
   KeyDistributionOptions options() const override;
@@ -0,0 +1,75 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/make_selector.h"
+
+#include <memory>
+
+#include "absl/memory/memory.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/selectors/alias.h"
+#include "reverb/cc/selectors/bucketized.h"
+#include "reverb/cc/selectors/clock.h"
+#include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/heap.h"
+#include "reverb/cc/selectors/lifo.h"
+#include "reverb/cc/selectors/prioritized.h"
+#include "reverb/cc/selectors/reservoir.h"
+#include "reverb/cc/selectors/uniform.h"
+
+namespace deepmind {
+namespace reverb {
+
+std::unique_ptr<ItemSelector> MakeSelectorFromOptions(
+    const KeyDistributionOptions& options) {
+  switch (options.distribution_case()) {
+    case KeyDistributionOptions::kFifo:
+      return absl::make_unique<FifoSelector>();
+    case KeyDistributionOptions::kLifo:
+      return absl::make_unique<LifoSelector>();
+    case KeyDistributionOptions::kUniform:
+      if (options.deterministic_sampling()) {
+        return absl::make_unique<UniformSelector>(
+            options.sampling_seed(), options.next_sample_index());
+      }
+      return absl::make_unique<UniformSelector>();
+    case KeyDistributionOptions::kPrioritized:
+      if (options.deterministic_sampling()) {
+        return absl::make_unique<PrioritizedSelector>(
+            options.prioritized().priority_exponent(), options.sampling_seed(),
+            options.next_sample_index());
+      }
+      return absl::make_unique<PrioritizedSelector>(
+          options.prioritized().priority_exponent());
+    case KeyDistributionOptions::kHeap:
+      return absl::make_unique<HeapSelector>(options.heap().min_heap());
+    case KeyDistributionOptions::kAlias:
+      return absl::make_unique<AliasSelector>(
+          options.alias().priority_exponent());
+    case KeyDistributionOptions::kReservoir:
+      return absl::make_unique<ReservoirSelector>();
+    case KeyDistributionOptions::kClock:
+      return absl::make_unique<ClockSelector>();
+    case KeyDistributionOptions::kBucketized:
+      return absl::make_unique<BucketizedSelector>(
+          options.bucketized().priority_exponent());
+    case KeyDistributionOptions::DISTRIBUTION_NOT_SET:
+      REVERB_LOG(REVERB_FATAL) << "Selector not set";
+    default:
+      REVERB_LOG(REVERB_FATAL) << "Selector not supported";
+  }
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,37 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SELECTORS_MAKE_SELECTOR_H_
+#define REVERB_CC_SELECTORS_MAKE_SELECTOR_H_
+
+#include <memory>
+
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/selectors/interface.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Constructs an empty selector of the type and configuration described by
+// `options`, i.e. the inverse of `ItemSelector::options()`. The state the
+// original selector held is not reproduced; callers restore it by reinserting
+// keys (see e.g. `Table::BulkInsertCheckpointItems`). Check fails if `options`
+// does not name a distribution.
+std::unique_ptr<ItemSelector> MakeSelectorFromOptions(
+    const KeyDistributionOptions& options);
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SELECTORS_MAKE_SELECTOR_H_
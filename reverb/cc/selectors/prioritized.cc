@@ -14,8 +14,12 @@
 
 #include "reverb/cc/selectors/prioritized.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
 
 #include "absl/random/distributions.h"
 #include "absl/random/random.h"
@@ -29,10 +33,6 @@ namespace deepmind {
 namespace reverb {
 namespace {
 
-// If the approximation error at a node exceeds this threshold, the sum tree is
-// reinitialized.
-constexpr double kMaxApproximationError = 1e-4;
-
 // A priority of zero should correspond to zero probability, even if the
 // priority exponent is zero. So this modified version of std::pow is used to
 // turn priorities into weights. Expects base and exponent to be non-negative.
@@ -49,15 +49,40 @@ absl::Status CheckValidPriority(double priority) {
   return absl::OkStatus();
 }
 
+// Returns the offset within a block of `fanout` children that contains
+// `target`, subtracting the weight of the skipped children from `target`.
+// Falls back to the last non-empty child if rounding errors pushed `target`
+// past the total weight of the block.
+template <size_t fanout>
+inline size_t DescendBlock(const double* children, double* target) {
+  size_t last_non_empty = 0;
+  for (size_t k = 0; k < fanout; ++k) {
+    const double weight = children[k];
+    if (weight > 0) {
+      if (*target < weight) return k;
+      last_non_empty = k;
+    }
+    *target -= weight;
+  }
+  return last_non_empty;
+}
+
 }  // namespace
 
 PrioritizedSelector::PrioritizedSelector(double priority_exponent,
                                          absl::BitGen bit_gen)
     : priority_exponent_(priority_exponent),
-      capacity_(std::pow(2, 17)),
-      sum_tree_(capacity_),
+      capacity_(0),
       bit_gen_(std::move(bit_gen)) {
   REVERB_CHECK_GE(priority_exponent_, 0);
+  Grow(std::pow(2, 17));
+}
+
+PrioritizedSelector::PrioritizedSelector(double priority_exponent,
+                                         uint64_t seed,
+                                         uint64_t next_sample_index)
+    : PrioritizedSelector(priority_exponent) {
+  draws_ = DeterministicDrawSequence(seed, next_sample_index);
 }
 
 absl::Status PrioritizedSelector::Delete(Key key) {
@@ -69,15 +94,21 @@ absl::Status PrioritizedSelector::Delete(Key key) {
 
   if (index != last_index) {
     // Replace the element that we want to remove with the last element.
-    SetNode(index, NodeValue(last_index));
-    const Key last_key = sum_tree_[last_index].key;
-    sum_tree_[index].key = last_key;
-    key_to_index_[last_key] = index;
+    values_[index] = values_[last_index];
+    priorities_[index] = priorities_[last_index];
+    keys_[index] = keys_[last_index];
+    key_to_index_[keys_[index]] = index;
   }
 
-  SetNode(last_index, 0);
-  key_to_index_.erase(it);  // Note that this must occur after SetNode.
+  values_[last_index] = 0;
+  priorities_[last_index] = 0;
+  keys_.pop_back();
+  key_to_index_.erase(it);
+
+  UpdatePath(index);
+  if (index / kFanout != last_index / kFanout) UpdatePath(last_index);
 
+  ++version_;
   return absl::OkStatus();
 }
 
@@ -85,16 +116,64 @@ absl::Status PrioritizedSelector::Insert(Key key, double priority) {
   REVERB_RETURN_IF_ERROR(CheckValidPriority(priority));
   const size_t index = key_to_index_.size();
   if (index == capacity_) {
-    capacity_ *= 2;
-    sum_tree_.resize(capacity_);
+    Grow(2 * capacity_);
   }
   if (!key_to_index_.try_emplace(key, index).second) {
     return absl::InvalidArgumentError(
         absl::StrCat("Key ", key, " already inserted."));
   }
-  sum_tree_[index].key = key;
+  keys_.push_back(key);
 
-  SetNode(index, power(priority, priority_exponent_));
+  values_[index] = power(priority, priority_exponent_);
+  priorities_[index] = priority;
+  UpdatePath(index);
+  ++version_;
+  return absl::OkStatus();
+}
+
+absl::Status PrioritizedSelector::BulkInsert(
+    absl::Span<const std::pair<Key, double>> items) {
+  if (items.empty()) return absl::OkStatus();
+
+  // Claim the keys before touching any leaf or sum so an invalid entry can be
+  // unwound with map erases alone.
+  const size_t first_index = key_to_index_.size();
+  for (size_t i = 0; i < items.size(); ++i) {
+    absl::Status status = CheckValidPriority(items[i].second);
+    if (status.ok() &&
+        !key_to_index_.try_emplace(items[i].first, first_index + i).second) {
+      status = absl::InvalidArgumentError(
+          absl::StrCat("Key ", items[i].first, " already inserted."));
+    }
+    if (!status.ok()) {
+      for (size_t j = 0; j < i; ++j) key_to_index_.erase(items[j].first);
+      return status;
+    }
+  }
+
+  const size_t size = first_index + items.size();
+  if (size > capacity_) {
+    size_t capacity = 2 * capacity_;
+    while (capacity < size) capacity *= 2;
+    Grow(capacity);
+  }
+
+  for (const auto& item : items) {
+    values_[keys_.size()] = power(item.second, priority_exponent_);
+    priorities_[keys_.size()] = item.second;
+    keys_.push_back(item.first);
+  }
+
+  // The new leaves are consecutive, so a single bottom-up pass over the
+  // contiguous range of affected blocks repairs the tree in O(n / kFanout).
+  size_t first = first_index / kFanout;
+  size_t last = (size - 1) / kFanout;
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    for (size_t node = first; node <= last; ++node) RecomputeNode(level, node);
+    first /= kFanout;
+    last /= kFanout;
+  }
+  ++version_;
   return absl::OkStatus();
 }
 
@@ -104,7 +183,76 @@ absl::Status PrioritizedSelector::Update(Key key, double priority) {
   if (it == key_to_index_.end()) {
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
   }
-  SetNode(it->second, power(priority, priority_exponent_));
+  values_[it->second] = power(priority, priority_exponent_);
+  priorities_[it->second] = priority;
+  UpdatePath(it->second);
+  ++version_;
+  return absl::OkStatus();
+}
+
+absl::Status PrioritizedSelector::BulkUpdate(
+    absl::Span<const std::pair<Key, double>> updates) {
+  // Resolve and validate the whole batch before mutating anything so an
+  // invalid entry does not leave the tree partially updated.
+  std::vector<std::pair<size_t, double>> indexed;
+  indexed.reserve(updates.size());
+  for (const auto& update : updates) {
+    REVERB_RETURN_IF_ERROR(CheckValidPriority(update.second));
+    const auto it = key_to_index_.find(update.first);
+    if (it == key_to_index_.end()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Key ", update.first, " not found."));
+    }
+    indexed.push_back({it->second, update.second});
+  }
+
+  // Apply all leaf updates and remember the affected blocks.
+  std::vector<size_t> dirty;
+  dirty.reserve(indexed.size());
+  for (const auto& update : indexed) {
+    values_[update.first] = power(update.second, priority_exponent_);
+    priorities_[update.first] = update.second;
+    dirty.push_back(update.first / kFanout);
+  }
+  std::sort(dirty.begin(), dirty.end());
+  dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+  // Single bottom-up repair pass; every dirty node is recomputed exactly once
+  // per level no matter how many updates landed below it.
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    for (size_t node : dirty) RecomputeNode(level, node);
+    for (auto& node : dirty) node /= kFanout;
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+  }
+  ++version_;
+  return absl::OkStatus();
+}
+
+absl::Status PrioritizedSelector::SetPriorityExponent(
+    double priority_exponent) {
+  if (std::isnan(priority_exponent) || priority_exponent < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Priority exponent must be a non-negative number, got ",
+                     priority_exponent, "."));
+  }
+  if (priority_exponent == priority_exponent_) return absl::OkStatus();
+  priority_exponent_ = priority_exponent;
+
+  const size_t size = key_to_index_.size();
+  if (size == 0) return absl::OkStatus();
+
+  // Re-exponentiate every leaf from its raw priority and repair the tree in
+  // one bottom-up pass, like `BulkInsert`. O(n) regardless of the old and
+  // new exponents.
+  for (size_t i = 0; i < size; ++i) {
+    values_[i] = power(priorities_[i], priority_exponent_);
+  }
+  size_t last = (size - 1) / kFanout;
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    for (size_t node = 0; node <= last; ++node) RecomputeNode(level, node);
+    last /= kFanout;
+  }
+  ++version_;
   return absl::OkStatus();
 }
 
@@ -113,59 +261,101 @@ ItemSelector::KeyWithProbability PrioritizedSelector::Sample() {
   REVERB_CHECK_NE(size, 0);
 
   // This should never be called concurrently from multiple threads.
-  const double target = absl::Uniform<double>(bit_gen_, 0, 1);
-  const double total_weight = sum_tree_[0].sum;
+  uint64_t draw_index_plus_one = 0;
+  double target;
+  if (draws_.has_value()) {
+    draw_index_plus_one = draws_->next_index() + 1;
+    target = draws_->NextDouble();
+  } else {
+    target = absl::Uniform<double>(bit_gen_, 0, 1);
+  }
+  const double total_weight = TotalWeight();
 
   // All keys have zero priority so treat as if uniformly sampling.
   if (total_weight == 0) {
     const size_t pos = static_cast<size_t>(target * size);
-    return {sum_tree_[pos].key, 1. / size};
+    return {keys_[pos], 1. / size, draw_index_plus_one};
   }
 
-  // We begin traversing the `sum_tree_` from the root to the children in order
-  // to find the `index` corresponding to the sampled `target_weight`.
-  size_t index = 0;
+  // Traverse the tree from the root towards the leaves. At each level we scan
+  // the block of `kFanout` contiguous children that contains the sampled
+  // `target_weight`; each block spans two cache lines and the scan
+  // vectorizes.
   double target_weight = target * total_weight;
-  while (true) {
-    // Go to the left sub tree if it contains our sampled `target_weight`.
-    const size_t left_index = 2 * index + 1;
-    const double left_sum = NodeSum(left_index);
-    if (target_weight < left_sum) {
-      index = left_index;
-      continue;
-    }
-    target_weight -= left_sum;
-    // Go to the right sub tree if it contains our sampled `target_weight`.
-    const size_t right_index = 2 * index + 2;
-    const double right_sum = NodeSum(right_index);
-    if (target_weight < right_sum) {
-      index = right_index;
-      continue;
-    }
-    target_weight -= right_sum;
-    // Otherwise it is the current index.
-    break;
+  size_t node = 0;
+  for (int level = static_cast<int>(level_sums_.size()) - 2; level >= 0;
+       --level) {
+    node = node * kFanout +
+           DescendBlock<kFanout>(level_sums_[level].data() + node * kFanout,
+                                 &target_weight);
   }
+  const size_t index =
+      node * kFanout +
+      DescendBlock<kFanout>(values_.data() + node * kFanout, &target_weight);
   REVERB_CHECK_LT(index, size);
-  const double picked_weight = NodeValue(index);
+
+  const double picked_weight = values_[index];
   REVERB_LOG_IF(REVERB_ERROR, target_weight >= picked_weight)
       << "Target weight should be smaller than picked weight (target_weight: "
       << target_weight << " >= picked_weight:" << picked_weight << ").";
-  return {sum_tree_[index].key, picked_weight / total_weight};
+
+  // Serve the normalized probability from the per-leaf cache when no mass has
+  // changed since it was computed. Between mutations repeated draws of a key
+  // are then a stamped read instead of a division.
+  if (cached_probability_versions_[index] != version_) {
+    cached_probabilities_[index] = picked_weight / total_weight;
+    cached_probability_versions_[index] = version_;
+  }
+  return {keys_[index], cached_probabilities_[index], draw_index_plus_one};
+}
+
+double PrioritizedSelector::TotalWeight() const {
+  return level_sums_.back()[0];
+}
+
+double PrioritizedSelector::MinWeight() const {
+  const double min = level_mins_.back()[0];
+  return min == std::numeric_limits<double>::infinity() ? 0 : min;
+}
+
+double PrioritizedSelector::MaxWeight() const { return level_maxes_.back()[0]; }
+
+void PrioritizedSelector::ExportSamplingWeights(
+    std::vector<std::pair<Key, double>>* weights) const {
+  const size_t size = key_to_index_.size();
+  weights->reserve(weights->size() + size);
+  for (size_t i = 0; i < size; ++i) {
+    weights->push_back({keys_[i], values_[i]});
+  }
 }
 
 void PrioritizedSelector::Clear() {
-  for (size_t i = 0; i < key_to_index_.size(); ++i) {
-    sum_tree_[i].sum = 0;
-    sum_tree_[i].value = 0;
+  std::fill(values_.begin(), values_.end(), 0.0);
+  std::fill(priorities_.begin(), priorities_.end(), 0.0);
+  for (auto& level : level_sums_) {
+    std::fill(level.begin(), level.end(), 0.0);
+  }
+  for (auto& level : level_mins_) {
+    std::fill(level.begin(), level.end(),
+              std::numeric_limits<double>::infinity());
+  }
+  for (auto& level : level_maxes_) {
+    std::fill(level.begin(), level.end(), 0.0);
   }
+  keys_.clear();
   key_to_index_.clear();
+  ++version_;
 }
 
 KeyDistributionOptions PrioritizedSelector::options() const {
   KeyDistributionOptions options;
   options.mutable_prioritized()->set_priority_exponent(priority_exponent_);
   options.set_is_deterministic(false);
+  if (draws_.has_value()) {
+    options.set_deterministic_sampling(true);
+    options.set_sampling_seed(draws_->seed());
+    options.set_next_sample_index(draws_->next_index());
+  }
   return options;
 }
 
@@ -174,60 +364,82 @@ std::string PrioritizedSelector::DebugString() const {
       "PrioritizedSelector(priority_exponent=", priority_exponent_, ")");
 }
 
-double PrioritizedSelector::NodeValue(size_t index) const {
-  return sum_tree_[index].value;
-}
-
-double PrioritizedSelector::NodeSum(size_t index) const {
-  return index < key_to_index_.size() ? sum_tree_[index].sum : 0;
-}
-
 double PrioritizedSelector::NodeSumTestingOnly(size_t index) const {
-  return NodeSum(index);
+  REVERB_CHECK_EQ(index, 0);
+  return TotalWeight();
 }
 
-// Updates the sum stored in a node and tracks if the tree needs to be
-// re-initialized.
-// Ensure the sum never becomes negative (it may happen because of rounding
-// errors).
-#define UPDATE_SUM(i)                                          \
-  sum_tree_[(i)].sum += difference;                            \
-  if (sum_tree_[(i)].sum < 0) sum_tree_[(i)].sum = 0.0;        \
-  error = std::abs(sum_tree_[(i)].sum - NodeSum(2 * (i) + 1) - \
-                   NodeSum(2 * (i) + 2) - sum_tree_[(i)].value);
-
-void PrioritizedSelector::SetNode(size_t index, double value) {
-  const double difference = value - NodeValue(index);
-
-  // The floating point approximation error of the last node update.
-  double error = 0.0;
-
-  // Update the subject node.
-  sum_tree_[index].value = value;
-  UPDATE_SUM(index);
-
-  // Update all parents until we find the root node.
-  while (index != 0 && error <= kMaxApproximationError) {
-    index = (index - 1) / 2;
-    UPDATE_SUM(index);
+void PrioritizedSelector::RecomputeNode(size_t level, size_t node) {
+  const size_t base = node * kFanout;
+  double sum = 0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = 0;
+  if (level == 0) {
+    const double* children = values_.data() + base;
+    for (size_t k = 0; k < kFanout; ++k) {
+      const double weight = children[k];
+      sum += weight;
+      // Zero-weight leaves (unused slots and zero-priority keys) can never be
+      // sampled, so they are excluded from the min.
+      min = std::min(
+          min, weight > 0 ? weight : std::numeric_limits<double>::infinity());
+      max = std::max(max, weight);
+    }
+  } else {
+    const double* sums = level_sums_[level - 1].data() + base;
+    const double* mins = level_mins_[level - 1].data() + base;
+    const double* maxes = level_maxes_[level - 1].data() + base;
+    for (size_t k = 0; k < kFanout; ++k) {
+      sum += sums[k];
+      min = std::min(min, mins[k]);
+      max = std::max(max, maxes[k]);
+    }
   }
+  level_sums_[level][node] = sum;
+  level_mins_[level][node] = min;
+  level_maxes_[level][node] = max;
+}
 
-  // If floating-point errors have built up, re-initialize the tree.
-  if (error > kMaxApproximationError) {
-    REVERB_LOG(REVERB_WARNING)
-        << "Tree needs to be initialized because node with index " << index
-        << " has approximation error " << error
-        << ", which exceeds the threshold of " << kMaxApproximationError;
-    ReinitializeSumTree();
+void PrioritizedSelector::UpdatePath(size_t index) {
+  size_t node = index;
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    node /= kFanout;
+    RecomputeNode(level, node);
   }
 }
 
-#undef UPDATE_SUM
-
-void PrioritizedSelector::ReinitializeSumTree() {
-  // Re-initialize the sums from the leaves to the root node.
-  for (int64_t i = sum_tree_.size() - 1; i >= 0; --i) {
-    sum_tree_[i].sum = NodeValue(i) + NodeSum(2 * i + 1) + NodeSum(2 * i + 2);
+void PrioritizedSelector::Grow(size_t capacity) {
+  capacity_ = (capacity + kFanout - 1) / kFanout * kFanout;
+  values_.resize(capacity_, 0.0);
+  priorities_.resize(capacity_, 0.0);
+  cached_probabilities_.resize(capacity_, 0.0);
+  cached_probability_versions_.resize(capacity_, 0);
+  keys_.reserve(capacity_);
+
+  // Rebuild the level structure. Every level is padded to a multiple of
+  // `kFanout` so a parent always aggregates a full block of children; the
+  // padding holds the aggregation identities (0 for sums and maxes, +inf for
+  // mins) so it never influences a parent.
+  level_sums_.clear();
+  level_mins_.clear();
+  level_maxes_.clear();
+  size_t num_nodes = values_.size() / kFanout;
+  while (num_nodes > 1) {
+    const size_t padded = (num_nodes + kFanout - 1) / kFanout * kFanout;
+    level_sums_.emplace_back(padded, 0.0);
+    level_mins_.emplace_back(padded, std::numeric_limits<double>::infinity());
+    level_maxes_.emplace_back(padded, 0.0);
+    num_nodes = padded / kFanout;
+  }
+  level_sums_.emplace_back(1, 0.0);
+  level_mins_.emplace_back(1, std::numeric_limits<double>::infinity());
+  level_maxes_.emplace_back(1, 0.0);
+
+  // Recompute all aggregates from the leaves to the root.
+  size_t nodes = values_.size() / kFanout;
+  for (size_t level = 0; level < level_sums_.size(); ++level) {
+    for (size_t i = 0; i < nodes; ++i) RecomputeNode(level, i);
+    nodes = level_sums_[level].size() / kFanout;
   }
 }
 
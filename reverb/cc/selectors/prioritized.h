@@ -15,10 +15,13 @@
 #ifndef REVERB_CC_SELECTORS_PRIORITIZED_H_
 #define REVERB_CC_SELECTORS_PRIORITIZED_H_
 
+#include <cstdint>
+#include <utility>
 #include <vector>
 
 #include "absl/random/random.h"
 #include "absl/status/status.h"
+#include "absl/types/optional.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/selectors/interface.h"
@@ -31,11 +34,22 @@ namespace reverb {
 // sampling a key is proportional to its priority raised to a configurable
 // exponent.
 //
+// The distribution is backed by a sum tree with a 16-wide fanout. The
+// exponentiated priorities are stored in a flat leaf array and every internal
+// node holds the sum — and, in parallel arrays, the min and max — of its 16
+// children, which are stored contiguously.
+// Updating a node therefore touches log16(n) blocks of 16 adjacent doubles
+// (two cache lines each) and the per-block summation loops are trivially
+// vectorizable, as opposed to the pointer-chasing root-to-leaf walk of a
+// binary sum tree. Since a parent is always recomputed from all of its
+// children, rounding errors do not accumulate across updates and no periodic
+// reinitialization of the tree is required.
+//
 // Since the priorities and probabilities are stored as doubles, numerical
 // rounding errors may be introduced especially when the relative size of
-// probabilities for keys is large. Ideally when using this class priorities are
-// roughly the same scale and the priority exponent is not large, e.g. less than
-// 2.
+// probabilities for keys is large. Ideally when using this class priorities
+// are roughly the same scale and the priority exponent is not large, e.g.
+// less than 2.
 //
 // This was forked from:
 // ## proportional_picker.h
@@ -45,18 +59,62 @@ class PrioritizedSelector : public ItemSelector {
   PrioritizedSelector(double priority_exponent,
                       absl::BitGen bit_gen = absl::BitGen());
 
+  // Constructs a selector in deterministic sampling mode: draws come from a
+  // `DeterministicDrawSequence` keyed by `seed` instead of `bit_gen_` and
+  // every sample records its draw index. `next_sample_index` seeds the draw
+  // counter when restoring from a checkpoint.
+  PrioritizedSelector(double priority_exponent, uint64_t seed,
+                      uint64_t next_sample_index = 0);
+
   // O(log n) time.
   absl::Status Delete(Key key) override;
 
   // The priority must be non-negative. O(log n) time.
   absl::Status Insert(Key key, double priority) override;
 
+  // Assigns the batch consecutive leaf indices, fills the leaves and repairs
+  // the tree with a single bottom-up pass over the blocks that received new
+  // leaves. Restoring n keys into an empty selector therefore costs O(n)
+  // instead of the O(n log n) of repeated `Insert` calls.
+  absl::Status BulkInsert(
+      absl::Span<const std::pair<Key, double>> items) override;
+
   // The priority must be non-negative. O(log n) time.
   absl::Status Update(Key key, double priority) override;
 
-  // O(log n) time.
+  // Applies all leaf updates first and then repairs the affected part of the
+  // tree in a single bottom-up pass, so shared ancestors are recomputed once
+  // per batch instead of once per update. O(k log n) time with a constant
+  // factor close to 1/k for dense batches.
+  absl::Status BulkUpdate(
+      absl::Span<const std::pair<Key, double>> updates) override;
+
+  // O(log n) time. The normalized probability of the picked key is served
+  // from a per-leaf cache that is invalidated (via a version counter) by any
+  // operation that changes sampling masses, so repeated draws from a stable
+  // selector are a stamped read instead of a division.
   KeyWithProbability Sample() override;
 
+  // O(1) time. Returns the sum of the exponentiated priorities of all keys.
+  double TotalWeight() const override;
+
+  // O(1) time. The smallest non-zero and largest exponentiated priority of
+  // any key, maintained in the tree nodes alongside the sums. Both return 0
+  // when the selector is empty (or every key has zero priority).
+  double MinWeight() const override;
+  double MaxWeight() const override;
+
+  // O(n) time. Exports the exponentiated priorities.
+  void ExportSamplingWeights(
+      std::vector<std::pair<Key, double>>* weights) const override;
+
+  // Changes the priority exponent and recomputes the weight of every key
+  // from its stored raw priority in a single O(n) bottom-up pass. Annealing
+  // the exponent mid training is therefore one cheap server side operation
+  // instead of a client driven re-prioritization sweep. The exponent must be
+  // a non-negative number.
+  absl::Status SetPriorityExponent(double priority_exponent) override;
+
   // O(n) time.
   void Clear() override;
 
@@ -64,62 +122,88 @@ class PrioritizedSelector : public ItemSelector {
 
   std::string DebugString() const override;
 
-  // Returns the sum stored at a node for testing purposes only.
+  // Returns the sum stored at the root node (`index` must be 0) for testing
+  // purposes only.
   double NodeSumTestingOnly(size_t index) const;
 
  private:
-  struct Node {
-    Key key;
-    // Sum of the exponentiated priority of this node and all its descendants.
-    // This includes the entire sub tree with inner and leaf nodes.
-    // `NodeValue()` can be used to get the exponentiated priority of a node
-    // without its children.
-    double sum = 0;
-    // The exponentiated priority of this node. This can be computed from `sum`,
-    // however, this calculation becomes less accurate over time as rounding
-    // errors accumulate.
-    double value = 0;
-  };
-
-  // Gets the individual value of a node in `sum_tree_` without the summed up
-  // value of all its descendants.
-  double NodeValue(size_t index) const;
-
-  // Sum of the exponentiated priority of this node and all its descendants.
-  // If the index is out of bounds, then 0 is returned.
-  double NodeSum(size_t index) const;
-
-  // Sets the individual value of a node in the `sum_tree_`. This does not
-  // include the value of the descendants. Usually, this operation's runtime is
-  // in O(log n). However, if floating point rounding errors have accumulated to
-  // a point where the intermediate sums deviate from their true values more
-  // than 1e-4, the tree is reinitialized, which takes O(n) time.
-  void SetNode(size_t index, double value);
-
-  // Computes the sum tree. This may be necessary if rounding errors have
-  // compounded due to repeated partial tree updates. For example, sums may
-  // become negative due to rounding errors (e.g. x - (x + epsilon) < 0 where
-  // epsilon is a small rounding error).
-  void ReinitializeSumTree();
+  // Number of children of each internal node. The children of a node are
+  // stored contiguously so the summation over them compiles down to a handful
+  // of vector instructions (e.g. AVX2) on platforms that support them.
+  static constexpr size_t kFanout = 16;
+
+  // Recomputes the sum, min and max of the node at position `node` of internal
+  // level `level` from its `kFanout` children. Zero-weight leaves are excluded
+  // from the min; empty subtrees aggregate to (0, +inf, 0).
+  void RecomputeNode(size_t level, size_t node);
+
+  // Recomputes the aggregates on the path from the leaf at `index` up to the
+  // root. Every affected node is recomputed from all of its children, so the
+  // stored aggregates never drift from the leaf values.
+  void UpdatePath(size_t index);
+
+  // Grows the leaf array to `capacity` (rounded up to a multiple of
+  // `kFanout`), rebuilds the level structure and recomputes all sums.
+  void Grow(size_t capacity);
 
   // Controls the degree of prioritization. Priorities are raised to this
-  // exponent before adding them to the `SumTree` as weights. A non-negative
+  // exponent before adding them to the sum tree as weights. A non-negative
   // number where a value of zero corresponds each key having the same
-  // probability (except for keys with zero priority).
-  const double priority_exponent_;
+  // probability (except for keys with zero priority). May be annealed
+  // through `SetPriorityExponent`.
+  double priority_exponent_;
 
-  // Capacity of the summary tree. Starts at ~130000 and grows exponentially.
+  // Capacity of the leaf array. Always a multiple of `kFanout`. Starts at
+  // ~130000 and grows exponentially.
   size_t capacity_;
 
-  // A tree stored as a flat vector were each node is the sum of its children
-  // plus its own exponentiated priority.
-  std::vector<Node> sum_tree_;
-
-  // Maps a key to the index where this key can be found in `sum_tree_`.
+  // Exponentiated priority of each key, indexed by the position assigned at
+  // insertion time. Unused slots hold zero so that internal nodes can always
+  // sum full blocks of `kFanout` children.
+  std::vector<double> values_;
+
+  // Raw (un-exponentiated) priority of each key, parallel to `values_`. Kept
+  // so that `SetPriorityExponent` can recompute the weights without the
+  // clients re-sending the priorities.
+  std::vector<double> priorities_;
+
+  // Normalized probability of each leaf and the value of `version_` at which
+  // it was computed, parallel to `values_`. Filled lazily by `Sample`; an
+  // entry whose stamp does not match `version_` is stale and recomputed on
+  // the next draw of that leaf.
+  std::vector<double> cached_probabilities_;
+  std::vector<uint64_t> cached_probability_versions_;
+
+  // Incremented by every operation that changes sampling masses (inserts,
+  // updates, deletes, exponent changes and `Clear`), invalidating all cached
+  // probabilities at once. Starts at 1 so the zero-initialized stamps of
+  // freshly grown leaves are always stale.
+  uint64_t version_ = 1;
+
+  // Maps the leaf index to the key stored there.
+  std::vector<Key> keys_;
+
+  // Internal levels of the sum tree, from the parents of the leaves
+  // (`level_sums_[0]`) up to the root level (a single node). Every level is
+  // padded with zeros to a multiple of `kFanout`.
+  std::vector<std::vector<double>> level_sums_;
+
+  // Min/max aggregates maintained in lock step with `level_sums_`, same level
+  // structure. `level_mins_` holds the smallest non-zero weight below each
+  // node (+inf for empty subtrees and padding) and `level_maxes_` the largest
+  // weight (0 for empty subtrees and padding), so the roots give the extreme
+  // sampling weights of the whole distribution in O(1).
+  std::vector<std::vector<double>> level_mins_;
+  std::vector<std::vector<double>> level_maxes_;
+
+  // Maps a key to the index where this key can be found in `values_`.
   internal::flat_hash_map<Key, size_t> key_to_index_;
 
   // Used for sampling, not thread-safe.
   absl::BitGen bit_gen_;
+
+  // Replaces `bit_gen_` in deterministic sampling mode.
+  absl::optional<DeterministicDrawSequence> draws_;
 };
 
 }  // namespace reverb
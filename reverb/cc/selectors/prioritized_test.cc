@@ -140,6 +140,32 @@ TEST(PrioritizedSelectorTest, SetsPriorityExponentInOptions) {
           "prioritized: { priority_exponent: 0.5 } is_deterministic: false"));
 }
 
+TEST(PrioritizedSelectorTest, SeededSelectorsReplayTheSameSequence) {
+  PrioritizedSelector first(/*priority_exponent=*/0.5, /*seed=*/42);
+  PrioritizedSelector second(/*priority_exponent=*/0.5, /*seed=*/42);
+  for (int i = 0; i < 100; i++) {
+    REVERB_EXPECT_OK(first.Insert(i, i));
+    REVERB_EXPECT_OK(second.Insert(i, i));
+  }
+  for (int i = 0; i < 1000; i++) {
+    const auto sample = first.Sample();
+    // Draw indices are recorded 1-based so a seeded sample is always
+    // distinguishable from the unseeded case.
+    EXPECT_EQ(sample.deterministic_sample_index, i + 1);
+    EXPECT_EQ(second.Sample().key, sample.key);
+  }
+  EXPECT_THAT(first.options(),
+              testing::EqualsProto(
+                  "prioritized: { priority_exponent: 0.5 } "
+                  "is_deterministic: false deterministic_sampling: true "
+                  "sampling_seed: 42 next_sample_index: 1000"));
+
+  // An unseeded selector does not record draw indices.
+  PrioritizedSelector unseeded(0.5);
+  REVERB_EXPECT_OK(unseeded.Insert(1, 1));
+  EXPECT_EQ(unseeded.Sample().deterministic_sample_index, 0);
+}
+
 TEST(PrioritizedSelector, RoundingErrors) {
   PrioritizedSelector prioritized(1.0);
 
@@ -157,6 +183,190 @@ TEST(PrioritizedSelector, RoundingErrors) {
   EXPECT_GE(prioritized.NodeSumTestingOnly(0), 0.0);
 }
 
+TEST(PrioritizedSelectorTest, BulkUpdateMatchesSequentialUpdates) {
+  const int kItems = 1000;
+  const int kSamples = 1000000;
+
+  PrioritizedSelector prioritized(1.0);
+  std::vector<std::pair<ItemSelector::Key, double>> updates;
+  double sum = 0;
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(prioritized.Insert(i, 123));
+    updates.push_back({i, static_cast<double>(i)});
+    sum += i;
+  }
+  REVERB_EXPECT_OK(prioritized.BulkUpdate(updates));
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), sum, 1e-6);
+
+  std::vector<int64_t> counts(kItems);
+  for (int i = 0; i < kSamples; i++) {
+    ItemSelector::KeyWithProbability sample = prioritized.Sample();
+    EXPECT_NEAR(sample.probability, sample.key / sum, 0.001);
+    counts[sample.key]++;
+  }
+  for (int k = 0; k < kItems; k++) {
+    EXPECT_NEAR(static_cast<double>(counts[k]) / static_cast<double>(kSamples),
+                k / sum, 0.05);
+  }
+}
+
+TEST(PrioritizedSelectorTest, BulkUpdateRejectsInvalidBatch) {
+  PrioritizedSelector prioritized(1.0);
+  REVERB_EXPECT_OK(prioritized.Insert(1, 1));
+
+  // A missing key rejects the batch without applying any update.
+  EXPECT_EQ(prioritized.BulkUpdate({{1, 5}, {2, 5}}).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), 1.0, 1e-9);
+
+  // So does an invalid priority.
+  EXPECT_EQ(prioritized.BulkUpdate({{1, -1}}).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), 1.0, 1e-9);
+}
+
+TEST(PrioritizedSelectorTest, BulkInsertMatchesSequentialInserts) {
+  const int kItems = 1000;
+
+  PrioritizedSelector prioritized(1.0);
+  std::vector<std::pair<ItemSelector::Key, double>> items;
+  double sum = 0;
+  for (int i = 0; i < kItems; i++) {
+    items.push_back({i, static_cast<double>(i)});
+    sum += i;
+  }
+  REVERB_EXPECT_OK(prioritized.BulkInsert(items));
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), sum, 1e-6);
+
+  // Bulk inserted keys behave like individually inserted ones.
+  REVERB_EXPECT_OK(prioritized.Update(1, 2));
+  REVERB_EXPECT_OK(prioritized.Delete(2));
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), sum - 1, 1e-6);
+}
+
+TEST(PrioritizedSelectorTest, BulkInsertGrowsLeafArray) {
+  // More keys than the initial capacity of the leaf array.
+  const size_t kItems = (1 << 17) + 100;
+
+  PrioritizedSelector prioritized(1.0);
+  std::vector<std::pair<ItemSelector::Key, double>> items;
+  for (size_t i = 0; i < kItems; i++) {
+    items.push_back({i, 1.0});
+  }
+  REVERB_EXPECT_OK(prioritized.BulkInsert(items));
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), kItems, 1e-6);
+}
+
+TEST(PrioritizedSelectorTest, BulkInsertRejectsInvalidBatch) {
+  PrioritizedSelector prioritized(1.0);
+  REVERB_EXPECT_OK(prioritized.Insert(1, 1));
+
+  // An already inserted key rejects the batch without inserting anything.
+  EXPECT_EQ(prioritized.BulkInsert({{2, 5}, {1, 5}}).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(prioritized.Delete(2).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), 1.0, 1e-9);
+
+  // So does an invalid priority.
+  EXPECT_EQ(prioritized.BulkInsert({{2, -1}}).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), 1.0, 1e-9);
+}
+
+TEST(PrioritizedSelectorTest, MaintainsMinAndMaxWeight) {
+  PrioritizedSelector prioritized(1.0);
+
+  // Empty distribution reports zero for both extremes.
+  EXPECT_EQ(prioritized.MinWeight(), 0);
+  EXPECT_EQ(prioritized.MaxWeight(), 0);
+
+  REVERB_EXPECT_OK(prioritized.Insert(1, 2));
+  REVERB_EXPECT_OK(prioritized.Insert(2, 5));
+  // Zero-priority keys can never be sampled so they do not lower the min.
+  REVERB_EXPECT_OK(prioritized.Insert(3, 0));
+  EXPECT_NEAR(prioritized.MinWeight(), 2, 1e-9);
+  EXPECT_NEAR(prioritized.MaxWeight(), 5, 1e-9);
+
+  // Updates and deletes keep the aggregates exact.
+  REVERB_EXPECT_OK(prioritized.Update(1, 10));
+  EXPECT_NEAR(prioritized.MinWeight(), 5, 1e-9);
+  EXPECT_NEAR(prioritized.MaxWeight(), 10, 1e-9);
+  REVERB_EXPECT_OK(prioritized.Delete(1));
+  EXPECT_NEAR(prioritized.MinWeight(), 5, 1e-9);
+  EXPECT_NEAR(prioritized.MaxWeight(), 5, 1e-9);
+
+  // Bulk operations maintain them as well.
+  REVERB_EXPECT_OK(prioritized.BulkInsert({{4, 1}, {5, 20}}));
+  EXPECT_NEAR(prioritized.MinWeight(), 1, 1e-9);
+  EXPECT_NEAR(prioritized.MaxWeight(), 20, 1e-9);
+  REVERB_EXPECT_OK(prioritized.BulkUpdate({{4, 3}, {5, 4}}));
+  EXPECT_NEAR(prioritized.MinWeight(), 3, 1e-9);
+  EXPECT_NEAR(prioritized.MaxWeight(), 5, 1e-9);
+
+  prioritized.Clear();
+  EXPECT_EQ(prioritized.MinWeight(), 0);
+  EXPECT_EQ(prioritized.MaxWeight(), 0);
+}
+
+TEST(PrioritizedSelectorTest, SetPriorityExponentRecomputesWeights) {
+  PrioritizedSelector prioritized(1.0);
+  REVERB_EXPECT_OK(prioritized.Insert(1, 2));
+  REVERB_EXPECT_OK(prioritized.Insert(2, 3));
+  // Mutate through every code path so the raw priorities are exercised.
+  REVERB_EXPECT_OK(prioritized.Update(2, 4));
+  REVERB_EXPECT_OK(prioritized.BulkInsert({{3, 5}, {4, 9}}));
+  REVERB_EXPECT_OK(prioritized.BulkUpdate({{3, 6}}));
+  REVERB_EXPECT_OK(prioritized.Delete(4));
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), 2 + 4 + 6, 1e-9);
+
+  // Annealing the exponent recomputes the weights from the raw priorities.
+  REVERB_EXPECT_OK(prioritized.SetPriorityExponent(2.0));
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), 4 + 16 + 36, 1e-9);
+  EXPECT_NEAR(prioritized.MinWeight(), 4, 1e-9);
+  EXPECT_NEAR(prioritized.MaxWeight(), 36, 1e-9);
+  EXPECT_THAT(
+      prioritized.options(),
+      testing::EqualsProto(
+          "prioritized: { priority_exponent: 2 } is_deterministic: false"));
+
+  // Exponent zero weighs all keys uniformly.
+  REVERB_EXPECT_OK(prioritized.SetPriorityExponent(0.0));
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), 3, 1e-9);
+}
+
+TEST(PrioritizedSelectorTest, SetPriorityExponentRejectsInvalidExponent) {
+  PrioritizedSelector prioritized(1.0);
+  REVERB_EXPECT_OK(prioritized.Insert(1, 2));
+
+  EXPECT_EQ(prioritized.SetPriorityExponent(-1).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(prioritized.SetPriorityExponent(NAN).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_NEAR(prioritized.NodeSumTestingOnly(0), 2, 1e-9);
+}
+
+TEST(PrioritizedSelectorTest, CachedProbabilitiesFollowMassChanges) {
+  PrioritizedSelector prioritized(1.0);
+  REVERB_EXPECT_OK(prioritized.Insert(1, 1));
+  REVERB_EXPECT_OK(prioritized.Insert(2, 3));
+
+  // Repeated draws of a stable selector serve the cached normalized value.
+  for (int i = 0; i < 100; i++) {
+    ItemSelector::KeyWithProbability sample = prioritized.Sample();
+    EXPECT_NEAR(sample.probability, sample.key == 1 ? 0.25 : 0.75, 1e-9);
+  }
+
+  // A mass change must invalidate the cached probability of every key, not
+  // just the one that was touched.
+  REVERB_EXPECT_OK(prioritized.Update(2, 1));
+  for (int i = 0; i < 100; i++) {
+    EXPECT_NEAR(prioritized.Sample().probability, 0.5, 1e-9);
+  }
+
+  REVERB_EXPECT_OK(prioritized.Delete(2));
+  EXPECT_NEAR(prioritized.Sample().probability, 1.0, 1e-9);
+}
+
 TEST(PrioritizedDeathTest, ClearThenSample) {
   PrioritizedSelector prioritized(kInitialPriorityExponent);
   for (int i = 0; i < 100; i++) {
@@ -0,0 +1,109 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/reservoir.h"
+
+#include <cmath>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+absl::Status CheckValidPriority(double priority) {
+  if (std::isnan(priority))
+    return absl::InvalidArgumentError("Priority must not be NaN.");
+  if (priority <= 0)
+    return absl::InvalidArgumentError(
+        "Priority must be positive for reservoir sampling.");
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status ReservoirSelector::Delete(Key key) {
+  auto it = nodes_.find(key);
+  if (it == nodes_.end()) {
+    return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
+  }
+  heap_.Remove(it->second.get());
+  nodes_.erase(it);
+  return absl::OkStatus();
+}
+
+absl::Status ReservoirSelector::Insert(Key key, double priority) {
+  REVERB_RETURN_IF_ERROR(CheckValidPriority(priority));
+  if (nodes_.contains(key)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Key ", key, " already inserted."));
+  }
+  // This code is not thread-safe, because bit_gen_ is not protected by a
+  // mutex and is not itself thread-safe. The open interval keeps log(u)
+  // finite.
+  const double u =
+      absl::Uniform(absl::IntervalOpenOpen, bit_gen_, 0.0, 1.0);
+  const double score = std::log(u) / priority;
+  nodes_[key] = absl::make_unique<HeapNode>(key, score, priority);
+  heap_.Push(nodes_[key].get());
+  return absl::OkStatus();
+}
+
+absl::Status ReservoirSelector::Update(Key key, double priority) {
+  REVERB_RETURN_IF_ERROR(CheckValidPriority(priority));
+  auto it = nodes_.find(key);
+  if (it == nodes_.end()) {
+    return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
+  }
+  // Rescale the score as if the original draw had used the new priority:
+  // score * old_priority recovers log(u).
+  HeapNode* node = it->second.get();
+  node->score = node->score * node->priority / priority;
+  node->priority = priority;
+  heap_.Adjust(node);
+  return absl::OkStatus();
+}
+
+ItemSelector::KeyWithProbability ReservoirSelector::Sample() {
+  REVERB_CHECK(!nodes_.empty());
+  return {heap_.top()->key, 1.};
+}
+
+double ReservoirSelector::TotalWeight() const {
+  return static_cast<double>(nodes_.size());
+}
+
+void ReservoirSelector::Clear() {
+  nodes_.clear();
+  heap_.Clear();
+}
+
+KeyDistributionOptions ReservoirSelector::options() const {
+  KeyDistributionOptions options;
+  options.set_reservoir(true);
+  options.set_is_deterministic(true);
+  return options;
+}
+
+std::string ReservoirSelector::DebugString() const {
+  return "ReservoirSelector";
+}
+
+}  // namespace reverb
+}  // namespace deepmind
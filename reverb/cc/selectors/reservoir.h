@@ -0,0 +1,99 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SELECTORS_RESERVOIR_H_
+#define REVERB_CC_SELECTORS_RESERVOIR_H_
+
+#include <cstdint>
+#include <utility>
+
+#include "absl/random/random.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/support/intrusive_heap.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Maintains a weighted reservoir sample of the stream of inserted items
+// (Efraimidis & Spirakis). Every key is assigned a random score log(u) /
+// priority (u uniform in (0, 1)) at insertion time and `Sample` always
+// returns the key with the lowest score. When used as the remover of a table
+// with `max_size` N, the N retained items are thus a weight proportional --
+// uniform when all priorities are equal -- sample of every item ever
+// inserted, no matter how long the stream is. This decouples the sampling
+// statistics from eviction: a `UniformSelector` sampler on the same table
+// draws unbiased samples over the entire history of the run with fixed
+// memory and O(log n) work per insert.
+//
+// Priorities must be positive. Updating a priority rescales the key's score
+// as if the original random draw had been made with the new priority.
+class ReservoirSelector : public ItemSelector {
+ public:
+  // O(log n) time.
+  absl::Status Delete(Key key) override;
+
+  // O(log n) time.
+  absl::Status Insert(Key key, double priority) override;
+
+  // O(log n) time.
+  absl::Status Update(Key key, double priority) override;
+
+  // O(1) time. Returns the key with the lowest score, i.e. the item a
+  // reservoir of the current size would discard next.
+  KeyWithProbability Sample() override;
+
+  double TotalWeight() const override;
+
+  // O(n) time.
+  void Clear() override;
+
+  KeyDistributionOptions options() const override;
+
+  std::string DebugString() const override;
+
+ private:
+  struct HeapNode {
+    Key key;
+    // log(u) / priority with u uniform in (0, 1). Always negative; larger
+    // scores survive longer.
+    double score;
+    // Priority the score was drawn with; needed to rescale on `Update`.
+    double priority;
+    IntrusiveHeapLink heap;
+
+    HeapNode(Key key, double score, double priority)
+        : key(key), score(score), priority(priority) {}
+  };
+
+  struct HeapNodeScoreAccess {
+    double Get(const HeapNode* node) const { return node->score; }
+  };
+
+  // Heap where the top item is the one with the lowest score.
+  FlatIntrusiveHeap<HeapNode, double, HeapNodeScoreAccess> heap_;
+
+  // `IntrusiveHeap` does not manage the memory of its nodes so they are
+  // stored in `nodes_`. The content of nodes_ and heap_ are always kept in
+  // sync.
+  internal::flat_hash_map<Key, std::unique_ptr<HeapNode>> nodes_;
+
+  // Used for drawing scores, not thread-safe.
+  absl::BitGen bit_gen_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SELECTORS_RESERVOIR_H_
@@ -0,0 +1,161 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/selectors/reservoir.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+TEST(ReservoirSelectorTest, ReturnValueSanityChecks) {
+  ReservoirSelector reservoir;
+
+  // Non existent keys cannot be deleted or updated.
+  EXPECT_EQ(reservoir.Delete(123).code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(reservoir.Update(123, 4).code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // Priorities must be positive.
+  EXPECT_EQ(reservoir.Insert(123, 0).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(reservoir.Insert(123, -1).code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // Keys cannot be inserted twice.
+  REVERB_EXPECT_OK(reservoir.Insert(123, 4));
+  EXPECT_EQ(reservoir.Insert(123, 4).code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // Existing keys can be updated and sampled.
+  REVERB_EXPECT_OK(reservoir.Update(123, 5));
+  EXPECT_EQ(reservoir.Sample().key, 123);
+
+  // Existing keys cannot be deleted twice.
+  REVERB_EXPECT_OK(reservoir.Delete(123));
+  EXPECT_EQ(reservoir.Delete(123).code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ReservoirSelectorTest, RetainedSetIsApproximatelyUniform) {
+  // Run many independent streams of 100 keys through a reservoir of size 10
+  // and count how often each key survives. Every key should be retained with
+  // probability ~10%.
+  const int kStreamSize = 100;
+  const int kReservoirSize = 10;
+  const int kRuns = 2000;
+
+  std::vector<int> retained(kStreamSize, 0);
+  for (int run = 0; run < kRuns; run++) {
+    ReservoirSelector reservoir;
+    int size = 0;
+    for (int key = 0; key < kStreamSize; key++) {
+      REVERB_EXPECT_OK(reservoir.Insert(key, 1.0));
+      if (++size > kReservoirSize) {
+        REVERB_EXPECT_OK(reservoir.Delete(reservoir.Sample().key));
+        size--;
+      }
+    }
+    for (int key = 0; key < kStreamSize; key++) {
+      if (!reservoir.Delete(key).ok()) continue;
+      retained[key]++;
+    }
+  }
+
+  const double expected =
+      static_cast<double>(kReservoirSize) / kStreamSize * kRuns;
+  for (int key = 0; key < kStreamSize; key++) {
+    EXPECT_NEAR(retained[key], expected, expected * 0.3);
+  }
+}
+
+TEST(ReservoirSelectorTest, HigherPriorityItemsAreRetainedMoreOften) {
+  // A single heavy key competes with 99 light keys for 10 slots. The heavy
+  // key should survive (much) more often than the light ones.
+  const int kStreamSize = 100;
+  const int kReservoirSize = 10;
+  const int kRuns = 500;
+
+  int heavy_retained = 0;
+  for (int run = 0; run < kRuns; run++) {
+    ReservoirSelector reservoir;
+    int size = 0;
+    for (int key = 0; key < kStreamSize; key++) {
+      REVERB_EXPECT_OK(reservoir.Insert(key, key == 0 ? 100.0 : 1.0));
+      if (++size > kReservoirSize) {
+        REVERB_EXPECT_OK(reservoir.Delete(reservoir.Sample().key));
+        size--;
+      }
+    }
+    if (reservoir.Delete(0).ok()) heavy_retained++;
+  }
+
+  // A weight of 100 vs 99 unit weights makes retention of the heavy key near
+  // certain; 10% would be the unweighted rate.
+  EXPECT_GT(heavy_retained, kRuns * 0.9);
+}
+
+TEST(ReservoirSelectorTest, UpdateRescalesRetention) {
+  // Lowering a priority to (almost) zero makes the key the next eviction
+  // candidate.
+  ReservoirSelector reservoir;
+  for (int key = 0; key < 10; key++) {
+    REVERB_EXPECT_OK(reservoir.Insert(key, 1.0));
+  }
+  REVERB_EXPECT_OK(reservoir.Update(5, 1e-9));
+  EXPECT_EQ(reservoir.Sample().key, 5);
+}
+
+TEST(ReservoirSelectorTest, ProbabilityIsAlwaysOne) {
+  ReservoirSelector reservoir;
+
+  for (int i = 100; i < 150; i++) {
+    REVERB_EXPECT_OK(reservoir.Insert(i, 1.0));
+  }
+
+  for (int i = 0; i < 50; i++) {
+    auto sample = reservoir.Sample();
+    EXPECT_EQ(sample.probability, 1);
+    REVERB_EXPECT_OK(reservoir.Delete(sample.key));
+  }
+}
+
+TEST(ReservoirSelectorTest, Options) {
+  ReservoirSelector reservoir;
+  EXPECT_THAT(
+      reservoir.options(),
+      testing::EqualsProto("reservoir: true is_deterministic: true"));
+}
+
+TEST(ReservoirSelectorDeathTest, SampleFromEmptySelector) {
+  ReservoirSelector reservoir;
+  EXPECT_DEATH(reservoir.Sample(), "");
+
+  REVERB_EXPECT_OK(reservoir.Insert(123, 2));
+  reservoir.Sample();
+
+  REVERB_EXPECT_OK(reservoir.Delete(123));
+  EXPECT_DEATH(reservoir.Sample(), "");
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
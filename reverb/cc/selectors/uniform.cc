@@ -14,6 +14,8 @@
 
 #include "reverb/cc/selectors/uniform.h"
 
+#include <algorithm>
+
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
@@ -23,6 +25,9 @@
 namespace deepmind {
 namespace reverb {
 
+UniformSelector::UniformSelector(uint64_t seed, uint64_t next_sample_index)
+    : draws_(DeterministicDrawSequence(seed, next_sample_index)) {}
+
 absl::Status UniformSelector::Delete(Key key) {
   const auto it = key_to_index_.find(key);
   if (it == key_to_index_.end())
@@ -59,12 +64,33 @@ absl::Status UniformSelector::Update(Key key, double priority) {
 ItemSelector::KeyWithProbability UniformSelector::Sample() {
   REVERB_CHECK(!keys_.empty());
 
+  if (draws_.has_value()) {
+    const uint64_t draw_index = draws_->next_index();
+    const size_t index =
+        std::min<size_t>(draws_->NextDouble() * keys_.size(),
+                         keys_.size() - 1);
+    return {keys_[index], 1.0 / static_cast<double>(keys_.size()),
+            draw_index + 1};
+  }
+
   // This code is not thread-safe, because bit_gen_ is not protected by a mutex
   // and is not itself thread-safe.
   const size_t index = absl::Uniform<size_t>(bit_gen_, 0, keys_.size());
   return {keys_[index], 1.0 / static_cast<double>(keys_.size())};
 }
 
+double UniformSelector::TotalWeight() const {
+  return static_cast<double>(keys_.size());
+}
+
+void UniformSelector::ExportSamplingWeights(
+    std::vector<std::pair<Key, double>>* weights) const {
+  weights->reserve(weights->size() + keys_.size());
+  for (Key key : keys_) {
+    weights->push_back({key, 1.0});
+  }
+}
+
 void UniformSelector::Clear() {
   keys_.clear();
   key_to_index_.clear();
@@ -74,6 +100,11 @@ KeyDistributionOptions UniformSelector::options() const {
   KeyDistributionOptions options;
   options.set_uniform(true);
   options.set_is_deterministic(false);
+  if (draws_.has_value()) {
+    options.set_deterministic_sampling(true);
+    options.set_sampling_seed(draws_->seed());
+    options.set_next_sample_index(draws_->next_index());
+  }
   return options;
 }
 
@@ -15,10 +15,12 @@
 #ifndef REVERB_CC_SELECTORS_UNIFORM_H_
 #define REVERB_CC_SELECTORS_UNIFORM_H_
 
+#include <utility>
 #include <vector>
 
 #include "absl/random/random.h"
 #include "absl/status/status.h"
+#include "absl/types/optional.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/selectors/interface.h"
@@ -31,6 +33,14 @@ namespace reverb {
 // public methods.
 class UniformSelector : public ItemSelector {
  public:
+  UniformSelector() = default;
+
+  // Constructs a selector in deterministic sampling mode: draws come from a
+  // `DeterministicDrawSequence` keyed by `seed` instead of `bit_gen_` and
+  // every sample records its draw index. `next_sample_index` seeds the draw
+  // counter when restoring from a checkpoint.
+  explicit UniformSelector(uint64_t seed, uint64_t next_sample_index = 0);
+
   absl::Status Delete(Key key) override;
 
   absl::Status Insert(Key key, double priority) override;
@@ -39,6 +49,11 @@ class UniformSelector : public ItemSelector {
 
   KeyWithProbability Sample() override;
 
+  double TotalWeight() const override;
+
+  void ExportSamplingWeights(
+      std::vector<std::pair<Key, double>>* weights) const override;
+
   void Clear() override;
 
   KeyDistributionOptions options() const override;
@@ -54,6 +69,9 @@ class UniformSelector : public ItemSelector {
 
   // Used for sampling, not thread-safe.
   absl::BitGen bit_gen_;
+
+  // Replaces `bit_gen_` in deterministic sampling mode.
+  absl::optional<DeterministicDrawSequence> draws_;
 };
 
 }  // namespace reverb
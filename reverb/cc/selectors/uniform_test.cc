@@ -74,6 +74,76 @@ TEST(UniformSelectorTest, Options) {
               testing::EqualsProto("uniform: true is_deterministic: false"));
 }
 
+TEST(UniformSelectorTest, SeededSelectorsReplayTheSameSequence) {
+  UniformSelector first(/*seed=*/42);
+  UniformSelector second(/*seed=*/42);
+  for (int i = 0; i < 100; i++) {
+    REVERB_EXPECT_OK(first.Insert(i, 0));
+    REVERB_EXPECT_OK(second.Insert(i, 0));
+  }
+  for (int i = 0; i < 1000; i++) {
+    const auto sample = first.Sample();
+    // Draw indices are recorded 1-based so a seeded sample is always
+    // distinguishable from the unseeded case.
+    EXPECT_EQ(sample.deterministic_sample_index, i + 1);
+    EXPECT_EQ(second.Sample().key, sample.key);
+  }
+
+  // An unseeded selector does not record draw indices.
+  UniformSelector unseeded;
+  REVERB_EXPECT_OK(unseeded.Insert(1, 0));
+  EXPECT_EQ(unseeded.Sample().deterministic_sample_index, 0);
+}
+
+TEST(UniformSelectorTest, SeededSelectorIsUniform) {
+  const int64_t kItems = 100;
+  const int64_t kSamples = 1000000;
+  double expected_probability = 1. / static_cast<double>(kItems);
+
+  UniformSelector uniform(/*seed=*/1337);
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(uniform.Insert(i, 0));
+  }
+  std::vector<int64_t> counts(kItems);
+  for (int i = 0; i < kSamples; i++) {
+    ItemSelector::KeyWithProbability sample = uniform.Sample();
+    EXPECT_EQ(sample.probability, expected_probability);
+    counts[sample.key]++;
+  }
+  for (int64_t count : counts) {
+    EXPECT_NEAR(static_cast<double>(count) / static_cast<double>(kSamples),
+                expected_probability, 0.05);
+  }
+}
+
+TEST(UniformSelectorTest, SeedAndSampleIndexRoundTripThroughOptions) {
+  UniformSelector uniform(/*seed=*/42);
+  REVERB_EXPECT_OK(uniform.Insert(1, 0));
+  for (int i = 0; i < 10; i++) {
+    uniform.Sample();
+  }
+  EXPECT_THAT(uniform.options(),
+              testing::EqualsProto("uniform: true is_deterministic: false "
+                                   "deterministic_sampling: true "
+                                   "sampling_seed: 42 next_sample_index: 10"));
+
+  // A selector restored from the options continues the exact sequence as
+  // long as the keys are restored in the same order.
+  UniformSelector restored(/*seed=*/42, /*next_sample_index=*/10);
+  REVERB_EXPECT_OK(restored.Insert(1, 0));
+  for (int i = 0; i < 90; i++) {
+    REVERB_EXPECT_OK(uniform.Insert(i + 2, 0));
+    REVERB_EXPECT_OK(restored.Insert(i + 2, 0));
+  }
+  for (int i = 0; i < 100; i++) {
+    const auto expected = uniform.Sample();
+    const auto actual = restored.Sample();
+    EXPECT_EQ(actual.key, expected.key);
+    EXPECT_EQ(actual.deterministic_sample_index,
+              expected.deterministic_sample_index);
+  }
+}
+
 TEST(UniformDeathTest, ClearThenSample) {
   UniformSelector uniform;
   for (int i = 0; i < 100; i++) {
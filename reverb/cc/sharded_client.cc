@@ -0,0 +1,174 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/sharded_client.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "grpcpp/support/channel_arguments.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "reverb/cc/platform/grpc_utils.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+grpc::ChannelArguments CreateChannelArguments() {
+  grpc::ChannelArguments arguments;
+  arguments.SetMaxReceiveMessageSize(-1);  // Unlimited.
+  arguments.SetMaxSendMessageSize(-1);     // Unlimited.
+  arguments.SetInt(GRPC_ARG_MAX_RECONNECT_BACKOFF_MS, 30 * 1000);
+  arguments.SetLoadBalancingPolicyName("round_robin");
+  return arguments;
+}
+
+std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+MakeStubs(const std::vector<std::string>& server_addresses) {
+  std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+      stubs;
+  stubs.reserve(server_addresses.size());
+  for (const auto& address : server_addresses) {
+    stubs.push_back(/* grpc_gen:: */ReverbService::NewStub(
+        CreateCustomGrpcChannel(address, MakeChannelCredentials(),
+                                CreateChannelArguments())));
+  }
+  return stubs;
+}
+
+// Finalizer of splitmix64. Used instead of `absl::Hash` as the key to shard
+// mapping must be stable across processes (absl::Hash is seeded randomly in
+// each process).
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+}  // namespace
+
+ShardedClient::ShardedClient(const std::vector<std::string>& server_addresses)
+    : ShardedClient(MakeStubs(server_addresses)) {}
+
+ShardedClient::ShardedClient(
+    std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+        stubs)
+    : stubs_(std::move(stubs)) {
+  REVERB_CHECK(!stubs_.empty());
+  shards_.reserve(stubs_.size());
+  for (const auto& stub : stubs_) {
+    shards_.push_back(absl::make_unique<Client>(stub));
+  }
+}
+
+size_t ShardedClient::ShardIndexForKey(uint64_t routing_key) const {
+  // Rendezvous hashing; the owner is the shard with the highest weight for
+  // the key.
+  size_t best_index = 0;
+  uint64_t best_weight = 0;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    uint64_t weight = Mix(routing_key ^ Mix(i + 1));
+    if (i == 0 || weight > best_weight) {
+      best_weight = weight;
+      best_index = i;
+    }
+  }
+  return best_index;
+}
+
+absl::Status ShardedClient::NewTrajectoryWriter(
+    uint64_t routing_key, const TrajectoryWriter::Options& options,
+    std::unique_ptr<TrajectoryWriter>* writer) {
+  return ShardForKey(routing_key)->NewTrajectoryWriter(options, writer);
+}
+
+absl::Status ShardedClient::MutatePriorities(
+    absl::string_view table, const std::vector<KeyWithPriority>& updates,
+    const std::vector<uint64_t>& deletes, absl::Duration timeout) {
+  for (auto& shard : shards_) {
+    REVERB_RETURN_IF_ERROR(
+        shard->MutatePriorities(table, updates, deletes, timeout));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ShardedClient::Reset(const std::string& table) {
+  for (auto& shard : shards_) {
+    REVERB_RETURN_IF_ERROR(shard->Reset(table));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ShardedClient::Checkpoint(std::vector<std::string>* paths) {
+  std::vector<std::string> shard_paths;
+  shard_paths.reserve(shards_.size());
+  for (auto& shard : shards_) {
+    std::string path;
+    REVERB_RETURN_IF_ERROR(shard->Checkpoint(&path));
+    shard_paths.push_back(std::move(path));
+  }
+  std::swap(*paths, shard_paths);
+  return absl::OkStatus();
+}
+
+absl::Status ShardedClient::ServerInfo(absl::Duration timeout,
+                                       struct Client::ServerInfo* info) {
+  REVERB_RETURN_IF_ERROR(shards_[0]->ServerInfo(timeout, info));
+  for (size_t i = 1; i < shards_.size(); ++i) {
+    struct Client::ServerInfo shard_info;
+    REVERB_RETURN_IF_ERROR(shards_[i]->ServerInfo(timeout, &shard_info));
+    for (const auto& table : shard_info.table_info) {
+      auto it = std::find_if(info->table_info.begin(), info->table_info.end(),
+                             [&table](const TableInfo& merged) {
+                               return merged.name() == table.name();
+                             });
+      if (it == info->table_info.end()) {
+        info->table_info.push_back(table);
+        continue;
+      }
+      it->set_current_size(it->current_size() + table.current_size());
+      it->set_num_episodes(it->num_episodes() + table.num_episodes());
+      it->set_num_deleted_episodes(it->num_deleted_episodes() +
+                                   table.num_deleted_episodes());
+      it->set_num_unique_samples(it->num_unique_samples() +
+                                 table.num_unique_samples());
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ShardedClient::ServerInfo(struct Client::ServerInfo* info) {
+  return ServerInfo(absl::InfiniteDuration(), info);
+}
+
+absl::Status ShardedClient::NewSampler(const std::string& table,
+                                       const Sampler::Options& options,
+                                       std::unique_ptr<Sampler>* sampler) {
+  REVERB_RETURN_IF_ERROR(options.Validate());
+  *sampler = absl::make_unique<Sampler>(stubs_, table, options);
+  return absl::OkStatus();
+}
+
+}  // namespace reverb
+}  // namespace deepmind
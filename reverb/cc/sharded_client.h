@@ -0,0 +1,123 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SHARDED_CLIENT_H_
+#define REVERB_CC_SHARDED_CLIENT_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "reverb/cc/client.h"
+#include "reverb/cc/reverb_service.grpc.pb.h"
+#include "reverb/cc/reverb_service.pb.h"
+#include "reverb/cc/sampler.h"
+#include "reverb/cc/trajectory_writer.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Routes traffic from a single process across multiple independent Reverb
+// servers ("shards").
+//
+// Insert traffic is routed by a caller provided routing key (typically a hash
+// of the episode or actor id) so that all items of an episode end up on the
+// same server. The key to shard mapping uses rendezvous (highest random
+// weight) hashing which is stable across processes and only remaps 1/N of the
+// keys when the number of shards changes.
+//
+// Priority mutations are fanned out to every shard; a shard silently ignores
+// keys of items it does not own so the net effect is that each mutation is
+// applied exactly once, by the owning shard. Samplers round robin their
+// workers across the shards so sample throughput scales with the number of
+// servers.
+class ShardedClient {
+ public:
+  // Creates one `Client` per address. Must be non empty.
+  explicit ShardedClient(const std::vector<std::string>& server_addresses);
+
+  // Creates one `Client` per stub. Must be non empty.
+  explicit ShardedClient(
+      std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+          stubs);
+
+  size_t num_shards() const { return shards_.size(); }
+
+  // Client connected to the shard at `index`. The pointer is valid for the
+  // lifetime of the `ShardedClient`.
+  Client* shard(size_t index) const { return shards_[index].get(); }
+
+  // Index of the shard that owns `routing_key`.
+  size_t ShardIndexForKey(uint64_t routing_key) const;
+
+  // Client connected to the shard that owns `routing_key`.
+  Client* ShardForKey(uint64_t routing_key) const {
+    return shards_[ShardIndexForKey(routing_key)].get();
+  }
+
+  // Creates a `TrajectoryWriter` connected to the shard owning `routing_key`.
+  // All items created by the writer are inserted into that shard.
+  absl::Status NewTrajectoryWriter(uint64_t routing_key,
+                                   const TrajectoryWriter::Options& options,
+                                   std::unique_ptr<TrajectoryWriter>* writer);
+
+  // Applies the mutations on every shard. Shards ignore keys of items they do
+  // not own so each mutation takes effect on exactly the shard owning the
+  // item. Returns the first error encountered, if any.
+  absl::Status MutatePriorities(
+      absl::string_view table, const std::vector<KeyWithPriority>& updates,
+      const std::vector<uint64_t>& deletes,
+      absl::Duration timeout = absl::InfiniteDuration());
+
+  // Resets `table` on every shard.
+  absl::Status Reset(const std::string& table);
+
+  // Checkpoints every shard. On success `paths` contains the checkpoint path
+  // of each shard, in shard order.
+  absl::Status Checkpoint(std::vector<std::string>* paths);
+
+  // Merged info of all shards. Table metadata (signatures, limits, selector
+  // options) is taken from the first shard while the item and episode counts
+  // (`current_size`, `num_episodes`, etc.) are summed across the shards.
+  // Tables only present on a subset of the shards are included as is.
+  absl::Status ServerInfo(absl::Duration timeout,
+                          struct Client::ServerInfo* info);
+  // Waits indefinitely for all servers to respond.
+  absl::Status ServerInfo(struct Client::ServerInfo* info);
+
+  // Creates a `Sampler` whose workers are round robined across the shards
+  // (see `Sampler`). No signature validation is performed.
+  absl::Status NewSampler(const std::string& table,
+                          const Sampler::Options& options,
+                          std::unique_ptr<Sampler>* sampler);
+
+ private:
+  // Stubs of the shards, used for constructing samplers.
+  std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+      stubs_;
+
+  // One client per shard, constructed from the stub with the same index.
+  std::vector<std::unique_ptr<Client>> shards_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SHARDED_CLIENT_H_
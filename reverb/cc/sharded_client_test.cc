@@ -0,0 +1,188 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/sharded_client.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "grpcpp/impl/codegen/client_context.h"
+#include "grpcpp/impl/codegen/status.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/memory/memory.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/reverb_service.pb.h"
+#include "reverb/cc/reverb_service_mock.grpc.pb.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+class FakeStub : public /* grpc_gen:: */MockReverbServiceStub {
+ public:
+  explicit FakeStub(std::string name) : name_(std::move(name)) {}
+
+  grpc::Status MutatePriorities(grpc::ClientContext* context,
+                                const MutatePrioritiesRequest& request,
+                                MutatePrioritiesResponse* response) override {
+    mutate_priorities_requests_.push_back(request);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status Reset(grpc::ClientContext* context, const ResetRequest& request,
+                     ResetResponse* response) override {
+    reset_requests_.push_back(request);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status Checkpoint(grpc::ClientContext* context,
+                          const CheckpointRequest& request,
+                          CheckpointResponse* response) override {
+    response->set_checkpoint_path("/path/to/checkpoint/" + name_);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status ServerInfo(grpc::ClientContext* context,
+                          const ServerInfoRequest& request,
+                          ServerInfoResponse* response) override {
+    auto* table_info = response->add_table_info();
+    table_info->set_name("table");
+    table_info->set_max_size(10);
+    table_info->set_current_size(2);
+    table_info->set_num_episodes(1);
+    return grpc::Status::OK;
+  }
+
+  const std::vector<MutatePrioritiesRequest>& mutate_priorities_requests()
+      const {
+    return mutate_priorities_requests_;
+  }
+
+  const std::vector<ResetRequest>& reset_requests() const {
+    return reset_requests_;
+  }
+
+ private:
+  std::string name_;
+  std::vector<MutatePrioritiesRequest> mutate_priorities_requests_;
+  std::vector<ResetRequest> reset_requests_;
+};
+
+std::unique_ptr<ShardedClient> MakeShardedClient(
+    const std::vector<std::shared_ptr<FakeStub>>& stubs) {
+  std::vector<std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface>>
+      stub_interfaces(stubs.begin(), stubs.end());
+  return absl::make_unique<ShardedClient>(std::move(stub_interfaces));
+}
+
+TEST(ShardedClientTest, ShardIndexForKeyIsStableAndCoversAllShards) {
+  auto client = MakeShardedClient({std::make_shared<FakeStub>("a"),
+                                   std::make_shared<FakeStub>("b"),
+                                   std::make_shared<FakeStub>("c")});
+  std::vector<int> hits(client->num_shards(), 0);
+  for (uint64_t key = 0; key < 1000; ++key) {
+    size_t index = client->ShardIndexForKey(key);
+    ASSERT_LT(index, client->num_shards());
+    EXPECT_EQ(index, client->ShardIndexForKey(key));
+    hits[index]++;
+  }
+  for (int count : hits) {
+    EXPECT_GT(count, 0);
+  }
+}
+
+TEST(ShardedClientTest, AddingAShardOnlyRemapsASubsetOfTheKeys) {
+  auto two_shards = MakeShardedClient(
+      {std::make_shared<FakeStub>("a"), std::make_shared<FakeStub>("b")});
+  auto three_shards = MakeShardedClient({std::make_shared<FakeStub>("a"),
+                                         std::make_shared<FakeStub>("b"),
+                                         std::make_shared<FakeStub>("c")});
+  int remapped = 0;
+  for (uint64_t key = 0; key < 1000; ++key) {
+    size_t old_index = two_shards->ShardIndexForKey(key);
+    size_t new_index = three_shards->ShardIndexForKey(key);
+    if (new_index != old_index) {
+      // Keys only ever move to the new shard, never between existing shards.
+      EXPECT_EQ(new_index, 2);
+      remapped++;
+    }
+  }
+  EXPECT_GT(remapped, 0);
+  EXPECT_LT(remapped, 500);
+}
+
+TEST(ShardedClientTest, MutatePrioritiesIsSentToAllShards) {
+  auto first = std::make_shared<FakeStub>("a");
+  auto second = std::make_shared<FakeStub>("b");
+  auto client = MakeShardedClient({first, second});
+
+  auto update = testing::MakeKeyWithPriority(123, 42);
+  REVERB_EXPECT_OK(client->MutatePriorities("table", {update}, {456}));
+
+  for (const auto& stub : {first, second}) {
+    ASSERT_EQ(stub->mutate_priorities_requests().size(), 1);
+    const auto& request = stub->mutate_priorities_requests()[0];
+    EXPECT_EQ(request.table(), "table");
+    ASSERT_EQ(request.updates_size(), 1);
+    EXPECT_EQ(request.updates(0).key(), 123);
+    ASSERT_EQ(request.delete_keys_size(), 1);
+    EXPECT_EQ(request.delete_keys(0), 456);
+  }
+}
+
+TEST(ShardedClientTest, ResetIsSentToAllShards) {
+  auto first = std::make_shared<FakeStub>("a");
+  auto second = std::make_shared<FakeStub>("b");
+  auto client = MakeShardedClient({first, second});
+
+  REVERB_EXPECT_OK(client->Reset("table"));
+
+  for (const auto& stub : {first, second}) {
+    ASSERT_EQ(stub->reset_requests().size(), 1);
+    EXPECT_EQ(stub->reset_requests()[0].table(), "table");
+  }
+}
+
+TEST(ShardedClientTest, CheckpointReturnsOnePathPerShard) {
+  auto client = MakeShardedClient(
+      {std::make_shared<FakeStub>("a"), std::make_shared<FakeStub>("b")});
+
+  std::vector<std::string> paths;
+  REVERB_EXPECT_OK(client->Checkpoint(&paths));
+
+  EXPECT_EQ(paths, std::vector<std::string>(
+                       {"/path/to/checkpoint/a", "/path/to/checkpoint/b"}));
+}
+
+TEST(ShardedClientTest, ServerInfoSumsItemCountsAcrossShards) {
+  auto client = MakeShardedClient(
+      {std::make_shared<FakeStub>("a"), std::make_shared<FakeStub>("b")});
+
+  struct Client::ServerInfo info;
+  REVERB_EXPECT_OK(client->ServerInfo(&info));
+
+  ASSERT_EQ(info.table_info.size(), 1);
+  EXPECT_EQ(info.table_info[0].name(), "table");
+  EXPECT_EQ(info.table_info[0].max_size(), 10);
+  EXPECT_EQ(info.table_info[0].current_size(), 4);
+  EXPECT_EQ(info.table_info[0].num_episodes(), 2);
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,363 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/sharded_table.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+#include "absl/random/distributions.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "reverb/cc/errors.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/selectors/interface.h"
+
+namespace deepmind {
+namespace reverb {
+
+ShardedTable::ShardedTable(std::string name,
+                           std::vector<std::shared_ptr<ItemSelector>> samplers,
+                           std::vector<std::shared_ptr<ItemSelector>> removers,
+                           int64_t max_size, int32_t max_times_sampled,
+                           double samples_per_insert,
+                           int64_t min_size_to_sample, double min_diff,
+                           double max_diff)
+    : name_(std::move(name)),
+      max_size_(max_size),
+      max_times_sampled_(max_times_sampled),
+      samples_per_insert_(samples_per_insert),
+      min_size_to_sample_(min_size_to_sample),
+      min_diff_(min_diff),
+      max_diff_(max_diff) {
+  REVERB_CHECK(!samplers.empty());
+  REVERB_CHECK_EQ(samplers.size(), removers.size());
+  REVERB_CHECK_GT(min_size_to_sample, 0);
+  shards_.reserve(samplers.size());
+  for (size_t i = 0; i < samplers.size(); ++i) {
+    auto shard = std::make_unique<Shard>();
+    shard->sampler = std::move(samplers[i]);
+    shard->remover = std::move(removers[i]);
+    shards_.push_back(std::move(shard));
+  }
+}
+
+ShardedTable::Shard* ShardedTable::shard(Key key) const {
+  // Item keys either are sampled uniformly at random or carry a local counter
+  // in their low bits (see support/key_generators.h); in both cases the low
+  // bits on their own spread the load evenly across shards.
+  return shards_[key % shards_.size()].get();
+}
+
+absl::Status ShardedTable::InsertOrAssign(Item item, absl::Duration timeout) {
+  REVERB_RETURN_IF_ERROR(AwaitAdmission(/*is_insert=*/true, timeout));
+
+  const Key key = item.item.key();
+  const double priority = item.item.priority();
+  Shard* s = shard(key);
+
+  {
+    absl::MutexLock lock(&s->mu);
+
+    // If an item is already stored at `key` then we only update the priority.
+    if (s->data.contains(key)) {
+      REVERB_RETURN_IF_ERROR(s->sampler->Update(key, priority));
+      REVERB_RETURN_IF_ERROR(s->remover->Update(key, priority));
+      s->data[key]->item.set_priority(priority);
+      s->cached_weight.store(s->sampler->TotalWeight(),
+                             std::memory_order_relaxed);
+      return absl::OkStatus();
+    }
+
+    s->data[key] = std::make_shared<Item>(std::move(item));
+    REVERB_RETURN_IF_ERROR(s->sampler->Insert(key, priority));
+    REVERB_RETURN_IF_ERROR(s->remover->Insert(key, priority));
+    inserts_.fetch_add(1, std::memory_order_relaxed);
+
+    // Remove an item from this shard if the global capacity is exceeded. Note
+    // that the remover sees only the keys owned by the shard; with a hash
+    // partitioned key space this approximates the global removal order.
+    if (size_.fetch_add(1, std::memory_order_relaxed) + 1 > max_size_) {
+      REVERB_RETURN_IF_ERROR(DeleteItem(s, s->remover->Sample().key));
+    }
+
+    s->cached_weight.store(s->sampler->TotalWeight(),
+                           std::memory_order_relaxed);
+  }
+  NudgeAdmissionWaiters();
+  return absl::OkStatus();
+}
+
+absl::Status ShardedTable::Sample(SampledItem* sampled_item,
+                                  absl::Duration timeout) {
+  REVERB_RETURN_IF_ERROR(AwaitAdmission(/*is_insert=*/false, timeout));
+
+  const int64_t num_shards = shards_.size();
+
+  // Snapshot the per shard weights and pick a shard proportionally to its
+  // share of the total sampler weight. The weights may be slightly stale with
+  // respect to concurrent mutations; this is the same kind of staleness that
+  // a sampled item already exhibits by the time the caller observes it.
+  std::vector<double> weights(num_shards);
+  double total_weight = 0;
+  for (int64_t i = 0; i < num_shards; ++i) {
+    weights[i] = shards_[i]->cached_weight.load(std::memory_order_relaxed);
+    total_weight += weights[i];
+  }
+
+  double target;
+  {
+    absl::MutexLock lock(&shard_pick_mu_);
+    target = absl::Uniform<double>(shard_pick_bit_gen_, 0, 1);
+  }
+
+  Shard* s = nullptr;
+  double shard_share = 1;
+  if (total_weight > 0) {
+    double cumulative = 0;
+    for (int64_t i = 0; i < num_shards; ++i) {
+      cumulative += weights[i];
+      if (target * total_weight < cumulative || i == num_shards - 1) {
+        s = shards_[i].get();
+        shard_share = weights[i] / total_weight;
+        break;
+      }
+    }
+  } else {
+    // All weights are zero (e.g. all priorities are zero with a prioritized
+    // sampler); fall back to picking a shard proportionally to its size.
+    const int64_t size = size_.load(std::memory_order_relaxed);
+    if (size == 0) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Cannot sample from empty table ", name_, "."));
+    }
+    int64_t target_index = static_cast<int64_t>(target * size);
+    for (int64_t i = 0; i < num_shards; ++i) {
+      absl::MutexLock lock(&shards_[i]->mu);
+      const int64_t shard_size = shards_[i]->data.size();
+      if (target_index < shard_size || i == num_shards - 1) {
+        s = shards_[i].get();
+        shard_share = static_cast<double>(shard_size) /
+                      static_cast<double>(size);
+        break;
+      }
+      target_index -= shard_size;
+    }
+  }
+
+  {
+    absl::MutexLock lock(&s->mu);
+    if (s->data.empty()) {
+      // The shard was drained between the weight snapshot and acquiring the
+      // lock. Treat it the same way as losing a rate limiter race.
+      return absl::FailedPreconditionError(absl::StrCat(
+          "Selected shard of table ", name_,
+          " was emptied by concurrent operations; please retry the sample."));
+    }
+
+    const ItemSelector::KeyWithProbability sample = s->sampler->Sample();
+    std::shared_ptr<Item>& item = s->data[sample.key];
+    item->item.set_times_sampled(item->item.times_sampled() + 1);
+    samples_.fetch_add(1, std::memory_order_relaxed);
+
+    *sampled_item = {
+        /*ref=*/item,
+        /*probability=*/sample.probability * shard_share,
+        /*table_size=*/size(),
+        /*priority=*/item->item.priority(),
+        /*times_sampled=*/item->item.times_sampled(),
+        /*rate_limited=*/false,
+    };
+
+    if (max_times_sampled_ > 0 &&
+        item->item.times_sampled() >= max_times_sampled_) {
+      REVERB_RETURN_IF_ERROR(DeleteItem(s, sample.key));
+      s->cached_weight.store(s->sampler->TotalWeight(),
+                             std::memory_order_relaxed);
+    }
+  }
+  NudgeAdmissionWaiters();
+  return absl::OkStatus();
+}
+
+absl::Status ShardedTable::MutateItems(
+    absl::Span<const KeyWithPriority> updates, absl::Span<const Key> deletes) {
+  // Group the operations by shard so each shard mutex is acquired at most
+  // twice (once for deletes, once for updates) per call.
+  std::vector<std::vector<Key>> deletes_per_shard(shards_.size());
+  std::vector<std::vector<const KeyWithPriority*>> updates_per_shard(
+      shards_.size());
+  for (const Key& key : deletes) {
+    deletes_per_shard[key % shards_.size()].push_back(key);
+  }
+  for (const KeyWithPriority& update : updates) {
+    updates_per_shard[update.key() % shards_.size()].push_back(&update);
+  }
+
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (deletes_per_shard[i].empty() && updates_per_shard[i].empty()) {
+      continue;
+    }
+    Shard* s = shards_[i].get();
+    absl::MutexLock lock(&s->mu);
+    for (const Key& key : deletes_per_shard[i]) {
+      REVERB_RETURN_IF_ERROR(DeleteItem(s, key));
+    }
+    for (const KeyWithPriority* update : updates_per_shard[i]) {
+      auto it = s->data.find(update->key());
+      if (it == s->data.end()) continue;
+      REVERB_RETURN_IF_ERROR(
+          s->sampler->Update(update->key(), update->priority()));
+      REVERB_RETURN_IF_ERROR(
+          s->remover->Update(update->key(), update->priority()));
+      it->second->item.set_priority(update->priority());
+    }
+    s->cached_weight.store(s->sampler->TotalWeight(),
+                           std::memory_order_relaxed);
+  }
+  NudgeAdmissionWaiters();
+  return absl::OkStatus();
+}
+
+absl::Status ShardedTable::DeleteItem(Shard* shard, Key key) {
+  auto it = shard->data.find(key);
+  if (it == shard->data.end()) return absl::OkStatus();
+
+  shard->data.erase(it);
+  size_.fetch_sub(1, std::memory_order_relaxed);
+  deletes_.fetch_add(1, std::memory_order_relaxed);
+
+  REVERB_RETURN_IF_ERROR(shard->sampler->Delete(key));
+  REVERB_RETURN_IF_ERROR(shard->remover->Delete(key));
+  shard->cached_weight.store(shard->sampler->TotalWeight(),
+                             std::memory_order_relaxed);
+  return absl::OkStatus();
+}
+
+absl::Status ShardedTable::AwaitAdmission(bool is_insert,
+                                          absl::Duration timeout) {
+  if (is_insert ? CanInsert(1) : CanSample(1)) return absl::OkStatus();
+
+  struct WaitArg {
+    const ShardedTable* table;
+    bool is_insert;
+  } arg = {this, is_insert};
+  const absl::Condition admitted(
+      +[](WaitArg* arg) {
+        return arg->is_insert ? arg->table->CanInsert(1)
+                              : arg->table->CanSample(1);
+      },
+      &arg);
+
+  admission_waiters_.fetch_add(1, std::memory_order_relaxed);
+  absl::MutexLock lock(&admission_mu_);
+  const bool ok = admission_mu_.AwaitWithTimeout(admitted, timeout);
+  admission_waiters_.fetch_sub(1, std::memory_order_relaxed);
+  return ok ? absl::OkStatus() : errors::RateLimiterTimeout();
+}
+
+void ShardedTable::NudgeAdmissionWaiters() const {
+  if (admission_waiters_.load(std::memory_order_relaxed) == 0) return;
+  // Acquiring and releasing the mutex makes blocked waiters re-evaluate their
+  // admission conditions against the updated counters.
+  absl::MutexLock lock(&admission_mu_);
+}
+
+double ShardedTable::diff() const {
+  return inserts_.load(std::memory_order_relaxed) * samples_per_insert_ -
+         samples_.load(std::memory_order_relaxed);
+}
+
+bool ShardedTable::CanSample(int num_samples) const {
+  REVERB_CHECK_GT(num_samples, 0);
+  if (inserts_.load(std::memory_order_relaxed) -
+          deletes_.load(std::memory_order_relaxed) <
+      min_size_to_sample_) {
+    return false;
+  }
+  return diff() - num_samples >= min_diff_;
+}
+
+bool ShardedTable::CanInsert(int num_inserts) const {
+  REVERB_CHECK_GT(num_inserts, 0);
+  // Until the min size is reached inserts are free to progress.
+  if (inserts_.load(std::memory_order_relaxed) + num_inserts -
+          deletes_.load(std::memory_order_relaxed) <=
+      min_size_to_sample_) {
+    return true;
+  }
+  return diff() + num_inserts * samples_per_insert_ <= max_diff_;
+}
+
+bool ShardedTable::Get(Key key, Item* item) {
+  Shard* s = shard(key);
+  absl::MutexLock lock(&s->mu);
+  auto it = s->data.find(key);
+  if (it != s->data.end()) {
+    *item = *it->second;
+    return true;
+  }
+  return false;
+}
+
+std::vector<ShardedTable::Item> ShardedTable::Copy() const {
+  std::vector<Item> items;
+  items.reserve(size());
+  for (const auto& shard : shards_) {
+    absl::MutexLock lock(&shard->mu);
+    for (const auto& entry : shard->data) {
+      items.push_back(*entry.second);
+    }
+  }
+  return items;
+}
+
+absl::Status ShardedTable::Reset() {
+  for (const auto& shard : shards_) {
+    absl::MutexLock lock(&shard->mu);
+    shard->sampler->Clear();
+    shard->remover->Clear();
+    shard->data.clear();
+    shard->cached_weight.store(0, std::memory_order_relaxed);
+  }
+  size_.store(0, std::memory_order_relaxed);
+  inserts_.store(0, std::memory_order_relaxed);
+  samples_.store(0, std::memory_order_relaxed);
+  deletes_.store(0, std::memory_order_relaxed);
+  NudgeAdmissionWaiters();
+  return absl::OkStatus();
+}
+
+int64_t ShardedTable::size() const {
+  return size_.load(std::memory_order_relaxed);
+}
+
+std::string ShardedTable::DebugString() const {
+  return absl::StrCat("ShardedTable(name=", name_,
+                      ", num_shards=", shards_.size(),
+                      ", size=", size(), ", max_size=", max_size_, ")");
+}
+
+}  // namespace reverb
+}  // namespace deepmind
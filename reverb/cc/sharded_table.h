@@ -0,0 +1,214 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SHARDED_TABLE_H_
+#define REVERB_CC_SHARDED_TABLE_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include "absl/base/thread_annotations.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/table.h"
+
+namespace deepmind {
+namespace reverb {
+
+// A `ShardedTable` stores `TableItem` objects just like `Table` but partitions
+// the key space across a fixed number of internal shards, each protected by
+// its own mutex and backed by its own sampler and remover. Operations on
+// unrelated keys therefore proceed in parallel instead of serializing behind a
+// single table-wide mutex.
+//
+// Sampling first picks a shard with probability proportional to the total
+// weight of the shard's sampler (see `ItemSelector::TotalWeight`) and then
+// samples within that shard, so the overall sampling distribution matches the
+// one produced by an unsharded table with the same selector type.
+//
+// Rate limiter style accounting (inserts, samples, deletes) is kept global
+// using atomic counters so that admission decisions reflect the state of the
+// whole table rather than a single shard. As with `Table`, `InsertOrAssign`
+// and `Sample` block until the counters admit the operation or the timeout
+// expires; `CanInsert`/`CanSample` remain available as non blocking probes.
+//
+// `ShardedTable` is deliberately a standalone class rather than a `Table`
+// subtype or mode: `Table` is a concrete (non virtual) type and its gRPC
+// streaming, table worker queue, extension and checkpointing plumbing all
+// assume the single mutex layout, so serving a sharded table through `Server`
+// first requires extracting a virtual interface from `Table`. Until that
+// happens this class only supports in-process replay.
+//
+// Capacity is enforced globally but evictions are performed with the remover
+// of the shard that received the insert. With a hash partitioned key space the
+// shards observe statistically identical streams, so the resulting global
+// eviction order closely follows the single remover behaviour.
+class ShardedTable {
+ public:
+  using Key = ItemSelector::Key;
+  using Item = TableItem;
+  using SampledItem = Table::SampledItem;
+
+  // `name` is the name of the table. Must be unique within server.
+  // `samplers` and `removers` each hold one selector per shard; their (equal)
+  //   length defines the number of shards. All selectors within a vector must
+  //   be of the same type for the sampling distribution to be well defined.
+  // `max_size` limits the total number of items across all shards.
+  // `max_times_sampled` is the maximum number of times we allow for an item to
+  //   be sampled before it is deleted. A value <= 0 means no limit.
+  // `samples_per_insert`, `min_size_to_sample`, `min_diff` and `max_diff`
+  //   mirror the `RateLimiter` constructor arguments and control the global
+  //   (non-blocking) admission checks.
+  ShardedTable(std::string name,
+               std::vector<std::shared_ptr<ItemSelector>> samplers,
+               std::vector<std::shared_ptr<ItemSelector>> removers,
+               int64_t max_size, int32_t max_times_sampled,
+               double samples_per_insert, int64_t min_size_to_sample,
+               double min_diff, double max_diff);
+
+  // Attempts to insert an item, or updates the priority if the key already
+  // exists. Only the shard owning the key is locked. If the insert grows the
+  // table beyond `max_size` then an item is removed using the shard's remover.
+  // Blocks until the global counters admit the insert; if admission cannot be
+  // acquired before `timeout` expires then `errors::RateLimiterTimeout()` is
+  // returned and no action is taken.
+  absl::Status InsertOrAssign(Item item,
+                              absl::Duration timeout = absl::InfiniteDuration());
+
+  // Samples an item from the table. Blocks until the global counters admit
+  // the sample; if admission cannot be acquired before `timeout` expires then
+  // `errors::RateLimiterTimeout()` is returned and no action is taken. If the
+  // item has reached `max_times_sampled` it is deleted before returning.
+  absl::Status Sample(SampledItem* item,
+                      absl::Duration timeout = absl::InfiniteDuration());
+
+  // Updates priorities and/or deletes items. Operations are grouped by shard
+  // so each shard mutex is acquired at most once per group. Non existing keys
+  // are ignored in the same way as `Table::MutateItems`.
+  absl::Status MutateItems(absl::Span<const KeyWithPriority> updates,
+                           absl::Span<const Key> deletes);
+
+  // Returns true iff the current state would allow for `num_samples` to be
+  // sampled. Dies if `num_samples` is < 1.
+  bool CanSample(int num_samples) const;
+
+  // Returns true iff the current state would allow for `num_inserts` to be
+  // inserted. Dies if `num_inserts` is < 1.
+  bool CanInsert(int num_inserts) const;
+
+  // Lookup a single item. Returns true if found, else false.
+  bool Get(Key key, Item* item);
+
+  // Copies all items currently in the table.
+  std::vector<Item> Copy() const;
+
+  // Removes all items and resets the global counters to their initial state.
+  absl::Status Reset();
+
+  // Total number of items across all shards.
+  int64_t size() const;
+
+  const std::string& name() const { return name_; }
+
+  int num_shards() const { return static_cast<int>(shards_.size()); }
+
+  // Returns a summary string description.
+  std::string DebugString() const;
+
+ private:
+  struct Shard {
+    mutable absl::Mutex mu;
+
+    // Distribution used for sampling within the shard.
+    std::shared_ptr<ItemSelector> sampler ABSL_GUARDED_BY(mu);
+
+    // Distribution used for removing within the shard.
+    std::shared_ptr<ItemSelector> remover ABSL_GUARDED_BY(mu);
+
+    // Bijection of key to item for the keys owned by the shard.
+    internal::flat_hash_map<Key, std::shared_ptr<Item>> data
+        ABSL_GUARDED_BY(mu);
+
+    // Cache of `sampler->TotalWeight()` refreshed after every mutation so
+    // shard selection can read it without acquiring `mu`.
+    std::atomic<double> cached_weight{0};
+
+    // Used for sampling within the shard; guarded by the shard mutex.
+    absl::BitGen bit_gen ABSL_GUARDED_BY(mu);
+  };
+
+  // Shard that owns `key`.
+  Shard* shard(Key key) const;
+
+  // Deletes the item associated with `key` from the shard. The shard mutex
+  // must be held. Ignores the key if it cannot be found.
+  absl::Status DeleteItem(Shard* shard, Key key)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard->mu);
+
+  // Blocks until `CanInsert(1)` (respectively `CanSample(1)`) holds or
+  // `timeout` expires, in which case `errors::RateLimiterTimeout()` is
+  // returned. Must not be called with a shard mutex held.
+  absl::Status AwaitAdmission(bool is_insert, absl::Duration timeout);
+
+  // Makes threads blocked in `AwaitAdmission` re-evaluate their admission
+  // condition. Called by mutators after updating the global counters; a no-op
+  // when nobody is waiting.
+  void NudgeAdmissionWaiters() const;
+
+  // Current rate limiter cursor, see `RateLimiter` for details.
+  double diff() const;
+
+  const std::string name_;
+  const int64_t max_size_;
+  const int32_t max_times_sampled_;
+
+  // Rate limiter configuration, see `RateLimiter` for documentation.
+  const double samples_per_insert_;
+  const int64_t min_size_to_sample_;
+  const double min_diff_;
+  const double max_diff_;
+
+  // Global rate limiter style counters, updated with relaxed atomics on the
+  // shard locked fast paths.
+  std::atomic<int64_t> size_{0};
+  std::atomic<int64_t> inserts_{0};
+  std::atomic<int64_t> samples_{0};
+  std::atomic<int64_t> deletes_{0};
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  // Used for picking a shard when sampling; protected by its own mutex since
+  // samples for different shards may be requested concurrently.
+  mutable absl::Mutex shard_pick_mu_;
+  absl::BitGen shard_pick_bit_gen_ ABSL_GUARDED_BY(shard_pick_mu_);
+
+  // Blocked admission waiters park on this mutex; `admission_waiters_` lets
+  // the mutator fast paths skip touching it when nobody is waiting.
+  mutable absl::Mutex admission_mu_;
+  std::atomic<int64_t> admission_waiters_{0};
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SHARDED_TABLE_H_
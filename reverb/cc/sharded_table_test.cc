@@ -0,0 +1,248 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/sharded_table.h"
+
+#include <cfloat>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include "absl/status/status.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/errors.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/prioritized.h"
+#include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr int kNumShards = 4;
+
+MATCHER_P(HasItemKey, key, "") { return arg.item.key() == key; }
+
+TableItem MakeItem(uint64_t key, double priority) {
+  TableItem item;
+  auto data = testing::MakeChunkData(
+      key * 100, testing::MakeSequenceRange(key * 100, 0, 1));
+  item.chunks.push_back(std::make_shared<ChunkStore::Chunk>(data));
+  item.item = testing::MakePrioritizedItem(key, priority, {data});
+  return item;
+}
+
+std::unique_ptr<ShardedTable> MakeUniformShardedTable(
+    const std::string& name, int64_t max_size = 1000,
+    int32_t max_times_sampled = 0) {
+  std::vector<std::shared_ptr<ItemSelector>> samplers;
+  std::vector<std::shared_ptr<ItemSelector>> removers;
+  for (int i = 0; i < kNumShards; i++) {
+    samplers.push_back(std::make_shared<UniformSelector>());
+    removers.push_back(std::make_shared<FifoSelector>());
+  }
+  return std::make_unique<ShardedTable>(
+      name, std::move(samplers), std::move(removers), max_size,
+      max_times_sampled, /*samples_per_insert=*/1.0, /*min_size_to_sample=*/1,
+      /*min_diff=*/-DBL_MAX, /*max_diff=*/DBL_MAX);
+}
+
+TEST(ShardedTableTest, InsertedItemsCanBeLookedUp) {
+  auto table = MakeUniformShardedTable("sharded");
+  for (uint64_t key = 1; key <= 100; key++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+  }
+  EXPECT_EQ(table->size(), 100);
+
+  ShardedTable::Item item;
+  EXPECT_TRUE(table->Get(42, &item));
+  EXPECT_THAT(item, HasItemKey(42));
+  EXPECT_FALSE(table->Get(101, &item));
+}
+
+TEST(ShardedTableTest, InsertOrAssignUpdatesExistingItem) {
+  auto table = MakeUniformShardedTable("sharded");
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(3, 123)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(3, 456)));
+  EXPECT_EQ(table->size(), 1);
+
+  ShardedTable::Item item;
+  EXPECT_TRUE(table->Get(3, &item));
+  EXPECT_EQ(item.item.priority(), 456);
+}
+
+TEST(ShardedTableTest, CapacityIsEnforcedGlobally) {
+  auto table = MakeUniformShardedTable("sharded", /*max_size=*/10);
+  for (uint64_t key = 1; key <= 100; key++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+    EXPECT_LE(table->size(), 10);
+  }
+  EXPECT_EQ(table->size(), 10);
+}
+
+TEST(ShardedTableTest, SampleObservesAllShards) {
+  auto table = MakeUniformShardedTable("sharded");
+  for (uint64_t key = 1; key <= 2 * kNumShards; key++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+  }
+
+  std::vector<int64_t> counts(2 * kNumShards + 1);
+  for (int i = 0; i < 5000; i++) {
+    ShardedTable::SampledItem sample;
+    REVERB_EXPECT_OK(table->Sample(&sample));
+    counts[sample.ref->item.key()]++;
+  }
+  for (uint64_t key = 1; key <= 2 * kNumShards; key++) {
+    EXPECT_GT(counts[key], 0) << "Key " << key << " was never sampled.";
+  }
+}
+
+TEST(ShardedTableTest, PrioritizedSamplingFollowsShardWeights) {
+  std::vector<std::shared_ptr<ItemSelector>> samplers;
+  std::vector<std::shared_ptr<ItemSelector>> removers;
+  for (int i = 0; i < kNumShards; i++) {
+    samplers.push_back(std::make_shared<PrioritizedSelector>(1.0));
+    removers.push_back(std::make_shared<FifoSelector>());
+  }
+  ShardedTable table("sharded", std::move(samplers), std::move(removers),
+                     /*max_size=*/1000, /*max_times_sampled=*/0,
+                     /*samples_per_insert=*/1.0, /*min_size_to_sample=*/1,
+                     /*min_diff=*/-DBL_MAX, /*max_diff=*/DBL_MAX);
+
+  // One item with priority 9 and three items with priority 1; the former
+  // should be sampled roughly 75% of the time regardless of which shards the
+  // items hash into.
+  REVERB_EXPECT_OK(table.InsertOrAssign(MakeItem(1, 9)));
+  for (uint64_t key = 2; key <= 4; key++) {
+    REVERB_EXPECT_OK(table.InsertOrAssign(MakeItem(key, 1)));
+  }
+
+  const int kSamples = 10000;
+  int64_t high_priority_count = 0;
+  for (int i = 0; i < kSamples; i++) {
+    ShardedTable::SampledItem sample;
+    REVERB_EXPECT_OK(table.Sample(&sample));
+    if (sample.ref->item.key() == 1) {
+      high_priority_count++;
+      EXPECT_NEAR(sample.probability, 0.75, 0.01);
+    }
+  }
+  EXPECT_NEAR(static_cast<double>(high_priority_count) / kSamples, 0.75, 0.05);
+}
+
+TEST(ShardedTableTest, MaxTimesSampledDeletesItem) {
+  auto table = MakeUniformShardedTable("sharded", /*max_size=*/1000,
+                                       /*max_times_sampled=*/2);
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+
+  ShardedTable::SampledItem sample;
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  EXPECT_EQ(sample.times_sampled, 2);
+  EXPECT_EQ(table->size(), 0);
+}
+
+TEST(ShardedTableTest, MutateItemsUpdatesAndDeletes) {
+  auto table = MakeUniformShardedTable("sharded");
+  for (uint64_t key = 1; key <= 10; key++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+  }
+
+  KeyWithPriority update;
+  update.set_key(4);
+  update.set_priority(9);
+  REVERB_EXPECT_OK(table->MutateItems({update}, {1, 2, 3}));
+  EXPECT_EQ(table->size(), 7);
+
+  ShardedTable::Item item;
+  EXPECT_TRUE(table->Get(4, &item));
+  EXPECT_EQ(item.item.priority(), 9);
+  EXPECT_FALSE(table->Get(1, &item));
+
+  // Mutating missing keys is a no-op.
+  REVERB_EXPECT_OK(table->MutateItems({update}, {1}));
+}
+
+std::unique_ptr<ShardedTable> MakeRateLimitedShardedTable(
+    const std::string& name) {
+  std::vector<std::shared_ptr<ItemSelector>> samplers;
+  std::vector<std::shared_ptr<ItemSelector>> removers;
+  for (int i = 0; i < kNumShards; i++) {
+    samplers.push_back(std::make_shared<UniformSelector>());
+    removers.push_back(std::make_shared<FifoSelector>());
+  }
+  return std::make_unique<ShardedTable>(
+      name, std::move(samplers), std::move(removers),
+      /*max_size=*/1000, /*max_times_sampled=*/0,
+      /*samples_per_insert=*/1.0, /*min_size_to_sample=*/1,
+      /*min_diff=*/0, /*max_diff=*/DBL_MAX);
+}
+
+TEST(ShardedTableTest, SampleIsRateLimited) {
+  auto table = MakeRateLimitedShardedTable("sharded");
+
+  EXPECT_FALSE(table->CanSample(1));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  EXPECT_TRUE(table->CanSample(1));
+  EXPECT_FALSE(table->CanSample(2));
+
+  ShardedTable::SampledItem sample;
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  EXPECT_FALSE(table->CanSample(1));
+  EXPECT_TRUE(errors::IsRateLimiterTimeout(
+      table->Sample(&sample, absl::Milliseconds(10))));
+}
+
+TEST(ShardedTableTest, BlockedSampleIsReleasedByInsert) {
+  auto table = MakeRateLimitedShardedTable("sharded");
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+
+  ShardedTable::SampledItem sample;
+  REVERB_EXPECT_OK(table->Sample(&sample));
+
+  // The limiter now blocks sampling until another insert arrives.
+  absl::Notification done;
+  auto thread = internal::StartThread("sample", [&] {
+    ShardedTable::SampledItem blocked_sample;
+    REVERB_EXPECT_OK(table->Sample(&blocked_sample));
+    done.Notify();
+  });
+  EXPECT_FALSE(done.WaitForNotificationWithTimeout(absl::Milliseconds(50)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 1)));
+  done.WaitForNotification();
+  thread = nullptr;  // Joins the thread.
+}
+
+TEST(ShardedTableTest, ResetClearsAllShards) {
+  auto table = MakeUniformShardedTable("sharded");
+  for (uint64_t key = 1; key <= 50; key++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+  }
+  REVERB_EXPECT_OK(table->Reset());
+  EXPECT_EQ(table->size(), 0);
+  EXPECT_THAT(table->Copy(), ::testing::IsEmpty());
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
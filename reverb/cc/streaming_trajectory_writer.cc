@@ -26,6 +26,8 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "reverb/cc/chunker.h"
@@ -39,8 +41,13 @@
 #include "reverb/cc/support/grpc_util.h"
 #include "reverb/cc/support/key_generators.h"
 #include "reverb/cc/support/signature.h"
+#include "reverb/cc/support/tf_util.h"
 #include "reverb/cc/trajectory_writer.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/platform/env.h"
 
 namespace deepmind::reverb {
 namespace {
@@ -51,6 +58,16 @@ bool IsTransientError(const absl::Status& status) {
          absl::IsCancelled(status);
 }
 
+constexpr absl::Duration kQueryReceivedChunksTimeout = absl::Seconds(10);
+
+// Spool files are sealed (and become eligible for replay) once they reach
+// this size.
+constexpr int64_t kSpoolFileTargetBytes = 64 * 1024 * 1024;  // 64MB.
+
+// Backoff window of the spool replay worker between failed replay attempts.
+constexpr absl::Duration kSpoolReplayMinBackoff = absl::Seconds(1);
+constexpr absl::Duration kSpoolReplayMaxBackoff = absl::Seconds(30);
+
 // Clears the vector on destruction unless `set_clear(false)` is called. Can be
 // used to ensure vectors returned via argument pointers only hold values if the
 // function succeeds entirely.
@@ -79,6 +96,7 @@ StreamingTrajectoryWriter::StreamingTrajectoryWriter(
       options_(options),
       episode_id_(key_generator_.Generate()),
       episode_step_(0),
+      writer_id_(key_generator_.Generate()),
       unrecoverable_error_(absl::OkStatus()),
       recoverable_error_(absl::OkStatus()) {
   REVERB_CHECK(options_.chunker_options != nullptr);
@@ -87,6 +105,12 @@ StreamingTrajectoryWriter::StreamingTrajectoryWriter(
 }
 
 StreamingTrajectoryWriter::~StreamingTrajectoryWriter() {
+  {
+    absl::MutexLock lock(&mutex_);
+    spool_shutdown_ = true;
+  }
+  spool_replay_worker_ = nullptr;  // Join thread.
+
   // Make sure to flush the stream on destruction.
   if (stream_) {
     stream_->WritesDone();
@@ -237,6 +261,19 @@ absl::Status StreamingTrajectoryWriter::EndEpisode(bool clear_buffers,
   episode_id_ = key_generator_.Generate();
   episode_step_ = 0;
 
+  {
+    // Leave spool mode at an episode boundary once the replay worker has
+    // drained the spool, so that no item sent on the stream references a
+    // chunk that is still on disk.
+    absl::MutexLock lock(&mutex_);
+    if (spooling_ && spool_connected_ && spool_active_file_.empty() &&
+        spool_sealed_files_.empty()) {
+      spooling_ = false;
+      REVERB_LOG(REVERB_INFO)
+          << "Insert spool drained; resuming direct streaming.";
+    }
+  }
+
   if (clear_buffers) {
     streamed_chunk_keys_.clear();
     recoverable_error_ = absl::OkStatus();
@@ -278,9 +315,13 @@ absl::Status StreamingTrajectoryWriter::StreamChunks(
   // We store requests in a vector as we may shard chunk insertions over several
   // requests to improve performance.
   std::vector<InsertStreamRequest> requests(1);
+  requests.back().set_writer_id(writer_id_);
 
   std::vector<uint64_t> chunk_keys;
 
+  // Chunk keys carried by each request, parallel to `requests`.
+  std::vector<std::vector<uint64_t>> request_chunk_keys(1);
+
   for (const std::shared_ptr<CellRef>& ref : refs) {
     // Skip this chunk if it's not ready yet.
     if (!ref->IsReady()) continue;
@@ -301,6 +342,7 @@ absl::Status StreamingTrajectoryWriter::StreamChunks(
     }
 
     chunk_keys.push_back(chunk->chunk_key());
+    request_chunk_keys.back().push_back(chunk->chunk_key());
     // Pass ownership of the chunk to the request proto.
     requests.back().mutable_chunks()->AddAllocated(
         const_cast<ChunkData*>(chunk.release()));
@@ -310,23 +352,31 @@ absl::Status StreamingTrajectoryWriter::StreamChunks(
     if (requests.back().ByteSizeLong() >=
         TrajectoryWriter::kMaxRequestSizeBytes) {
       requests.emplace_back();
+      requests.back().set_writer_id(writer_id_);
+      request_chunk_keys.emplace_back();
     }
   }
 
   if (chunk_keys.empty()) return absl::OkStatus();
 
-  // Send all requests.
-  for (const InsertStreamRequest& request : requests) {
-    REVERB_RETURN_IF_ERROR(WriteStream(request));
+  // Send all requests. The keys of a request are recorded as streamed as soon
+  // as its write succeeds; if a later write fails there is no guarantee that
+  // the earlier writes reached the server so the resume path (see
+  // `TryResumeStream`) checks `streamed_chunk_keys_` against the server's
+  // writer chunk cache.
+  for (int i = 0; i < requests.size(); ++i) {
+    REVERB_RETURN_IF_ERROR(WriteStream(requests[i]));
+    streamed_chunk_keys_.insert(request_chunk_keys[i].begin(),
+                                request_chunk_keys[i].end());
   }
 
-  streamed_chunk_keys_.insert(chunk_keys.begin(), chunk_keys.end());
-
   return absl::OkStatus();
 }
 
 absl::Status StreamingTrajectoryWriter::SendItem(PrioritizedItem item) {
   InsertStreamRequest request;
+  request.set_writer_id(writer_id_);
+  request.add_item_sequence_numbers(next_sequence_number_++);
 
   *request.add_items() = std::move(item);
 
@@ -337,58 +387,345 @@ absl::Status StreamingTrajectoryWriter::SendItem(PrioritizedItem item) {
     request.add_keep_chunk_keys(keep_key);
   }
 
+  // Mark the item as in flight and retain a copy of the request until the
+  // server acknowledges the item so that it can be retransmitted if the
+  // stream breaks.
+  {
+    absl::MutexLock lock(&mutex_);
+    in_flight_items_.insert(request.items(0).key());
+    unacked_item_requests_.push_back(request);
+  }
+
   return WriteStream(request);
 }
 
 absl::Status StreamingTrajectoryWriter::WriteStream(
     const InsertStreamRequest& request) {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (spooling_) {
+      return SpoolRequest(request);
+    }
+  }
+
   grpc::WriteOptions options;
   options.set_no_compression();
 
-  // If this request contains items, mark them as "in-flight".
-  if (request.items_size() > 0) {
+  if (stream_->Write(request, options)) {
+    return absl::OkStatus();
+  }
+
+  absl::Status streaming_status = FromGrpcStatus(stream_->Finish());
+
+  // Join the confirmation thread.
+  item_confirmation_worker_ = nullptr;
+
+  if (IsTransientError(streaming_status)) {
+    SetContextAndCreateStream();
+
+    // If the server still holds all chunks belonging to this episode then the
+    // failed write and all unacknowledged items can simply be replayed on the
+    // new stream.
+    if (TryResumeStream(request)) {
+      return absl::OkStatus();
+    }
+
+    // Resuming was not possible so the episode is corrupt. No confirmations
+    // will arrive for items sent on the broken stream.
+    {
+      absl::MutexLock lock(&mutex_);
+      in_flight_items_.clear();
+      unacked_item_requests_.clear();
+      // The chunks streamed earlier in this episode are gone so the episode
+      // cannot be salvaged, but with a spool configured the episodes that
+      // follow are written to disk instead of racing the broken stream.
+      if (!options_.insert_spool_dir.empty()) {
+        StartSpooling();
+      }
+    }
+    recoverable_error_ = absl::DataLossError(absl::StrCat(
+        "Stream interrupted with error: ", streaming_status.message()));
+    return recoverable_error_;
+  }
+
+  {
     absl::MutexLock lock(&mutex_);
-    for (auto& item : request.items()) {
-      in_flight_items_.insert(item.key());
+    in_flight_items_.clear();
+    unacked_item_requests_.clear();
+  }
+  unrecoverable_error_ = streaming_status;
+  return unrecoverable_error_;
+}
+
+bool StreamingTrajectoryWriter::TryResumeStream(
+    const InsertStreamRequest& failed_request) {
+  // A failed write provides no information about the fate of the requests
+  // written before it, so resuming is only safe if the server still caches
+  // every chunk of the episode (keyed by `writer_id_`, see
+  // `QueryReceivedChunks`).
+  if (!streamed_chunk_keys_.empty()) {
+    QueryReceivedChunksRequest query;
+    query.set_writer_id(writer_id_);
+    for (uint64_t key : streamed_chunk_keys_) {
+      query.add_chunk_keys(key);
+    }
+
+    grpc::ClientContext context;
+    context.set_deadline(
+        absl::ToChronoTime(absl::Now() + kQueryReceivedChunksTimeout));
+    QueryReceivedChunksResponse response;
+    if (!stub_->QueryReceivedChunks(&context, query, &response).ok()) {
+      return false;
+    }
+    if (response.chunk_keys_size() != streamed_chunk_keys_.size()) {
+      return false;
+    }
+  }
+
+  grpc::WriteOptions options;
+  options.set_no_compression();
+
+  // Retransmit items the server never acknowledged. Tables key items on the
+  // item key so items that were received but not confirmed before the stream
+  // broke are simply overwritten with identical content. The keep keys are
+  // refreshed since the snapshots taken when the items were first sent may
+  // not cover all chunks the new stream was seeded with.
+  absl::MutexLock lock(&mutex_);
+  for (InsertStreamRequest& request : unacked_item_requests_) {
+    request.clear_keep_chunk_keys();
+    for (uint64_t keep_key : streamed_chunk_keys_) {
+      request.add_keep_chunk_keys(keep_key);
+    }
+    if (!stream_->Write(request, options)) {
+      return false;
+    }
+  }
+
+  // Finally replay the write that failed. If it carried an item it is part of
+  // `unacked_item_requests_` and has already been retransmitted above.
+  if (failed_request.items_size() > 0) {
+    return true;
+  }
+  return stream_->Write(failed_request, options);
+}
+
+void StreamingTrajectoryWriter::StartSpooling() {
+  spooling_ = true;
+  spool_connected_ = false;
+  REVERB_LOG(REVERB_WARNING)
+      << "Insert stream could not be resumed; spooling subsequent requests "
+         "to '"
+      << options_.insert_spool_dir << "'.";
+  if (spool_replay_worker_ == nullptr) {
+    spool_replay_worker_ = internal::StartThread(
+        "StreamingTrajectoryWriter_SpoolReplayWorker",
+        [this]() { RunSpoolReplayWorker(); });
+  }
+}
+
+absl::Status StreamingTrajectoryWriter::SpoolRequest(
+    const InsertStreamRequest& request) {
+  // A spooled item counts as accepted: the replay worker delivers it once
+  // connectivity returns, so it must not hold up `Flush` and needs no copy
+  // for stream resumption.
+  if (request.items_size() > 0) {
+    in_flight_items_.erase(request.items(0).key());
+    for (auto it = unacked_item_requests_.begin();
+         it != unacked_item_requests_.end(); ++it) {
+      if (it->items(0).key() == request.items(0).key()) {
+        unacked_item_requests_.erase(it);
+        break;
+      }
     }
   }
 
-  if (!stream_->Write(request, options)) {
-    // We won't get a confirmation these items.
-    if (request.items_size() > 0) {
+  auto* env = tensorflow::Env::Default();
+  if (spool_active_file_.empty()) {
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        env->RecursivelyCreateDir(options_.insert_spool_dir)));
+    spool_active_file_ = tensorflow::io::JoinPath(
+        options_.insert_spool_dir,
+        absl::StrCat("spool-", writer_id_, "-", spool_file_sequence_++,
+                     ".tfrecord"));
+    spool_active_bytes_ = 0;
+  }
+
+  // The file is opened per request rather than held open so that the replay
+  // worker can seal and read it without coordinating on a live writer; the
+  // open is cheap relative to the (chunk carrying) requests spooled here.
+  std::unique_ptr<tensorflow::WritableFile> file;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      env->NewAppendableFile(spool_active_file_, &file)));
+  {
+    tensorflow::io::RecordWriter record_writer(file.get());
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        record_writer.WriteRecord(request.SerializeAsString())));
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(record_writer.Close()));
+  }
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(file->Close()));
+
+  const int64_t record_bytes = request.ByteSizeLong();
+  spool_active_bytes_ += record_bytes;
+  spool_total_bytes_ += record_bytes;
+
+  if (spool_active_bytes_ >= kSpoolFileTargetBytes) {
+    spool_sealed_files_.emplace_back(std::move(spool_active_file_),
+                                     spool_active_bytes_);
+    spool_active_file_.clear();
+    spool_active_bytes_ = 0;
+  }
+
+  // Enforce the ring bound by dropping the oldest sealed file. The loss is
+  // deliberate: the spool trades a bounded amount of the oldest data for a
+  // bounded disk footprint.
+  while (spool_total_bytes_ > options_.insert_spool_max_bytes &&
+         !spool_sealed_files_.empty()) {
+    auto& [path, bytes] = spool_sealed_files_.front();
+    REVERB_LOG(REVERB_WARNING)
+        << "Insert spool exceeds " << options_.insert_spool_max_bytes
+        << " bytes; dropping oldest spool file '" << path << "' (" << bytes
+        << " bytes of data lost).";
+    env->DeleteFile(path).IgnoreError();
+    spool_total_bytes_ -= bytes;
+    spool_sealed_files_.pop_front();
+  }
+
+  return absl::OkStatus();
+}
+
+void StreamingTrajectoryWriter::RunSpoolReplayWorker() {
+  absl::Duration backoff = kSpoolReplayMinBackoff;
+  while (true) {
+    std::vector<std::string> paths;
+    {
       absl::MutexLock lock(&mutex_);
-      for (auto& item : request.items()) {
-        in_flight_items_.erase(item.key());
+      auto wake = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) -> bool {
+        return spool_shutdown_ || !spool_sealed_files_.empty() ||
+               !spool_active_file_.empty();
+      };
+      mutex_.Await(absl::Condition(&wake));
+      if (spool_shutdown_) return;
+
+      // Seal the active file so it can be replayed; the writer starts a new
+      // one with its next spooled request.
+      if (!spool_active_file_.empty()) {
+        spool_sealed_files_.emplace_back(std::move(spool_active_file_),
+                                         spool_active_bytes_);
+        spool_active_file_.clear();
+        spool_active_bytes_ = 0;
+      }
+      paths.reserve(spool_sealed_files_.size());
+      for (const auto& [path, bytes] : spool_sealed_files_) {
+        paths.push_back(path);
       }
     }
 
-    // We can recover from transient errors as they only corrupt the current
-    // episode.
-    absl::Status streaming_status = FromGrpcStatus(stream_->Finish());
-
-    // Join the confirmation thread.
-    item_confirmation_worker_ = nullptr;
-
-    if (IsTransientError(streaming_status)) {
-      SetContextAndCreateStream();
-      recoverable_error_ = absl::DataLossError(absl::StrCat(
-          "Stream interrupted with error: ", streaming_status.message()));
-      return recoverable_error_;
-    } else {
-      unrecoverable_error_ = streaming_status;
-      return unrecoverable_error_;
+    absl::Status status = ReplaySpoolFiles(paths);
+    if (status.ok()) {
+      absl::MutexLock lock(&mutex_);
+      spool_connected_ = true;
+      for (size_t i = 0; i < paths.size(); i++) {
+        tensorflow::Env::Default()
+            ->DeleteFile(spool_sealed_files_.front().first)
+            .IgnoreError();
+        spool_total_bytes_ -= spool_sealed_files_.front().second;
+        spool_sealed_files_.pop_front();
+      }
+      REVERB_LOG(REVERB_INFO)
+          << "Replayed " << paths.size() << " insert spool file(s).";
+      backoff = kSpoolReplayMinBackoff;
+      continue;
     }
+
+    REVERB_LOG(REVERB_WARNING)
+        << "Replaying the insert spool failed (" << status.ToString()
+        << "); retrying in " << backoff << ".";
+    {
+      absl::MutexLock lock(&mutex_);
+      auto shutdown = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) -> bool {
+        return spool_shutdown_;
+      };
+      if (mutex_.AwaitWithTimeout(absl::Condition(&shutdown), backoff)) {
+        return;
+      }
+    }
+    backoff = std::min(backoff * 2, kSpoolReplayMaxBackoff);
   }
+}
 
-  return absl::OkStatus();
+absl::Status StreamingTrajectoryWriter::ReplaySpoolFiles(
+    const std::vector<std::string>& paths) {
+  grpc::ClientContext context;
+  std::unique_ptr<InsertStream> stream = stub_->InsertStream(&context);
+
+  grpc::WriteOptions options;
+  options.set_no_compression();
+
+  for (const std::string& path : paths) {
+    std::unique_ptr<tensorflow::RandomAccessFile> file;
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        tensorflow::Env::Default()->NewRandomAccessFile(path, &file)));
+    tensorflow::io::RecordReader reader(file.get());
+
+    InsertStreamRequest request;
+    tensorflow::uint64 offset = 0;
+    tensorflow::tstring record;
+    absl::Status read_status;
+    while ((read_status =
+                FromTensorflowStatus(reader.ReadRecord(&offset, &record)))
+               .ok()) {
+      if (!request.ParseFromArray(record.data(), record.size())) {
+        REVERB_LOG(REVERB_ERROR)
+            << "Skipping corrupt record in insert spool file '" << path
+            << "'.";
+        continue;
+      }
+      if (!stream->Write(request, options)) {
+        return FromGrpcStatus(stream->Finish());
+      }
+    }
+    if (!absl::IsOutOfRange(read_status)) {
+      // A torn trailing record (e.g. the process died mid append) ends the
+      // file; everything before it has been replayed.
+      REVERB_LOG(REVERB_WARNING)
+          << "Insert spool file '" << path
+          << "' ended with unreadable data: " << read_status.ToString();
+    }
+  }
+
+  stream->WritesDone();
+  InsertStreamResponse response;
+  while (stream->Read(&response)) {
+    response.Clear();
+  }
+  return FromGrpcStatus(stream->Finish());
 }
 
 void StreamingTrajectoryWriter::ProcessItemConfirmations() {
   InsertStreamResponse response;
   while (stream_->Read(&response)) {
     absl::MutexLock lock(&mutex_);
+
+    // Drop the retained copies of all items covered by the cumulative
+    // sequence number acknowledgement.
+    while (!unacked_item_requests_.empty() &&
+           unacked_item_requests_.front().item_sequence_numbers(0) <=
+               response.last_sequence_number()) {
+      unacked_item_requests_.pop_front();
+    }
+
     for (uint64_t key : response.keys()) {
       in_flight_items_.erase(key);
+
+      // Servers that predate sequence number acknowledgements only confirm
+      // item keys.
+      for (auto it = unacked_item_requests_.begin();
+           it != unacked_item_requests_.end(); ++it) {
+        if (it->items(0).key() == key) {
+          unacked_item_requests_.erase(it);
+          break;
+        }
+      }
     }
     response.Clear();
   }
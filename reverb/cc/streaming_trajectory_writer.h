@@ -17,8 +17,11 @@
 
 #include <stdint.h>
 
+#include <deque>
 #include <memory>
 #include <optional>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -54,13 +57,20 @@ namespace deepmind::reverb {
 // episodes may still pose problems on the reading side where the entire
 // trajectory must be kept in memory.
 //
-// The downside of using `StreamingTrajectoryWriter` is that it does not
-// gracefully recover from data loss. If streaming a chunk belonging to an
-// episode fails, the write call will not be retried. Instead, the entire
-// episode is considered corrupt and no priority items can be created until a
-// new episode is started. If an episode is corrupt, calls for adding additional
-// tensors or creating priority items will return an `absl::DataLossError`.
-// Callers should start a new episode when they observe the error.
+// Items are streamed without waiting for the previous item to be confirmed,
+// so an arbitrary number of items can be in flight at any point. Each item is
+// assigned a sequence number and the server acknowledges the highest confirmed
+// sequence number on its responses. If the stream breaks with a transient
+// error, a new stream is opened and the writer resumes from the last
+// acknowledged item: unacknowledged items are retransmitted and deduplicated
+// by the server (tables key items on the item key). Resuming is only possible
+// while the server still caches every chunk of the episode (see
+// `QueryReceivedChunks` in reverb_service.proto). If chunks have been lost
+// then the entire episode is considered corrupt and no priority items can be
+// created until a new episode is started. If an episode is corrupt, calls for
+// adding additional tensors or creating priority items will return an
+// `absl::DataLossError`. Callers should start a new episode when they observe
+// the error.
 //
 // This class is not thread-safe.
 //
@@ -129,11 +139,44 @@ class StreamingTrajectoryWriter : public ColumnWriter {
   // this method.
   absl::Status SendItem(PrioritizedItem item);
 
-  // Writes the requests provided in the argument to the stream. If writing
-  // fails, the current episode is considered corrupt, which is a recoverable
-  // error, which will be reset when a new episode is started.
+  // Writes the request provided in the argument to the stream. If writing
+  // fails with a transient error, a new stream is opened and the writer
+  // attempts to resume from the last item acknowledged by the server (see
+  // `TryResumeStream`). If resuming is not possible, the current episode is
+  // considered corrupt, which is a recoverable error, which will be reset
+  // when a new episode is started.
   absl::Status WriteStream(const InsertStreamRequest& request);
 
+  // Attempts to resume after the active stream broke with a transient error.
+  // Must be called after a new stream has been created. Returns true iff the
+  // server still caches every chunk of the episode and all unacknowledged
+  // items (followed by `failed_request`, if it carries chunks) were replayed
+  // on the new stream.
+  bool TryResumeStream(const InsertStreamRequest& failed_request);
+
+  // Enters spool mode (see `TrajectoryWriter::Options::insert_spool_dir`) and
+  // starts the replay worker if it is not running yet. Called when a stream
+  // could not be resumed; subsequent requests are spooled to disk until the
+  // worker has drained the spool and a new episode starts.
+  void StartSpooling() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Appends `request` as one TFRecord to the active spool file, rotating the
+  // file when it reaches its target size and dropping the oldest sealed file
+  // when the spool exceeds its byte bound. If the request carries an item it
+  // is removed from the in flight bookkeeping: spooled items count as
+  // accepted and are delivered asynchronously by the replay worker.
+  absl::Status SpoolRequest(const InsertStreamRequest& request)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Body of `spool_replay_worker_`. Waits for spooled data, replays the
+  // sealed files on a dedicated stream once the server is reachable again and
+  // deletes them on success. Runs until the writer is destroyed.
+  void RunSpoolReplayWorker();
+
+  // Replays the records of `paths` in order on a fresh stream. Returns the
+  // status of the stream; corrupt records are logged and skipped.
+  absl::Status ReplaySpoolFiles(const std::vector<std::string>& paths);
+
   // Waits for item confirmations until the stream expires.
   void ProcessItemConfirmations();
 
@@ -158,26 +201,82 @@ class StreamingTrajectoryWriter : public ColumnWriter {
   // Set of item IDs that have been sent to the replay server but haven't been
   // confirmed yet.
   internal::flat_hash_set<uint64_t> in_flight_items_ ABSL_GUARDED_BY(mutex_);
+
+  // Copies of single item requests that have been written to the stream but
+  // not yet acknowledged by the server, in sequence number order. The item
+  // protos are small (metadata only) so retaining them does not interfere
+  // with the greedy chunk memory release this writer exists to provide. If
+  // the stream breaks with a transient error, these are replayed on the new
+  // stream.
+  std::deque<InsertStreamRequest> unacked_item_requests_
+      ABSL_GUARDED_BY(mutex_);
+
+  // True while requests are diverted to the on disk spool instead of the
+  // stream. Entered when a stream cannot be resumed and
+  // `options_.insert_spool_dir` is set; left at the first episode boundary
+  // with an empty spool so items never reference chunks still on disk.
+  bool spooling_ ABSL_GUARDED_BY(mutex_) = false;
+
+  // Tells the spool replay worker to exit; set by the destructor.
+  bool spool_shutdown_ ABSL_GUARDED_BY(mutex_) = false;
+
+  // True once the replay worker has completed a replay session since spool
+  // mode was last entered, proving that the server is reachable again.
+  // Without it an empty spool alone would let the writer resume direct
+  // streaming against a server that is still down.
+  bool spool_connected_ ABSL_GUARDED_BY(mutex_) = false;
+
+  // File currently appended to by `SpoolRequest` and its size. Empty when
+  // the next spooled request starts a new file.
+  std::string spool_active_file_ ABSL_GUARDED_BY(mutex_);
+  int64_t spool_active_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  // Suffix of the next spool file, to keep names unique within the writer.
+  int64_t spool_file_sequence_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  // Files no longer appended to, oldest first, with their sizes. The replay
+  // worker consumes these from the front; the byte bound drops from the
+  // front as well.
+  std::deque<std::pair<std::string, int64_t>> spool_sealed_files_
+      ABSL_GUARDED_BY(mutex_);
+
+  // Total bytes currently spooled (active and sealed files).
+  int64_t spool_total_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+
   absl::Mutex mutex_;
 
   // Thread that receives item confirmations.
   std::unique_ptr<internal::Thread> item_confirmation_worker_;
 
+  // Thread that replays the spool when connectivity returns. Started the
+  // first time spool mode is entered and joined by the destructor.
+  std::unique_ptr<internal::Thread> spool_replay_worker_;
+
   // ID of the active episode.
   uint64_t episode_id_;
 
   // Step within the episode.
   int episode_step_;
 
+  // Identifies this writer on `InsertStreamRequest.writer_id` so that the
+  // server caches received chunks across streams of the same writer (see
+  // `QueryReceivedChunks` in reverb_service.proto).
+  uint64_t writer_id_;
+
+  // Sequence number assigned to the next item. Strictly increasing within
+  // the lifetime of the writer; the server acknowledges items by echoing the
+  // highest confirmed sequence number on its responses.
+  uint64_t next_sequence_number_ = 1;
+
   // Set if a non transient error encountered by the stream worker or if `Close`
   // has been called. In the latter case `unrecoverable_status_` will be set to
   // `CancelledError`.
   absl::Status unrecoverable_error_;
 
-  // Set if a a transient error occurs. Since this writer doesn't have a retry
-  // mechanism, all data associated with the episode in which the transient
-  // error occurred is considered corrupt. When a new episode starts, the error
-  // is reset.
+  // Set if a transient error occurs and the stream could not be resumed
+  // because the server no longer caches all chunks of the episode. All data
+  // associated with the episode in which the transient error occurred is then
+  // considered corrupt. When a new episode starts, the error is reset.
   absl::Status recoverable_error_;
 
   // Context used to create (and cancel) the gRPC stream used in
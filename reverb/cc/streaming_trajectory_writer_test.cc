@@ -14,6 +14,7 @@
 
 #include "reverb/cc/streaming_trajectory_writer.h"
 
+#include <cstdlib>
 #include <limits>
 #include <memory>
 #include <string>
@@ -222,6 +223,34 @@ inline TrajectoryWriter::Options MakeOptions(int max_chunk_length,
   };
 }
 
+// Records all written requests into a log shared with the test body. Unlike
+// `FakeStream`, instances can be created lazily by the stub since the spool
+// replay worker opens a fresh stream per replay session.
+struct SharedRequestLog {
+  absl::Mutex mu;
+  std::vector<InsertStreamRequest> requests ABSL_GUARDED_BY(mu);
+};
+
+class LoggingStream : public MockStream {
+ public:
+  explicit LoggingStream(std::shared_ptr<SharedRequestLog> log)
+      : log_(std::move(log)) {}
+
+  bool Write(const InsertStreamRequest& msg,
+             grpc::WriteOptions options) override {
+    absl::MutexLock lock(&log_->mu);
+    log_->requests.push_back(msg);
+    return true;
+  }
+
+  bool Read(InsertStreamResponse* response) override { return false; }
+
+  grpc::Status Finish() override { return grpc::Status::OK; }
+
+ private:
+  std::shared_ptr<SharedRequestLog> log_;
+};
+
 TEST(StreamingTrajectoryWriter, AppendValidatesDtype) {
   auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
   EXPECT_CALL(*stub, InsertStreamRaw(_))
@@ -542,9 +571,10 @@ TEST(StreamingTrajectoryWriter, ChunkersNotifiedWhenAllChunksDone) {
   counter.Wait();
 }
 
-TEST(StreamingTrajectoryWriter, CorruptEpisodeOnTransientError) {
+TEST(StreamingTrajectoryWriter, ResumesStreamOnTransientError) {
   auto* fail_stream = new MockStream();
   EXPECT_CALL(*fail_stream, Write(IsChunk(), _)).WillOnce(Return(false));
+  EXPECT_CALL(*fail_stream, Read(_)).WillRepeatedly(Return(false));
   EXPECT_CALL(*fail_stream, Finish())
       .WillOnce(Return(grpc::Status(grpc::StatusCode::UNAVAILABLE, "")));
 
@@ -558,31 +588,136 @@ TEST(StreamingTrajectoryWriter, CorruptEpisodeOnTransientError) {
   StreamingTrajectoryWriter writer(
       stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1));
 
-  // Writing will fail on the first chunk.
+  // Writing fails on the first chunk but since no chunks of the episode
+  // predate the failure, the writer opens a new stream and replays the chunk
+  // on it.
   StepRef first;
-  EXPECT_THAT(writer.Append(Step({MakeTensor(kIntSpec)}), &first),
+  REVERB_EXPECT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{first[0]}})));
+  REVERB_EXPECT_OK(writer.Flush());
+
+  EXPECT_THAT(success_stream->requests(), ElementsAre(IsChunk(), IsItem()));
+}
+
+TEST(StreamingTrajectoryWriter, CorruptsEpisodeWhenServerLostChunks) {
+  auto* fail_stream = new MockStream();
+  EXPECT_CALL(*fail_stream, Write(IsChunk(), _))
+      .WillOnce(Return(true))
+      .WillOnce(Return(false));
+  EXPECT_CALL(*fail_stream, Read(_)).WillRepeatedly(Return(false));
+  EXPECT_CALL(*fail_stream, Finish())
+      .WillOnce(Return(grpc::Status(grpc::StatusCode::UNAVAILABLE, "")));
+
+  auto* success_stream = new FakeStream();
+
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, InsertStreamRaw(_))
+      .WillOnce(Return(fail_stream))
+      .WillOnce(Return(success_stream));
+
+  // The server does not cache any of the queried chunks.
+  EXPECT_CALL(*stub, QueryReceivedChunks(_, _, _))
+      .WillOnce(Return(grpc::Status::OK));
+
+  StreamingTrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1));
+
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+
+  // The second write fails and since the server no longer holds the first
+  // chunk the episode cannot be resumed.
+  StepRef second;
+  EXPECT_THAT(writer.Append(Step({MakeTensor(kIntSpec)}), &second),
               StatusIs(absl::StatusCode::kDataLoss, ""));
 
   // Any future attempts in the same episode will fail as well.
-  EXPECT_THAT(writer.Append(Step({MakeTensor(kIntSpec)}), &first),
+  EXPECT_THAT(writer.Append(Step({MakeTensor(kIntSpec)}), &second),
               StatusIs(absl::StatusCode::kDataLoss, ""));
 
   // Start a new episode.
   REVERB_EXPECT_OK(writer.EndEpisode(true));
 
-  REVERB_EXPECT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+  REVERB_EXPECT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &second));
   REVERB_ASSERT_OK(
-      writer.CreateItem("table", 1.0, MakeTrajectory({{first[0]}})));
+      writer.CreateItem("table", 1.0, MakeTrajectory({{second[0]}})));
   REVERB_EXPECT_OK(writer.Flush());
 
-  // The first stream will fail on the second request (item). The writer should
-  // then close the stream and once it sees the UNAVAILABLE error open a nee
-  // stream. The writer should then proceed to resend the chunk since there
-  // is no guarantee that the new stream is connected to the same server and
-  // thus the data might not exist on the server.
   EXPECT_THAT(success_stream->requests(), ElementsAre(IsChunk(), IsItem()));
 }
 
+TEST(StreamingTrajectoryWriter, RetransmitsUnacknowledgedItemsOnResume) {
+  auto* fail_stream = new MockStream();
+  EXPECT_CALL(*fail_stream, Write(IsChunk(), _))
+      .WillOnce(Return(true))
+      .WillOnce(Return(false));
+  EXPECT_CALL(*fail_stream, Write(IsItem(), _)).WillOnce(Return(true));
+  EXPECT_CALL(*fail_stream, Read(_)).WillRepeatedly(Return(false));
+  EXPECT_CALL(*fail_stream, Finish())
+      .WillOnce(Return(grpc::Status(grpc::StatusCode::UNAVAILABLE, "")));
+
+  auto* success_stream = new FakeStream();
+
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, InsertStreamRaw(_))
+      .WillOnce(Return(fail_stream))
+      .WillOnce(Return(success_stream));
+
+  // The server still caches all queried chunks.
+  EXPECT_CALL(*stub, QueryReceivedChunks(_, _, _))
+      .WillOnce(Invoke([](grpc::ClientContext*,
+                          const QueryReceivedChunksRequest& request,
+                          QueryReceivedChunksResponse* response) {
+        *response->mutable_chunk_keys() = request.chunk_keys();
+        return grpc::Status::OK;
+      }));
+
+  StreamingTrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1));
+
+  // The chunk and item reach the first stream but the item is never
+  // acknowledged since the stream breaks on the next write.
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{first[0]}})));
+
+  StepRef second;
+  REVERB_EXPECT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &second));
+
+  // The unacknowledged item is replayed before the chunk whose write failed.
+  EXPECT_THAT(success_stream->requests(), ElementsAre(IsItem(), IsChunk()));
+  EXPECT_THAT(success_stream->requests()[0].item_sequence_numbers(),
+              ElementsAre(1));
+
+  // The retransmitted item is confirmed on the new stream.
+  REVERB_EXPECT_OK(writer.Flush());
+}
+
+TEST(StreamingTrajectoryWriter, ItemsCarrySequenceNumbersAndWriterId) {
+  auto* stream = new FakeStream();
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, InsertStreamRaw(_)).WillOnce(Return(stream));
+
+  StreamingTrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1));
+
+  StepRef step;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &step));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{step[0]}})));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 0.5, MakeTrajectory({{step[0]}})));
+  REVERB_EXPECT_OK(writer.Flush());
+
+  ASSERT_THAT(stream->requests(), ElementsAre(IsChunk(), IsItem(), IsItem()));
+  EXPECT_NE(stream->requests()[0].writer_id(), 0);
+  EXPECT_THAT(stream->requests()[1].item_sequence_numbers(), ElementsAre(1));
+  EXPECT_THAT(stream->requests()[2].item_sequence_numbers(), ElementsAre(2));
+}
+
 TEST(StreamingTrajectoryWriter, StopsOnNonTransientError) {
   auto* fail_stream = new MockStream();
   EXPECT_CALL(*fail_stream, Write(IsChunk(), _)).WillOnce(Return(false));
@@ -1005,6 +1140,64 @@ TEST(StreamingTrajectoryWriter, EndEpisodeResetsEpisodeKeyAndStep) {
   EXPECT_EQ(second[0]->lock()->episode_step(), 0);
 }
 
+TEST(StreamingTrajectoryWriter, SpoolsAndReplaysWhenStreamCannotBeResumed) {
+  auto* fail_stream = new MockStream();
+  EXPECT_CALL(*fail_stream, Write(IsChunk(), _))
+      .WillOnce(Return(true))
+      .WillOnce(Return(false));
+  EXPECT_CALL(*fail_stream, Read(_)).WillRepeatedly(Return(false));
+  EXPECT_CALL(*fail_stream, Finish())
+      .WillOnce(Return(grpc::Status(grpc::StatusCode::UNAVAILABLE, "")));
+
+  auto log = std::make_shared<SharedRequestLog>();
+
+  auto stub = std::make_shared</* grpc_gen:: */MockReverbServiceStub>();
+  EXPECT_CALL(*stub, InsertStreamRaw(_))
+      .WillOnce(Return(fail_stream))
+      .WillRepeatedly(Invoke([&](grpc::ClientContext*) {
+        return new LoggingStream(log);
+      }));
+
+  // The server does not cache any of the queried chunks so the episode cannot
+  // be resumed and the writer enters spool mode.
+  EXPECT_CALL(*stub, QueryReceivedChunks(_, _, _))
+      .WillOnce(Return(grpc::Status::OK));
+
+  auto options = MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1);
+  options.insert_spool_dir =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/insert_spool_replay");
+  StreamingTrajectoryWriter writer(stub, options);
+
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+
+  // The second write fails and since the server no longer holds the first
+  // chunk the episode is corrupt. The writer starts spooling.
+  StepRef second;
+  EXPECT_THAT(writer.Append(Step({MakeTensor(kIntSpec)}), &second),
+              StatusIs(absl::StatusCode::kDataLoss, ""));
+
+  // Start a new episode. The new episode is written to the spool and Flush
+  // treats the spooled items as accepted.
+  REVERB_EXPECT_OK(writer.EndEpisode(true));
+
+  REVERB_EXPECT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &second));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{second[0]}})));
+  REVERB_EXPECT_OK(writer.Flush());
+
+  // The replay worker eventually pushes the spooled requests to the server.
+  {
+    absl::MutexLock lock(&log->mu);
+    auto drained = [&]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(log->mu) {
+      return log->requests.size() >= 2;
+    };
+    ASSERT_TRUE(
+        log->mu.AwaitWithTimeout(absl::Condition(&drained), absl::Seconds(10)));
+    EXPECT_THAT(log->requests, ElementsAre(IsChunk(), IsItem()));
+  }
+}
+
 }  // namespace
 }  // namespace reverb
 }  // namespace deepmind
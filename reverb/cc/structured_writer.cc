@@ -75,79 +75,138 @@ CellRef::EpisodeInfo GetEpisodeInfo(
 bool CheckCondition(
     const std::vector<std::deque<std::shared_ptr<CellRef>>>& columns,
     const CellRef::EpisodeInfo& current_step, int steps_since_applied,
-    bool is_end_of_episode, const Condition& condition) {
+    bool is_end_of_episode,
+    const StructuredWriter::CompiledCondition& condition) {
   REVERB_CHECK(!columns.empty()) << "This should never happen";
 
   int left = [&]() -> int {
-    switch (condition.left_case()) {
-      case Condition::kStepIndex:
+    switch (condition.left) {
+      case StructuredWriter::CompiledCondition::Left::kStepIndex:
         return current_step.step;
-      case Condition::kStepsSinceApplied:
+      case StructuredWriter::CompiledCondition::Left::kStepsSinceApplied:
         return steps_since_applied;
-      case Condition::kBufferLength:
+      case StructuredWriter::CompiledCondition::Left::kBufferLength:
         return std::max_element(columns.begin(), columns.end(),
                                 [](const auto& a, const auto& b) {
                                   return a.size() < b.size();
                                 })
             ->size();
-      case Condition::kIsEndEpisode:
+      case StructuredWriter::CompiledCondition::Left::kIsEndEpisode:
         return is_end_of_episode ? 1 : 0;
-
-      case Condition::LEFT_NOT_SET:
-        REVERB_CHECK(false) << "This should never happen";
     }
   }();
 
-  switch (condition.cmp_case()) {
-    case Condition::kEq:
-      return left == condition.eq();
-    case Condition::kGe:
-      return left >= condition.ge();
-    case Condition::kLe:
-      return left <= condition.le();
-    case Condition::kModEq:
-      return left % condition.mod_eq().mod() == condition.mod_eq().eq();
-    case Condition::CMP_NOT_SET:
-      REVERB_CHECK(false) << "This should never happen";
+  switch (condition.cmp) {
+    case StructuredWriter::CompiledCondition::Cmp::kEq:
+      return left == condition.rhs;
+    case StructuredWriter::CompiledCondition::Cmp::kGe:
+      return left >= condition.rhs;
+    case StructuredWriter::CompiledCondition::Cmp::kLe:
+      return left <= condition.rhs;
+    case StructuredWriter::CompiledCondition::Cmp::kModEq:
+      return left % condition.mod == condition.rhs;
   }
 }
 
 absl::StatusOr<std::vector<TrajectoryColumn>> BuildTrajectory(
-    const StructuredWriterConfig& config,
+    const StructuredWriter::CompiledPattern& pattern,
     const std::vector<std::deque<std::shared_ptr<CellRef>>>& columns) {
   std::vector<TrajectoryColumn> out;
   out.reserve(columns.size());
 
-  for (const auto& node : config.flat()) {
-    REVERB_QCHECK_GT(columns.size(), node.flat_source_index());
-    const auto& col = columns[node.flat_source_index()];
-
-    const int offset =
-        col.size() + (HasStart(node) ? node.start() : node.stop());
-    const int length = HasStart(node) ? node.stop() - node.start() : 1;
-    const int step = HasStep(node) ? node.step() : 1;
+  for (const auto& node : pattern.nodes) {
+    REVERB_QCHECK_GT(columns.size(), node.column);
+    const auto& col = columns[node.column];
 
     auto it = col.begin();
-    std::advance(it, offset);
+    std::advance(it, col.size() + node.offset);
 
     std::vector<std::weak_ptr<CellRef>> refs;
-    refs.reserve(length / step);
-    for (int i = 0; i < length; i += step) {
+    refs.reserve(node.length / node.step);
+    for (int i = 0; i < node.length; i += node.step) {
       if (*it == nullptr) {
         return absl::FailedPreconditionError(absl::StrFormat(
             "The %dth column contain null values in the references slice",
-            node.flat_source_index()));
+            node.column));
       }
       refs.push_back(*it);
-      std::advance(it, step);
+      std::advance(it, node.step);
     }
 
-    out.emplace_back(std::move(refs), !HasStart(node) && HasStop(node));
+    out.emplace_back(std::move(refs), node.squeeze);
   }
 
   return out;
 }
 
+// Translates a validated config into its compiled form. Must only be called
+// on configs which passed `ValidateStructuredWriterConfig`.
+StructuredWriter::CompiledPattern CompilePattern(
+    const StructuredWriterConfig& config) {
+  StructuredWriter::CompiledPattern pattern;
+  pattern.table = config.table();
+  pattern.priority = config.priority();
+
+  pattern.conditions.reserve(config.conditions_size());
+  for (const auto& condition : config.conditions()) {
+    StructuredWriter::CompiledCondition compiled;
+    switch (condition.left_case()) {
+      case Condition::kStepIndex:
+        compiled.left = StructuredWriter::CompiledCondition::Left::kStepIndex;
+        break;
+      case Condition::kStepsSinceApplied:
+        compiled.left =
+            StructuredWriter::CompiledCondition::Left::kStepsSinceApplied;
+        break;
+      case Condition::kBufferLength:
+        compiled.left =
+            StructuredWriter::CompiledCondition::Left::kBufferLength;
+        break;
+      case Condition::kIsEndEpisode:
+        compiled.left =
+            StructuredWriter::CompiledCondition::Left::kIsEndEpisode;
+        break;
+      case Condition::LEFT_NOT_SET:
+        REVERB_CHECK(false) << "This should never happen";
+    }
+    switch (condition.cmp_case()) {
+      case Condition::kEq:
+        compiled.cmp = StructuredWriter::CompiledCondition::Cmp::kEq;
+        compiled.rhs = condition.eq();
+        break;
+      case Condition::kGe:
+        compiled.cmp = StructuredWriter::CompiledCondition::Cmp::kGe;
+        compiled.rhs = condition.ge();
+        break;
+      case Condition::kLe:
+        compiled.cmp = StructuredWriter::CompiledCondition::Cmp::kLe;
+        compiled.rhs = condition.le();
+        break;
+      case Condition::kModEq:
+        compiled.cmp = StructuredWriter::CompiledCondition::Cmp::kModEq;
+        compiled.rhs = condition.mod_eq().eq();
+        compiled.mod = condition.mod_eq().mod();
+        break;
+      case Condition::CMP_NOT_SET:
+        REVERB_CHECK(false) << "This should never happen";
+    }
+    pattern.conditions.push_back(compiled);
+  }
+
+  pattern.nodes.reserve(config.flat_size());
+  for (const auto& node : config.flat()) {
+    pattern.nodes.push_back({
+        /*column=*/node.flat_source_index(),
+        /*offset=*/HasStart(node) ? node.start() : node.stop(),
+        /*length=*/HasStart(node) ? node.stop() - node.start() : 1,
+        /*step=*/HasStep(node) ? node.step() : 1,
+        /*squeeze=*/!HasStart(node) && HasStop(node),
+    });
+  }
+
+  return pattern;
+}
+
 absl::Status ValidateCondition(const Condition& condition) {
   if (condition.left_case() == Condition::LEFT_NOT_SET) {
     return absl::InvalidArgumentError(
@@ -288,7 +347,7 @@ StructuredWriter::StructuredWriter(std::unique_ptr<ColumnWriter> writer,
       max_column_history_(MaxHistoryLengthPerColumn(configs)) {
   for (auto& config : configs) {
     REVERB_CHECK_OK(ValidateStructuredWriterConfig(config));
-    configs_and_states_.push_back({std::move(config)});
+    configs_and_states_.push_back({CompilePattern(config)});
   }
 }
 
@@ -363,7 +422,7 @@ absl::Status StructuredWriter::ApplyConfigs(bool is_end_of_episode) {
     }
 
     // Don't do anything unless all conditions are fulfilled.
-    if (std::any_of(c.config.conditions().begin(), c.config.conditions().end(),
+    if (std::any_of(c.pattern.conditions.begin(), c.pattern.conditions.end(),
                     [&](const auto& cond) {
                       return !CheckCondition(columns_, current_step,
                                              c.steps_since_applied,
@@ -374,14 +433,14 @@ absl::Status StructuredWriter::ApplyConfigs(bool is_end_of_episode) {
 
     // Try to build the trajectory. If it turns out that it contained null
     // values then we behave just as if a static condition wasn't fulfilled.
-    auto trajectory_or_status = BuildTrajectory(c.config, columns_);
+    auto trajectory_or_status = BuildTrajectory(c.pattern, columns_);
     if (absl::IsFailedPrecondition(trajectory_or_status.status())) {
       continue;
     }
 
     REVERB_ASSIGN_OR_RETURN(auto trajectory, trajectory_or_status);
     REVERB_RETURN_IF_ERROR(writer_->CreateItem(
-        c.config.table(), c.config.priority(), std::move(trajectory)));
+        c.pattern.table, c.pattern.priority, std::move(trajectory)));
 
     c.last_applied = current_step;
     c.steps_since_applied = 0;
@@ -16,6 +16,7 @@
 #define REVERB_CC_STRUCTURED_WRITER_H_
 
 #include <deque>
+#include <string>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -51,6 +52,65 @@ class StructuredWriter {
   absl::Status Flush(int ignore_last_num_items = 0,
                      absl::Duration timeout = absl::InfiniteDuration());
 
+  // A `Condition` proto compiled into plain integers. Evaluating it per step
+  // only requires selecting the left operand and a single integer compare
+  // instead of repeated proto (oneof) inspections.
+  struct CompiledCondition {
+    enum class Left {
+      kStepIndex,
+      kStepsSinceApplied,
+      kBufferLength,
+      kIsEndEpisode,
+    };
+    enum class Cmp {
+      kEq,
+      kGe,
+      kLe,
+      kModEq,
+    };
+
+    Left left;
+    Cmp cmp;
+
+    // Right hand side of the comparison (`eq`, `ge`, `le` or `mod_eq.eq`).
+    int rhs = 0;
+
+    // Modulus of the left operand. Only used by `kModEq`.
+    int mod = 0;
+  };
+
+  // A `PatternNode` proto compiled into precomputed column index, offset,
+  // length and stride.
+  struct CompiledNode {
+    // `flat_source_index` of the source column.
+    int column;
+
+    // Negative offset from the end of the column buffer where the slice
+    // starts.
+    int offset;
+
+    // Number of buffer entries spanned by the slice (before applying
+    // `step`).
+    int length;
+
+    // Stride through the slice.
+    int step;
+
+    // True for single step nodes defined only through `stop`, i.e the time
+    // dimension is squeezed from the resulting column.
+    bool squeeze;
+  };
+
+  // A `StructuredWriterConfig` compiled once at construction. Since patterns
+  // are fixed for the lifetime of the writer this turns the per step work in
+  // `ApplyConfigs` into a handful of array walks.
+  struct CompiledPattern {
+    std::string table;
+    double priority;
+    std::vector<CompiledCondition> conditions;
+    std::vector<CompiledNode> nodes;
+  };
+
  private:
   // Forwards `data` to wrapped `ColumnWriter` then calls `ApplyConfig`.
   absl::Status AppendInternal(
@@ -61,8 +121,8 @@ class StructuredWriter {
   absl::Status ApplyConfigs(bool is_end_of_episode);
 
   struct ConfigState {
-    // The wrapped proto config.
-    const StructuredWriterConfig config;
+    // The pattern compiled from the proto config.
+    const CompiledPattern pattern;
 
     // The number of since the config was last used to produce a trajectory.
     int steps_since_applied = 0;
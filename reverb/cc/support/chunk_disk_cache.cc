@@ -0,0 +1,131 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/chunk_disk_cache.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/support/tf_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+constexpr char kChunkFileSuffix[] = ".chunk";
+
+}  // namespace
+
+absl::Status ChunkDiskCache::Open(std::string directory,
+                                  std::unique_ptr<ChunkDiskCache>* cache) {
+  auto* env = tensorflow::Env::Default();
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(env->RecursivelyCreateDir(directory)));
+
+  auto opened = absl::WrapUnique(new ChunkDiskCache(std::move(directory)));
+  std::vector<std::string> children;
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(env->GetChildren(opened->directory_, &children)));
+  for (const std::string& child : children) {
+    // Entries that do not parse as `<key>.chunk` are ignored; in particular
+    // temporary files left behind by an interrupted `Put` are simply
+    // overwritten by the next write of the same chunk.
+    if (!absl::EndsWith(child, kChunkFileSuffix)) continue;
+    uint64_t key;
+    if (!absl::SimpleAtoi(
+            child.substr(0, child.size() - strlen(kChunkFileSuffix)), &key)) {
+      continue;
+    }
+    opened->keys_.insert(key);
+  }
+  *cache = std::move(opened);
+  return absl::OkStatus();
+}
+
+ChunkDiskCache::ChunkDiskCache(std::string directory)
+    : directory_(std::move(directory)) {}
+
+std::string ChunkDiskCache::PathForKey(uint64_t key) const {
+  return tensorflow::io::JoinPath(directory_,
+                                  absl::StrCat(key, kChunkFileSuffix));
+}
+
+std::vector<uint64_t> ChunkDiskCache::Keys() const {
+  absl::MutexLock lock(&mu_);
+  return std::vector<uint64_t>(keys_.begin(), keys_.end());
+}
+
+bool ChunkDiskCache::Contains(uint64_t key) const {
+  absl::MutexLock lock(&mu_);
+  return keys_.contains(key);
+}
+
+absl::Status ChunkDiskCache::Get(uint64_t key,
+                                 std::shared_ptr<ChunkData>* chunk) const {
+  {
+    absl::MutexLock lock(&mu_);
+    if (!keys_.contains(key)) {
+      return absl::NotFoundError(
+          absl::StrCat("Chunk ", key, " is not present in the disk cache."));
+    }
+  }
+  std::string content;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(tensorflow::ReadFileToString(
+      tensorflow::Env::Default(), PathForKey(key), &content)));
+  auto data = std::make_shared<ChunkData>();
+  if (!data->ParseFromString(content)) {
+    return absl::DataLossError(
+        absl::StrCat("Failed to parse disk cached chunk ", key, "."));
+  }
+  *chunk = std::move(data);
+  return absl::OkStatus();
+}
+
+absl::Status ChunkDiskCache::Put(const ChunkData& chunk) {
+  const uint64_t key = chunk.chunk_key();
+  {
+    absl::MutexLock lock(&mu_);
+    if (keys_.contains(key)) return absl::OkStatus();
+  }
+  // Write to a temporary file and rename it into place so concurrent readers
+  // (and future opens of the cache) never observe a partial entry. Concurrent
+  // writers of the same chunk write identical content so the last rename
+  // winning is harmless.
+  auto* env = tensorflow::Env::Default();
+  const std::string path = PathForKey(key);
+  const std::string tmp_path = absl::StrCat(path, ".tmp");
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(tensorflow::WriteStringToFile(
+      env, tmp_path, chunk.SerializeAsString())));
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(env->RenameFile(tmp_path, path)));
+  absl::MutexLock lock(&mu_);
+  keys_.insert(key);
+  return absl::OkStatus();
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
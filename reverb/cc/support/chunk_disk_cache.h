@@ -0,0 +1,82 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_CHUNK_DISK_CACHE_H_
+#define REVERB_CC_SUPPORT_CHUNK_DISK_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "reverb/cc/platform/hash_set.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Persistent content-addressed store of compressed sample chunks, keyed by
+// chunk key. Chunk payloads are immutable once written so an entry never goes
+// stale; a cached payload is only used when the server references its key
+// from the (always freshly transmitted) metadata of a sampled item. Used by
+// the `Sampler` to avoid re-downloading the chunks of items that are sampled
+// repeatedly across process restarts, e.g. held-out evaluation sets. See
+// `Sampler::Options::disk_cache_dir`.
+//
+// Every chunk is stored in its own file named after the key, written to a
+// temporary file first and renamed into place so readers never observe
+// partial entries. All methods are thread safe.
+class ChunkDiskCache {
+ public:
+  // Opens the cache rooted at `directory`, creating the directory if needed,
+  // and indexes the entries already present.
+  static absl::Status Open(std::string directory,
+                           std::unique_ptr<ChunkDiskCache>* cache);
+
+  // Keys of all chunks currently in the cache.
+  std::vector<uint64_t> Keys() const;
+
+  bool Contains(uint64_t key) const;
+
+  // Reads the chunk stored under `key`. Returns `NotFoundError` if the cache
+  // holds no such entry and `DataLossError` if the entry cannot be parsed.
+  absl::Status Get(uint64_t key, std::shared_ptr<ChunkData>* chunk) const;
+
+  // Persists `chunk` under its key. No-op if the key is already present.
+  absl::Status Put(const ChunkData& chunk);
+
+ private:
+  explicit ChunkDiskCache(std::string directory);
+
+  // Path of the file holding the chunk with `key`.
+  std::string PathForKey(uint64_t key) const;
+
+  // Root directory of the cache.
+  const std::string directory_;
+
+  mutable absl::Mutex mu_;
+
+  // Keys of the entries on disk.
+  flat_hash_set<uint64_t> keys_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_CHUNK_DISK_CACHE_H_
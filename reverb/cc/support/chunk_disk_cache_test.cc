@@ -0,0 +1,84 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/chunk_disk_cache.h"
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/testing/proto_test_util.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+using ::testing::UnorderedElementsAre;
+
+std::string TempCacheDir() {
+  std::string path;
+  REVERB_CHECK(tensorflow::Env::Default()->LocalTempFilename(&path));
+  return path;
+}
+
+ChunkData MakeChunk(uint64_t key) {
+  ChunkData chunk;
+  chunk.set_chunk_key(key);
+  chunk.set_data_tensors_len(100 + static_cast<int32_t>(key));
+  return chunk;
+}
+
+TEST(ChunkDiskCacheTest, PutGetRoundtrip) {
+  std::unique_ptr<ChunkDiskCache> cache;
+  REVERB_ASSERT_OK(ChunkDiskCache::Open(TempCacheDir(), &cache));
+
+  EXPECT_FALSE(cache->Contains(1));
+  REVERB_EXPECT_OK(cache->Put(MakeChunk(1)));
+  REVERB_EXPECT_OK(cache->Put(MakeChunk(2)));
+  EXPECT_TRUE(cache->Contains(1));
+  EXPECT_THAT(cache->Keys(), UnorderedElementsAre(1, 2));
+
+  std::shared_ptr<ChunkData> chunk;
+  REVERB_ASSERT_OK(cache->Get(1, &chunk));
+  EXPECT_THAT(*chunk, testing::EqualsProto(MakeChunk(1)));
+
+  // Missing keys are reported as not found.
+  EXPECT_EQ(cache->Get(3, &chunk).code(), absl::StatusCode::kNotFound);
+}
+
+TEST(ChunkDiskCacheTest, EntriesSurviveReopen) {
+  const std::string dir = TempCacheDir();
+  {
+    std::unique_ptr<ChunkDiskCache> cache;
+    REVERB_ASSERT_OK(ChunkDiskCache::Open(dir, &cache));
+    REVERB_EXPECT_OK(cache->Put(MakeChunk(42)));
+  }
+
+  std::unique_ptr<ChunkDiskCache> cache;
+  REVERB_ASSERT_OK(ChunkDiskCache::Open(dir, &cache));
+  EXPECT_THAT(cache->Keys(), UnorderedElementsAre(42));
+  std::shared_ptr<ChunkData> chunk;
+  REVERB_ASSERT_OK(cache->Get(42, &chunk));
+  EXPECT_THAT(*chunk, testing::EqualsProto(MakeChunk(42)));
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
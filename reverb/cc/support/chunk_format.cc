@@ -0,0 +1,226 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/chunk_format.h"
+
+#include <cstring>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "reverb/cc/platform/status_macros.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Fixed header:
+//
+//   offset  0  uint32  magic
+//   offset  4  uint16  version
+//   offset  6  uint16  (reserved)
+//   offset  8  uint32  header size (start of the column records)
+//   offset 12  uint32  column record size
+//   offset 16  uint64  chunk key
+//   offset 24  uint64  episode id
+//   offset 32  int32   sequence start
+//   offset 36  int32   sequence end
+//   offset 40  uint64  metadata offset
+//   offset 48  uint64  metadata length
+//   offset 56  uint32  number of columns
+//   offset 60  uint32  (reserved)
+//
+// Column record:
+//
+//   offset  0  uint64  column offset
+//   offset  8  uint32  column length
+//   offset 12  uint8   codec
+//   offset 13  uint8   delta encoded
+//   offset 14  uint16  (reserved)
+constexpr uint32_t kHeaderSize = 64;
+constexpr uint32_t kColumnRecordSize = 16;
+
+void AppendLittleEndian(uint64_t value, int bytes, std::string* out) {
+  for (int i = 0; i < bytes; i++) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64_t LoadLittleEndian(absl::string_view data, size_t offset, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(data[offset + i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace
+
+absl::Status PackChunk(const ChunkData& chunk, std::string* out) {
+  if (chunk.payload_cached() || chunk.has_shm_ref()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Chunk ", chunk.chunk_key(),
+        " is a payload reference and cannot be packed."));
+  }
+  ChunkData metadata = chunk;
+  metadata.clear_data();
+  std::string metadata_bytes;
+  if (!metadata.SerializeToString(&metadata_bytes)) {
+    return absl::InternalError(absl::StrCat(
+        "Failed to serialize the metadata of chunk ", chunk.chunk_key(), "."));
+  }
+
+  const int num_columns = chunk.data().tensors_size();
+  uint64_t offset = kHeaderSize + num_columns * kColumnRecordSize;
+  std::string records;
+  records.reserve(num_columns * kColumnRecordSize);
+  uint64_t columns_size = 0;
+  for (int i = 0; i < num_columns; i++) {
+    const size_t column_size = chunk.data().tensors(i).ByteSizeLong();
+    const bool has_stream = i < chunk.column_streams_size();
+    const CompressionCodec codec =
+        has_stream ? chunk.column_streams(i).codec() : chunk.codec();
+    const bool delta_encoded = has_stream
+                                   ? chunk.column_streams(i).delta_encoded()
+                                   : chunk.delta_encoded();
+    AppendLittleEndian(offset + columns_size, 8, &records);
+    AppendLittleEndian(column_size, 4, &records);
+    AppendLittleEndian(static_cast<uint64_t>(codec), 1, &records);
+    AppendLittleEndian(delta_encoded ? 1 : 0, 1, &records);
+    AppendLittleEndian(0, 2, &records);
+    columns_size += column_size;
+  }
+  const uint64_t metadata_offset = offset + columns_size;
+
+  out->clear();
+  out->reserve(metadata_offset + metadata_bytes.size());
+  AppendLittleEndian(kPackedChunkMagic, 4, out);
+  AppendLittleEndian(kPackedChunkVersion, 2, out);
+  AppendLittleEndian(0, 2, out);
+  AppendLittleEndian(kHeaderSize, 4, out);
+  AppendLittleEndian(kColumnRecordSize, 4, out);
+  AppendLittleEndian(chunk.chunk_key(), 8, out);
+  AppendLittleEndian(chunk.sequence_range().episode_id(), 8, out);
+  AppendLittleEndian(static_cast<uint32_t>(chunk.sequence_range().start()), 4,
+                     out);
+  AppendLittleEndian(static_cast<uint32_t>(chunk.sequence_range().end()), 4,
+                     out);
+  AppendLittleEndian(metadata_offset, 8, out);
+  AppendLittleEndian(metadata_bytes.size(), 8, out);
+  AppendLittleEndian(num_columns, 4, out);
+  AppendLittleEndian(0, 4, out);
+  out->append(records);
+  for (int i = 0; i < num_columns; i++) {
+    if (!chunk.data().tensors(i).AppendToString(out)) {
+      return absl::InternalError(absl::StrCat("Failed to serialize column ", i,
+                                              " of chunk ", chunk.chunk_key(),
+                                              "."));
+    }
+  }
+  out->append(metadata_bytes);
+  return absl::OkStatus();
+}
+
+absl::Status PackedChunkView::Wrap(absl::string_view data,
+                                   PackedChunkView* view) {
+  if (data.size() < kHeaderSize ||
+      LoadLittleEndian(data, 0, 4) != kPackedChunkMagic) {
+    return absl::InvalidArgumentError("Buffer is not a packed chunk.");
+  }
+  const uint64_t version = LoadLittleEndian(data, 4, 2);
+  if (version != kPackedChunkVersion) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Packed chunk has incompatible version ", version,
+                     " (expected ", kPackedChunkVersion, ")."));
+  }
+  view->data_ = data;
+  view->header_size_ = LoadLittleEndian(data, 8, 4);
+  view->column_record_size_ = LoadLittleEndian(data, 12, 4);
+  view->chunk_key_ = LoadLittleEndian(data, 16, 8);
+  view->episode_id_ = LoadLittleEndian(data, 24, 8);
+  view->sequence_start_ =
+      static_cast<int32_t>(LoadLittleEndian(data, 32, 4));
+  view->sequence_end_ = static_cast<int32_t>(LoadLittleEndian(data, 36, 4));
+  view->metadata_offset_ = LoadLittleEndian(data, 40, 8);
+  view->metadata_length_ = LoadLittleEndian(data, 48, 8);
+  view->num_columns_ = static_cast<int>(LoadLittleEndian(data, 56, 4));
+  // A newer writer may have grown the header or the records; striding on the
+  // recorded sizes skips the fields this reader does not know about.
+  if (view->header_size_ < kHeaderSize ||
+      view->column_record_size_ < kColumnRecordSize ||
+      view->num_columns_ < 0 ||
+      view->header_size_ +
+              static_cast<uint64_t>(view->num_columns_) *
+                  view->column_record_size_ >
+          data.size() ||
+      view->metadata_offset_ + view->metadata_length_ > data.size()) {
+    return absl::InvalidArgumentError(
+        "Packed chunk header references bytes beyond the buffer.");
+  }
+  for (int i = 0; i < view->num_columns_; i++) {
+    const size_t record = view->header_size_ + i * view->column_record_size_;
+    const uint64_t offset = LoadLittleEndian(data, record, 8);
+    const uint64_t length = LoadLittleEndian(data, record + 8, 4);
+    if (offset + length > data.size()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Packed chunk column ", i, " references bytes beyond the buffer."));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::string_view PackedChunkView::column(int i) const {
+  const size_t record = header_size_ + i * column_record_size_;
+  return data_.substr(LoadLittleEndian(data_, record, 8),
+                      LoadLittleEndian(data_, record + 8, 4));
+}
+
+CompressionCodec PackedChunkView::column_codec(int i) const {
+  const size_t record = header_size_ + i * column_record_size_;
+  return static_cast<CompressionCodec>(LoadLittleEndian(data_, record + 12, 1));
+}
+
+bool PackedChunkView::column_delta_encoded(int i) const {
+  const size_t record = header_size_ + i * column_record_size_;
+  return LoadLittleEndian(data_, record + 13, 1) != 0;
+}
+
+absl::Status PackedChunkView::Metadata(ChunkData* chunk) const {
+  if (!chunk->ParseFromArray(data_.data() + metadata_offset_,
+                             metadata_length_)) {
+    return absl::DataLossError(absl::StrCat(
+        "Failed to parse the metadata of packed chunk ", chunk_key_, "."));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status PackedChunkView::Unpack(ChunkData* chunk) const {
+  REVERB_RETURN_IF_ERROR(Metadata(chunk));
+  for (int i = 0; i < num_columns_; i++) {
+    const absl::string_view bytes = column(i);
+    if (!chunk->mutable_data()->add_tensors()->ParseFromArray(bytes.data(),
+                                                              bytes.size())) {
+      return absl::DataLossError(absl::StrCat(
+          "Failed to parse column ", i, " of packed chunk ", chunk_key_, "."));
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
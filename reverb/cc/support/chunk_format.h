@@ -0,0 +1,114 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_CHUNK_FORMAT_H_
+#define REVERB_CC_SUPPORT_CHUNK_FORMAT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Packed serialization of a `ChunkData` with a fixed-offset header in front
+// of the performance critical fields, used where raw chunk bytes are stored
+// and re-read (the shared memory sample arena; see `ShmArena`). A full
+// protobuf parse of a chunk walks every nested `TensorProto`; the packed
+// layout lets a reader locate the chunk key, sequence range and any single
+// column's bytes with a handful of bounds-checked loads, keeping protobuf for
+// the long tail of metadata only.
+//
+// Layout (all integers little endian):
+//
+//   [fixed header][one record per column][column sections...][metadata]
+//
+// Each column section holds the serialized `TensorProto` of the
+// corresponding entry of `ChunkData.data.tensors`, so a reader that projects
+// a subset of columns parses only those tensors. The metadata tail is the
+// serialized `ChunkData` with `data` cleared.
+//
+// Forward compatibility: the header records its own size and the size of a
+// column record, so fields appended by a newer writer are skipped by older
+// readers striding on the recorded sizes. `kPackedChunkVersion` only changes
+// when the layout changes incompatibly, in which case `PackedChunkView::Wrap`
+// rejects the buffer.
+
+inline constexpr uint32_t kPackedChunkMagic = 0x52564232;  // "RVB2".
+
+// Version 2 matches the columnar chunk layout it was introduced with (see
+// `ChunkData.column_streams`).
+inline constexpr uint16_t kPackedChunkVersion = 2;
+
+// Serializes `chunk` into the packed layout. Returns `InvalidArgumentError`
+// if `chunk` carries no payload (`payload_cached` or `shm_ref` references).
+absl::Status PackChunk(const ChunkData& chunk, std::string* out);
+
+// Read-only view over a packed chunk. The view borrows the buffer passed to
+// `Wrap`; the caller keeps it alive and unchanged for the lifetime of the
+// view. All offsets are validated once by `Wrap` so the accessors are plain
+// loads.
+class PackedChunkView {
+ public:
+  // Validates the magic, version and every recorded offset against the
+  // buffer bounds. Returns `InvalidArgumentError` when `data` is not a
+  // packed chunk or was written with an incompatible version.
+  static absl::Status Wrap(absl::string_view data, PackedChunkView* view);
+
+  uint64_t chunk_key() const { return chunk_key_; }
+
+  // The episode and step range of `ChunkData.sequence_range`.
+  uint64_t episode_id() const { return episode_id_; }
+  int32_t sequence_start() const { return sequence_start_; }
+  int32_t sequence_end() const { return sequence_end_; }
+
+  int num_columns() const { return num_columns_; }
+
+  // Serialized `TensorProto` of column `i`.
+  absl::string_view column(int i) const;
+
+  // Codec and delta encoding of column `i`, resolved from the column's
+  // `ColumnStream` (or the chunk level fields for chunks without one).
+  CompressionCodec column_codec(int i) const;
+  bool column_delta_encoded(int i) const;
+
+  // Parses the metadata tail, i.e. the chunk without its `data` field.
+  absl::Status Metadata(ChunkData* chunk) const;
+
+  // Reconstructs the full `ChunkData`, metadata and all columns. Returns
+  // `DataLossError` if the metadata or a column fails to parse.
+  absl::Status Unpack(ChunkData* chunk) const;
+
+ private:
+  absl::string_view data_;
+  uint64_t chunk_key_ = 0;
+  uint64_t episode_id_ = 0;
+  int32_t sequence_start_ = 0;
+  int32_t sequence_end_ = 0;
+  int num_columns_ = 0;
+  uint32_t header_size_ = 0;
+  uint32_t column_record_size_ = 0;
+  uint64_t metadata_offset_ = 0;
+  uint64_t metadata_length_ = 0;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_CHUNK_FORMAT_H_
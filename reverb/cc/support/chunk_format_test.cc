@@ -0,0 +1,123 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/chunk_format.h"
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+ChunkData MakeTestChunk() {
+  ChunkData chunk = testing::MakeChunkData(
+      42, testing::MakeSequenceRange(1001, 5, 9), /*num_tensors=*/2);
+  chunk.set_codec(COMPRESSION_SNAPPY);
+  chunk.set_delta_encoded(true);
+  auto* stream = chunk.add_column_streams();
+  stream->set_codec(COMPRESSION_NONE);
+  stream->set_delta_encoded(false);
+  return chunk;
+}
+
+TEST(ChunkFormatTest, PackedHeaderExposesHotFieldsWithoutParsing) {
+  const ChunkData chunk = MakeTestChunk();
+  std::string packed;
+  REVERB_ASSERT_OK(PackChunk(chunk, &packed));
+
+  PackedChunkView view;
+  REVERB_ASSERT_OK(PackedChunkView::Wrap(packed, &view));
+  EXPECT_EQ(view.chunk_key(), 42);
+  EXPECT_EQ(view.episode_id(), 1001);
+  EXPECT_EQ(view.sequence_start(), 5);
+  EXPECT_EQ(view.sequence_end(), 9);
+  ASSERT_EQ(view.num_columns(), 2);
+
+  // The first column has a `ColumnStream`, the second falls back to the
+  // chunk level fields.
+  EXPECT_EQ(view.column_codec(0), COMPRESSION_NONE);
+  EXPECT_FALSE(view.column_delta_encoded(0));
+  EXPECT_EQ(view.column_codec(1), COMPRESSION_SNAPPY);
+  EXPECT_TRUE(view.column_delta_encoded(1));
+
+  tensorflow::TensorProto column;
+  ASSERT_TRUE(column.ParseFromArray(view.column(1).data(),
+                                    view.column(1).size()));
+  EXPECT_EQ(column.DebugString(), chunk.data().tensors(1).DebugString());
+}
+
+TEST(ChunkFormatTest, UnpackRoundtrips) {
+  const ChunkData chunk = MakeTestChunk();
+  std::string packed;
+  REVERB_ASSERT_OK(PackChunk(chunk, &packed));
+
+  PackedChunkView view;
+  REVERB_ASSERT_OK(PackedChunkView::Wrap(packed, &view));
+  ChunkData unpacked;
+  REVERB_ASSERT_OK(view.Unpack(&unpacked));
+  EXPECT_THAT(unpacked, testing::EqualsProto(chunk));
+}
+
+TEST(ChunkFormatTest, MetadataSkipsTheColumns) {
+  ChunkData chunk = MakeTestChunk();
+  std::string packed;
+  REVERB_ASSERT_OK(PackChunk(chunk, &packed));
+
+  PackedChunkView view;
+  REVERB_ASSERT_OK(PackedChunkView::Wrap(packed, &view));
+  ChunkData metadata;
+  REVERB_ASSERT_OK(view.Metadata(&metadata));
+  chunk.clear_data();
+  EXPECT_THAT(metadata, testing::EqualsProto(chunk));
+}
+
+TEST(ChunkFormatTest, RejectsForeignBuffers) {
+  PackedChunkView view;
+  EXPECT_EQ(PackedChunkView::Wrap("not a packed chunk", &view).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(PackedChunkView::Wrap("", &view).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ChunkFormatTest, RejectsTruncatedBuffers) {
+  std::string packed;
+  REVERB_ASSERT_OK(PackChunk(MakeTestChunk(), &packed));
+  PackedChunkView view;
+  EXPECT_EQ(PackedChunkView::Wrap(
+                absl::string_view(packed).substr(0, packed.size() / 2), &view)
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ChunkFormatTest, RejectsPayloadReferences) {
+  ChunkData reference;
+  reference.set_chunk_key(42);
+  reference.set_payload_cached(true);
+  std::string packed;
+  EXPECT_EQ(PackChunk(reference, &packed).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -18,6 +18,7 @@
 #include "grpcpp/grpcpp.h"
 #include "grpcpp/impl/codegen/proto_utils.h"
 #include "absl/status/status.h"
+#include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/substitute.h"
 #include "tensorflow/core/lib/core/error_codes.pb.h"
@@ -65,8 +66,11 @@ inline std::string FormatGrpcStatus(const grpc::Status& s) {
 }
 
 inline bool IsLocalhostOrInProcess(absl::string_view hostname) {
+  // Unix domain socket peers ("unix:<path>") are by definition on the same
+  // host.
   return absl::StrContains(hostname, ":127.0.0.1:") ||
-         absl::StrContains(hostname, "[::1]") || hostname == "unknown";
+         absl::StrContains(hostname, "[::1]") ||
+         absl::StartsWith(hostname, "unix:") || hostname == "unknown";
 }
 
 }  // namespace reverb
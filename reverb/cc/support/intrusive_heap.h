@@ -29,6 +29,8 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <ostream>  // NOLINT
 #include <vector>
@@ -270,6 +272,198 @@ class IntrusiveHeap {
   Rep rep_;
 };
 
+// FlatIntrusiveHeap<T, Key, KeyAccess, KeyCompare, kArity, LinkAccess>
+//
+//   A cache-friendly d-ary variant of IntrusiveHeap. Each heap slot holds a
+//   copy of the element's sort key next to the element pointer, so sift
+//   operations compare keys that are packed contiguously in a flat array
+//   instead of dereferencing one element pointer per level. With the default
+//   arity of four the heap also has half the depth of a binary heap and the
+//   children of a slot share a cache line for small key types. For heaps with
+//   millions of elements this turns most of the cache misses of
+//   Push/Pop/Adjust into hits.
+//
+//   Elements carry the same IntrusiveHeapLink bookkeeping (via the same
+//   LinkAccess policies) as with IntrusiveHeap, so an element type can switch
+//   between the two heaps without changes. The difference in the contract is
+//   that the key of an element is cached inside the heap: mutating the fields
+//   that `KeyAccess` reads has no effect until `Adjust` is called for the
+//   element (which re-reads the key).
+//
+//   T: the element type referenced by the heap. As with IntrusiveHeap, the
+//      heap does not own its elements.
+//   Key: the sort key type copied into the heap array. Should be cheap to
+//      copy; a numeric type or a small pair/tuple.
+//   KeyAccess: a policy class providing 'Key Get(const T* elem)'.
+//   KeyCompare: a strict weak ordering over Key. The element with the least
+//      key (under KeyCompare) is popped first.
+//   kArity: number of children per heap slot. Must be at least 2.
+//   LinkAccess: see IntrusiveHeap.
+template <typename T, typename Key, typename KeyAccess,
+          typename KeyCompare = std::less<Key>, size_t kArity = 4,
+          typename LinkAccess = DefaultIntrusiveHeapLinkAccess<T> >
+class FlatIntrusiveHeap {
+ public:
+  static_assert(kArity >= 2, "kArity must be at least 2.");
+
+  typedef typename IntrusiveHeapLink::size_type size_type;
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+
+  explicit FlatIntrusiveHeap(const KeyAccess& key_access = KeyAccess(),
+                             const KeyCompare& compare = KeyCompare(),
+                             const LinkAccess& link_access = LinkAccess())
+      : key_access_(key_access),
+        compare_(compare),
+        link_access_(link_access) {}
+
+  size_type size() const { return heap_.size(); }
+
+  bool empty() const { return heap_.empty(); }
+
+  // Return the top element, but don't remove it.
+  pointer top() const {
+    REVERB_CHECK(!empty());
+    return heap_[0].elem;
+  }
+
+  // Remove the top() pointer from the heap and return it.
+  pointer Pop() {
+    pointer t = top();
+    Remove(t);
+    return t;
+  }
+
+  // Insert 't' into the heap.
+  void Push(pointer t) {
+    SetPositionOf(t, heap_.size());
+    heap_.push_back({key_access_.Get(t), t});
+    FixHeapUp(heap_.size() - 1);
+  }
+
+  // Insert all elements of 'ts' and restore the heap invariant with a single
+  // bottom-up heapify sweep. Building a heap of n elements this way is O(n),
+  // compared to O(n log n) for n individual Push calls.
+  void BulkPush(const std::vector<pointer>& ts) {
+    heap_.reserve(heap_.size() + ts.size());
+    for (pointer t : ts) {
+      SetPositionOf(t, heap_.size());
+      heap_.push_back({key_access_.Get(t), t});
+    }
+    if (heap_.size() < 2) return;
+    for (size_type h = (heap_.size() - 2) / kArity + 1; h-- > 0;) {
+      FixHeapDown(h);
+    }
+  }
+
+  // Adjust the heap to accommodate changes in '*t'.
+  void Adjust(pointer t) {
+    REVERB_CHECK(Contains(t));
+    size_type h = GetPositionOf(t);
+    heap_[h].key = key_access_.Get(t);
+    FixHeap(h);
+  }
+
+  // Remove the specified pointer from the heap.
+  void Remove(pointer t) {
+    REVERB_CHECK(Contains(t));
+    size_type h = GetPositionOf(t);
+    SetPositionOf(t, IntrusiveHeapLink::kNotMember);
+    if (h == heap_.size() - 1) {
+      // Fast path for removing from back of heap.
+      heap_.pop_back();
+      return;
+    }
+    // Move the entry from the back of the heap to overwrite 't's slot.
+    heap_[h] = heap_.back();
+    SetPositionOf(heap_[h].elem, h);
+    heap_.pop_back();
+    FixHeap(h);  // Restore the heap invariant.
+  }
+
+  void Clear() { heap_.clear(); }
+
+  bool Contains(const_pointer t) const {
+    size_type h = GetPositionOf(t);
+    return (h != IntrusiveHeapLink::kNotMember) && (h < size()) &&
+           heap_[h].elem == t;
+  }
+
+  void reserve(size_type n) { heap_.reserve(n); }
+
+  size_type capacity() const { return heap_.capacity(); }
+
+ private:
+  struct Entry {
+    Key key;
+    pointer elem;
+  };
+
+  size_type GetPositionOf(const_pointer t) const {
+    return link_access_.Get(t).get();
+  }
+
+  void SetPositionOf(pointer t, size_type pos) const {
+    return link_access_.Set(t, IntrusiveHeapLink(pos));
+  }
+
+  // Restore the heap invariant for the (possibly out of place) entry in slot
+  // 'h'.
+  void FixHeap(size_type h) {
+    if (h != 0 && compare_(heap_[h].key, heap_[(h - 1) / kArity].key)) {
+      FixHeapUp(h);
+    } else {
+      FixHeapDown(h);
+    }
+  }
+
+  void FixHeapUp(size_type h) {
+    Entry e = heap_[h];
+    while (h != 0) {
+      size_type parent = (h - 1) / kArity;
+      if (compare_(heap_[parent].key, e.key)) {
+        break;
+      }
+      heap_[h] = heap_[parent];
+      SetPositionOf(heap_[h].elem, h);
+      h = parent;
+    }
+    heap_[h] = e;
+    SetPositionOf(e.elem, h);
+  }
+
+  void FixHeapDown(size_type h) {
+    Entry e = heap_[h];
+    for (;;) {
+      size_type kid = h * kArity + 1;
+      if (kid >= heap_.size()) {
+        break;
+      }
+      const size_type end = std::min(kid + kArity, heap_.size());
+      size_type best = kid;
+      for (++kid; kid < end; ++kid) {
+        if (compare_(heap_[kid].key, heap_[best].key)) {
+          best = kid;
+        }
+      }
+      if (compare_(e.key, heap_[best].key)) {
+        break;
+      }
+      heap_[h] = heap_[best];
+      SetPositionOf(heap_[h].elem, h);
+      h = best;
+    }
+    heap_[h] = e;
+    SetPositionOf(e.elem, h);
+  }
+
+  KeyAccess key_access_;
+  KeyCompare compare_;
+  LinkAccess link_access_;
+  std::vector<Entry> heap_;
+};
+
 }  // namespace reverb
 }  // namespace deepmind
 
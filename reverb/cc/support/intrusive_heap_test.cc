@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <string>
+#include <utility>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -211,6 +212,123 @@ TEST_F(IntrusiveHeapTest, InheritElement) {
   }
 }
 
+class FlatIntrusiveHeapTest : public testing::Test {
+ protected:
+  struct Elem {
+    int32_t val;
+    int iota;
+    IntrusiveHeapLink heap;  // position in the heap
+  };
+
+  struct ElemKeyAccess {
+    std::pair<int32_t, int> Get(const Elem* e) const {
+      return std::make_pair(e->val, e->iota);
+    }
+  };
+
+  struct ElemValLess {
+    bool operator()(const Elem& e1, const Elem& e2) const {
+      return std::make_pair(e1.val, e1.iota) < std::make_pair(e2.val, e2.iota);
+    }
+  };
+
+  typedef FlatIntrusiveHeap<Elem, std::pair<int32_t, int>, ElemKeyAccess>
+      ElemHeap;
+
+  absl::BitGen rnd_;
+  ElemHeap heap_;
+  std::vector<Elem> elems_;     // Storage for items in the heap
+  std::vector<Elem> expected_;  // Copy of the elements, for reference
+
+  void BuildHeap() {
+    elems_.resize(kNumElems);
+    for (int i = 0; i < kNumElems; i++) {
+      elems_[i].val = absl::Uniform<uint32_t>(rnd_);
+      elems_[i].iota = i;
+      heap_.Push(&elems_[i]);
+      expected_.push_back(elems_[i]);
+    }
+  }
+
+  // Pop the elements from the heap, verifying they are as expected.
+  void VerifyHeap() {
+    EXPECT_EQ(expected_.size(), heap_.size());
+
+    std::sort(expected_.begin(), expected_.end(), ElemValLess());
+
+    for (int i = 0; i < expected_.size(); i++) {
+      ASSERT_FALSE(heap_.empty());
+      Elem* e = heap_.Pop();
+      EXPECT_EQ(expected_[i].iota, e->iota) << i;
+      EXPECT_EQ(expected_[i].val, e->val) << i;
+    }
+
+    EXPECT_EQ(0, heap_.size());
+    EXPECT_TRUE(heap_.empty());
+  }
+};
+
+TEST_F(FlatIntrusiveHeapTest, PushPop) {
+  BuildHeap();
+  VerifyHeap();
+}
+
+TEST_F(FlatIntrusiveHeapTest, Contains) {
+  Elem dummy;
+  dummy.val = 8675309;
+  dummy.iota = 123456;
+  EXPECT_FALSE(heap_.Contains(&dummy));
+  heap_.Push(&dummy);
+  EXPECT_TRUE(heap_.Contains(&dummy));
+  heap_.Clear();
+  EXPECT_FALSE(heap_.Contains(&dummy));
+}
+
+TEST_F(FlatIntrusiveHeapTest, Remove) {
+  BuildHeap();
+
+  // Remove the second half of the elements.
+  for (int i = kNumElems / 2; i < kNumElems; i++) {
+    heap_.Remove(&elems_[i]);
+  }
+  expected_.resize(kNumElems / 2);
+
+  VerifyHeap();
+}
+
+TEST_F(FlatIntrusiveHeapTest, Adjust) {
+  BuildHeap();
+
+  // Adjust the weights of all elements. The heap caches keys so the change
+  // must only take effect through Adjust.
+  for (int i = 0; i < kNumElems; i++) {
+    elems_[i].val = absl::Uniform<uint32_t>(rnd_);
+    expected_[i].val = elems_[i].val;
+    heap_.Adjust(&elems_[i]);
+  }
+
+  VerifyHeap();
+}
+
+TEST_F(FlatIntrusiveHeapTest, HigherArities) {
+  std::vector<Elem> elems(kNumElems);
+  std::vector<Elem> expected;
+  FlatIntrusiveHeap<Elem, std::pair<int32_t, int>, ElemKeyAccess,
+                    std::less<std::pair<int32_t, int>>, 8>
+      heap;
+  for (int i = 0; i < kNumElems; i++) {
+    elems[i].val = absl::Uniform<uint32_t>(rnd_);
+    elems[i].iota = i;
+    heap.Push(&elems[i]);
+    expected.push_back(elems[i]);
+  }
+  std::sort(expected.begin(), expected.end(), ElemValLess());
+  for (int i = 0; i < expected.size(); i++) {
+    ASSERT_FALSE(heap.empty());
+    EXPECT_EQ(expected[i].iota, heap.Pop()->iota) << i;
+  }
+}
+
 class SyntheticLinkTest : public testing::Test {
  public:
   struct Element {
@@ -0,0 +1,106 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_ITEM_ARENA_H_
+#define REVERB_CC_SUPPORT_ITEM_ARENA_H_
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Slot-indexed arena of shared item nodes.
+//
+// `Table` used to map item keys directly to `std::shared_ptr` nodes, making
+// every bucket of its index 24 bytes wide. Keeping the owners in a
+// slot-indexed arena and storing 4-byte slot numbers in the index doubles the
+// probe density of the hash map; a lookup becomes a single probe plus one
+// access into the contiguous slot array. Ownership stays shared (rather than
+// unique) because in-flight sample responses, extensions and checkpoint
+// snapshots hold references to items after they have left the table.
+//
+// Slots of removed items are recycled through a free list, so slot numbers
+// stay dense and the arena's memory is bounded by the peak number of live
+// items. The caller owns synchronization; `Table` accesses the arena while
+// holding its mutex.
+template <typename T>
+class ItemArena {
+ public:
+  using Slot = uint32_t;
+
+  // Value of a slot field that is not (or no longer) backed by the arena.
+  static constexpr Slot kInvalidSlot = std::numeric_limits<Slot>::max();
+
+  // Stores `value` and returns the slot it is stored in.
+  Slot Add(std::shared_ptr<T> value) {
+    Slot slot;
+    if (free_slots_.empty()) {
+      slot = slots_.size();
+      slots_.push_back(std::move(value));
+    } else {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+      slots_[slot] = std::move(value);
+    }
+    return slot;
+  }
+
+  // Releases the slot for reuse and returns the owning reference stored in it
+  // so that the caller can defer destruction of the node (e.g. through
+  // `Table`'s deferred deletion list). Must not be called twice for the same
+  // slot.
+  std::shared_ptr<T> Release(Slot slot) {
+    free_slots_.push_back(slot);
+    return std::move(slots_[slot]);
+  }
+
+  // Releases all slots.
+  void Clear() {
+    slots_.clear();
+    free_slots_.clear();
+  }
+
+  // Raw access to the stored node. The pointer is invalidated when the slot
+  // is released but, unlike references into the slot array, survives arena
+  // growth.
+  T* get(Slot slot) const { return slots_[slot].get(); }
+
+  // Owning reference stored in the slot. The reference is invalidated when
+  // `Add` grows the arena; copy it before inserting new values.
+  const std::shared_ptr<T>& shared(Slot slot) const { return slots_[slot]; }
+
+  // Mutable access to the stored owner, used to swap in a fresh node for
+  // copy-on-write mutations. Invalidated when `Add` grows the arena.
+  std::shared_ptr<T>* mutable_shared(Slot slot) { return &slots_[slot]; }
+
+  // Number of live items in the arena.
+  int64_t size() const { return slots_.size() - free_slots_.size(); }
+
+ private:
+  std::vector<std::shared_ptr<T>> slots_;
+
+  // Slots of removed items available for reuse.
+  std::vector<Slot> free_slots_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_ITEM_ARENA_H_
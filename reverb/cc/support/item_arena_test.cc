@@ -0,0 +1,90 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/item_arena.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+TEST(ItemArenaTest, StoresAndReturnsValues) {
+  ItemArena<int> arena;
+  uint32_t slot = arena.Add(std::make_shared<int>(42));
+  EXPECT_EQ(*arena.get(slot), 42);
+  EXPECT_EQ(*arena.shared(slot), 42);
+  EXPECT_EQ(arena.size(), 1);
+}
+
+TEST(ItemArenaTest, ReleasedSlotsAreRecycled) {
+  ItemArena<int> arena;
+  uint32_t first = arena.Add(std::make_shared<int>(1));
+  uint32_t second = arena.Add(std::make_shared<int>(2));
+  EXPECT_EQ(arena.size(), 2);
+
+  std::shared_ptr<int> released = arena.Release(first);
+  EXPECT_EQ(*released, 1);
+  EXPECT_EQ(arena.size(), 1);
+
+  // The freed slot is handed out again and the surviving value is untouched.
+  uint32_t third = arena.Add(std::make_shared<int>(3));
+  EXPECT_EQ(third, first);
+  EXPECT_EQ(*arena.get(third), 3);
+  EXPECT_EQ(*arena.get(second), 2);
+  EXPECT_EQ(arena.size(), 2);
+}
+
+TEST(ItemArenaTest, ReleaseTransfersOwnership) {
+  ItemArena<int> arena;
+  uint32_t slot = arena.Add(std::make_shared<int>(7));
+  std::weak_ptr<int> weak = arena.shared(slot);
+
+  std::shared_ptr<int> released = arena.Release(slot);
+  EXPECT_FALSE(weak.expired());
+  released.reset();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST(ItemArenaTest, MutableSharedSwapsNodes) {
+  ItemArena<int> arena;
+  uint32_t slot = arena.Add(std::make_shared<int>(1));
+  std::shared_ptr<int> original = arena.shared(slot);
+
+  // Swapping in a fresh node (as done for copy-on-write mutations) leaves
+  // existing references to the original untouched.
+  *arena.mutable_shared(slot) = std::make_shared<int>(2);
+  EXPECT_EQ(*arena.get(slot), 2);
+  EXPECT_EQ(*original, 1);
+}
+
+TEST(ItemArenaTest, ClearReleasesAllSlots) {
+  ItemArena<int> arena;
+  arena.Add(std::make_shared<int>(1));
+  arena.Add(std::make_shared<int>(2));
+  arena.Clear();
+  EXPECT_EQ(arena.size(), 0);
+
+  uint32_t slot = arena.Add(std::make_shared<int>(3));
+  EXPECT_EQ(slot, 0);
+  EXPECT_EQ(arena.size(), 1);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,109 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_ITEM_METADATA_H_
+#define REVERB_CC_SUPPORT_ITEM_METADATA_H_
+
+#include <vector>
+
+#include <cstdint>
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Contiguous struct-of-arrays store for the hot metadata of table items.
+//
+// `Table` keeps its items as individually heap allocated nodes behind a hash
+// map, so operations that only need an item's priority or sample count (the
+// sampling bookkeeping, extension snapshots, priority mutations) chase a
+// pointer and drag the whole item proto through the cache. This store keeps
+// the frequently accessed fields of every item -- key, priority, sample count
+// and total chunk byte size -- in parallel arrays indexed by slot, so such
+// operations touch a couple of cache lines instead.
+//
+// Slots of removed items are recycled through a free list, keeping the arrays
+// contiguous with their memory bounded by the peak number of live items. The
+// caller owns synchronization; `Table` accesses the store while holding its
+// mutex.
+class ItemMetadataStore {
+ public:
+  // Value of a slot field that is not (or no longer) backed by the store.
+  static constexpr int64_t kInvalidSlot = -1;
+
+  // Adds an item and returns the slot its metadata is stored in.
+  int64_t Add(uint64_t key, double priority, int32_t times_sampled,
+              int64_t num_bytes) {
+    int64_t slot;
+    if (free_slots_.empty()) {
+      slot = keys_.size();
+      keys_.push_back(key);
+      priorities_.push_back(priority);
+      times_sampled_.push_back(times_sampled);
+      num_bytes_.push_back(num_bytes);
+    } else {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+      keys_[slot] = key;
+      priorities_[slot] = priority;
+      times_sampled_[slot] = times_sampled;
+      num_bytes_[slot] = num_bytes;
+    }
+    return slot;
+  }
+
+  // Releases the slot for reuse. Must not be called twice for the same slot.
+  void Remove(int64_t slot) { free_slots_.push_back(slot); }
+
+  // Releases all slots.
+  void Clear() {
+    keys_.clear();
+    priorities_.clear();
+    times_sampled_.clear();
+    num_bytes_.clear();
+    free_slots_.clear();
+  }
+
+  uint64_t key(int64_t slot) const { return keys_[slot]; }
+  double priority(int64_t slot) const { return priorities_[slot]; }
+  int32_t times_sampled(int64_t slot) const { return times_sampled_[slot]; }
+  int64_t num_bytes(int64_t slot) const { return num_bytes_[slot]; }
+
+  void set_priority(int64_t slot, double priority) {
+    priorities_[slot] = priority;
+  }
+
+  // Increments the sample count of the slot and returns the new count.
+  int32_t IncrementTimesSampled(int64_t slot) {
+    return ++times_sampled_[slot];
+  }
+
+  // Number of live items in the store.
+  int64_t size() const { return keys_.size() - free_slots_.size(); }
+
+ private:
+  std::vector<uint64_t> keys_;
+  std::vector<double> priorities_;
+  std::vector<int32_t> times_sampled_;
+  std::vector<int64_t> num_bytes_;
+
+  // Slots of removed items available for reuse.
+  std::vector<int64_t> free_slots_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_ITEM_METADATA_H_
@@ -0,0 +1,68 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/item_metadata.h"
+
+#include "gtest/gtest.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+TEST(ItemMetadataStoreTest, StoresAndMutatesFields) {
+  ItemMetadataStore store;
+  int64_t slot = store.Add(/*key=*/5, /*priority=*/1.5, /*times_sampled=*/0,
+                           /*num_bytes=*/100);
+  EXPECT_EQ(store.key(slot), 5);
+  EXPECT_EQ(store.priority(slot), 1.5);
+  EXPECT_EQ(store.times_sampled(slot), 0);
+  EXPECT_EQ(store.num_bytes(slot), 100);
+
+  store.set_priority(slot, 2.5);
+  EXPECT_EQ(store.priority(slot), 2.5);
+  EXPECT_EQ(store.IncrementTimesSampled(slot), 1);
+  EXPECT_EQ(store.times_sampled(slot), 1);
+}
+
+TEST(ItemMetadataStoreTest, RemovedSlotsAreRecycled) {
+  ItemMetadataStore store;
+  int64_t first = store.Add(1, 1.0, 0, 10);
+  int64_t second = store.Add(2, 2.0, 0, 20);
+  EXPECT_EQ(store.size(), 2);
+
+  store.Remove(first);
+  EXPECT_EQ(store.size(), 1);
+
+  // The freed slot is handed out again and the surviving item is untouched.
+  int64_t third = store.Add(3, 3.0, 0, 30);
+  EXPECT_EQ(third, first);
+  EXPECT_EQ(store.key(third), 3);
+  EXPECT_EQ(store.key(second), 2);
+  EXPECT_EQ(store.size(), 2);
+}
+
+TEST(ItemMetadataStoreTest, ClearReleasesAllSlots) {
+  ItemMetadataStore store;
+  store.Add(1, 1.0, 0, 10);
+  store.Add(2, 2.0, 0, 20);
+  store.Clear();
+  EXPECT_EQ(store.size(), 0);
+  EXPECT_EQ(store.Add(3, 3.0, 0, 30), 0);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -17,6 +17,7 @@
 
 #include <limits>
 
+#include "absl/base/optimization.h"
 #include "absl/random/random.h"
 
 namespace deepmind::reverb::internal {
@@ -38,6 +39,45 @@ class UniformKeyGenerator : public KeyGenerator {
   absl::BitGen bit_gen_;
 };
 
+// Combines a randomly drawn shard prefix in the high bits with a local
+// counter in the low bits. Generating a key is a plain increment, so writers
+// that assign keys on their hot path (item and chunk key assignment) avoid
+// the cost of drawing a fresh random number per key while the random prefix
+// keeps keys unique across generators and processes with the same
+// probabilistic guarantees as uniform draws. A fresh prefix is drawn when the
+// counter space of the current one is exhausted.
+//
+// Like `UniformKeyGenerator`, instances are not thread-safe; each writer
+// owns its own generator so keys are produced with zero cross-thread
+// coordination.
+class ShardedKeyGenerator : public KeyGenerator {
+ public:
+  // Number of low bits counted through before a new shard prefix is drawn.
+  static constexpr int kCounterBits = 24;
+
+  ShardedKeyGenerator() { DrawShardPrefix(); }
+
+  uint64_t Generate() override {
+    if (ABSL_PREDICT_FALSE(next_ == limit_)) {
+      DrawShardPrefix();
+    }
+    return next_++;
+  }
+
+ private:
+  void DrawShardPrefix() {
+    const uint64_t prefix =
+        absl::Uniform<uint64_t>(bit_gen_, 0, uint64_t{1} << (64 - kCounterBits))
+        << kCounterBits;
+    next_ = prefix;
+    limit_ = prefix + (uint64_t{1} << kCounterBits);
+  }
+
+  absl::BitGen bit_gen_;
+  uint64_t next_;
+  uint64_t limit_;
+};
+
 }  // namespace deepmind::reverb::internal
 
 #endif  // REVERB_CC_SUPPORT_KEY_GENERATORS_H_
@@ -0,0 +1,195 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_MPSC_QUEUE_H_
+#define REVERB_CC_SUPPORT_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Multi-producer single-consumer variant of `UnboundedQueue` with the same
+// closable interface. Producers push onto an intrusive linked list with a
+// single atomic exchange (Vyukov style), so any number of producer threads
+// never contend on a mutex; this matters on the server's insert path where
+// many gRPC threads hand tasks to one worker and a shared lock would sit on
+// the ack path of every insert.
+//
+// The consumer side is serialized by a mutex. With a single consumer thread
+// that mutex is uncontended, and it doubles as the place where a consumer
+// that found the queue empty sleeps. A producer only touches the mutex when
+// the consumer has advertised that it is about to sleep, i.e. when the queue
+// just went empty.
+//
+// `Close` and `SetLastItemPushed` have the same semantics as on
+// `UnboundedQueue`.
+template <typename T>
+class MpscUnboundedQueue {
+ public:
+  // Consumer operations are correct for concurrent callers (they hold the
+  // consumer mutex) but only lock-freedom of the producers is the point; use
+  // `UnboundedQueue` when several threads pop in steady state.
+  static constexpr bool kSingleConsumer = true;
+
+  MpscUnboundedQueue() {
+    Node* stub = new Node();
+    head_.store(stub, std::memory_order_relaxed);
+    tail_ = stub;
+  }
+
+  ~MpscUnboundedQueue() {
+    absl::MutexLock lock(&mu_);
+    Node* node = tail_;
+    while (node != nullptr) {
+      Node* next = node->next.load(std::memory_order_relaxed);
+      delete node;
+      node = next;
+    }
+  }
+
+  // Pushes an item to the queue. On success, `true` is returned. If the queue
+  // is closed, `false` is returned. Lock free unless the consumer is asleep.
+  bool Push(T x) {
+    if (closed_.load(std::memory_order_acquire) ||
+        last_item_pushed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    Node* node = new Node(std::move(x));
+    size_.fetch_add(1, std::memory_order_relaxed);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+    // Paired with the fence in `Pop`: either this load sees the consumer
+    // about to sleep (and wakes it) or the consumer's recheck sees the node
+    // published above.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_sleeping_.load(std::memory_order_relaxed)) {
+      absl::MutexLock lock(&wake_mu_);
+      ++wakeups_;
+    }
+    return true;
+  }
+
+  // Marks that no more items will be pushed to the queue.
+  void SetLastItemPushed() {
+    last_item_pushed_.store(true, std::memory_order_release);
+    absl::MutexLock lock(&wake_mu_);
+    ++wakeups_;
+  }
+
+  // Closes the queue. All pending and future calls to `Push()` and `Pop()`
+  // are unblocked and return false without performing the operation.
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+    absl::MutexLock lock(&wake_mu_);
+    ++wakeups_;
+  }
+
+  // Removes an element from the queue and move-assigns it to *item. Blocks if
+  // the queue is empty. On success, `true` is returned. If the queue was
+  // closed, `false` is returned.
+  //
+  // If called after `SetLastItemPushed` and the final item of the queue is
+  // returned then queue is closed.
+  bool Pop(T* item) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    while (true) {
+      if (closed_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      if (TryPopLocked(item)) {
+        return true;
+      }
+      if (last_item_pushed_.load(std::memory_order_acquire)) {
+        // The queue is empty and no further push can succeed.
+        closed_.store(true, std::memory_order_release);
+        return false;
+      }
+      int64_t seen;
+      {
+        absl::MutexLock wake_lock(&wake_mu_);
+        seen = wakeups_;
+      }
+      consumer_sleeping_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      // Recheck after advertising the sleep; a producer that published its
+      // node before our fence is visible here, one that published after it
+      // sees `consumer_sleeping_` and bumps `wakeups_`.
+      if (TryPopLocked(item)) {
+        consumer_sleeping_.store(false, std::memory_order_relaxed);
+        return true;
+      }
+      {
+        absl::MutexLock wake_lock(&wake_mu_);
+        auto woken = [this, seen]() { return wakeups_ != seen; };
+        wake_mu_.Await(absl::Condition(&woken));
+      }
+      consumer_sleeping_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  // Current number of elements. May be momentarily stale when producers are
+  // active.
+  int size() const { return size_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Node {
+    Node() = default;
+    explicit Node(T v) : value(std::move(v)) {}
+
+    std::atomic<Node*> next{nullptr};
+    T value;
+  };
+
+  bool TryPopLocked(T* item) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Node* next = tail_->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    *item = std::move(next->value);
+    delete tail_;
+    tail_ = next;
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Producers append behind `head_`; `tail_` points at the consumed stub
+  // whose `next` is the oldest unconsumed node.
+  std::atomic<Node*> head_;
+
+  // Serializes consumers; uncontended with a single consumer thread.
+  mutable absl::Mutex mu_;
+  Node* tail_ ABSL_GUARDED_BY(mu_);
+
+  // A consumer that found the queue empty advertises itself here before
+  // waiting for `wakeups_` to move.
+  std::atomic<bool> consumer_sleeping_{false};
+  absl::Mutex wake_mu_;
+  int64_t wakeups_ ABSL_GUARDED_BY(wake_mu_) = 0;
+
+  std::atomic<int> size_{0};
+  std::atomic<bool> closed_{false};
+  std::atomic<bool> last_item_pushed_{false};
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_MPSC_QUEUE_H_
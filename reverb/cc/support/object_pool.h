@@ -0,0 +1,114 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_OBJECT_POOL_H_
+#define REVERB_CC_SUPPORT_OBJECT_POOL_H_
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// A thread-safe pool that recycles heap allocated objects of type T.
+//
+// `Acquire` hands out objects as `std::shared_ptr<T>`; when the last
+// reference goes away the object is reset and returned to the pool instead of
+// being freed, so steady-state acquire/release churn performs no
+// general-purpose heap traffic for the object itself (and keeps any
+// internally owned buffers, e.g. vector capacity, warm). At most `capacity`
+// idle objects are retained; beyond that released objects are destroyed.
+//
+// The pool must be owned through a `std::shared_ptr` (see `Create`) since
+// handed out objects keep the pool alive until they are released, even if the
+// owner of the pool has already been destroyed.
+template <typename T>
+class ObjectPool : public std::enable_shared_from_this<ObjectPool<T>> {
+ public:
+  // Called on an object before it is returned to the pool, typically to
+  // release references held by the object while keeping its buffers.
+  using ResetFn = std::function<void(T*)>;
+
+  static std::shared_ptr<ObjectPool<T>> Create(size_t capacity,
+                                               ResetFn reset = nullptr) {
+    return std::shared_ptr<ObjectPool<T>>(
+        new ObjectPool<T>(capacity, std::move(reset)));
+  }
+
+  ~ObjectPool() = default;
+
+  // Returns a pooled object, or a newly allocated one if the pool is empty.
+  // The object is in the state left behind by `reset` (or default constructed
+  // if it was never pooled).
+  std::shared_ptr<T> Acquire() {
+    std::unique_ptr<T> object;
+    {
+      absl::MutexLock lock(&mu_);
+      if (!free_.empty()) {
+        object = std::move(free_.back());
+        free_.pop_back();
+      }
+    }
+    if (object == nullptr) {
+      object = std::make_unique<T>();
+    }
+    return std::shared_ptr<T>(object.release(),
+                              Releaser{this->shared_from_this()});
+  }
+
+  // Number of idle objects currently held by the pool.
+  size_t NumIdle() const {
+    absl::MutexLock lock(&mu_);
+    return free_.size();
+  }
+
+ private:
+  ObjectPool(size_t capacity, ResetFn reset)
+      : capacity_(capacity), reset_(std::move(reset)) {}
+
+  struct Releaser {
+    std::shared_ptr<ObjectPool<T>> pool;
+
+    void operator()(T* object) const {
+      pool->Release(std::unique_ptr<T>(object));
+    }
+  };
+
+  void Release(std::unique_ptr<T> object) {
+    if (reset_) reset_(object.get());
+    absl::MutexLock lock(&mu_);
+    if (free_.size() < capacity_) {
+      free_.push_back(std::move(object));
+    }
+    // Otherwise the object is destroyed when `object` goes out of scope.
+  }
+
+  const size_t capacity_;
+  const ResetFn reset_;
+
+  mutable absl::Mutex mu_;
+  std::vector<std::unique_ptr<T>> free_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_OBJECT_POOL_H_
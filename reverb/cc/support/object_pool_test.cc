@@ -0,0 +1,71 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/object_pool.h"
+
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+TEST(ObjectPoolTest, ReleasedObjectsAreRecycled) {
+  auto pool = ObjectPool<std::vector<int>>::Create(
+      /*capacity=*/4, [](std::vector<int>* v) { v->clear(); });
+
+  auto object = pool->Acquire();
+  object->assign(100, 1);
+  auto* address = object.get();
+  object = nullptr;
+  EXPECT_EQ(pool->NumIdle(), 1);
+
+  // The recycled object is handed out again, reset but with its buffer kept.
+  object = pool->Acquire();
+  EXPECT_EQ(object.get(), address);
+  EXPECT_TRUE(object->empty());
+  EXPECT_GE(object->capacity(), 100);
+  EXPECT_EQ(pool->NumIdle(), 0);
+}
+
+TEST(ObjectPoolTest, CapacityBoundsIdleObjects) {
+  auto pool = ObjectPool<int>::Create(/*capacity=*/2);
+
+  std::vector<std::shared_ptr<int>> objects;
+  for (int i = 0; i < 5; i++) {
+    objects.push_back(pool->Acquire());
+  }
+  objects.clear();
+
+  EXPECT_EQ(pool->NumIdle(), 2);
+}
+
+TEST(ObjectPoolTest, ObjectsCanOutliveTheOwnerOfThePool) {
+  auto pool = ObjectPool<int>::Create(/*capacity=*/1);
+  auto object = pool->Acquire();
+  *object = 42;
+
+  // The object keeps the pool state alive through its deleter.
+  pool = nullptr;
+  EXPECT_EQ(*object, 42);
+  object = nullptr;
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -14,8 +14,10 @@
 
 #include "reverb/cc/support/periodic_closure.h"
 
+#include <algorithm>
 #include <functional>
 #include <string>
+#include <utility>
 
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
@@ -32,10 +34,24 @@ PeriodicClosure::~PeriodicClosure() {
 
 PeriodicClosure::PeriodicClosure(std::function<void()> fn,
                                  absl::Duration period, std::string name_prefix)
+    : PeriodicClosure(
+          [fn = std::move(fn)] {
+            fn();
+            return true;
+          },
+          period, period, std::move(name_prefix)) {}
+
+PeriodicClosure::PeriodicClosure(std::function<bool()> fn,
+                                 absl::Duration min_period,
+                                 absl::Duration max_period,
+                                 std::string name_prefix)
     : fn_(std::move(fn)),
-      period_(period),
+      period_(min_period),
+      max_period_(max_period),
       name_prefix_(std::move(name_prefix)) {
   REVERB_CHECK_GE(period_, absl::ZeroDuration()) << "period should be >= 0";
+  REVERB_CHECK_GE(max_period_, period_)
+      << "max_period should be >= min_period";
 }
 
 absl::Status PeriodicClosure::Start() {
@@ -49,20 +65,38 @@ absl::Status PeriodicClosure::Start() {
         "PeriodicClosure: Start called when closure already running");
   }
   worker_ = StartThread(name_prefix_, [this] {
-    for (auto next_run = absl::Now() + period_; true;) {
-      if (mu_.LockWhenWithDeadline(absl::Condition(&stopped_), next_run)) {
+    // Current period; doubles after no-op runs up to `max_period_` and falls
+    // back to `period_` after productive runs or a `Wakeup` call.
+    absl::Duration period = period_;
+    for (auto next_run = absl::Now() + period; true;) {
+      const auto stop_or_wakeup = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return stopped_ || wakeup_;
+      };
+      mu_.LockWhenWithDeadline(absl::Condition(&stop_or_wakeup), next_run);
+      if (stopped_) {
         mu_.Unlock();
         return;
       }
+      if (wakeup_) {
+        wakeup_ = false;
+        period = period_;
+      }
       mu_.Unlock();
-      next_run = absl::Now() + period_;
 
-      fn_();
+      const absl::Time started = absl::Now();
+      const bool did_work = fn_();
+      period = did_work ? period_ : std::min(period * 2, max_period_);
+      next_run = started + period;
     }
   });
   return absl::OkStatus();
 }
 
+void PeriodicClosure::Wakeup() {
+  absl::MutexLock lock(&mu_);
+  wakeup_ = true;
+}
+
 absl::Status PeriodicClosure::Stop() {
   {
     absl::MutexLock l(&mu_);
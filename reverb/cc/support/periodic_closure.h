@@ -72,6 +72,15 @@ class PeriodicClosure {
   PeriodicClosure(std::function<void()> fn, absl::Duration period,
                   std::string name_prefix = "");
 
+  // Adaptive variant. The closure reports whether its run did any work; after
+  // a no-op run the period doubles, up to `max_period`, and after a
+  // productive run it falls back to `min_period`. This lets rarely productive
+  // closures (stats refresh, expiration checks, ...) stop waking cores on an
+  // idle server while still reacting at `min_period` when there is work.
+  // `Wakeup` re-arms a backed off closure promptly.
+  PeriodicClosure(std::function<bool()> fn, absl::Duration min_period,
+                  absl::Duration max_period, std::string name_prefix = "");
+
   // Dies if `Start` but not `Stop` called.
   ~PeriodicClosure();
 
@@ -87,22 +96,39 @@ class PeriodicClosure {
   // Returns InvalidArgumentError if called more than once.
   absl::Status Stop();
 
+  // Signals activity to a closure constructed with the adaptive variant: the
+  // closure runs promptly and its period is reset to `min_period`. Callers
+  // use this when they know new work has appeared (e.g. the table received an
+  // insert after being idle) so a backed off closure does not sit out its
+  // full period. Safe to call at any time, including when the closure is not
+  // running; no-op for fixed period closures beyond triggering a run.
+  void Wakeup();
+
   // PeriodicClosure is neither copyable nor movable.
   PeriodicClosure(const PeriodicClosure&) = delete;
   PeriodicClosure& operator=(const PeriodicClosure&) = delete;
 
  private:
-  // Closure called by the background thread.
-  const std::function<void()> fn_;
+  // Closure called by the background thread. Returns whether the run did any
+  // work; closures constructed with the fixed period variant always report
+  // true so their period never backs off.
+  const std::function<bool()> fn_;
 
   // The minimum duration between calls to `fn_`.
   const absl::Duration period_;
 
+  // Upper bound the period backs off to while runs are no-ops. Equal to
+  // `period_` for fixed period closures.
+  const absl::Duration max_period_;
+
   // Name prefix assigned to background thread.
   const std::string name_prefix_;
 
   // Flag to ensure that `Start` and `Stop` is not called multiple times.
   bool stopped_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Set by `Wakeup` to request a prompt run; consumed by the worker.
+  bool wakeup_ ABSL_GUARDED_BY(mu_) = false;
   absl::Mutex mu_;
 
   // Background thread constructed in `Start` and joined in `Stop`.
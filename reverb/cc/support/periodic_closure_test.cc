@@ -76,6 +76,48 @@ TEST(PeriodicClosureTest, MinInterval) {
   ASSERT_LT(actual_calls, 3);
 }
 
+TEST(PeriodicClosureTest, AdaptiveClosureBacksOffWhenIdle) {
+  std::atomic_int actual_calls(0);
+  PeriodicClosure pc([&]() -> bool {
+    ++actual_calls;
+    return false;  // Every run is a no-op.
+  },
+                     absl::Milliseconds(10), absl::Seconds(10));
+
+  REVERB_EXPECT_OK(pc.Start());
+  absl::SleepFor(absl::Milliseconds(500));
+  REVERB_EXPECT_OK(pc.Stop());
+
+  // The period doubles after every no-op run (10ms, 20ms, 40ms, ...) so only
+  // a handful of runs fit in the window; a fixed 10ms period would fit ~50.
+  ASSERT_GT(actual_calls, 0);
+  ASSERT_LT(actual_calls, 10);
+}
+
+TEST(PeriodicClosureTest, WakeupRearmsBackedOffClosure) {
+  std::atomic_int actual_calls(0);
+  PeriodicClosure pc([&]() -> bool {
+    ++actual_calls;
+    return false;
+  },
+                     absl::Milliseconds(10), absl::Seconds(10));
+
+  REVERB_EXPECT_OK(pc.Start());
+  // After six no-op runs the period has grown to 640ms.
+  test::WaitFor([&]() { return actual_calls >= 6; }, absl::Milliseconds(10),
+                200);
+  ASSERT_GE(actual_calls, 6);
+
+  // A wakeup triggers a prompt run instead of waiting out the grown period.
+  const int calls_before = actual_calls;
+  pc.Wakeup();
+  test::WaitFor([&]() { return actual_calls > calls_before; },
+                absl::Milliseconds(10), 30);
+  EXPECT_GT(actual_calls, calls_before);
+
+  REVERB_EXPECT_OK(pc.Stop());
+}
+
 std::function<void()> DoNothing() {
   return []() {};
 }
@@ -15,6 +15,7 @@
 #ifndef REVERB_CC_SUPPORT_QUEUE_H_
 #define REVERB_CC_SUPPORT_QUEUE_H_
 
+#include <algorithm>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
@@ -22,6 +23,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "reverb/cc/errors.h"
 #include "reverb/cc/platform/logging.h"
 
 namespace deepmind {
@@ -137,7 +139,7 @@ class Queue {
     }
 
     if (closed_) {
-      return absl::CancelledError("Queue is closed.");
+      return errors::QueueClosed();
     }
 
     if (last_item_pushed_) {
@@ -193,6 +195,35 @@ class Queue {
     return true;
   }
 
+  // Removes up to `max_count` elements from the queue and appends them to
+  // `out` in fifo order. Blocks while the queue is empty. Unlike `PopBatch`,
+  // which waits for a full batch, this moves whatever is available (at least
+  // one element, at most `max_count`) under a single lock acquisition; a
+  // consumer that handles items one by one can drain bursts without a mutex
+  // round-trip per element. On success, `true` is returned. If the queue was
+  // closed, `false` is returned.
+  //
+  // If called after `SetLastItemPushed` and the final item of the queue is
+  // returned then queue is closed.
+  bool PopBatchUpTo(int max_count, std::vector<T>* out)
+      ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    ScopedIncrement ticket(&num_waiting_to_pop_);
+
+    mu_.Await(absl::Condition(+[](Queue* q) {
+        return q->closed_ || q->pushes_ > q->pops_; }, this));
+    if (closed_) return false;
+    const int64_t count = std::min<int64_t>(max_count, pushes_ - pops_);
+    for (int64_t i = 0; i < count; i++) {
+      out->push_back(std::move(buffer_[pops_ % buffer_.size()]));
+      pops_++;
+    }
+    if (pushes_ == pops_ && last_item_pushed_) {
+      closed_ = true;
+    }
+    return true;
+  }
+
   // Current number of elements.
   int size() const ABSL_LOCKS_EXCLUDED(mu_) {
     absl::ReaderMutexLock lock(&mu_);
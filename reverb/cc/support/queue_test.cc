@@ -214,6 +214,57 @@ TEST(QueueTest, PopBatchReturnsIfSetLastItemPushed) {
   EXPECT_EQ(status.code(), absl::StatusCode::kResourceExhausted);
 }
 
+TEST(QueueTest, PopBatchUpToDrainsAvailableItemsInOrder) {
+  Queue<int> q(10);
+
+  EXPECT_TRUE(q.Reserve(3));
+  q.PushBatch({0, 1, 2});
+
+  // Only three items are available so a larger maximum pops just those.
+  std::vector<int> v;
+  EXPECT_TRUE(q.PopBatchUpTo(5, &v));
+  EXPECT_THAT(v, testing::ElementsAre(0, 1, 2));
+
+  // The maximum caps the batch when more items are available.
+  EXPECT_TRUE(q.Reserve(3));
+  q.PushBatch({3, 4, 5});
+  v.clear();
+  EXPECT_TRUE(q.PopBatchUpTo(2, &v));
+  EXPECT_THAT(v, testing::ElementsAre(3, 4));
+  v.clear();
+  EXPECT_TRUE(q.PopBatchUpTo(2, &v));
+  EXPECT_THAT(v, testing::ElementsAre(5));
+}
+
+TEST(QueueTest, PopBatchUpToBlocksWhenEmptyAndReturnsFalseWhenClosed) {
+  Queue<int> q(10);
+  absl::Notification n;
+  bool ok;
+  auto t = StartThread("", [&q, &n, &ok] {
+    std::vector<int> v;
+    ok = q.PopBatchUpTo(5, &v);
+    n.Notify();
+  });
+  ASSERT_FALSE(n.WaitForNotificationWithTimeout(absl::Milliseconds(100)));
+  q.Close();
+  n.WaitForNotification();
+  EXPECT_FALSE(ok);
+}
+
+TEST(QueueTest, PopBatchUpToClosesQueueWhenLastItemPopped) {
+  Queue<int> q(10);
+  EXPECT_TRUE(q.Reserve(2));
+  q.PushBatch({0, 1});
+  q.SetLastItemPushed();
+
+  std::vector<int> v;
+  EXPECT_TRUE(q.PopBatchUpTo(5, &v));
+  EXPECT_THAT(v, testing::ElementsAre(0, 1));
+
+  // Queue is now empty and no items can be pushed so it is effectively closed.
+  EXPECT_FALSE(q.PopBatchUpTo(5, &v));
+}
+
 TEST(QueueTest, PopBatchReturnsInvalidArgumentIfBatchSizeTooBig) {
   Queue<int> q(3);
   std::vector<int> v;
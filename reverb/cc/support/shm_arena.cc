@@ -0,0 +1,197 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/shm_arena.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/logging.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Header preceding every block in the arena. The sequence is stored with
+// release semantics after the payload so a reader that observes the expected
+// sequence also observes the payload bytes.
+struct BlockHeader {
+  std::atomic<uint64_t> sequence;
+  uint64_t length;
+};
+
+static_assert(sizeof(BlockHeader) == 16, "Unexpected block header layout.");
+
+BlockHeader* HeaderAt(void* base, int64_t offset) {
+  return reinterpret_cast<BlockHeader*>(static_cast<char*>(base) + offset);
+}
+
+const BlockHeader* HeaderAt(const void* base, int64_t offset) {
+  return reinterpret_cast<const BlockHeader*>(static_cast<const char*>(base) +
+                                              offset);
+}
+
+}  // namespace
+
+absl::Status ShmArena::Create(const std::string& name, int64_t capacity,
+                              std::unique_ptr<ShmArena>* arena) {
+  if (capacity <= static_cast<int64_t>(sizeof(BlockHeader))) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("ShmArena capacity must be positive but got ", capacity,
+                     " for arena '", name, "'."));
+  }
+  const int fd =
+      shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    return absl::InternalError(absl::StrCat("Failed to create shm arena '",
+                                            name,
+                                            "': ", std::strerror(errno)));
+  }
+  if (ftruncate(fd, capacity) != 0) {
+    const std::string error = std::strerror(errno);
+    close(fd);
+    shm_unlink(name.c_str());
+    return absl::InternalError(
+        absl::StrCat("Failed to size shm arena '", name, "' to ", capacity,
+                     " bytes: ", error));
+  }
+  void* base =
+      mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return absl::InternalError(absl::StrCat("Failed to map shm arena '", name,
+                                            "': ", std::strerror(errno)));
+  }
+  *arena = absl::WrapUnique(new ShmArena(name, capacity, base, /*owned=*/true));
+  return absl::OkStatus();
+}
+
+absl::Status ShmArena::Attach(const std::string& name,
+                              std::unique_ptr<ShmArena>* arena) {
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return absl::NotFoundError(
+        absl::StrCat("Failed to open shm arena '", name,
+                     "': ", std::strerror(errno),
+                     ". Out of band transport requires the client to run on "
+                     "the same host as the server."));
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    const std::string error = std::strerror(errno);
+    close(fd);
+    return absl::InternalError(
+        absl::StrCat("Failed to stat shm arena '", name, "': ", error));
+  }
+  void* base = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return absl::InternalError(absl::StrCat("Failed to map shm arena '", name,
+                                            "': ", std::strerror(errno)));
+  }
+  *arena = absl::WrapUnique(
+      new ShmArena(name, info.st_size, base, /*owned=*/false));
+  return absl::OkStatus();
+}
+
+ShmArena::ShmArena(std::string name, int64_t capacity, void* base, bool owned)
+    : name_(std::move(name)), capacity_(capacity), base_(base), owned_(owned) {}
+
+ShmArena::~ShmArena() {
+  munmap(base_, capacity_);
+  if (owned_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+absl::Status ShmArena::Write(absl::string_view payload, BlockRef* ref) {
+  REVERB_CHECK(owned_) << "Write called on an attached (read only) arena.";
+  const int64_t block_size = sizeof(BlockHeader) + payload.size();
+  if (block_size > capacity_) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Payload of ", payload.size(), " bytes does not fit in shm arena '",
+        name_, "' of ", capacity_, " bytes."));
+  }
+  absl::MutexLock lock(&mu_);
+  // Blocks never straddle the end of the mapping; wrap to the start instead.
+  if (next_offset_ + block_size > capacity_) {
+    next_offset_ = 0;
+  }
+  const int64_t offset = next_offset_;
+  BlockHeader* header = HeaderAt(base_, offset);
+  // Invalidate the header before touching the payload bytes so a concurrent
+  // reader of the previous occupant of this region fails its sequence check
+  // instead of racing the memcpy.
+  header->sequence.store(0, std::memory_order_release);
+  header->length = payload.size();
+  std::memcpy(static_cast<char*>(base_) + offset + sizeof(BlockHeader),
+              payload.data(), payload.size());
+  header->sequence.store(next_sequence_, std::memory_order_release);
+  ref->offset = offset;
+  ref->length = payload.size();
+  ref->sequence = next_sequence_;
+  next_offset_ += block_size;
+  ++next_sequence_;
+  return absl::OkStatus();
+}
+
+absl::Status ShmArena::Read(const BlockRef& ref, std::string* payload) const {
+  if (ref.offset < 0 || ref.length < 0 ||
+      ref.offset + static_cast<int64_t>(sizeof(BlockHeader)) + ref.length >
+          capacity_) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Block reference {offset=", ref.offset,
+                     ", length=", ref.length, "} is out of bounds for shm "
+                     "arena '", name_, "' of ", capacity_, " bytes."));
+  }
+  const BlockHeader* header = HeaderAt(base_, ref.offset);
+  if (header->sequence.load(std::memory_order_acquire) != ref.sequence) {
+    return absl::DataLossError(
+        absl::StrCat("Block ", ref.sequence, " of shm arena '", name_,
+                     "' has been overwritten; the reader lagged more than ",
+                     capacity_, " bytes behind the writer."));
+  }
+  payload->assign(
+      static_cast<const char*>(base_) + ref.offset + sizeof(BlockHeader),
+      ref.length);
+  // The block may have been overwritten while it was copied; re-checking the
+  // sequence after the copy makes such a torn read detectable. The fence
+  // orders the payload reads above before the validation load below; an
+  // acquire load alone only orders against subsequent reads, so on weakly
+  // ordered CPUs the copy could otherwise be reordered past the check.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (header->sequence.load(std::memory_order_relaxed) != ref.sequence) {
+    return absl::DataLossError(
+        absl::StrCat("Block ", ref.sequence, " of shm arena '", name_,
+                     "' was overwritten while it was read."));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,119 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_SHM_ARENA_H_
+#define REVERB_CC_SUPPORT_SHM_ARENA_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// A named POSIX shared memory arena used as an out of band data plane for
+// same host clients. The server appends variable sized blocks with `Write`
+// and ships `{offset, length, sequence}` references to the client (see
+// `ChunkData.shm_ref`) instead of the bytes themselves; the client attaches
+// the arena read only with `Attach` and resolves the references with `Read`,
+// so chunk payloads move between the processes at memory speed while control
+// messages stay on gRPC.
+//
+// Allocation is a ring: a block stays valid until roughly `capacity` further
+// bytes have been written, so arenas should be sized for several seconds of
+// peak sampling throughput. Every block is preceded by a header carrying its
+// monotonically increasing sequence number; `Read` verifies the header both
+// before and after copying the payload so a block that was overwritten while
+// a lagging reader consumed it is reported as `DataLossError` instead of
+// being returned corrupt.
+//
+// `Write` is thread safe. `Read` is thread safe and may run concurrently
+// with writes in another process.
+class ShmArena {
+ public:
+  // Reference to a block returned by `Write` and required by `Read`.
+  // Mirrored on the wire by `ChunkData.ShmRef`.
+  struct BlockRef {
+    int64_t offset = 0;
+    int64_t length = 0;
+    uint64_t sequence = 0;
+  };
+
+  // Creates the shared memory object `name` of `capacity` payload bytes and
+  // maps it writable. Fails if an object with that name already exists.
+  // `name` must be a valid shm name ("/reverb_<suffix>"). The object is
+  // unlinked when the creating arena is destroyed.
+  static absl::Status Create(const std::string& name, int64_t capacity,
+                             std::unique_ptr<ShmArena>* arena);
+
+  // Maps the existing shared memory object `name` read only. Fails with
+  // `NotFoundError` if no such object exists on this host.
+  static absl::Status Attach(const std::string& name,
+                             std::unique_ptr<ShmArena>* arena);
+
+  ~ShmArena();
+
+  ShmArena(const ShmArena&) = delete;
+  ShmArena& operator=(const ShmArena&) = delete;
+
+  // Copies `payload` into the next block of the ring and returns its
+  // reference. Fails with `InvalidArgumentError` if the payload (plus its
+  // header) does not fit in the arena at all. Only valid on arenas opened
+  // with `Create`.
+  absl::Status Write(absl::string_view payload, BlockRef* ref);
+
+  // Copies the block `ref` into `payload`. Returns `DataLossError` when the
+  // block has been overwritten by the ring allocator, i.e. the reader lagged
+  // more than `capacity()` bytes behind the writer.
+  absl::Status Read(const BlockRef& ref, std::string* payload) const;
+
+  const std::string& name() const { return name_; }
+  int64_t capacity() const { return capacity_; }
+
+ private:
+  ShmArena(std::string name, int64_t capacity, void* base, bool owned);
+
+  // Name of the underlying shared memory object.
+  const std::string name_;
+
+  // Number of mapped bytes.
+  const int64_t capacity_;
+
+  // Base address of the mapping.
+  void* const base_;
+
+  // Whether this arena created (and thus unlinks) the shm object.
+  const bool owned_;
+
+  absl::Mutex mu_;
+
+  // Offset at which the next block is placed.
+  int64_t next_offset_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Sequence number of the next block. Starts at 1 so 0 never names a valid
+  // block.
+  uint64_t next_sequence_ ABSL_GUARDED_BY(mu_) = 1;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_SHM_ARENA_H_
@@ -0,0 +1,117 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/shm_arena.h"
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/status_matchers.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+std::string UniqueArenaName() {
+  absl::BitGen gen;
+  return absl::StrCat("/reverb_shm_test_", absl::Uniform<uint64_t>(gen));
+}
+
+TEST(ShmArenaTest, WriteReadRoundtrip) {
+  std::unique_ptr<ShmArena> arena;
+  REVERB_ASSERT_OK(ShmArena::Create(UniqueArenaName(), 1024, &arena));
+
+  ShmArena::BlockRef first;
+  ShmArena::BlockRef second;
+  REVERB_ASSERT_OK(arena->Write("first payload", &first));
+  REVERB_ASSERT_OK(arena->Write("second payload", &second));
+
+  std::string payload;
+  REVERB_ASSERT_OK(arena->Read(first, &payload));
+  EXPECT_EQ(payload, "first payload");
+  REVERB_ASSERT_OK(arena->Read(second, &payload));
+  EXPECT_EQ(payload, "second payload");
+}
+
+TEST(ShmArenaTest, AttachedArenaReadsBlocksOfTheCreator) {
+  const std::string name = UniqueArenaName();
+  std::unique_ptr<ShmArena> server;
+  REVERB_ASSERT_OK(ShmArena::Create(name, 1024, &server));
+
+  ShmArena::BlockRef block;
+  REVERB_ASSERT_OK(server->Write("out of band", &block));
+
+  std::unique_ptr<ShmArena> client;
+  REVERB_ASSERT_OK(ShmArena::Attach(name, &client));
+  std::string payload;
+  REVERB_ASSERT_OK(client->Read(block, &payload));
+  EXPECT_EQ(payload, "out of band");
+}
+
+TEST(ShmArenaTest, RecycledBlockIsReportedAsDataLoss) {
+  std::unique_ptr<ShmArena> arena;
+  // Small enough that a handful of writes wrap the ring.
+  REVERB_ASSERT_OK(ShmArena::Create(UniqueArenaName(), 128, &arena));
+
+  ShmArena::BlockRef stale;
+  REVERB_ASSERT_OK(arena->Write(std::string(64, 'a'), &stale));
+  ShmArena::BlockRef fresh;
+  REVERB_ASSERT_OK(arena->Write(std::string(64, 'b'), &fresh));
+  REVERB_ASSERT_OK(arena->Write(std::string(64, 'c'), &fresh));
+
+  std::string payload;
+  EXPECT_EQ(arena->Read(stale, &payload).code(),
+            absl::StatusCode::kDataLoss);
+  REVERB_ASSERT_OK(arena->Read(fresh, &payload));
+  EXPECT_EQ(payload, std::string(64, 'c'));
+}
+
+TEST(ShmArenaTest, RejectsOutOfBoundsReferences) {
+  std::unique_ptr<ShmArena> arena;
+  REVERB_ASSERT_OK(ShmArena::Create(UniqueArenaName(), 128, &arena));
+
+  ShmArena::BlockRef bogus;
+  bogus.offset = 64;
+  bogus.length = 1024;
+  bogus.sequence = 1;
+  std::string payload;
+  EXPECT_EQ(arena->Read(bogus, &payload).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ShmArenaTest, RejectsPayloadsLargerThanTheArena) {
+  std::unique_ptr<ShmArena> arena;
+  REVERB_ASSERT_OK(ShmArena::Create(UniqueArenaName(), 128, &arena));
+
+  ShmArena::BlockRef block;
+  EXPECT_EQ(arena->Write(std::string(256, 'x'), &block).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ShmArenaTest, AttachToMissingArenaFails) {
+  std::unique_ptr<ShmArena> arena;
+  EXPECT_EQ(ShmArena::Attach(UniqueArenaName(), &arena).code(),
+            absl::StatusCode::kNotFound);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -262,6 +262,41 @@ std::vector<internal::TensorSpec> SpecsFromTensors(
   return spec;
 }
 
+CompiledSignature CompileSignature(const DtypesAndShapes& dtypes_and_shapes) {
+  if (!dtypes_and_shapes.has_value()) return absl::nullopt;
+  std::vector<CompiledColumnSpec> columns;
+  columns.reserve(dtypes_and_shapes->size());
+  for (const auto& spec : *dtypes_and_shapes) {
+    CompiledColumnSpec column;
+    column.dtype = spec.dtype;
+    column.unknown_rank = spec.shape.unknown_rank();
+    if (!column.unknown_rank) {
+      column.dims.reserve(spec.shape.dims());
+      for (int i = 0; i < spec.shape.dims(); i++) {
+        column.dims.push_back(spec.shape.dim_size(i));
+      }
+    }
+    columns.push_back(std::move(column));
+  }
+  return columns;
+}
+
+bool TensorMatchesColumnSpec(const tensorflow::Tensor& tensor,
+                             const CompiledColumnSpec& spec,
+                             bool skip_leading_dim) {
+  if (tensor.dtype() != spec.dtype) return false;
+  if (spec.unknown_rank) return true;
+  const int offset = skip_leading_dim ? 1 : 0;
+  const tensorflow::TensorShape& shape = tensor.shape();
+  if (shape.dims() - offset != spec.dims.size()) return false;
+  for (int i = 0; i < spec.dims.size(); i++) {
+    if (spec.dims[i] >= 0 && spec.dims[i] != shape.dim_size(i + offset)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 }  // namespace internal
 }  // namespace reverb
 }  // namespace deepmind
@@ -70,6 +70,37 @@ std::string DtypesShapesString(const std::vector<tensorflow::Tensor>& tensors);
 std::vector<internal::TensorSpec> SpecsFromTensors(
     const std::vector<tensorflow::Tensor>& tensors);
 
+// The signature of a single column compiled down to plain integers. Checking a
+// tensor against this is a dtype comparison and a dimension-by-dimension size
+// comparison; no `PartialTensorShape` is constructed per sample.
+struct CompiledColumnSpec {
+  tensorflow::DataType dtype;
+
+  // If set then any rank (and thus any shape) is accepted and `dims` is empty.
+  bool unknown_rank;
+
+  // Size of each dimension with -1 for unconstrained dimensions.
+  std::vector<int64_t> dims;
+};
+
+// One `CompiledColumnSpec` per flattened column, or absl::nullopt when the
+// signature is unknown (in which case all data passes validation).
+typedef absl::optional<std::vector<CompiledColumnSpec>> CompiledSignature;
+
+// Compiles `dtypes_and_shapes` into a fixed column plan that can be checked
+// against sampled tensors with integer comparisons only.
+CompiledSignature CompileSignature(const DtypesAndShapes& dtypes_and_shapes);
+
+// Checks `tensor` against `spec`. If `skip_leading_dim` is set then the
+// outermost dimension of `tensor` is ignored; this is used for batched
+// timesteps where the spec describes a single timestep without the time
+// dimension. Equivalent to a dtype comparison followed by
+// `PartialTensorShape::IsCompatibleWith` but without materialising any shape
+// objects.
+bool TensorMatchesColumnSpec(const tensorflow::Tensor& tensor,
+                             const CompiledColumnSpec& spec,
+                             bool skip_leading_dim);
+
 }  // namespace internal
 }  // namespace reverb
 }  // namespace deepmind
@@ -19,6 +19,7 @@
 #include "absl/strings/string_view.h"
 #include "reverb/cc/platform/status_matchers.h"
 #include "reverb/cc/testing/proto_test_util.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/protobuf/struct.pb.h"
@@ -332,6 +333,78 @@ TEST(AddBatchDim, NestedStructure) {
   )pb"));
 }
 
+TEST(CompileSignature, UnknownSignatureCompilesToNullopt) {
+  EXPECT_FALSE(CompileSignature(absl::nullopt).has_value());
+}
+
+TEST(CompileSignature, CompilesDtypesAndDims) {
+  DtypesAndShapes dtypes_and_shapes = DtypesAndShapes::value_type({
+      {"a", tensorflow::DT_FLOAT, tensorflow::PartialTensorShape({-1, 3})},
+      {"b", tensorflow::DT_INT32, tensorflow::PartialTensorShape()},
+  });
+
+  CompiledSignature compiled = CompileSignature(dtypes_and_shapes);
+  ASSERT_TRUE(compiled.has_value());
+  ASSERT_EQ(compiled->size(), 2);
+
+  EXPECT_EQ(compiled->at(0).dtype, tensorflow::DT_FLOAT);
+  EXPECT_FALSE(compiled->at(0).unknown_rank);
+  EXPECT_THAT(compiled->at(0).dims, ::testing::ElementsAre(-1, 3));
+
+  EXPECT_EQ(compiled->at(1).dtype, tensorflow::DT_INT32);
+  EXPECT_TRUE(compiled->at(1).unknown_rank);
+  EXPECT_TRUE(compiled->at(1).dims.empty());
+}
+
+TEST(TensorMatchesColumnSpec, MatchesLikeIsCompatibleWith) {
+  CompiledColumnSpec spec;
+  spec.dtype = tensorflow::DT_FLOAT;
+  spec.unknown_rank = false;
+  spec.dims = {-1, 3};
+
+  tensorflow::Tensor ok(tensorflow::DT_FLOAT, {5, 3});
+  EXPECT_TRUE(TensorMatchesColumnSpec(ok, spec, /*skip_leading_dim=*/false));
+
+  tensorflow::Tensor wrong_dtype(tensorflow::DT_INT32, {5, 3});
+  EXPECT_FALSE(
+      TensorMatchesColumnSpec(wrong_dtype, spec, /*skip_leading_dim=*/false));
+
+  tensorflow::Tensor wrong_dim(tensorflow::DT_FLOAT, {5, 4});
+  EXPECT_FALSE(
+      TensorMatchesColumnSpec(wrong_dim, spec, /*skip_leading_dim=*/false));
+
+  tensorflow::Tensor wrong_rank(tensorflow::DT_FLOAT, {5, 3, 1});
+  EXPECT_FALSE(
+      TensorMatchesColumnSpec(wrong_rank, spec, /*skip_leading_dim=*/false));
+}
+
+TEST(TensorMatchesColumnSpec, UnknownRankAcceptsAnyShape) {
+  CompiledColumnSpec spec;
+  spec.dtype = tensorflow::DT_FLOAT;
+  spec.unknown_rank = true;
+
+  tensorflow::Tensor scalar(tensorflow::DT_FLOAT, {});
+  EXPECT_TRUE(
+      TensorMatchesColumnSpec(scalar, spec, /*skip_leading_dim=*/false));
+
+  tensorflow::Tensor matrix(tensorflow::DT_FLOAT, {2, 2});
+  EXPECT_TRUE(
+      TensorMatchesColumnSpec(matrix, spec, /*skip_leading_dim=*/false));
+}
+
+TEST(TensorMatchesColumnSpec, SkipLeadingDimIgnoresTimeDimension) {
+  CompiledColumnSpec spec;
+  spec.dtype = tensorflow::DT_FLOAT;
+  spec.unknown_rank = false;
+  spec.dims = {3};
+
+  tensorflow::Tensor batched(tensorflow::DT_FLOAT, {10, 3});
+  EXPECT_TRUE(
+      TensorMatchesColumnSpec(batched, spec, /*skip_leading_dim=*/true));
+  EXPECT_FALSE(
+      TensorMatchesColumnSpec(batched, spec, /*skip_leading_dim=*/false));
+}
+
 }  // namespace
 }  // namespace internal
 }  // namespace reverb
@@ -14,16 +14,32 @@
 
 #include "reverb/cc/support/task_executor.h"
 
+#include <algorithm>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
 namespace deepmind {
 namespace reverb {
 
 TaskExecutor::TaskExecutor(size_t num_threads,
                            const std::string& thread_name_prefix)
-    : queue_() {
+    : TaskExecutor(num_threads, thread_name_prefix,
+                   internal::ThreadOptions()) {}
+
+TaskExecutor::TaskExecutor(size_t num_threads,
+                           const std::string& thread_name_prefix,
+                           const internal::ThreadOptions& thread_options) {
+  // With zero threads tasks simply accumulate until `Close` runs them, so a
+  // queue must exist even then.
+  for (size_t i = 0; i < std::max<size_t>(num_threads, 1); i++) {
+    queues_.push_back(absl::make_unique<WorkerQueue>());
+  }
   for (int thread_index = 0; thread_index < num_threads; thread_index++) {
     threads_.push_back(internal::StartThread(
-        absl::StrCat(thread_name_prefix, "_", thread_index),
-        [this] { RunWorker(); }));
+        absl::StrCat(thread_name_prefix, "_", thread_index), thread_options,
+        [this, thread_index] { RunWorker(thread_index); }));
   }
 }
 
@@ -32,23 +48,98 @@ TaskExecutor::~TaskExecutor() {
 }
 
 void TaskExecutor::Schedule(const std::function<void()>& callback) {
-  queue_.Push(std::move(callback));
+  Push(next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size(),
+       callback);
+}
+
+void TaskExecutor::Schedule(size_t affinity_hint,
+                            const std::function<void()>& callback) {
+  // Hints are often pointers; hash them so that alignment does not map
+  // everything onto a few queues.
+  Push(absl::Hash<size_t>()(affinity_hint) % queues_.size(), callback);
+}
+
+void TaskExecutor::Push(size_t queue_index,
+                        const std::function<void()>& callback) {
+  {
+    WorkerQueue& queue = *queues_[queue_index];
+    absl::MutexLock lock(&queue.mu);
+    queue.tasks.push_back(callback);
+  }
+  absl::MutexLock lock(&mu_);
+  ++num_scheduled_;
 }
 
 void TaskExecutor::Close() {
-  std::function<void()> callback;
-  // Before closing, we cancel all the pending tasks.
-  queue_.SetLastItemPushed();
-  while (queue_.Pop(&callback)) {
-    callback();
+  {
+    absl::MutexLock lock(&mu_);
+    if (closed_) return;
+    closed_ = true;
   }
   threads_.clear();  // Joins worker threads.
+  // Before closing, we cancel all the pending tasks. The queue mutex is
+  // released while each task runs since a task may itself call `Schedule`.
+  for (auto& queue : queues_) {
+    while (true) {
+      std::function<void()> task;
+      {
+        absl::MutexLock lock(&queue->mu);
+        if (queue->tasks.empty()) break;
+        task = std::move(queue->tasks.front());
+        queue->tasks.pop_front();
+      }
+      task();
+    }
+  }
+}
+
+bool TaskExecutor::ClaimTask(size_t worker_index,
+                             std::function<void()>* task) {
+  {
+    WorkerQueue& own = *queues_[worker_index];
+    absl::MutexLock lock(&own.mu);
+    if (!own.tasks.empty()) {
+      *task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  // Steal from the back of another queue; the owner pops from the front so
+  // the thief and a busy owner rarely want the same task.
+  for (size_t i = 1; i < queues_.size(); i++) {
+    WorkerQueue& victim = *queues_[(worker_index + i) % queues_.size()];
+    absl::MutexLock lock(&victim.mu);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
 }
 
-void TaskExecutor::RunWorker() {
-  std::function<void()> callback;
-  while (queue_.Pop(&callback)) {
-    callback();
+void TaskExecutor::RunWorker(size_t worker_index) {
+  while (true) {
+    // The pending-task count is read before scanning the queues so that a
+    // task pushed during the scan changes the counter and prevents the worker
+    // from sleeping through it.
+    int64_t seen;
+    {
+      absl::MutexLock lock(&mu_);
+      if (closed_) return;
+      seen = num_scheduled_;
+    }
+    std::function<void()> task;
+    if (ClaimTask(worker_index, &task)) {
+      task();
+      continue;
+    }
+    absl::MutexLock lock(&mu_);
+    auto has_news = [this, seen]() {
+      return num_scheduled_ != seen || closed_;
+    };
+    mu_.Await(absl::Condition(&has_news));
+    if (closed_) return;
   }
 }
 
@@ -15,17 +15,32 @@
 #ifndef REVERB_CC_TASK_EXECUTOR_H_
 #define REVERB_CC_TASK_EXECUTOR_H_
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/hash/hash.h"
+#include "absl/synchronization/mutex.h"
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/platform/thread.h"
-#include "reverb/cc/support/unbounded_queue.h"
 
 namespace deepmind {
 namespace reverb {
 
-// Class that implements a thread pool that executes tasks from a queue. It is
-// thread-safe.
+// Class that implements a work-stealing thread pool. It is thread-safe.
+//
+// Each worker thread owns a queue and runs its tasks in FIFO order; a worker
+// whose queue is empty steals a task from the back of another worker's queue
+// so that no thread idles while work is pending. Tasks scheduled with the
+// same affinity hint always land on the same worker's queue, so with one
+// hint per table a slow task of one table delays the other tables' work only
+// when the pool as a whole is saturated, and a table's tasks tend to run on
+// the same core (keeping its state warm in cache) instead of being picked up
+// by whichever thread reaches a single shared queue first.
 class TaskExecutor {
  public:
   // Constructs a TaskExecutor.
@@ -33,19 +48,53 @@ class TaskExecutor {
   // thread_name_prefix: is used as a prefix for the name of the threads.
   TaskExecutor(size_t num_threads, const std::string& thread_name_prefix);
 
+  // Same as above but additionally applies `thread_options` (CPU affinity,
+  // priority) to every worker thread of the pool.
+  TaskExecutor(size_t num_threads, const std::string& thread_name_prefix,
+               const internal::ThreadOptions& thread_options);
+
   ~TaskExecutor();
 
-  // Schedules `task_cb` to be called as soon as possible.
+  // Schedules `callback` to be called as soon as possible. Placement
+  // alternates over the worker queues.
   void Schedule(const std::function<void()>& callback);
 
-  // Closes the thread pool and the queue. After calling this, no new tasks
+  // Same as above but tasks sharing `affinity_hint` are placed on the same
+  // worker's queue (e.g. the address of the table scheduling its callbacks).
+  // The hint only affects placement; an idle worker may still steal the task.
+  void Schedule(size_t affinity_hint, const std::function<void()>& callback);
+
+  // Closes the thread pool and the queues. After calling this, no new tasks
   // will be scheduled and pending tasks will run with a cancelled status.
   void Close();
 
  private:
-  void RunWorker();
+  // A queue owned by one worker thread. The owner pops from the front while
+  // thieves pop from the back, so they only contend on the mutex when the
+  // queue is nearly empty.
+  struct WorkerQueue {
+    absl::Mutex mu;
+    std::deque<std::function<void()>> tasks ABSL_GUARDED_BY(mu);
+  };
+
+  void Push(size_t queue_index, const std::function<void()>& callback);
+
+  // Pops a task from the worker's own queue or, failing that, steals one
+  // from another queue. Returns false if no task is pending anywhere.
+  bool ClaimTask(size_t worker_index, std::function<void()>* task);
+
+  void RunWorker(size_t worker_index);
+
+  // Signals pushed tasks (through `num_scheduled_`) and `Close` to workers
+  // sleeping because every queue was empty.
+  absl::Mutex mu_;
+  int64_t num_scheduled_ ABSL_GUARDED_BY(mu_) = 0;
+  bool closed_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Round-robin cursor for tasks scheduled without an affinity hint.
+  std::atomic<size_t> next_queue_{0};
 
-  internal::UnboundedQueue<std::function<void()>> queue_;
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
   std::vector<std::unique_ptr<internal::Thread>> threads_;
 };
 
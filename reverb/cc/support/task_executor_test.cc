@@ -0,0 +1,88 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/task_executor.h"
+
+#include <atomic>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+TEST(TaskExecutorTest, RunsAllScheduledTasks) {
+  std::atomic<int> count(0);
+  absl::Notification done;
+  {
+    TaskExecutor executor(4, "test");
+    for (int i = 0; i < 100; i++) {
+      executor.Schedule([&count, &done] {
+        if (++count == 100) done.Notify();
+      });
+    }
+    EXPECT_TRUE(done.WaitForNotificationWithTimeout(absl::Seconds(10)));
+  }
+  EXPECT_EQ(count, 100);
+}
+
+TEST(TaskExecutorTest, RunsAllTasksScheduledWithAffinityHints) {
+  std::atomic<int> count(0);
+  absl::Notification done;
+  {
+    TaskExecutor executor(4, "test");
+    for (int i = 0; i < 100; i++) {
+      executor.Schedule(/*affinity_hint=*/i % 3, [&count, &done] {
+        if (++count == 100) done.Notify();
+      });
+    }
+    EXPECT_TRUE(done.WaitForNotificationWithTimeout(absl::Seconds(10)));
+  }
+  EXPECT_EQ(count, 100);
+}
+
+TEST(TaskExecutorTest, IdleWorkerStealsTasksOfBusyWorker) {
+  // The first task blocks its worker until the second task, which carries the
+  // same affinity hint and thus sits behind it in the same queue, has been
+  // stolen and run by the other worker.
+  TaskExecutor executor(2, "test");
+  absl::Notification stolen_task_done;
+  absl::Notification blocking_task_done;
+  executor.Schedule(/*affinity_hint=*/1, [&] {
+    if (stolen_task_done.WaitForNotificationWithTimeout(absl::Seconds(10))) {
+      blocking_task_done.Notify();
+    }
+  });
+  executor.Schedule(/*affinity_hint=*/1,
+                    [&] { stolen_task_done.Notify(); });
+  EXPECT_TRUE(
+      blocking_task_done.WaitForNotificationWithTimeout(absl::Seconds(10)));
+}
+
+TEST(TaskExecutorTest, CloseRunsPendingTasks) {
+  std::atomic<int> count(0);
+  TaskExecutor executor(0, "test");
+  for (int i = 0; i < 5; i++) {
+    executor.Schedule([&count] { ++count; });
+  }
+  executor.Close();
+  EXPECT_EQ(count, 5);
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,136 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/synchronization/mutex.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Number of events each thread retains. At e.g. 100k events/s per thread the
+// ring covers the most recent ~40ms, which is plenty for an on-demand dump.
+// Must be a power of two so the slot index is a mask rather than a division.
+constexpr uint64_t kRingSize = 4096;
+static_assert((kRingSize & (kRingSize - 1)) == 0,
+              "kRingSize must be a power of two");
+
+// Per thread ring buffer. The owning thread is the only writer; `head_` is
+// published with release semantics so that a snapshotting thread reading it
+// with acquire semantics sees fully written slots below it. The slot that is
+// `kRingSize` writes behind the head may be overwritten concurrently with a
+// snapshot; such a torn event is tolerated rather than synchronized away.
+class Ring {
+ public:
+  explicit Ring(int64_t thread_id) : thread_id_(thread_id) {}
+
+  void Record(const char* stage, int64_t start_cycles, int64_t end_cycles) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    TraceEvent& slot = events_[head & (kRingSize - 1)];
+    slot.stage = stage;
+    slot.start_cycles = start_cycles;
+    slot.end_cycles = end_cycles;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  ThreadTraceEvents Snapshot() const {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    ThreadTraceEvents result;
+    result.thread_id = thread_id_;
+    const uint64_t num_events = std::min(head, kRingSize);
+    result.events.reserve(num_events);
+    for (uint64_t i = head - num_events; i != head; i++) {
+      result.events.push_back(events_[i & (kRingSize - 1)]);
+    }
+    return result;
+  }
+
+ private:
+  const int64_t thread_id_;
+  std::atomic<uint64_t> head_{0};
+  TraceEvent events_[kRingSize];
+};
+
+// Registry of all rings ever created. Rings are held by shared_ptr and never
+// removed so that the events of exited threads remain visible in dumps; at
+// sizeof(Ring) per thread this is cheap for any realistic thread count.
+absl::Mutex* RegistryMu() {
+  static absl::Mutex* mu = new absl::Mutex;
+  return mu;
+}
+
+std::vector<std::shared_ptr<Ring>>* Registry() {
+  static auto* registry = new std::vector<std::shared_ptr<Ring>>;
+  return registry;
+}
+
+Ring* ThisThreadRing() {
+  thread_local std::shared_ptr<Ring> ring = [] {
+    static std::atomic<int64_t> next_thread_id{0};
+    auto r = std::make_shared<Ring>(
+        next_thread_id.fetch_add(1, std::memory_order_relaxed));
+    absl::MutexLock lock(RegistryMu());
+    Registry()->push_back(r);
+    return r;
+  }();
+  return ring.get();
+}
+
+}  // namespace
+
+ScopedTrace::ScopedTrace(const char* stage)
+    : stage_(stage), start_cycles_(absl::base_internal::CycleClock::Now()) {}
+
+ScopedTrace::~ScopedTrace() {
+  ThisThreadRing()->Record(stage_, start_cycles_,
+                           absl::base_internal::CycleClock::Now());
+}
+
+int64_t TraceNowCycles() { return absl::base_internal::CycleClock::Now(); }
+
+void RecordTraceEvent(const char* stage, int64_t start_cycles) {
+  ThisThreadRing()->Record(stage, start_cycles,
+                           absl::base_internal::CycleClock::Now());
+}
+
+double TraceCyclesToSeconds(int64_t cycles) {
+  return cycles / absl::base_internal::CycleClock::Frequency();
+}
+
+std::vector<ThreadTraceEvents> SnapshotTraceEvents() {
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    absl::MutexLock lock(RegistryMu());
+    rings = *Registry();
+  }
+  std::vector<ThreadTraceEvents> result;
+  result.reserve(rings.size());
+  for (const auto& ring : rings) {
+    result.push_back(ring->Snapshot());
+  }
+  return result;
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,90 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_TRACE_H_
+#define REVERB_CC_SUPPORT_TRACE_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Lightweight always-on tracing of named hot-path stages.
+//
+// Each thread that records events owns a fixed size ring buffer which is
+// written to without any locking or allocation; recording an event costs two
+// cycle counter reads and one ring slot write, so the instrumentation can be
+// left enabled in production. The rings of all threads can be snapshotted on
+// demand (e.g. through an admin RPC) to see where time in the hot paths is
+// going right now, without having to attach an external profiler.
+//
+// Readers of a snapshot should treat it as approximate: a thread may be
+// overwriting its oldest slot while the snapshot is taken, in which case that
+// single event can be torn. The stage names are expected to be string
+// literals; only the pointer is stored.
+
+// One closed interval recorded by `ScopedTrace` or `RecordTraceEvent`.
+// Timestamps are in cycle counter ticks; use `TraceCyclesToSeconds` to
+// convert differences to wall time.
+struct TraceEvent {
+  const char* stage;
+  int64_t start_cycles;
+  int64_t end_cycles;
+};
+
+// The events currently held by one thread's ring buffer, oldest first.
+struct ThreadTraceEvents {
+  // Identifies the recording thread. Assigned from a process wide counter
+  // when the thread records its first event; stable across snapshots.
+  int64_t thread_id;
+  std::vector<TraceEvent> events;
+};
+
+// Records the time spent between construction and destruction as a single
+// event in the calling thread's ring buffer.
+class ScopedTrace {
+ public:
+  explicit ScopedTrace(const char* stage);
+  ~ScopedTrace();
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+ private:
+  const char* stage_;
+  int64_t start_cycles_;
+};
+
+// Current value of the cycle counter. For stages whose start and end are not
+// lexically scoped (e.g. spanning asynchronous callbacks); pair with
+// `RecordTraceEvent`.
+int64_t TraceNowCycles();
+
+// Records an event for `stage` that started at `start_cycles` and ends now.
+void RecordTraceEvent(const char* stage, int64_t start_cycles);
+
+// Converts a cycle counter difference to seconds.
+double TraceCyclesToSeconds(int64_t cycles);
+
+// Returns the current contents of every thread's ring buffer, including
+// threads that have since exited. Threads are ordered by `thread_id`.
+std::vector<ThreadTraceEvents> SnapshotTraceEvents();
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_TRACE_H_
@@ -0,0 +1,93 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/trace.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/platform/thread.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+std::vector<TraceEvent> EventsForStage(const char* stage) {
+  std::vector<TraceEvent> events;
+  for (const auto& thread : SnapshotTraceEvents()) {
+    for (const auto& event : thread.events) {
+      if (std::string(event.stage) == stage) {
+        events.push_back(event);
+      }
+    }
+  }
+  return events;
+}
+
+TEST(TraceTest, ScopedTraceRecordsOrderedTimestamps) {
+  { ScopedTrace trace("trace_test_scoped"); }
+  auto events = EventsForStage("trace_test_scoped");
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_LE(events[0].start_cycles, events[0].end_cycles);
+}
+
+TEST(TraceTest, RecordTraceEventUsesProvidedStart) {
+  const int64_t start = TraceNowCycles();
+  RecordTraceEvent("trace_test_manual", start);
+  auto events = EventsForStage("trace_test_manual");
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].start_cycles, start);
+  EXPECT_LE(events[0].start_cycles, events[0].end_cycles);
+}
+
+TEST(TraceTest, SnapshotIncludesEventsOfExitedThreads) {
+  {
+    auto thread = StartThread("trace_test", [] {
+      ScopedTrace trace("trace_test_other_thread");
+    });
+  }
+  EXPECT_EQ(EventsForStage("trace_test_other_thread").size(), 1);
+}
+
+TEST(TraceTest, RingKeepsTheMostRecentEvents) {
+  // Overflow the ring and check that the retained events are the latest ones
+  // in recording order.
+  for (int i = 0; i < 5000; i++) {
+    ScopedTrace trace("trace_test_overflow");
+  }
+  auto events = EventsForStage("trace_test_overflow");
+  EXPECT_GT(events.size(), 0);
+  EXPECT_LT(events.size(), 5000);
+  for (size_t i = 1; i < events.size(); i++) {
+    EXPECT_LE(events[i - 1].end_cycles, events[i].end_cycles);
+  }
+}
+
+TEST(TraceTest, CyclesConvertToPositiveSeconds) {
+  const int64_t start = TraceNowCycles();
+  absl::SleepFor(absl::Milliseconds(1));
+  const double elapsed = TraceCyclesToSeconds(TraceNowCycles() - start);
+  EXPECT_GT(elapsed, 0.0);
+  EXPECT_LT(elapsed, 1.0);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
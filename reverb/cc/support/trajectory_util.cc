@@ -26,8 +26,10 @@
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/tensor_compression.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_util.h"
+#include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/platform/errors.h"
 
 namespace deepmind {
@@ -104,6 +106,130 @@ int TimestepTrajectoryLength(const FlatTrajectory& trajectory) {
   return ColumnLength(trajectory, 0);
 }
 
+FlatTrajectory SliceTimestepTrajectory(const FlatTrajectory& trajectory,
+                                       int offset, int length) {
+  REVERB_CHECK_GE(offset, 0);
+  REVERB_CHECK_GT(length, 0);
+  REVERB_CHECK_LE(offset + length, TimestepTrajectoryLength(trajectory));
+
+  FlatTrajectory sliced;
+  for (const auto& column : trajectory.columns()) {
+    auto* sliced_column = sliced.add_columns();
+    sliced_column->set_squeeze(column.squeeze());
+    int remaining_offset = offset;
+    int remaining_length = length;
+    for (const auto& slice : column.chunk_slices()) {
+      if (remaining_length == 0) break;
+      if (remaining_offset >= slice.length()) {
+        // The window starts beyond this slice.
+        remaining_offset -= slice.length();
+        continue;
+      }
+      auto* sliced_slice = sliced_column->add_chunk_slices();
+      sliced_slice->set_chunk_key(slice.chunk_key());
+      sliced_slice->set_index(slice.index());
+      sliced_slice->set_offset(slice.offset() + remaining_offset);
+      sliced_slice->set_length(
+          std::min(slice.length() - remaining_offset, remaining_length));
+      remaining_length -= sliced_slice->length();
+      remaining_offset = 0;
+    }
+  }
+  return sliced;
+}
+
+FlatTrajectory ProjectTrajectory(const FlatTrajectory& trajectory,
+                                 absl::Span<const int> columns) {
+  FlatTrajectory projected;
+  for (int column : columns) {
+    if (column < 0 || column >= trajectory.columns_size()) continue;
+    *projected.add_columns() = trajectory.columns(column);
+  }
+  return projected;
+}
+
+FlatTrajectory NStepTransitionTrajectory(const FlatTrajectory& trajectory,
+                                         int start, int num_steps) {
+  REVERB_CHECK_GE(start, 0);
+  REVERB_CHECK_GT(num_steps, 0);
+  REVERB_CHECK_LT(start + num_steps, TimestepTrajectoryLength(trajectory));
+
+  FlatTrajectory transition = SliceTimestepTrajectory(trajectory, start, 1);
+  FlatTrajectory last =
+      SliceTimestepTrajectory(trajectory, start + num_steps, 1);
+  for (int i = 0; i < transition.columns_size(); i++) {
+    for (auto& slice : *last.mutable_columns(i)->mutable_chunk_slices()) {
+      *transition.mutable_columns(i)->add_chunk_slices() = std::move(slice);
+    }
+  }
+  return transition;
+}
+
+absl::Status AccumulateNStepReward(
+    const FlatTrajectory& trajectory,
+    absl::Span<const std::shared_ptr<ChunkStore::Chunk>> chunks,
+    int reward_column, int start, int num_steps, double discount,
+    double* reward, tensorflow::DataType* reward_dtype) {
+  if (reward_column < 0 || reward_column >= trajectory.columns_size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Reward column ", reward_column,
+                     " is out of range for trajectory with ",
+                     trajectory.columns_size(), " columns."));
+  }
+
+  const FlatTrajectory window =
+      SliceTimestepTrajectory(trajectory, start, num_steps);
+
+  *reward = 0;
+  double scale = 1;
+  for (const auto& slice : window.columns(reward_column).chunk_slices()) {
+    const ChunkStore::Chunk* chunk = nullptr;
+    for (const auto& candidate : chunks) {
+      if (candidate->key() == slice.chunk_key()) {
+        chunk = candidate.get();
+        break;
+      }
+    }
+    if (chunk == nullptr) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Chunk ", slice.chunk_key(),
+                       " referenced by the reward column is not part of the "
+                       "provided chunks."));
+    }
+
+    tensorflow::Tensor rewards;
+    REVERB_RETURN_IF_ERROR(
+        UnpackChunkColumnAndSlice(chunk->data(), slice, &rewards));
+    if (rewards.NumElements() != slice.length()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Reward column ", reward_column, " holds ",
+                       rewards.NumElements(), " values for ", slice.length(),
+                       " steps; expected exactly one value per step."));
+    }
+
+    if (rewards.dtype() == tensorflow::DT_FLOAT) {
+      auto flat = rewards.flat<float>();
+      for (int i = 0; i < flat.size(); i++) {
+        *reward += scale * flat(i);
+        scale *= discount;
+      }
+    } else if (rewards.dtype() == tensorflow::DT_DOUBLE) {
+      auto flat = rewards.flat<double>();
+      for (int i = 0; i < flat.size(); i++) {
+        *reward += scale * flat(i);
+        scale *= discount;
+      }
+    } else {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Reward column must hold float or double values, got ",
+          tensorflow::DataTypeString(rewards.dtype()), "."));
+    }
+    *reward_dtype = rewards.dtype();
+  }
+
+  return absl::OkStatus();
+}
+
 bool IsTimestepTrajectory(const FlatTrajectory& trajectory) {
   if (trajectory.columns().empty()) {
     return false;
@@ -142,18 +268,104 @@ bool IsTimestepTrajectory(const FlatTrajectory& trajectory) {
   return true;
 }
 
-absl::Status UnpackChunkColumn(const ChunkData& chunk_data, int column,
-                               tensorflow::Tensor* out) {
+namespace {
+
+// Codec of `column`. Chunks written with the columnar layout tag every
+// column individually; older chunks share the chunk level codec.
+CompressionCodec ColumnCodec(const ChunkData& chunk_data, int column) {
+  return column < chunk_data.column_streams_size()
+             ? chunk_data.column_streams(column).codec()
+             : chunk_data.codec();
+}
+
+// As `ColumnCodec` but for the delta encoding flag.
+bool ColumnDeltaEncoded(const ChunkData& chunk_data, int column) {
+  return column < chunk_data.column_streams_size()
+             ? chunk_data.column_streams(column).delta_encoded()
+             : chunk_data.delta_encoded();
+}
+
+// Shared by `UnpackChunkColumn` and `UnpackChunkColumnWithBaseline`; inverts
+// every transform except the cross chunk delta.
+absl::Status UnpackColumnTransforms(const ChunkData& chunk_data, int column,
+                                    tensorflow::Tensor* out) {
   if (column >= chunk_data.data().tensors_size() || column < 0) {
     return absl::InvalidArgumentError(absl::StrCat(
         "Cannot unpack column ", column, " in chunk ", chunk_data.chunk_key(),
         " which has ", chunk_data.data().tensors_size(), " columns."));
   }
 
-  *out = DecompressTensorFromProto(chunk_data.data().tensors(column));
-  if (chunk_data.delta_encoded()) {
+  *out = DecompressTensorFromProto(chunk_data.data().tensors(column),
+                                   ColumnCodec(chunk_data, column));
+  // Bit-packed columns skip the other transforms when written.
+  if (column < chunk_data.bit_packings_size() &&
+      !chunk_data.bit_packings(column).dictionary().empty()) {
+    *out = BitUnpackTensor(*out, chunk_data.bit_packings(column));
+    return absl::OkStatus();
+  }
+  if (ColumnDeltaEncoded(chunk_data, column)) {
     *out = DeltaEncode(*out, /*encode=*/false);
   }
+  if (column < chunk_data.lossy_transforms_size()) {
+    *out = LossyDecompress(*out, chunk_data.lossy_transforms(column));
+  }
+
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status UnpackChunkColumn(const ChunkData& chunk_data, int column,
+                               tensorflow::Tensor* out) {
+  if (chunk_data.delta_baseline_chunk_key() != 0) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Chunk ", chunk_data.chunk_key(), " is delta encoded against chunk ",
+        chunk_data.delta_baseline_chunk_key(),
+        " and must be unpacked with UnpackChunkColumnWithBaseline."));
+  }
+  return UnpackColumnTransforms(chunk_data, column, out);
+}
+
+absl::Status WarmUnpackedColumnCache(
+    const std::shared_ptr<ChunkStore::Chunk>& chunk) {
+  if (!chunk->unpacked_cache_enabled() || chunk->unpacked_cached()) {
+    return absl::OkStatus();
+  }
+  const ChunkData& chunk_data = chunk->data();
+  // Chunks that are delta encoded against their predecessor cannot be
+  // unpacked in isolation; they stay compressed and are unpacked per sample
+  // with the baseline column.
+  if (chunk_data.delta_baseline_chunk_key() != 0) {
+    return absl::OkStatus();
+  }
+  std::vector<tensorflow::Tensor> columns(chunk_data.data().tensors_size());
+  for (int i = 0; i < chunk_data.data().tensors_size(); i++) {
+    REVERB_RETURN_IF_ERROR(UnpackChunkColumn(chunk_data, i, &columns[i]));
+  }
+  chunk->CacheUnpackedColumns(std::move(columns));
+  return absl::OkStatus();
+}
+
+absl::Status UnpackChunkColumnWithBaseline(
+    const ChunkData& chunk_data, int column,
+    const tensorflow::Tensor& baseline_column, tensorflow::Tensor* out) {
+  if (chunk_data.delta_baseline_chunk_key() == 0) {
+    return UnpackChunkColumn(chunk_data, column, out);
+  }
+  if (baseline_column.dims() == 0 || baseline_column.dim_size(0) == 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot unpack chunk ", chunk_data.chunk_key(),
+                     " with an empty baseline column."));
+  }
+
+  REVERB_RETURN_IF_ERROR(UnpackColumnTransforms(chunk_data, column, out));
+
+  tensorflow::Tensor baseline =
+      baseline_column.SubSlice(baseline_column.dim_size(0) - 1);
+  if (!baseline.IsAligned()) {
+    baseline = tensorflow::tensor::DeepCopy(baseline);
+  }
+  *out = CrossChunkDelta(*out, baseline, /*encode=*/false);
 
   return absl::OkStatus();
 }
@@ -184,6 +396,86 @@ absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data,
                                    slice.length(), out);
 }
 
+namespace {
+
+// Tensor buffer which points into the serialized content of a chunk and keeps
+// the chunk alive for as long as the tensor referencing the buffer exists.
+class ChunkAliasingBuffer : public tensorflow::TensorBuffer {
+ public:
+  ChunkAliasingBuffer(std::shared_ptr<const ChunkData> chunk, void* data,
+                      size_t size)
+      : TensorBuffer(data), chunk_(std::move(chunk)), size_(size) {}
+
+  size_t size() const override { return size_; }
+
+  TensorBuffer* root_buffer() override { return this; }
+
+  void FillAllocationDescription(
+      tensorflow::AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocated_bytes(size_);
+  }
+
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  const std::shared_ptr<const ChunkData> chunk_;
+  const size_t size_;
+};
+
+}  // namespace
+
+bool AliasChunkColumnAndSlice(std::shared_ptr<const ChunkData> chunk_data,
+                              const FlatTrajectory::ChunkSlice& slice,
+                              tensorflow::Tensor* out) {
+  if (slice.index() < 0 || slice.index() >= chunk_data->data().tensors_size()) {
+    return false;
+  }
+  // Columns of the columnar layout are tagged individually, so a raw column
+  // can be aliased even when its siblings are compressed.
+  if (ColumnCodec(*chunk_data, slice.index()) != COMPRESSION_NONE ||
+      ColumnDeltaEncoded(*chunk_data, slice.index())) {
+    return false;
+  }
+  // Lossily transformed and bit-packed columns are stored with a different
+  // dtype than they were written with and must be decoded with
+  // `UnpackChunkColumn`.
+  if (slice.index() < chunk_data->lossy_transforms_size() &&
+      chunk_data->lossy_transforms(slice.index()).type() !=
+          LOSSY_COMPRESSION_NONE) {
+    return false;
+  }
+  if (slice.index() < chunk_data->bit_packings_size() &&
+      !chunk_data->bit_packings(slice.index()).dictionary().empty()) {
+    return false;
+  }
+
+  const tensorflow::TensorProto& proto =
+      chunk_data->data().tensors(slice.index());
+  if (!tensorflow::DataTypeCanUseMemcpy(proto.dtype())) {
+    return false;
+  }
+
+  const tensorflow::TensorShape shape(proto.tensor_shape());
+  if (shape.dims() == 0 || slice.offset() != 0 ||
+      slice.length() != shape.dim_size(0)) {
+    return false;
+  }
+
+  const std::string& content = proto.tensor_content();
+  if (content.size() !=
+      shape.num_elements() * tensorflow::DataTypeSize(proto.dtype())) {
+    return false;
+  }
+
+  auto* buffer = new ChunkAliasingBuffer(std::move(chunk_data),
+                                         const_cast<char*>(content.data()),
+                                         content.size());
+  *out = tensorflow::Tensor(proto.dtype(), shape, buffer);
+  buffer->Unref();
+  return true;
+}
+
 int TimestepTrajectoryOffset(const FlatTrajectory& trajectory) {
   return trajectory.columns(0).chunk_slices(0).offset();
 }
@@ -15,6 +15,7 @@
 #ifndef REVERB_CC_SUPPORT_TRAJECTORY_UTIL_H_
 #define REVERB_CC_SUPPORT_TRAJECTORY_UTIL_H_
 
+#include <memory>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -62,10 +63,66 @@ int TimestepTrajectoryOffset(const FlatTrajectory& trajectory);
 // Number of steps referenced by column.
 int ColumnLength(const FlatTrajectory& trajectory, int column);
 
-// Decompresses the tensor at index `column` in `chunk_data` into `out`.
+// Builds a trajectory referencing timesteps [offset, offset + length) of
+// `trajectory`. Slices outside the window are dropped and boundary slices are
+// narrowed, so the result references only the chunks that overlap the window.
+// The window must lie within the trajectory. Assumes that
+// IsTimestepTrajectory has been checked by caller before.
+FlatTrajectory SliceTimestepTrajectory(const FlatTrajectory& trajectory,
+                                       int offset, int length);
+
+// Builds a trajectory holding the columns of `trajectory` listed in `columns`,
+// in the listed order. Indices outside [0, num columns) are ignored.
+FlatTrajectory ProjectTrajectory(const FlatTrajectory& trajectory,
+                                 absl::Span<const int> columns);
+
+// Builds a trajectory referencing timesteps `start` and `start + num_steps`
+// of `trajectory`, i.e. two single step rows per column. Used for N-step
+// transition materialization where the steps in between are folded into an
+// accumulated reward. Both steps must lie within the trajectory. Assumes
+// that `IsTimestepTrajectory` has been checked by the caller before.
+FlatTrajectory NStepTransitionTrajectory(const FlatTrajectory& trajectory,
+                                         int start, int num_steps);
+
+// Accumulates `sum_k discount^k * reward[start + k]` for k in [0, num_steps)
+// from the scalar per step rewards stored in column `reward_column` of
+// `trajectory`, decompressing the referenced chunks in `chunks` (matched by
+// `ChunkData.chunk_key`). Sets `*reward_dtype` to the dtype of the reward
+// column. Returns `InvalidArgumentError` if the column does not hold exactly
+// one float or double value per step or references a chunk missing from
+// `chunks`. Assumes that `IsTimestepTrajectory` has been checked by the
+// caller before.
+absl::Status AccumulateNStepReward(
+    const FlatTrajectory& trajectory,
+    absl::Span<const std::shared_ptr<ChunkStore::Chunk>> chunks,
+    int reward_column, int start, int num_steps, double discount,
+    double* reward, tensorflow::DataType* reward_dtype);
+
+// Decompresses the tensor at index `column` in `chunk_data` into `out`,
+// inverting delta encoding and any lossy transform so `out` has the dtype the
+// column was written with. Returns `FailedPreconditionError` if the chunk was
+// delta encoded against its predecessor (`ChunkData.delta_baseline_chunk_key`
+// is set); such chunks must be unpacked with
+// `UnpackChunkColumnWithBaseline`.
 absl::Status UnpackChunkColumn(const ChunkData& chunk_data, int column,
                                tensorflow::Tensor* out);
 
+// Decompresses every column of `chunk` and admits them to the chunk's
+// uncompressed column cache (see `ChunkStore::Chunk::CacheUnpackedColumns`).
+// Noop when no cache is attached to the chunk, its columns are already
+// resident, or the chunk is delta encoded against its predecessor (such
+// chunks cannot be unpacked in isolation).
+absl::Status WarmUnpackedColumnCache(
+    const std::shared_ptr<ChunkStore::Chunk>& chunk);
+
+// As `UnpackChunkColumn` but additionally inverts the cross chunk delta
+// encoding using `baseline_column`, the fully unpacked column of the chunk
+// referenced by `ChunkData.delta_baseline_chunk_key` (only its last row is
+// used). Falls back to `UnpackChunkColumn` if the chunk is self contained.
+absl::Status UnpackChunkColumnWithBaseline(
+    const ChunkData& chunk_data, int column,
+    const tensorflow::Tensor& baseline_column, tensorflow::Tensor* out);
+
 // Unpacks content of column (see `UnpackChunkColumn`) and returns an aligned
 // tensor of the desired slice,
 absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data, int column,
@@ -78,6 +135,22 @@ absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data,
                                        const FlatTrajectory::ChunkSlice& slice,
                                        tensorflow::Tensor* out);
 
+// Attempts to build a tensor for `slice` that aliases the serialized chunk
+// instead of copying the data out of it. This is only possible when the
+// column is stored without compression or delta encoding (consulting the per
+// column stream tags when present), the column holds numeric
+// data and the slice covers every row of the chunk. Returns true and
+// populates `out` on success, false if the slice must be unpacked with
+// `UnpackChunkColumnAndSlice`.
+//
+// On success the tensor shares memory with, and holds a reference to,
+// `chunk_data` so the chunk stays alive for as long as the tensor does. The
+// returned tensor may not be aligned; callers that slice it further must
+// check `IsAligned` just as they would for any other tensor.
+bool AliasChunkColumnAndSlice(std::shared_ptr<const ChunkData> chunk_data,
+                              const FlatTrajectory::ChunkSlice& slice,
+                              tensorflow::Tensor* out);
+
 }  // namespace internal
 }  // namespace reverb
 }  // namespace deepmind
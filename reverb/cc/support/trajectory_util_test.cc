@@ -15,7 +15,9 @@
 #include "reverb/cc/support/trajectory_util.h"
 
 #include <memory>
+#include <vector>
 
+#include "absl/status/status.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "reverb/cc/chunk_store.h"
@@ -241,6 +243,109 @@ TEST(TimestepTrajectoryLength, AccumulatesSlices) {
   EXPECT_EQ(TimestepTrajectoryLength(trajectory), 6);
 }
 
+TEST(ProjectTrajectory, KeepsListedColumnsInOrder) {
+  auto trajectory = FlatTimestepTrajectory(
+      /*chunk_keys=*/{1, 2}, /*chunk_lengths=*/{2, 2},
+      /*num_columns=*/3, /*offset=*/0, /*length=*/4);
+  auto projected = ProjectTrajectory(trajectory, {2, 0});
+  ASSERT_EQ(projected.columns_size(), 2);
+  EXPECT_EQ(projected.columns(0).chunk_slices(0).index(), 2);
+  EXPECT_EQ(projected.columns(1).chunk_slices(0).index(), 0);
+}
+
+TEST(ProjectTrajectory, IgnoresOutOfRangeColumns) {
+  auto trajectory = FlatTimestepTrajectory(
+      /*chunk_keys=*/{1}, /*chunk_lengths=*/{2},
+      /*num_columns=*/2, /*offset=*/0, /*length=*/2);
+  auto projected = ProjectTrajectory(trajectory, {1, 5});
+  ASSERT_EQ(projected.columns_size(), 1);
+  EXPECT_EQ(projected.columns(0).chunk_slices(0).index(), 1);
+}
+
+TEST(NStepTransitionTrajectory, ReferencesFirstAndLastStep) {
+  auto trajectory = FlatTimestepTrajectory(
+      /*chunk_keys=*/{1, 2}, /*chunk_lengths=*/{3, 3},
+      /*num_columns=*/2, /*offset=*/0, /*length=*/6);
+  auto transition = NStepTransitionTrajectory(trajectory, /*start=*/1,
+                                              /*num_steps=*/3);
+  EXPECT_THAT(transition, testing::EqualsProto(R"(
+                columns: {
+                  chunk_slices: { chunk_key: 1 offset: 1 length: 1 index: 0 }
+                  chunk_slices: { chunk_key: 2 offset: 1 length: 1 index: 0 }
+                }
+                columns: {
+                  chunk_slices: { chunk_key: 1 offset: 1 length: 1 index: 1 }
+                  chunk_slices: { chunk_key: 2 offset: 1 length: 1 index: 1 }
+                }
+              )"));
+}
+
+std::shared_ptr<ChunkStore::Chunk> MakeRewardChunk(
+    uint64_t key, const tensorflow::Tensor& rewards) {
+  ChunkData data;
+  data.set_chunk_key(key);
+  CompressTensorAsProto(rewards, data.mutable_data()->add_tensors());
+  data.set_data_tensors_len(1);
+  return std::make_shared<ChunkStore::Chunk>(std::move(data));
+}
+
+TEST(AccumulateNStepReward, DiscountsAcrossChunkBoundaries) {
+  tensorflow::Tensor first_rewards(tensorflow::DT_FLOAT, {3});
+  tensorflow::Tensor second_rewards(tensorflow::DT_FLOAT, {3});
+  for (int i = 0; i < 3; i++) {
+    first_rewards.flat<float>()(i) = i + 1;
+    second_rewards.flat<float>()(i) = i + 4;
+  }
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks = {
+      MakeRewardChunk(1, first_rewards),
+      MakeRewardChunk(2, second_rewards),
+  };
+  auto trajectory = FlatTimestepTrajectory(
+      /*chunk_keys=*/{1, 2}, /*chunk_lengths=*/{3, 3},
+      /*num_columns=*/1, /*offset=*/0, /*length=*/6);
+
+  // Steps [1, 4) hold rewards 2, 3 and 4.
+  double reward = 0;
+  tensorflow::DataType reward_dtype = tensorflow::DT_INVALID;
+  REVERB_EXPECT_OK(AccumulateNStepReward(
+      trajectory, chunks, /*reward_column=*/0, /*start=*/1, /*num_steps=*/3,
+      /*discount=*/0.5, &reward, &reward_dtype));
+  EXPECT_DOUBLE_EQ(reward, 2 + 0.5 * 3 + 0.25 * 4);
+  EXPECT_EQ(reward_dtype, tensorflow::DT_FLOAT);
+}
+
+TEST(AccumulateNStepReward, RejectsNonScalarRewards) {
+  tensorflow::Tensor rewards(tensorflow::DT_FLOAT, {3, 2});
+  rewards.flat<float>().setZero();
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks = {
+      MakeRewardChunk(1, rewards),
+  };
+  auto trajectory = FlatTimestepTrajectory(
+      /*chunk_keys=*/{1}, /*chunk_lengths=*/{3},
+      /*num_columns=*/1, /*offset=*/0, /*length=*/3);
+
+  double reward = 0;
+  tensorflow::DataType reward_dtype = tensorflow::DT_INVALID;
+  auto status = AccumulateNStepReward(trajectory, chunks, /*reward_column=*/0,
+                                      /*start=*/0, /*num_steps=*/2,
+                                      /*discount=*/1, &reward, &reward_dtype);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(AccumulateNStepReward, RejectsMissingChunks) {
+  auto trajectory = FlatTimestepTrajectory(
+      /*chunk_keys=*/{1}, /*chunk_lengths=*/{3},
+      /*num_columns=*/1, /*offset=*/0, /*length=*/3);
+
+  double reward = 0;
+  tensorflow::DataType reward_dtype = tensorflow::DT_INVALID;
+  auto status = AccumulateNStepReward(trajectory, /*chunks=*/{},
+                                      /*reward_column=*/0, /*start=*/0,
+                                      /*num_steps=*/2, /*discount=*/1, &reward,
+                                      &reward_dtype);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+}
+
 TEST(UnpackChunkColumn, SelectsCorrectColumn) {
   tensorflow::Tensor first_col_tensor(static_cast<int32_t>(1337));
   tensorflow::Tensor second_col_tensor(static_cast<int32_t>(9000));
@@ -259,6 +364,149 @@ TEST(UnpackChunkColumn, SelectsCorrectColumn) {
   test::ExpectTensorEqual<int32_t>(second_got, second_col_tensor);
 }
 
+TEST(UnpackChunkColumn, HonoursPerColumnStreams) {
+  // A columnar (v2) chunk where each column picked its own encoding: the
+  // integer column is delta encoded and compressed while the float column is
+  // stored raw.
+  tensorflow::Tensor ints(tensorflow::DT_INT32, {4, 2});
+  ints.flat<int32_t>().setRandom();
+  tensorflow::Tensor floats(tensorflow::DT_FLOAT, {4, 2});
+  floats.flat<float>().setRandom();
+
+  ChunkData data;
+  auto* int_stream = data.add_column_streams();
+  int_stream->set_delta_encoded(true);
+  int_stream->set_codec(
+      CompressTensorAsProto(DeltaEncode(ints, /*encode=*/true),
+                            data.mutable_data()->add_tensors(),
+                            COMPRESSION_SNAPPY));
+  data.add_column_streams()->set_codec(CompressTensorAsProto(
+      floats, data.mutable_data()->add_tensors(), COMPRESSION_NONE));
+  data.set_data_tensors_len(2);
+
+  tensorflow::Tensor got;
+  REVERB_EXPECT_OK(UnpackChunkColumn(data, 0, &got));
+  test::ExpectTensorEqual<int32_t>(got, ints);
+  REVERB_EXPECT_OK(UnpackChunkColumn(data, 1, &got));
+  test::ExpectTensorEqual<float>(got, floats);
+}
+
+std::shared_ptr<ChunkData> MakeUncompressedChunk(
+    const tensorflow::Tensor& tensor) {
+  auto chunk = std::make_shared<ChunkData>();
+  chunk->set_codec(CompressTensorAsProto(
+      tensor, chunk->mutable_data()->add_tensors(), COMPRESSION_NONE));
+  chunk->set_data_tensors_len(1);
+  return chunk;
+}
+
+TEST(AliasChunkColumnAndSlice, AliasesWholeUncompressedChunk) {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT, {4, 2});
+  for (int i = 0; i < tensor.NumElements(); i++) {
+    tensor.flat<float>()(i) = i;
+  }
+  auto chunk = MakeUncompressedChunk(tensor);
+
+  FlatTrajectory::ChunkSlice slice;
+  slice.set_index(0);
+  slice.set_offset(0);
+  slice.set_length(4);
+
+  tensorflow::Tensor got;
+  ASSERT_TRUE(AliasChunkColumnAndSlice(chunk, slice, &got));
+  test::ExpectTensorEqual<float>(got, tensor);
+
+  // The tensor should point straight into the serialized chunk content.
+  EXPECT_EQ(got.tensor_data().data(),
+            chunk->data().tensors(0).tensor_content().data());
+
+  // The tensor must keep the chunk alive after all other references are gone.
+  std::weak_ptr<ChunkData> weak = chunk;
+  chunk = nullptr;
+  EXPECT_FALSE(weak.expired());
+  got = tensorflow::Tensor();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST(AliasChunkColumnAndSlice, RejectsPartialSlices) {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT, {4, 2});
+  auto chunk = MakeUncompressedChunk(tensor);
+
+  FlatTrajectory::ChunkSlice slice;
+  slice.set_index(0);
+  slice.set_offset(1);
+  slice.set_length(3);
+
+  tensorflow::Tensor got;
+  EXPECT_FALSE(AliasChunkColumnAndSlice(chunk, slice, &got));
+
+  slice.set_offset(0);
+  slice.set_length(2);
+  EXPECT_FALSE(AliasChunkColumnAndSlice(chunk, slice, &got));
+}
+
+TEST(AliasChunkColumnAndSlice, RejectsCompressedChunks) {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT, {4, 2});
+  auto chunk = std::make_shared<ChunkData>();
+  chunk->set_codec(CompressTensorAsProto(
+      tensor, chunk->mutable_data()->add_tensors(), COMPRESSION_SNAPPY));
+  chunk->set_data_tensors_len(1);
+
+  FlatTrajectory::ChunkSlice slice;
+  slice.set_index(0);
+  slice.set_offset(0);
+  slice.set_length(4);
+
+  tensorflow::Tensor got;
+  EXPECT_FALSE(AliasChunkColumnAndSlice(chunk, slice, &got));
+}
+
+TEST(AliasChunkColumnAndSlice, RejectsDeltaEncodedChunks) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT32, {4, 2});
+  tensor.flat<int32_t>().setZero();
+  auto chunk = MakeUncompressedChunk(tensor);
+  chunk->set_delta_encoded(true);
+
+  FlatTrajectory::ChunkSlice slice;
+  slice.set_index(0);
+  slice.set_offset(0);
+  slice.set_length(4);
+
+  tensorflow::Tensor got;
+  EXPECT_FALSE(AliasChunkColumnAndSlice(chunk, slice, &got));
+}
+
+TEST(AliasChunkColumnAndSlice, HonoursPerColumnStreams) {
+  tensorflow::Tensor ints(tensorflow::DT_INT32, {4, 2});
+  ints.flat<int32_t>().setRandom();
+  tensorflow::Tensor floats(tensorflow::DT_FLOAT, {4, 2});
+  floats.flat<float>().setRandom();
+
+  auto chunk = std::make_shared<ChunkData>();
+  auto* int_stream = chunk->add_column_streams();
+  int_stream->set_delta_encoded(true);
+  int_stream->set_codec(
+      CompressTensorAsProto(DeltaEncode(ints, /*encode=*/true),
+                            chunk->mutable_data()->add_tensors(),
+                            COMPRESSION_SNAPPY));
+  chunk->add_column_streams()->set_codec(CompressTensorAsProto(
+      floats, chunk->mutable_data()->add_tensors(), COMPRESSION_NONE));
+  chunk->set_data_tensors_len(2);
+
+  FlatTrajectory::ChunkSlice slice;
+  slice.set_offset(0);
+  slice.set_length(4);
+
+  // The raw float column can be aliased even though its sibling column is
+  // compressed.
+  tensorflow::Tensor got;
+  slice.set_index(0);
+  EXPECT_FALSE(AliasChunkColumnAndSlice(chunk, slice, &got));
+  slice.set_index(1);
+  ASSERT_TRUE(AliasChunkColumnAndSlice(chunk, slice, &got));
+  test::ExpectTensorEqual<float>(got, floats);
+}
+
 }  // namespace
 }  // namespace internal
 }  // namespace reverb
@@ -38,6 +38,11 @@ namespace internal {
 template <typename T>
 class UnboundedQueue {
  public:
+  // Any number of threads may push and pop concurrently. See
+  // `MpscUnboundedQueue` for a producer-side lock-free alternative when only
+  // a single thread consumes.
+  static constexpr bool kSingleConsumer = false;
+
   // Closes the queue. All pending and future calls to `Push()` and `Pop()` are
   // unblocked and return false without performing the operation. Additional
   // calls of Close after the first one have no effect.
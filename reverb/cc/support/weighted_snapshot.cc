@@ -0,0 +1,63 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/weighted_snapshot.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "reverb/cc/platform/logging.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+WeightedSnapshot::WeightedSnapshot(
+    std::vector<std::pair<ItemSelector::Key, double>> weights) {
+  keys_.reserve(weights.size());
+  cumulative_weights_.reserve(weights.size());
+  double sum = 0;
+  for (const auto& weight : weights) {
+    keys_.push_back(weight.first);
+    sum += weight.second;
+    cumulative_weights_.push_back(sum);
+  }
+}
+
+ItemSelector::KeyWithProbability WeightedSnapshot::Sample(
+    double target) const {
+  REVERB_CHECK(!keys_.empty());
+  const double total = total_weight();
+
+  // All keys have zero weight so treat as if uniformly sampling.
+  if (total == 0) {
+    const size_t pos = static_cast<size_t>(target * keys_.size());
+    return {keys_[pos], 1. / keys_.size()};
+  }
+
+  const double target_weight = target * total;
+  const auto it = std::upper_bound(cumulative_weights_.begin(),
+                                   cumulative_weights_.end(), target_weight);
+  const size_t index =
+      std::min<size_t>(it - cumulative_weights_.begin(), keys_.size() - 1);
+  const double weight =
+      cumulative_weights_[index] -
+      (index == 0 ? 0 : cumulative_weights_[index - 1]);
+  return {keys_[index], weight / total};
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
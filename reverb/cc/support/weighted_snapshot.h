@@ -0,0 +1,71 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_WEIGHTED_SNAPSHOT_H_
+#define REVERB_CC_SUPPORT_WEIGHTED_SNAPSHOT_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+#include "reverb/cc/selectors/interface.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// An immutable snapshot of a weighted key distribution. Once constructed the
+// snapshot is never mutated, so any number of threads can sample from it
+// concurrently without synchronization. It is the building block for epoch
+// style read paths where readers sample from a published snapshot while
+// writers keep mutating the live selector state.
+//
+// Sampling performs a binary search over the cumulative weights and therefore
+// costs O(log n) without touching any shared mutable state; the caller
+// provides the random value so the snapshot does not need to own a (non
+// thread-safe) bit generator.
+class WeightedSnapshot {
+ public:
+  // `weights` holds one (key, weight) pair per item. Weights must be
+  // non-negative; keys with zero weight are never sampled (unless all weights
+  // are zero, in which case sampling falls back to uniform).
+  explicit WeightedSnapshot(
+      std::vector<std::pair<ItemSelector::Key, double>> weights);
+
+  // Samples a key using `target`, which must be uniformly distributed in
+  // [0, 1). Must not be called if `empty()`.
+  ItemSelector::KeyWithProbability Sample(double target) const;
+
+  bool empty() const { return keys_.empty(); }
+
+  size_t size() const { return keys_.size(); }
+
+  double total_weight() const {
+    return cumulative_weights_.empty() ? 0 : cumulative_weights_.back();
+  }
+
+ private:
+  // Keys in the order their weights were provided.
+  std::vector<ItemSelector::Key> keys_;
+
+  // `cumulative_weights_[i]` is the sum of the weights of `keys_[0..i]`.
+  std::vector<double> cumulative_weights_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_WEIGHTED_SNAPSHOT_H_
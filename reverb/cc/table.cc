@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdlib>
 #include <initializer_list>
 #include <memory>
 #include <string>
@@ -24,7 +25,9 @@
 
 #include "google/protobuf/timestamp.pb.h"
 #include <cstdint>
+#include "absl/base/internal/cycleclock.h"
 #include "absl/memory/memory.h"
+#include "absl/random/distributions.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
@@ -38,11 +41,15 @@
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/hash_set.h"
 #include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/numa.h"
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/selectors/make_selector.h"
+#include "reverb/cc/support/trace.h"
 #include "reverb/cc/support/trajectory_util.h"
+#include "reverb/cc/support/weighted_snapshot.h"
 #include "reverb/cc/table_extensions/interface.h"
 
 namespace deepmind {
@@ -51,6 +58,16 @@ namespace {
 
 using Extensions = std::vector<std::shared_ptr<TableExtension>>;
 
+// Hints the CPU that the caller is in a spin-wait loop so the core can yield
+// pipeline resources (e.g. to a hyper-thread sibling) while waiting.
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  asm volatile("pause");
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
 inline bool IsInsertedBefore(const PrioritizedItem& a,
                              const PrioritizedItem& b) {
   return a.inserted_at().seconds() < b.inserted_at().seconds() ||
@@ -65,6 +82,12 @@ inline void EncodeAsTimestampProto(absl::Time t,
   proto->set_nanos((t - absl::FromUnixSeconds(s)) / absl::Nanoseconds(1));
 }
 
+inline absl::Time DecodeTimestampProto(
+    const google::protobuf::Timestamp& proto) {
+  return absl::FromUnixSeconds(proto.seconds()) +
+         absl::Nanoseconds(proto.nanos());
+}
+
 inline absl::Status CheckItemValidity(const Table::Item& item) {
   if (item.item.flat_trajectory().columns().empty() ||
       item.item.flat_trajectory().columns(0).chunk_slices().empty()) {
@@ -92,23 +115,42 @@ inline absl::Status CheckItemValidity(const Table::Item& item) {
 
 }  // namespace
 
-void Table::FinalizeSampleRequest(std::unique_ptr<Table::SampleRequest> request,
+void Table::FinalizeSampleRequest(std::shared_ptr<Table::SampleRequest> request,
                                   absl::Status status) {
-  Table::SampleRequest* r = request.release();
   // Sampling request could have been already finalized due to a timeout,
   // in such case it is a nullptr.
-  if (!r) {
+  if (request == nullptr) {
     return;
   }
-  r->status = status;
-  callback_executor_->Schedule([r] {
-    auto to_notify = r->on_batch_done.lock();
-    // Callback might have been destroyed in the meantime.
-    if (to_notify != nullptr) {
-      (*to_notify)(r);
-    }
-    delete r;
-  });
+  request->status = status;
+  // Stamp the queueing delay breakdown on the samples before handing them
+  // back to the client.
+  const absl::Duration queued_for = absl::Now() - request->enqueued_at;
+  const absl::Duration rate_limiter_wait =
+      absl::Nanoseconds(
+          rate_limiter_wait_total_ns_.load(std::memory_order_relaxed)) -
+      request->rate_limiter_wait_before;
+  for (auto& sample : request->samples) {
+    sample.queued_for = queued_for;
+    sample.rate_limiter_wait = rate_limiter_wait;
+  }
+  // Only successful waits feed the adaptive timeout; folding in timed out
+  // requests would make the p99.9 chase whatever timeout produced them.
+  if (request->status.ok()) {
+    rate_limiter_->RecordWait(queued_for);
+  }
+  // The table's address as affinity hint keeps its callbacks on one worker.
+  // Dropping the captured reference after the callback returns the request
+  // shell to `sample_request_pool_`.
+  callback_executor_->Schedule(reinterpret_cast<size_t>(this),
+                               [r = std::move(request)] {
+                                 auto to_notify = r->on_batch_done.lock();
+                                 // Callback might have been destroyed in the
+                                 // meantime.
+                                 if (to_notify != nullptr) {
+                                   (*to_notify)(r.get());
+                                 }
+                               });
 }
 
 // For a given set of sampling requests extract the ones exceeding provided
@@ -117,8 +159,8 @@ void Table::FinalizeSampleRequest(std::unique_ptr<Table::SampleRequest> request,
 // and replaced by nullptr.
 void GetExpiredRequests(
     const absl::Time& deadline,
-    std::vector<std::unique_ptr<Table::SampleRequest>>* requests,
-    std::vector<std::unique_ptr<Table::SampleRequest>>* to_terminate,
+    std::vector<std::shared_ptr<Table::SampleRequest>>* requests,
+    std::vector<std::shared_ptr<Table::SampleRequest>>* to_terminate,
     absl::Time* next_deadline) {
   for (auto& sample : *requests) {
     if (sample == nullptr) {
@@ -147,33 +189,68 @@ Table::Table(std::string name, std::shared_ptr<ItemSelector> sampler,
              std::shared_ptr<ItemSelector> remover, int64_t max_size,
              int32_t max_times_sampled, std::shared_ptr<RateLimiter> rate_limiter,
              Extensions extensions,
-             absl::optional<tensorflow::StructuredValue> signature)
+             absl::optional<tensorflow::StructuredValue> signature,
+             int64_t max_size_bytes)
     : sampler_(std::move(sampler)),
       remover_(std::move(remover)),
       num_deleted_episodes_(0),
       num_unique_samples_(0),
       max_size_(max_size),
+      max_size_bytes_(max_size_bytes),
       max_enqueued_inserts_(
           std::max(1L, std::min<int64_t>(max_size * kMaxEnqueuedInsertsPerc,
                                        kMaxEnqueuedInserts))),
       max_enqueued_extension_ops_(
           std::max(1L, std::min<int64_t>(max_size * kMaxPendingExtensionOpsPerc,
                                        kMaxPendingExtensionOps))),
+      max_enqueued_delete_ops_(
+          std::max(1L, std::min<int64_t>(max_size * kMaxPendingExtensionOpsPerc,
+                                       kMaxPendingDeleteOps))),
       max_times_sampled_(max_times_sampled),
       name_(std::move(name)),
       rate_limiter_(std::move(rate_limiter)),
       signature_(std::move(signature)),
       sync_extensions_(std::move(extensions)) {
+  item_pool_ = internal::ObjectPool<Item>::Create(
+      max_enqueued_inserts_, [](Item* item) {
+        // Release chunk references eagerly so idle pooled items do not keep
+        // chunk data alive.
+        item->chunks.clear();
+        item->item.Clear();
+        item->metadata_slot = internal::ItemMetadataStore::kInvalidSlot;
+      });
+  sample_request_pool_ = internal::ObjectPool<SampleRequest>::Create(
+      kMaxPooledSampleRequests, [](SampleRequest* request) {
+        // Release the item references but keep the vector's capacity so the
+        // next request of a similar batch size does not allocate.
+        request->samples.clear();
+        request->batch_size = 0;
+        request->status = absl::OkStatus();
+        request->on_batch_done.reset();
+        request->partial_since = absl::InfiniteFuture();
+      });
   REVERB_CHECK_OK(rate_limiter_->RegisterTable(this));
   for (auto& extension : sync_extensions_) {
     REVERB_CHECK_OK(extension->RegisterTable(&mu_, this));
   }
+  {
+    // The configuration of a selector never changes, so `info()` reads these
+    // copies instead of locking the live selectors.
+    absl::MutexLock lock(&mu_);
+    sampler_options_ = sampler_->options();
+    remover_options_ = remover_->options();
+  }
   auto executor =
       std::make_shared<TaskExecutor>(1, "TableCallbackExecutor_" + name_);
   EnableTableWorker(executor);
 }
 
 Table::~Table() {
+  // Stop the expiration closure before tearing down the workers it feeds
+  // deletions to.
+  if (expiration_closure_) {
+    REVERB_CHECK_OK(expiration_closure_->Stop());
+  }
   Close();
   {
     absl::MutexLock lock(&mu_);
@@ -201,7 +278,7 @@ absl::Status Table::TableWorkerLoop() {
   // Index of the next item in the `pending_inserts` to be processed.
   int insert_idx = 0;
   // Collection of sample requests to be processed.
-  std::vector<std::unique_ptr<SampleRequest>> current_sampling;
+  std::vector<std::shared_ptr<SampleRequest>> current_sampling;
   // Index of the next request from the `sampling_requests` to be processed.
   int sample_idx = 0;
   // Whether the next sample was rate limited.
@@ -214,35 +291,62 @@ absl::Status Table::TableWorkerLoop() {
   // worker has something to do (making progress) or should go to sleep.
   int64_t progress = 0;
   int64_t last_progress = 0;
+  // How long to spin before parking on `wakeup_worker_`. Adapts between one
+  // microsecond and `max_worker_spin_` based on whether recent spins observed
+  // the wakeup; zero while spinning is disabled.
+  absl::Duration spin_budget = absl::ZeroDuration();
+  // NUMA node the worker thread is currently bound to (see `SetNumaNode`).
+  int bound_numa_node = -1;
   {
     absl::MutexLock lock(&worker_mu_);
     worker_stats.Enter(TableWorkerState::kRunning);
   }
   while (true) {
+    MaybeBindToNumaNode(&bound_numa_node);
     {
       absl::MutexLock lock(&mu_);
       // Tracks whether while loop below makes progress.
       int64_t prev_progress = progress - 1;
       while (prev_progress < progress) {
         prev_progress = progress;
-        // Try processing an insert request.
+        // Try processing insert requests. The run of requests admitted by the
+        // rate limiter is applied as one block (bounded by
+        // `kInsertWorkerBatchSize` to keep sampling responsive) so that the
+        // completion callbacks can be scheduled as a single task.
         worker_stats.Enter(TableWorkerState::kActivelyInserting);
         if (insert_idx < current_inserts.size() &&
             rate_limiter_->CanInsert(&mu_, 1)) {
-          uint64_t id = current_inserts[insert_idx].item->item.key();
-          REVERB_RETURN_IF_ERROR(InsertOrAssignInternal(
-              std::move(current_inserts[insert_idx].item)));
-          auto callback =
-              std::move(current_inserts[insert_idx].insert_completed);
-          callback_executor_->Schedule([callback, id] {
-            auto to_notify = callback.lock();
-            // Callback might have been destroyed in the meantime.
-            if (to_notify != nullptr) {
-              (*to_notify)(id);
-            }
-          });
-          insert_idx++;
-          progress++;
+          std::vector<std::pair<std::weak_ptr<InsertCallback>, uint64_t>>
+              completed;
+          do {
+            uint64_t id = current_inserts[insert_idx].item->item.key();
+            REVERB_RETURN_IF_ERROR(InsertOrAssignInternal(
+                std::move(current_inserts[insert_idx].item)));
+            completed.emplace_back(
+                std::move(current_inserts[insert_idx].insert_completed), id);
+            insert_idx++;
+            progress++;
+          } while (static_cast<int64_t>(completed.size()) <
+                       kInsertWorkerBatchSize &&
+                   insert_idx < current_inserts.size() &&
+                   rate_limiter_->CanInsert(&mu_, 1));
+          // Insert completions run on the dedicated executor (when
+          // configured) so that a backlog of sampling responses can not
+          // starve them.
+          auto& insert_executor = insert_callback_executor_ != nullptr
+                                      ? insert_callback_executor_
+                                      : callback_executor_;
+          insert_executor->Schedule(reinterpret_cast<size_t>(this),
+                                    [completed = std::move(completed)] {
+                                      for (const auto& entry : completed) {
+                                        auto to_notify = entry.first.lock();
+                                        // Callback might have been destroyed
+                                        // in the meantime.
+                                        if (to_notify != nullptr) {
+                                          (*to_notify)(entry.second);
+                                        }
+                                      }
+                                    });
         }
         // Skip sampling requests which timed out already.
         worker_stats.Enter(TableWorkerState::kActivelySampling);
@@ -253,22 +357,51 @@ absl::Status Table::TableWorkerLoop() {
         // Try processing a sample request.
         if (sample_idx < current_sampling.size()) {
           auto& request = current_sampling[sample_idx];
-          while (rate_limiter_->MaybeCommitSample(&mu_)) {
+          // Reserve credits for the remainder of the request in a single
+          // operation so a full batch pays the admission arithmetic once
+          // instead of once per item.
+          int credits = rate_limiter_->MaybeCommitSamples(
+              &mu_, static_cast<int>(request->batch_size -
+                                     request->samples.size()));
+          while (credits > 0) {
+            if (data_.empty() || !rate_limiter_->MinSizeSatisfied()) {
+              // Deletions performed while drawing (e.g. due to
+              // `max_times_sampled`) invalidated the remaining credits.
+              rate_limiter_->RollbackSamples(credits);
+              break;
+            }
+            credits--;
             progress++;
             if (request->samples.empty()) {
               current_sampling_response_size_bytes = 0;
+              request->partial_since = absl::Now();
             }
             request->samples.emplace_back();
             REVERB_RETURN_IF_ERROR(
                 SampleInternal(rate_limited, &request->samples.back()));
             // Capacity of the samples collection indicates how many items
             // should be sampled.
-            for (const auto& chunk : request->samples.back().ref->chunks) {
-              current_sampling_response_size_bytes += chunk->DataByteSizeLong();
+            const auto& sampled_ref = request->samples.back().ref;
+            if (sampled_ref->metadata_slot !=
+                internal::ItemMetadataStore::kInvalidSlot) {
+              current_sampling_response_size_bytes +=
+                  hot_metadata_.num_bytes(sampled_ref->metadata_slot);
+            } else {
+              // The item was deleted by the sample (max_times_sampled
+              // reached) so its cached byte size is gone; fall back to
+              // walking the chunks.
+              for (const auto& chunk : sampled_ref->chunks) {
+                current_sampling_response_size_bytes +=
+                    chunk->DataByteSizeLong();
+              }
             }
-            if (request->samples.capacity() == request->samples.size() ||
+            if (static_cast<int>(request->samples.size()) >=
+                    request->batch_size ||
                 current_sampling_response_size_bytes >=
-                    kMaxSampleResponseSizeBytes) {
+                    max_sample_response_size_bytes()) {
+              // Return the credits we reserved but didn't use (the response
+              // size limit can cut the batch short).
+              rate_limiter_->RollbackSamples(credits);
               // Finalized request is moved out of sampling_requests.
               // As we break from the request processing loop, there is no need
               // to reset current_sampling_response_size_bytes.
@@ -277,12 +410,28 @@ absl::Status Table::TableWorkerLoop() {
               break;
             }
           }
+          // The rate limiter admitted the batch only partially and the
+          // gathered samples have aged past the bound. Flush them instead of
+          // holding the response until the rest of the batch is admitted:
+          // while inserts keep the worker busy (e.g. a nearly empty table at
+          // experiment start) the pre-sleep flush below is never reached and
+          // a trickle-filled batch would otherwise only flow once complete.
+          if (sample_idx < current_sampling.size() &&
+              current_sampling[sample_idx] != nullptr &&
+              !current_sampling[sample_idx]->samples.empty() &&
+              absl::Now() - current_sampling[sample_idx]->partial_since >=
+                  kMaxPartialSampleBatchAge) {
+            FinalizeSampleRequest(std::move(current_sampling[sample_idx]),
+                                  absl::OkStatus());
+            sample_idx++;
+            progress++;
+          }
         }
       }
     }
     worker_stats.Enter(TableWorkerState::kRunning);
     // Sampling requests that exceeded deadline and should be terminated.
-    std::vector<std::unique_ptr<Table::SampleRequest>> to_terminate;
+    std::vector<std::shared_ptr<Table::SampleRequest>> to_terminate;
     {
       absl::MutexLock lock(&worker_mu_);
       if (stop_worker_) {
@@ -292,6 +441,15 @@ absl::Status Table::TableWorkerLoop() {
       // to hold this mutex each time worker stats are updated, so
       // `worker_time_distribution_` is updated periodically.
       worker_time_distribution_ = worker_stats;
+      if (const absl::Time now = absl::Now();
+          now - last_queue_depth_sample_ >= kQueueDepthSamplePeriod) {
+        last_queue_depth_sample_ = now;
+        queue_depth_history_.push_back(pending_inserts_.size() +
+                                       pending_sampling_.size());
+        if (queue_depth_history_.size() > kQueueDepthHistoryLength) {
+          queue_depth_history_.pop_front();
+        }
+      }
       if (insert_idx == current_inserts.size() &&
           !pending_inserts_.empty()) {
         // Get a new batch of insert requests as previous batch is done.
@@ -344,7 +502,59 @@ absl::Status Table::TableWorkerLoop() {
         worker_time_distribution_ = worker_stats;
         rate_limited = !current_sampling.empty() &&
                        sample_idx != current_sampling.size();
-        wakeup_worker_.WaitWithDeadline(&worker_mu_, wakeup);
+        {
+          // Only record the sleep as a rate limiter wait when there are
+          // sample requests that the rate limiter is holding back; an idle
+          // worker sleeping for lack of work is not interesting to trace.
+          absl::optional<internal::ScopedTrace> trace;
+          absl::Time sleep_started;
+          if (rate_limited) {
+            trace.emplace("rate_limiter_wait");
+            sleep_started = absl::Now();
+          }
+          // Pick up configuration changes made through `EnableWorkerSpinWait`.
+          if (spin_budget == absl::ZeroDuration() ||
+              spin_budget > max_worker_spin_) {
+            spin_budget = max_worker_spin_;
+          }
+          bool woken_by_spin = false;
+          if (spin_budget > absl::ZeroDuration()) {
+            // At the samples-per-insert equilibrium the admission credit the
+            // worker is waiting for typically arrives within microseconds, so
+            // a bounded spin (off the mutex) is cheaper than parking on the
+            // condition variable and eating the wakeup latency.
+            const uint64_t epoch =
+                worker_wakeup_epoch_.load(std::memory_order_acquire);
+            const absl::Duration budget =
+                std::min(spin_budget, wakeup - absl::Now());
+            worker_mu_.Unlock();
+            woken_by_spin = SpinForWakeup(epoch, budget);
+            worker_mu_.Lock();
+            // The wakeup may also have arrived between the spin giving up and
+            // the mutex being reacquired.
+            woken_by_spin =
+                woken_by_spin ||
+                worker_wakeup_epoch_.load(std::memory_order_acquire) != epoch;
+            // Grow the budget when the spin caught the wakeup and shrink it
+            // when the spin was wasted so a table whose waits outgrow the
+            // configured bound stops burning CPU on them.
+            if (woken_by_spin) {
+              spin_budget = std::min(max_worker_spin_, spin_budget * 2);
+            } else {
+              spin_budget = std::max(absl::Microseconds(1), spin_budget / 2);
+            }
+          }
+          if (!woken_by_spin) {
+            worker_sleeping_ = true;
+            wakeup_worker_.WaitWithDeadline(&worker_mu_, wakeup);
+            worker_sleeping_ = false;
+          }
+          if (rate_limited) {
+            rate_limiter_wait_total_ns_.fetch_add(
+                absl::ToInt64Nanoseconds(absl::Now() - sleep_started),
+                std::memory_order_relaxed);
+          }
+        }
         worker_stats.Enter(TableWorkerState::kRunning);
       }
     }
@@ -390,17 +600,42 @@ absl::Status Table::ExtensionsWorkerLoop() {
   // Collection of deleted items for which memory is to be released by the
   // clients (to not perform expensive operations inside the worker loop).
   std::vector<std::shared_ptr<Item>> deleted_items;
+  // Scratch buffer holding a run of consecutive requests of the same type.
+  // Runs are dispatched to each extension as a single batch so extensions can
+  // amortize their per call costs across many items.
+  std::vector<ExtensionItem> batch;
+  // NUMA node the worker thread is currently bound to (see `SetNumaNode`).
+  int bound_numa_node = -1;
   {
     absl::MutexLock lock(&mu_);
     extension_worker_sleeps_ = false;
   }
   while (true) {
-    {
-      absl::MutexLock lock(&worker_mu_);
-      if (deleted_items_.empty() && !deleted_items.empty()) {
-        // Deleted items are freed by the clients to spread the load.
-        // Previous deletion batch has been processed, give clients a new batch.
-        std::swap(deleted_items, deleted_items_);
+    MaybeBindToNumaNode(&bound_numa_node);
+    if (!deleted_items.empty()) {
+      std::shared_ptr<TaskExecutor> reclamation_executor;
+      {
+        absl::MutexLock lock(&mu_);
+        reclamation_executor = callback_executor_;
+      }
+      if (reclamation_executor != nullptr) {
+        // Releasing the chunk references of a deletion batch can cascade
+        // into freeing megabytes, so reclamation runs on the executor where
+        // it blocks neither the workers nor inserting clients. The task only
+        // owns the carcasses and may safely outlive the table.
+        auto carcasses =
+            std::make_shared<std::vector<std::shared_ptr<Item>>>(
+                std::move(deleted_items));
+        reclamation_executor->Schedule([carcasses] { carcasses->clear(); });
+        deleted_items.clear();
+      } else {
+        absl::MutexLock lock(&worker_mu_);
+        if (deleted_items_.empty()) {
+          // Without an executor, deleted items are freed by the clients to
+          // spread the load. Previous deletion batch has been processed,
+          // give clients a new batch.
+          std::swap(deleted_items, deleted_items_);
+        }
       }
     }
     {
@@ -421,7 +656,11 @@ absl::Status Table::ExtensionsWorkerLoop() {
         extension_worker_sleeps_ = false;
       }
       std::swap(extension_requests_, extension_requests);
-      if (extension_requests.size() >= max_enqueued_extension_ops_) {
+      const int64_t delete_requests = num_pending_delete_requests_;
+      num_pending_delete_requests_ = 0;
+      if (static_cast<int64_t>(extension_requests.size()) - delete_requests >=
+              max_enqueued_extension_ops_ ||
+          delete_requests >= max_enqueued_delete_ops_) {
         // Let know waiting clients there is place to add more
         // extension requests now. There may be many clients - table worker
         // and table API calls not performed through the worker.
@@ -430,33 +669,55 @@ absl::Status Table::ExtensionsWorkerLoop() {
     }
     {
       absl::MutexLock lock(&async_extensions_mu_);
-      for (auto& request : extension_requests) {
-        switch (request.call_type) {
+      for (size_t start = 0; start < extension_requests.size();) {
+        // Coalesce the maximal run of consecutive requests of the same type
+        // into one batch. Operation order is preserved as runs are dispatched
+        // in queue order.
+        const auto call_type = extension_requests[start].call_type;
+        size_t end = start + 1;
+        while (end < extension_requests.size() &&
+               extension_requests[end].call_type == call_type) {
+          ++end;
+        }
+        batch.clear();
+        for (size_t i = start; i < end; ++i) {
+          batch.push_back(std::move(extension_requests[i].item));
+          // Range deletes carry additional items of the same call type.
+          for (auto& more : extension_requests[i].more_items) {
+            batch.push_back(std::move(more));
+          }
+        }
+        switch (call_type) {
           case ExtensionRequest::CallType::kInsert:
             for (auto& extension : async_extensions_) {
-              extension->OnInsert(&async_extensions_mu_, request.item);
+              extension->OnInsertBatch(&async_extensions_mu_, batch);
             }
             break;
           case ExtensionRequest::CallType::kSample:
             for (auto& extension : async_extensions_) {
-              extension->OnSample(&async_extensions_mu_, request.item);
+              extension->OnSampleBatch(&async_extensions_mu_, batch);
             }
             break;
           case ExtensionRequest::CallType::kUpdate:
             for (auto& extension : async_extensions_) {
-              extension->OnUpdate(&async_extensions_mu_, request.item);
+              extension->OnUpdateBatch(&async_extensions_mu_, batch);
             }
             break;
           case ExtensionRequest::CallType::kDelete:
             for (auto& extension : async_extensions_) {
-              extension->OnDelete(&async_extensions_mu_, request.item);
+              extension->OnDeleteBatch(&async_extensions_mu_, batch);
+            }
+            for (auto& item : batch) {
+              deleted_items.push_back(std::move(item.ref));
             }
-            deleted_items.push_back(std::move(request.item.ref));
             break;
           case ExtensionRequest::CallType::kMemoryRelease:
-            deleted_items.push_back(std::move(request.item.ref));
+            for (auto& item : batch) {
+              deleted_items.push_back(std::move(item.ref));
+            }
             break;
         }
+        start = end;
       }
     }
     extension_requests.clear();
@@ -468,6 +729,20 @@ void Table::SetCallbackExecutor(std::shared_ptr<TaskExecutor> executor) {
   callback_executor_ = executor;
 }
 
+void Table::SetMaxSampleResponseSizeBytes(int64_t max_bytes) {
+  REVERB_CHECK_GT(max_bytes, 0);
+  max_sample_response_size_bytes_.store(max_bytes, std::memory_order_relaxed);
+}
+
+int64_t Table::max_sample_response_size_bytes() const {
+  return max_sample_response_size_bytes_.load(std::memory_order_relaxed);
+}
+
+void Table::SetInsertCallbackExecutor(std::shared_ptr<TaskExecutor> executor) {
+  absl::MutexLock lock(&mu_);
+  insert_callback_executor_ = executor;
+}
+
 void Table::EnableTableWorker(std::shared_ptr<TaskExecutor> executor) {
   {
     absl::MutexLock lock(&mu_);
@@ -501,19 +776,47 @@ void Table::EnableTableWorker(std::shared_ptr<TaskExecutor> executor) {
   }
 }
 
+void Table::SetNumaNode(int node) {
+  numa_node_.store(node, std::memory_order_relaxed);
+}
+
+int Table::numa_node() const {
+  return numa_node_.load(std::memory_order_relaxed);
+}
+
+void Table::MaybeBindToNumaNode(int* bound_node) {
+  const int node = numa_node_.load(std::memory_order_relaxed);
+  if (node == *bound_node) {
+    return;
+  }
+  // Remember the node even when binding fails so the warning is logged once
+  // instead of on every iteration.
+  *bound_node = node;
+  if (node < 0) {
+    return;
+  }
+  const auto status = internal::BindCurrentThreadToNumaNode(node);
+  REVERB_LOG_IF(REVERB_WARNING, !status.ok())
+      << "Failed to bind a worker of table " << name_ << " to NUMA node "
+      << node << ": " << status.message();
+}
+
 std::vector<Table::Item> Table::Copy(size_t count) const {
   std::vector<Item> items;
   absl::MutexLock lock(&mu_);
   items.reserve(count == 0 ? data_.size() : count);
   for (auto it = data_.cbegin();
        it != data_.cend() && (count == 0 || items.size() < count); it++) {
-    items.push_back(*it->second);
+    items.push_back(*items_.get(it->second));
   }
   return items;
 }
 
 absl::Status Table::InsertOrAssign(Item item, absl::Duration timeout) {
   REVERB_RETURN_IF_ERROR(CheckItemValidity(item));
+  if (timeout == kAdaptiveTimeout) {
+    timeout = rate_limiter_->AdaptiveTimeout();
+  }
   // This code path is here mainly to allow running existing tests with the
   // table that has a table worker. To be removed together with this entire
   // function once async server is fully enabled.
@@ -529,12 +832,24 @@ absl::Status Table::InsertOrAssign(Item item, absl::Duration timeout) {
   return errors::RateLimiterTimeout();
 }
 
+int64_t Table::AdmissionLimit(int admission_class) const {
+  const int shift = std::min(std::abs(admission_class), 20);
+  if (admission_class >= 0) {
+    return max_enqueued_inserts_ << shift;
+  }
+  return std::max<int64_t>(1, max_enqueued_inserts_ >> shift);
+}
+
 absl::Status Table::InsertOrAssignAsync(
     Item item, bool* can_insert_more,
-    std::weak_ptr<InsertCallback> insert_completed) {
+    std::weak_ptr<InsertCallback> insert_completed, int admission_class) {
   REVERB_RETURN_IF_ERROR(CheckItemValidity(item));
-  InsertRequest request{std::make_shared<Item>(std::move(item)),
-                        std::move(insert_completed)};
+  if (unpacked_chunk_cache_ != nullptr) {
+    AttachChunkCache(item);
+  }
+  std::shared_ptr<Item> pooled_item = item_pool_->Acquire();
+  *pooled_item = std::move(item);
+  InsertRequest request{std::move(pooled_item), std::move(insert_completed)};
   // Table worker doesn't release memory of removed items, clients do that
   // asynchrously.
   std::shared_ptr<Item> to_delete;
@@ -544,12 +859,55 @@ absl::Status Table::InsertOrAssignAsync(
       return absl::CancelledError("RateLimiter has been cancelled");
     }
     pending_inserts_.push_back(std::move(request));
-    wakeup_worker_.Signal();
+    WakeupWorker();
     if (!deleted_items_.empty()) {
       to_delete = std::move(deleted_items_.back());
       deleted_items_.pop_back();
     }
-    *can_insert_more = pending_inserts_.size() < max_enqueued_inserts_;
+    *can_insert_more =
+        pending_inserts_.size() < AdmissionLimit(admission_class);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Table::InsertOrAssignBatch(
+    std::vector<Item> items, bool* can_insert_more,
+    std::weak_ptr<InsertCallback> insert_completed, int admission_class) {
+  // Validate everything up front so that the batch is enqueued either
+  // entirely or not at all.
+  for (const auto& item : items) {
+    REVERB_RETURN_IF_ERROR(CheckItemValidity(item));
+  }
+  if (unpacked_chunk_cache_ != nullptr) {
+    for (const auto& item : items) {
+      AttachChunkCache(item);
+    }
+  }
+  std::vector<InsertRequest> requests;
+  requests.reserve(items.size());
+  for (auto& item : items) {
+    std::shared_ptr<Item> pooled_item = item_pool_->Acquire();
+    *pooled_item = std::move(item);
+    requests.push_back({std::move(pooled_item), insert_completed});
+  }
+  // Table worker doesn't release memory of removed items, clients do that
+  // asynchrously.
+  std::vector<std::shared_ptr<Item>> to_delete;
+  {
+    absl::MutexLock lock(&worker_mu_);
+    if (stop_worker_) {
+      return absl::CancelledError("RateLimiter has been cancelled");
+    }
+    pending_inserts_.insert(pending_inserts_.end(),
+                            std::make_move_iterator(requests.begin()),
+                            std::make_move_iterator(requests.end()));
+    WakeupWorker();
+    while (!deleted_items_.empty() && to_delete.size() < requests.size()) {
+      to_delete.push_back(std::move(deleted_items_.back()));
+      deleted_items_.pop_back();
+    }
+    *can_insert_more =
+        pending_inserts_.size() < AdmissionLimit(admission_class);
   }
   return absl::OkStatus();
 }
@@ -565,53 +923,388 @@ absl::Status Table::InsertOrAssignInternal(std::shared_ptr<Item> item) {
 
   // Set the insertion timestamp after the lock has been acquired as this
   // represents the order it was inserted into the sampler and remover.
-  EncodeAsTimestampProto(absl::Now(), item->item.mutable_inserted_at());
-  data_[key] = std::move(item);
+  const absl::Time now = absl::Now();
+  EncodeAsTimestampProto(now, item->item.mutable_inserted_at());
+  if (max_item_age_ != absl::InfiniteDuration()) {
+    const bool was_idle = expiration_queue_.empty();
+    expiration_queue_.emplace_back(now, key);
+    // The expiration closure backs off while it has nothing to do; the first
+    // insert after an idle period re-arms it so the new item is not observed
+    // late. Inserts into a non-empty queue skip the signal.
+    if (was_idle && expiration_closure_ != nullptr) {
+      expiration_closure_->Wakeup();
+    }
+  }
+  const uint32_t arena_slot = items_.Add(std::move(item));
+  data_[key] = arena_slot;
 
   REVERB_RETURN_IF_ERROR(sampler_->Insert(key, priority));
-  REVERB_RETURN_IF_ERROR(remover_->Insert(key, priority));
+  REVERB_RETURN_IF_ERROR(
+      remover_->Insert(key, evict_by_marginal_bytes_ ? 0 : priority));
 
-  auto it = data_.find(key);
+  Item* stored = items_.get(arena_slot);
 
   // Increment references to the episode/s the item is referencing.
   // We increment before a possible call to DeleteItem since the sampler can
   // return this key.
-  for (const auto& chunk : it->second->chunks) {
+  int64_t item_num_bytes = 0;
+  int64_t marginal_bytes = 0;
+  for (const auto& chunk : stored->chunks) {
+    const int64_t chunk_bytes = chunk->DataByteSizeLong();
+    item_num_bytes += chunk_bytes;
     ++episode_refs_[chunk->episode_id()];
+    ChunkRef& ref = chunk_refs_[chunk->key()];
+    if (++ref.num_items == 1) {
+      ref.chunk = chunk;
+      num_bytes_ += chunk_bytes;
+      marginal_bytes += chunk_bytes;
+    } else if (evict_by_marginal_bytes_ && ref.num_items == 2) {
+      // The chunk is no longer exclusively owned, so evicting the previous
+      // sole owner would no longer free it.
+      const Key other = ref.item_keys.front();
+      REVERB_RETURN_IF_ERROR(
+          remover_->Update(other, marginal_bytes_[other] -= chunk_bytes));
+    }
+    if (evict_by_marginal_bytes_) {
+      ref.item_keys.push_back(key);
+    }
+  }
+  if (evict_by_marginal_bytes_) {
+    marginal_bytes_[key] = marginal_bytes;
+    REVERB_RETURN_IF_ERROR(remover_->Update(key, marginal_bytes));
   }
 
-  ExtensionOperation(ExtensionRequest::CallType::kInsert, it->second);
+  stored->metadata_slot = hot_metadata_.Add(
+      key, priority, stored->item.times_sampled(), item_num_bytes);
+
+  ExtensionOperation(ExtensionRequest::CallType::kInsert,
+                     items_.shared(arena_slot));
+
+  // Evicted items are reported to the extensions as a single range delete so
+  // that a large eviction sweep occupies one slot of the extension queue
+  // instead of throttling the insert that triggered it.
+  std::vector<ExtensionItem> evicted;
 
   // Remove an item if we exceeded `max_size_`.
   if (data_.size() > max_size_) {
-    REVERB_RETURN_IF_ERROR(DeleteItem(remover_->Sample().key));
+    REVERB_RETURN_IF_ERROR(
+        DeleteItem(remover_->Sample().key, nullptr, &evicted));
+  }
+
+  // Remove items until the byte limit is respected again. Note that deleting
+  // an item only releases bytes that are not shared with remaining items, so
+  // several removals may be required.
+  while (max_size_bytes_ > 0 && num_bytes_ > max_size_bytes_ &&
+         data_.size() > 1) {
+    REVERB_RETURN_IF_ERROR(
+        DeleteItem(remover_->Sample().key, nullptr, &evicted));
   }
+  EnqueueRangeDelete(std::move(evicted));
 
   // Now that the new item has been inserted and an older item has
   // (potentially) been removed the insert can be finalized.
   rate_limiter_->Insert(&mu_);
+  num_mutations_.fetch_add(1, std::memory_order_relaxed);
+  PublishTableStats();
   return absl::OkStatus();
 }
 
 absl::Status Table::MutateItems(absl::Span<const KeyWithPriority> updates,
                                 absl::Span<const Key> deletes) {
-  std::vector<std::shared_ptr<Item>> deleted_items(deletes.size());
-  {
-    absl::MutexLock lock(&mu_);
-    for (int i = 0; i < deletes.size(); i++) {
-      REVERB_RETURN_IF_ERROR(DeleteItem(deletes[i], &deleted_items[i]));
-    }
-    for (const auto& item : updates) {
-      REVERB_RETURN_IF_ERROR(UpdateItem(item.key(), item.priority()));
+  // Upper bound on the number of operations applied per lock hold. Cleanup
+  // jobs send batches of 100k+ keys in a single request; applying them in
+  // bounded slices lets samplers and inserters interleave between slices
+  // instead of stalling behind one long critical section. The operations of a
+  // partially failed call may have been applied partially either way, so
+  // slicing does not change the error semantics.
+  static constexpr size_t kMaxMutationsPerLockHold = 4096;
+
+  while (!deletes.empty() || !updates.empty()) {
+    const size_t num_deletes =
+        std::min(deletes.size(), kMaxMutationsPerLockHold);
+    const size_t num_updates =
+        std::min(updates.size(), kMaxMutationsPerLockHold - num_deletes);
+    // Holding the only reference, the carcasses of this slice are released
+    // after the lock below has been dropped.
+    std::vector<std::shared_ptr<Item>> deleted_items(num_deletes);
+    {
+      absl::MutexLock lock(&mu_);
+      for (int i = 0; i < num_deletes; i++) {
+        REVERB_RETURN_IF_ERROR(DeleteItem(deletes[i], &deleted_items[i]));
+      }
+      if (num_updates == 1) {
+        REVERB_RETURN_IF_ERROR(
+            UpdateItem(updates[0].key(), updates[0].priority()));
+      } else if (num_updates > 0) {
+        REVERB_RETURN_IF_ERROR(BulkUpdateItems(updates.first(num_updates)));
+      }
     }
+    deletes.remove_prefix(num_deletes);
+    updates.remove_prefix(num_updates);
   }
   // Table worker doesn't listen on rate_limiter, so need to wake it up
   // explicitly.
   absl::MutexLock lock(&worker_mu_);
-  wakeup_worker_.Signal();
+  WakeupWorker();
   return absl::OkStatus();
 }
 
+void Table::EnableItemExpiration(absl::Duration max_item_age) {
+  REVERB_CHECK_GT(max_item_age, absl::ZeroDuration());
+  {
+    absl::MutexLock lock(&mu_);
+    REVERB_CHECK(max_item_age_ == absl::InfiniteDuration())
+        << "EnableItemExpiration called twice on table " << name_ << ".";
+    max_item_age_ = max_item_age;
+    // Seed the queue with the items already in the table (e.g. restored from
+    // a checkpoint). The queue must be ordered by insertion time.
+    for (const auto& [key, slot] : data_) {
+      expiration_queue_.emplace_back(
+          DecodeTimestampProto(items_.get(slot)->item.inserted_at()), key);
+    }
+    std::sort(expiration_queue_.begin(), expiration_queue_.end());
+  }
+  // Adaptive period: while nothing expires (e.g. an idle or empty table) the
+  // check backs off up to 30s, bounding both the idle wakeup rate and how
+  // late an expiration can be observed; inserts into an empty queue re-arm
+  // it promptly (see `InsertOrAssign`).
+  expiration_closure_ = absl::make_unique<internal::PeriodicClosure>(
+      [this]() -> bool { return DeleteExpiredItems(); },
+      std::min(max_item_age / 2, absl::Seconds(1)),
+      std::min(max_item_age / 2, absl::Seconds(30)),
+      "TableExpiration_" + name_);
+  REVERB_CHECK_OK(expiration_closure_->Start());
+}
+
+void Table::EnableMarginalBytesEviction() {
+  absl::MutexLock lock(&mu_);
+  REVERB_CHECK(data_.empty())
+      << "EnableMarginalBytesEviction must be called before table " << name_
+      << " contains any items.";
+  evict_by_marginal_bytes_ = true;
+}
+
+void Table::EnableUncompressedChunkCache(size_t max_cached_bytes,
+                                         bool decompress_on_insert) {
+  unpacked_chunk_cache_ =
+      std::make_shared<internal::UnpackedChunkCache>(max_cached_bytes);
+  decompress_chunks_on_insert_ = decompress_on_insert;
+}
+
+void Table::AttachChunkCache(const Item& item) const {
+  for (const auto& chunk : item.chunks) {
+    chunk->EnableUnpackedCaching(unpacked_chunk_cache_);
+    if (decompress_chunks_on_insert_) {
+      // A chunk that cannot be decompressed here is not an insertion error;
+      // it is simply served compressed and unpacked per sample as before.
+      internal::WarmUnpackedColumnCache(chunk).IgnoreError();
+    }
+  }
+}
+
+void Table::EnableWorkerSpinWait(absl::Duration max_spin_duration) {
+  REVERB_CHECK_GE(max_spin_duration, absl::ZeroDuration());
+  absl::MutexLock lock(&worker_mu_);
+  max_worker_spin_ = max_spin_duration;
+}
+
+void Table::WakeupWorker() {
+  worker_wakeup_epoch_.fetch_add(1, std::memory_order_release);
+  // Only signal when the worker is actually parked on the condition variable;
+  // a running or spinning worker observes the epoch bump without the producer
+  // paying for a wakeup syscall.
+  if (worker_sleeping_) {
+    wakeup_worker_.Signal();
+  }
+}
+
+bool Table::SpinForWakeup(uint64_t epoch, absl::Duration budget) const {
+  const int64_t deadline =
+      absl::base_internal::CycleClock::Now() +
+      static_cast<int64_t>(absl::ToDoubleSeconds(budget) *
+                           absl::base_internal::CycleClock::Frequency());
+  while (absl::base_internal::CycleClock::Now() < deadline) {
+    // Poll the epoch in small batches so the loop spends most of its time in
+    // pause instructions rather than reading the cycle counter.
+    for (int i = 0; i < 64; ++i) {
+      if (worker_wakeup_epoch_.load(std::memory_order_acquire) != epoch) {
+        return true;
+      }
+      CpuRelax();
+    }
+  }
+  return false;
+}
+
+bool Table::DeleteExpiredItems() {
+  int num_deleted = 0;
+  {
+    absl::MutexLock lock(&mu_);
+    const absl::Time cutoff = absl::Now() - max_item_age_;
+    // Expired items are reported to the extensions as a single range delete;
+    // a sweep over a long idle period may delete most of the table.
+    std::vector<ExtensionItem> expired;
+    while (!expiration_queue_.empty() &&
+           expiration_queue_.front().first <= cutoff) {
+      const Key key = expiration_queue_.front().second;
+      expiration_queue_.pop_front();
+      // Items deleted before they expired are ignored by `DeleteItem`. The
+      // memory of deleted items is released outside of this closure (see
+      // `deleted_items_`).
+      if (data_.contains(key)) {
+        absl::Status status = DeleteItem(key, nullptr, &expired);
+        REVERB_LOG_IF(REVERB_ERROR, !status.ok())
+            << "Failed to delete expired item " << key << " from table "
+            << name_ << ": " << status;
+        ++num_deleted;
+      }
+    }
+    EnqueueRangeDelete(std::move(expired));
+  }
+  if (num_deleted > 0) {
+    // Deletions may have unblocked inserts; the table worker doesn't listen
+    // on the rate limiter so it has to be woken up explicitly.
+    absl::MutexLock lock(&worker_mu_);
+    WakeupWorker();
+  }
+  return num_deleted > 0;
+}
+
+void Table::EnableSamplingSnapshots(int64_t max_staleness) {
+  REVERB_CHECK_GT(max_staleness, 0);
+  absl::MutexLock lock(&snapshot_mu_);
+  snapshot_max_staleness_ = max_staleness;
+}
+
+void Table::RefreshSnapshot() {
+  std::vector<std::pair<Key, double>> weights;
+  {
+    absl::MutexLock lock(&mu_);
+    sampler_->ExportSamplingWeights(&weights);
+    snapshot_mutation_count_ = num_mutations_.load(std::memory_order_relaxed);
+  }
+  sampling_snapshot_ =
+      std::make_shared<const internal::WeightedSnapshot>(std::move(weights));
+}
+
+absl::Status Table::SampleFromSnapshot(SampledItem* result) {
+  // Items sampled from the snapshot may have been deleted from the table in
+  // the meantime. Such draws are discarded and retried; the bound only exists
+  // to guarantee termination when almost the entire snapshot is stale.
+  static constexpr int kMaxAttempts = 16;
+
+  std::shared_ptr<const internal::WeightedSnapshot> snapshot;
+  double target;
+  {
+    absl::MutexLock lock(&snapshot_mu_);
+    if (snapshot_max_staleness_ == 0) {
+      return absl::FailedPreconditionError(absl::StrCat(
+          "SampleFromSnapshot called on table ", name_,
+          " without calling EnableSamplingSnapshots first."));
+    }
+    if (sampling_snapshot_ == nullptr ||
+        num_mutations_.load(std::memory_order_relaxed) -
+                snapshot_mutation_count_ >=
+            snapshot_max_staleness_) {
+      RefreshSnapshot();
+    }
+    snapshot = sampling_snapshot_;
+    target = absl::Uniform<double>(snapshot_bit_gen_, 0, 1);
+  }
+
+  if (snapshot->empty()) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Table ", name_, " has no snapshot to sample from; it is either ",
+        "empty or its sampler does not support snapshot exports."));
+  }
+
+  // Commit the sample through the lock-free fast path when the limiter has
+  // headroom; only near the admission boundary do we fall back to the exact
+  // accounting under the table mutex.
+  bool committed = rate_limiter_->TryCommitSampleFastPath();
+
+  for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
+    const auto sample = snapshot->Sample(target);
+    bool found = false;
+    absl::Status status = absl::OkStatus();
+    {
+      absl::MutexLock lock(&mu_);
+      auto it = data_.find(sample.key);
+      if (it != data_.end()) {
+        if (!committed && !rate_limiter_->MaybeCommitSample(&mu_)) {
+          return absl::FailedPreconditionError(absl::StrCat(
+              "RateLimiter state of table ", name_,
+              " does not currently allow sampling. Use CanSample to await ",
+              "admission before calling SampleFromSnapshot."));
+        }
+        found = true;
+        PrepareForMutation(items_.mutable_shared(it->second));
+        const std::shared_ptr<Item>& item = items_.shared(it->second);
+        const int64_t slot = item->metadata_slot;
+        const int32_t times_sampled = hot_metadata_.IncrementTimesSampled(slot);
+        if (times_sampled == 1) {
+          ++num_unique_samples_;
+          PublishTableStats();
+        }
+        item->item.set_times_sampled(times_sampled);
+        remover_->MarkSampled(sample.key);
+
+        int64_t chunk_compressed_bytes = 0;
+        int64_t chunk_uncompressed_bytes = 0;
+        for (const auto& chunk : item->chunks) {
+          chunk_compressed_bytes += chunk->DataByteSizeLong();
+          chunk_uncompressed_bytes += chunk->uncompressed_byte_size();
+        }
+
+        *result = {
+            .ref = item,
+            .probability = sample.probability,
+            .table_size = static_cast<int64_t>(data_.size()),
+            .priority = hot_metadata_.priority(slot),
+            .times_sampled = times_sampled,
+            .rate_limited = false,
+            .min_sampling_weight = sampler_->MinWeight(),
+            .max_sampling_weight = sampler_->MaxWeight(),
+            .chunk_compressed_bytes = chunk_compressed_bytes,
+            .chunk_uncompressed_bytes = chunk_uncompressed_bytes,
+        };
+
+        ExtensionOperation(ExtensionRequest::CallType::kSample, item);
+
+        if (times_sampled == max_times_sampled_) {
+          status = DeleteItem(sample.key);
+        }
+      }
+    }
+    if (found) {
+      // The committed sample (and a possible max_times_sampled deletion) may
+      // have unblocked inserts; the table worker doesn't listen on the rate
+      // limiter so it has to be woken up explicitly.
+      absl::MutexLock lock(&worker_mu_);
+      WakeupWorker();
+      return status;
+    }
+    // The sampled item has been deleted since the snapshot was built; draw
+    // again.
+    absl::MutexLock lock(&snapshot_mu_);
+    target = absl::Uniform<double>(snapshot_bit_gen_, 0, 1);
+  }
+
+  // Nearly everything we draw from the snapshot is gone; force a refresh so
+  // the next call starts from a fresh view.
+  if (committed) {
+    rate_limiter_->RollbackSample();
+  }
+  {
+    absl::MutexLock lock(&snapshot_mu_);
+    sampling_snapshot_ = nullptr;
+  }
+  return absl::UnavailableError(absl::StrCat(
+      "SampleFromSnapshot of table ", name_, " repeatedly drew items that ",
+      "have since been deleted; the snapshot has been invalidated, please ",
+      "retry."));
+}
+
 absl::Status Table::Sample(SampledItem* sampled_item, absl::Duration timeout) {
   std::vector<SampledItem> items;
   REVERB_RETURN_IF_ERROR(SampleFlexibleBatch(&items, 1, timeout));
@@ -622,11 +1315,19 @@ absl::Status Table::Sample(SampledItem* sampled_item, absl::Duration timeout) {
 void Table::EnqueSampleRequest(int num_samples,
                                std::weak_ptr<SamplingCallback> callback,
                                absl::Duration timeout) {
-  auto request = std::make_unique<SampleRequest>();
+  std::shared_ptr<SampleRequest> request = sample_request_pool_->Acquire();
   request->on_batch_done = std::move(callback);
-  request->deadline = absl::Now() + timeout;
-  // Reserved size is used to communicate sampling batch size (it eliminates the
-  // need of alocating memory inside the table worker).
+  request->enqueued_at = absl::Now();
+  if (timeout == kAdaptiveTimeout) {
+    timeout = rate_limiter_->AdaptiveTimeout();
+  }
+  request->deadline = request->enqueued_at + timeout;
+  request->rate_limiter_wait_before = absl::Nanoseconds(
+      rate_limiter_wait_total_ns_.load(std::memory_order_relaxed));
+  // The batch is reserved up front so no memory is allocated inside the
+  // table worker. A recycled request often already carries enough capacity,
+  // in which case the reserve is a noop.
+  request->batch_size = num_samples;
   request->samples.reserve(num_samples);
   // Table worker doesn't release memory of removed items, clients do that
   // asynchrously.
@@ -644,7 +1345,7 @@ void Table::EnqueSampleRequest(int num_samples,
       to_delete = std::move(deleted_items_.back());
       deleted_items_.pop_back();
     }
-    wakeup_worker_.Signal();
+    WakeupWorker();
   }
 }
 
@@ -674,24 +1375,49 @@ absl::Status Table::SampleFlexibleBatch(std::vector<SampledItem>* items,
 }
 
 absl::Status Table::SampleInternal(bool rate_limited, SampledItem* result) {
-  auto sample = sampler_->Sample();
-  std::shared_ptr<Item>& item = data_[sample.key];
+  ItemSelector::KeyWithProbability sample;
+  {
+    internal::ScopedTrace trace("selector_draw");
+    sample = sampler_->Sample();
+  }
+  const uint32_t arena_slot = data_[sample.key];
+  PrepareForMutation(items_.mutable_shared(arena_slot));
+  const std::shared_ptr<Item>& item = items_.shared(arena_slot);
+  const int64_t slot = item->metadata_slot;
+  // Increment the sample count. The bookkeeping runs off the hot metadata
+  // store; the proto is updated to stay in sync.
+  const int32_t times_sampled = hot_metadata_.IncrementTimesSampled(slot);
   // If this is the first time the item was sampled then update unique
   // sampled counter.
-  if (item->item.times_sampled() == 0) {
+  if (times_sampled == 1) {
     ++num_unique_samples_;
+    PublishTableStats();
+  }
+  item->item.set_times_sampled(times_sampled);
+  remover_->MarkSampled(sample.key);
+
+  // Byte sizes of the item's chunks for consumer-side memory budgeting. Both
+  // are cached metadata reads; no payload is touched.
+  int64_t chunk_compressed_bytes = 0;
+  int64_t chunk_uncompressed_bytes = 0;
+  for (const auto& chunk : item->chunks) {
+    chunk_compressed_bytes += chunk->DataByteSizeLong();
+    chunk_uncompressed_bytes += chunk->uncompressed_byte_size();
   }
-  // Increment the sample count.
-  item->item.set_times_sampled(item->item.times_sampled() + 1);
 
   // Copy Details of the sampled item.
   *result = {
       .ref = item,
       .probability = sample.probability,
       .table_size = static_cast<int64_t>(data_.size()),
-      .priority = item->item.priority(),
-      .times_sampled = item->item.times_sampled(),
+      .priority = hot_metadata_.priority(slot),
+      .times_sampled = times_sampled,
       .rate_limited = rate_limited,
+      .min_sampling_weight = sampler_->MinWeight(),
+      .max_sampling_weight = sampler_->MaxWeight(),
+      .deterministic_sample_index = sample.deterministic_sample_index,
+      .chunk_compressed_bytes = chunk_compressed_bytes,
+      .chunk_uncompressed_bytes = chunk_uncompressed_bytes,
   };
 
   // Notify extensions which item was sampled.
@@ -700,15 +1426,29 @@ absl::Status Table::SampleInternal(bool rate_limited, SampledItem* result) {
   // If there is an upper bound of the number of times an item can be
   // sampled and it is now reached then delete the item before the lock is
   // released.
-  if (item->item.times_sampled() == max_times_sampled_) {
-    REVERB_RETURN_IF_ERROR(DeleteItem(item->item.key()));
+  if (times_sampled == max_times_sampled_) {
+    REVERB_RETURN_IF_ERROR(DeleteItem(sample.key));
   }
   return absl::OkStatus();
 }
 
+void Table::PublishTableStats() {
+  table_stats_.current_size.store(data_.size(), std::memory_order_relaxed);
+  table_stats_.current_size_bytes.store(num_bytes_, std::memory_order_relaxed);
+  table_stats_.num_episodes.store(episode_refs_.size(),
+                                  std::memory_order_relaxed);
+  table_stats_.num_deleted_episodes.store(num_deleted_episodes_,
+                                          std::memory_order_relaxed);
+  table_stats_.num_unique_samples.store(num_unique_samples_,
+                                        std::memory_order_relaxed);
+}
+
 int64_t Table::size() const {
-  absl::MutexLock lock(&mu_);
-  return data_.size();
+  return table_stats_.current_size.load(std::memory_order_relaxed);
+}
+
+int64_t Table::size_bytes() const {
+  return table_stats_.current_size_bytes.load(std::memory_order_relaxed);
 }
 
 const std::string& Table::name() const { return name_; }
@@ -724,15 +1464,28 @@ TableInfo Table::info() const {
     *info.mutable_signature() = *signature_;
   }
 
+  // The rate limiter counters and the table statistics are published
+  // atomically at every transition so none of this requires `mu_`.
+  *info.mutable_rate_limiter_info() = rate_limiter_->Info();
+  *info.mutable_sampler_options() = sampler_options_;
+  *info.mutable_remover_options() = remover_options_;
+  info.set_current_size(
+      table_stats_.current_size.load(std::memory_order_relaxed));
+  info.set_current_size_bytes(
+      table_stats_.current_size_bytes.load(std::memory_order_relaxed));
+  info.set_max_size_bytes(max_size_bytes_);
+  info.set_num_episodes(
+      table_stats_.num_episodes.load(std::memory_order_relaxed));
+  info.set_num_deleted_episodes(
+      table_stats_.num_deleted_episodes.load(std::memory_order_relaxed));
+  info.set_num_unique_samples(
+      table_stats_.num_unique_samples.load(std::memory_order_relaxed));
   {
+    // The extreme weights change with every priority mutation so they are
+    // read from the live selector; both reads are O(1).
     absl::MutexLock lock(&mu_);
-    *info.mutable_rate_limiter_info() = rate_limiter_->Info(&mu_);
-    *info.mutable_sampler_options() = sampler_->options();
-    *info.mutable_remover_options() = remover_->options();
-    info.set_current_size(data_.size());
-    info.set_num_episodes(episode_refs_.size());
-    info.set_num_deleted_episodes(num_deleted_episodes_);
-    info.set_num_unique_samples(num_unique_samples_);
+    info.set_min_sampling_weight(sampler_->MinWeight());
+    info.set_max_sampling_weight(sampler_->MaxWeight());
   }
   {
     absl::MutexLock lock(&worker_mu_);
@@ -753,6 +1506,11 @@ TableInfo Table::info() const {
     worker_time->set_waiting_for_inserts_ms(
         absl::ToInt64Milliseconds(worker_time_distribution_.GetTotalTimeIn(
             TableWorkerState::kWaitingForInserts)));
+    worker_time->set_pending_inserts(pending_inserts_.size());
+    worker_time->set_pending_sample_requests(pending_sampling_.size());
+    for (int64_t depth : queue_depth_history_) {
+      worker_time->add_queue_depth_history(depth);
+    }
   }
 
   return info;
@@ -766,17 +1524,18 @@ void Table::Close() {
   {
     absl::MutexLock lock(&worker_mu_);
     stop_worker_ = true;
-    wakeup_worker_.Signal();
+    WakeupWorker();
   }
 }
 
-absl::Status Table::DeleteItem(Table::Key key,
-                               std::shared_ptr<Item>* deleted_item) {
+absl::Status Table::DeleteItem(
+    Table::Key key, std::shared_ptr<Item>* deleted_item,
+    std::vector<ExtensionItem>* deferred_deletes) {
   auto it = data_.find(key);
   if (it == data_.end()) return absl::OkStatus();
 
   // Decrement counts to the episodes the item is referencing.
-  for (const auto& chunk : it->second->chunks) {
+  for (const auto& chunk : items_.get(it->second)->chunks) {
     auto ep_it = episode_refs_.find(chunk->episode_id());
     if (ep_it == episode_refs_.end()) {
       return absl::FailedPreconditionError(
@@ -787,13 +1546,42 @@ absl::Status Table::DeleteItem(Table::Key key,
       episode_refs_.erase(ep_it);
       num_deleted_episodes_++;
     }
+    auto chunk_it = chunk_refs_.find(chunk->key());
+    if (chunk_it == chunk_refs_.end()) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Unable to find chunk ", chunk->key(),
+                       " in chunk refs table."));
+    }
+    if (--(chunk_it->second.num_items) == 0) {
+      chunk_refs_.erase(chunk_it);
+      num_bytes_ -= chunk->DataByteSizeLong();
+    } else if (evict_by_marginal_bytes_) {
+      std::vector<Key>& item_keys = chunk_it->second.item_keys;
+      item_keys.erase(std::remove(item_keys.begin(), item_keys.end(), key),
+                      item_keys.end());
+      if (chunk_it->second.num_items == 1) {
+        // The remaining owner now holds the chunk exclusively and would free
+        // it on eviction.
+        const Key sole = item_keys.front();
+        REVERB_RETURN_IF_ERROR(remover_->Update(
+            sole, marginal_bytes_[sole] += chunk->DataByteSizeLong()));
+      }
+    }
+  }
+  if (evict_by_marginal_bytes_) {
+    marginal_bytes_.erase(key);
   }
-  auto item = std::move(it->second);
+  auto item = items_.Release(it->second);
   data_.erase(it);
   rate_limiter_->Delete(&mu_);
+  num_mutations_.fetch_add(1, std::memory_order_relaxed);
+  PublishTableStats();
   REVERB_RETURN_IF_ERROR(sampler_->Delete(key));
   REVERB_RETURN_IF_ERROR(remover_->Delete(key));
-  ExtensionOperation(ExtensionRequest::CallType::kDelete, item);
+  ExtensionOperation(ExtensionRequest::CallType::kDelete, item,
+                     deferred_deletes);
+  hot_metadata_.Remove(item->metadata_slot);
+  item->metadata_slot = internal::ItemMetadataStore::kInvalidSlot;
   if (deleted_item) {
     *deleted_item = std::move(item);
   }
@@ -801,8 +1589,16 @@ absl::Status Table::DeleteItem(Table::Key key,
 }
 
 void Table::ExtensionOperation(ExtensionRequest::CallType type,
-                               const std::shared_ptr<Item>& item) {
-  ExtensionItem e_item(item);
+                               const std::shared_ptr<Item>& item,
+                               std::vector<ExtensionItem>* deferred_deletes) {
+  // Items without a slot (e.g. memory releases of items that never entered
+  // the table) fall back to reading the proto.
+  const int64_t slot = item->metadata_slot;
+  ExtensionItem e_item =
+      slot != internal::ItemMetadataStore::kInvalidSlot
+          ? ExtensionItem(item, hot_metadata_.priority(slot),
+                          hot_metadata_.times_sampled(slot))
+          : ExtensionItem(item);
 
   // First execute all synchronous extensions.
   for (auto& extension : sync_extensions_) {
@@ -834,15 +1630,52 @@ void Table::ExtensionOperation(ExtensionRequest::CallType type,
     // otherwise no need to enqueue the operation.
     return;
   }
+  if (type == ExtensionRequest::CallType::kDelete &&
+      deferred_deletes != nullptr) {
+    // The caller aggregates this delete into a range-delete request (see
+    // `EnqueueRangeDelete`); only the synchronous extensions ran here.
+    deferred_deletes->push_back(std::move(e_item));
+    return;
+  }
+
+  EnqueueExtensionRequest({type, std::move(e_item)});
+}
+
+void Table::EnqueueRangeDelete(std::vector<ExtensionItem> items) {
+  if (items.empty()) {
+    return;
+  }
+  ExtensionRequest request = {ExtensionRequest::CallType::kDelete,
+                              std::move(items.front())};
+  request.more_items.assign(std::make_move_iterator(items.begin() + 1),
+                            std::make_move_iterator(items.end()));
+  EnqueueExtensionRequest(std::move(request));
+}
+
+void Table::EnqueueExtensionRequest(ExtensionRequest request) {
+  const bool counts_against_delete_budget =
+      request.call_type == ExtensionRequest::CallType::kDelete ||
+      request.call_type == ExtensionRequest::CallType::kMemoryRelease;
 
   // We push the request to the queue BEFORE we check if the size has been
   // exceeded. This is done to ensure that the order of the requests in the
   // queue is the same as the calls that created the requests.
-  ExtensionRequest request = {type, std::move(e_item)};
   extension_requests_.push_back(std::move(request));
 
-  while (extension_requests_.size() > max_enqueued_extension_ops_) {
-    extension_buffer_available_cv_.Wait(&mu_);
+  if (counts_against_delete_budget) {
+    // Deletes draw on a budget of their own so that extensions lagging
+    // behind an eviction storm cannot backpressure the insert path through
+    // the shared limit.
+    ++num_pending_delete_requests_;
+    while (num_pending_delete_requests_ > max_enqueued_delete_ops_) {
+      extension_buffer_available_cv_.Wait(&mu_);
+    }
+  } else {
+    while (static_cast<int64_t>(extension_requests_.size()) -
+               num_pending_delete_requests_ >
+           max_enqueued_extension_ops_) {
+      extension_buffer_available_cv_.Wait(&mu_);
+    }
   }
 
   if (extension_requests_.size() == 1) {
@@ -850,16 +1683,66 @@ void Table::ExtensionOperation(ExtensionRequest::CallType type,
   }
 }
 
+void Table::PrepareForMutation(std::shared_ptr<Item>* stored) {
+  if (frozen_item_keys_.empty()) {
+    return;
+  }
+  auto it = frozen_item_keys_.find((*stored)->item.key());
+  if (it == frozen_item_keys_.end()) {
+    return;
+  }
+  std::shared_ptr<Item> fresh = item_pool_->Acquire();
+  *fresh = **stored;
+  *stored = std::move(fresh);
+  frozen_item_keys_.erase(it);
+}
+
 absl::Status Table::UpdateItem(Key key, double priority) {
   auto it = data_.find(key);
   if (it == data_.end()) {
     return absl::OkStatus();
   }
-  it->second->item.set_priority(priority);
+  PrepareForMutation(items_.mutable_shared(it->second));
+  Item* item = items_.get(it->second);
+  item->item.set_priority(priority);
+  hot_metadata_.set_priority(item->metadata_slot, priority);
   REVERB_RETURN_IF_ERROR(sampler_->Update(key, priority));
-  REVERB_RETURN_IF_ERROR(remover_->Update(key, priority));
-  ExtensionOperation(ExtensionRequest::CallType::kUpdate, it->second);
+  // In marginal bytes mode the remover weight tracks chunk sharing, not the
+  // priority, so it is left untouched by priority mutations.
+  if (!evict_by_marginal_bytes_) {
+    REVERB_RETURN_IF_ERROR(remover_->Update(key, priority));
+  }
+  ExtensionOperation(ExtensionRequest::CallType::kUpdate,
+                     items_.shared(it->second));
+  num_mutations_.fetch_add(1, std::memory_order_relaxed);
+
+  return absl::OkStatus();
+}
 
+absl::Status Table::BulkUpdateItems(absl::Span<const KeyWithPriority> updates) {
+  std::vector<std::pair<Key, double>> applied;
+  applied.reserve(updates.size());
+  for (const auto& update : updates) {
+    auto it = data_.find(update.key());
+    if (it == data_.end()) {
+      continue;
+    }
+    PrepareForMutation(items_.mutable_shared(it->second));
+    Item* item = items_.get(it->second);
+    item->item.set_priority(update.priority());
+    hot_metadata_.set_priority(item->metadata_slot, update.priority());
+    applied.push_back({update.key(), update.priority()});
+    ExtensionOperation(ExtensionRequest::CallType::kUpdate,
+                       items_.shared(it->second));
+  }
+  if (applied.empty()) {
+    return absl::OkStatus();
+  }
+  REVERB_RETURN_IF_ERROR(sampler_->BulkUpdate(applied));
+  if (!evict_by_marginal_bytes_) {
+    REVERB_RETURN_IF_ERROR(remover_->BulkUpdate(applied));
+  }
+  num_mutations_.fetch_add(applied.size(), std::memory_order_relaxed);
   return absl::OkStatus();
 }
 
@@ -888,10 +1771,17 @@ absl::Status Table::Reset() {
     num_deleted_episodes_ = 0;
     num_unique_samples_ = 0;
     episode_refs_.clear();
+    chunk_refs_.clear();
+    marginal_bytes_.clear();
+    num_bytes_ = 0;
+    expiration_queue_.clear();
+    hot_metadata_.Clear();
 
     data_.clear();
+    items_.Clear();
 
     rate_limiter_->Reset(&mu_);
+    PublishTableStats();
   }
   {
     absl::MutexLock worker_lock(&worker_mu_);
@@ -899,11 +1789,16 @@ absl::Status Table::Reset() {
     deleted_items_.clear();
     // Wakeup worker in case it has pending inserts which couldn't make progress
     // before.
-    wakeup_worker_.Signal();
+    WakeupWorker();
   }
   return absl::OkStatus();
 }
 
+absl::Status Table::SetPriorityExponent(double priority_exponent) {
+  absl::MutexLock lock(&mu_);
+  return sampler_->SetPriorityExponent(priority_exponent);
+}
+
 Table::CheckpointAndChunks Table::Checkpoint() {
   PriorityTableCheckpoint checkpoint;
   checkpoint.set_table_name(name());
@@ -914,22 +1809,44 @@ Table::CheckpointAndChunks Table::Checkpoint() {
     *checkpoint.mutable_signature() = signature_.value();
   }
 
-  absl::MutexLock lock(&mu_);
+  // Freeze a copy-on-write snapshot of the table. Only cheap state is
+  // captured while the lock is held: shared pointers to the stored items and
+  // the rate limiter and selector state. Mutations that arrive after the
+  // freeze proceed on fresh item nodes (see `PrepareForMutation`) so the
+  // frozen nodes can be serialized below without holding the lock.
+  std::vector<std::shared_ptr<Item>> frozen;
+  absl::flat_hash_set<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  {
+    absl::MutexLock lock(&mu_);
 
-  checkpoint.set_num_deleted_episodes(num_deleted_episodes_);
-  checkpoint.set_num_unique_samples(num_unique_samples_);
+    checkpoint.set_num_deleted_episodes(num_deleted_episodes_);
+    checkpoint.set_num_unique_samples(num_unique_samples_);
 
-  *checkpoint.mutable_sampler() = sampler_->options();
-  *checkpoint.mutable_remover() = remover_->options();
+    *checkpoint.mutable_sampler() = sampler_->options();
+    *checkpoint.mutable_remover() = remover_->options();
 
-  // Note that is is important that the rate limiter checkpoint is
-  // finalized before the items are added
-  *checkpoint.mutable_rate_limiter() = rate_limiter_->CheckpointReader(&mu_);
+    // Note that is is important that the rate limiter checkpoint is
+    // finalized before the items are added
+    *checkpoint.mutable_rate_limiter() = rate_limiter_->CheckpointReader(&mu_);
 
-  absl::flat_hash_set<std::shared_ptr<ChunkStore::Chunk>> chunks;
-  for (const auto& entry : data_) {
-    *checkpoint.add_items() = entry.second->item;
-    chunks.insert(entry.second->chunks.begin(), entry.second->chunks.end());
+    frozen.reserve(data_.size());
+    for (const auto& entry : data_) {
+      frozen.push_back(items_.shared(entry.second));
+      frozen_item_keys_.insert(entry.first);
+    }
+
+    // `chunk_refs_` already indexes the distinct chunks referenced by the
+    // frozen items, so the chunk set is read straight from it in O(chunks)
+    // instead of walking the chunk vector of every item below.
+    chunks.reserve(chunk_refs_.size());
+    for (const auto& entry : chunk_refs_) {
+      chunks.insert(entry.second.chunk);
+    }
+    ++num_checkpoints_in_flight_;
+  }
+
+  for (const auto& item : frozen) {
+    *checkpoint.add_items() = item->item;
   }
 
   // Sort the items in ascending order based on their insertion time. This makes
@@ -938,6 +1855,13 @@ Table::CheckpointAndChunks Table::Checkpoint() {
   std::sort(checkpoint.mutable_items()->begin(),
             checkpoint.mutable_items()->end(), IsInsertedBefore);
 
+  {
+    absl::MutexLock lock(&mu_);
+    if (--num_checkpoints_in_flight_ == 0) {
+      frozen_item_keys_.clear();
+    }
+  }
+
   return {std::move(checkpoint), std::move(chunks)};
 }
 
@@ -959,33 +1883,189 @@ absl::Status Table::InsertCheckpointItem(Table::Item item) {
   REVERB_RETURN_IF_ERROR(
       remover_->Insert(item.item.key(), item.item.priority()));
 
+  FinishCheckpointItemInsert(std::move(item));
+  return absl::OkStatus();
+}
+
+absl::Status Table::BulkInsertCheckpointItems(std::vector<Item> items) {
+  absl::MutexLock lock(&mu_);
+  if (data_.size() + items.size() > max_size_) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "BulkInsertCheckpointItems would overflow the Table. table size: ",
+        data_.size(), ", batch size: ", items.size(),
+        ", maximum size: ", max_size_));
+  }
+
+  std::vector<std::pair<Key, double>> keys_with_priorities;
+  keys_with_priorities.reserve(items.size());
+  for (const auto& item : items) {
+    if (data_.contains(item.item.key())) {
+      return absl::FailedPreconditionError(absl::StrCat(
+          "BulkInsertCheckpointItems called for item with already present "
+          "key: ",
+          item.item.key()));
+    }
+    keys_with_priorities.push_back({item.item.key(), item.item.priority()});
+  }
+
+  // One bulk call per selector so implementations can build their internal
+  // structures bottom-up instead of inserting one key at a time.
+  REVERB_RETURN_IF_ERROR(sampler_->BulkInsert(keys_with_priorities));
+  REVERB_RETURN_IF_ERROR(remover_->BulkInsert(keys_with_priorities));
+
+  for (auto& item : items) {
+    FinishCheckpointItemInsert(std::move(item));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Table::Fork(std::string name,
+                         std::shared_ptr<Table>* forked) const {
+  // Carrying the rate limiter state (not just its configuration) over to the
+  // fork means that a fork of a sampleable table is immediately sampleable
+  // instead of having to wait for `min_size_to_sample` fresh inserts.
+  RateLimiterCheckpoint limiter_state;
+  bool evict_by_marginal_bytes;
+  {
+    absl::MutexLock lock(&mu_);
+    limiter_state = rate_limiter_->CheckpointReader(&mu_);
+    evict_by_marginal_bytes = evict_by_marginal_bytes_;
+  }
+
+  auto table = std::make_shared<Table>(
+      /*name=*/std::move(name),
+      /*sampler=*/MakeSelectorFromOptions(sampler_options_),
+      /*remover=*/MakeSelectorFromOptions(remover_options_),
+      /*max_size=*/max_size_,
+      /*max_times_sampled=*/max_times_sampled_,
+      /*rate_limiter=*/std::make_shared<RateLimiter>(limiter_state),
+      /*extensions=*/{},
+      /*signature=*/signature_,
+      /*max_size_bytes=*/max_size_bytes_);
+  if (evict_by_marginal_bytes) {
+    table->EnableMarginalBytesEviction();
+  }
+
+  // `Copy` returns the items in hash order but order sensitive selectors
+  // (Fifo, Lifo) reconstruct their state from the order the keys are handed
+  // to `BulkInsert`, so sort by insertion time first just like checkpoint
+  // restoration does.
+  std::vector<Item> items = Copy();
+  std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+    return IsInsertedBefore(a.item, b.item);
+  });
+  REVERB_RETURN_IF_ERROR(table->BulkInsertCheckpointItems(std::move(items)));
+
+  *forked = std::move(table);
+  return absl::OkStatus();
+}
+
+absl::Status Table::MoveItemsTo(Table* target, Key min_key, Key max_key,
+                                int64_t* num_moved) {
+  // Snapshot the metadata of the requested key range. The copies reference
+  // the same `ChunkStore::Chunk` objects as this table so no chunk data is
+  // touched by the move.
+  std::vector<Item> items;
+  {
+    absl::MutexLock lock(&mu_);
+    for (auto it = data_.cbegin(); it != data_.cend(); it++) {
+      if (it->first >= min_key && it->first <= max_key) {
+        items.push_back(*items_.get(it->second));
+      }
+    }
+  }
+
+  // `data_` iterates in hash order but order sensitive selectors (Fifo, Lifo)
+  // reconstruct their state from the order the keys are handed to
+  // `BulkInsert`, so sort by insertion time first just like `Fork` does.
+  std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+    return IsInsertedBefore(a.item, b.item);
+  });
+
+  std::vector<Key> keys;
+  keys.reserve(items.size());
+  for (const auto& item : items) {
+    keys.push_back(item.item.key());
+  }
+
+  REVERB_RETURN_IF_ERROR(target->BulkInsertCheckpointItems(std::move(items)));
+
+  // Deleting the moved keys completes the handover; until this returns the
+  // items can be served by both tables.
+  REVERB_RETURN_IF_ERROR(MutateItems({}, keys));
+  *num_moved = keys.size();
+  return absl::OkStatus();
+}
+
+void Table::FinishCheckpointItemInsert(Table::Item item) {
   const auto key = item.item.key();
-  auto it = data_.emplace(key, std::make_shared<Item>(std::move(item))).first;
+  std::shared_ptr<Item> pooled_item = item_pool_->Acquire();
+  *pooled_item = std::move(item);
+  const uint32_t arena_slot = items_.Add(std::move(pooled_item));
+  data_.emplace(key, arena_slot);
+  Item* stored = items_.get(arena_slot);
+
+  // Checkpointed items are inserted in `inserted_at` order so appending keeps
+  // the expiration queue sorted.
+  if (max_item_age_ != absl::InfiniteDuration()) {
+    expiration_queue_.emplace_back(
+        DecodeTimestampProto(stored->item.inserted_at()), key);
+  }
 
-  for (const auto& chunk : it->second->chunks) {
+  int64_t item_num_bytes = 0;
+  int64_t marginal_bytes = 0;
+  for (const auto& chunk : stored->chunks) {
+    const int64_t chunk_bytes = chunk->DataByteSizeLong();
+    item_num_bytes += chunk_bytes;
     ++episode_refs_[chunk->episode_id()];
+    ChunkRef& ref = chunk_refs_[chunk->key()];
+    if (++ref.num_items == 1) {
+      ref.chunk = chunk;
+      num_bytes_ += chunk_bytes;
+      marginal_bytes += chunk_bytes;
+    } else if (evict_by_marginal_bytes_ && ref.num_items == 2) {
+      const Key other = ref.item_keys.front();
+      REVERB_CHECK_OK(
+          remover_->Update(other, marginal_bytes_[other] -= chunk_bytes));
+    }
+    if (evict_by_marginal_bytes_) {
+      ref.item_keys.push_back(key);
+    }
+  }
+  if (evict_by_marginal_bytes_) {
+    marginal_bytes_[key] = marginal_bytes;
+    REVERB_CHECK_OK(remover_->Update(key, marginal_bytes));
   }
-  ExtensionOperation(ExtensionRequest::CallType::kInsert, it->second);
 
-  return absl::OkStatus();
+  stored->metadata_slot =
+      hot_metadata_.Add(key, stored->item.priority(),
+                        stored->item.times_sampled(), item_num_bytes);
+
+  ExtensionOperation(ExtensionRequest::CallType::kInsert,
+                     items_.shared(arena_slot));
+  PublishTableStats();
 }
 
 bool Table::Get(Table::Key key, Table::Item* item) {
   absl::MutexLock lock(&mu_);
   auto it = data_.find(key);
   if (it != data_.end()) {
-    *item = *it->second;
+    *item = *items_.get(it->second);
     return true;
   }
   return false;
 }
 
-const internal::flat_hash_map<Table::Key, std::shared_ptr<Table::Item>>*
-Table::RawLookup() {
+const internal::flat_hash_map<Table::Key, uint32_t>* Table::RawLookup() {
   mu_.AssertHeld();
   return &data_;
 }
 
+const Table::Item* Table::UnsafeItemBySlot(uint32_t slot) {
+  mu_.AssertHeld();
+  return items_.get(slot);
+}
+
 void Table::UnsafeAddExtension(std::shared_ptr<TableExtension> extension) {
   REVERB_CHECK_OK(extension->RegisterTable(&mu_, this));
   absl::MutexLock lock(&mu_);
@@ -1004,18 +2084,17 @@ const absl::optional<tensorflow::StructuredValue>& Table::signature() const {
 }
 
 bool Table::CanSample(int num_samples) const {
-  absl::MutexLock lock(&mu_);
-  return rate_limiter_->CanSample(&mu_, num_samples);
+  // The rate limiter counters are atomic so admission queries do not need to
+  // contend on the table mutex.
+  return rate_limiter_->CanSampleWithoutLock(num_samples);
 }
 
 bool Table::CanInsert(int num_inserts) const {
-  absl::MutexLock lock(&mu_);
-  return rate_limiter_->CanInsert(&mu_, num_inserts);
+  return rate_limiter_->CanInsertWithoutLock(num_inserts);
 }
 
 int64_t Table::num_episodes() const {
-  absl::MutexLock lock(&mu_);
-  return episode_refs_.size();
+  return table_stats_.num_episodes.load(std::memory_order_relaxed);
 }
 
 absl::Status Table::UnsafeUpdateItem(Key key, double priority) {
@@ -1044,20 +2123,21 @@ std::vector<std::shared_ptr<TableExtension>> Table::UnsafeClearExtensions() {
 }
 
 int64_t Table::num_deleted_episodes() const {
-  absl::MutexLock lock(&mu_);
-  return num_deleted_episodes_;
+  return table_stats_.num_deleted_episodes.load(std::memory_order_relaxed);
 }
 
 void Table::set_num_deleted_episodes_from_checkpoint(int64_t value) {
   absl::MutexLock lock(&mu_);
   REVERB_CHECK(data_.empty() && num_deleted_episodes_ == 0);
   num_deleted_episodes_ = value;
+  PublishTableStats();
 }
 
 void Table::set_num_unique_samples_from_checkpoint(int64_t value) {
   absl::MutexLock lock(&mu_);
   REVERB_CHECK(data_.empty() && num_unique_samples_ == 0);
   num_unique_samples_ = value;
+  PublishTableStats();
 }
 
 std::string Table::DebugString() const {
@@ -1104,6 +2184,11 @@ int Table::num_pending_async_sample_requests() const {
   return pending_sampling_.size();
 }
 
+int Table::num_pending_async_insert_requests() const {
+  absl::MutexLock lock(&worker_mu_);
+  return pending_inserts_.size();
+}
+
 bool Table::all_extensions_are_up_to_date() const {
   absl::MutexLock lock(&mu_);
   return extension_requests_.empty() && extension_worker_sleeps_;
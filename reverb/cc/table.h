@@ -15,7 +15,9 @@
 #ifndef REVERB_CC_TABLE_H_
 #define REVERB_CC_TABLE_H_
 
+#include <atomic>
 #include <cstddef>
+#include <deque>
 #include <initializer_list>
 #include <memory>
 #include <string>
@@ -24,6 +26,7 @@
 
 #include <cstdint>
 #include "absl/base/thread_annotations.h"
+#include "absl/random/random.h"
 #include "absl/status/status.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
@@ -35,7 +38,12 @@
 #include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/support/item_arena.h"
+#include "reverb/cc/support/item_metadata.h"
+#include "reverb/cc/support/object_pool.h"
+#include "reverb/cc/support/periodic_closure.h"
 #include "reverb/cc/support/state_statistics.h"
+#include "reverb/cc/support/weighted_snapshot.h"
 #include "reverb/cc/support/task_executor.h"
 #include "reverb/cc/table_extensions/interface.h"
 #include "tensorflow/core/protobuf/struct.pb.h"
@@ -48,6 +56,11 @@ namespace reverb {
 struct TableItem {
   PrioritizedItem item;
   std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+
+  // Slot of the item's hot metadata in the owning table's
+  // `ItemMetadataStore`. Managed by the table; `kInvalidSlot` while the item
+  // is not stored in a table.
+  int64_t metadata_slot = internal::ItemMetadataStore::kInvalidSlot;
 };
 
 // Table item wrapper used by extensions. It holds shared pointer to the
@@ -58,6 +71,13 @@ struct ExtensionItem {
     times_sampled = ref->item.times_sampled();
     priority = ref->item.priority();
   }
+
+  // Variant used when the mutable fields are already at hand (e.g. from the
+  // table's hot metadata store), avoiding a read of the item proto.
+  ExtensionItem(std::shared_ptr<TableItem> item, double priority,
+                int32_t times_sampled)
+      : ref(std::move(item)), times_sampled(times_sampled), priority(priority) {}
+
   std::shared_ptr<TableItem> ref;
   int32_t times_sampled;
   double priority;
@@ -100,17 +120,48 @@ class Table {
   static constexpr int64_t kMaxEnqueuedInserts = 1000;
   static constexpr float kMaxEnqueuedInsertsPerc = 0.1;
 
+  // Maximum number of idle `SampleRequest` shells retained by
+  // `sample_request_pool_`.
+  static constexpr int64_t kMaxPooledSampleRequests = 256;
+
+  // Maximum number of insert requests the table worker applies back to back
+  // (without giving sampling requests a chance to make progress). Bounds the
+  // latency that batched insert processing can add to concurrent sampling.
+  static constexpr int64_t kInsertWorkerBatchSize = 32;
+
+  // How often the table worker samples the depth of its pending queues and
+  // how many of those samples are kept (one minute of history).
+  static constexpr absl::Duration kQueueDepthSamplePeriod = absl::Seconds(1);
+  static constexpr int64_t kQueueDepthHistoryLength = 60;
+
   // Maximum number of allowed enqueued extension operations.
   // - absolute value limit.
   // - table's maximum size percentage limit.
   static constexpr int64_t kMaxPendingExtensionOps = 1000;
   static constexpr float kMaxPendingExtensionOpsPerc = 0.1;
 
+  // Maximum number of enqueued delete (and memory release) extension
+  // requests. Deletes draw on a budget separate from
+  // `kMaxPendingExtensionOps` so that a capacity eviction storm cannot
+  // exhaust the shared budget and backpressure the inserts that triggered
+  // it. A range delete produced by an eviction sweep counts as a single
+  // request regardless of how many items it carries.
+  static constexpr int64_t kMaxPendingDeleteOps = 1000;
+
   // Multiple `ChunkData` can be sent with the same `SampleStreamResponseCtx`.
   // If the size of the message exceeds this value then the request is sent and
-  // the remaining chunks are sent with other messages.
+  // the remaining chunks are sent with other messages. This is the default;
+  // the threshold can be overridden per table with
+  // `SetMaxSampleResponseSizeBytes`.
   static constexpr int64_t kMaxSampleResponseSizeBytes = 1 * 1024 * 1024;  // 1MB.
 
+  // How long the table worker may hold a partially admitted sample batch
+  // before flushing what it has (see `EnqueSampleRequest`). Long enough that
+  // batches fill well within it at production sampling rates, short enough
+  // that a freshly restarted job sees its first samples promptly.
+  static constexpr absl::Duration kMaxPartialSampleBatchAge =
+      absl::Milliseconds(10);
+
   struct SampleRequest;
   using Key = ItemSelector::Key;
   using Item = TableItem;
@@ -131,14 +182,46 @@ class Table {
     // stopped proccessing requests even though there were outstanding sample
     // requests to be fulfilled.
     bool rate_limited;
+    // Smallest and largest sampling weight in the table at the time of the
+    // sample, or 0 if the sampler does not maintain per-key weights. Used for
+    // normalizing importance sampling weights.
+    double min_sampling_weight = 0;
+    double max_sampling_weight = 0;
+    // One plus the index of the draw within the sampler's deterministic
+    // sampling sequence, or 0 when the sampler does not run in deterministic
+    // mode (or the sample was drawn from a snapshot).
+    uint64_t deterministic_sample_index = 0;
+    // Breakdown of the queueing delay: total time the sample request spent in
+    // the table worker's pending queue and the portion of it during which the
+    // worker was put to sleep by the rate limiter.
+    absl::Duration queued_for = absl::ZeroDuration();
+    absl::Duration rate_limiter_wait = absl::ZeroDuration();
+    // Total byte sizes of the item's chunks: serialized (compressed) size and
+    // unpacked size (0 when unknown). See `SampleInfo` in schema.proto.
+    int64_t chunk_compressed_bytes = 0;
+    int64_t chunk_uncompressed_bytes = 0;
   };
 
   // Represents asynchronous sampling request processed by the table worker.
   struct SampleRequest {
     std::vector<SampledItem> samples;
+    // Number of samples requested. `samples` is reserved to at least this
+    // size up front so the table worker never has to grow it; a recycled
+    // request may carry more capacity than the batch needs, so the size of
+    // the batch is tracked explicitly instead of through the capacity.
+    int batch_size = 0;
     absl::Time deadline;
     absl::Status status;
     std::weak_ptr<SamplingCallback> on_batch_done;
+    // Time when the request was pushed to `pending_sampling_` and the value
+    // of `rate_limiter_wait_total_ns_` at that point. The deltas at
+    // completion give the queueing delay breakdown of the request.
+    absl::Time enqueued_at;
+    absl::Duration rate_limiter_wait_before;
+    // Time the first sample of the (current) batch was gathered. Used by the
+    // table worker to flush a partially admitted batch once it is older than
+    // `kMaxPartialSampleBatchAge`.
+    absl::Time partial_since = absl::InfiniteFuture();
   };
 
   // Represents asynchronous insert request processed by the table worker.
@@ -168,11 +251,17 @@ class Table {
   // `signature` allows an optional declaration of the data that can be stored
   //   in this table.  writers and readers are responsible for checking against
   //   this signature, as it is available via RPC request.
+  // `max_size_bytes` limits the total number of bytes referenced by the
+  //   chunks of the items in the table (shared chunks counted once). When an
+  //   insert pushes the table above the limit, items are removed with the
+  //   strategy specified by the `remover_` until the limit is respected
+  //   again. Zero (the default) disables byte based eviction.
   Table(std::string name, std::shared_ptr<ItemSelector> sampler,
         std::shared_ptr<ItemSelector> remover, int64_t max_size,
         int32_t max_times_sampled, std::shared_ptr<RateLimiter> rate_limiter,
         std::vector<std::shared_ptr<TableExtension>> extensions = {},
-        absl::optional<tensorflow::StructuredValue> signature = absl::nullopt);
+        absl::optional<tensorflow::StructuredValue> signature = absl::nullopt,
+        int64_t max_size_bytes = 0);
 
   ~Table();
 
@@ -205,9 +294,31 @@ class Table {
   // if further inserts can be performed right away. When can_insert_more is set
   // to false, further inserts can be executed only after insert_completed
   // callback is called.
+  //
+  // `admission_class` shifts the queue depth at which `can_insert_more`
+  // turns false: each class below 0 halves it and each class above 0
+  // doubles it, so low class writers back off first under queue pressure
+  // while high class writers keep flowing (see
+  // `InsertStreamRequest.admission_class`). The queue itself is never
+  // rejected from; the class only moves the advisory backpressure point.
   absl::Status InsertOrAssignAsync(
       Item item, bool* can_insert_more,
-      std::weak_ptr<InsertCallback> insert_completed);
+      std::weak_ptr<InsertCallback> insert_completed,
+      int admission_class = 0);
+
+  // Batched version of InsertOrAssignAsync. All items are validated up front
+  // and the whole batch is enqueued under a single lock acquisition; the
+  // table worker then applies runs of queued inserts as one block. Bursts of
+  // items, e.g. produced at episode boundaries, thus avoid the per-item
+  // queueing overhead. `insert_completed` is called once per item as the
+  // inserts complete. `can_insert_more` has the same semantics as for
+  // InsertOrAssignAsync and refers to the state after the entire batch has
+  // been enqueued; `admission_class` has the same semantics as for
+  // InsertOrAssignAsync.
+  absl::Status InsertOrAssignBatch(
+      std::vector<Item> items, bool* can_insert_more,
+      std::weak_ptr<InsertCallback> insert_completed,
+      int admission_class = 0);
 
   // Inserts an item without consulting or modifying the RateLimiter about the
   // operation.
@@ -215,11 +326,50 @@ class Table {
   // This should ONLY be used when restoring a `Table` from a checkpoint.
   absl::Status InsertCheckpointItem(Item item);
 
+  // Inserts a batch of items without consulting or modifying the RateLimiter.
+  // Equivalent to calling `InsertCheckpointItem` for every element of `items`
+  // in order, but the keys and priorities are handed to the selectors in one
+  // `BulkInsert` call each so they can build their internal structures
+  // bottom-up in O(n) instead of inserting one key at a time.
+  //
+  // This should ONLY be used when restoring a `Table` from a checkpoint.
+  absl::Status BulkInsertCheckpointItems(std::vector<Item> items);
+
+  // Creates a new table named `name` holding a copy of this table's current
+  // items and the same configuration (selector types, rate limiter options,
+  // size limits and signature). The clone is populated through the bulk
+  // checkpoint-insert path and its items reference the same
+  // `ChunkStore::Chunk` objects as this table, so forking never copies chunk
+  // data; only item metadata and selector state are duplicated. The item set
+  // is a consistent snapshot but the fork is completely detached afterwards:
+  // mutations of either table are not observed by the other. Extensions are
+  // not cloned.
+  //
+  // The caller is responsible for hosting the returned table, e.g. by
+  // registering it with the server (see `ReverbServiceImpl::ForkTable`).
+  absl::Status Fork(std::string name, std::shared_ptr<Table>* forked) const;
+
+  // Moves every item whose key lies in the inclusive range [`min_key`,
+  // `max_key`] into `target`. The items are re-registered through the bulk
+  // checkpoint-insert path and keep referencing the same `ChunkStore::Chunk`
+  // objects, so only item metadata and selector entries cross tables; chunk
+  // payloads are never copied. The moved keys are deleted from this table
+  // only after the bulk insert succeeded, so a failed insert (key collision
+  // or overflow in `target`) leaves both tables unchanged. Between the insert
+  // and the delete the items are briefly sampleable from both tables and a
+  // priority update that races the move can be lost; this is intended for
+  // administrative rebalancing (see `ReverbServiceImpl::MoveItems`) where
+  // that window is acceptable.
+  absl::Status MoveItemsTo(Table* target, Key min_key, Key max_key,
+                           int64_t* num_moved);
+
   // Updates the priority or deletes items in this table distribution. All
   // operations in the arguments are applied in the order that they are listed.
   // Different operations can be set at the same time. Ignores non existing keys
   // but returns any other errors. The operations might be applied partially
-  // when an error occurs.
+  // when an error occurs. Large batches are applied in bounded slices with the
+  // table mutex released between slices, so concurrent sampling and inserting
+  // may interleave with (and observe intermediate states of) a single call.
   absl::Status MutateItems(absl::Span<const KeyWithPriority> updates,
                            absl::Span<const Key> deletes);
 
@@ -237,6 +387,11 @@ class Table {
   // strategy defined by the `rate_limiter_`. Sampled element which has reached
   // `max_times_sampled_` are deleted from the table, so it cannot be
   // sampled again.
+  // The callback may be invoked with fewer than `num_samples` samples: when
+  // the rate limiter admits the batch piecemeal (e.g. a nearly empty table at
+  // experiment start), samples that have been held back for more than
+  // `kMaxPartialSampleBatchAge` are flushed instead of waiting for the full
+  // batch, so the first samples flow as soon as they are admissible.
   void EnqueSampleRequest(int num_samples,
                           std::weak_ptr<SamplingCallback> callback,
                           absl::Duration timeout = kDefaultTimeout);
@@ -264,6 +419,29 @@ class Table {
                                    int batch_size,
                                    absl::Duration timeout = kDefaultTimeout);
 
+  // Enables the epoch based sampling read path used by
+  // `SampleFromSnapshot`. A snapshot of the sampler's key weights is
+  // published and refreshed once `max_staleness` mutations (inserts, updates
+  // and deletes) have been applied since the last refresh. Larger values
+  // trade sampling distribution freshness for less time spent holding the
+  // table mutex. Thread safe.
+  void EnableSamplingSnapshots(int64_t max_staleness)
+      ABSL_LOCKS_EXCLUDED(snapshot_mu_);
+
+  // Samples an item from the most recently published snapshot instead of the
+  // live sampler. The table mutex is only held for the constant time
+  // accounting (rate limiter commit, `times_sampled` bump and extension
+  // notification), so concurrent inserts are not blocked behind selector
+  // traversals. The sampled distribution is at most `max_staleness` mutations
+  // out of date.
+  //
+  // Returns `FailedPreconditionError` if snapshots have not been enabled, if
+  // the sampler does not support weight exports (e.g. fifo) or if the rate
+  // limiter does not currently allow sampling; this call never blocks on the
+  // rate limiter so callers should await admission through `CanSample`.
+  absl::Status SampleFromSnapshot(SampledItem* item)
+      ABSL_LOCKS_EXCLUDED(snapshot_mu_, mu_);
+
   // Returns true iff the current state would allow for `num_samples` to be
   // sampled. Dies if `num_samples` is < 1.
   //
@@ -298,25 +476,53 @@ class Table {
   // Lookup a single item. Returns true if found, else false.
   bool Get(Key key, Item* item) ABSL_LOCKS_EXCLUDED(mu_);
 
-  // Get pointer to `data_`. Must only be called by extensions while lock held.
-  const internal::flat_hash_map<Key, std::shared_ptr<Item>>* RawLookup()
+  // Get pointer to `data_`, which maps item keys to slots in the item arena
+  // (resolve them through `UnsafeItemBySlot`). Must only be called by
+  // extensions while lock held.
+  const internal::flat_hash_map<Key, uint32_t>* RawLookup()
       ABSL_ASSERT_EXCLUSIVE_LOCK(mu_);
 
+  // Resolves an arena slot obtained through `RawLookup` to the stored item.
+  // Must only be called by extensions while lock held.
+  const Item* UnsafeItemBySlot(uint32_t slot) ABSL_ASSERT_EXCLUSIVE_LOCK(mu_);
+
   // Removes all items and resets the RateLimiter to its initial state.
   absl::Status Reset();
 
+  // Changes the priority exponent of the sampling selector, recomputing the
+  // sampling weights of all stored items from their raw priorities in a
+  // single pass (see `ItemSelector::SetPriorityExponent`). Returns
+  // `FailedPrecondition` if the selector does not apply a priority exponent.
+  // The table lock is held for the duration of the recompute.
+  absl::Status SetPriorityExponent(double priority_exponent);
+
   // Generate a checkpoint from the table's current state.
+  //
+  // The lock is only held while freezing a copy-on-write snapshot of the
+  // table (shared pointers to the stored items plus the rate limiter and
+  // selector state); the item protos are copied into the checkpoint after the
+  // lock has been released. Mutations that arrive while the snapshot is being
+  // serialized proceed on fresh item nodes (see `PrepareForMutation`) so
+  // checkpointing large tables no longer stalls concurrent inserts and
+  // samples.
   CheckpointAndChunks Checkpoint() ABSL_LOCKS_EXCLUDED(mu_);
 
-  // Number of items in the table distribution.
-  int64_t size() const ABSL_LOCKS_EXCLUDED(mu_);
+  // Number of items in the table distribution. Wait-free; reads the published
+  // statistics snapshot (see `table_stats_`).
+  int64_t size() const;
+
+  // Number of bytes referenced by the chunks of the items in the table.
+  // Chunks shared by several items are counted once. Wait-free; reads the
+  // published statistics snapshot.
+  int64_t size_bytes() const;
 
-  // Number of episodes in the table.
-  int64_t num_episodes() const ABSL_LOCKS_EXCLUDED(mu_);
+  // Number of episodes in the table. Wait-free; reads the published
+  // statistics snapshot.
+  int64_t num_episodes() const;
 
   // Number of episodes that previously were in the table but has since been
-  // deleted.
-  int64_t num_deleted_episodes() const ABSL_LOCKS_EXCLUDED(mu_);
+  // deleted. Wait-free; reads the published statistics snapshot.
+  int64_t num_deleted_episodes() const;
 
   // "Manually" set the number of deleted episodes and unique samples. This is
   // only intended to be called when reconstructing a Table from a checkpoint
@@ -331,7 +537,10 @@ class Table {
 
   // Metadata about the table, including the current state of the rate limiter
   // and table worker execution time. Execution time is slightly out of sync, as
-  // it is updated periodically by the table worker thread.
+  // it is updated periodically by the table worker thread. The table statistics
+  // and rate limiter state are read from atomically published snapshots so
+  // this call never contends with the data path on `mu_`; the values may be
+  // marginally stale.
   TableInfo info() const;
 
   // Signature (if any) of the table.
@@ -351,6 +560,79 @@ class Table {
   // Make table worker use provided executor for executing callbacks.
   void SetCallbackExecutor(std::shared_ptr<TaskExecutor> executor);
 
+  // Overrides the threshold at which sample responses of this table are cut
+  // and flushed to the stream. Tables with tiny items can raise it to
+  // amortize the per-message overhead over more samples while tables with
+  // jumbo items can lower it to reduce head-of-line blocking. Defaults to
+  // `kMaxSampleResponseSizeBytes`.
+  void SetMaxSampleResponseSizeBytes(int64_t max_bytes);
+
+  // Threshold at which sample responses of this table are cut.
+  int64_t max_sample_response_size_bytes() const;
+
+  // Make table worker use a dedicated executor for insert completion
+  // callbacks. Without a dedicated executor insert completions share the
+  // callback executor with sampling responses and can be starved by sampling
+  // storms; isolating them guarantees insert throughput regardless of the
+  // sampling load.
+  void SetInsertCallbackExecutor(std::shared_ptr<TaskExecutor> executor);
+
+  // Enables time based eviction of items. Items whose age, measured from
+  // `inserted_at`, exceeds `max_item_age` are deleted by a background thread
+  // without a sample or insert having to touch them. The expiration check
+  // runs periodically so items may outlive `max_item_age` by up to one check
+  // period. Items already in the table (e.g. restored from a checkpoint) are
+  // subject to expiration as well. Must be called at most once.
+  void EnableItemExpiration(absl::Duration max_item_age)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Enables a bounded spin phase before the table worker parks on its wakeup
+  // condition variable. At the samples-per-insert equilibrium the worker's
+  // rate limiter waits are usually microseconds, so briefly spinning (with
+  // pause instructions) before paying the park/wake round trip saves the
+  // wakeup latency and context switch on most admissions. The spin budget
+  // adapts between `max_spin_duration` and a small floor depending on whether
+  // recent spins observed work arriving in time; a zero duration disables
+  // spinning (the default).
+  void EnableWorkerSpinWait(absl::Duration max_spin_duration)
+      ABSL_LOCKS_EXCLUDED(worker_mu_);
+
+  // Makes the remover weight items by their marginal reclaimable bytes (the
+  // combined size of the chunks referenced by no other item in the table)
+  // instead of their priority. Evicting an item whose chunks are all shared
+  // with remaining items frees nothing, so under memory pressure (see
+  // `max_size_bytes`) a remover that maximizes this weight, e.g.
+  // `HeapSelector(/*min_heap=*/false)`, evicts the items that actually
+  // release memory. The weights are maintained by the table as chunk sharing
+  // changes; priority updates do not touch the remover in this mode. Must be
+  // called before the table contains any items.
+  void EnableMarginalBytesEviction() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Keeps up to `max_cached_bytes` of decompressed chunk columns resident on
+  // the `ChunkStore::Chunk` objects referenced by this table's items; the
+  // least recently sampled chunks are demoted back to compressed-only form
+  // once the budget is exceeded. When `decompress_on_insert` is true the
+  // chunks of every inserted item are decompressed up front, otherwise on
+  // their first sample. Only in-process samplers serve from the cache; remote
+  // samplers always receive (and decompress) the compressed chunks. Intended
+  // for heavily oversampled tables where repeated decompression costs more
+  // CPU than the cached tensors cost memory. Must be called before the table
+  // starts serving inserts.
+  void EnableUncompressedChunkCache(size_t max_cached_bytes,
+                                    bool decompress_on_insert);
+
+  // Pins the table worker and extension worker threads to the CPUs of the
+  // given NUMA node and makes the node the preferred target of the pages the
+  // workers allocate. Intended for multi socket servers where tables are
+  // deliberately placed on specific sockets (see `StartServer`). The workers
+  // rebind on their next iteration so the call is cheap and can be made at
+  // any time. A negative `node` clears the placement of future iterations but
+  // does not undo an existing binding.
+  void SetNumaNode(int node);
+
+  // NUMA node the table workers are pinned to, or -1 when unpinned.
+  int numa_node() const;
+
   // Check whether the worker is currently sleeping (either no work to do or
   // blocked). This method is only exposed for testing purposes.
   bool worker_is_sleeping() const ABSL_LOCKS_EXCLUDED(worker_mu_);
@@ -359,6 +641,10 @@ class Table {
   // yet. This method is only exposed for testing purposes.
   int num_pending_async_sample_requests() const ABSL_LOCKS_EXCLUDED(worker_mu_);
 
+  // Get the number of insert requests which hasn't been picked up by the
+  // worker yet.
+  int num_pending_async_insert_requests() const ABSL_LOCKS_EXCLUDED(worker_mu_);
+
   // Checks whether all extensions requests, async and sync, have been
   // processed. This is the case if there are no pending requests AND the
   // extension worker is sleeping.
@@ -394,30 +680,87 @@ class Table {
     enum class CallType { kDelete, kInsert, kSample, kUpdate, kMemoryRelease };
     CallType call_type;
     ExtensionItem item;
+    // Additional items carried by a range delete (see `EnqueueRangeDelete`).
+    // Empty for all other requests.
+    std::vector<ExtensionItem> more_items;
   };
 
   // Starts table worker thread which processes table operations queue. Worker
   // will use provided executor for running operation callbacks.
   void EnableTableWorker(std::shared_ptr<TaskExecutor> executor);
 
+  // Queue depth at which inserts of `admission_class` start seeing
+  // backpressure: `max_enqueued_inserts_` shifted one power of two per
+  // class. Clamped so extreme classes saturate instead of overflowing.
+  int64_t AdmissionLimit(int admission_class) const;
+
   // Table worker execution loop. It is executed by a dedicated thread
   // and performs enqueued table operations (inserts, mutations, sampling...).
   absl::Status TableWorkerLoop();
 
+  // Wakes up the table worker: bumps `worker_wakeup_epoch_` for a spinning
+  // worker and signals `wakeup_worker_` when the worker is parked.
+  void WakeupWorker() ABSL_EXCLUSIVE_LOCKS_REQUIRED(worker_mu_);
+
+  // Spins (with pause instructions) until `worker_wakeup_epoch_` moves past
+  // `epoch` or `budget` elapses. Returns true iff a wakeup was observed.
+  bool SpinForWakeup(uint64_t epoch, absl::Duration budget) const
+      ABSL_LOCKS_EXCLUDED(worker_mu_);
+
+  // Rebinds the calling worker thread to `numa_node_` when it differs from
+  // `*bound_node`, the node the thread is currently bound to. Called at the
+  // top of every worker loop iteration; the common case is a single relaxed
+  // load.
+  void MaybeBindToNumaNode(int* bound_node);
+
+  // Shared tail of the checkpoint insertion paths: stores `item` in the item
+  // arena and performs all per-item bookkeeping except the selector inserts,
+  // which the callers have already applied.
+  void FinishCheckpointItemInsert(Item item)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Stores the statistics exported through `info()` and the size accessors
+  // into `table_stats_`. Must be called before releasing `mu_` by every
+  // critical section that changes any of the mirrored values.
+  void PublishTableStats() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   // Updates item priority in `data_`, `samper_`, `remover_` and calls
   // `OnUpdate` on all extensions.
   absl::Status UpdateItem(Key key, double priority)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Applies a batch of priority updates through the selectors' `BulkUpdate`
+  // so tree maintenance is amortized across the batch. Keys that cannot be
+  // found are ignored. Calls `OnUpdate` on all extensions for every updated
+  // item.
+  absl::Status BulkUpdateItems(absl::Span<const KeyWithPriority> updates)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Must be called before mutating the proto of the item node `*stored` (an
+  // entry of `data_`) in place. If the node is frozen by an in-flight
+  // `Checkpoint` snapshot it is replaced by a fresh copy acquired from
+  // `item_pool_`; the mutation then proceeds on the copy while the snapshot
+  // keeps streaming the untouched frozen node. No-op when no snapshot is in
+  // flight.
+  void PrepareForMutation(std::shared_ptr<Item>* stored)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   // Used by the table worker to perform sampling.
   absl::Status SampleInternal(bool rate_limited, SampledItem* result)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
-  // Finalize sampling request with a given status.
-  void FinalizeSampleRequest(std::unique_ptr<Table::SampleRequest> request,
+  // Finalize sampling request with a given status. The request shell returns
+  // to `sample_request_pool_` once the completion callback has run.
+  void FinalizeSampleRequest(std::shared_ptr<Table::SampleRequest> request,
                              absl::Status status)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Attaches `unpacked_chunk_cache_` to the chunks of `item` and, when
+  // configured, decompresses them up front. Called on the insert caller's
+  // thread (outside of all table locks) so the decompression cost never lands
+  // on the table worker.
+  void AttachChunkCache(const Item& item) const;
+
   // Performs insertion of the `item` into the table.
   absl::Status InsertOrAssignInternal(std::shared_ptr<Item> item)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
@@ -429,16 +772,47 @@ class Table {
   // underlying item to be postponed until the lock has been released.
   // If deleted_item is not provided, deletion is handled by the
   // extension worker asynchronously.
+  //
+  // If `deferred_deletes` is provided then the asynchronous part of the
+  // extension notification is appended to it instead of being enqueued;
+  // synchronous extensions still run inline. Callers deleting many items in
+  // one sweep use this to combine the notifications into a single range
+  // delete (see `EnqueueRangeDelete`).
   absl::Status DeleteItem(Key key,
-                          std::shared_ptr<Item>* deleted_item = nullptr)
+                          std::shared_ptr<Item>* deleted_item = nullptr,
+                          std::vector<ExtensionItem>* deferred_deletes =
+                              nullptr)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
   // Executes a given extension operation for all extensions registered with the
   // table. If extension worker is enabled, operation is executed asynchronously
   // for all extensions that support asynchronous execution. For synchronous
   // extensions operation is executed synchronously.
+  //
+  // If `deferred_deletes` is provided and `type` is a delete that would have
+  // been enqueued for the worker, the item is appended to `deferred_deletes`
+  // instead; the caller must hand the collected items to
+  // `EnqueueRangeDelete`.
   void ExtensionOperation(ExtensionRequest::CallType type,
-                          const std::shared_ptr<Item>& item)
+                          const std::shared_ptr<Item>& item,
+                          std::vector<ExtensionItem>* deferred_deletes =
+                              nullptr)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Enqueues a single range-delete request carrying all of `items` for the
+  // extension worker. Eviction and expiration sweeps use this so that
+  // deleting many items occupies one slot of the extension queue instead of
+  // one per item. Synchronous extensions must already have been notified
+  // (see the `deferred_deletes` argument of `DeleteItem`). No-op when
+  // `items` is empty.
+  void EnqueueRangeDelete(std::vector<ExtensionItem> items)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Pushes `request` onto `extension_requests_` and blocks until the pending
+  // requests of its budget class (deletes and memory releases vs. everything
+  // else) are back under the class limit. Wakes the extension worker when
+  // the queue was empty.
+  void EnqueueExtensionRequest(ExtensionRequest request)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
   // Extensions worker execution loop. It is executed by a dedicated thread
@@ -446,6 +820,17 @@ class Table {
   // the order enqueued, but they run without holding table's lock.
   absl::Status ExtensionsWorkerLoop();
 
+  // Rebuilds `sampling_snapshot_` from the live sampler. Acquires `mu_` for
+  // the duration of the weight export.
+  void RefreshSnapshot() ABSL_EXCLUSIVE_LOCKS_REQUIRED(snapshot_mu_)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Deletes all items whose age exceeds `max_item_age_`. Called periodically
+  // by `expiration_closure_` (see `EnableItemExpiration`). Returns whether
+  // any item was deleted, letting the closure back off while nothing
+  // expires.
+  bool DeleteExpiredItems() ABSL_LOCKS_EXCLUDED(mu_, worker_mu_);
+
   // Synchronizes access to the table's data. Needs to be acquired to sample or
   // insert data into the table. Synchronous extensions are also executed while
   // holding this mutex.
@@ -457,14 +842,69 @@ class Table {
   // Distribution used for removing.
   std::shared_ptr<ItemSelector> remover_ ABSL_GUARDED_BY(mu_);
 
-  // Bijection of key to item. Used for storing the chunks and timestep range of
-  // each item.
-  internal::flat_hash_map<Key, std::shared_ptr<Item>> data_
-      ABSL_GUARDED_BY(mu_);
+  // Bijection of key to the arena slot holding the item. Keeping 4-byte slot
+  // numbers (instead of 16-byte shared pointers) as the map values doubles
+  // the probe density of the index; lookups resolve to the item with a single
+  // probe plus one access into `items_`.
+  internal::flat_hash_map<Key, uint32_t> data_ ABSL_GUARDED_BY(mu_);
+
+  // Slot-indexed arena owning the item nodes referenced by `data_`. Ownership
+  // is shared because in-flight sample responses, extensions and checkpoint
+  // snapshots keep references to items after they leave the table.
+  internal::ItemArena<Item> items_ ABSL_GUARDED_BY(mu_);
+
+  // Contiguous struct-of-arrays mirror of the hot metadata (key, priority,
+  // sample count, byte size) of the items in `data_`, indexed by
+  // `TableItem::metadata_slot`. Operations that only need these fields (the
+  // sampling bookkeeping, extension snapshots, priority mutations) read them
+  // from here instead of chasing the item pointer into the proto. The proto
+  // remains the authoritative cold copy and is kept in sync at every
+  // mutation.
+  internal::ItemMetadataStore hot_metadata_ ABSL_GUARDED_BY(mu_);
 
   // Count of references from chunks referenced by items.
   internal::flat_hash_map<uint64_t, int64_t> episode_refs_ ABSL_GUARDED_BY(mu_);
 
+  // Bookkeeping of one chunk referenced by the items in the table.
+  struct ChunkRef {
+    // Number of items referencing the chunk.
+    int64_t num_items = 0;
+    // The chunk itself. Keeping the pointer here gives the table a
+    // ready-made index of the distinct chunks it references, so
+    // checkpointing collects the chunk set in O(chunks) straight from
+    // `chunk_refs_` instead of walking the chunk vector of every item.
+    std::shared_ptr<ChunkStore::Chunk> chunk;
+    // Keys of the items referencing the chunk. Only maintained when
+    // `evict_by_marginal_bytes_` is set; needed to repair the marginal byte
+    // weight of the other owner when sharing of the chunk begins or ends.
+    std::vector<Key> item_keys;
+  };
+
+  // The chunks referenced by the items in the table, keyed by chunk key and
+  // updated at insert and delete. Used by `Checkpoint` to gather the chunk
+  // set and together with `num_bytes_` to account for the memory referenced
+  // by the table.
+  internal::flat_hash_map<uint64_t, ChunkRef> chunk_refs_ ABSL_GUARDED_BY(mu_);
+
+  // Total number of bytes of the chunks referenced by the items in the table.
+  // Each chunk is counted once regardless of how many items reference it.
+  int64_t num_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // True once `EnableMarginalBytesEviction` has been called; the remover is
+  // then weighted by `marginal_bytes_` instead of item priorities.
+  bool evict_by_marginal_bytes_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Bytes each item would free if evicted: the combined size of its chunks
+  // referenced by no other item. Empty unless `evict_by_marginal_bytes_`.
+  internal::flat_hash_map<Key, int64_t> marginal_bytes_ ABSL_GUARDED_BY(mu_);
+
+  // Cache of decompressed chunk columns attached to the chunks of inserted
+  // items, or nullptr unless `EnableUncompressedChunkCache` has been called.
+  // Set during setup, before insert traffic starts, so insert threads read
+  // both fields without a lock.
+  std::shared_ptr<internal::UnpackedChunkCache> unpacked_chunk_cache_;
+  bool decompress_chunks_on_insert_ = false;
+
   // The total number of episodes that were at some point referenced by items
   // in the table but have since been removed. Is set to 0 when `Reset()`
   // called.
@@ -474,6 +914,68 @@ class Table {
   // was created or reset most recently.
   int64_t num_unique_samples_ ABSL_GUARDED_BY(mu_);
 
+  // Wait-free mirror of the table statistics exported through `info()` and
+  // the size accessors. Republished by `PublishTableStats` (while holding
+  // `mu_`) whenever any of the guarded originals change, so readers load a
+  // recent snapshot without ever touching the mutex.
+  struct TableStats {
+    std::atomic<int64_t> current_size{0};
+    std::atomic<int64_t> current_size_bytes{0};
+    std::atomic<int64_t> num_episodes{0};
+    std::atomic<int64_t> num_deleted_episodes{0};
+    std::atomic<int64_t> num_unique_samples{0};
+  };
+  TableStats table_stats_;
+
+  // Copies of the selector configurations, captured at construction. The
+  // configuration of a selector never changes so `info()` can read these
+  // without synchronizing with the live selectors.
+  KeyDistributionOptions sampler_options_;
+  KeyDistributionOptions remover_options_;
+
+  // Total number of mutations (inserts, updates and deletes) applied to the
+  // table. Only used to measure the staleness of `sampling_snapshot_`.
+  // Incremented while holding `mu_` but read without it.
+  std::atomic<int64_t> num_mutations_{0};
+
+  // Keys whose stored nodes are frozen by an in-flight `Checkpoint` snapshot.
+  // In-place mutations of a frozen node first swap a private copy into
+  // `data_` (see `PrepareForMutation`) so that the snapshot observes the
+  // state captured at freeze time. Empty whenever no checkpoint is in flight.
+  internal::flat_hash_set<Key> frozen_item_keys_ ABSL_GUARDED_BY(mu_);
+
+  // Number of `Checkpoint` calls that are currently serializing a frozen
+  // snapshot outside the lock. `frozen_item_keys_` is cleared when the last
+  // one completes.
+  int num_checkpoints_in_flight_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Threshold at which sample responses of this table are cut. Written by
+  // `SetMaxSampleResponseSizeBytes` and read by the table worker and the
+  // sample streams without holding any lock.
+  std::atomic<int64_t> max_sample_response_size_bytes_{
+      kMaxSampleResponseSizeBytes};
+
+  // State of the epoch based sampling read path (see `SampleFromSnapshot`).
+  // `snapshot_max_staleness_` is zero for as long as snapshots are disabled.
+  mutable absl::Mutex snapshot_mu_ ABSL_ACQUIRED_BEFORE(mu_);
+  std::shared_ptr<const internal::WeightedSnapshot> sampling_snapshot_
+      ABSL_GUARDED_BY(snapshot_mu_);
+  int64_t snapshot_max_staleness_ ABSL_GUARDED_BY(snapshot_mu_) = 0;
+  int64_t snapshot_mutation_count_ ABSL_GUARDED_BY(snapshot_mu_) = 0;
+  absl::BitGen snapshot_bit_gen_ ABSL_GUARDED_BY(snapshot_mu_);
+
+  // State of time based eviction (see `EnableItemExpiration`).
+  // `max_item_age_` is infinite for as long as expiration is disabled. Items
+  // enter `expiration_queue_` in insertion time order, so each check only
+  // inspects the front of the queue and the cost of a check is proportional
+  // to the number of expired items rather than the size of the table. Entries
+  // of items that were deleted before they expired are simply ignored when
+  // their time comes (keys are never reused).
+  absl::Duration max_item_age_ ABSL_GUARDED_BY(mu_) = absl::InfiniteDuration();
+  std::deque<std::pair<absl::Time, Key>> expiration_queue_
+      ABSL_GUARDED_BY(mu_);
+  std::unique_ptr<internal::PeriodicClosure> expiration_closure_;
+
   // Is the table being closed.
   bool closed_ ABSL_GUARDED_BY(mu_) = false;
 
@@ -481,6 +983,10 @@ class Table {
   // respects this limit when inserting a new item.
   const int64_t max_size_;
 
+  // Maximum number of chunk bytes the items of this table may reference.
+  // Zero means that no byte limit is enforced.
+  const int64_t max_size_bytes_;
+
   // Number of queued inserts that are allowed on the table without slowing down
   // further inserts.
   const int64_t max_enqueued_inserts_;
@@ -488,6 +994,11 @@ class Table {
   // Maximum number of allowed enqueued extension operations.
   const int64_t max_enqueued_extension_ops_;
 
+  // Maximum number of enqueued delete / memory release extension requests.
+  // Budgeted separately from `max_enqueued_extension_ops_` (see
+  // `kMaxPendingDeleteOps`).
+  const int64_t max_enqueued_delete_ops_;
+
   // Maximum number of times an item can be sampled before it is deleted.
   // A value <= 0 means there is no limit.
   const int32_t max_times_sampled_;
@@ -510,19 +1021,44 @@ class Table {
   std::vector<InsertRequest> pending_inserts_ ABSL_GUARDED_BY(worker_mu_);
 
   // Pending sample requests to the table (not yet picked up by the worker).
-  std::vector<std::unique_ptr<SampleRequest>> pending_sampling_
+  std::vector<std::shared_ptr<SampleRequest>> pending_sampling_
       ABSL_GUARDED_BY(worker_mu_);
 
   // Items collected by the worker for asynchronous deletion by the clients.
-  // This way we avoid expensive memory dealocation inside the worker.
+  // This way we avoid expensive memory dealocation inside the worker. Only
+  // used when no callback executor is available; otherwise deletion batches
+  // are reclaimed on the executor and never handed to the clients.
   std::vector<std::shared_ptr<Item>> deleted_items_ ABSL_GUARDED_BY(worker_mu_);
 
+  // Pool that recycles `Item` shells once their last reference is released
+  // (typically through `deleted_items_`), so steady-state insert/evict churn
+  // does not allocate and free items on the general purpose heap. Pooled items
+  // hold no chunk references.
+  std::shared_ptr<internal::ObjectPool<Item>> item_pool_;
+
+  // Pool that recycles `SampleRequest` shells once a finalized request's
+  // completion callback has run. The reset keeps the capacity of the
+  // `samples` vector, so at a steady sampling rate neither the requests nor
+  // their sample buffers touch the general purpose heap.
+  std::shared_ptr<internal::ObjectPool<SampleRequest>> sample_request_pool_;
+
   // Table worker execution time stats. It is updated periodically as table
   // worker state changes frequently and we don't want to grab `worker_mu_` each
   // time that happens.
   internal::StateStatistics<TableWorkerState> worker_time_distribution_
       ABSL_GUARDED_BY(worker_mu_);
 
+  // Recent combined depth of `pending_inserts_` and `pending_sampling_`,
+  // oldest sample first. Recorded by the table worker at most once per
+  // `kQueueDepthSamplePeriod` and capped at `kQueueDepthHistoryLength`
+  // entries. Exported through `info()` so that mis-sized servers can be
+  // spotted before throughput collapses.
+  std::deque<int64_t> queue_depth_history_ ABSL_GUARDED_BY(worker_mu_);
+
+  // When the last entry was added to `queue_depth_history_`.
+  absl::Time last_queue_depth_sample_ ABSL_GUARDED_BY(worker_mu_) =
+      absl::InfinitePast();
+
   // Should worker terminate. Set to true upon table termination to stop the
   // worker.
   bool stop_worker_ ABSL_GUARDED_BY(worker_mu_) = false;
@@ -530,18 +1066,54 @@ class Table {
   // Used for waking up a table worker when asleep.
   absl::CondVar wakeup_worker_ ABSL_GUARDED_BY(worker_mu_);
 
+  // True while the table worker is parked on `wakeup_worker_`.
+  // `WakeupWorker` only signals the condition variable when the worker is
+  // actually parked, saving the wakeup syscall on every enqueue while the
+  // worker is busy.
+  bool worker_sleeping_ ABSL_GUARDED_BY(worker_mu_) = false;
+
+  // Incremented by `WakeupWorker` on every wakeup request. Lets the worker
+  // spin on work arrival without holding `worker_mu_` (see
+  // `EnableWorkerSpinWait`).
+  std::atomic<uint64_t> worker_wakeup_epoch_{0};
+
+  // Upper bound of the worker's spin-before-park phase; zero disables
+  // spinning. See `EnableWorkerSpinWait`.
+  absl::Duration max_worker_spin_ ABSL_GUARDED_BY(worker_mu_) =
+      absl::ZeroDuration();
+
+  // Total time the table worker has slept while the rate limiter was holding
+  // back pending sample requests. Only written by the worker; read when
+  // stamping completed sample requests with their rate limiter wait.
+  std::atomic<int64_t> rate_limiter_wait_total_ns_{0};
+
   // Mutex to protect table worker's state.
   mutable absl::Mutex worker_mu_ ABSL_ACQUIRED_BEFORE(mu_);
 
   // Executor used by the table worker to run operation callbacks.
   std::shared_ptr<TaskExecutor> callback_executor_ ABSL_GUARDED_BY(mu_);
 
+  // Executor used by the table worker to run insert completion callbacks.
+  // Falls back to `callback_executor_` when null.
+  std::shared_ptr<TaskExecutor> insert_callback_executor_ ABSL_GUARDED_BY(mu_);
+
+  // NUMA node the table worker and extension worker threads pin themselves
+  // to, or -1 when unpinned (see `SetNumaNode`). The workers poll the value
+  // at the start of each iteration and rebind when it changed.
+  std::atomic<int> numa_node_{-1};
+
   // Extension worker which asynchronously updates monitoring.
   std::unique_ptr<internal::Thread> extension_worker_;
 
   // Pending extension requests to be processed by the extension worker.
   std::vector<ExtensionRequest> extension_requests_ ABSL_GUARDED_BY(mu_);
 
+  // Number of entries of `extension_requests_` that are delete or memory
+  // release requests. Tracked separately so that deletes draw on their own
+  // budget (see `kMaxPendingDeleteOps`). Reset when the worker swaps the
+  // queue out.
+  int64_t num_pending_delete_requests_ ABSL_GUARDED_BY(mu_) = 0;
+
   // Used for waking up extension worker when asleep.
   absl::CondVar extension_work_available_cv_ ABSL_GUARDED_BY(mu_);
 
@@ -16,6 +16,7 @@
 
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/table.h"
 
@@ -60,6 +61,26 @@ void TableExtensionBase::OnSample(absl::Mutex* mu, const ExtensionItem& item) {
   ApplyOnSample(item);
 }
 
+void TableExtensionBase::OnDeleteBatch(absl::Mutex* mu,
+                                       absl::Span<const ExtensionItem> items) {
+  ApplyOnDeleteBatch(items);
+}
+
+void TableExtensionBase::OnInsertBatch(absl::Mutex* mu,
+                                       absl::Span<const ExtensionItem> items) {
+  ApplyOnInsertBatch(items);
+}
+
+void TableExtensionBase::OnUpdateBatch(absl::Mutex* mu,
+                                       absl::Span<const ExtensionItem> items) {
+  ApplyOnUpdateBatch(items);
+}
+
+void TableExtensionBase::OnSampleBatch(absl::Mutex* mu,
+                                       absl::Span<const ExtensionItem> items) {
+  ApplyOnSampleBatch(items);
+}
+
 void TableExtensionBase::ApplyOnDelete(const ExtensionItem& item) {}
 
 void TableExtensionBase::ApplyOnInsert(const ExtensionItem& item) {}
@@ -70,5 +91,25 @@ void TableExtensionBase::ApplyOnUpdate(const ExtensionItem& item) {}
 
 void TableExtensionBase::ApplyOnSample(const ExtensionItem& item) {}
 
+void TableExtensionBase::ApplyOnDeleteBatch(
+    absl::Span<const ExtensionItem> items) {
+  for (const ExtensionItem& item : items) ApplyOnDelete(item);
+}
+
+void TableExtensionBase::ApplyOnInsertBatch(
+    absl::Span<const ExtensionItem> items) {
+  for (const ExtensionItem& item : items) ApplyOnInsert(item);
+}
+
+void TableExtensionBase::ApplyOnUpdateBatch(
+    absl::Span<const ExtensionItem> items) {
+  for (const ExtensionItem& item : items) ApplyOnUpdate(item);
+}
+
+void TableExtensionBase::ApplyOnSampleBatch(
+    absl::Span<const ExtensionItem> items) {
+  for (const ExtensionItem& item : items) ApplyOnSample(item);
+}
+
 }  // namespace reverb
 }  // namespace deepmind
@@ -17,6 +17,7 @@
 
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "reverb/cc/table.h"
 #include "reverb/cc/table_extensions/interface.h"
 
@@ -41,6 +42,15 @@ class TableExtensionBase : public TableExtension {
   virtual void ApplyOnUpdate(const ExtensionItem& item);
   virtual void ApplyOnSample(const ExtensionItem& item);
 
+  // Batch versions of the ApplyOn methods. By default the per item method is
+  // called once for every element of `items`, in order. Children with per
+  // call costs that can be shared across a batch (e.g. taking their own lock
+  // once) should override these instead of the per item methods.
+  virtual void ApplyOnDeleteBatch(absl::Span<const ExtensionItem> items);
+  virtual void ApplyOnInsertBatch(absl::Span<const ExtensionItem> items);
+  virtual void ApplyOnUpdateBatch(absl::Span<const ExtensionItem> items);
+  virtual void ApplyOnSampleBatch(absl::Span<const ExtensionItem> items);
+
  protected:
   friend class Table;
 
@@ -69,6 +79,23 @@ class TableExtensionBase : public TableExtension {
   void OnSample(absl::Mutex* mu, const ExtensionItem& item) override
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu);
 
+  // Delegate calls to the matching ApplyOn*Batch method.
+  void OnDeleteBatch(absl::Mutex* mu,
+                     absl::Span<const ExtensionItem> items) override
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  void OnInsertBatch(absl::Mutex* mu,
+                     absl::Span<const ExtensionItem> items) override
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  void OnUpdateBatch(absl::Mutex* mu,
+                     absl::Span<const ExtensionItem> items) override
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  void OnSampleBatch(absl::Mutex* mu,
+                     absl::Span<const ExtensionItem> items) override
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu);
+
  protected:
   absl::Mutex table_mu_;
   Table* table_ ABSL_GUARDED_BY(table_mu_) = nullptr;
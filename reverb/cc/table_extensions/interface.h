@@ -21,6 +21,7 @@
 #include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "reverb/cc/schema.pb.h"
 
 namespace deepmind {
@@ -67,6 +68,27 @@ class TableExtension {
   virtual void OnSample(absl::Mutex* mu, const ExtensionItem& item)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu) = 0;
 
+  // Batch versions of the hooks above. The extension worker dispatches runs
+  // of consecutive operations of the same type as a single call so that
+  // extensions can amortize per call costs (e.g. their own locking) across
+  // many items. Semantically equivalent to calling the per item hook once for
+  // every element of `items`, in order.
+  virtual void OnInsertBatch(absl::Mutex* mu,
+                             absl::Span<const ExtensionItem> items)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu) = 0;
+
+  virtual void OnDeleteBatch(absl::Mutex* mu,
+                             absl::Span<const ExtensionItem> items)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu) = 0;
+
+  virtual void OnUpdateBatch(absl::Mutex* mu,
+                             absl::Span<const ExtensionItem> items)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu) = 0;
+
+  virtual void OnSampleBatch(absl::Mutex* mu,
+                             absl::Span<const ExtensionItem> items)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu) = 0;
+
   // Executed just before all items are deleted.
   virtual void OnReset(absl::Mutex* mu) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu) = 0;
 
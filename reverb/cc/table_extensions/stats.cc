@@ -0,0 +1,178 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/table_extensions/stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/platform/hash_map.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr int kNumOps = 4;
+constexpr int kNumBuckets = StatsTableExtension::Histogram::kNumBuckets;
+
+// HDR-style bucketing: the exponent of the value selects a group of four
+// sub-buckets addressed by the two mantissa bits below the leading one,
+// bounding the relative error of a bucket at ~19% over the whole int64
+// range. Non-positive values land in bucket 0.
+int BucketIndex(int64_t value) {
+  if (value < 4) return std::max<int64_t>(value, 0);
+  int msb = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+  const int index = (msb << 2) | ((value >> (msb - 2)) & 3);
+  return std::min(index, kNumBuckets - 1);
+}
+
+// Lower bound of the value range covered by `index`.
+int64_t BucketValue(int index) {
+  if (index < 4) return index;
+  const int msb = index >> 2;
+  return (int64_t{4} | (index & 3)) << (msb - 2);
+}
+
+int64_t PriorityToMicros(double priority) {
+  if (!std::isfinite(priority)) return 0;
+  return static_cast<int64_t>(priority * 1e6);
+}
+
+}  // namespace
+
+// Single writer histograms of one thread. The owning thread increments with
+// relaxed atomics (no contention, no fences); mergers read concurrently and
+// may miss the most recent increments.
+struct StatsTableExtension::Recorder {
+  struct Counters {
+    std::atomic<int64_t> count{0};
+    std::atomic<int64_t> priority[kNumBuckets] = {};
+    std::atomic<int64_t> latency[kNumBuckets] = {};
+  };
+
+  Counters ops[kNumOps];
+
+  void Record(int op, int64_t priority_micros, int64_t latency_ns) {
+    Counters& c = ops[op];
+    c.priority[BucketIndex(priority_micros)].fetch_add(
+        1, std::memory_order_relaxed);
+    c.latency[BucketIndex(latency_ns)].fetch_add(1, std::memory_order_relaxed);
+    c.count.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+int64_t StatsTableExtension::Histogram::Percentile(double q) const {
+  if (count == 0) return 0;
+  const int64_t target = static_cast<int64_t>(q * (count - 1)) + 1;
+  int64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    seen += buckets[i];
+    if (seen >= target) return BucketValue(i);
+  }
+  return BucketValue(kNumBuckets - 1);
+}
+
+StatsTableExtension::Recorder* StatsTableExtension::ThisThreadRecorder() {
+  // Keyed by extension as multiple tables may each own a stats extension
+  // while sharing worker threads.
+  thread_local internal::flat_hash_map<const StatsTableExtension*,
+                                       std::shared_ptr<Recorder>>
+      recorders;
+  auto& recorder = recorders[this];
+  if (recorder == nullptr) {
+    recorder = std::make_shared<Recorder>();
+    absl::MutexLock lock(&recorders_mu_);
+    recorders_.push_back(recorder);
+  }
+  return recorder.get();
+}
+
+void StatsTableExtension::Record(Op op, const ExtensionItem& item) {
+  const auto& inserted_at = item.ref->item.inserted_at();
+  const absl::Time inserted = absl::FromUnixSeconds(inserted_at.seconds()) +
+                              absl::Nanoseconds(inserted_at.nanos());
+  const int64_t latency_ns = absl::ToInt64Nanoseconds(absl::Now() - inserted);
+  ThisThreadRecorder()->Record(static_cast<int>(op),
+                               PriorityToMicros(item.priority), latency_ns);
+}
+
+void StatsTableExtension::ApplyOnInsert(const ExtensionItem& item) {
+  Record(Op::kInsert, item);
+}
+
+void StatsTableExtension::ApplyOnDelete(const ExtensionItem& item) {
+  Record(Op::kDelete, item);
+}
+
+void StatsTableExtension::ApplyOnUpdate(const ExtensionItem& item) {
+  Record(Op::kUpdate, item);
+}
+
+void StatsTableExtension::ApplyOnSample(const ExtensionItem& item) {
+  Record(Op::kSample, item);
+}
+
+StatsTableExtension::OpStats StatsTableExtension::stats(Op op) const {
+  std::vector<std::shared_ptr<Recorder>> recorders;
+  {
+    absl::MutexLock lock(&recorders_mu_);
+    recorders = recorders_;
+  }
+  OpStats result;
+  result.priority.buckets.assign(kNumBuckets, 0);
+  result.latency.buckets.assign(kNumBuckets, 0);
+  for (const auto& recorder : recorders) {
+    const Recorder::Counters& c = recorder->ops[static_cast<int>(op)];
+    result.count += c.count.load(std::memory_order_relaxed);
+    for (int i = 0; i < kNumBuckets; i++) {
+      result.priority.buckets[i] +=
+          c.priority[i].load(std::memory_order_relaxed);
+      result.latency.buckets[i] += c.latency[i].load(std::memory_order_relaxed);
+    }
+  }
+  result.priority.count = result.count;
+  result.latency.count = result.count;
+  return result;
+}
+
+std::string StatsTableExtension::DebugString() const {
+  const std::pair<const char*, Op> ops[] = {
+      {"insert", Op::kInsert},
+      {"delete", Op::kDelete},
+      {"update", Op::kUpdate},
+      {"sample", Op::kSample},
+  };
+  std::string out = "StatsTableExtension(";
+  for (int i = 0; i < kNumOps; i++) {
+    const OpStats s = stats(ops[i].second);
+    absl::StrAppend(
+        &out, i == 0 ? "" : ", ", ops[i].first, "={count=", s.count,
+        ", latency_s p50/p99=",
+        s.latency.Percentile(0.5) / 1e9, "/", s.latency.Percentile(0.99) / 1e9,
+        ", priority p50/p99=", s.priority.Percentile(0.5) / 1e6, "/",
+        s.priority.Percentile(0.99) / 1e6, "}");
+  }
+  absl::StrAppend(&out, ")");
+  return out;
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,110 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_TABLE_EXTENSIONS_STATS_H_
+#define REVERB_CC_TABLE_EXTENSIONS_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "reverb/cc/table.h"
+#include "reverb/cc/table_extensions/base.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Built-in telemetry extension recording distributions of table operations.
+//
+// For every insert, update, delete and sample the extension records the
+// item's priority and a latency into HDR-style logarithmic histograms (~19%
+// relative bucket error over the full int64 range). The latency of a sample
+// is the age of the item, i.e. the time between its insertion and the draw;
+// for the other operations it is the delay between the item's insertion time
+// and the extension observing the operation, which on the asynchronous
+// extension worker measures how far telemetry lags behind the table.
+//
+// Recording is lock free: each recording thread owns its own set of plain
+// counters, so the extension never introduces a lock that serializes table
+// operations (hooks may run on the table worker or the extension worker).
+// The per-thread histograms are merged when a summary is requested; a merge
+// may miss increments that race with it, which for telemetry is fine.
+class StatsTableExtension : public TableExtensionBase {
+ public:
+  // The operations for which distributions are recorded.
+  enum class Op { kInsert = 0, kDelete = 1, kUpdate = 2, kSample = 3 };
+
+  // Merged view of one histogram. Bucket `i` counts recorded values `v` with
+  // `BucketIndex(v) == i`; use `Percentile` for interpretation.
+  struct Histogram {
+    static constexpr int kNumBuckets = 256;
+
+    std::vector<int64_t> buckets;
+    int64_t count = 0;
+
+    // Approximate value at quantile `q` in [0, 1], in the recorded unit
+    // (nanoseconds for latencies, micro-units for priorities).
+    int64_t Percentile(double q) const;
+  };
+
+  // Merged statistics of one operation type.
+  struct OpStats {
+    int64_t count = 0;
+    Histogram priority;  // Priorities in fixed point micro-units.
+    Histogram latency;   // Latencies in nanoseconds.
+  };
+
+  StatsTableExtension() = default;
+
+  // Recording is lock free so the hooks are safe (and cheap) to run on the
+  // extension worker.
+  bool CanRunAsync() const override { return true; }
+
+  // Returns the merged statistics for `op`.
+  OpStats stats(Op op) const ABSL_LOCKS_EXCLUDED(recorders_mu_);
+
+  // Single line summary with counts and latency percentiles per operation.
+  std::string DebugString() const override;
+
+  // TableExtensionBase hooks.
+  void ApplyOnInsert(const ExtensionItem& item) override;
+  void ApplyOnDelete(const ExtensionItem& item) override;
+  void ApplyOnUpdate(const ExtensionItem& item) override;
+  void ApplyOnSample(const ExtensionItem& item) override;
+
+ private:
+  struct Recorder;
+
+  // Returns the calling thread's recorder, creating and registering it on
+  // first use.
+  Recorder* ThisThreadRecorder() ABSL_LOCKS_EXCLUDED(recorders_mu_);
+
+  void Record(Op op, const ExtensionItem& item);
+
+  // All recorders ever created for this extension. Held by shared_ptr so
+  // that recorders of exited threads keep contributing to summaries.
+  mutable absl::Mutex recorders_mu_;
+  std::vector<std::shared_ptr<Recorder>> recorders_
+      ABSL_GUARDED_BY(recorders_mu_);
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_TABLE_EXTENSIONS_STATS_H_
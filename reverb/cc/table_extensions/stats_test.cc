@@ -0,0 +1,129 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/table_extensions/stats.h"
+
+#include <cfloat>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/rate_limiter.h"
+#include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/table.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+TableItem MakeItem(uint64_t key, double priority) {
+  TableItem item;
+  auto data = testing::MakeChunkData(
+      key * 100, testing::MakeSequenceRange(key * 100, 0, 1));
+  item.chunks.push_back(std::make_shared<ChunkStore::Chunk>(data));
+  item.item = testing::MakePrioritizedItem(key, priority, {data});
+  return item;
+}
+
+std::unique_ptr<Table> MakeUniformTable(
+    const std::string& name,
+    std::vector<std::shared_ptr<TableExtension>> extensions = {}) {
+  return absl::make_unique<Table>(
+      name, std::make_shared<UniformSelector>(),
+      std::make_shared<FifoSelector>(), /*max_size=*/1000, 0,
+      std::make_shared<RateLimiter>(1.0, 1, -DBL_MAX, DBL_MAX),
+      std::move(extensions));
+}
+
+void WaitForExtensions(Table* table) {
+  for (int retry = 0; retry < 100 && !table->all_extensions_are_up_to_date();
+       retry++) {
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+}
+
+TEST(StatsTableExtensionTest, CountsOperations) {
+  auto stats = std::make_shared<StatsTableExtension>();
+  auto table = MakeUniformTable("dist", {stats});
+
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 2)));
+  REVERB_EXPECT_OK(
+      table->MutateItems({testing::MakeKeyWithPriority(2, 20)}, {1}));
+  Table::SampledItem sample;
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  WaitForExtensions(table.get());
+
+  EXPECT_EQ(stats->stats(StatsTableExtension::Op::kInsert).count, 2);
+  EXPECT_EQ(stats->stats(StatsTableExtension::Op::kUpdate).count, 1);
+  EXPECT_EQ(stats->stats(StatsTableExtension::Op::kDelete).count, 1);
+  EXPECT_EQ(stats->stats(StatsTableExtension::Op::kSample).count, 1);
+}
+
+TEST(StatsTableExtensionTest, RecordsPriorityDistribution) {
+  auto stats = std::make_shared<StatsTableExtension>();
+  auto table = MakeUniformTable("dist", {stats});
+
+  for (int i = 1; i <= 100; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 2.0)));
+  }
+  WaitForExtensions(table.get());
+
+  const auto insert_stats = stats->stats(StatsTableExtension::Op::kInsert);
+  ASSERT_EQ(insert_stats.count, 100);
+  // All priorities are 2.0 so every percentile falls into the same bucket
+  // (2e6 in micro-units, subject to ~19% bucket granularity).
+  const int64_t p50 = insert_stats.priority.Percentile(0.5);
+  EXPECT_NEAR(p50, 2e6, 2e6 * 0.2);
+  EXPECT_EQ(p50, insert_stats.priority.Percentile(0.99));
+}
+
+TEST(StatsTableExtensionTest, SampleLatencyIsItemAge) {
+  auto stats = std::make_shared<StatsTableExtension>();
+  auto table = MakeUniformTable("dist", {stats});
+
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  absl::SleepFor(absl::Milliseconds(50));
+  Table::SampledItem sample;
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  WaitForExtensions(table.get());
+
+  const auto sample_stats = stats->stats(StatsTableExtension::Op::kSample);
+  ASSERT_EQ(sample_stats.count, 1);
+  // The sampled item was at least 50ms old.
+  EXPECT_GE(sample_stats.latency.Percentile(0.5), 40 * 1000 * 1000);
+}
+
+TEST(StatsTableExtensionTest, DebugStringContainsCounts) {
+  auto stats = std::make_shared<StatsTableExtension>();
+  auto table = MakeUniformTable("dist", {stats});
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  WaitForExtensions(table.get());
+  EXPECT_THAT(stats->DebugString(),
+              ::testing::HasSubstr("insert={count=1"));
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,300 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/table_extensions/write_ahead_log.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/tf_util.h"
+#include "reverb/cc/support/trajectory_util.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+
+namespace deepmind {
+namespace reverb {
+
+absl::Status WriteAheadLog::Create(const std::string& path,
+                                   std::shared_ptr<WriteAheadLog>* log) {
+  auto result = std::shared_ptr<WriteAheadLog>(new WriteAheadLog(path));
+  {
+    absl::MutexLock lock(&result->io_mu_);
+    REVERB_RETURN_IF_ERROR(result->OpenLog());
+  }
+  result->writer_thread_ = internal::StartThread(
+      "wal_writer", [log = result.get()] { log->WriterLoop(); });
+  *log = std::move(result);
+  return absl::OkStatus();
+}
+
+WriteAheadLog::WriteAheadLog(std::string path)
+    : path_(std::move(path)), last_sync_(absl::Now()) {}
+
+WriteAheadLog::~WriteAheadLog() {
+  {
+    absl::MutexLock lock(&mu_);
+    stop_ = true;
+  }
+  writer_thread_ = nullptr;  // Joins the thread.
+  absl::MutexLock lock(&io_mu_);
+  if (writer_ != nullptr) {
+    writer_->Close().IgnoreError();
+  }
+  if (file_ != nullptr) {
+    file_->Close().IgnoreError();
+  }
+}
+
+absl::Status WriteAheadLog::OpenLog() {
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      tensorflow::Env::Default()->NewWritableFile(path_, &file_)));
+  writer_ = absl::make_unique<tensorflow::io::RecordWriter>(file_.get());
+  records_since_sync_ = 0;
+  last_sync_ = absl::Now();
+  return absl::OkStatus();
+}
+
+void WriteAheadLog::ApplyOnInsert(const ExtensionItem& item) {
+  absl::MutexLock lock(&mu_);
+  PendingOp op;
+  *op.record.mutable_insert() = item.ref->item;
+  for (const auto& chunk : item.ref->chunks) {
+    if (logged_chunk_keys_.insert(chunk->key()).second) {
+      op.chunks.push_back(chunk);
+    }
+  }
+  pending_.push_back(std::move(op));
+  ++enqueued_ops_;
+}
+
+void WriteAheadLog::ApplyOnDelete(const ExtensionItem& item) {
+  absl::MutexLock lock(&mu_);
+  PendingOp op;
+  op.record.set_delete_key(item.ref->item.key());
+  pending_.push_back(std::move(op));
+  ++enqueued_ops_;
+}
+
+void WriteAheadLog::ApplyOnUpdate(const ExtensionItem& item) {
+  absl::MutexLock lock(&mu_);
+  PendingOp op;
+  op.record.mutable_update()->set_key(item.ref->item.key());
+  op.record.mutable_update()->set_priority(item.priority);
+  pending_.push_back(std::move(op));
+  ++enqueued_ops_;
+}
+
+void WriteAheadLog::ApplyOnReset() {
+  absl::MutexLock lock(&mu_);
+  PendingOp op;
+  op.record.set_reset(true);
+  pending_.push_back(std::move(op));
+  ++enqueued_ops_;
+}
+
+void WriteAheadLog::WriterLoop() {
+  while (true) {
+    std::vector<PendingOp> batch;
+    bool stopping;
+    {
+      absl::MutexLock lock(&mu_);
+      auto has_work = [this]() { return !pending_.empty() || stop_; };
+      // Wake up periodically even without new work so that a written but
+      // unsynced tail of the log does not stay unsynced indefinitely.
+      mu_.AwaitWithTimeout(absl::Condition(&has_work), kSyncInterval);
+      std::swap(batch, pending_);
+      stopping = stop_;
+    }
+    const absl::Status status = WriteBatch(batch);
+    if (!batch.empty()) {
+      absl::MutexLock lock(&mu_);
+      written_ops_ += batch.size();
+    }
+    if (!status.ok()) {
+      REVERB_LOG(REVERB_ERROR)
+          << "Write ahead log " << path_ << " failed: " << status.ToString();
+    }
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+absl::Status WriteAheadLog::WriteBatch(const std::vector<PendingOp>& batch) {
+  absl::MutexLock lock(&io_mu_);
+  if (!writer_status_.ok()) {
+    return writer_status_;
+  }
+  auto write = [this](const WriteAheadLogRecord& record) {
+    return FromTensorflowStatus(writer_->WriteRecord(record.SerializeAsString()));
+  };
+  for (const auto& op : batch) {
+    for (const auto& chunk : op.chunks) {
+      WriteAheadLogRecord chunk_record;
+      *chunk_record.mutable_chunk() = chunk->data();
+      writer_status_ = write(chunk_record);
+      if (!writer_status_.ok()) return writer_status_;
+      ++records_since_sync_;
+    }
+    writer_status_ = write(op.record);
+    if (!writer_status_.ok()) return writer_status_;
+    ++records_since_sync_;
+  }
+  if (records_since_sync_ > 0 &&
+      (records_since_sync_ >= kSyncEveryRecords ||
+       absl::Now() - last_sync_ >= kSyncInterval)) {
+    writer_status_ = FromTensorflowStatus(writer_->Flush());
+    if (!writer_status_.ok()) return writer_status_;
+    writer_status_ = FromTensorflowStatus(file_->Sync());
+    if (!writer_status_.ok()) return writer_status_;
+    records_since_sync_ = 0;
+    last_sync_ = absl::Now();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status WriteAheadLog::Sync() {
+  {
+    absl::MutexLock lock(&mu_);
+    const int64_t target = enqueued_ops_;
+    auto drained = [this, target]() { return written_ops_ >= target; };
+    mu_.Await(absl::Condition(&drained));
+  }
+  absl::MutexLock lock(&io_mu_);
+  if (!writer_status_.ok()) {
+    return writer_status_;
+  }
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(writer_->Flush()));
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(file_->Sync()));
+  records_since_sync_ = 0;
+  last_sync_ = absl::Now();
+  return absl::OkStatus();
+}
+
+absl::Status WriteAheadLog::Truncate() {
+  {
+    absl::MutexLock lock(&mu_);
+    // Everything enqueued so far is covered by the checkpoint.
+    written_ops_ += pending_.size();
+    pending_.clear();
+    logged_chunk_keys_.clear();
+  }
+  absl::MutexLock lock(&io_mu_);
+  if (writer_ != nullptr) {
+    writer_->Close().IgnoreError();
+  }
+  if (file_ != nullptr) {
+    file_->Close().IgnoreError();
+  }
+  writer_status_ = absl::OkStatus();
+  return OpenLog();
+}
+
+absl::Status WriteAheadLog::Replay(const std::string& path,
+                                   ChunkStore* chunk_store, Table* table) {
+  if (!tensorflow::Env::Default()->FileExists(path).ok()) {
+    return absl::OkStatus();
+  }
+
+  std::unique_ptr<tensorflow::RandomAccessFile> file;
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      tensorflow::Env::Default()->NewRandomAccessFile(path, &file)));
+  tensorflow::io::RecordReader reader(file.get());
+
+  internal::flat_hash_map<ChunkStore::Key, std::shared_ptr<ChunkStore::Chunk>>
+      chunk_by_key;
+
+  WriteAheadLogRecord record;
+  absl::Status status;
+  tensorflow::uint64 offset = 0;
+  tensorflow::tstring data;
+  do {
+    status = FromTensorflowStatus(reader.ReadRecord(&offset, &data));
+    if (!status.ok()) break;
+    if (!record.ParseFromArray(data.data(), data.size())) {
+      return absl::DataLossError(
+          absl::StrCat("Could not parse TFRecord as WriteAheadLogRecord at ",
+                       "offset ", offset, " of ", path));
+    }
+    switch (record.op_case()) {
+      case WriteAheadLogRecord::kChunk: {
+        const ChunkStore::Key key = record.chunk().chunk_key();
+        chunk_by_key[key] = chunk_store->Insert(std::move(*record.mutable_chunk()));
+        break;
+      }
+      case WriteAheadLogRecord::kInsert: {
+        Table::Item item;
+        item.item = std::move(*record.mutable_insert());
+        Table::Item existing;
+        if (table->Get(item.item.key(), &existing)) {
+          // The checkpoint already covers this insert.
+          break;
+        }
+        for (const auto& key :
+             internal::GetChunkKeys(item.item.flat_trajectory())) {
+          auto it = chunk_by_key.find(key);
+          if (it != chunk_by_key.end()) {
+            item.chunks.push_back(it->second);
+            continue;
+          }
+          // The chunk was not logged so it must have been persisted (and
+          // loaded) with the checkpoint.
+          std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+          REVERB_RETURN_IF_ERROR(
+              FromTensorflowStatus(chunk_store->Get({key}, &chunks)));
+          item.chunks.push_back(std::move(chunks[0]));
+        }
+        REVERB_RETURN_IF_ERROR(table->InsertCheckpointItem(std::move(item)));
+        break;
+      }
+      case WriteAheadLogRecord::kUpdate: {
+        REVERB_RETURN_IF_ERROR(table->MutateItems({record.update()}, {}));
+        break;
+      }
+      case WriteAheadLogRecord::kDeleteKey: {
+        REVERB_RETURN_IF_ERROR(table->MutateItems({}, {record.delete_key()}));
+        break;
+      }
+      case WriteAheadLogRecord::kReset: {
+        REVERB_RETURN_IF_ERROR(table->Reset());
+        break;
+      }
+      case WriteAheadLogRecord::OP_NOT_SET:
+        return absl::DataLossError(absl::StrCat(
+            "WriteAheadLogRecord without op at offset ", offset, " of ", path));
+    }
+  } while (status.ok());
+  if (!absl::IsOutOfRange(status)) {
+    return status;
+  }
+  return absl::OkStatus();
+}
+
+std::string WriteAheadLog::DebugString() const {
+  return absl::StrCat("WriteAheadLog(path=", path_, ")");
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,159 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_TABLE_EXTENSIONS_WRITE_AHEAD_LOG_H_
+#define REVERB_CC_TABLE_EXTENSIONS_WRITE_AHEAD_LOG_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_set.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/table.h"
+#include "reverb/cc/table_extensions/base.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Table extension that appends every committed mutation of its table to a
+// write ahead log, bounding the data lost by a crash to the records not yet
+// synced rather than everything since the last checkpoint.
+//
+// The hooks only copy the item metadata and enqueue references to the
+// (immutable) chunks while the table lock is held; serialization, file
+// writes and syncs happen on a dedicated writer thread so the log adds no
+// I/O latency to the insert ack path. The writer syncs the file to disk in
+// batches (see `kSyncEveryRecords` / `kSyncInterval`), trading a small
+// durability window for not syncing on every insert.
+//
+// Chunk payloads are logged once, before the first logged item referencing
+// them. Deletes are logged for both explicit removals and evictions, so a
+// replayed table respects its capacity without rerunning eviction logic.
+// Sample counts are not logged; replayed items start with the sample count
+// they had when inserted or last updated.
+//
+// Recovery loads the latest checkpoint and then calls `Replay` with the log
+// path. Replay is idempotent: inserts of keys already present (because the
+// checkpoint includes them) and deletes of absent keys are skipped, so a log
+// that was not truncated exactly at the checkpoint boundary replays
+// correctly. After a successful checkpoint `Truncate` drops the log content
+// that the checkpoint made redundant.
+class WriteAheadLog : public TableExtensionBase {
+ public:
+  // Number of records after which the writer thread syncs the log file.
+  static constexpr int64_t kSyncEveryRecords = 256;
+
+  // Maximum time records may stay unsynced once written.
+  static constexpr absl::Duration kSyncInterval = absl::Milliseconds(100);
+
+  // Creates the extension, creating (or truncating) the log file at `path`.
+  static absl::Status Create(const std::string& path,
+                             std::shared_ptr<WriteAheadLog>* log);
+
+  // Blocks until all enqueued records have been written and synced.
+  ~WriteAheadLog() override;
+
+  // Replays the log at `path` on top of `table`, which has typically just
+  // been restored from the latest checkpoint. Chunks logged before their
+  // items are inserted into `chunk_store`; chunks already loaded by the
+  // checkpoint are looked up there. A missing log file is not an error.
+  static absl::Status Replay(const std::string& path, ChunkStore* chunk_store,
+                             Table* table);
+
+  // Writes all enqueued records and syncs the file before returning.
+  absl::Status Sync();
+
+  // Discards enqueued records and truncates the log file. Must be called
+  // right after a checkpoint of the table succeeded; the log then only
+  // accumulates mutations that the checkpoint does not cover.
+  absl::Status Truncate();
+
+  // Hooks run while the table lock is held and must stay cheap; they enqueue
+  // and return.
+  void ApplyOnInsert(const ExtensionItem& item) override;
+  void ApplyOnDelete(const ExtensionItem& item) override;
+  void ApplyOnUpdate(const ExtensionItem& item) override;
+  void ApplyOnReset() override;
+
+  bool CanRunAsync() const override { return false; }
+
+  std::string DebugString() const override;
+
+ private:
+  // A logged operation together with the chunks whose payloads must be
+  // written before it. Chunks are serialized on the writer thread since their
+  // payloads are immutable.
+  struct PendingOp {
+    WriteAheadLogRecord record;
+    std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  };
+
+  explicit WriteAheadLog(std::string path);
+
+  // Opens (or truncates) the log file. Requires `io_mu_`.
+  absl::Status OpenLog() ABSL_EXCLUSIVE_LOCKS_REQUIRED(io_mu_);
+
+  // Writes `batch` to the log file and syncs if the batch threshold or sync
+  // interval has been reached.
+  absl::Status WriteBatch(const std::vector<PendingOp>& batch)
+      ABSL_LOCKS_EXCLUDED(io_mu_);
+
+  // Writer thread main loop.
+  void WriterLoop();
+
+  const std::string path_;
+
+  absl::Mutex mu_;
+  std::vector<PendingOp> pending_ ABSL_GUARDED_BY(mu_);
+  bool stop_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Number of operations enqueued respectively written to the file. `Sync`
+  // waits until the writer has caught up with the enqueue counter.
+  int64_t enqueued_ops_ ABSL_GUARDED_BY(mu_) = 0;
+  int64_t written_ops_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Keys of the chunks whose payloads have already been enqueued or written.
+  // Cleared by `Truncate` so chunks referenced after it are logged again.
+  internal::flat_hash_set<uint64_t> logged_chunk_keys_ ABSL_GUARDED_BY(mu_);
+
+  // Guards the file state; held by the writer thread while writing a batch
+  // and by `Truncate` while recreating the file.
+  absl::Mutex io_mu_;
+  std::unique_ptr<tensorflow::WritableFile> file_ ABSL_GUARDED_BY(io_mu_);
+  std::unique_ptr<tensorflow::io::RecordWriter> writer_ ABSL_GUARDED_BY(io_mu_);
+  int64_t records_since_sync_ ABSL_GUARDED_BY(io_mu_) = 0;
+  absl::Time last_sync_ ABSL_GUARDED_BY(io_mu_);
+
+  // First error hit by the writer thread, surfaced by `Sync`. Writing stops
+  // once an error occurred.
+  absl::Status writer_status_ ABSL_GUARDED_BY(io_mu_) = absl::OkStatus();
+
+  // Keep last so the thread is joined before the other members die.
+  std::unique_ptr<internal::Thread> writer_thread_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_TABLE_EXTENSIONS_WRITE_AHEAD_LOG_H_
@@ -0,0 +1,172 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/table_extensions/write_ahead_log.h"
+
+#include <cfloat>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include "absl/memory/memory.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/rate_limiter.h"
+#include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/table.h"
+#include "reverb/cc/testing/proto_test_util.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+using ::testing::SizeIs;
+
+std::string LogPath() {
+  std::string name;
+  REVERB_CHECK(tensorflow::Env::Default()->LocalTempFilename(&name));
+  return name;
+}
+
+TableItem MakeItem(uint64_t key, double priority) {
+  TableItem item;
+  auto data = testing::MakeChunkData(
+      key * 100, testing::MakeSequenceRange(key * 100, 0, 1));
+  item.chunks.push_back(std::make_shared<ChunkStore::Chunk>(data));
+  item.item = testing::MakePrioritizedItem(key, priority, {data});
+  return item;
+}
+
+std::unique_ptr<Table> MakeUniformTable(
+    const std::string& name,
+    std::vector<std::shared_ptr<TableExtension>> extensions = {},
+    int64_t max_size = 1000) {
+  return absl::make_unique<Table>(
+      name, std::make_shared<UniformSelector>(),
+      std::make_shared<FifoSelector>(), max_size, 0,
+      std::make_shared<RateLimiter>(1.0, 1, -DBL_MAX, DBL_MAX),
+      std::move(extensions));
+}
+
+TEST(WriteAheadLogTest, ReplayRestoresInsertsUpdatesAndDeletes) {
+  const std::string path = LogPath();
+  std::shared_ptr<WriteAheadLog> log;
+  REVERB_ASSERT_OK(WriteAheadLog::Create(path, &log));
+
+  auto table = MakeUniformTable("dist", {log});
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 2)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(3, 3)));
+  REVERB_EXPECT_OK(table->MutateItems({testing::MakeKeyWithPriority(2, 20)},
+                                      {3}));
+  REVERB_EXPECT_OK(log->Sync());
+
+  ChunkStore chunk_store;
+  auto restored = MakeUniformTable("dist");
+  REVERB_EXPECT_OK(
+      WriteAheadLog::Replay(path, &chunk_store, restored.get()));
+
+  auto items = restored->Copy();
+  ASSERT_THAT(items, SizeIs(2));
+  for (const auto& item : items) {
+    EXPECT_EQ(item.item.priority(), item.item.key() == 2 ? 20 : 1);
+    ASSERT_THAT(item.chunks, SizeIs(1));
+    EXPECT_EQ(item.chunks[0]->key(), item.item.key() * 100);
+  }
+}
+
+TEST(WriteAheadLogTest, ReplaySkipsItemsCoveredByCheckpoint) {
+  const std::string path = LogPath();
+  std::shared_ptr<WriteAheadLog> log;
+  REVERB_ASSERT_OK(WriteAheadLog::Create(path, &log));
+
+  auto table = MakeUniformTable("dist", {log});
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 2)));
+  REVERB_EXPECT_OK(log->Sync());
+
+  // Simulate a checkpoint that already covers the first item; replaying the
+  // (untruncated) log must not overwrite it.
+  ChunkStore chunk_store;
+  auto restored = MakeUniformTable("dist");
+  REVERB_EXPECT_OK(restored->InsertOrAssign(MakeItem(1, 100)));
+  REVERB_EXPECT_OK(
+      WriteAheadLog::Replay(path, &chunk_store, restored.get()));
+
+  auto items = restored->Copy();
+  ASSERT_THAT(items, SizeIs(2));
+  for (const auto& item : items) {
+    if (item.item.key() == 1) {
+      EXPECT_EQ(item.item.priority(), 100);
+    }
+  }
+}
+
+TEST(WriteAheadLogTest, ReplayAfterTruncateOnlySeesLaterMutations) {
+  const std::string path = LogPath();
+  std::shared_ptr<WriteAheadLog> log;
+  REVERB_ASSERT_OK(WriteAheadLog::Create(path, &log));
+
+  auto table = MakeUniformTable("dist", {log});
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  REVERB_EXPECT_OK(log->Sync());
+  REVERB_EXPECT_OK(log->Truncate());
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 2)));
+  REVERB_EXPECT_OK(log->Sync());
+
+  ChunkStore chunk_store;
+  auto restored = MakeUniformTable("dist");
+  REVERB_EXPECT_OK(
+      WriteAheadLog::Replay(path, &chunk_store, restored.get()));
+
+  auto items = restored->Copy();
+  ASSERT_THAT(items, SizeIs(1));
+  EXPECT_EQ(items[0].item.key(), 2);
+}
+
+TEST(WriteAheadLogTest, ReplayRespectsEvictions) {
+  const std::string path = LogPath();
+  std::shared_ptr<WriteAheadLog> log;
+  REVERB_ASSERT_OK(WriteAheadLog::Create(path, &log));
+
+  auto table = MakeUniformTable("dist", {log}, /*max_size=*/2);
+  for (int i = 1; i <= 5; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, i)));
+  }
+  REVERB_EXPECT_OK(log->Sync());
+  EXPECT_EQ(table->size(), 2);
+
+  ChunkStore chunk_store;
+  auto restored = MakeUniformTable("dist", {}, /*max_size=*/2);
+  REVERB_EXPECT_OK(
+      WriteAheadLog::Replay(path, &chunk_store, restored.get()));
+  EXPECT_EQ(restored->size(), 2);
+}
+
+TEST(WriteAheadLogTest, ReplayOfMissingLogIsANoOp) {
+  ChunkStore chunk_store;
+  auto table = MakeUniformTable("dist");
+  REVERB_EXPECT_OK(
+      WriteAheadLog::Replay(LogPath(), &chunk_store, table.get()));
+  EXPECT_EQ(table->size(), 0);
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -32,15 +32,19 @@
 #include "absl/time/time.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
 #include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/status_matchers.h"
 #include "reverb/cc/platform/thread.h"
 #include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/schema.pb.h"
+#include "reverb/cc/selectors/clock.h"
 #include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/heap.h"
 #include "reverb/cc/selectors/uniform.h"
 #include "reverb/cc/support/task_executor.h"
 #include "reverb/cc/table_extensions/interface.h"
 #include "reverb/cc/testing/proto_test_util.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
 #include "tensorflow/core/framework/types.pb.h"
@@ -54,6 +58,7 @@ const absl::Duration kTimeout = absl::Milliseconds(250);
 const absl::Duration kLongTimeout = absl::Seconds(1);
 
 using ::deepmind::reverb::testing::Partially;
+using ::testing::Contains;
 using ::testing::ElementsAre;
 using ::testing::IsEmpty;
 using ::testing::SizeIs;
@@ -125,6 +130,71 @@ TEST(TableTest, CopyAfterInsert) {
       Partially(testing::EqualsProto("key: 3 times_sampled: 0 priority: 123")));
 }
 
+TEST(TableTest, ForkSharesChunksAndDetaches) {
+  auto table = MakeUniformTable("dist");
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(3, 123)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(4, 456)));
+
+  std::shared_ptr<Table> fork;
+  REVERB_ASSERT_OK(table->Fork("frozen", &fork));
+  EXPECT_EQ(fork->name(), "frozen");
+  EXPECT_EQ(fork->size(), 2);
+
+  // The fork holds its own copies of the items but references the same chunk
+  // objects as the source table.
+  internal::flat_hash_map<uint64_t, ChunkStore::Chunk*> source_chunks;
+  for (const auto& item : table->Copy()) {
+    source_chunks[item.item.key()] = item.chunks[0].get();
+  }
+  for (const auto& item : fork->Copy()) {
+    EXPECT_EQ(item.chunks[0].get(), source_chunks[item.item.key()]);
+  }
+
+  // After the fork the two tables are completely independent.
+  REVERB_EXPECT_OK(table->MutateItems({}, {3}));
+  EXPECT_EQ(table->size(), 1);
+  EXPECT_EQ(fork->size(), 2);
+  EXPECT_THAT(fork->Copy(), Contains(HasItemKey(3)));
+}
+
+TEST(TableTest, ClockRemoverGivesSampledItemsASecondChance) {
+  auto table = MakeTable("dist", std::make_shared<UniformSelector>(),
+                         std::make_shared<ClockSelector>(), /*max_size=*/2,
+                         /*max_times_sampled=*/0, MakeLimiter(1));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 123)));
+
+  // Sampling sets the item's reference bit in the remover.
+  Table::SampledItem sample;
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  EXPECT_THAT(sample, HasSampledItemKey(1));
+
+  // Filling the table past capacity sweeps past the sampled item and evicts
+  // the never sampled one instead, even though it is younger.
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 123)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(3, 123)));
+  EXPECT_THAT(table->Copy(), Contains(HasItemKey(1)));
+  EXPECT_THAT(table->Copy(), Contains(HasItemKey(3)));
+}
+
+TEST(TableTest, SampleWorksWithOverriddenMaxSampleResponseSize) {
+  auto table = MakeUniformTable("dist");
+  // A one byte threshold forces every sampled item into its own response.
+  table->SetMaxSampleResponseSizeBytes(1);
+  EXPECT_EQ(table->max_sample_response_size_bytes(), 1);
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(3, 123)));
+  Table::SampledItem sample;
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  EXPECT_THAT(sample, HasSampledItemKey(3));
+}
+
+TEST(TableTest, InsertCompletesOnDedicatedInsertCallbackExecutor) {
+  auto table = MakeUniformTable("dist");
+  table->SetInsertCallbackExecutor(
+      std::make_shared<TaskExecutor>(1, "insert_worker"));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(3, 123)));
+  EXPECT_THAT(table->Copy(), SizeIs(1));
+}
+
 TEST(TableTest, CopySubset) {
   auto table = MakeUniformTable("dist");
   REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(3, 123)));
@@ -294,6 +364,117 @@ TEST(TableTest, EnqueSampleRequestSetsRateLimitedIfBlocked) {
   EXPECT_FALSE(not_rate_limited_item.rate_limited);
 }
 
+TEST(TableTest, EnqueSampleRequestFlushesPartiallyAdmittedBatch) {
+  // Sampling is admitted at one sample per thousand inserts so a request for
+  // a full batch only trickles in. While the test keeps the worker busy with
+  // inserts, the partially admitted batch should still be flushed once it has
+  // aged past `Table::kMaxPartialSampleBatchAge` instead of being held back
+  // until the remaining samples are admitted.
+  auto table = MakeTable("dist", std::make_shared<UniformSelector>(),
+                         std::make_shared<FifoSelector>(),
+                         /*max_size=*/1000,
+                         /*max_times_sampled=*/0,
+                         std::make_shared<RateLimiter>(
+                             /*samples_per_insert=*/0.001,
+                             /*min_size_to_sample=*/1,
+                             /*min_diff=*/0,
+                             /*max_diff=*/DBL_MAX));
+
+  absl::Notification done;
+  std::atomic<int> num_samples(-1);
+  auto callback =
+      std::make_shared<Table::SamplingCallback>([&](Table::SampleRequest* req) {
+        REVERB_EXPECT_OK(req->status);
+        num_samples = req->samples.size();
+        done.Notify();
+      });
+  table->EnqueSampleRequest(100, callback, kLongTimeout);
+
+  auto insert_callback =
+      std::make_shared<Table::InsertCallback>([](uint64_t) {});
+  for (uint64_t key = 1; !done.HasBeenNotified() && key < 200000; key++) {
+    bool can_insert_more;
+    REVERB_ASSERT_OK(table->InsertOrAssignAsync(
+        MakeItem(key, 1), &can_insert_more, insert_callback));
+    if (!can_insert_more) {
+      absl::SleepFor(absl::Milliseconds(1));
+    }
+  }
+
+  ASSERT_TRUE(done.WaitForNotificationWithTimeout(kLongTimeout));
+  EXPECT_GT(num_samples, 0);
+  EXPECT_LT(num_samples, 100);
+}
+
+TEST(TableTest, InsertOrAssignBatchInsertsAllItems) {
+  auto table = MakeUniformTable("dist");
+
+  std::atomic<int> completed(0);
+  auto callback =
+      std::make_shared<Table::InsertCallback>([&](uint64_t) { completed++; });
+
+  std::vector<Table::Item> items;
+  for (int i = 0; i < 10; i++) {
+    items.push_back(MakeItem(i, 123));
+  }
+  bool can_insert_more;
+  REVERB_ASSERT_OK(
+      table->InsertOrAssignBatch(std::move(items), &can_insert_more, callback));
+  EXPECT_TRUE(can_insert_more);
+
+  // The callback must be invoked once per item in the batch.
+  while (completed < 10) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  EXPECT_EQ(table->size(), 10);
+}
+
+TEST(TableTest, LowAdmissionClassSeesBackpressureFirst) {
+  auto table = MakeUniformTable("dist");  // Backpressure threshold is 100.
+
+  auto callback =
+      std::make_shared<Table::InsertCallback>([](uint64_t) {});
+
+  // 60 pending inserts is below the regular backpressure threshold (100)
+  // but above the halved threshold of a class -1 writer (50).
+  std::vector<Table::Item> items;
+  for (int i = 0; i < 60; i++) {
+    items.push_back(MakeItem(i, 123));
+  }
+  bool can_insert_more;
+  REVERB_ASSERT_OK(table->InsertOrAssignBatch(std::move(items),
+                                              &can_insert_more, callback,
+                                              /*admission_class=*/-1));
+  EXPECT_FALSE(can_insert_more);
+
+  // A default class writer is still admitted at this queue depth.
+  std::vector<Table::Item> more_items;
+  for (int i = 60; i < 70; i++) {
+    more_items.push_back(MakeItem(i, 123));
+  }
+  REVERB_ASSERT_OK(table->InsertOrAssignBatch(std::move(more_items),
+                                              &can_insert_more, callback));
+  EXPECT_TRUE(can_insert_more);
+}
+
+TEST(TableTest, InsertOrAssignBatchRejectsInvalidItems) {
+  auto table = MakeUniformTable("dist");
+
+  std::vector<Table::Item> items;
+  items.push_back(MakeItem(1, 123));
+  // An item with an empty trajectory is invalid.
+  items.emplace_back();
+
+  bool can_insert_more;
+  auto status = table->InsertOrAssignBatch(
+      std::move(items), &can_insert_more,
+      std::make_shared<Table::InsertCallback>([](uint64_t) {}));
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+
+  // Nothing from the batch may have been enqueued.
+  EXPECT_EQ(table->size(), 0);
+}
+
 TEST(TableTest, InsertDeletesWhenOverflowing) {
   auto table = MakeUniformTable("dist", 10);
 
@@ -308,6 +489,75 @@ TEST(TableTest, InsertDeletesWhenOverflowing) {
   }
 }
 
+TEST(TableTest, MarginalBytesEvictionRemovesItemThatFreesMemory) {
+  auto table = MakeTable(
+      "dist", std::make_shared<UniformSelector>(),
+      std::make_shared<HeapSelector>(/*min_heap=*/false),
+      /*max_size=*/2,
+      /*max_times_sampled=*/0, MakeLimiter(1));
+  table->EnableMarginalBytesEviction();
+
+  // Two items sharing a single chunk; evicting either of them would free
+  // nothing as long as the other remains.
+  const auto shared_data =
+      testing::MakeChunkData(1001, testing::MakeSequenceRange(100, 0, 1));
+  auto shared_chunk = std::make_shared<ChunkStore::Chunk>(shared_data);
+  for (uint64_t key : {1, 2}) {
+    TableItem item;
+    item.chunks = {shared_chunk};
+    item.item = testing::MakePrioritizedItem(key, 123, {shared_data});
+    REVERB_EXPECT_OK(table->InsertOrAssign(std::move(item)));
+  }
+
+  // A third item with an exclusive chunk overflows the table. It frees more
+  // memory than either of the sharing items so it is the one evicted, even
+  // though it is the newest.
+  const auto own_data =
+      testing::MakeChunkData(2001, testing::MakeSequenceRange(200, 0, 1));
+  TableItem third;
+  third.chunks = {std::make_shared<ChunkStore::Chunk>(own_data)};
+  third.item = testing::MakePrioritizedItem(3, 123, {own_data});
+  REVERB_EXPECT_OK(table->InsertOrAssign(std::move(third)));
+
+  auto items = table->Copy();
+  EXPECT_THAT(items, SizeIs(2));
+  EXPECT_THAT(items, Contains(HasItemKey(1)));
+  EXPECT_THAT(items, Contains(HasItemKey(2)));
+}
+
+TEST(TableTest, UncompressedChunkCacheDecompressesOnInsert) {
+  auto table = MakeUniformTable("dist");
+  table->EnableUncompressedChunkCache(/*max_cached_bytes=*/10 << 20,
+                                      /*decompress_on_insert=*/true);
+
+  auto item = MakeItem(1, 123);
+  std::shared_ptr<ChunkStore::Chunk> chunk = item.chunks.front();
+  REVERB_EXPECT_OK(table->InsertOrAssign(std::move(item)));
+
+  // The chunk was decompressed as part of the insert so its columns can be
+  // served straight from the cache.
+  EXPECT_TRUE(chunk->unpacked_cached());
+  tensorflow::Tensor column;
+  ASSERT_TRUE(chunk->GetCachedColumn(0, &column));
+  EXPECT_EQ(column.dim_size(0), chunk->num_rows());
+}
+
+TEST(TableTest, EvictedItemsAreReclaimedInBackground) {
+  auto table = MakeUniformTable("dist", /*max_size=*/1);
+
+  auto first = MakeItem(1, 123);
+  std::weak_ptr<ChunkStore::Chunk> chunk = first.chunks.front();
+  REVERB_EXPECT_OK(table->InsertOrAssign(std::move(first)));
+
+  // Inserting a second item evicts the first; its carcass is handed to the
+  // reclamation executor which drops the chunk reference shortly after.
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 123)));
+  for (int retry = 0; retry < 1000 && chunk.lock() != nullptr; retry++) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  EXPECT_EQ(chunk.lock(), nullptr);
+}
+
 TEST(TableTest, ConcurrentCalls) {
   auto table = MakeUniformTable("dist", 1000);
 
@@ -500,6 +750,36 @@ TEST(TableTest, ResetClearsAllData) {
   EXPECT_EQ(table->size(), 0);
 }
 
+TEST(TableTest, ExpiresItemsOlderThanMaxItemAge) {
+  auto table = MakeUniformTable("dist");
+  table->EnableItemExpiration(absl::Milliseconds(50));
+
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 123)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 456)));
+  EXPECT_EQ(table->size(), 2);
+
+  // The items expire without any sample or insert touching the table.
+  const absl::Time deadline = absl::Now() + absl::Seconds(10);
+  while (table->size() != 0 && absl::Now() < deadline) {
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+  EXPECT_EQ(table->size(), 0);
+}
+
+TEST(TableTest, ItemsDeletedBeforeExpiryAreIgnoredByExpiration) {
+  auto table = MakeUniformTable("dist");
+  table->EnableItemExpiration(absl::Milliseconds(50));
+
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 123)));
+  REVERB_EXPECT_OK(table->MutateItems({}, {1}));
+  EXPECT_EQ(table->size(), 0);
+
+  // Entries of the already deleted item are simply skipped when they expire.
+  absl::SleepFor(absl::Milliseconds(100));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 456)));
+  EXPECT_EQ(table->size(), 1);
+}
+
 TEST(TableTest, ResetWhileConcurrentCalls) {
   auto table = MakeUniformTable("dist");
   std::vector<std::unique_ptr<internal::Thread>> bundle;
@@ -592,6 +872,75 @@ TEST(TableTest, CheckpointSanityCheck) {
               )pb")));
 }
 
+TEST(TableTest, CheckpointCollectsChunksOfAllItems) {
+  auto table = MakeUniformTable("dist");
+
+  // Two items with one chunk each plus one item sharing chunks with multiple
+  // sequences.
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 123)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 124)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(
+      MakeItem(3, 125,
+               {testing::MakeSequenceRange(300, 0, 1),
+                testing::MakeSequenceRange(301, 0, 1)})));
+
+  auto checkpoint = table->Checkpoint();
+  EXPECT_EQ(checkpoint.checkpoint.items_size(), 3);
+  EXPECT_THAT(checkpoint.chunks, SizeIs(4));
+
+  // Deleting an item drops its chunks from subsequent checkpoints.
+  REVERB_EXPECT_OK(table->MutateItems({}, {3}));
+  EXPECT_THAT(table->Checkpoint().chunks, SizeIs(2));
+}
+
+TEST(TableTest, CheckpointInsertedItemsAreByteAccounted) {
+  auto table = MakeUniformTable("dist");
+
+  REVERB_EXPECT_OK(table->InsertCheckpointItem(MakeItem(1, 123)));
+  EXPECT_GT(table->size_bytes(), 0);
+  EXPECT_THAT(table->Checkpoint().chunks, SizeIs(1));
+
+  // Restored items can be deleted like regular inserts and release their
+  // bytes.
+  REVERB_EXPECT_OK(table->MutateItems({}, {1}));
+  EXPECT_EQ(table->size_bytes(), 0);
+}
+
+TEST(TableTest, CheckpointConcurrentWithMutations) {
+  auto table = MakeUniformTable("dist", 1000);
+  for (int i = 0; i < 100; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, i)));
+  }
+
+  // Checkpoints freeze a copy-on-write snapshot and serialize it outside the
+  // table lock so priority updates and samples proceed while checkpoints of
+  // the frozen view are taken.
+  absl::Notification stop;
+  auto checkpoint_thread = internal::StartThread("", [&] {
+    while (!stop.HasBeenNotified()) {
+      auto checkpoint = table->Checkpoint();
+      EXPECT_EQ(checkpoint.checkpoint.items_size(), 100);
+    }
+  });
+  for (int round = 0; round < 100; round++) {
+    std::vector<KeyWithPriority> updates;
+    for (int i = 0; i < 100; i++) {
+      updates.push_back(testing::MakeKeyWithPriority(i, round));
+    }
+    REVERB_EXPECT_OK(table->MutateItems(updates, {}));
+    Table::SampledItem item;
+    REVERB_EXPECT_OK(table->Sample(&item));
+  }
+  stop.Notify();
+  checkpoint_thread = nullptr;  // Joins the thread.
+
+  auto checkpoint = table->Checkpoint();
+  EXPECT_EQ(checkpoint.checkpoint.items_size(), 100);
+  for (const auto& item : checkpoint.checkpoint.items()) {
+    EXPECT_EQ(item.priority(), 99);
+  }
+}
+
 TEST(TableTest, BlocksSamplesWhenSizeToSmallDueToAutoDelete) {
   auto table = MakeTable(
       /*name=*/"dist",
@@ -799,6 +1148,90 @@ TEST(TableTest, NumDeletedEpisodes) {
   EXPECT_EQ(table->num_deleted_episodes(), 0);
 }
 
+TEST(TableTest, EnforcesMaxSizeBytes) {
+  // Probe the per item chunk size with an unbounded table.
+  auto probe = MakeUniformTable("probe");
+  REVERB_EXPECT_OK(probe->InsertOrAssign(MakeItem(1, 1)));
+  const int64_t item_bytes = probe->size_bytes();
+  EXPECT_GT(item_bytes, 0);
+
+  auto table = MakeTable(
+      "bytes", std::make_shared<UniformSelector>(),
+      std::make_shared<FifoSelector>(), /*max_size=*/1000,
+      /*max_times_sampled=*/0, MakeLimiter(1),
+      std::vector<std::shared_ptr<TableExtension>>{},
+      absl::optional<tensorflow::StructuredValue>(),
+      /*max_size_bytes=*/5 * item_bytes);
+
+  for (uint64_t key = 1; key <= 100; key++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+    EXPECT_LE(table->size_bytes(), 5 * item_bytes);
+  }
+  EXPECT_EQ(table->size(), 5);
+
+  // Deleting items releases their bytes.
+  auto items = table->Copy();
+  std::vector<Table::Key> deletes;
+  for (const auto& item : items) deletes.push_back(item.item.key());
+  REVERB_EXPECT_OK(table->MutateItems({}, deletes));
+  EXPECT_EQ(table->size_bytes(), 0);
+}
+
+TEST(TableTest, MutateItemsAppliesLargeBatchesInSlices) {
+  // Exceeds the per-lock-hold slice bound of `MutateItems`, so the batch is
+  // applied across several lock holds.
+  const int kItems = 5000;
+
+  auto table = MakeUniformTable("dist", /*max_size=*/2 * kItems);
+  std::vector<KeyWithPriority> updates;
+  std::vector<Table::Key> deletes;
+  for (uint64_t key = 1; key <= kItems; key++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+    updates.push_back(testing::MakeKeyWithPriority(key, 2));
+    if (key <= kItems - 100) deletes.push_back(key);
+  }
+  REVERB_EXPECT_OK(table->MutateItems(updates, deletes));
+  EXPECT_EQ(table->size(), 100);
+}
+
+TEST(TableTest, SampleFromSnapshotMatchesTableContent) {
+  auto table = MakeUniformTable("dist");
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 1)));
+
+  // Snapshots must be explicitly enabled.
+  Table::SampledItem sample;
+  EXPECT_EQ(table->SampleFromSnapshot(&sample).code(),
+            absl::StatusCode::kFailedPrecondition);
+
+  table->EnableSamplingSnapshots(100);
+  for (int i = 0; i < 100; i++) {
+    REVERB_EXPECT_OK(table->SampleFromSnapshot(&sample));
+    EXPECT_NEAR(sample.probability, 0.5, 1e-9);
+    EXPECT_GE(sample.ref->item.key(), 1);
+    EXPECT_LE(sample.ref->item.key(), 2);
+  }
+}
+
+TEST(TableTest, SampleFromSnapshotRetriesDeletedItems) {
+  auto table = MakeUniformTable("dist");
+  table->EnableSamplingSnapshots(1000);
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 1)));
+
+  // Publish a snapshot containing both items.
+  Table::SampledItem sample;
+  REVERB_EXPECT_OK(table->SampleFromSnapshot(&sample));
+
+  // Delete item 1. The snapshot is stale (staleness bound not reached) but
+  // draws of the deleted key must be discarded and retried.
+  REVERB_EXPECT_OK(table->MutateItems({}, {1}));
+  for (int i = 0; i < 50; i++) {
+    REVERB_EXPECT_OK(table->SampleFromSnapshot(&sample));
+    EXPECT_THAT(sample, HasSampledItemKey(2));
+  }
+}
+
 TEST(TableDeathTest, SetNumDeletedEpisodesFromCheckpointOnNonEmptyTable) {
   ::testing::GTEST_FLAG(death_test_style) = "threadsafe";
   auto table = MakeUniformTable("dist");
@@ -856,6 +1289,7 @@ TEST(TableTest, Info) {
                   sample_stats {
                     completed: 1
                   }
+                  adaptive_timeout_ms: -1
                 }
                 current_size: 1
                 num_episodes: 1
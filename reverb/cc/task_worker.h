@@ -15,13 +15,18 @@
 #ifndef REVERB_CC_TASK_WORKER_H_
 #define REVERB_CC_TASK_WORKER_H_
 
+#include <algorithm>
+#include <deque>
 #include <string>
+#include <vector>
 
 #include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/platform/thread.h"
+#include "reverb/cc/support/mpsc_queue.h"
 #include "reverb/cc/support/periodic_closure.h"
 #include "reverb/cc/support/unbounded_queue.h"
 #include "reverb/cc/table.h"
@@ -45,6 +50,14 @@ struct SampleTaskInfo {
   int32_t fetched_samples;  // Number of samples fetched before this task.
   int32_t requested_samples;  // Number of total samples requested.
   int32_t last_batch_size;  // # of items retrieved in the previous response.
+  int32_t subsequence_length;  // Timesteps per returned window; 0 when the
+                               // full trajectory of each item is returned.
+  std::vector<int> columns;  // Trajectory columns to return; empty when all
+                             // columns of each item are returned.
+  int32_t nstep_num_steps;   // Steps folded into each N-step transition; 0
+                             // when items are returned as stored.
+  int32_t nstep_reward_column;  // Column holding the scalar per step rewards.
+  double nstep_discount;        // Per step discount of the accumulated reward.
   std::string DebugString() const {
     return absl::StrFormat(
         "SampleTask{table: %s, requested_samples: %d, samples_fetched_so_far: "
@@ -68,8 +81,11 @@ typedef std::function<void(SampleTaskInfo task_info, const absl::Status&,
 // Class that implements a thread pool that executes tasks from a queue. It is
 // thread-safe.
 // In addition to the worker threads dedicated to run the tasks, a periodic
-// closure checks for potential deadlocks and warns if the queue has been
-// blocked for more than 1 minute.
+// monitor closure samples the thread states. It warns if the queue has been
+// blocked for more than 1 minute (a likely deadlock), maintains per-worker
+// utilization statistics (see `GetUtilizationStats`) and, when a thread limit
+// above `num_threads` is configured, grows and shrinks the number of active
+// workers based on sustained saturation or idleness.
 // * TaskInfo is a class containing task information, as well as a method
 //   `string DebugString() const` that returns a string with information about
 //   the task (used for debugging and logging).
@@ -77,17 +93,44 @@ typedef std::function<void(SampleTaskInfo task_info, const absl::Status&,
 //   `void task_callback(TaskInfo task_info, const absl::Status&,
 //                           bool enough_queue_slots)`
 //   This function will be called with the threads of the worker.
-template <class TaskInfo, class TaskCallback>
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT = internal::UnboundedQueue>
 class TaskWorker {
  public:
+  // Snapshot of the utilization of the worker produced by the periodic
+  // monitor.
+  struct UtilizationStats {
+    // Number of worker threads currently allowed to pick up tasks. Always
+    // within [num_threads, max_threads] (see the constructor).
+    size_t target_num_threads = 0;
+    // Fraction of the last monitor period that each thread spent executing
+    // task callbacks (including the currently running task). Empty until the
+    // monitor has run for the first time.
+    std::vector<double> busy_fractions;
+    // For how long the task currently executed by each thread has been
+    // running. Zero for threads that are waiting for a task.
+    std::vector<absl::Duration> current_task_ages;
+    // Queue depths sampled once per monitor period, oldest first. Capped at
+    // `kQueueDepthHistoryLength` entries.
+    std::vector<size_t> queue_depth_history;
+  };
+
   // Constructs an TaskWorker.
   // num_threads: number of threads that will run tasks.
   // max_queue_size_to_warn: used to indicate that the queue is growing and
   //   we should stop inserting new tasks to avoid OOMs. If the value is
   //   negative it will be ignored.
   // thread_name_prefix: is used as a prefix for the name of the threads.
+  // max_threads: when greater than `num_threads`, the monitor is allowed to
+  //   scale the number of active workers between `num_threads` and
+  //   `max_threads` based on sustained saturation or idleness. The default (0)
+  //   keeps the worker count fixed at `num_threads`.
+  // thread_options: scheduling attributes (CPU affinity, priority) applied to
+  //   every worker thread. Defaults to inheriting everything.
   TaskWorker(size_t num_threads, size_t max_queue_size_to_warn,
-             const std::string& thread_name_prefix);
+             const std::string& thread_name_prefix, size_t max_threads = 0,
+             const internal::ThreadOptions& thread_options =
+                 internal::ThreadOptions());
 
   ~TaskWorker();
 
@@ -107,9 +150,34 @@ class TaskWorker {
   // of the vector corresponds to one worker thread).
   std::vector<ThreadStats> GetThreadStats() const;
 
-  static constexpr auto kDeadlockCheckerPeriod = absl::Seconds(20);
+  // Returns a snapshot of the utilization statistics maintained by the
+  // periodic monitor. `busy_fractions` and `queue_depth_history` are empty
+  // until the monitor has run for the first time (see `kMonitorPeriod`).
+  UtilizationStats GetUtilizationStats() const;
+
+  static constexpr auto kMonitorPeriod = absl::Seconds(20);
   static constexpr auto kDeadlockCheckerTimeToWarn = absl::Minutes(1);
 
+  // Number of queue depth samples kept by the monitor (about 20 minutes of
+  // history with `kMonitorPeriod`).
+  static constexpr size_t kQueueDepthHistoryLength = 64;
+
+  // A worker is considered saturated during a monitor period when every
+  // active thread spent at least `kScaleUpBusyFraction` of the period running
+  // tasks while the queue was non-empty, and idle when the mean busy fraction
+  // is below `kScaleDownBusyFraction`. The active thread count is adjusted
+  // after `kScalingPatience` consecutive saturated (resp. idle) periods.
+  static constexpr double kScaleUpBusyFraction = 0.95;
+  static constexpr double kScaleDownBusyFraction = 0.25;
+  static constexpr int kScalingPatience = 3;
+
+  // Queue depth, as a fraction of `max_queue_size_to_warn`, above which the
+  // monitor grows the pool on every period instead of waiting for
+  // `kScalingPatience` saturated periods. Bursty producers (e.g. synchronized
+  // episode ends across many actors) fill the queue much faster than the
+  // saturation patience reacts. Ignored when `max_queue_size_to_warn` is 0.
+  static constexpr double kScaleUpQueueFraction = 0.5;
+
  private:
   struct Task {
     TaskCallback callback;
@@ -123,21 +191,29 @@ class TaskWorker {
     std::unique_ptr<absl::Mutex> mu = absl::make_unique<absl::Mutex>();
   };
 
-  void RunWorker(std::shared_ptr<ThreadStatsMutex> thread_stats);
+  void RunWorker(std::shared_ptr<ThreadStatsMutex> thread_stats,
+                 size_t thread_index);
 
   // Returns true if the number of elements in the queue is <
   // max_queue_size_to_warn_.
   bool QueueIsNotAlmostFull() const;
 
-  // The DeadlockChecker runs periodically to check the state of the
-  // TaskWorker threads. It gets the current stats, checks them, and logs if a
-  // situation of deadlock is likely to be happening: if all threads have been
-  // blocked by the rate limiter for at least kDeadlockCheckerTimeToWarn.
-  void RunDeadlockChecker();
+  // The monitor runs periodically to check the state of the TaskWorker
+  // threads. It updates the utilization statistics, adjusts the number of
+  // active workers when scaling is enabled, and logs if a situation of
+  // deadlock is likely to be happening: if all threads have been blocked by
+  // the rate limiter for at least kDeadlockCheckerTimeToWarn.
+  void RunMonitor();
+
+  // Grows or shrinks `target_num_threads_` based on the busy fractions
+  // computed by the monitor. Threads above the target park between tasks
+  // until the target is raised again, so no threads are created or destroyed
+  // after construction.
+  void MaybeScaleActiveThreads() ABSL_EXCLUSIVE_LOCKS_REQUIRED(monitor_mu_);
 
-  internal::PeriodicClosure deadlock_checker_;
+  internal::PeriodicClosure monitor_;
 
-  internal::UnboundedQueue<Task> queue_;
+  QueueT<Task> queue_;
   std::vector<std::unique_ptr<internal::Thread>> threads_;
 
   // When picking up a task, if it has been more than this time in the queue,
@@ -145,60 +221,109 @@ class TaskWorker {
   static constexpr auto kQueueTimeToWarn = absl::Seconds(10);
   std::vector<std::shared_ptr<ThreadStatsMutex>> thread_stats_;
   size_t max_queue_size_to_warn_;
+
+  // Bounds between which the monitor may move `target_num_threads_`. Equal
+  // when scaling is disabled.
+  size_t min_num_threads_;
+  size_t max_num_threads_;
+
+  // Number of threads allowed to pick up tasks. Threads with an index >=
+  // `target_num_threads_` park between tasks until the target is raised.
+  mutable absl::Mutex scaling_mu_;
+  size_t target_num_threads_ ABSL_GUARDED_BY(scaling_mu_);
+  bool closing_ ABSL_GUARDED_BY(scaling_mu_) = false;
+
+  // State maintained by the periodic monitor.
+  mutable absl::Mutex monitor_mu_;
+  absl::Time last_monitor_run_ ABSL_GUARDED_BY(monitor_mu_);
+  // Cumulative busy time of each thread (including the in-flight task) as of
+  // the previous monitor run; used to compute per-period busy fractions.
+  std::vector<absl::Duration> last_busy_durations_ ABSL_GUARDED_BY(monitor_mu_);
+  std::vector<double> busy_fractions_ ABSL_GUARDED_BY(monitor_mu_);
+  std::deque<size_t> queue_depth_history_ ABSL_GUARDED_BY(monitor_mu_);
+  int saturated_periods_ ABSL_GUARDED_BY(monitor_mu_) = 0;
+  int idle_periods_ ABSL_GUARDED_BY(monitor_mu_) = 0;
 };
 
-typedef TaskWorker<InsertTaskInfo, InsertCallback> InsertWorker;
+// The insert flow has many gRPC producer threads and a single worker
+// consuming, so it uses the producer-side lock-free MPSC queue.
+typedef TaskWorker<InsertTaskInfo, InsertCallback, internal::MpscUnboundedQueue>
+    InsertWorker;
+// Insert worker whose active thread count may be scaled by the monitor (pass
+// `max_threads` > `num_threads`). Multiple consumers rule out the MPSC queue,
+// so it trades the lock-free pops of `InsertWorker` for elasticity under
+// bursty ingestion.
+typedef TaskWorker<InsertTaskInfo, InsertCallback> ScalingInsertWorker;
 typedef TaskWorker<SampleTaskInfo, SampleCallback> SampleWorker;
 /*****************************************************************************
  * Implementation of the template                                            *
  *****************************************************************************/
 
 // Definition of the static constexpr for the linker.
-template <class TaskInfo, class TaskCallback> constexpr absl::Duration
-TaskWorker<TaskInfo, TaskCallback>::kDeadlockCheckerPeriod;
-template <class TaskInfo, class TaskCallback> constexpr absl::Duration
-TaskWorker<TaskInfo, TaskCallback>::kDeadlockCheckerTimeToWarn;
-
-template <class TaskInfo, class TaskCallback>
-TaskWorker<TaskInfo, TaskCallback>::TaskWorker(
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT> constexpr absl::Duration
+TaskWorker<TaskInfo, TaskCallback, QueueT>::kMonitorPeriod;
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT> constexpr absl::Duration
+TaskWorker<TaskInfo, TaskCallback, QueueT>::kDeadlockCheckerTimeToWarn;
+
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+TaskWorker<TaskInfo, TaskCallback, QueueT>::TaskWorker(
     size_t num_threads, size_t max_queue_size_to_warn,
-    const std::string& thread_name_prefix)
-    : deadlock_checker_([this] { RunDeadlockChecker(); },
-                        kDeadlockCheckerPeriod),
+    const std::string& thread_name_prefix, size_t max_threads,
+    const internal::ThreadOptions& thread_options)
+    : monitor_([this] { RunMonitor(); }, kMonitorPeriod),
       queue_(),
-      max_queue_size_to_warn_(max_queue_size_to_warn) {
-  for (int thread_index = 0; thread_index < num_threads; thread_index++) {
+      max_queue_size_to_warn_(max_queue_size_to_warn),
+      min_num_threads_(num_threads),
+      max_num_threads_(std::max(num_threads, max_threads)),
+      target_num_threads_(num_threads),
+      last_monitor_run_(absl::Now()) {
+  REVERB_CHECK(max_num_threads_ <= 1 || !QueueT<Task>::kSingleConsumer)
+      << "A single consumer queue cannot serve multiple worker threads.";
+  // All threads are spawned upfront; the ones above `target_num_threads_`
+  // park until the monitor raises the target.
+  for (int thread_index = 0; thread_index < max_num_threads_; thread_index++) {
     auto stats = std::make_shared<ThreadStatsMutex>();
     thread_stats_.push_back(stats);
     threads_.push_back(internal::StartThread(
-        absl::StrCat(thread_name_prefix, "_", thread_index),
-        [this, stats] { RunWorker(stats); }));
+        absl::StrCat(thread_name_prefix, "_", thread_index), thread_options,
+        [this, stats, thread_index] { RunWorker(stats, thread_index); }));
   }
-  REVERB_CHECK_OK(deadlock_checker_.Start());
+  REVERB_CHECK_OK(monitor_.Start());
 }
 
-template <class TaskInfo, class TaskCallback>
-TaskWorker<TaskInfo, TaskCallback>::~TaskWorker() {
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+TaskWorker<TaskInfo, TaskCallback, QueueT>::~TaskWorker() {
   Close();
 }
 
-template <class TaskInfo, class TaskCallback>
-bool TaskWorker<TaskInfo, TaskCallback>::Schedule(TaskInfo task_info,
-                                                  TaskCallback task_cb) {
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+bool TaskWorker<TaskInfo, TaskCallback, QueueT>::Schedule(
+    TaskInfo task_info, TaskCallback task_cb) {
   queue_.Push({.callback = task_cb,
                .task_info = std::move(task_info),
                .created_at = absl::Now()});
   return QueueIsNotAlmostFull();
 }
 
-template <class TaskInfo, class TaskCallback>
-void TaskWorker<TaskInfo, TaskCallback>::Close() {
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+void TaskWorker<TaskInfo, TaskCallback, QueueT>::Close() {
   Task task;
+  {
+    // Unpark threads above the target so they can observe the closed queue.
+    absl::MutexLock lock(&scaling_mu_);
+    closing_ = true;
+  }
   // Before closing, we cancel all the pending tasks.
   queue_.SetLastItemPushed();
-  auto status = deadlock_checker_.Stop();
+  auto status = monitor_.Stop();
   REVERB_LOG_IF(REVERB_ERROR, !status.ok())
-      << "Error when stopping the Deadlock Checker: " << status.ToString();
+      << "Error when stopping the worker monitor: " << status.ToString();
   while (queue_.Pop(&task)) {
     task.callback(std::move(task.task_info),
                   absl::CancelledError("Task queue is closed."),
@@ -207,11 +332,26 @@ void TaskWorker<TaskInfo, TaskCallback>::Close() {
   threads_.clear();  // Joins worker threads.
 }
 
-template <class TaskInfo, class TaskCallback>
-void TaskWorker<TaskInfo, TaskCallback>::RunWorker(
-    std::shared_ptr<ThreadStatsMutex> thread_stats) {
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+void TaskWorker<TaskInfo, TaskCallback, QueueT>::RunWorker(
+    std::shared_ptr<ThreadStatsMutex> thread_stats, size_t thread_index) {
   Task task;
-  while (queue_.Pop(&task)) {
+  while (true) {
+    {
+      // Threads above the scaling target park here until the monitor raises
+      // the target again (or the worker is closed).
+      absl::MutexLock lock(&scaling_mu_);
+      const auto active = [this, thread_index]()
+                              ABSL_EXCLUSIVE_LOCKS_REQUIRED(scaling_mu_) {
+                                return thread_index < target_num_threads_ ||
+                                       closing_;
+                              };
+      scaling_mu_.Await(absl::Condition(&active));
+    }
+    if (!queue_.Pop(&task)) {
+      break;
+    }
     if (auto time_in_queue = absl::Now() - task.created_at;
         time_in_queue >= kQueueTimeToWarn) {
       REVERB_LOG(REVERB_WARNING)
@@ -221,10 +361,11 @@ void TaskWorker<TaskInfo, TaskCallback>::RunWorker(
              "It could indicate that the tasks are blocked on the rate "
              "limiter.";
     }
+    const absl::Time started_at = absl::Now();
     {
       absl::MutexLock lock(thread_stats->mu.get());
       thread_stats->stats.current_task_id++;
-      thread_stats->stats.current_task_started_at = absl::Now();
+      thread_stats->stats.current_task_started_at = started_at;
       thread_stats->stats.current_task_created_at = task.created_at;
       thread_stats->stats.current_task_info = task.task_info.DebugString();
     }
@@ -234,21 +375,24 @@ void TaskWorker<TaskInfo, TaskCallback>::RunWorker(
     {
       absl::MutexLock lock(thread_stats->mu.get());
       thread_stats->stats.num_tasks_processed++;
+      thread_stats->stats.busy_duration += absl::Now() - started_at;
     }
   }
 }
 
-template <class TaskInfo, class TaskCallback>
-bool TaskWorker<TaskInfo, TaskCallback>::QueueIsNotAlmostFull() const {
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+bool TaskWorker<TaskInfo, TaskCallback, QueueT>::QueueIsNotAlmostFull() const {
   if (max_queue_size_to_warn_ < 0) {
     return true;
   }
   return queue_.size() <= max_queue_size_to_warn_;
 }
 
-template <class TaskInfo, class TaskCallback>
-std::vector<ThreadStats> TaskWorker<TaskInfo, TaskCallback>::GetThreadStats()
-    const {
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+std::vector<ThreadStats>
+TaskWorker<TaskInfo, TaskCallback, QueueT>::GetThreadStats() const {
   std::vector<ThreadStats> stats(thread_stats_.size());
   for (int i = 0; i < thread_stats_.size(); i++) {
     absl::MutexLock lock(thread_stats_[i]->mu.get());
@@ -257,14 +401,73 @@ std::vector<ThreadStats> TaskWorker<TaskInfo, TaskCallback>::GetThreadStats()
   return stats;
 }
 
-template <class TaskInfo, class TaskCallback>
-void TaskWorker<TaskInfo, TaskCallback>::RunDeadlockChecker() {
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+typename TaskWorker<TaskInfo, TaskCallback, QueueT>::UtilizationStats
+TaskWorker<TaskInfo, TaskCallback, QueueT>::GetUtilizationStats() const {
+  UtilizationStats utilization;
+  {
+    absl::MutexLock lock(&scaling_mu_);
+    utilization.target_num_threads = target_num_threads_;
+  }
+  {
+    absl::MutexLock lock(&monitor_mu_);
+    utilization.busy_fractions = busy_fractions_;
+    utilization.queue_depth_history.assign(queue_depth_history_.begin(),
+                                           queue_depth_history_.end());
+  }
+  const auto stats = GetThreadStats();
+  const absl::Time now = absl::Now();
+  utilization.current_task_ages.reserve(stats.size());
+  for (const auto& thread : stats) {
+    const bool busy = thread.current_task_id >= thread.num_tasks_processed &&
+                      thread.current_task_id != -1;
+    utilization.current_task_ages.push_back(
+        busy ? now - thread.current_task_started_at : absl::ZeroDuration());
+  }
+  return utilization;
+}
+
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+void TaskWorker<TaskInfo, TaskCallback, QueueT>::RunMonitor() {
+  // TODO(b/178566313) add unit tests for the deadlock checker.
+  auto stats = GetThreadStats();
+  const absl::Time now = absl::Now();
+  {
+    absl::MutexLock lock(&monitor_mu_);
+    const absl::Duration period = now - last_monitor_run_;
+    last_monitor_run_ = now;
+    last_busy_durations_.resize(stats.size());
+    busy_fractions_.resize(stats.size());
+    for (int i = 0; i < stats.size(); i++) {
+      // Include the in-flight task in the cumulative busy time; once the task
+      // completes its full duration is added to `busy_duration` and the
+      // in-flight contribution disappears, so the sum stays monotonic.
+      absl::Duration busy = stats[i].busy_duration;
+      if (stats[i].current_task_id >= stats[i].num_tasks_processed &&
+          stats[i].current_task_id != -1) {
+        busy += now - stats[i].current_task_started_at;
+      }
+      busy_fractions_[i] =
+          period > absl::ZeroDuration()
+              ? std::min(
+                    1.0, absl::FDivDuration(busy - last_busy_durations_[i],
+                                            period))
+              : 0.0;
+      last_busy_durations_[i] = busy;
+    }
+    queue_depth_history_.push_back(queue_.size());
+    if (queue_depth_history_.size() > kQueueDepthHistoryLength) {
+      queue_depth_history_.pop_front();
+    }
+    MaybeScaleActiveThreads();
+  }
+
   // The deadlock situation happens when all tasks have been in process for a
   // long time, this may indicate that they are all blocked by a rate limiter.
   // To track this situation, we track when the last task started and
   // which thread is working on it.
-  // TODO(b/178566313) add unit tests for the deadlock checker.
-  auto stats = GetThreadStats();
   int last_thread_id = LastThreadId(stats);
   if (last_thread_id == -1) {
     // There is a thread waiting for a new task, so the server is not blocked.
@@ -282,6 +485,61 @@ void TaskWorker<TaskInfo, TaskCallback>::RunDeadlockChecker() {
   }
 }
 
+template <class TaskInfo, class TaskCallback,
+          template <typename> class QueueT>
+void TaskWorker<TaskInfo, TaskCallback,
+                QueueT>::MaybeScaleActiveThreads() {
+  if (max_num_threads_ <= min_num_threads_) {
+    return;
+  }
+  absl::MutexLock lock(&scaling_mu_);
+  // A deep queue is acted upon without patience; waiting `kScalingPatience`
+  // periods while the queue approaches `max_queue_size_to_warn_` would stall
+  // producers for no reason when there are parked threads available.
+  if (max_queue_size_to_warn_ > 0 &&
+      queue_.size() >= kScaleUpQueueFraction * max_queue_size_to_warn_ &&
+      target_num_threads_ < max_num_threads_) {
+    target_num_threads_++;
+    saturated_periods_ = 0;
+    idle_periods_ = 0;
+    REVERB_LOG(REVERB_INFO)
+        << "The task queue holds " << queue_.size()
+        << " tasks; growing the number of active workers to "
+        << target_num_threads_ << ".";
+    return;
+  }
+  // Only the threads below the target are eligible to run tasks, so only
+  // their busy fractions are meaningful.
+  double busy_sum = 0;
+  bool all_saturated = true;
+  for (int i = 0; i < target_num_threads_ && i < busy_fractions_.size(); i++) {
+    busy_sum += busy_fractions_[i];
+    all_saturated &= busy_fractions_[i] >= kScaleUpBusyFraction;
+  }
+  const bool saturated = all_saturated && queue_.size() > 0;
+  const bool idle =
+      busy_sum <= kScaleDownBusyFraction * target_num_threads_;
+  saturated_periods_ = saturated ? saturated_periods_ + 1 : 0;
+  idle_periods_ = idle ? idle_periods_ + 1 : 0;
+  if (saturated_periods_ >= kScalingPatience &&
+      target_num_threads_ < max_num_threads_) {
+    target_num_threads_++;
+    saturated_periods_ = 0;
+    REVERB_LOG(REVERB_INFO)
+        << "All active task workers have been saturated for the last "
+        << kScalingPatience << " monitor periods; growing the number of "
+        << "active workers to " << target_num_threads_ << ".";
+  } else if (idle_periods_ >= kScalingPatience &&
+             target_num_threads_ > min_num_threads_) {
+    target_num_threads_--;
+    idle_periods_ = 0;
+    REVERB_LOG(REVERB_INFO)
+        << "The task workers have been mostly idle for the last "
+        << kScalingPatience << " monitor periods; shrinking the number of "
+        << "active workers to " << target_num_threads_ << ".";
+  }
+}
+
 }  // namespace reverb
 }  // namespace deepmind
 
@@ -14,10 +14,21 @@
 
 #include "reverb/cc/tensor_compression.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
 
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/snappy.h"
+#ifdef REVERB_HAVE_ZSTD
+#include "zstd.h"  // NOLINT(build/include)
+#endif
+#ifdef REVERB_HAVE_LZ4
+#include "lz4.h"  // NOLINT(build/include)
+#endif
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.h"
@@ -27,6 +38,37 @@ namespace deepmind {
 namespace reverb {
 namespace {
 
+// The row-wise loops below run over contiguous buffers that do not alias, so
+// they compile to vectorized code (SSE/AVX/NEON, depending on the build) for
+// every integer width without hand written kernels. The decode dependency on
+// the previous row only spans rows, never elements within a row, so each row
+// still vectorizes.
+template <typename T>
+void DeltaEncodeRows(const T* src, T* dst, int64_t rows, int64_t cols) {
+  std::memcpy(dst, src, cols * sizeof(T));
+  for (int64_t i = 1; i < rows; i++) {
+    const T* cur = src + i * cols;
+    const T* prev = src + (i - 1) * cols;
+    T* out = dst + i * cols;
+    for (int64_t j = 0; j < cols; j++) {
+      out[j] = cur[j] - prev[j];
+    }
+  }
+}
+
+template <typename T>
+void DeltaDecodeRows(const T* src, T* dst, int64_t rows, int64_t cols) {
+  std::memcpy(dst, src, cols * sizeof(T));
+  for (int64_t i = 1; i < rows; i++) {
+    const T* cur = src + i * cols;
+    const T* prev_out = dst + (i - 1) * cols;
+    T* out = dst + i * cols;
+    for (int64_t j = 0; j < cols; j++) {
+      out[j] = cur[j] + prev_out[j];
+    }
+  }
+}
+
 template <typename T>
 tensorflow::Tensor DeltaEncode(const tensorflow::Tensor& tensor, bool encode) {
   tensorflow::Tensor output(tensor.dtype(), tensor.shape());
@@ -39,19 +81,234 @@ tensorflow::Tensor DeltaEncode(const tensorflow::Tensor& tensor, bool encode) {
   TF_CHECK_OK(output_reinterpret.BitcastFrom(
       output, tensorflow::DataTypeToEnum<T>::v(), output.shape()));
 
-  auto src = tensor_reinterpret.flat_outer_dims<T>();
-  auto dst = output_reinterpret.flat_outer_dims<T>();
-  for (int j = 0; j < src.dimension(1); j++) {
-    dst(0, j) = src(0, j);
+  const int64_t rows = tensor.dim_size(0);
+  const int64_t cols = rows == 0 ? 0 : tensor.NumElements() / rows;
+  const T* src = tensor_reinterpret.flat<T>().data();
+  T* dst = output_reinterpret.flat<T>().data();
+  if (rows == 0 || cols == 0) return output;
+
+  if (encode) {
+    DeltaEncodeRows(src, dst, rows, cols);
+  } else {
+    DeltaDecodeRows(src, dst, rows, cols);
+  }
+  return output;
+}
+
+// Casts a DT_FLOAT tensor to the (narrower) floating point type `T`.
+template <typename T>
+tensorflow::Tensor DowncastFloat(const tensorflow::Tensor& tensor) {
+  tensorflow::Tensor output(tensorflow::DataTypeToEnum<T>::v(), tensor.shape());
+  const float* src = tensor.flat<float>().data();
+  T* dst = output.flat<T>().data();
+  for (int64_t i = 0; i < tensor.NumElements(); i++) {
+    dst[i] = static_cast<T>(src[i]);
+  }
+  return output;
+}
+
+// Casts a tensor of the floating point type `T` back to DT_FLOAT.
+template <typename T>
+tensorflow::Tensor UpcastFloat(const tensorflow::Tensor& tensor) {
+  tensorflow::Tensor output(tensorflow::DT_FLOAT, tensor.shape());
+  const T* src = tensor.flat<T>().data();
+  float* dst = output.flat<float>().data();
+  for (int64_t i = 0; i < tensor.NumElements(); i++) {
+    dst[i] = static_cast<float>(src[i]);
   }
-  for (int i = 1; i < src.dimension(0); i++) {
-    for (int j = 0; j < src.dimension(1); j++) {
-      dst(i, j) = src(i, j) + (encode ? -src(i - 1, j) : dst(i - 1, j));
+  return output;
+}
+
+template <typename T>
+tensorflow::Tensor CrossChunkDelta(const tensorflow::Tensor& tensor,
+                                   const tensorflow::Tensor& baseline,
+                                   bool encode) {
+  tensorflow::Tensor output(tensor.dtype(), tensor.shape());
+
+  tensorflow::Tensor tensor_reinterpret;
+  TF_CHECK_OK(tensor_reinterpret.BitcastFrom(
+      tensor, tensorflow::DataTypeToEnum<T>::v(), tensor.shape()));
+  tensorflow::Tensor baseline_reinterpret;
+  TF_CHECK_OK(baseline_reinterpret.BitcastFrom(
+      baseline, tensorflow::DataTypeToEnum<T>::v(), baseline.shape()));
+  tensorflow::Tensor output_reinterpret;
+  TF_CHECK_OK(output_reinterpret.BitcastFrom(
+      output, tensorflow::DataTypeToEnum<T>::v(), output.shape()));
+
+  const int64_t rows = tensor.dim_size(0);
+  const int64_t cols = rows == 0 ? 0 : tensor.NumElements() / rows;
+  if (rows == 0 || cols == 0) return output;
+  REVERB_CHECK_EQ(baseline.NumElements(), cols);
+
+  const T* src = tensor_reinterpret.flat<T>().data();
+  const T* base = baseline_reinterpret.flat<T>().data();
+  T* dst = output_reinterpret.flat<T>().data();
+
+  if (encode) {
+    // Only the first (already delta encoded) row references the baseline.
+    for (int64_t j = 0; j < cols; j++) {
+      dst[j] = src[j] - base[j];
+    }
+    std::memcpy(dst + cols, src + cols, (rows - 1) * cols * sizeof(T));
+  } else {
+    // The first row seeds the intra-chunk prefix sums so after the regular
+    // delta decode every row is offset by the baseline.
+    for (int64_t i = 0; i < rows; i++) {
+      for (int64_t j = 0; j < cols; j++) {
+        dst[i * cols + j] = src[i * cols + j] + base[j];
+      }
     }
   }
   return output;
 }
 
+// Bit-packing applies to columns with at most this many distinct values; 8
+// bit codes are the widest that still shrink a multi-byte dtype.
+constexpr int kMaxBitPackDictionarySize = 256;
+
+// Code widths are restricted to divisors of 8 so codes never straddle byte
+// boundaries; see `ChunkData.BitPacking.bits`.
+int BitsForDictionarySize(size_t size) {
+  if (size <= 1) return 0;
+  if (size <= 2) return 1;
+  if (size <= 4) return 2;
+  if (size <= 16) return 4;
+  return 8;
+}
+
+template <typename T>
+bool BitPackTensorT(const tensorflow::Tensor& tensor,
+                    ChunkData::BitPacking* packing,
+                    tensorflow::Tensor* packed) {
+  const auto src = tensor.flat<T>();
+  const int64_t num_elements = tensor.NumElements();
+
+  std::set<T> distinct;
+  for (int64_t i = 0; i < num_elements; i++) {
+    distinct.insert(src(i));
+    if (distinct.size() > kMaxBitPackDictionarySize) return false;
+  }
+  const std::vector<T> dictionary(distinct.begin(), distinct.end());
+  const int bits = BitsForDictionarySize(dictionary.size());
+  // Packing a dtype into codes of its own width would not shrink anything.
+  if (bits >= 8 * static_cast<int>(sizeof(T))) return false;
+
+  packing->Clear();
+  packing->set_bits(bits);
+  for (const T value : dictionary) {
+    packing->add_dictionary(static_cast<int64_t>(value));
+  }
+  packing->set_original_dtype(tensor.dtype());
+  tensor.shape().AsProto(packing->mutable_original_shape());
+
+  // A constant column is fully described by its dictionary.
+  if (bits == 0) {
+    *packed = tensorflow::Tensor(tensorflow::DT_UINT8,
+                                 tensorflow::TensorShape({0}));
+    return true;
+  }
+
+  const int64_t codes_per_byte = 8 / bits;
+  const int64_t num_bytes =
+      (num_elements + codes_per_byte - 1) / codes_per_byte;
+  *packed = tensorflow::Tensor(tensorflow::DT_UINT8,
+                               tensorflow::TensorShape({num_bytes}));
+  tensorflow::uint8* dst = packed->flat<tensorflow::uint8>().data();
+  std::memset(dst, 0, num_bytes);
+  for (int64_t i = 0; i < num_elements; i++) {
+    const tensorflow::uint8 code =
+        std::lower_bound(dictionary.begin(), dictionary.end(), src(i)) -
+        dictionary.begin();
+    dst[i / codes_per_byte] |= code << ((i % codes_per_byte) * bits);
+  }
+  return true;
+}
+
+// Unpacks `kBits` wide codes and maps them through `dictionary`. The whole
+// byte loop emits a fixed number of outputs per packed word which the
+// compiler unrolls and vectorizes; the dictionary gather stays in L1 since
+// the table holds at most 256 entries.
+template <typename T, int kBits>
+void BitUnpackCodes(const tensorflow::uint8* src,
+                    const std::vector<T>& dictionary, T* dst, int64_t n) {
+  constexpr int kCodesPerByte = 8 / kBits;
+  constexpr tensorflow::uint8 kMask =
+      static_cast<tensorflow::uint8>((1 << kBits) - 1);
+  const int64_t whole_bytes = n / kCodesPerByte;
+  for (int64_t b = 0; b < whole_bytes; b++) {
+    const tensorflow::uint8 word = src[b];
+    for (int j = 0; j < kCodesPerByte; j++) {
+      dst[b * kCodesPerByte + j] = dictionary[(word >> (j * kBits)) & kMask];
+    }
+  }
+  for (int64_t i = whole_bytes * kCodesPerByte; i < n; i++) {
+    dst[i] =
+        dictionary[(src[i / kCodesPerByte] >> ((i % kCodesPerByte) * kBits)) &
+                   kMask];
+  }
+}
+
+// Monomorphic entry points bound into `DeltaEncodingKernels`. They mirror
+// the dimension checks of the free `DeltaEncode`/`CrossChunkDelta` functions
+// but have the dtype branch resolved at instantiation.
+template <typename T>
+tensorflow::Tensor DeltaEncodeKernel(const tensorflow::Tensor& tensor,
+                                     bool encode) {
+  if (tensor.dims() < 2) return tensor;
+  return DeltaEncode<typename UnsignedType<T>::Type>(tensor, encode);
+}
+
+template <typename T>
+tensorflow::Tensor CrossChunkDeltaKernel(const tensorflow::Tensor& tensor,
+                                         const tensorflow::Tensor& baseline,
+                                         bool encode) {
+  if (tensor.dims() < 2) return tensor;
+  return CrossChunkDelta<typename UnsignedType<T>::Type>(tensor, baseline,
+                                                         encode);
+}
+
+template <typename T>
+tensorflow::Tensor BitUnpackTensorT(const tensorflow::Tensor& packed,
+                                    const ChunkData::BitPacking& packing) {
+  tensorflow::Tensor output(
+      packing.original_dtype(),
+      tensorflow::TensorShape(packing.original_shape()));
+  T* dst = output.flat<T>().data();
+  const int64_t num_elements = output.NumElements();
+
+  std::vector<T> dictionary;
+  dictionary.reserve(packing.dictionary_size());
+  for (const int64_t value : packing.dictionary()) {
+    dictionary.push_back(static_cast<T>(value));
+  }
+
+  if (packing.bits() == 0) {
+    REVERB_CHECK_EQ(dictionary.size(), 1);
+    std::fill(dst, dst + num_elements, dictionary[0]);
+    return output;
+  }
+
+  const tensorflow::uint8* src = packed.flat<tensorflow::uint8>().data();
+  switch (packing.bits()) {
+    case 1:
+      BitUnpackCodes<T, 1>(src, dictionary, dst, num_elements);
+      break;
+    case 2:
+      BitUnpackCodes<T, 2>(src, dictionary, dst, num_elements);
+      break;
+    case 4:
+      BitUnpackCodes<T, 4>(src, dictionary, dst, num_elements);
+      break;
+    case 8:
+      BitUnpackCodes<T, 8>(src, dictionary, dst, num_elements);
+      break;
+    default:
+      REVERB_LOG(REVERB_FATAL)
+          << "Unsupported bit-packing width: " << packing.bits();
+  }
+  return output;
+}
+
 }  // namespace
 
 tensorflow::Tensor DeltaEncode(const tensorflow::Tensor& tensor, bool encode) {
@@ -78,33 +335,289 @@ std::vector<tensorflow::Tensor> DeltaEncodeList(
   return outputs;
 }
 
+bool DeltaEncodeTransforms(const tensorflow::Tensor& tensor) {
+  if (tensor.dims() < 2) return false;
+  switch (tensor.dtype()) {
+#define DELTA_TRANSFORMS(T) case tensorflow::DataTypeToEnum<T>::value:
+    TF_CALL_INTEGRAL_TYPES(DELTA_TRANSFORMS)
+#undef DELTA_TRANSFORMS
+    return true;
+    default:
+      return false;
+  }
+}
+
+tensorflow::Tensor CrossChunkDelta(const tensorflow::Tensor& tensor,
+                                   const tensorflow::Tensor& baseline,
+                                   bool encode) {
+  if (!DeltaEncodeTransforms(tensor)) return tensor;
+
+  switch (tensor.dtype()) {
+#define CROSS_CHUNK_DELTA(T)                 \
+  case tensorflow::DataTypeToEnum<T>::value: \
+    return CrossChunkDelta<UnsignedType<T>::Type>(tensor, baseline, encode);
+    TF_CALL_INTEGRAL_TYPES(CROSS_CHUNK_DELTA)
+#undef CROSS_CHUNK_DELTA
+    default:
+      return tensor;
+  }
+}
+
+const DeltaEncodingKernels& GetDeltaEncodingKernels(
+    tensorflow::DataType dtype) {
+  static const DeltaEncodingKernels kPassThrough;
+  switch (dtype) {
+#define DELTA_KERNELS(T)                                     \
+  case tensorflow::DataTypeToEnum<T>::value: {               \
+    static const DeltaEncodingKernels kernels = {            \
+        &DeltaEncodeKernel<T>, &CrossChunkDeltaKernel<T>};   \
+    return kernels;                                          \
+  }
+    TF_CALL_INTEGRAL_TYPES(DELTA_KERNELS)
+#undef DELTA_KERNELS
+    default:
+      return kPassThrough;
+  }
+}
+
+bool CompressionCodecSupported(CompressionCodec codec) {
+  switch (codec) {
+    case COMPRESSION_SNAPPY:
+    case COMPRESSION_NONE:
+      return true;
+    case COMPRESSION_ZSTD:
+#ifdef REVERB_HAVE_ZSTD
+      return true;
+#else
+      return false;
+#endif
+    case COMPRESSION_LZ4:
+#ifdef REVERB_HAVE_LZ4
+      return true;
+#else
+      return false;
+#endif
+    default:
+      return false;
+  }
+}
+
+tensorflow::Tensor LossyCompress(const tensorflow::Tensor& tensor,
+                                 LossyCompressionType type,
+                                 ChunkData::LossyTransform* transform) {
+  transform->Clear();
+  if (type == LOSSY_COMPRESSION_NONE ||
+      tensor.dtype() != tensorflow::DT_FLOAT || tensor.NumElements() == 0) {
+    return tensor;
+  }
+  switch (type) {
+    case LOSSY_COMPRESSION_FLOAT16:
+      transform->set_type(type);
+      return DowncastFloat<Eigen::half>(tensor);
+    case LOSSY_COMPRESSION_BFLOAT16:
+      transform->set_type(type);
+      return DowncastFloat<tensorflow::bfloat16>(tensor);
+    case LOSSY_COMPRESSION_INT8_AFFINE: {
+      const float* src = tensor.flat<float>().data();
+      const int64_t num_elements = tensor.NumElements();
+      float min = src[0];
+      float max = src[0];
+      for (int64_t i = 1; i < num_elements; i++) {
+        min = std::min(min, src[i]);
+        max = std::max(max, src[i]);
+      }
+      // Map [min, max] onto [-128, 127]. A constant tensor maps to its zero
+      // point with any nonzero scale so the roundtrip stays exact.
+      float scale = (max - min) / 255.0f;
+      if (scale == 0) scale = 1.0f;
+      const float zero_point = std::round(-128.0f - min / scale);
+
+      tensorflow::Tensor output(tensorflow::DT_INT8, tensor.shape());
+      tensorflow::int8* dst = output.flat<tensorflow::int8>().data();
+      for (int64_t i = 0; i < num_elements; i++) {
+        const float q = std::round(src[i] / scale + zero_point);
+        dst[i] = static_cast<tensorflow::int8>(
+            std::min(127.0f, std::max(-128.0f, q)));
+      }
+
+      transform->set_type(type);
+      transform->set_scale(scale);
+      transform->set_zero_point(zero_point);
+      return output;
+    }
+    default:
+      REVERB_LOG(REVERB_FATAL) << "Unsupported lossy transform: " << type;
+  }
+  return tensor;
+}
+
+tensorflow::Tensor LossyDecompress(const tensorflow::Tensor& tensor,
+                                   const ChunkData::LossyTransform& transform) {
+  switch (transform.type()) {
+    case LOSSY_COMPRESSION_NONE:
+      return tensor;
+    case LOSSY_COMPRESSION_FLOAT16:
+      REVERB_CHECK_EQ(tensor.dtype(), tensorflow::DT_HALF);
+      return UpcastFloat<Eigen::half>(tensor);
+    case LOSSY_COMPRESSION_BFLOAT16:
+      REVERB_CHECK_EQ(tensor.dtype(), tensorflow::DT_BFLOAT16);
+      return UpcastFloat<tensorflow::bfloat16>(tensor);
+    case LOSSY_COMPRESSION_INT8_AFFINE: {
+      REVERB_CHECK_EQ(tensor.dtype(), tensorflow::DT_INT8);
+      tensorflow::Tensor output(tensorflow::DT_FLOAT, tensor.shape());
+      const tensorflow::int8* src = tensor.flat<tensorflow::int8>().data();
+      float* dst = output.flat<float>().data();
+      for (int64_t i = 0; i < tensor.NumElements(); i++) {
+        dst[i] = transform.scale() * (src[i] - transform.zero_point());
+      }
+      return output;
+    }
+    default:
+      REVERB_LOG(REVERB_FATAL)
+          << "Unsupported lossy transform: " << transform.type();
+  }
+  return tensor;
+}
+
+bool BitPackTensor(const tensorflow::Tensor& tensor,
+                   ChunkData::BitPacking* packing, tensorflow::Tensor* packed) {
+  if (tensor.NumElements() == 0) return false;
+  switch (tensor.dtype()) {
+    case tensorflow::DT_BOOL:
+      return BitPackTensorT<bool>(tensor, packing, packed);
+#define BIT_PACK(T)                          \
+  case tensorflow::DataTypeToEnum<T>::value: \
+    return BitPackTensorT<T>(tensor, packing, packed);
+      TF_CALL_INTEGRAL_TYPES(BIT_PACK)
+#undef BIT_PACK
+    default:
+      return false;
+  }
+}
+
+tensorflow::Tensor BitUnpackTensor(const tensorflow::Tensor& packed,
+                                   const ChunkData::BitPacking& packing) {
+  REVERB_CHECK_EQ(packed.dtype(), tensorflow::DT_UINT8);
+  switch (packing.original_dtype()) {
+    case tensorflow::DT_BOOL:
+      return BitUnpackTensorT<bool>(packed, packing);
+#define BIT_UNPACK(T)                        \
+  case tensorflow::DataTypeToEnum<T>::value: \
+    return BitUnpackTensorT<T>(packed, packing);
+      TF_CALL_INTEGRAL_TYPES(BIT_UNPACK)
+#undef BIT_UNPACK
+    default:
+      REVERB_LOG(REVERB_FATAL) << "Unsupported bit-packed dtype: "
+                               << packing.original_dtype();
+  }
+  return packed;
+}
+
 void CompressTensorAsProto(const tensorflow::Tensor& tensor,
                            tensorflow::TensorProto* proto) {
+  CompressTensorAsProto(tensor, proto, COMPRESSION_SNAPPY);
+}
+
+CompressionCodec CompressTensorAsProto(const tensorflow::Tensor& tensor,
+                                       tensorflow::TensorProto* proto,
+                                       CompressionCodec codec) {
   if (tensor.dtype() == tensorflow::DT_STRING) {
     tensor.AsProtoTensorContent(proto);
-  } else {
-    proto->set_dtype(tensor.dtype());
-    tensor.shape().AsProto(proto->mutable_tensor_shape());
-    SnappyCompressFromString(tensor.tensor_data(),
-                             proto->mutable_tensor_content());
+    return codec;
   }
+  if (!CompressionCodecSupported(codec)) {
+    codec = COMPRESSION_SNAPPY;
+  }
+  proto->set_dtype(tensor.dtype());
+  tensor.shape().AsProto(proto->mutable_tensor_shape());
+  const absl::string_view data = tensor.tensor_data();
+  std::string* content = proto->mutable_tensor_content();
+  switch (codec) {
+    case COMPRESSION_SNAPPY:
+      SnappyCompressFromString(data, content);
+      break;
+    case COMPRESSION_NONE:
+      content->assign(data.data(), data.size());
+      break;
+#ifdef REVERB_HAVE_ZSTD
+    case COMPRESSION_ZSTD: {
+      content->resize(ZSTD_compressBound(data.size()));
+      const size_t size =
+          ZSTD_compress(&(*content)[0], content->size(), data.data(),
+                        data.size(), /*compressionLevel=*/3);
+      REVERB_CHECK(!ZSTD_isError(size));
+      content->resize(size);
+      break;
+    }
+#endif
+#ifdef REVERB_HAVE_LZ4
+    case COMPRESSION_LZ4: {
+      content->resize(LZ4_compressBound(data.size()));
+      const int size = LZ4_compress_default(data.data(), &(*content)[0],
+                                            data.size(), content->size());
+      REVERB_CHECK_GT(size, 0);
+      content->resize(size);
+      break;
+    }
+#endif
+    default:
+      REVERB_LOG(REVERB_FATAL) << "Unsupported compression codec: " << codec;
+  }
+  return codec;
 }
 
 tensorflow::Tensor DecompressTensorFromProto(
     const tensorflow::TensorProto& proto) {
+  return DecompressTensorFromProto(proto, COMPRESSION_SNAPPY);
+}
+
+tensorflow::Tensor DecompressTensorFromProto(
+    const tensorflow::TensorProto& proto, CompressionCodec codec) {
   if (proto.dtype() == tensorflow::DT_STRING) {
     tensorflow::Tensor tensor;
     REVERB_CHECK(tensor.FromProto(proto));
     return tensor;
-  } else {
-    tensorflow::Tensor tensor(proto.dtype(),
-                              tensorflow::TensorShape(proto.tensor_shape()));
-    const auto& tensor_content = proto.tensor_content();
-    SnappyUncompressToString(tensor_content,
-                             tensor.tensor_data().size(),
-                             const_cast<char*>(tensor.tensor_data().data()));
-    return tensor;
   }
+  tensorflow::Tensor tensor(proto.dtype(),
+                            tensorflow::TensorShape(proto.tensor_shape()));
+  const auto& tensor_content = proto.tensor_content();
+  char* output = const_cast<char*>(tensor.tensor_data().data());
+  const size_t output_capacity = tensor.tensor_data().size();
+  REVERB_CHECK(CompressionCodecSupported(codec))
+      << "Chunk was compressed with codec " << codec
+      << " which is not available in this binary.";
+  switch (codec) {
+    case COMPRESSION_SNAPPY:
+      REVERB_CHECK(
+          SnappyUncompressToString(tensor_content, output_capacity, output));
+      break;
+    case COMPRESSION_NONE:
+      REVERB_CHECK_EQ(tensor_content.size(), output_capacity);
+      std::memcpy(output, tensor_content.data(), tensor_content.size());
+      break;
+#ifdef REVERB_HAVE_ZSTD
+    case COMPRESSION_ZSTD: {
+      const size_t size = ZSTD_decompress(output, output_capacity,
+                                          tensor_content.data(),
+                                          tensor_content.size());
+      REVERB_CHECK(!ZSTD_isError(size));
+      REVERB_CHECK_EQ(size, output_capacity);
+      break;
+    }
+#endif
+#ifdef REVERB_HAVE_LZ4
+    case COMPRESSION_LZ4: {
+      const int size =
+          LZ4_decompress_safe(tensor_content.data(), output,
+                              tensor_content.size(), output_capacity);
+      REVERB_CHECK_EQ(size, output_capacity);
+      break;
+    }
+#endif
+    default:
+      REVERB_LOG(REVERB_FATAL) << "Unsupported compression codec: " << codec;
+  }
+  return tensor;
 }
 
 }  // namespace reverb
@@ -15,6 +15,7 @@
 #ifndef LEARNING_DEEPMIND_REPLAY_REVERB_TENSOR_COMPRESSION_H_
 #define LEARNING_DEEPMIND_REPLAY_REVERB_TENSOR_COMPRESSION_H_
 
+#include "reverb/cc/schema.pb.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 
@@ -31,15 +32,110 @@ tensorflow::Tensor DeltaEncode(const tensorflow::Tensor& tensor, bool encode);
 std::vector<tensorflow::Tensor> DeltaEncodeList(
     const std::vector<tensorflow::Tensor>& tensors, bool encode);
 
-// Compresses a Tensor with Zippy. The resulting `proto` must be read with
+// Whether `DeltaEncode` transforms `tensor`, i.e. whether it is an integer
+// tensor with at least two dimensions. Other tensors pass through unchanged.
+bool DeltaEncodeTransforms(const tensorflow::Tensor& tensor);
+
+// Folds the last row of the preceding chunk (`baseline`, shaped like a single
+// row of `tensor`) into a delta encoded tensor so that the first row also
+// becomes a small delta. For `encode=true` the input must already be delta
+// encoded and the baseline is subtracted from the first row; for
+// `encode=false` the input must already be delta decoded and the baseline is
+// added to every row (the first row seeds the intra-chunk prefix sums, so
+// every decoded row is offset by it). Applies to the same tensors as
+// `DeltaEncode`; others are returned unchanged.
+tensorflow::Tensor CrossChunkDelta(const tensorflow::Tensor& tensor,
+                                   const tensorflow::Tensor& baseline,
+                                   bool encode);
+
+// Function table holding the delta encoding kernels instantiated for a
+// single dtype. A column's dtype is fixed the first time data is appended to
+// it, so a `Chunker` binds the table once at creation and the per chunk
+// encode path becomes an indirect call into monomorphic code instead of
+// re-running the `tensorflow::DataType` switch of the free functions above
+// for every chunk.
+struct DeltaEncodingKernels {
+  // Dtype specialized equivalents of `DeltaEncode` and `CrossChunkDelta`.
+  // Both are null iff delta encoding passes the dtype through unchanged (see
+  // `DeltaEncodeTransforms`); tensors with fewer than two dimensions are
+  // still returned unchanged by the kernels themselves.
+  tensorflow::Tensor (*delta_encode)(const tensorflow::Tensor& tensor,
+                                     bool encode) = nullptr;
+  tensorflow::Tensor (*cross_chunk_delta)(const tensorflow::Tensor& tensor,
+                                          const tensorflow::Tensor& baseline,
+                                          bool encode) = nullptr;
+
+  // Whether `delta_encode` would transform `tensor`. Equivalent to
+  // `DeltaEncodeTransforms` with the dtype branch already resolved.
+  bool Transforms(const tensorflow::Tensor& tensor) const {
+    return delta_encode != nullptr && tensor.dims() >= 2;
+  }
+};
+
+// Returns the kernel table for `dtype`. The returned reference is valid for
+// the lifetime of the process; for dtypes which delta encoding does not
+// transform the table's function pointers are null.
+const DeltaEncodingKernels& GetDeltaEncodingKernels(tensorflow::DataType dtype);
+
+// Whether the codec was compiled into this binary. Snappy and none are always
+// available; zstd and LZ4 require building with REVERB_HAVE_ZSTD or
+// REVERB_HAVE_LZ4 respectively.
+bool CompressionCodecSupported(CompressionCodec codec);
+
+// Applies the requested lossy transform to `tensor` and records the
+// parameters needed to invert it in `transform`. Only DT_FLOAT tensors are
+// transformed; any other dtype (and empty tensors) are returned unchanged
+// with `transform->type()` set to `LOSSY_COMPRESSION_NONE`. Callers must
+// store `transform` in the owning `ChunkData` so readers can recover the
+// original values. Applied before delta encoding and the lossless codec.
+tensorflow::Tensor LossyCompress(const tensorflow::Tensor& tensor,
+                                 LossyCompressionType type,
+                                 ChunkData::LossyTransform* transform);
+
+// Inverts `LossyCompress` and returns a DT_FLOAT tensor. Note that the
+// recovered values approximate the original ones; the transform is lossy.
+tensorflow::Tensor LossyDecompress(const tensorflow::Tensor& tensor,
+                                   const ChunkData::LossyTransform& transform);
+
+// Attempts to dictionary encode and bit-pack `tensor`. Packing applies to
+// bool and integer tensors with at most 256 distinct values; each element is
+// stored as an index into the sorted dictionary recorded in `packing`, using
+// 1, 2, 4 or 8 bits per element. Returns true and sets `packed` to a flat
+// DT_UINT8 tensor of the packed words when the tensor shrinks, false (leaving
+// the outputs untouched) otherwise. The transform is lossless and applied
+// instead of delta encoding, before the lossless codec; readers invert it
+// with `BitUnpackTensor`.
+bool BitPackTensor(const tensorflow::Tensor& tensor,
+                   ChunkData::BitPacking* packing, tensorflow::Tensor* packed);
+
+// Inverts `BitPackTensor`, restoring the original dtype and shape.
+tensorflow::Tensor BitUnpackTensor(const tensorflow::Tensor& packed,
+                                   const ChunkData::BitPacking& packing);
+
+// Compresses a Tensor with snappy. The resulting `proto` must be read with
 // `DecompressTensorFromProto`. Note that string tensors are not compressed.
 void CompressTensorAsProto(const tensorflow::Tensor& tensor,
                            tensorflow::TensorProto* proto);
 
-// Assumes that the TensorProto was built by calling `CompressTensorAsProto`.
+// As above but with an explicit codec. If the requested codec was not
+// compiled into this binary the tensor is compressed with snappy instead.
+// Returns the codec actually used; callers must record it in the owning
+// `ChunkData` so readers dispatch correctly.
+CompressionCodec CompressTensorAsProto(const tensorflow::Tensor& tensor,
+                                       tensorflow::TensorProto* proto,
+                                       CompressionCodec codec);
+
+// Assumes that the TensorProto was built by calling `CompressTensorAsProto`
+// with snappy.
 tensorflow::Tensor DecompressTensorFromProto(
     const tensorflow::TensorProto& proto);
 
+// As above but with an explicit codec, typically read from
+// `ChunkData.codec`. Check-fails if the codec was not compiled into this
+// binary as the data cannot be recovered.
+tensorflow::Tensor DecompressTensorFromProto(
+    const tensorflow::TensorProto& proto, CompressionCodec codec);
+
 template <typename T>
 struct UnsignedType {
   static_assert(
@@ -48,6 +48,51 @@ TEST(TensorCompressionTest, EncodeMatchesDecode) {
   EncodeMatchesDecodeT<bool>();
 }
 
+template <typename T>
+void KernelsMatchFreeFunctionsT() {
+  const auto& kernels =
+      GetDeltaEncodingKernels(tensorflow::DataTypeToEnum<T>::v());
+  ASSERT_NE(kernels.delta_encode, nullptr);
+  ASSERT_NE(kernels.cross_chunk_delta, nullptr);
+
+  tensorflow::Tensor tensor(tensorflow::DataTypeToEnum<T>::v(),
+                            tensorflow::TensorShape({16, 37, 6}));
+  tensor.flat<T>().setRandom();
+  EXPECT_TRUE(kernels.Transforms(tensor));
+
+  tensorflow::Tensor encoded = kernels.delta_encode(tensor, true);
+  test::ExpectTensorEqual<T>(DeltaEncode(tensor, true), encoded);
+  test::ExpectTensorEqual<T>(tensor, kernels.delta_encode(encoded, false));
+
+  tensorflow::Tensor baseline(tensorflow::DataTypeToEnum<T>::v(),
+                              tensorflow::TensorShape({1, 37, 6}));
+  baseline.flat<T>().setRandom();
+  test::ExpectTensorEqual<T>(
+      CrossChunkDelta(encoded, baseline, true),
+      kernels.cross_chunk_delta(encoded, baseline, true));
+}
+
+TEST(TensorCompressionTest, DeltaKernelsMatchFreeFunctions) {
+#define KERNELS_MATCH(T) KernelsMatchFreeFunctionsT<T>();
+  TF_CALL_INTEGRAL_TYPES(KERNELS_MATCH)
+#undef KERNELS_MATCH
+}
+
+TEST(TensorCompressionTest, DeltaKernelsPassThroughUntransformedDtypes) {
+  const auto& float_kernels = GetDeltaEncodingKernels(tensorflow::DT_FLOAT);
+  EXPECT_EQ(float_kernels.delta_encode, nullptr);
+  EXPECT_EQ(float_kernels.cross_chunk_delta, nullptr);
+
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({4, 4}));
+  EXPECT_FALSE(float_kernels.Transforms(tensor));
+
+  // Tensors with fewer than two dimensions are never transformed, matching
+  // `DeltaEncodeTransforms`.
+  tensorflow::Tensor flat(tensorflow::DT_INT32, tensorflow::TensorShape({4}));
+  EXPECT_FALSE(GetDeltaEncodingKernels(tensorflow::DT_INT32).Transforms(flat));
+}
+
 TEST(TensorCompressionTest, EncodeListMatchesDecode) {
   tensorflow::Tensor tensor(tensorflow::DT_INT32,
                             tensorflow::TensorShape({16, 37, 6}));
@@ -86,6 +131,194 @@ TEST(TensorCompressionTest, NonStringTensor) {
   test::ExpectTensorEqual<int>(tensor, result);
 }
 
+TEST(TensorCompressionTest, RoundtripsWithEverySupportedCodec) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT32,
+                            tensorflow::TensorShape({4, 16}));
+  tensor.flat<int>().setRandom();
+
+  for (const CompressionCodec codec :
+       {COMPRESSION_SNAPPY, COMPRESSION_NONE, COMPRESSION_ZSTD,
+        COMPRESSION_LZ4}) {
+    tensorflow::TensorProto proto;
+    const CompressionCodec used = CompressTensorAsProto(tensor, &proto, codec);
+    if (CompressionCodecSupported(codec)) {
+      EXPECT_EQ(used, codec);
+    } else {
+      // Codecs that are not compiled in fall back to snappy.
+      EXPECT_EQ(used, COMPRESSION_SNAPPY);
+    }
+    tensorflow::Tensor result = DecompressTensorFromProto(proto, used);
+    test::ExpectTensorEqual<int>(tensor, result);
+  }
+}
+
+TEST(TensorCompressionTest, NoneCodecStoresRawTensorContent) {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({8, 8}));
+  tensor.flat<float>().setRandom();
+
+  tensorflow::TensorProto proto;
+  EXPECT_EQ(CompressTensorAsProto(tensor, &proto, COMPRESSION_NONE),
+            COMPRESSION_NONE);
+  EXPECT_EQ(proto.tensor_content().size(), tensor.tensor_data().size());
+
+  tensorflow::Tensor result =
+      DecompressTensorFromProto(proto, COMPRESSION_NONE);
+  test::ExpectTensorEqual<float>(tensor, result);
+}
+
+TEST(TensorCompressionTest, LossyRoundtripsWithinPrecision) {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({4, 16}));
+  tensor.flat<float>().setRandom();  // Uniform in [-1, 1].
+
+  for (const LossyCompressionType type :
+       {LOSSY_COMPRESSION_FLOAT16, LOSSY_COMPRESSION_BFLOAT16,
+        LOSSY_COMPRESSION_INT8_AFFINE}) {
+    ChunkData::LossyTransform transform;
+    tensorflow::Tensor encoded = LossyCompress(tensor, type, &transform);
+    EXPECT_EQ(transform.type(), type);
+    EXPECT_LT(encoded.tensor_data().size(), tensor.tensor_data().size());
+
+    tensorflow::Tensor decoded = LossyDecompress(encoded, transform);
+    ASSERT_EQ(decoded.dtype(), tensorflow::DT_FLOAT);
+    // bfloat16 has the coarsest mantissa (8 bits) of the three transforms;
+    // int8 affine over [-1, 1] resolves ~1/128.
+    test::ExpectTensorNear<float>(tensor, decoded, 1e-2);
+  }
+}
+
+TEST(TensorCompressionTest, LossyIgnoresNonFloatTensors) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT32,
+                            tensorflow::TensorShape({2, 2}));
+  tensor.flat<int>().setRandom();
+
+  ChunkData::LossyTransform transform;
+  tensorflow::Tensor encoded =
+      LossyCompress(tensor, LOSSY_COMPRESSION_FLOAT16, &transform);
+  EXPECT_EQ(transform.type(), LOSSY_COMPRESSION_NONE);
+  test::ExpectTensorEqual<int>(tensor, encoded);
+  test::ExpectTensorEqual<int>(tensor, LossyDecompress(encoded, transform));
+}
+
+TEST(TensorCompressionTest, Int8AffineRoundtripsConstantTensorExactly) {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({8}));
+  for (int i = 0; i < tensor.NumElements(); i++) {
+    tensor.flat<float>()(i) = 3.0f;
+  }
+
+  ChunkData::LossyTransform transform;
+  tensorflow::Tensor encoded =
+      LossyCompress(tensor, LOSSY_COMPRESSION_INT8_AFFINE, &transform);
+  test::ExpectTensorEqual<float>(tensor, LossyDecompress(encoded, transform));
+}
+
+TEST(TensorCompressionTest, BitPackRoundtripsLowCardinalityTensors) {
+  // A bool mask and a small-enum action column, the motivating use cases.
+  tensorflow::Tensor mask(tensorflow::DT_BOOL, tensorflow::TensorShape({7, 9}));
+  for (int i = 0; i < mask.NumElements(); i++) {
+    mask.flat<bool>()(i) = i % 3 == 0;
+  }
+  tensorflow::Tensor actions(tensorflow::DT_INT32,
+                             tensorflow::TensorShape({100}));
+  for (int i = 0; i < actions.NumElements(); i++) {
+    actions.flat<int>()(i) = (i * 7) % 6;
+  }
+
+  for (const tensorflow::Tensor& tensor : {mask, actions}) {
+    ChunkData::BitPacking packing;
+    tensorflow::Tensor packed;
+    ASSERT_TRUE(BitPackTensor(tensor, &packing, &packed));
+    EXPECT_EQ(packed.dtype(), tensorflow::DT_UINT8);
+    EXPECT_LT(packed.tensor_data().size(), tensor.tensor_data().size());
+
+    tensorflow::Tensor unpacked = BitUnpackTensor(packed, packing);
+    ASSERT_EQ(unpacked.dtype(), tensor.dtype());
+    if (tensor.dtype() == tensorflow::DT_BOOL) {
+      test::ExpectTensorEqual<bool>(tensor, unpacked);
+    } else {
+      test::ExpectTensorEqual<int>(tensor, unpacked);
+    }
+  }
+}
+
+TEST(TensorCompressionTest, BitPackStoresConstantTensorWithoutPayload) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT64,
+                            tensorflow::TensorShape({4, 4}));
+  for (int i = 0; i < tensor.NumElements(); i++) {
+    tensor.flat<tensorflow::int64>()(i) = 42;
+  }
+
+  ChunkData::BitPacking packing;
+  tensorflow::Tensor packed;
+  ASSERT_TRUE(BitPackTensor(tensor, &packing, &packed));
+  EXPECT_EQ(packing.bits(), 0);
+  EXPECT_EQ(packed.NumElements(), 0);
+  test::ExpectTensorEqual<tensorflow::int64>(tensor,
+                                             BitUnpackTensor(packed, packing));
+}
+
+TEST(TensorCompressionTest, BitPackRejectsUnsuitableTensors) {
+  // High cardinality data does not fit a 256 entry dictionary.
+  tensorflow::Tensor random(tensorflow::DT_INT32,
+                            tensorflow::TensorShape({1000}));
+  random.flat<int>().setRandom();
+
+  // Floats are never packed.
+  tensorflow::Tensor floats(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({2, 2}));
+  floats.flat<float>().setRandom();
+
+  for (const tensorflow::Tensor& tensor : {random, floats}) {
+    ChunkData::BitPacking packing;
+    tensorflow::Tensor packed;
+    EXPECT_FALSE(BitPackTensor(tensor, &packing, &packed));
+  }
+}
+
+TEST(TensorCompressionTest, CrossChunkDeltaRoundtrips) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT32,
+                            tensorflow::TensorShape({4, 16}));
+  tensor.flat<int>().setRandom();
+  tensorflow::Tensor baseline(tensorflow::DT_INT32,
+                              tensorflow::TensorShape({16}));
+  baseline.flat<int>().setRandom();
+
+  ASSERT_TRUE(DeltaEncodeTransforms(tensor));
+
+  // Encoding order matches `Chunker::CompleteChunk`: delta encode within the
+  // chunk, then fold in the baseline.
+  tensorflow::Tensor encoded = DeltaEncode(tensor, /*encode=*/true);
+  encoded = CrossChunkDelta(encoded, baseline, /*encode=*/true);
+
+  tensorflow::Tensor decoded = DeltaEncode(encoded, /*encode=*/false);
+  decoded = CrossChunkDelta(decoded, baseline, /*encode=*/false);
+  test::ExpectTensorEqual<int>(tensor, decoded);
+}
+
+TEST(TensorCompressionTest, CrossChunkDeltaIgnoresUntransformedTensors) {
+  // Floats and rank-1 tensors are not delta encoded and so pass through the
+  // cross chunk transform unchanged as well.
+  tensorflow::Tensor floats(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({2, 2}));
+  floats.flat<float>().setRandom();
+  tensorflow::Tensor float_baseline(tensorflow::DT_FLOAT,
+                                    tensorflow::TensorShape({2}));
+  float_baseline.flat<float>().setRandom();
+  EXPECT_FALSE(DeltaEncodeTransforms(floats));
+  test::ExpectTensorEqual<float>(
+      floats, CrossChunkDelta(floats, float_baseline, /*encode=*/true));
+
+  tensorflow::Tensor flat(tensorflow::DT_INT32, tensorflow::TensorShape({8}));
+  flat.flat<int>().setRandom();
+  tensorflow::Tensor flat_baseline(tensorflow::DT_INT32,
+                                   tensorflow::TensorShape({}));
+  EXPECT_FALSE(DeltaEncodeTransforms(flat));
+  test::ExpectTensorEqual<int>(
+      flat, CrossChunkDelta(flat, flat_baseline, /*encode=*/true));
+}
+
 TEST(TensorCompressionTest, NonStringTensorWithDeltaEncoding) {
   tensorflow::Tensor tensor(tensorflow::DT_INT32,
                             tensorflow::TensorShape({2, 2}));
@@ -41,6 +41,9 @@ struct ThreadStats {
   // Number of tasks that have been processed and completed. It doesn't include
   // the current task being processed.
   int num_tasks_processed = 0;
+  // Cumulative time the thread has spent executing task callbacks. It doesn't
+  // include the current task being processed.
+  absl::Duration busy_duration = absl::ZeroDuration();
 };
 
 int LastThreadId(const std::vector<ThreadStats>& stats);
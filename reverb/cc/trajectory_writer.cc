@@ -14,6 +14,7 @@
 
 #include "reverb/cc/trajectory_writer.h"
 
+#include <atomic>
 #include <limits>
 #include <memory>
 #include <vector>
@@ -21,6 +22,7 @@
 #include "grpcpp/impl/codegen/sync_stream.h"
 #include "absl/algorithm/container.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/hash/hash.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
@@ -30,6 +32,7 @@
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "reverb/cc/chunker.h"
+#include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/hash_set.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/status_macros.h"
@@ -69,6 +72,12 @@ class ArenaOwnedRequest {
   inline int64_t RequestSize() {
     return request_size_bytes_;
   }
+  inline void SetWriterId(uint64_t writer_id) {
+    r_.set_writer_id(writer_id);
+  }
+  inline void SetAdmissionClass(int32_t admission_class) {
+    r_.set_admission_class(admission_class);
+  }
   inline void AddKeepChunkKeys(uint64_t keep_key) {
     r_.add_keep_chunk_keys(keep_key);
     request_size_bytes_ += sizeof(uint64_t);
@@ -88,6 +97,10 @@ class ArenaOwnedRequest {
 
 namespace {
 
+// How long to wait for the server to answer which chunks it still caches
+// before falling back to retransmitting everything.
+constexpr absl::Duration kQueryReceivedChunksTimeout = absl::Seconds(10);
+
 std::vector<FlatTrajectory::ChunkSlice> MergeAdjacent(
     const std::vector<std::weak_ptr<CellRef>>& refs) {
   std::vector<FlatTrajectory::ChunkSlice> slices;
@@ -97,11 +110,13 @@ std::vector<FlatTrajectory::ChunkSlice> MergeAdjacent(
     std::shared_ptr<CellRef> ref_sp = ref.lock();
     REVERB_CHECK(ref_sp);
 
-    if (slices.empty() || slices.back().chunk_key() != ref_sp->chunk_key()) {
+    if (slices.empty() || slices.back().chunk_key() != ref_sp->chunk_key() ||
+        slices.back().index() != ref_sp->chunk_column()) {
       FlatTrajectory::ChunkSlice slice;
       slice.set_chunk_key(ref_sp->chunk_key());
       slice.set_offset(ref_sp->offset());
       slice.set_length(1);
+      slice.set_index(ref_sp->chunk_column());
       slices.push_back(std::move(slice));
     } else {
       slices.back().set_length(slices.back().length() + 1);
@@ -127,10 +142,12 @@ bool ContainsAll(const internal::flat_hash_set<uint64_t>& set,
 std::vector<internal::TensorSpec> FlatSignatureFromTrajectory(
     const FlatTrajectory& trajectory,
     absl::Span<const std::shared_ptr<CellRef>> refs) {
-  auto get_spec = [&](uint64_t chunk_key) -> internal::TensorSpec {
+  auto get_spec =
+      [&](const FlatTrajectory::ChunkSlice& slice) -> internal::TensorSpec {
     for (const auto& ref : refs) {
-      if (ref->chunk_key() == chunk_key) {
-        return ref->chunker().lock()->spec();
+      if (ref->chunk_key() == slice.chunk_key() &&
+          ref->chunk_column() == slice.index()) {
+        return ref->chunker().lock()->spec(ref->chunk_column());
       }
     }
     REVERB_CHECK(false) << "Invalid trajectory";
@@ -139,7 +156,7 @@ std::vector<internal::TensorSpec> FlatSignatureFromTrajectory(
   std::vector<internal::TensorSpec> specs;
   for (int col_idx = 0; col_idx < trajectory.columns_size(); col_idx++) {
     const FlatTrajectory::Column& col = trajectory.columns(col_idx);
-    internal::TensorSpec spec = get_spec(col.chunk_slices(0).chunk_key());
+    internal::TensorSpec spec = get_spec(col.chunk_slices(0));
     spec.name = std::to_string(col_idx);
     if (!col.squeeze()) {
       spec.shape.InsertDim(0, internal::ColumnLength(trajectory, col_idx));
@@ -149,6 +166,40 @@ std::vector<internal::TensorSpec> FlatSignatureFromTrajectory(
   return specs;
 }
 
+// Hash of the column layout of `trajectory`: the dtype and per step shape of
+// every column together with its length and squeeze flag. These are exactly
+// the properties the signature check compares, so two trajectories with equal
+// layout hashes validate identically against a table signature. Used by
+// `BuildItem` to skip the full spec comparison for repeat layouts.
+size_t TrajectorySignatureHash(
+    const FlatTrajectory& trajectory,
+    absl::Span<const std::shared_ptr<CellRef>> refs) {
+  auto get_spec =
+      [&](const FlatTrajectory::ChunkSlice& slice) -> internal::TensorSpec {
+    for (const auto& ref : refs) {
+      if (ref->chunk_key() == slice.chunk_key() &&
+          ref->chunk_column() == slice.index()) {
+        return ref->chunker().lock()->spec(ref->chunk_column());
+      }
+    }
+    REVERB_CHECK(false) << "Invalid trajectory";
+  };
+
+  size_t hash = 0;
+  for (int col_idx = 0; col_idx < trajectory.columns_size(); col_idx++) {
+    const FlatTrajectory::Column& col = trajectory.columns(col_idx);
+    const internal::TensorSpec spec = get_spec(col.chunk_slices(0));
+    hash = absl::HashOf(hash, spec.dtype, spec.shape.dims());
+    for (int d = 0; d < spec.shape.dims(); ++d) {
+      hash = absl::HashOf(hash, spec.shape.dim_size(d));
+    }
+    hash = absl::HashOf(
+        hash, col.squeeze(),
+        col.squeeze() ? 0 : internal::ColumnLength(trajectory, col_idx));
+  }
+  return hash;
+}
+
 }  // namespace
 
 bool TrajectoryWriter::WriteIfNotEmpty(
@@ -157,6 +208,8 @@ bool TrajectoryWriter::WriteIfNotEmpty(
   if (request->RequestSize() == 0) {
     return true;
   }
+  request->SetWriterId(writer_id_);
+  request->SetAdmissionClass(options_.admission_class);
   for (uint64_t keep_key : keep_keys) {
     request->AddKeepChunkKeys(keep_key);
   }
@@ -209,6 +262,17 @@ absl::Status TrajectoryWriter::Options::Validate() const {
   if (chunker_options == nullptr) {
     return absl::InvalidArgumentError("chunker_options must be set.");
   }
+  if (num_insert_streams < 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("num_insert_streams must be a positive integer but got ",
+                     num_insert_streams, "."));
+  }
+  if (!insert_spool_dir.empty() && insert_spool_max_bytes < 1) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "insert_spool_max_bytes must be a positive integer when "
+        "insert_spool_dir is set but got ",
+        insert_spool_max_bytes, "."));
+  }
   return ValidateChunkerOptions(chunker_options.get());
 }
 
@@ -276,7 +340,8 @@ TrajectoryWriter::TrajectoryWriter(
     const Options& options)
     : stub_(std::move(stub)),
       options_(options),
-      key_generator_(absl::make_unique<internal::UniformKeyGenerator>()),
+      key_generator_(absl::make_unique<internal::ShardedKeyGenerator>()),
+      writer_id_(key_generator_->Generate()),
       episode_id_(key_generator_->Generate()),
       episode_step_(0),
       closed_(false),
@@ -292,12 +357,14 @@ TrajectoryWriter::TrajectoryWriter(
               if (closed_) {
                 unrecoverable_status_ = absl::CancelledError(
                     "TrajectoryWriter::Close has been called.");
+                CompletePendingFlushesLocked();
                 return;
               }
 
               if (!status.ok() && !absl::IsUnavailable(status) &&
                   !absl::IsCancelled(status)) {
                 unrecoverable_status_ = status;
+                CompletePendingFlushesLocked();
                 return;
               }
 
@@ -323,19 +390,40 @@ TrajectoryWriter::TrajectoryWriter(
             }
           })) {
   REVERB_CHECK_OK(options.Validate());
+
+  // The parent writer acts as stream 0; the remaining streams are provided by
+  // internal writers which only run the streaming machinery for the items
+  // routed to them.
+  for (int i = 1; i < options.num_insert_streams; i++) {
+    Options stream_options = options;
+    stream_options.num_insert_streams = 1;
+    additional_stream_writers_.push_back(
+        absl::make_unique<TrajectoryWriter>(stub_, stream_options));
+  }
 }
 
 TrajectoryWriter::~TrajectoryWriter() {
   {
     absl::MutexLock lock(&mu_);
-    if (closed_) return;
-
-    absl::Status status = FlushLocked(/*ignore_last_num_items=*/0,
-                                      /*timeout=*/absl::InfiniteDuration());
-    REVERB_LOG_IF(REVERB_WARNING, !status.ok())
-        << "TrajectoryWriter destroyed before content finalized. Encountered "
-           "error when trying to finalize content: "
-        << status;
+    if (!closed_) {
+      absl::Status status = FlushLocked(/*ignore_last_num_items=*/0,
+                                        /*timeout=*/absl::InfiniteDuration());
+      REVERB_LOG_IF(REVERB_WARNING, !status.ok())
+          << "TrajectoryWriter destroyed before content finalized. Encountered "
+             "error when trying to finalize content: "
+          << status;
+    }
+  }
+  // Scheduled compression tasks hold a reference to their chunker but may
+  // invoke the `chunk_ready` callback which references `this`. Wait for them
+  // to drain before members are destroyed.
+  for (auto& [_, chunker] : chunkers_) {
+    chunker->WaitForPendingChunks();
+  }
+  // A dissolved small column group is no longer reachable through `chunkers_`
+  // but may still have chunks on the executor.
+  if (inline_chunker_ != nullptr) {
+    inline_chunker_->WaitForPendingChunks();
   }
   Close();
 }
@@ -343,16 +431,76 @@ TrajectoryWriter::~TrajectoryWriter() {
 absl::Status TrajectoryWriter::Append(
     std::vector<absl::optional<tensorflow::Tensor>> data,
     std::vector<absl::optional<std::weak_ptr<CellRef>>>* refs) {
+  if (options_.combine_partial_appends && !staged_step_.empty()) {
+    // Fold the closing call into the staged step and hand the combined row
+    // to the chunkers in one go.
+    REVERB_RETURN_IF_ERROR(StageStep(&data));
+    std::vector<absl::optional<tensorflow::Tensor>> combined =
+        std::move(staged_step_);
+    staged_step_.clear();
+    return AppendInternal(std::move(combined), /*increment_episode_step=*/true,
+                          refs);
+  }
   return AppendInternal(std::move(data), /*increment_episode_step=*/true, refs);
 }
 
 absl::Status TrajectoryWriter::AppendPartial(
     std::vector<absl::optional<tensorflow::Tensor>> data,
     std::vector<absl::optional<std::weak_ptr<CellRef>>>* refs) {
+  if (options_.combine_partial_appends) {
+    // Partial appends only stage their tensors; the chunkers see the
+    // combined step once when the closing `Append` arrives. The references
+    // of the staged columns are created (and returned) by that call.
+    {
+      absl::MutexLock lock(&mu_);
+      REVERB_RETURN_IF_ERROR(unrecoverable_status_);
+    }
+    const size_t num_columns = data.size();
+    REVERB_RETURN_IF_ERROR(StageStep(&data));
+    for (size_t i = 0; i < num_columns; i++) {
+      refs->push_back(absl::nullopt);
+    }
+    return absl::OkStatus();
+  }
   return AppendInternal(std::move(data), /*increment_episode_step=*/false,
                         refs);
 }
 
+absl::Status TrajectoryWriter::StageStep(
+    std::vector<absl::optional<tensorflow::Tensor>>* data) {
+  if (staged_step_.size() < data->size()) {
+    staged_step_.resize(data->size());
+  }
+  for (size_t i = 0; i < data->size(); i++) {
+    if (!(*data)[i].has_value()) continue;
+    if (staged_step_[i].has_value()) {
+      return absl::FailedPreconditionError(
+          "Append/AppendPartial called with data containing column that was "
+          "present in previous AppendPartial call.");
+    }
+    staged_step_[i] = std::move((*data)[i]);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status TrajectoryWriter::ResolveStagedStep(bool clear_buffers) {
+  const bool has_staged_columns = absl::c_any_of(
+      staged_step_, [](const absl::optional<tensorflow::Tensor>& column) {
+        return column.has_value();
+      });
+  if (!has_staged_columns) {
+    staged_step_.clear();
+    return absl::OkStatus();
+  }
+  if (clear_buffers) {
+    staged_step_.clear();
+    return absl::OkStatus();
+  }
+  return absl::FailedPreconditionError(
+      "EndEpisode called while a step staged by AppendPartial is still open; "
+      "close the step with Append first.");
+}
+
 absl::Status TrajectoryWriter::AppendInternal(
     std::vector<absl::optional<tensorflow::Tensor>> data,
     bool increment_episode_step,
@@ -364,6 +512,64 @@ absl::Status TrajectoryWriter::AppendInternal(
     episode_info = {episode_id_, episode_step_};
   }
 
+  // Number of grouped small columns (see `Options::max_inline_column_bytes`)
+  // present in this call. The combined chunker appends whole rows so either
+  // all members must be present or none; a partial row dissolves the group
+  // and the affected columns continue as individual chunkers.
+  int num_inline_present = 0;
+  for (int column : inline_columns_) {
+    if (column < data.size() && data[column].has_value()) {
+      num_inline_present++;
+    }
+  }
+  if (num_inline_present > 0 && num_inline_present < inline_columns_.size()) {
+    REVERB_RETURN_IF_ERROR(inline_chunker_->Flush());
+    for (int column : inline_columns_) {
+      chunkers_.erase(column);
+    }
+    inline_columns_.clear();
+    num_inline_present = 0;
+  }
+
+  // Group the small columns of the first append into a combined chunker so
+  // that scalar signals (reward, discount, done flags, ...) do not each cut a
+  // chunk whose metadata dwarfs the payload.
+  if (!inline_group_decided_ && options_.max_inline_column_bytes > 0) {
+    inline_group_decided_ = true;
+    std::vector<internal::TensorSpec> specs;
+    for (int i = 0; i < data.size(); i++) {
+      if (!data[i].has_value() || options_override_.contains(i)) continue;
+      const tensorflow::Tensor& tensor = data[i].value();
+      // Only fixed size dtypes are grouped; the payload of e.g. a string
+      // column may grow beyond the threshold in later steps.
+      if (!tensorflow::DataTypeCanUseMemcpy(tensor.dtype()) ||
+          tensor.TotalBytes() > options_.max_inline_column_bytes) {
+        continue;
+      }
+      specs.push_back(internal::TensorSpec{std::to_string(i), tensor.dtype(),
+                                           tensor.shape()});
+      inline_columns_.push_back(i);
+    }
+    // A single small column gains nothing from the combined layout.
+    if (inline_columns_.size() < 2) {
+      inline_columns_.clear();
+    } else {
+      inline_chunker_ = std::make_shared<Chunker>(
+          std::move(specs), options_.chunker_options->Clone());
+      if (options_.compression_executor != nullptr) {
+        inline_chunker_->EnableAsyncCompression(options_.compression_executor,
+                                               [this] {
+                                                 absl::MutexLock lock(&mu_);
+                                                 data_cv_.Signal();
+                                               });
+      }
+      for (int column : inline_columns_) {
+        chunkers_[column] = inline_chunker_;
+      }
+      num_inline_present = inline_columns_.size();
+    }
+  }
+
   // If this is the first time the column has been present in the data then
   // create a chunker using the spec of the item.
   for (int i = 0; i < data.size(); i++) {
@@ -379,19 +585,53 @@ absl::Status TrajectoryWriter::AppendInternal(
           internal::TensorSpec{std::to_string(i), tensor.dtype(),
                                tensor.shape()},
           chunker_options->Clone());
+      if (options_.compression_executor != nullptr) {
+        chunkers_[i]->EnableAsyncCompression(options_.compression_executor,
+                                             [this] {
+                                               absl::MutexLock lock(&mu_);
+                                               data_cv_.Signal();
+                                             });
+      }
+    }
+  }
+
+  // Append the grouped small columns as a single combined row.
+  internal::flat_hash_map<int, std::weak_ptr<CellRef>> inline_refs;
+  if (num_inline_present > 0) {
+    std::vector<tensorflow::Tensor> tensors;
+    tensors.reserve(inline_columns_.size());
+    for (int column : inline_columns_) {
+      tensors.push_back(std::move(data[column]).value());
+    }
+    std::vector<std::weak_ptr<CellRef>> row_refs;
+    absl::Status status = inline_chunker_->AppendColumns(std::move(tensors),
+                                                         episode_info,
+                                                         &row_refs);
+    if (absl::IsFailedPrecondition(status)) {
+      return absl::FailedPreconditionError(
+          "Append/AppendPartial called with data containing column that was "
+          "present in previous AppendPartial call.");
+    }
+    REVERB_RETURN_IF_ERROR(status);
+    for (int i = 0; i < inline_columns_.size(); i++) {
+      inline_refs[inline_columns_[i]] = std::move(row_refs[i]);
     }
   }
 
   // Append data to respective column chunker.
   for (int i = 0; i < data.size(); i++) {
+    if (auto it = inline_refs.find(i); it != inline_refs.end()) {
+      refs->push_back(std::move(it->second));
+      continue;
+    }
     if (!data[i].has_value()) {
       refs->push_back(absl::nullopt);
       continue;
     }
 
     std::weak_ptr<CellRef> ref;
-    absl::Status status =
-        chunkers_[i]->Append(data[i].value(), episode_info, &ref);
+    absl::Status status = chunkers_[i]->Append(std::move(data[i]).value(),
+                                               episode_info, &ref);
     if (absl::IsFailedPrecondition(status)) {
       return absl::FailedPreconditionError(
           "Append/AppendPartial called with data containing column that was "
@@ -419,9 +659,10 @@ absl::Status TrajectoryWriter::AppendInternal(
   return absl::OkStatus();
 }
 
-absl::Status TrajectoryWriter::CreateItem(
+absl::Status TrajectoryWriter::BuildItem(
     absl::string_view table, double priority,
-    absl::Span<const TrajectoryColumn> trajectory) {
+    absl::Span<const TrajectoryColumn> trajectory,
+    std::unique_ptr<ItemAndRefs>* item_and_refs) {
   if (trajectory.empty() ||
       std::all_of(trajectory.begin(), trajectory.end(),
                   [](const TrajectoryColumn& col) { return col.empty(); })) {
@@ -433,7 +674,7 @@ absl::Status TrajectoryWriter::CreateItem(
     REVERB_RETURN_IF_ERROR(unrecoverable_status_);
   }
 
-  auto item_and_refs = std::make_unique<ItemAndRefs>();
+  *item_and_refs = std::make_unique<ItemAndRefs>();
 
   // Lock all the references to ensure that the underlying data is not
   // deallocated before the worker has successfully written the item (and data)
@@ -443,30 +684,83 @@ absl::Status TrajectoryWriter::CreateItem(
       return absl::InvalidArgumentError(
           absl::StrCat("Error in column ", col_idx, ": ", status.message()));
     }
-    if (!trajectory[col_idx].LockReferences(&item_and_refs->refs)) {
+    if (!trajectory[col_idx].LockReferences(&(*item_and_refs)->refs)) {
       return absl::InternalError("CellRef unexpectedly expired in CreateItem.");
     }
   }
 
-  item_and_refs->item.set_key(key_generator_->Generate());
-  item_and_refs->item.set_table(table.data(), table.size());
-  item_and_refs->item.set_priority(priority);
+  (*item_and_refs)->item.set_key(key_generator_->Generate());
+  (*item_and_refs)->item.set_table(table.data(), table.size());
+  (*item_and_refs)->item.set_priority(priority);
 
   for (const TrajectoryColumn& column : trajectory) {
     column.ToProto(
-        item_and_refs->item.mutable_flat_trajectory()->add_columns());
+        (*item_and_refs)->item.mutable_flat_trajectory()->add_columns());
   }
 
-  REVERB_RETURN_IF_ERROR(item_and_refs->Validate(options_));
+  if (!options_.flat_signature_map.has_value()) {
+    return absl::OkStatus();
+  }
 
+  // A writer produces identically shaped items until its configuration
+  // changes, so the full signature comparison only needs to run when the
+  // column layout differs from the last item validated against the table.
+  const size_t layout_hash = TrajectorySignatureHash(
+      (*item_and_refs)->item.flat_trajectory(), (*item_and_refs)->refs);
+  auto layout_it = validated_layouts_.find(table);
+  if (layout_it != validated_layouts_.end() &&
+      layout_it->second == layout_hash) {
+    return absl::OkStatus();
+  }
+  REVERB_RETURN_IF_ERROR((*item_and_refs)->Validate(options_));
+  validated_layouts_[std::string(table)] = layout_hash;
+  return absl::OkStatus();
+}
+
+absl::Status TrajectoryWriter::CreateItem(
+    absl::string_view table, double priority,
+    absl::Span<const TrajectoryColumn> trajectory) {
+  std::unique_ptr<ItemAndRefs> item_and_refs;
+  REVERB_RETURN_IF_ERROR(
+      BuildItem(table, priority, trajectory, &item_and_refs));
+
+  int stream_idx;
   {
     absl::MutexLock lock(&mu_);
-    write_queue_.push_back(std::move(item_and_refs));
+    stream_idx = active_stream_;
+    if (stream_idx == 0) {
+      write_queue_.push_back(std::move(item_and_refs));
+      return absl::OkStatus();
+    }
   }
 
+  // The active episode is assigned to one of the additional streams. The
+  // stream worker of that writer resends any referenced chunks it has not
+  // already transmitted so the item is self contained.
+  additional_stream_writers_[stream_idx - 1]->EnqueueItem(
+      std::move(item_and_refs));
+
+  return absl::OkStatus();
+}
+
+absl::Status TrajectoryWriter::CreateDeferredItem(
+    absl::string_view table, absl::Span<const TrajectoryColumn> trajectory,
+    uint64_t* key) {
+  std::unique_ptr<ItemAndRefs> item_and_refs;
+  REVERB_RETURN_IF_ERROR(
+      BuildItem(table, /*priority=*/0, trajectory, &item_and_refs));
+  *key = item_and_refs->item.key();
+
+  absl::MutexLock lock(&mu_);
+  deferred_items_.push_back(std::move(item_and_refs));
   return absl::OkStatus();
 }
 
+void TrajectoryWriter::EnqueueItem(std::unique_ptr<ItemAndRefs> item_and_refs) {
+  absl::MutexLock lock(&mu_);
+  write_queue_.push_back(std::move(item_and_refs));
+}
+
 void TrajectoryWriter::Close() {
   {
     absl::MutexLock lock(&mu_);
@@ -489,6 +783,10 @@ void TrajectoryWriter::Close() {
 
   // Join the worker thread.
   stream_worker_ = nullptr;
+
+  for (auto& writer : additional_stream_writers_) {
+    writer->Close();
+  }
 }
 
 void TrajectoryWriter::OnReadDone(bool ok) {
@@ -501,6 +799,7 @@ void TrajectoryWriter::OnReadDone(bool ok) {
   for (uint64_t key : response_.keys()) {
     in_flight_items_.erase(key);
   }
+  CompletePendingFlushesLocked();
   StartRead(&response_);
 }
 
@@ -585,9 +884,50 @@ internal::flat_hash_set<uint64_t> TrajectoryWriter::GetKeepKeys(
   return keys;
 }
 
+void TrajectoryWriter::SeedStreamedChunkKeysFromServer(
+    internal::flat_hash_set<uint64_t>* streamed_chunk_keys) {
+  QueryReceivedChunksRequest request;
+  request.set_writer_id(writer_id_);
+  {
+    absl::MutexLock lock(&mu_);
+    internal::flat_hash_set<uint64_t> candidates;
+    for (const auto& item : write_queue_) {
+      for (const std::shared_ptr<CellRef>& ref : item->refs) {
+        if (ref->IsReady()) {
+          candidates.insert(ref->chunk_key());
+        }
+      }
+    }
+    for (uint64_t key : candidates) {
+      request.add_chunk_keys(key);
+    }
+  }
+  if (request.chunk_keys().empty()) return;
+
+  grpc::ClientContext context;
+  context.set_deadline(
+      absl::ToChronoTime(absl::Now() + kQueryReceivedChunksTimeout));
+  QueryReceivedChunksResponse response;
+  // Failures are not fatal; the chunks are simply retransmitted as if the
+  // server had not cached anything.
+  if (!stub_->QueryReceivedChunks(&context, request, &response).ok()) {
+    return;
+  }
+  for (uint64_t key : response.chunk_keys()) {
+    streamed_chunk_keys->insert(key);
+  }
+}
+
 absl::Status TrajectoryWriter::RunStreamWorker() {
-  REVERB_RETURN_IF_ERROR(SetContextAndCreateStream());
   internal::flat_hash_set<uint64_t> streamed_chunk_keys;
+  if (first_stream_) {
+    first_stream_ = false;
+  } else {
+    // This stream replaces one that broke; chunks the server still caches for
+    // this writer do not have to be retransmitted.
+    SeedStreamedChunkKeysFromServer(&streamed_chunk_keys);
+  }
+  REVERB_RETURN_IF_ERROR(SetContextAndCreateStream());
   ArenaOwnedRequest request;
 
   // How many more items to add to the current request. When a new request is
@@ -646,9 +986,23 @@ absl::Status TrajectoryWriter::RunStreamWorker() {
       streamed_chunk_keys = GetKeepKeys(streamed_chunk_keys);
     }
 
-    for (auto& [_, chunker] : chunkers_) {
-      REVERB_RETURN_IF_ERROR(
-          chunker->OnItemFinalized(item_and_refs->item, item_and_refs->refs));
+    // Notify the chunkers which own cells referenced by the item. We reach
+    // the chunkers through the refs (rather than through `chunkers_`) so
+    // that writers which do not own any chunkers themselves (the additional
+    // insert streams) notify the chunkers of the parent writer.
+    internal::flat_hash_set<Chunker*> notified_chunkers;
+    for (const std::shared_ptr<CellRef>& ref : item_and_refs->refs) {
+      std::shared_ptr<Chunker> chunker = ref->chunker().lock();
+      if (chunker == nullptr) {
+        return absl::FailedPreconditionError(absl::StrCat(
+            "Unable to lock the weak_ptr for the chunker associated with "
+            "chunk_key: ",
+            ref->chunk_key()));
+      }
+      if (notified_chunkers.insert(chunker.get()).second) {
+        REVERB_RETURN_IF_ERROR(
+            chunker->OnItemFinalized(item_and_refs->item, item_and_refs->refs));
+      }
     }
 
     // All chunks have been written to the stream so the item can now be
@@ -664,14 +1018,144 @@ absl::Status TrajectoryWriter::RunStreamWorker() {
   return Finish();
 }
 
+TrajectoryWriter::FlushHandle::FlushHandle(
+    std::function<void(absl::Status)> on_done)
+    : on_done_(std::move(on_done)) {}
+
+absl::Status TrajectoryWriter::FlushHandle::Await(absl::Duration timeout) {
+  absl::MutexLock lock(&mu_);
+  auto done = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return status_.has_value();
+  };
+  if (!mu_.AwaitWithTimeout(absl::Condition(&done), timeout)) {
+    return absl::DeadlineExceededError(
+        "Timeout exceeded before the flush completed.");
+  }
+  return *status_;
+}
+
+bool TrajectoryWriter::FlushHandle::Done() const {
+  absl::MutexLock lock(&mu_);
+  return status_.has_value();
+}
+
+void TrajectoryWriter::FlushHandle::Complete(absl::Status status) {
+  std::function<void(absl::Status)> on_done;
+  {
+    absl::MutexLock lock(&mu_);
+    if (status_.has_value()) return;
+    status_ = status;
+    on_done = std::move(on_done_);
+  }
+  if (on_done) {
+    on_done(std::move(status));
+  }
+}
+
 absl::Status TrajectoryWriter::Flush(int ignore_last_num_items,
                                      absl::Duration timeout) {
-  absl::MutexLock lock(&mu_);
-  return FlushLocked(ignore_last_num_items, timeout);
+  const absl::Time deadline = absl::Now() + timeout;
+  int stream_idx;
+  {
+    absl::MutexLock lock(&mu_);
+    stream_idx = active_stream_;
+    // `ignore_last_num_items` limits the run ahead of the active episode so
+    // it only applies to the stream which receives its items. The other
+    // streams can only hold items of completed episodes which should all be
+    // sent.
+    REVERB_RETURN_IF_ERROR(FlushLocked(
+        stream_idx == 0 ? ignore_last_num_items : 0, timeout));
+  }
+  for (int i = 0; i < additional_stream_writers_.size(); i++) {
+    REVERB_RETURN_IF_ERROR(additional_stream_writers_[i]->Flush(
+        i + 1 == stream_idx ? ignore_last_num_items : 0,
+        deadline - absl::Now()));
+  }
+  return absl::OkStatus();
 }
 
-absl::Status TrajectoryWriter::FlushLocked(int ignore_last_num_items,
-                                           absl::Duration timeout) {
+absl::Status TrajectoryWriter::FlushAsync(
+    std::shared_ptr<FlushHandle>* handle, int ignore_last_num_items,
+    std::function<void(absl::Status)> on_done) {
+  if (additional_stream_writers_.empty()) {
+    absl::MutexLock lock(&mu_);
+    return FlushAsyncLocked(handle, ignore_last_num_items, std::move(on_done));
+  }
+
+  // With multiple streams a combined handle is created which completes once
+  // the flushes of all streams have completed. The first error (if any)
+  // completes the handle early; `Complete` ignores all calls but the first.
+  auto combined = std::make_shared<FlushHandle>(std::move(on_done));
+  auto num_remaining = std::make_shared<std::atomic<int>>(
+      1 + static_cast<int>(additional_stream_writers_.size()));
+  auto completion = [combined, num_remaining](absl::Status status) {
+    if (!status.ok()) {
+      combined->Complete(status);
+    }
+    if (num_remaining->fetch_sub(1) == 1) {
+      combined->Complete(absl::OkStatus());
+    }
+  };
+
+  int stream_idx;
+  std::shared_ptr<FlushHandle> sub_handle;
+  {
+    absl::MutexLock lock(&mu_);
+    stream_idx = active_stream_;
+    REVERB_RETURN_IF_ERROR(FlushAsyncLocked(
+        &sub_handle, stream_idx == 0 ? ignore_last_num_items : 0, completion));
+  }
+  for (int i = 0; i < additional_stream_writers_.size(); i++) {
+    REVERB_RETURN_IF_ERROR(additional_stream_writers_[i]->FlushAsync(
+        &sub_handle, i + 1 == stream_idx ? ignore_last_num_items : 0,
+        completion));
+  }
+
+  *handle = std::move(combined);
+  return absl::OkStatus();
+}
+
+absl::Status TrajectoryWriter::FlushAsyncLocked(
+    std::shared_ptr<FlushHandle>* handle, int ignore_last_num_items,
+    std::function<void(absl::Status)> on_done) {
+  REVERB_RETURN_IF_ERROR(unrecoverable_status_);
+  REVERB_RETURN_IF_ERROR(
+      FinalizeChunksOfPendingItemsLocked(ignore_last_num_items));
+
+  *handle = std::make_shared<FlushHandle>(std::move(on_done));
+  pending_flushes_.push_back({ignore_last_num_items, *handle});
+
+  // The flush may already be fulfilled, e.g if there are no pending items.
+  CompletePendingFlushesLocked();
+
+  return absl::OkStatus();
+}
+
+void TrajectoryWriter::CompletePendingFlushesLocked() {
+  if (pending_flushes_.empty()) return;
+
+  if (!unrecoverable_status_.ok()) {
+    for (PendingFlush& pending : pending_flushes_) {
+      pending.handle->Complete(unrecoverable_status_);
+    }
+    pending_flushes_.clear();
+    return;
+  }
+
+  const int num_unconfirmed_items =
+      write_queue_.size() + in_flight_items_.size();
+  for (auto it = pending_flushes_.begin(); it != pending_flushes_.end();) {
+    if (num_unconfirmed_items <= it->max_num_unconfirmed_items) {
+      it->handle->Complete(absl::OkStatus());
+      it = pending_flushes_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+absl::Status TrajectoryWriter::FinalizeChunksOfPendingItemsLocked(
+    int ignore_last_num_items) {
   // If items are referencing any data which has not yet been finalized into a
   // `ChunkData` then force the chunk to be created prematurely. This will allow
   // the worker to write all items to the stream. Note that we don't need to
@@ -692,6 +1176,14 @@ absl::Status TrajectoryWriter::FlushLocked(int ignore_last_num_items,
   // can be woken up.
   data_cv_.Signal();
 
+  return absl::OkStatus();
+}
+
+absl::Status TrajectoryWriter::FlushLocked(int ignore_last_num_items,
+                                           absl::Duration timeout) {
+  REVERB_RETURN_IF_ERROR(
+      FinalizeChunksOfPendingItemsLocked(ignore_last_num_items));
+
   // The write worker is now able to send  (at least) all but the last
   // `ignore_last_num_items` items to the server. We release the mutex and wait
   // for the items to be confirmed or the TrajectoryWriter to be closed.
@@ -716,10 +1208,23 @@ absl::Status TrajectoryWriter::FlushLocked(int ignore_last_num_items,
 
 absl::Status TrajectoryWriter::EndEpisode(bool clear_buffers,
                                           absl::Duration timeout) {
-  absl::MutexLock lock(&mu_);
-  REVERB_RETURN_IF_ERROR(unrecoverable_status_);
+  REVERB_RETURN_IF_ERROR(ResolveStagedStep(clear_buffers));
+  const absl::Time deadline = absl::Now() + timeout;
+  {
+    absl::MutexLock lock(&mu_);
+    REVERB_RETURN_IF_ERROR(unrecoverable_status_);
+    if (!deferred_items_.empty()) {
+      return absl::FailedPreconditionError(
+          "EndEpisode called while deferred items are awaiting their "
+          "priorities; use the overload which takes a priority map.");
+    }
+    REVERB_RETURN_IF_ERROR(FlushLocked(0, timeout));
+  }
+  for (auto& writer : additional_stream_writers_) {
+    REVERB_RETURN_IF_ERROR(writer->Flush(0, deadline - absl::Now()));
+  }
 
-  REVERB_RETURN_IF_ERROR(FlushLocked(0, timeout));
+  absl::MutexLock lock(&mu_);
 
   for (auto& [_, chunker] : chunkers_) {
     if (clear_buffers) {
@@ -734,6 +1239,108 @@ absl::Status TrajectoryWriter::EndEpisode(bool clear_buffers,
 
   episode_id_ = key_generator_->Generate();
   episode_step_ = 0;
+  if (!additional_stream_writers_.empty()) {
+    active_stream_ =
+        (active_stream_ + 1) % (additional_stream_writers_.size() + 1);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status TrajectoryWriter::EndEpisode(
+    const internal::flat_hash_map<uint64_t, double>& priorities,
+    bool clear_buffers, absl::Duration timeout) {
+  REVERB_RETURN_IF_ERROR(ResolveStagedStep(clear_buffers));
+  int stream_idx;
+  std::vector<std::unique_ptr<ItemAndRefs>> items_to_send;
+  {
+    absl::MutexLock lock(&mu_);
+    REVERB_RETURN_IF_ERROR(unrecoverable_status_);
+
+    // Since the keys of the deferred items are unique, equal sizes combined
+    // with every item finding its priority below means that `priorities` is
+    // an exact match for the deferred items.
+    if (priorities.size() != deferred_items_.size()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "priorities must contain exactly one entry per deferred item; got ",
+          priorities.size(), " priorities for ", deferred_items_.size(),
+          " deferred items."));
+    }
+    for (auto& item_and_refs : deferred_items_) {
+      auto it = priorities.find(item_and_refs->item.key());
+      if (it == priorities.end()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("priorities is missing an entry for deferred item ",
+                         item_and_refs->item.key(), "."));
+      }
+      item_and_refs->item.set_priority(it->second);
+    }
+
+    items_to_send = std::move(deferred_items_);
+    deferred_items_.clear();
+
+    stream_idx = active_stream_;
+    if (stream_idx == 0) {
+      for (auto& item_and_refs : items_to_send) {
+        write_queue_.push_back(std::move(item_and_refs));
+      }
+    }
+  }
+  if (stream_idx != 0) {
+    for (auto& item_and_refs : items_to_send) {
+      additional_stream_writers_[stream_idx - 1]->EnqueueItem(
+          std::move(item_and_refs));
+    }
+  }
+
+  // The burst of items is now pending like any other created items so the
+  // flushing (and episode reset) of the regular `EndEpisode` applies.
+  return EndEpisode(clear_buffers, timeout);
+}
+
+absl::Status TrajectoryWriter::EndEpisodeAsync(
+    bool clear_buffers, std::shared_ptr<FlushHandle>* handle,
+    std::function<void(absl::Status)> on_done) {
+  REVERB_RETURN_IF_ERROR(ResolveStagedStep(clear_buffers));
+  {
+    absl::MutexLock lock(&mu_);
+    if (!deferred_items_.empty()) {
+      return absl::FailedPreconditionError(
+          "EndEpisodeAsync called while deferred items are awaiting their "
+          "priorities; use the EndEpisode overload which takes a priority "
+          "map.");
+    }
+  }
+
+  // Registers the handle(s) and forces finalization of all chunks referenced
+  // by pending items. This has to happen before the chunkers are reset below
+  // as resetting drops buffered data which has not been finalized into
+  // chunks.
+  REVERB_RETURN_IF_ERROR(
+      FlushAsync(handle, /*ignore_last_num_items=*/0, std::move(on_done)));
+
+  absl::MutexLock lock(&mu_);
+  REVERB_RETURN_IF_ERROR(unrecoverable_status_);
+
+  for (auto& [_, chunker] : chunkers_) {
+    if (clear_buffers) {
+      chunker->Reset();
+    } else {
+      // This call should NEVER fail but if it does then we will not be able to
+      // recover from it.
+      unrecoverable_status_ = chunker->Flush();
+      if (!unrecoverable_status_.ok()) {
+        CompletePendingFlushesLocked();
+        return unrecoverable_status_;
+      }
+    }
+  }
+
+  episode_id_ = key_generator_->Generate();
+  episode_step_ = 0;
+  if (!additional_stream_writers_.empty()) {
+    active_stream_ =
+        (active_stream_ + 1) % (additional_stream_writers_.size() + 1);
+  }
   return absl::OkStatus();
 }
 
@@ -785,9 +1392,10 @@ absl::Status TrajectoryColumn::Validate() const {
 
   // Check that the column only contains compatible data references.
   const internal::TensorSpec& col_spec =
-      locked_refs[0]->chunker().lock()->spec();
+      locked_refs[0]->chunker().lock()->spec(locked_refs[0]->chunk_column());
   for (int i = 1; i < locked_refs.size(); ++i) {
-    const internal::TensorSpec& spec = locked_refs[i]->chunker().lock()->spec();
+    const internal::TensorSpec& spec =
+        locked_refs[i]->chunker().lock()->spec(locked_refs[i]->chunk_column());
     if (spec.dtype != col_spec.dtype) {
       return absl::InvalidArgumentError(absl::StrCat(
           "Column references tensors with different dtypes: ",
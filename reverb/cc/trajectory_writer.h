@@ -16,6 +16,7 @@
 #define REVERB_CC_TRAJECTORY_WRITER_H_
 
 #include <deque>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string_view>
@@ -155,6 +156,10 @@ class ColumnWriter {
   // the value is given. The remaining elements will hold `absl::nullopt`. The
   // references should be used to define the trajectory in `CreateItem`.
   //
+  // The tensors in `data` are donated to the writer; their buffers are held by
+  // reference (not copied) until the chunk they belong to is finalized and
+  // compressed. Callers must not mutate the underlying buffers after the call.
+  //
   // TODO(b/178085792): Figure out how episode information should be handled.
   // TODO(b/178085755): Decide how to manage partially invalid data.
   virtual absl::Status Append(
@@ -245,6 +250,71 @@ class TrajectoryWriter : public ColumnWriter,
     // knowledge whatsoever about the tables.
     absl::optional<internal::FlatSignatureMap> flat_signature_map =
         absl::nullopt;
+
+    // If set then chunk finalization (delta encoding and compression) is
+    // offloaded to this executor instead of running inline in `Append`. When
+    // null (the default) chunks are finalized synchronously.
+    std::shared_ptr<TaskExecutor> compression_executor = nullptr;
+
+    // Number of parallel `InsertStream` connections used to upload chunks and
+    // items. A single stream is limited to one connection's worth of gRPC
+    // flow-control window which can cap very high throughput writers. When
+    // larger than 1 the episodes are assigned to the streams in a round robin
+    // fashion; all items created during an episode are sent on the stream of
+    // that episode and each stream (re)transmits the chunks its items
+    // reference. The public API is unaffected by this option.
+    int num_insert_streams = 1;
+
+    // If larger than 0 then columns whose per step payload is at most this
+    // many bytes are packed into a single combined chunker instead of each
+    // cutting their own chunks. Scalar signals (reward, discount, done flags,
+    // ...) otherwise produce one chunk per column whose metadata dwarfs the
+    // payload, inflating the number of chunks the server must track. The
+    // group is formed from the small fixed size columns present the first
+    // time data is appended; small columns that first appear later get their
+    // own chunker and if an `Append` call only provides a subset of the group
+    // then the group is dissolved and its columns continue as individual
+    // chunkers. Columns configured with `ConfigureChunker` are never grouped.
+    // 0 (the default) gives every column its own chunker.
+    size_t max_inline_column_bytes = 0;
+
+    // If true then `AppendPartial` calls only stage their tensors into a per
+    // step buffer and all chunker interaction happens once, when the closing
+    // `Append` call combines the staged columns with its own data. Agents
+    // that build a step across many partial calls (one per module) thereby
+    // pay the column bookkeeping once per step instead of once per call. The
+    // trade off is that `AppendPartial` returns null references for all of
+    // its columns; the closing `Append` returns the references of the entire
+    // combined step, so trajectories can only use columns of a step once the
+    // step has been closed. `EndEpisode` fails while a staged step is open
+    // unless buffers are cleared. False (the default) forwards every call to
+    // the chunkers as it arrives.
+    bool combine_partial_appends = false;
+
+    // Admission class announced on the writer's insert streams. When the
+    // pending insert queue of a table on the server fills up, streams of a
+    // lower class are backpressured first while higher class streams keep
+    // flowing (see `InsertStreamRequest.admission_class`). Mark bulk or
+    // exploration writers with a negative class so that they yield to more
+    // important writers sharing the table under load. 0 (the default) keeps
+    // the regular backpressure threshold.
+    int32_t admission_class = 0;
+
+    // If non empty then `StreamingTrajectoryWriter` spools insert requests to
+    // TFRecord files in this directory when the stream breaks and cannot be
+    // resumed (e.g. the server restarted), instead of failing the episodes
+    // written during the outage. A background thread replays the spool once
+    // connectivity returns. Spooled items count as accepted by `Flush`; they
+    // are delivered asynchronously and duplicates created by replay retries
+    // are deduplicated by the server on the item key. Only used by
+    // `StreamingTrajectoryWriter`. Empty (the default) disables spooling.
+    std::string insert_spool_dir;
+
+    // Upper bound on the total size of the spool. When an outage outlasts
+    // the bound the oldest spool file is dropped (and its episodes lost),
+    // bounding disk usage like a ring buffer. Only used when
+    // `insert_spool_dir` is set.
+    int64_t insert_spool_max_bytes = int64_t{1} << 30;  // 1GB.
   };
 
   struct ItemAndRefs {
@@ -261,6 +331,41 @@ class TrajectoryWriter : public ColumnWriter,
     std::vector<std::shared_ptr<CellRef>> refs;
   };
 
+  // Completion handle returned by `FlushAsync` and `EndEpisodeAsync`. The
+  // handle completes once the server has confirmed the flushed items, or with
+  // the unrecoverable error of the writer (`CancelledError` if the writer is
+  // closed first). All methods are thread safe and the handle may outlive the
+  // writer.
+  class FlushHandle {
+   public:
+    // If `on_done` is provided then it is invoked exactly once with the final
+    // status when the handle completes. The callback runs on the thread which
+    // completed the flush (most likely the stream worker) while the writer
+    // mutex is held so it must be cheap and must not call back into the
+    // writer.
+    explicit FlushHandle(std::function<void(absl::Status)> on_done = nullptr);
+
+    // Blocks until the flush has completed or `timeout` expires. Returns
+    // `DeadlineExceededError` if the timeout expired, otherwise the status of
+    // the flush.
+    absl::Status Await(absl::Duration timeout = absl::InfiniteDuration())
+        ABSL_LOCKS_EXCLUDED(mu_);
+
+    // True iff the flush has completed (successfully or not).
+    bool Done() const ABSL_LOCKS_EXCLUDED(mu_);
+
+   private:
+    friend class TrajectoryWriter;
+
+    // Unblocks `Await` calls and invokes the callback (if any). Calls after
+    // the first are noops.
+    void Complete(absl::Status status) ABSL_LOCKS_EXCLUDED(mu_);
+
+    mutable absl::Mutex mu_;
+    absl::optional<absl::Status> status_ ABSL_GUARDED_BY(mu_);
+    std::function<void(absl::Status)> on_done_ ABSL_GUARDED_BY(mu_);
+  };
+
   // TODO(b/178084425): Allow chunking options to be specified for each column.
   // TODO(b/178085651): Support initiation using the table signature.
   explicit TrajectoryWriter(
@@ -287,16 +392,72 @@ class TrajectoryWriter : public ColumnWriter,
                           absl::Span<const TrajectoryColumn> trajectory)
       override ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Same as `CreateItem` except that the priority is provided later. The item
+  // is validated and then held by the writer (the rows it references are kept
+  // alive just like for pending items) until `EndEpisode` is called with a
+  // priority for every held item, at which point all of them are pushed to
+  // the stream in a single burst. The generated key of the item is returned
+  // through `key`; it identifies the item in the priority map passed to
+  // `EndEpisode`.
+  //
+  // This removes the need to buffer entire episodes outside the writer when
+  // priorities can only be computed once the episode has ended (e.g TD error
+  // based priorities).
+  //
+  // Deferred items are not visible to `Flush`; they are only sent by the
+  // priority taking `EndEpisode` overload. Items still deferred when the
+  // writer is closed are dropped.
+  absl::Status CreateDeferredItem(absl::string_view table,
+                                  absl::Span<const TrajectoryColumn> trajectory,
+                                  uint64_t* key) ABSL_LOCKS_EXCLUDED(mu_);
+
   // See `ColumnWriter::Flush` above.
   absl::Status Flush(int ignore_last_num_items = 0,
                      absl::Duration timeout = absl::InfiniteDuration()) override
       ABSL_LOCKS_EXCLUDED(mu_);
 
-  // See `ColumnWriter::EndEpisode` above.
+  // Nonblocking version of `Flush`. Incomplete chunks referenced by the items
+  // to be sent are finalized and `handle` is populated without waiting for
+  // the items to be confirmed by the server. The handle (and `on_done`, see
+  // `FlushHandle`) completes once the number of unconfirmed items has dropped
+  // to `ignore_last_num_items` or below, or with the unrecoverable error of
+  // the writer.
+  absl::Status FlushAsync(std::shared_ptr<FlushHandle>* handle,
+                          int ignore_last_num_items = 0,
+                          std::function<void(absl::Status)> on_done = nullptr)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // See `ColumnWriter::EndEpisode` above. Returns `FailedPreconditionError`
+  // if any `CreateDeferredItem` items have not yet received their priorities;
+  // use the overload below to finalize such episodes.
   absl::Status EndEpisode(
       bool clear_buffers,
       absl::Duration timeout = absl::InfiniteDuration()) override;
 
+  // Same as `EndEpisode` above but first assigns `priorities` (keyed by the
+  // values returned by `CreateDeferredItem`) to the items held by the writer
+  // and pushes them to the stream in one burst. Every deferred item must be
+  // covered by `priorities` and every key in `priorities` must match a
+  // deferred item; otherwise `InvalidArgumentError` is returned and no item
+  // is sent (the items remain deferred so the call can be retried with a
+  // corrected map).
+  absl::Status EndEpisode(
+      const internal::flat_hash_map<uint64_t, double>& priorities,
+      bool clear_buffers, absl::Duration timeout = absl::InfiniteDuration())
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Nonblocking version of `EndEpisode`. All chunks are finalized (or, when
+  // `clear_buffers` is true, unreferenced buffers dropped) and the episode
+  // state is reset right away so the caller can start appending the next
+  // episode immediately. The returned `handle` completes once all items
+  // created before the call have been confirmed by the server. Like
+  // `EndEpisode(bool, ...)` this returns `FailedPreconditionError` if any
+  // deferred items are still awaiting their priorities.
+  absl::Status EndEpisodeAsync(
+      bool clear_buffers, std::shared_ptr<FlushHandle>* handle,
+      std::function<void(absl::Status)> on_done = nullptr)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // Closes the stream, joins the worker thread and unblocks any concurrent
   // `Flush` call. All future (and concurrent) calls returns CancelledError once
   void Close() ABSL_LOCKS_EXCLUDED(mu_);
@@ -304,7 +465,10 @@ class TrajectoryWriter : public ColumnWriter,
   // Attempts to configure a column `Chunker` (see `Chunker::Configure` for
   // details). If no `Chunker` exists for the column then the options will be
   // used to create the chunker when the column is present for the first time
-  // in the data of an `Append` call.
+  // in the data of an `Append` call. Note that if the column has already been
+  // grouped into a combined small column chunker (see
+  // `Options::max_inline_column_bytes`) then the config applies to the entire
+  // group.
   absl::Status ConfigureChunker(int column,
                                 const std::shared_ptr<ChunkerOptions>& options);
 
@@ -325,6 +489,14 @@ class TrajectoryWriter : public ColumnWriter,
       absl::Span<const std::shared_ptr<CellRef>> refs,
       ArenaOwnedRequest* request);
 
+  // Validates `trajectory`, locks the referenced rows and builds the item
+  // proto without enqueueing it. Shared by `CreateItem` and
+  // `CreateDeferredItem`.
+  absl::Status BuildItem(absl::string_view table, double priority,
+                         absl::Span<const TrajectoryColumn> trajectory,
+                         std::unique_ptr<ItemAndRefs>* item_and_refs)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // See `Append` and `AppendPartial`.
   absl::Status AppendInternal(
       std::vector<absl::optional<tensorflow::Tensor>> data,
@@ -332,12 +504,45 @@ class TrajectoryWriter : public ColumnWriter,
       std::vector<absl::optional<std::weak_ptr<CellRef>>>* refs)
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Moves the columns of `data` into `staged_step_` (see
+  // `Options::combine_partial_appends`). Returns `FailedPreconditionError`
+  // when a column of `data` has already been staged for the open step.
+  absl::Status StageStep(std::vector<absl::optional<tensorflow::Tensor>>* data);
+
+  // Fails with `FailedPreconditionError` when a step staged by
+  // `AppendPartial` has not been closed with `Append`, unless
+  // `clear_buffers` is true in which case the staged step is dropped with
+  // the rest of the episode. Called by the `EndEpisode` variants.
+  absl::Status ResolveStagedStep(bool clear_buffers);
+
   // Sends all but the last `ignore_last_num_items` pending items and awaits
   // confirmation. Incomplete chunks referenced by non ignored items are
   // finalized and transmitted.
   absl::Status FlushLocked(int ignore_last_num_items, absl::Duration timeout)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Forces the finalization of incomplete chunks referenced by all but the
+  // last `ignore_last_num_items` items in `write_queue_` and wakes up the
+  // stream worker. Shared by `FlushLocked` and `FlushAsyncLocked`.
+  absl::Status FinalizeChunksOfPendingItemsLocked(int ignore_last_num_items)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // See `FlushAsync`.
+  absl::Status FlushAsyncLocked(std::shared_ptr<FlushHandle>* handle,
+                                int ignore_last_num_items,
+                                std::function<void(absl::Status)> on_done)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Pushes an item created (and validated) by the parent writer to
+  // `write_queue_`. Only used on the additional stream writers.
+  void EnqueueItem(std::unique_ptr<ItemAndRefs> item_and_refs)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Completes (and removes) all pending `FlushAsync` handles whose condition
+  // is fulfilled. Called whenever the number of unconfirmed items shrinks and
+  // when `unrecoverable_status_` is set.
+  void CompletePendingFlushesLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   // Creates a gRPC stream to the server with `context_` and continues to run
   // until `closed_` set or until an error is encountered. In both cases
   // `Finish` is called on the stream and the status returned to the caller.
@@ -380,6 +585,16 @@ class TrajectoryWriter : public ColumnWriter,
       const internal::flat_hash_set<uint64_t>& streamed_chunk_keys) const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Asks the server which of the chunks referenced by pending items it still
+  // caches for this writer (see `QueryReceivedChunks` in
+  // reverb_service.proto) and inserts the returned keys into
+  // `streamed_chunk_keys` so they are not retransmitted. Best effort; if the
+  // call fails then nothing is seeded and all chunks are sent as before.
+  // Called when a new stream replaces one that broke.
+  void SeedStreamedChunkKeysFromServer(
+      internal::flat_hash_set<uint64_t>* streamed_chunk_keys)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // Stub used to create InsertStream gRPC streams.
   std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub_;
 
@@ -389,15 +604,49 @@ class TrajectoryWriter : public ColumnWriter,
   // Used to generates keys for episode and item IDs.
   std::unique_ptr<internal::KeyGenerator> key_generator_;
 
+  // Identifies this writer on the insert streams it opens so that the server
+  // can cache received chunks across reconnects.
+  const uint64_t writer_id_;
+
   // Override of default options for yet to be constructed chunkers.
   internal::flat_hash_map<int, std::shared_ptr<ChunkerOptions>>
       options_override_;
 
   // Mapping from column index to Chunker. Shared pointers are used as the
   // `CellRef`s created by the chunker will own a weak_ptr created using
-  // `weak_from_this()` on the Chunker.
+  // `weak_from_this()` on the Chunker. Columns grouped by
+  // `Options::max_inline_column_bytes` all map to `inline_chunker_`.
   internal::flat_hash_map<int, std::shared_ptr<Chunker>> chunkers_;
 
+  // Combined chunker shared by the columns grouped by
+  // `Options::max_inline_column_bytes`, or nullptr if no group has been
+  // formed. Retained after the group has been dissolved so that pending
+  // asynchronous compression can be drained on destruction.
+  std::shared_ptr<Chunker> inline_chunker_;
+
+  // Hash of the most recently validated trajectory column layout, per table.
+  // A writer produces identically shaped items until its configuration
+  // changes, so `BuildItem` skips the full signature comparison when the
+  // layout hash of a new item matches the last one validated against the
+  // same table. Like `chunkers_`, only accessed by the thread calling the
+  // write methods.
+  internal::flat_hash_map<std::string, size_t> validated_layouts_;
+
+  // Writer columns packed into `inline_chunker_`, ordered by their tensor
+  // index within its chunks. Empty iff `inline_chunker_` is nullptr.
+  std::vector<int> inline_columns_;
+
+  // True once forming the group has been attempted (on the first `Append`
+  // call) or the group has been dissolved; small columns encountered from
+  // then on get individual chunkers.
+  bool inline_group_decided_ = false;
+
+  // Columns staged by `AppendPartial` calls of the open step when
+  // `Options::combine_partial_appends` is set. Consumed (and the chunkers
+  // updated) by the closing `Append` call. Like `chunkers_`, only accessed
+  // by the thread calling the write methods.
+  std::vector<absl::optional<tensorflow::Tensor>> staged_step_;
+
   mutable absl::Mutex mu_;
 
   // ID of the active episode.
@@ -417,6 +666,13 @@ class TrajectoryWriter : public ColumnWriter,
   // Items waiting for `stream_worker_` to write it to the steam.
   std::deque<std::unique_ptr<ItemAndRefs>> write_queue_ ABSL_GUARDED_BY(mu_);
 
+  // Items created by `CreateDeferredItem` which have not yet received their
+  // priorities. Held in creation order (keeping the referenced data alive)
+  // until the priority taking `EndEpisode` overload pushes them to
+  // `write_queue_`.
+  std::vector<std::unique_ptr<ItemAndRefs>> deferred_items_
+      ABSL_GUARDED_BY(mu_);
+
   // Items which have been written to the stream but for which no confirmation
   // has yet been received from the server. Note that we have to keep the item
   // alive until the confirmation has been received so that we are able to
@@ -428,12 +684,39 @@ class TrajectoryWriter : public ColumnWriter,
   // to the front item of `write_queue_` referencing incomplete chunks.
   absl::CondVar data_cv_ ABSL_GUARDED_BY(mu_);
 
+  // Handles created by `FlushAsync` which have not yet completed. Each handle
+  // completes once the number of unconfirmed items has dropped to its
+  // `max_num_unconfirmed_items` or the writer encounters an unrecoverable
+  // error.
+  struct PendingFlush {
+    int max_num_unconfirmed_items;
+    std::shared_ptr<FlushHandle> handle;
+  };
+  std::vector<PendingFlush> pending_flushes_ ABSL_GUARDED_BY(mu_);
+
+  // Writers providing the additional `InsertStream` connections when
+  // `Options::num_insert_streams` > 1. The parent writer serves as stream 0
+  // and owns all chunkers; the additional writers only run the streaming
+  // machinery (write queue, stream worker and reactor) for the items routed
+  // to them. Empty when a single stream is used.
+  std::vector<std::unique_ptr<TrajectoryWriter>> additional_stream_writers_;
+
+  // Index of the stream which receives items created during the active
+  // episode. Incremented (modulo `num_insert_streams`) by `EndEpisode` and
+  // `EndEpisodeAsync`. Stream 0 is the parent writer itself.
+  int active_stream_ ABSL_GUARDED_BY(mu_) = 0;
+
   // Context used to create (and cancel) the gRPC stream used in
   // `stream_worker_`. The worker creates the context before invoking
   // `RunStreamWorker`. The mutex protects against potential data races between
   // concurrent `Close` calls and creation of new streams.
   std::unique_ptr<grpc::ClientContext> context_ ABSL_GUARDED_BY(mu_);
 
+  // True until the first stream has been created. Later streams replace one
+  // that broke and may skip retransmitting chunks the server still caches.
+  // Only accessed by `stream_worker_`.
+  bool first_stream_ = true;
+
   // Creates `context_` and calls `RunStreamWorker` until `Close` called or
   // until the stream returns a non transient error. In both cases
   // `unrecoverable_status_` is populated before the thread is joinable.
@@ -604,6 +604,67 @@ TEST(TrajectoryWriter, AppendPartialDoesNotIncrementEpisodeStep) {
             first_column_only_again[0]->lock()->episode_step());
 }
 
+TEST(TrajectoryWriter, CombinePartialAppendsStagesUntilClosingAppend) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async())
+      .WillRepeatedly(Return(&async));
+
+  auto options = MakeOptions(/*max_chunk_length=*/10,
+                             /*num_keep_alive_refs=*/10);
+  options.combine_partial_appends = true;
+  TrajectoryWriter writer(stub, options);
+
+  // The partial call only stages its data so no reference exists yet.
+  StepRef first_column_only;
+  REVERB_ASSERT_OK(
+      writer.AppendPartial(Step({MakeTensor(kIntSpec)}), &first_column_only));
+  EXPECT_FALSE(first_column_only[0].has_value());
+
+  // Staging the same column again is rejected just like in the eager mode.
+  StepRef first_column_again;
+  auto status =
+      writer.AppendPartial(Step({MakeTensor(kIntSpec)}), &first_column_again);
+  EXPECT_EQ(status.code(), absl::StatusCode::kFailedPrecondition);
+
+  // The closing call returns references for the entire combined step.
+  StepRef both_columns;
+  REVERB_ASSERT_OK(writer.Append(Step({absl::nullopt, MakeTensor(kFloatSpec)}),
+                                 &both_columns));
+  ASSERT_EQ(both_columns.size(), 2);
+  EXPECT_TRUE(both_columns[0].has_value());
+  EXPECT_TRUE(both_columns[1].has_value());
+
+  // Both columns belong to the same (first) episode step.
+  EXPECT_EQ(both_columns[0]->lock()->episode_step(),
+            both_columns[1]->lock()->episode_step());
+}
+
+TEST(TrajectoryWriter, CombinePartialAppendsRejectsEndEpisodeOfOpenStep) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async())
+      .WillRepeatedly(Return(&async));
+
+  auto options = MakeOptions(/*max_chunk_length=*/10,
+                             /*num_keep_alive_refs=*/10);
+  options.combine_partial_appends = true;
+  TrajectoryWriter writer(stub, options);
+
+  StepRef first_column_only;
+  REVERB_ASSERT_OK(
+      writer.AppendPartial(Step({MakeTensor(kIntSpec)}), &first_column_only));
+
+  // The staged step has not been closed with `Append` so ending the episode
+  // would silently drop it.
+  auto status = writer.EndEpisode(/*clear_buffers=*/false);
+  EXPECT_EQ(status.code(), absl::StatusCode::kFailedPrecondition);
+
+  // Clearing the buffers explicitly drops the staged step with the rest of
+  // the episode.
+  REVERB_EXPECT_OK(writer.EndEpisode(/*clear_buffers=*/true));
+}
+
 TEST(TrajectoryWriter, ConfigureChunkerOnExistingColumn) {
   AsyncInterface async;
   auto stub = std::make_shared<MockReverbServiceAsyncStub>();
@@ -685,6 +746,68 @@ TEST(TrajectoryWriter, ConfigureChunkerOnFutureColumn) {
   EXPECT_FALSE(second[1]->expired());
 }
 
+TEST(TrajectoryWriter, SmallColumnsShareACombinedChunk) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async()).WillRepeatedly(Return(&async));
+
+  TrajectoryWriter::Options options =
+      MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1);
+  options.max_inline_column_bytes = 64;
+  TrajectoryWriter writer(stub, options);
+
+  // Two scalar-ish columns and one large observation column.
+  const auto large_spec =
+      internal::TensorSpec{"2", tensorflow::DT_FLOAT, {100}};
+  StepRef refs;
+  REVERB_ASSERT_OK(writer.Append(
+      Step({MakeTensor(kIntSpec), MakeTensor(kFloatSpec),
+            MakeTensor(large_spec)}),
+      &refs));
+
+  // The small columns are packed into a single chunk; the large column cuts
+  // its own.
+  EXPECT_EQ(refs[0]->lock()->chunk_key(), refs[1]->lock()->chunk_key());
+  EXPECT_NE(refs[0]->lock()->chunk_key(), refs[2]->lock()->chunk_key());
+  EXPECT_EQ(refs[0]->lock()->chunk_column(), 0);
+  EXPECT_EQ(refs[1]->lock()->chunk_column(), 1);
+  EXPECT_EQ(refs[2]->lock()->chunk_column(), 0);
+
+  // The combined chunk holds one tensor per member column.
+  ASSERT_TRUE(refs[0]->lock()->IsReady());
+  EXPECT_EQ(refs[0]->lock()->GetChunk()->get()->data().tensors_size(), 2);
+}
+
+TEST(TrajectoryWriter, SmallColumnGroupDissolvesOnPartialRow) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async()).WillRepeatedly(Return(&async));
+
+  TrajectoryWriter::Options options =
+      MakeOptions(/*max_chunk_length=*/2, /*num_keep_alive_refs=*/2);
+  options.max_inline_column_bytes = 64;
+  TrajectoryWriter writer(stub, options);
+
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(
+      Step({MakeTensor(kIntSpec), MakeTensor(kFloatSpec)}), &first));
+  EXPECT_EQ(first[0]->lock()->chunk_key(), first[1]->lock()->chunk_key());
+
+  // A step with only one of the grouped columns dissolves the group; the
+  // columns continue as individual chunkers.
+  StepRef second;
+  REVERB_ASSERT_OK(
+      writer.Append(Step({MakeTensor(kIntSpec), absl::nullopt}), &second));
+  EXPECT_NE(second[0]->lock()->chunk_key(), first[0]->lock()->chunk_key());
+  EXPECT_EQ(second[0]->lock()->chunk_column(), 0);
+
+  // The combined chunk cut by the dissolution still serves reads.
+  ASSERT_TRUE(first[1]->lock()->IsReady());
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(first[1]->lock()->GetData(&got));
+  test::ExpectTensorEqual<float>(got, MakeTensor(kFloatSpec));
+}
+
 TEST(TrajectoryWriter, NoDataIsSentIfNoItemsCreated) {
   AsyncInterface async;
   auto stub = std::make_shared<MockReverbServiceAsyncStub>();
@@ -1094,6 +1217,138 @@ TEST(TrajectoryWriter, FlushCanIgnorePendingItems) {
   EXPECT_FALSE(first[1]->lock()->IsReady());
 }
 
+TEST(TrajectoryWriter, FlushAsyncCompletesWhenItemsConfirmed) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async()).WillOnce(Return(&async));
+
+  TrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1));
+
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{first[0]}})));
+
+  // The handle should complete, and the callback be invoked with OK, once the
+  // server has confirmed the item.
+  absl::Notification callback_called;
+  std::shared_ptr<TrajectoryWriter::FlushHandle> handle;
+  REVERB_ASSERT_OK(writer.FlushAsync(&handle, /*ignore_last_num_items=*/0,
+                                     [&](absl::Status status) {
+                                       EXPECT_TRUE(status.ok());
+                                       callback_called.Notify();
+                                     }));
+  REVERB_EXPECT_OK(handle->Await());
+  EXPECT_TRUE(handle->Done());
+  callback_called.WaitForNotification();
+  EXPECT_THAT(async.stream_.requests(), ElementsAre(IsChunkAndItem()));
+}
+
+TEST(TrajectoryWriter, FlushAsyncCompletesImmediatelyWithoutPendingItems) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async()).WillOnce(Return(&async));
+
+  TrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1));
+
+  // Without any pending items there is nothing to wait for so the handle is
+  // done before `FlushAsync` even returns.
+  std::shared_ptr<TrajectoryWriter::FlushHandle> handle;
+  REVERB_ASSERT_OK(writer.FlushAsync(&handle));
+  EXPECT_TRUE(handle->Done());
+  REVERB_EXPECT_OK(handle->Await());
+}
+
+TEST(TrajectoryWriter, CloseCompletesPendingFlushAsyncHandles) {
+  AsyncInterface fail_stream(false);
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async()).WillRepeatedly(Return(&fail_stream));
+
+  TrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1));
+
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{first[0]}})));
+
+  // The stream never confirms any items so the handle cannot complete until
+  // the writer is closed.
+  std::shared_ptr<TrajectoryWriter::FlushHandle> handle;
+  REVERB_ASSERT_OK(writer.FlushAsync(&handle));
+  EXPECT_FALSE(handle->Done());
+
+  writer.Close();
+  auto status = handle->Await();
+  EXPECT_EQ(status.code(), absl::StatusCode::kCancelled);
+}
+
+TEST(TrajectoryWriter, EndEpisodeAsyncResetsEpisodeWithoutBlocking) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async()).WillRepeatedly(Return(&async));
+
+  TrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/2, /*num_keep_alive_refs=*/2));
+
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{first[0]}})));
+
+  // All chunks should be finalized just like `EndEpisode` does it.
+  std::shared_ptr<TrajectoryWriter::FlushHandle> handle;
+  REVERB_ASSERT_OK(writer.EndEpisodeAsync(/*clear_buffers=*/false, &handle));
+  EXPECT_TRUE(first[0]->lock()->IsReady());
+
+  // The next episode can start before the item has been confirmed.
+  StepRef second;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &second));
+  EXPECT_NE(first[0]->lock()->episode_id(), second[0]->lock()->episode_id());
+  EXPECT_EQ(second[0]->lock()->episode_step(), 0);
+
+  // The handle completes once the item created in the first episode has been
+  // confirmed by the server.
+  REVERB_EXPECT_OK(handle->Await());
+  EXPECT_THAT(async.stream_.requests(), ElementsAre(IsChunkAndItem()));
+}
+
+TEST(TrajectoryWriter, MultipleInsertStreamsPartitionEpisodes) {
+  AsyncInterface first_stream;
+  AsyncInterface second_stream;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async())
+      .WillOnce(Return(&first_stream))
+      .WillOnce(Return(&second_stream));
+
+  auto options =
+      MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1);
+  options.num_insert_streams = 2;
+  TrajectoryWriter writer(stub, options);
+
+  // Create one item in each of two episodes.
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{first[0]}})));
+  REVERB_ASSERT_OK(writer.EndEpisode(/*clear_buffers=*/false));
+
+  StepRef second;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &second));
+  REVERB_ASSERT_OK(
+      writer.CreateItem("table", 1.0, MakeTrajectory({{second[0]}})));
+  REVERB_ASSERT_OK(writer.Flush());
+
+  // The episodes are assigned to the streams in a round robin fashion so each
+  // stream should have received exactly one item together with the chunk it
+  // references. Note that the order in which the streams are claimed by the
+  // writers is undefined so we cannot tell which episode went where.
+  EXPECT_THAT(first_stream.stream_.requests(), ElementsAre(IsChunkAndItem()));
+  EXPECT_THAT(second_stream.stream_.requests(), ElementsAre(IsChunkAndItem()));
+}
+
 TEST(TrajectoryWriter, MultipleChunksAreSentInSameMessage) {
   AsyncInterface success_stream;
 
@@ -1423,6 +1678,33 @@ TEST_F(TrajectoryWriterSignatureValidationTest, Valid) {
                                        })));
 }
 
+TEST_F(TrajectoryWriterSignatureValidationTest, LayoutChangeAfterValidItem) {
+  // The first item primes the writer's memoized layout for the table.
+  REVERB_EXPECT_OK(writer_->CreateItem("table", 1.0,
+                                       MakeTrajectory({
+                                           {step_[0], step_[0]},
+                                           {step_[1]},
+                                           {step_[1]},
+                                       })));
+
+  // An identically shaped item hits the memoized layout and remains valid.
+  REVERB_EXPECT_OK(writer_->CreateItem("table", 1.0,
+                                       MakeTrajectory({
+                                           {step_[0], step_[0]},
+                                           {step_[1]},
+                                           {step_[1]},
+                                       })));
+
+  // A different (and invalid) layout must still run the full comparison.
+  auto status = writer_->CreateItem("table", 1.0,
+                                    MakeTrajectory({
+                                        {step_[0], step_[0]},
+                                        {step_[2]},
+                                        {step_[1]},
+                                    }));
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+}
+
 TEST_F(TrajectoryWriterSignatureValidationTest, WrongNumColumns) {
   auto status = writer_->CreateItem("table", 1.0,
                                     MakeTrajectory({
@@ -1604,6 +1886,75 @@ TEST(TrajectoryWriter, EndEpisodeResetsEpisodeKeyAndStep) {
   EXPECT_EQ(second[0]->lock()->episode_step(), 0);
 }
 
+TEST(TrajectoryWriter, DeferredItemsAreSentWithPrioritiesOnEndEpisode) {
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  AsyncInterface async;
+  EXPECT_CALL(*stub, async()).WillRepeatedly(Return(&async));
+
+  TrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/2));
+
+  StepRef first;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &first));
+  StepRef second;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &second));
+
+  uint64_t first_key;
+  REVERB_ASSERT_OK(writer.CreateDeferredItem(
+      "table", MakeTrajectory({{first[0]}}), &first_key));
+  uint64_t second_key;
+  REVERB_ASSERT_OK(writer.CreateDeferredItem(
+      "table", MakeTrajectory({{second[0]}}), &second_key));
+
+  // The items are held by the writer until their priorities are provided so
+  // a plain flush should not send anything.
+  REVERB_ASSERT_OK(writer.Flush());
+  EXPECT_EQ(async.stream_.requests_size(), 0);
+
+  REVERB_ASSERT_OK(writer.EndEpisode({{first_key, 0.5}, {second_key, 2.0}},
+                                     /*clear_buffers=*/true));
+
+  internal::flat_hash_map<uint64_t, double> sent_priorities;
+  for (const auto& request : async.stream_.requests()) {
+    for (const auto& item : request.items()) {
+      sent_priorities[item.key()] = item.priority();
+    }
+  }
+  EXPECT_THAT(sent_priorities,
+              UnorderedElementsAre(::testing::Pair(first_key, 0.5),
+                                   ::testing::Pair(second_key, 2.0)));
+}
+
+TEST(TrajectoryWriter, EndEpisodeValidatesDeferredItemPriorities) {
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  AsyncInterface async;
+  EXPECT_CALL(*stub, async()).WillRepeatedly(Return(&async));
+
+  TrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/2));
+
+  StepRef step;
+  REVERB_ASSERT_OK(writer.Append(Step({MakeTensor(kIntSpec)}), &step));
+
+  uint64_t key;
+  REVERB_ASSERT_OK(
+      writer.CreateDeferredItem("table", MakeTrajectory({{step[0]}}), &key));
+
+  // The plain overloads refuse to end the episode while the item awaits its
+  // priority.
+  auto status = writer.EndEpisode(/*clear_buffers=*/true);
+  EXPECT_EQ(status.code(), absl::StatusCode::kFailedPrecondition);
+
+  // A map of the right size which doesn't cover the item is rejected and the
+  // item remains deferred.
+  status = writer.EndEpisode({{key + 1, 1.0}}, /*clear_buffers=*/true);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+
+  // A corrected map completes the episode.
+  REVERB_ASSERT_OK(writer.EndEpisode({{key, 1.0}}, /*clear_buffers=*/true));
+  EXPECT_EQ(async.stream_.requests_size(), 1);
+}
+
 TEST(TrajectoryWriter, EndEpisodeReturnsIfTimeoutExpired) {
   AsyncInterface fail_stream(false);
   auto stub = std::make_shared<MockReverbServiceAsyncStub>();
@@ -1676,6 +2027,13 @@ TEST_F(TrajectoryWriterOptionsTest, NegativeNumKeepAliveRefs) {
       "num_keep_alive_refs must be > 0 but got -1.");
 }
 
+TEST_F(TrajectoryWriterOptionsTest, ZeroNumInsertStreams) {
+  options_ = MakeOptions(/*max_chunk_length=*/2, /*num_keep_alive_refs=*/2);
+  options_.num_insert_streams = 0;
+  ExpectInvalidArgumentWithMessage(
+      "num_insert_streams must be a positive integer but got 0.");
+}
+
 TEST_F(TrajectoryWriterOptionsTest, NumKeepAliveLtMaxChunkLength) {
   options_ = MakeOptions(/*max_chunk_length=*/6, /*num_keep_alive_refs=*/5);
   ExpectInvalidArgumentWithMessage(
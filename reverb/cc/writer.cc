@@ -411,14 +411,25 @@ absl::Status Writer::Finish(bool retry_on_unavailable) {
   chunk_data.mutable_sequence_range()->set_end(index_within_episode_ +
                                                buffer_.size() - 1);
 
+  // The chunk level flag is kept for readers that predate the columnar
+  // layout; they delta decode every column, which is a no-op for the columns
+  // the transform does not apply to.
   if (delta_encoded_) {
-    batched_tensors = DeltaEncodeList(batched_tensors, true);
     chunk_data.set_delta_encoded(true);
   }
 
   chunk_data.set_data_tensors_len(batched_tensors.size());
-  for (const auto& tensor : batched_tensors) {
-    CompressTensorAsProto(tensor, chunk_data.mutable_data()->add_tensors());
+  for (auto& tensor : batched_tensors) {
+    // Each column is stored as an independent stream with its own transform
+    // and codec tag, so mixed dtype timesteps are not limited to encoding
+    // choices that suit every column.
+    ChunkData::ColumnStream* stream = chunk_data.add_column_streams();
+    if (delta_encoded_ && DeltaEncodeTransforms(tensor)) {
+      tensor = DeltaEncode(tensor, /*encode=*/true);
+      stream->set_delta_encoded(true);
+    }
+    stream->set_codec(CompressTensorAsProto(
+        tensor, chunk_data.mutable_data()->add_tensors(), COMPRESSION_SNAPPY));
   }
 
   chunks_.emplace_back(std::move(chunk_data));
@@ -0,0 +1,112 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/writer_chunk_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "reverb/cc/chunk_store.h"
+
+namespace deepmind {
+namespace reverb {
+
+constexpr absl::Duration WriterChunkCache::kReservationDuration;
+
+WriterChunkCache::WriterChunkCache(size_t max_bytes)
+    : max_bytes_(max_bytes) {}
+
+void WriterChunkCache::Put(uint64_t writer_id,
+                           std::shared_ptr<ChunkStore::Chunk> chunk) {
+  const uint64_t key = chunk->key();
+  const size_t num_bytes = chunk->DataByteSizeLong();
+  absl::MutexLock lock(&mu_);
+  auto& index = writers_[writer_id];
+  const auto it = index.find(key);
+  if (it != index.end()) {
+    TouchLocked(it->second);
+    return;
+  }
+  lru_.push_back({writer_id, std::move(chunk), num_bytes});
+  index[key] = std::prev(lru_.end());
+  num_bytes_ += num_bytes;
+  TrimLocked();
+}
+
+std::vector<uint64_t> WriterChunkCache::Query(
+    uint64_t writer_id, absl::Span<const uint64_t> chunk_keys) {
+  std::vector<uint64_t> cached;
+  const absl::Time reserved_until = absl::Now() + kReservationDuration;
+  absl::MutexLock lock(&mu_);
+  const auto writer_it = writers_.find(writer_id);
+  if (writer_it == writers_.end()) return cached;
+  for (uint64_t key : chunk_keys) {
+    const auto it = writer_it->second.find(key);
+    if (it == writer_it->second.end()) continue;
+    it->second->reserved_until = reserved_until;
+    TouchLocked(it->second);
+    cached.push_back(key);
+  }
+  return cached;
+}
+
+std::vector<std::shared_ptr<ChunkStore::Chunk>> WriterChunkCache::GetChunks(
+    uint64_t writer_id) {
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  absl::MutexLock lock(&mu_);
+  const auto writer_it = writers_.find(writer_id);
+  if (writer_it == writers_.end()) return chunks;
+  chunks.reserve(writer_it->second.size());
+  for (auto& [_, it] : writer_it->second) {
+    TouchLocked(it);
+    chunks.push_back(it->chunk);
+  }
+  return chunks;
+}
+
+void WriterChunkCache::TouchLocked(EntryList::iterator it) {
+  lru_.splice(lru_.end(), lru_, it);
+}
+
+void WriterChunkCache::TrimLocked() {
+  const absl::Time now = absl::Now();
+  // Each iteration either evicts the coldest entry or rotates a reserved one
+  // to the warm end, so the loop visits every entry at most once.
+  size_t attempts = lru_.size();
+  while (num_bytes_ > max_bytes_ && !lru_.empty() && attempts-- > 0) {
+    const Entry& entry = lru_.front();
+    if (entry.reserved_until > now) {
+      // The entry was promised to a reconnecting writer; look for a colder
+      // victim instead. Splicing does not invalidate the index iterators.
+      lru_.splice(lru_.end(), lru_, lru_.begin());
+      continue;
+    }
+    const auto writer_it = writers_.find(entry.writer_id);
+    writer_it->second.erase(entry.chunk->key());
+    if (writer_it->second.empty()) {
+      writers_.erase(writer_it);
+    }
+    num_bytes_ -= entry.num_bytes;
+    lru_.pop_front();
+  }
+}
+
+}  // namespace reverb
+}  // namespace deepmind
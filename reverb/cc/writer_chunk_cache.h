@@ -0,0 +1,110 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_WRITER_CHUNK_CACHE_H_
+#define REVERB_CC_WRITER_CHUNK_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_map.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Bounded cache of the chunks most recently received on `InsertStream` calls,
+// keyed by the identity of the writer that sent them. The chunk references of
+// a stream normally die with the stream, so a writer whose stream broke has
+// to retransmit every chunk that pending items may reference. With this cache
+// a reconnecting writer can instead ask which of its chunks the server still
+// holds (the `QueryReceivedChunks` RPC) and only send the missing ones; the
+// new stream is seeded with the cached chunks.
+//
+// The cache shares ownership of the chunks so its memory usage is bounded by
+// `max_bytes`; when the budget is exceeded the least recently used chunks
+// (across all writers) are released first. Chunks returned by a recent
+// `Query` are kept for a grace period so that they cannot be evicted between
+// the query and the first request of the new stream.
+//
+// All public methods are thread safe.
+class WriterChunkCache {
+ public:
+  // How long chunks returned by `Query` are protected from eviction.
+  static constexpr absl::Duration kReservationDuration = absl::Minutes(1);
+
+  explicit WriterChunkCache(size_t max_bytes);
+
+  // Adds `chunk` to the cache of `writer_id`, or marks it as recently used if
+  // it is already cached. Evicts the least recently used chunks if the
+  // combined size of the cache exceeds `max_bytes`.
+  void Put(uint64_t writer_id, std::shared_ptr<ChunkStore::Chunk> chunk);
+
+  // Returns the subset of `chunk_keys` that is cached for `writer_id`. The
+  // returned chunks are marked as recently used and protected from eviction
+  // for `kReservationDuration`.
+  std::vector<uint64_t> Query(uint64_t writer_id,
+                              absl::Span<const uint64_t> chunk_keys);
+
+  // Returns all chunks cached for `writer_id`, marking them as recently used.
+  // Used to seed the chunk references of a new stream of the same writer.
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> GetChunks(
+      uint64_t writer_id);
+
+ private:
+  struct Entry {
+    uint64_t writer_id;
+    std::shared_ptr<ChunkStore::Chunk> chunk;
+    size_t num_bytes;
+
+    // Entries are not evicted before this time. Set by `Query`.
+    absl::Time reserved_until = absl::InfinitePast();
+  };
+
+  using EntryList = std::list<Entry>;
+
+  // Moves `it` to the most recently used end of `lru_`.
+  void TouchLocked(EntryList::iterator it) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Evicts least recently used entries until the cache fits in `max_bytes_`.
+  // Entries with an active reservation are skipped.
+  void TrimLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const size_t max_bytes_;
+
+  absl::Mutex mu_;
+
+  // Entries of all writers, ordered from least to most recently used.
+  EntryList lru_ ABSL_GUARDED_BY(mu_);
+
+  // Per writer index into `lru_`, keyed by chunk key.
+  internal::flat_hash_map<uint64_t,
+                          internal::flat_hash_map<uint64_t,
+                                                  EntryList::iterator>>
+      writers_ ABSL_GUARDED_BY(mu_);
+
+  // Combined size of the cached chunks.
+  size_t num_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_WRITER_CHUNK_CACHE_H_
@@ -0,0 +1,80 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/writer_chunk_cache.h"
+
+#include <memory>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAre;
+
+std::shared_ptr<ChunkStore::Chunk> MakeChunk(uint64_t key) {
+  return std::make_shared<ChunkStore::Chunk>(testing::MakeChunkData(key));
+}
+
+TEST(WriterChunkCacheTest, QueryReturnsIntersectionWithCachedKeys) {
+  WriterChunkCache cache(/*max_bytes=*/1 << 20);
+  cache.Put(1, MakeChunk(10));
+  cache.Put(1, MakeChunk(11));
+  EXPECT_THAT(cache.Query(1, {10, 11, 12}), UnorderedElementsAre(10, 11));
+}
+
+TEST(WriterChunkCacheTest, QueryForUnknownWriterReturnsNothing) {
+  WriterChunkCache cache(/*max_bytes=*/1 << 20);
+  cache.Put(1, MakeChunk(10));
+  EXPECT_THAT(cache.Query(2, {10}), IsEmpty());
+}
+
+TEST(WriterChunkCacheTest, GetChunksReturnsTheCachedChunks) {
+  WriterChunkCache cache(/*max_bytes=*/1 << 20);
+  std::shared_ptr<ChunkStore::Chunk> chunk = MakeChunk(10);
+  cache.Put(1, chunk);
+  EXPECT_THAT(cache.GetChunks(1), ElementsAre(chunk));
+  EXPECT_THAT(cache.GetChunks(2), IsEmpty());
+}
+
+TEST(WriterChunkCacheTest, EvictsLeastRecentlyUsedChunk) {
+  std::shared_ptr<ChunkStore::Chunk> first = MakeChunk(10);
+  // Budget for a single chunk.
+  WriterChunkCache cache(first->DataByteSizeLong());
+  cache.Put(1, first);
+  cache.Put(1, MakeChunk(11));
+  EXPECT_THAT(cache.Query(1, {10, 11}), ElementsAre(11));
+}
+
+TEST(WriterChunkCacheTest, QueriedChunksAreNotEvicted) {
+  std::shared_ptr<ChunkStore::Chunk> first = MakeChunk(10);
+  WriterChunkCache cache(first->DataByteSizeLong());
+  cache.Put(1, first);
+
+  // The query promises the chunk to a reconnecting writer so later inserts
+  // must not push it out of the cache.
+  EXPECT_THAT(cache.Query(1, {10}), ElementsAre(10));
+  cache.Put(1, MakeChunk(11));
+  EXPECT_THAT(cache.GetChunks(1), ElementsAre(first));
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -641,6 +641,36 @@ TEST(WriterTest, DeltaEncode) {
               IsItemWithRangeAndPriorityAndTable(0, 3, 1.0, "dist"));
 }
 
+TEST(WriterTest, ColumnStreamsRecordPerColumnEncoding) {
+  std::vector<InsertStreamRequest> requests;
+  auto stub = MakeGoodStub(&requests);
+  Writer writer(stub, /*chunk_length=*/2,
+                /*max_timesteps=*/4, /*delta_encoded=*/true);
+
+  tensorflow::Tensor ints(tensorflow::DT_INT32, {2});
+  ints.flat<int32_t>().setZero();
+  tensorflow::Tensor floats(tensorflow::DT_FLOAT, {2});
+  floats.flat<float>().setZero();
+
+  REVERB_EXPECT_OK(writer.Append({ints, floats}));
+  REVERB_EXPECT_OK(writer.Append({ints, floats}));
+  REVERB_EXPECT_OK(writer.CreateItem("dist", 2, 1.0));
+  REVERB_EXPECT_OK(writer.Flush());
+
+  ASSERT_GE(requests.size(), 1);
+  ASSERT_GE(requests[0].chunks_size(), 1);
+  const auto& chunk = requests[0].chunks(0);
+  ASSERT_EQ(chunk.column_streams_size(), 2);
+
+  // Only the integer column is delta encoded; the chunk level flag stays set
+  // for readers that predate the per column tags.
+  EXPECT_TRUE(chunk.delta_encoded());
+  EXPECT_TRUE(chunk.column_streams(0).delta_encoded());
+  EXPECT_FALSE(chunk.column_streams(1).delta_encoded());
+  EXPECT_EQ(chunk.column_streams(0).codec(), COMPRESSION_SNAPPY);
+  EXPECT_EQ(chunk.column_streams(1).codec(), COMPRESSION_SNAPPY);
+}
+
 TEST(WriterTest, MultiChunkItemsAreCorrect) {
   std::vector<InsertStreamRequest> requests;
   auto stub = MakeGoodStub(&requests);
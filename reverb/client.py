@@ -20,7 +20,7 @@ exposes direct methods for both inserting (i.e `insert`) and sampling (i.e
 `TrajectoryDataset` directly whenever possible.
 """
 
-from typing import Any, Dict, Generator, List, Optional, Sequence, Union
+from typing import Any, Dict, Generator, List, Optional, Sequence, Tuple, Union
 
 from absl import logging
 import numpy as np
@@ -216,14 +216,20 @@ class Client:
   Whenever possible, prefer to use TFClient (see ./tf_client.py).
   """
 
-  def __init__(self, server_address: str):
+  def __init__(self,
+               server_address: str,
+               client: Optional[pybind.Client] = None):
     """Constructor of Client.
 
     Args:
       server_address: Address to the Reverb ReverbService.
+      client: Optional pre-existing low-level client (e.g. one communicating
+        over an in-process channel, see `Server.in_process_client`). If not
+        provided then a new client is connected to `server_address`.
     """
     self._server_address = server_address
-    self._client = pybind.Client(server_address)
+    self._client = client if client is not None else pybind.Client(
+        server_address)
     self._signature_cache = {}
 
   def __reduce__(self):
@@ -428,24 +434,28 @@ class Client:
           key=int(sample[0]),
           probability=float(sample[1]),
           table_size=int(sample[2]),
-          priority=float(sample[3]))
+          priority=float(sample[3]),
+          queued_for_secs=float(sample[4]),
+          rate_limiter_wait_secs=float(sample[5]),
+          serialize_time_secs=float(sample[6]))
+      num_info = len(info)
 
       if emit_timesteps:
-        if len(set([len(col) for col in sample[4:]])) != 1:
+        if len(set([len(col) for col in sample[num_info:]])) != 1:
           raise ValueError(
               'Can\'t split non timestep trajectory into timesteps.')
 
         timesteps = []
-        for i in range(sample[4].shape[0]):
+        for i in range(sample[num_info].shape[0]):
           timestep = replay_sample.ReplaySample(
               info=info,
               data=unflatten([np.asarray(col[i], col.dtype)
-                              for col in sample[4:]]))
+                              for col in sample[num_info:]]))
           timesteps.append(timestep)
 
         yield timesteps
       else:
-        yield replay_sample.ReplaySample(info, unflatten(sample[4:]))
+        yield replay_sample.ReplaySample(info, unflatten(sample[num_info:]))
 
   def mutate_priorities(self,
                         table: str,
@@ -497,12 +507,10 @@ class Client:
     """
     try:
       info_proto_strings = self._client.ServerInfo(timeout or 0)
-    except RuntimeError as e:
-      if 'Deadline Exceeded' in str(e) and timeout is not None:
-        raise errors.DeadlineExceededError(
-            f'ServerInfo call did not complete within provided timeout of '
-            f'{timeout}s')
-      raise
+    except TimeoutError:
+      raise errors.DeadlineExceededError(
+          f'ServerInfo call did not complete within provided timeout of '
+          f'{timeout}s')
 
     table_infos = {}
     for proto_string in info_proto_strings:
@@ -519,6 +527,45 @@ class Client:
 
     return table_infos
 
+  def table_watermarks(
+      self,
+      table_names: Optional[Sequence[str]] = None,
+      timeout: Optional[int] = None,
+  ) -> Dict[str, Tuple[int, int]]:
+    """Reads the size watermarks of tables on the server.
+
+    Unlike `server_info` this only reads atomically published counters on the
+    server and builds no protos, so it is cheap enough to poll at high
+    frequency, e.g. from backpressure loops that throttle actors on table
+    size.
+
+    Args:
+      table_names: Names of the tables to read. If not provided then the
+        watermarks of all tables on the server are returned.
+      timeout: Timeout in seconds to wait for server response. By default no
+        deadline is set and call will block indefinetely until server
+        responds.
+
+    Returns:
+      A dictionary mapping table names to `(current_size, num_episodes)`
+      tuples.
+
+    Raises:
+      errors.DeadlineExceededError: If timeout provided and exceeded.
+    """
+    try:
+      watermarks = self._client.TableWatermarks(
+          list(table_names or []), timeout or 0)
+    except TimeoutError:
+      raise errors.DeadlineExceededError(
+          f'TableWatermarks call did not complete within provided timeout '
+          f'of {timeout}s')
+
+    return {
+        name: (current_size, num_episodes)
+        for name, current_size, num_episodes in watermarks
+    }
+
   def checkpoint(self) -> str:
     """Triggers a checkpoint to be created.
 
@@ -527,6 +574,88 @@ class Client:
     """
     return self._client.Checkpoint()
 
+  def import_checkpoint(
+      self,
+      checkpoint_path: str,
+      tables: Optional[Sequence[str]] = None) -> Dict[str, int]:
+    """Imports tables from an existing checkpoint into the running server.
+
+    Unlike restoring at startup, importing does not replace the server's
+    tables. The checkpoint may come from a different server with different
+    companion tables; only the requested tables are restored and their items
+    are inserted through the regular insert path of the live tables, so
+    capacity limits and rate limiters apply.
+
+    Args:
+      checkpoint_path: Absolute path of the checkpoint directory to import
+        from.
+      tables: Names of the tables to import. Each named table must exist both
+        in the checkpoint and on the server. If None (default) then all tables
+        present in both are imported.
+
+    Returns:
+      A dict mapping the name of each imported table to the number of items
+      inserted into it.
+    """
+    return self._client.ImportCheckpoint(checkpoint_path,
+                                         list(tables) if tables else [])
+
+  def fork_table(self, table: str, new_table_name: str) -> int:
+    """Clones a live table into a new table on the same server.
+
+    The new table holds a consistent snapshot of the source table's items and
+    configuration (selector types, rate limiter options, size limits and
+    signature) but shares all chunk data with the source, so forking is cheap
+    regardless of how much data the items reference. After the fork the two
+    tables are completely independent: inserts, updates and deletes on one
+    are not observed by the other. Typical use is freezing the current state
+    of a training table into a companion evaluation table without
+    checkpointing and restoring into a second server.
+
+    Args:
+      table: Name of the table to fork. Must exist on the server.
+      new_table_name: Name of the new table. Must not collide with an
+        existing table.
+
+    Returns:
+      The number of items copied into the new table.
+    """
+    return self._client.ForkTable(table, new_table_name)
+
+  def move_items(self,
+                 source_table: str,
+                 target_table: str,
+                 min_key: int = 0,
+                 max_key: int = 2**64 - 1) -> int:
+    """Moves a key range of items between two tables on the same server.
+
+    Both tables share the server's chunk store, so only item metadata and
+    selector entries are transferred; chunk payloads are never copied or
+    retransmitted through the client. This makes online rebalancing (e.g.
+    draining a table before resizing a sharded deployment) run at metadata
+    speed regardless of how much data the items reference.
+
+    The moved keys are deleted from the source only after they have been
+    registered in the target, so a failure (e.g. a key already present in the
+    target) leaves both tables unchanged. Between registration and deletion
+    the items are briefly sampleable from both tables.
+
+    Args:
+      source_table: Name of the table to move items out of. Must exist on the
+        server.
+      target_table: Name of the table to move the items into. Must exist on
+        the server and differ from `source_table`.
+      min_key: Smallest item key to move (inclusive). Defaults to moving from
+        the start of the key space.
+      max_key: Largest item key to move (inclusive). Defaults to moving to
+        the end of the key space, i.e. by default every item is moved.
+
+    Returns:
+      The number of items moved into the target table.
+    """
+    return self._client.MoveItems(source_table, target_table, min_key,
+                                  max_key)
+
   def trajectory_writer(self,
                         num_keep_alive_refs: int,
                         *,
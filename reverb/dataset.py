@@ -144,12 +144,10 @@ class ReplayDataset(tf.data.Dataset):
     # Add the info fields.
     dtypes = replay_sample.ReplaySample(replay_sample.SampleInfo.tf_dtypes(),
                                         dtypes)
+    info_shape = tf.TensorShape([sequence_length] if not emit_timesteps else [])
     shapes = replay_sample.ReplaySample(
-        replay_sample.SampleInfo(
-            tf.TensorShape([sequence_length] if not emit_timesteps else []),
-            tf.TensorShape([sequence_length] if not emit_timesteps else []),
-            tf.TensorShape([sequence_length] if not emit_timesteps else []),
-            tf.TensorShape([sequence_length] if not emit_timesteps else [])),
+        replay_sample.SampleInfo(*([info_shape] *
+                                   len(replay_sample.SampleInfo._fields))),
         shapes)
 
     # If sequences are to be emitted then all shapes must specify use
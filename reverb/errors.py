@@ -20,6 +20,10 @@ class ReverbError(Exception):
   pass
 
 
-class DeadlineExceededError(ReverbError):
-  """A call to the server timed out."""
+class DeadlineExceededError(ReverbError, TimeoutError):
+  """A call to the server timed out.
+
+  Also inherits from `TimeoutError` since that is what the bindings raise for
+  timed out calls; callers can catch either type.
+  """
   pass
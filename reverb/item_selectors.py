@@ -18,9 +18,13 @@ import functools
 
 from reverb import pybind
 
+Alias = pybind.AliasSelector
+Bucketized = pybind.BucketizedSelector
+Clock = pybind.ClockSelector
 Fifo = pybind.FifoSelector
 Lifo = pybind.LifoSelector
 MaxHeap = functools.partial(pybind.HeapSelector, False)  # pylint: disable=invalid-name
 MinHeap = functools.partial(pybind.HeapSelector, True)  # pylint: disable=invalid-name
 Prioritized = pybind.PrioritizedSelector
+Reservoir = pybind.ReservoirSelector
 Uniform = pybind.UniformSelector
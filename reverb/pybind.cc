@@ -12,11 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "numpy/arrayobject.h"
 #include "absl/container/inlined_vector.h"
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/time/time.h"
@@ -29,23 +32,31 @@
 #include "reverb/cc/client.h"
 #include "reverb/cc/patterns.pb.h"
 #include "reverb/cc/platform/checkpointing.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/platform/server.h"
 #include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/sampler.h"
+#include "reverb/cc/selectors/alias.h"
+#include "reverb/cc/selectors/bucketized.h"
+#include "reverb/cc/selectors/clock.h"
 #include "reverb/cc/selectors/fifo.h"
 #include "reverb/cc/selectors/heap.h"
 #include "reverb/cc/selectors/interface.h"
 #include "reverb/cc/selectors/lifo.h"
 #include "reverb/cc/selectors/prioritized.h"
+#include "reverb/cc/selectors/reservoir.h"
 #include "reverb/cc/selectors/uniform.h"
 #include "reverb/cc/structured_writer.h"
 #include "reverb/cc/support/tf_util.h"
 #include "reverb/cc/table.h"
 #include "reverb/cc/table_extensions/interface.h"
+#include "reverb/cc/table_extensions/stats.h"
 #include "reverb/cc/trajectory_writer.h"
 #include "reverb/cc/writer.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/framework/types.h"
 
 namespace {
@@ -56,6 +67,20 @@ struct PyDecrefDeleter {
 using Safe_PyObjectPtr = std::unique_ptr<PyObject, PyDecrefDeleter>;
 Safe_PyObjectPtr make_safe(PyObject *o) { return Safe_PyObjectPtr(o); }
 
+// Debug-mode guard for blocking Reverb calls. Call after releasing the GIL
+// and immediately before a call that may block on table mutexes or server
+// round trips; in debug builds it aborts if the calling thread still holds
+// the GIL, which catches bindings that forgot (or lost) their
+// `py::gil_scoped_release`. Holding the GIL across such a call freezes every
+// unrelated Python thread for the duration. A no-op in opt builds.
+inline void AssertGilReleasedForBlockingCall() {
+#ifndef NDEBUG
+  REVERB_CHECK(!PyGILState_Check())
+      << "Blocking Reverb call entered while holding the GIL. Wrap the call "
+         "in py::gil_scoped_release.";
+#endif
+}
+
 // Converts non OK statuses to Python exceptions and throws. Does nothing for
 // OK statuses.
 inline void MaybeRaiseFromStatus(const absl::Status &status) {
@@ -73,6 +98,10 @@ inline void MaybeRaiseFromStatus(const absl::Status &status) {
     CODE_TO_PY_EXC(absl::StatusCode::kResourceExhausted, PyExc_IndexError)
     CODE_TO_PY_EXC(absl::StatusCode::kUnimplemented, PyExc_NotImplementedError)
     CODE_TO_PY_EXC(absl::StatusCode::kInternal, PyExc_RuntimeError)
+    // Timeouts (e.g. rate limiter timeouts) are control flow for many
+    // callers; a distinct exception type lets the Python layer branch on the
+    // type instead of matching message text.
+    CODE_TO_PY_EXC(absl::StatusCode::kDeadlineExceeded, PyExc_TimeoutError)
 
     // TODO(b/154927554): Map more status codes to Python exceptions.
 
@@ -386,6 +415,218 @@ tensorflow::Status TensorToNdArray(const tensorflow::Tensor &tensor,
   return tensorflow::Status::OK();
 }
 
+// Minimal definitions of the stable DLPack C ABI (see dlpack.h, v0.8).
+// Defined locally so that DLPack capsules can be exchanged with consumers
+// built against their own copy of dlpack.h without Reverb taking a dependency
+// on the header. Only the layout matters for compatibility; the names mirror
+// the upstream header for readability.
+extern "C" {
+
+typedef struct {
+  int32_t device_type;
+  int32_t device_id;
+} DLDevice;
+
+typedef struct {
+  uint8_t code;
+  uint8_t bits;
+  uint16_t lanes;
+} DLDataType;
+
+typedef struct {
+  void *data;
+  DLDevice device;
+  int32_t ndim;
+  DLDataType dtype;
+  int64_t *shape;
+  int64_t *strides;
+  uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor {
+  DLTensor dl_tensor;
+  void *manager_ctx;
+  void (*deleter)(struct DLManagedTensor *);
+} DLManagedTensor;
+
+}  // extern "C"
+
+// DLPack device and dtype codes used below.
+constexpr int32_t kDLCPU = 1;
+constexpr uint8_t kDLInt = 0;
+constexpr uint8_t kDLUInt = 1;
+constexpr uint8_t kDLFloat = 2;
+constexpr uint8_t kDLBfloat = 4;
+constexpr uint8_t kDLComplex = 5;
+constexpr uint8_t kDLBool = 6;
+
+tensorflow::Status GetDLDataType(tensorflow::DataType dtype,
+                                 DLDataType *out_dtype) {
+  out_dtype->lanes = 1;
+  switch (dtype) {
+    case tensorflow::DT_HALF:
+      *out_dtype = {kDLFloat, 16, 1};
+      break;
+    case tensorflow::DT_FLOAT:
+      *out_dtype = {kDLFloat, 32, 1};
+      break;
+    case tensorflow::DT_DOUBLE:
+      *out_dtype = {kDLFloat, 64, 1};
+      break;
+    case tensorflow::DT_BFLOAT16:
+      *out_dtype = {kDLBfloat, 16, 1};
+      break;
+    case tensorflow::DT_INT8:
+      *out_dtype = {kDLInt, 8, 1};
+      break;
+    case tensorflow::DT_INT16:
+      *out_dtype = {kDLInt, 16, 1};
+      break;
+    case tensorflow::DT_INT32:
+      *out_dtype = {kDLInt, 32, 1};
+      break;
+    case tensorflow::DT_INT64:
+      *out_dtype = {kDLInt, 64, 1};
+      break;
+    case tensorflow::DT_UINT8:
+      *out_dtype = {kDLUInt, 8, 1};
+      break;
+    case tensorflow::DT_UINT16:
+      *out_dtype = {kDLUInt, 16, 1};
+      break;
+    case tensorflow::DT_UINT32:
+      *out_dtype = {kDLUInt, 32, 1};
+      break;
+    case tensorflow::DT_UINT64:
+      *out_dtype = {kDLUInt, 64, 1};
+      break;
+    case tensorflow::DT_BOOL:
+      *out_dtype = {kDLBool, 8, 1};
+      break;
+    case tensorflow::DT_COMPLEX64:
+      *out_dtype = {kDLComplex, 64, 1};
+      break;
+    case tensorflow::DT_COMPLEX128:
+      *out_dtype = {kDLComplex, 128, 1};
+      break;
+    default:
+      return tensorflow::errors::Unimplemented(
+          "Tensors of dtype ", tensorflow::DataTypeString(dtype),
+          " cannot be exported through DLPack.");
+  }
+  return tensorflow::Status::OK();
+}
+
+// Owns everything an exported DLPack tensor points into. The wrapped
+// `tensorflow::Tensor` reference counts the underlying buffer so the sampled
+// memory stays valid until the consumer invokes the deleter, even if the
+// Python-side sample has been garbage collected by then.
+struct DLPackContext {
+  tensorflow::Tensor tensor;
+  std::vector<int64_t> shape;
+  DLManagedTensor managed;
+};
+
+// Builds a `DLManagedTensor` aliasing (not copying) the buffer of `tensor`.
+// The caller takes ownership and must eventually invoke the deleter.
+tensorflow::Status TensorToDLManagedTensor(tensorflow::Tensor tensor,
+                                           DLManagedTensor **out_managed) {
+  DLDataType dl_dtype;
+  TF_RETURN_IF_ERROR(GetDLDataType(tensor.dtype(), &dl_dtype));
+
+  auto ctx = absl::make_unique<DLPackContext>();
+  ctx->tensor = std::move(tensor);
+  ctx->shape.reserve(ctx->tensor.dims());
+  for (int i = 0; i < ctx->tensor.dims(); i++) {
+    ctx->shape.push_back(ctx->tensor.dim_size(i));
+  }
+
+  ctx->managed.dl_tensor.data = ctx->tensor.data();
+  ctx->managed.dl_tensor.device = {kDLCPU, 0};
+  ctx->managed.dl_tensor.ndim = ctx->shape.size();
+  ctx->managed.dl_tensor.dtype = dl_dtype;
+  ctx->managed.dl_tensor.shape = ctx->shape.data();
+  // Tensorflow tensors are compact and row major.
+  ctx->managed.dl_tensor.strides = nullptr;
+  ctx->managed.dl_tensor.byte_offset = 0;
+  ctx->managed.manager_ctx = ctx.get();
+  ctx->managed.deleter = [](DLManagedTensor *managed) {
+    delete static_cast<DLPackContext *>(managed->manager_ctx);
+  };
+
+  *out_managed = &ctx.release()->managed;
+  return tensorflow::Status::OK();
+}
+
+// Extracts slice `index` along dim `axis` of `tensor` into `out`, dropping
+// the sliced dim from the shape. The slice shares the input buffer when
+// `axis` is 0 (and the slice is aligned); otherwise a compact copy is made.
+tensorflow::Status ExtractAxisSlice(const tensorflow::Tensor &tensor, int axis,
+                                    int64_t index, tensorflow::Tensor *out) {
+  if (axis == 0) {
+    *out = tensor.SubSlice(index);
+    if (!out->IsAligned()) {
+      *out = tensorflow::tensor::DeepCopy(*out);
+    }
+    return tensorflow::Status::OK();
+  }
+
+  tensorflow::TensorShape shape = tensor.shape();
+  shape.RemoveDim(axis);
+
+  int64_t outer = 1;
+  for (int i = 0; i < axis; i++) {
+    outer *= tensor.dim_size(i);
+  }
+  int64_t inner = 1;
+  for (int i = axis + 1; i < tensor.dims(); i++) {
+    inner *= tensor.dim_size(i);
+  }
+  const int64_t axis_size = tensor.dim_size(axis);
+
+  *out = tensorflow::Tensor(tensor.dtype(), shape);
+  if (tensorflow::DataTypeCanUseMemcpy(tensor.dtype())) {
+    const int64_t block = inner * tensorflow::DataTypeSize(tensor.dtype());
+    const char *src = tensor.tensor_data().data();
+    char *dst = const_cast<char *>(out->tensor_data().data());
+    for (int64_t i = 0; i < outer; i++) {
+      memcpy(dst + i * block, src + (i * axis_size + index) * block, block);
+    }
+  } else if (tensor.dtype() == tensorflow::DT_STRING) {
+    const auto src = tensor.flat<tensorflow::tstring>();
+    auto dst = out->flat<tensorflow::tstring>();
+    for (int64_t i = 0; i < outer; i++) {
+      for (int64_t j = 0; j < inner; j++) {
+        dst(i * inner + j) = src((i * axis_size + index) * inner + j);
+      }
+    }
+  } else {
+    return tensorflow::errors::Unimplemented(
+        "Unexpected tensor dtype: ",
+        tensorflow::DataTypeString(tensor.dtype()));
+  }
+
+  return tensorflow::Status::OK();
+}
+
+// Holds one column of a sampled trajectory and exposes it through the DLPack
+// protocol (`__dlpack__` / `__dlpack_device__`) so that frameworks like JAX
+// and PyTorch ingest the sample memory directly instead of going through a
+// numpy copy of every column. Each `__dlpack__` call exports a capsule that
+// shares (rather than copies) the column buffer; the buffer is reference
+// counted so it outlives both this wrapper and the sample it came from for as
+// long as any consumer holds on to it.
+class SampleColumn {
+ public:
+  explicit SampleColumn(tensorflow::Tensor tensor)
+      : tensor_(std::move(tensor)) {}
+
+  const tensorflow::Tensor &tensor() const { return tensor_; }
+
+ private:
+  tensorflow::Tensor tensor_;
+};
+
 // This wrapper exists for the sole purpose of allowing the weak_ptr to be
 // handled in Python. Pybind supports shared_ptr and unique_ptr out of the box
 // and although it is possible to implement our own `SmartPointer, using a
@@ -489,6 +730,54 @@ namespace {
 
 namespace py = pybind11;
 
+// Fans one batch of stacked steps out to one `Append` call per writer,
+// without re-entering Python in between. Column `c` of the step appended to
+// `writers[i]` is slice `i` along `env_axis` of `data[c]`; columns set to
+// `nullopt` are skipped for every writer. The refs created by `writers[i]`
+// are returned in `(*refs)[i]`.
+absl::Status AppendBatchToWriters(
+    const std::vector<std::shared_ptr<TrajectoryWriter>> &writers,
+    const std::vector<absl::optional<tensorflow::Tensor>> &data, int env_axis,
+    std::vector<std::vector<absl::optional<std::weak_ptr<CellRef>>>> *refs) {
+  if (env_axis < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("env_axis (", env_axis, ") must be >= 0"));
+  }
+  for (int c = 0; c < data.size(); c++) {
+    if (!data[c].has_value()) continue;
+    const tensorflow::Tensor &tensor = data[c].value();
+    if (env_axis >= tensor.dims()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "env_axis (", env_axis, ") must be a valid dim of all columns but "
+          "column ", c, " has shape ", tensor.shape().DebugString(), "."));
+    }
+    if (tensor.dim_size(env_axis) != writers.size()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "All columns must have dim[env_axis] equal to the number of writers "
+          "(", writers.size(), ") but column ", c, " has shape ",
+          tensor.shape().DebugString(), "."));
+    }
+  }
+
+  refs->resize(writers.size());
+  std::vector<absl::optional<tensorflow::Tensor>> step(data.size());
+  for (int i = 0; i < writers.size(); i++) {
+    for (int c = 0; c < data.size(); c++) {
+      if (!data[c].has_value()) {
+        step[c] = absl::nullopt;
+        continue;
+      }
+      tensorflow::Tensor slice;
+      REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+          ExtractAxisSlice(data[c].value(), env_axis, i, &slice)));
+      step[c] = std::move(slice);
+    }
+    REVERB_RETURN_IF_ERROR(writers[i]->Append(step, &(*refs)[i]));
+  }
+
+  return absl::OkStatus();
+}
+
 PYBIND11_MODULE(libpybind, m) {
   // Initialization code to use numpy types in the type casters.
   ImportNumpy();
@@ -499,33 +788,61 @@ PYBIND11_MODULE(libpybind, m) {
 
   py::class_<PrioritizedSelector, ItemSelector,
              std::shared_ptr<PrioritizedSelector>>(m, "PrioritizedSelector")
+      .def(py::init<double>(), py::arg("priority_exponent"))
+      .def(py::init<double, uint64_t, uint64_t>(),
+           py::arg("priority_exponent"), py::arg("seed"),
+           py::arg("next_sample_index") = 0);
+
+  py::class_<AliasSelector, ItemSelector, std::shared_ptr<AliasSelector>>(
+      m, "AliasSelector")
+      .def(py::init<double>(), py::arg("priority_exponent"));
+
+  py::class_<BucketizedSelector, ItemSelector,
+             std::shared_ptr<BucketizedSelector>>(m, "BucketizedSelector")
       .def(py::init<double>(), py::arg("priority_exponent"));
 
   py::class_<FifoSelector, ItemSelector, std::shared_ptr<FifoSelector>>(
       m, "FifoSelector")
       .def(py::init());
 
+  py::class_<ClockSelector, ItemSelector, std::shared_ptr<ClockSelector>>(
+      m, "ClockSelector")
+      .def(py::init());
+
   py::class_<LifoSelector, ItemSelector, std::shared_ptr<LifoSelector>>(
       m, "LifoSelector")
       .def(py::init());
 
   py::class_<UniformSelector, ItemSelector, std::shared_ptr<UniformSelector>>(
       m, "UniformSelector")
-      .def(py::init());
+      .def(py::init())
+      .def(py::init<uint64_t, uint64_t>(), py::arg("seed"),
+           py::arg("next_sample_index") = 0);
 
   py::class_<HeapSelector, ItemSelector, std::shared_ptr<HeapSelector>>(
       m, "HeapSelector")
       .def(py::init<bool>(), py::arg("min_heap"));
 
+  py::class_<ReservoirSelector, ItemSelector,
+             std::shared_ptr<ReservoirSelector>>(m, "ReservoirSelector")
+      .def(py::init());
+
   py::class_<TableExtension, std::shared_ptr<TableExtension>>(m,
                                                               "TableExtension")
       .def("__repr__", &TableExtension::DebugString,
            py::call_guard<py::gil_scoped_release>());
 
+  py::class_<StatsTableExtension, TableExtension,
+             std::shared_ptr<StatsTableExtension>>(m, "StatsTableExtension")
+      .def(py::init<>())
+      .def("summary", &StatsTableExtension::DebugString,
+           py::call_guard<py::gil_scoped_release>());
+
   py::class_<RateLimiter, std::shared_ptr<RateLimiter>>(m, "RateLimiter")
-      .def(py::init<double, int, double, double>(),
+      .def(py::init<double, int, double, double, double>(),
            py::arg("samples_per_insert"), py::arg("min_size_to_sample"),
-           py::arg("min_diff"), py::arg("max_diff"))
+           py::arg("min_diff"), py::arg("max_diff"),
+           py::arg("burst_capacity") = 0.0)
       .def("__repr__", &RateLimiter::DebugString,
            py::call_guard<py::gil_scoped_release>());
 
@@ -565,6 +882,14 @@ PYBIND11_MODULE(libpybind, m) {
            py::call_guard<py::gil_scoped_release>())
       .def("can_insert", &Table::CanInsert,
            py::call_guard<py::gil_scoped_release>())
+      // Wait-free watermark reads off the published statistics snapshot; no
+      // proto construction and no GIL release (the guard would cost more than
+      // the atomic load), so they can be polled in tight loops.
+      .def("current_size", &Table::size)
+      .def("num_episodes", &Table::num_episodes)
+      .def("set_max_sample_response_size_bytes",
+           &Table::SetMaxSampleResponseSizeBytes,
+           py::call_guard<py::gil_scoped_release>())
       .def(
           "info",
           [](Table *table) -> py::bytes {
@@ -591,6 +916,7 @@ PYBIND11_MODULE(libpybind, m) {
             absl::Status status;
             {
               py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
               status = writer->Flush();
             }
             MaybeRaiseFromStatus(status);
@@ -612,6 +938,7 @@ PYBIND11_MODULE(libpybind, m) {
              // details from the status.
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status = sampler->GetNextTimestep(&sample, &end_of_sequence);
              }
 
@@ -629,14 +956,113 @@ PYBIND11_MODULE(libpybind, m) {
              // details from the status.
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status = sampler->GetNextTrajectory(&sample);
              }
 
              MaybeRaiseFromStatus(status);
              return sample;
            })
+      .def("GetNextTrajectoryBatch",
+           [](Sampler *sampler, int num_samples) {
+             absl::Status status;
+             std::vector<tensorflow::Tensor> batch;
+
+             // Release the GIL only when waiting for the call to complete. If
+             // the GIL is not held when `MaybeRaiseFromStatus` is called it can
+             // result in segfaults as the Python exception is populated with
+             // details from the status.
+             {
+               py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
+               status = sampler->GetNextTrajectoryBatch(num_samples, &batch);
+             }
+
+             MaybeRaiseFromStatus(status);
+             return batch;
+           })
+      .def("GetNextTrajectoryDLPack",
+           [](Sampler *sampler) {
+             absl::Status status;
+             std::vector<tensorflow::Tensor> sample;
+
+             // Release the GIL only when waiting for the call to complete. If
+             // the GIL is not held when `MaybeRaiseFromStatus` is called it can
+             // result in segfaults as the Python exception is populated with
+             // details from the status.
+             {
+               py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
+               status = sampler->GetNextTrajectory(&sample);
+             }
+
+             MaybeRaiseFromStatus(status);
+
+             std::vector<std::shared_ptr<SampleColumn>> columns;
+             columns.reserve(sample.size());
+             for (auto &tensor : sample) {
+               columns.push_back(
+                   std::make_shared<SampleColumn>(std::move(tensor)));
+             }
+             return columns;
+           })
+      .def("GetNextTrajectoryBatchDLPack",
+           [](Sampler *sampler, int num_samples) {
+             absl::Status status;
+             std::vector<tensorflow::Tensor> batch;
+
+             // Release the GIL only when waiting for the call to complete. If
+             // the GIL is not held when `MaybeRaiseFromStatus` is called it can
+             // result in segfaults as the Python exception is populated with
+             // details from the status.
+             {
+               py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
+               status = sampler->GetNextTrajectoryBatch(num_samples, &batch);
+             }
+
+             MaybeRaiseFromStatus(status);
+
+             std::vector<std::shared_ptr<SampleColumn>> columns;
+             columns.reserve(batch.size());
+             for (auto &tensor : batch) {
+               columns.push_back(
+                   std::make_shared<SampleColumn>(std::move(tensor)));
+             }
+             return columns;
+           })
       .def("Close", &Sampler::Close, py::call_guard<py::gil_scoped_release>());
 
+  py::class_<SampleColumn, std::shared_ptr<SampleColumn>>(m, "SampleColumn")
+      .def("__dlpack__",
+           [](SampleColumn *column, py::object /*stream*/) {
+             DLManagedTensor *managed = nullptr;
+             MaybeRaiseFromStatus(FromTensorflowStatus(
+                 TensorToDLManagedTensor(column->tensor(), &managed)));
+
+             // Per the DLPack protocol the capsule is named "dltensor" until a
+             // consumer takes ownership of the data, at which point it renames
+             // the capsule to "used_dltensor" and assumes responsibility for
+             // calling the deleter. The capsule destructor thus only runs the
+             // deleter if the capsule was never consumed.
+             return py::capsule(static_cast<void *>(managed), "dltensor",
+                                [](PyObject *capsule) {
+                                  if (!PyCapsule_IsValid(capsule, "dltensor")) {
+                                    return;
+                                  }
+                                  auto *managed = static_cast<DLManagedTensor *>(
+                                      PyCapsule_GetPointer(capsule, "dltensor"));
+                                  managed->deleter(managed);
+                                });
+           },
+           py::arg("stream") = py::none())
+      .def("__dlpack_device__",
+           [](SampleColumn *) { return std::make_pair(kDLCPU, 0); })
+      .def("numpy",
+           [](SampleColumn *column) -> tensorflow::Tensor {
+             return column->tensor();
+           });
+
   py::class_<Client>(m, "Client")
       .def(py::init<std::string>(), py::arg("server_name"))
       .def(
@@ -651,6 +1077,7 @@ PYBIND11_MODULE(libpybind, m) {
             absl::Status status;
             {
               py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
               status = client->NewWriter(
                   chunk_length, max_timesteps, delta_encoded,
                   max_in_flight_items, &writer);
@@ -674,6 +1101,7 @@ PYBIND11_MODULE(libpybind, m) {
              absl::Status status;
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status = client->NewSamplerWithoutSignatureCheck(table, options,
                                                                 &sampler);
              }
@@ -695,6 +1123,7 @@ PYBIND11_MODULE(libpybind, m) {
              absl::Status status;
              if (get_signature_timeout_ms.has_value()) {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
 
                status = client->NewTrajectoryWriter(
                    options,
@@ -733,6 +1162,7 @@ PYBIND11_MODULE(libpybind, m) {
              absl::Status status;
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status =
                    client->NewStructuredWriter(std::move(configs), &writer);
              }
@@ -775,6 +1205,7 @@ PYBIND11_MODULE(libpybind, m) {
              absl::Status status;
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status = client->ServerInfo(timeout, &info);
              }
              MaybeRaiseFromStatus(status);
@@ -788,16 +1219,89 @@ PYBIND11_MODULE(libpybind, m) {
              }
              return serialized_table_info;
            })
-      .def("Checkpoint", [](Client *client) {
-        std::string path;
-        absl::Status status;
-        {
-          py::gil_scoped_release g;
-          status = client->Checkpoint(&path);
-        }
-        MaybeRaiseFromStatus(status);
-        return path;
-      });
+      .def(
+          "TableWatermarks",
+          [](Client *client, const std::vector<std::string> &table_names,
+             int timeout_sec) {
+            auto timeout = timeout_sec > 0 ? absl::Seconds(timeout_sec)
+                                           : absl::InfiniteDuration();
+
+            std::vector<Client::TableWatermark> watermarks;
+            absl::Status status;
+            {
+              py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
+              status = client->TableWatermarks(table_names, timeout,
+                                               &watermarks);
+            }
+            MaybeRaiseFromStatus(status);
+
+            // Plain tuples; unlike `ServerInfo` no protos are built or
+            // parsed, so this is cheap enough for high frequency polling.
+            std::vector<std::tuple<std::string, int64_t, int64_t>> result;
+            result.reserve(watermarks.size());
+            for (auto &watermark : watermarks) {
+              result.emplace_back(std::move(watermark.table_name),
+                                  watermark.current_size,
+                                  watermark.num_episodes);
+            }
+            return result;
+          },
+          py::arg("table_names"), py::arg("timeout_sec") = 0)
+      .def("Checkpoint",
+           [](Client *client) {
+             std::string path;
+             absl::Status status;
+             {
+               py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
+               status = client->Checkpoint(&path);
+             }
+             MaybeRaiseFromStatus(status);
+             return path;
+           })
+      .def("ImportCheckpoint",
+           [](Client *client, const std::string &checkpoint_path,
+              const std::vector<std::string> &table_names) {
+             std::map<std::string, int64_t> num_items_per_table;
+             absl::Status status;
+             {
+               py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
+               status = client->ImportCheckpoint(checkpoint_path, table_names,
+                                                 &num_items_per_table);
+             }
+             MaybeRaiseFromStatus(status);
+             return num_items_per_table;
+           })
+      .def("ForkTable",
+           [](Client *client, const std::string &table,
+              const std::string &new_table_name) {
+             int64_t num_items = 0;
+             absl::Status status;
+             {
+               py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
+               status = client->ForkTable(table, new_table_name, &num_items);
+             }
+             MaybeRaiseFromStatus(status);
+             return num_items;
+           })
+      .def("MoveItems",
+           [](Client *client, const std::string &source_table,
+              const std::string &target_table, uint64_t min_key,
+              uint64_t max_key) {
+             int64_t num_items = 0;
+             absl::Status status;
+             {
+               py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
+               status = client->MoveItems(source_table, target_table, min_key,
+                                          max_key, &num_items);
+             }
+             MaybeRaiseFromStatus(status);
+             return num_items;
+           });
 
   py::class_<Checkpointer, std::shared_ptr<Checkpointer>>(m, "Checkpointer")
       .def("__repr__", &Checkpointer::DebugString,
@@ -817,16 +1321,47 @@ PYBIND11_MODULE(libpybind, m) {
       .def(
           py::init([](std::vector<std::shared_ptr<Table>> priority_tables,
                       int port,
-                      std::shared_ptr<Checkpointer> checkpointer = nullptr) {
+                      std::shared_ptr<Checkpointer> checkpointer = nullptr,
+                      std::string unix_address = "",
+                      std::map<std::string, int> numa_placement = {},
+                      int num_server_instances = 1,
+                      int http2_stream_window_bytes = 0,
+                      int http2_write_buffer_bytes = 0) {
             std::unique_ptr<Server> server;
-            MaybeRaiseFromStatus(StartServer(std::move(priority_tables), port,
-                                             std::move(checkpointer), &server));
+            ServerTransportOptions transport_options;
+            transport_options.http2_stream_window_bytes =
+                http2_stream_window_bytes;
+            transport_options.http2_write_buffer_bytes =
+                http2_write_buffer_bytes;
+
+            // Release the GIL only when waiting for the call to complete. If
+            // the GIL is not held when `MaybeRaiseFromStatus` is called it can
+            // result in segfaults as the Python exception is populated with
+            // details from the status.
+            absl::Status status;
+            {
+              py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
+              status = StartServer(std::move(priority_tables), port,
+                                   unix_address, std::move(checkpointer),
+                                   numa_placement, num_server_instances,
+                                   transport_options, &server);
+            }
+            MaybeRaiseFromStatus(status);
             return server.release();
           }),
           py::arg("priority_tables"), py::arg("port"),
-          py::arg("checkpointer") = nullptr)
+          py::arg("checkpointer") = nullptr, py::arg("unix_address") = "",
+          py::arg("numa_placement") = std::map<std::string, int>(),
+          py::arg("num_server_instances") = 1,
+          py::arg("http2_stream_window_bytes") = 0,
+          py::arg("http2_write_buffer_bytes") = 0)
       .def("Stop", &Server::Stop, py::call_guard<py::gil_scoped_release>())
       .def("Wait", &Server::Wait, py::call_guard<py::gil_scoped_release>())
+      .def(
+          "InProcessClient",
+          [](Server* server) { return server->InProcessClient().release(); },
+          py::call_guard<py::gil_scoped_release>())
       .def("__repr__", &Server::DebugString,
            py::call_guard<py::gil_scoped_release>());
 
@@ -846,6 +1381,7 @@ PYBIND11_MODULE(libpybind, m) {
              absl::Status status;
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status = sp->GetData(&tensor);
              }
              MaybeRaiseFromStatus(status);
@@ -867,6 +1403,7 @@ PYBIND11_MODULE(libpybind, m) {
             absl::Status status;
             {
               py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
               internal::TensorSpec spec;
               status = sp->GetSpec(&spec);
               out_shape.reserve(spec.shape.dims());
@@ -893,6 +1430,7 @@ PYBIND11_MODULE(libpybind, m) {
             py::dtype dtype;
             {
               py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
               internal::TensorSpec spec;
               status = sp->GetSpec(&spec);
 
@@ -934,6 +1472,16 @@ PYBIND11_MODULE(libpybind, m) {
         return self->GetNumKeepAliveRefs() == other->GetNumKeepAliveRefs();
       });
 
+  py::class_<TargetSizeChunkerOptions, ChunkerOptions,
+             std::shared_ptr<TargetSizeChunkerOptions>>(
+      m, "TargetSizeChunkerOptions")
+      .def(py::init<int, size_t>(), py::arg("num_keep_alive_refs"),
+           py::arg("target_chunk_size_bytes"))
+      .def("__eq__", [](TargetSizeChunkerOptions *self,
+                        std::shared_ptr<TargetSizeChunkerOptions> other) {
+        return self->GetNumKeepAliveRefs() == other->GetNumKeepAliveRefs();
+      });
+
   py::class_<TrajectoryWriter, std::shared_ptr<TrajectoryWriter>>(
       m, "TrajectoryWriter")
       .def(
@@ -941,7 +1489,18 @@ PYBIND11_MODULE(libpybind, m) {
           [](TrajectoryWriter *writer,
              std::vector<absl::optional<tensorflow::Tensor>> data) {
             std::vector<absl::optional<std::weak_ptr<CellRef>>> refs;
-            MaybeRaiseFromStatus(writer->Append(std::move(data), &refs));
+
+            // Release the GIL only when waiting for the call to complete. If
+            // the GIL is not held when `MaybeRaiseFromStatus` is called it can
+            // result in segfaults as the Python exception is populated with
+            // details from the status.
+            absl::Status status;
+            {
+              py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
+              status = writer->Append(std::move(data), &refs);
+            }
+            MaybeRaiseFromStatus(status);
 
             std::vector<absl::optional<std::shared_ptr<WeakCellRef>>> weak_refs(
                 refs.size());
@@ -961,7 +1520,18 @@ PYBIND11_MODULE(libpybind, m) {
           [](TrajectoryWriter *writer,
              std::vector<absl::optional<tensorflow::Tensor>> data) {
             std::vector<absl::optional<std::weak_ptr<CellRef>>> refs;
-            MaybeRaiseFromStatus(writer->AppendPartial(std::move(data), &refs));
+
+            // Release the GIL only when waiting for the call to complete. If
+            // the GIL is not held when `MaybeRaiseFromStatus` is called it can
+            // result in segfaults as the Python exception is populated with
+            // details from the status.
+            absl::Status status;
+            {
+              py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
+              status = writer->AppendPartial(std::move(data), &refs);
+            }
+            MaybeRaiseFromStatus(status);
 
             std::vector<absl::optional<std::shared_ptr<WeakCellRef>>> weak_refs(
                 refs.size());
@@ -1001,8 +1571,18 @@ PYBIND11_MODULE(libpybind, m) {
               trajectory.push_back(
                   TrajectoryColumn(std::move(column), squeeze_column[i]));
             }
-            MaybeRaiseFromStatus(
-                writer->CreateItem(table, priority, trajectory));
+
+            // Release the GIL only when waiting for the call to complete. If
+            // the GIL is not held when `MaybeRaiseFromStatus` is called it can
+            // result in segfaults as the Python exception is populated with
+            // details from the status.
+            absl::Status status;
+            {
+              py::gil_scoped_release g;
+              AssertGilReleasedForBlockingCall();
+              status = writer->CreateItem(table, priority, trajectory);
+            }
+            MaybeRaiseFromStatus(status);
           })
       .def("Flush",
            [](TrajectoryWriter *writer, int ignore_last_num_items,
@@ -1012,6 +1592,7 @@ PYBIND11_MODULE(libpybind, m) {
                                            : absl::InfiniteDuration();
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status = writer->Flush(ignore_last_num_items, timeout);
              }
              MaybeRaiseFromStatus(status);
@@ -1022,6 +1603,7 @@ PYBIND11_MODULE(libpybind, m) {
              absl::Status status;
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status = writer->EndEpisode(
                    clear_buffers, timeout_ms.has_value()
                                       ? absl::Milliseconds(timeout_ms.value())
@@ -1036,6 +1618,48 @@ PYBIND11_MODULE(libpybind, m) {
       .def_property_readonly("max_num_keep_alive_refs",
                              &TrajectoryWriter::max_num_keep_alive_refs);
 
+  m.def(
+      "trajectory_writer_append_batch",
+      [](std::vector<std::shared_ptr<TrajectoryWriter>> writers,
+         std::vector<absl::optional<tensorflow::Tensor>> data, int env_axis) {
+        absl::Status status;
+        std::vector<std::vector<absl::optional<std::weak_ptr<CellRef>>>> refs;
+
+        // Release the GIL only when waiting for the call to complete. If
+        // the GIL is not held when `MaybeRaiseFromStatus` is called it can
+        // result in segfaults as the Python exception is populated with
+        // details from the status.
+        {
+          py::gil_scoped_release g;
+          AssertGilReleasedForBlockingCall();
+          status = AppendBatchToWriters(writers, data, env_axis, &refs);
+        }
+        MaybeRaiseFromStatus(status);
+
+        std::vector<std::vector<absl::optional<std::shared_ptr<WeakCellRef>>>>
+            weak_refs(refs.size());
+        for (int i = 0; i < refs.size(); i++) {
+          weak_refs[i].resize(refs[i].size());
+          for (int j = 0; j < refs[i].size(); j++) {
+            if (refs[i][j].has_value()) {
+              weak_refs[i][j] =
+                  std::make_shared<WeakCellRef>(std::move(refs[i][j].value()));
+            } else {
+              weak_refs[i][j] = absl::nullopt;
+            }
+          }
+        }
+
+        return weak_refs;
+      },
+      py::arg("writers"), py::arg("data"), py::arg("env_axis") = 0,
+      "Appends one step to every writer from stacked arrays.\n"
+      "\n"
+      "Column c of the step appended to writers[i] is slice i along env_axis\n"
+      "of data[c] (None columns are skipped for every writer). The fan out\n"
+      "runs entirely in C++ under a single GIL release so stepping B\n"
+      "vectorized environments costs one Python call instead of B.");
+
   py::class_<StructuredWriter, std::shared_ptr<StructuredWriter>>(
       m, "StructuredWriter")
       .def("Append", &StructuredWriter::Append,
@@ -1048,6 +1672,7 @@ PYBIND11_MODULE(libpybind, m) {
              absl::Status status;
              {
                py::gil_scoped_release g;
+               AssertGilReleasedForBlockingCall();
                status =
                    writer->Flush(ignore_last_num_items,
                                  timeout_ms.has_value()
@@ -1061,6 +1686,7 @@ PYBIND11_MODULE(libpybind, m) {
         absl::Status status;
         {
           py::gil_scoped_release g;
+          AssertGilReleasedForBlockingCall();
           status = writer->EndEpisode(
               clear_buffers, timeout_ms.has_value()
                                  ? absl::Milliseconds(timeout_ms.value())
@@ -1,11 +1,15 @@
 # LINT.IfChange
-from typing import List, Optional, Sequence, Any, Tuple
+from typing import Any, List, Mapping, Optional, Sequence, Tuple
 
 import numpy as np
 
 
 class ItemSelector: ...
 
+class AliasSelector(ItemSelector):
+  def __init__(self, priority_exponent: float): ...
+
+
 class PrioritizedSelector(ItemSelector):
   def __init__(self, priority_exponent: float): ...
 
@@ -29,6 +33,11 @@ class HeapSelector(ItemSelector):
 class TableExtension: ...
 
 
+class StatsTableExtension(TableExtension):
+  def __init__(self): ...
+  def summary(self) -> str: ...
+
+
 class RateLimiter:
   def __init__(self, samples_per_insert: float, min_size_to_sample: int,
                min_diff: float, max_diff: float):    ...
@@ -52,9 +61,18 @@ class Writer:
   def Close(self, retry_on_unavailable: bool): ...
 
 
+class SampleColumn:
+  def __dlpack__(self, stream: Optional[Any] = None) -> Any: ...
+  def __dlpack_device__(self) -> Tuple[int, int]: ...
+  def numpy(self) -> np.ndarray: ...
+
+
 class Sampler:
   def GetNextTimestep(self) -> Tuple[List[Any], bool]: ...
   def GetNextTrajectory(self) -> List[np.ndarray]: ...
+  def GetNextTrajectoryDLPack(self) -> List[SampleColumn]: ...
+  def GetNextTrajectoryBatchDLPack(
+      self, num_samples: int) -> List[SampleColumn]: ...
 
 
 class Client:
@@ -121,7 +139,10 @@ def create_default_checkpointer(
 
 class Server:
   def __init__(self, priority_tables: Sequence[Table], port: int,
-               checkpointer: Optional[Checkpointer]):    ...
+               checkpointer: Optional[Checkpointer],
+               unix_address: str = ...,
+               numa_placement: Mapping[str, int] = ...,
+               num_server_instances: int = ...):    ...
   def Stop(self): ...
   def Wait(self): ...
 
@@ -148,6 +169,11 @@ class AutoTunedChunkerOptions:
   def __init__(self, num_keep_alive_refs: int, throughput_weight: float): ...
 
 
+class TargetSizeChunkerOptions(ChunkerOptions):
+  def __init__(self, num_keep_alive_refs: int,
+               target_chunk_size_bytes: int): ...
+
+
 class TrajectoryWriter:
 
   def Append(
@@ -194,6 +220,13 @@ class TrajectoryWriter:
     ...
 
 
+def trajectory_writer_append_batch(
+    writers: Sequence[TrajectoryWriter],
+    data: Sequence[Optional[Any]],
+    env_axis: int = 0) -> List[List[Optional[WeakCellRef]]]:
+  ...
+
+
 class StructuredWriter:
   def Append(self, data: Sequence[Optional[Any]]): ...
   def AppendPartial(self, data: Sequence[Optional[Any]]): ...
@@ -145,6 +145,59 @@ class SampleToInsertRatio(RateLimiter):
             max_diff=max_diff))
 
 
+class TokenBucket(RateLimiter):
+  """Enforces `samples_per_insert` on average while allowing bursts.
+
+  Each insert deposits `samples_per_insert` sample tokens into a bucket that
+  holds at most `burst_capacity` tokens; each sample spends one token.
+  Sampling is blocked only when the bucket is empty (or the table holds fewer
+  than `min_size_to_sample` items) and inserts are never blocked; deposits
+  that would overflow the bucket are forfeited.
+
+  Compared to `SampleToInsertRatio` this does not force the sampler down to
+  the sustained rate immediately: credit accumulated while the sampler was
+  paused (e.g. during evaluation) can be spent in a full speed burst of up to
+  `burst_capacity` samples, while the long-run sample/insert ratio still
+  cannot exceed `samples_per_insert`.
+  """
+
+  def __init__(self, samples_per_insert: float, min_size_to_sample: int,
+               burst_capacity: float):
+    """Constructor of TokenBucket.
+
+    Args:
+      samples_per_insert: The sustained rate, i.e. the average number of times
+        each inserted item may be sampled.
+      min_size_to_sample: The minimum number of items that the table must
+        contain before any sample operation.
+      burst_capacity: Maximum number of sample tokens the bucket can hold,
+        i.e. the largest burst that can follow a sampling pause. Must be at
+        least max(1.0, samples_per_insert) or the bucket could never hold a
+        whole token.
+
+    Raises:
+      ValueError: If burst_capacity is smaller than
+        max(1.0, samples_per_insert) or min_size_to_sample is not positive.
+    """
+    if min_size_to_sample < 1:
+      raise ValueError(
+          f'min_size_to_sample ({min_size_to_sample}) must be a positive '
+          f'integer')
+    if burst_capacity < max(1.0, samples_per_insert):
+      raise ValueError(
+          f'burst_capacity ({burst_capacity}) must be >= '
+          f'max(1.0, samples_per_insert) ({max(1.0, samples_per_insert)}) as '
+          f'smaller values could completely block sample calls.')
+
+    super().__init__(
+        pybind.RateLimiter(
+            samples_per_insert=samples_per_insert,
+            min_size_to_sample=min_size_to_sample,
+            min_diff=-sys.float_info.max,
+            max_diff=sys.float_info.max,
+            burst_capacity=burst_capacity))
+
+
 class Queue(RateLimiter):
   """Effectively turns the priority table into a queue.
 
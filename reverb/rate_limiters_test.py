@@ -106,6 +106,49 @@ class TestSampleToInsertRatio(parameterized.TestCase):
                                         error_buffer)
 
 
+class TestTokenBucket(parameterized.TestCase):
+
+  @parameterized.named_parameters(
+      {
+          'testcase_name': 'burst_below_one_token',
+          'samples_per_insert': 0.5,
+          'min_size_to_sample': 10,
+          'burst_capacity': 0.9,
+          'want': ValueError,
+      },
+      {
+          'testcase_name': 'burst_below_samples_per_insert',
+          'samples_per_insert': 5,
+          'min_size_to_sample': 10,
+          'burst_capacity': 4,
+          'want': ValueError,
+      },
+      {
+          'testcase_name': 'min_size_to_sample_smaller_than_1',
+          'samples_per_insert': 1,
+          'min_size_to_sample': 0,
+          'burst_capacity': 100,
+          'want': ValueError,
+      },
+      {
+          'testcase_name': 'valid',
+          'samples_per_insert': 0.5,
+          'min_size_to_sample': 10,
+          'burst_capacity': 100,
+          'want': None,
+      },
+  )
+  def test_validates_arguments(self, samples_per_insert, min_size_to_sample,
+                               burst_capacity, want):
+    if want:
+      with self.assertRaises(want):
+        rate_limiters.TokenBucket(samples_per_insert, min_size_to_sample,
+                                  burst_capacity)
+    else:  # Should not raise any error.
+      rate_limiters.TokenBucket(samples_per_insert, min_size_to_sample,
+                                burst_capacity)
+
+
 class TestMinSize(parameterized.TestCase):
 
   @parameterized.parameters(
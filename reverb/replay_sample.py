@@ -33,16 +33,26 @@ class SampleInfo(NamedTuple):
     table_size: The total number of items present in the table at sample time.
     priority: Priority of the item at the time of sampling. A python `float` or
       `tf.float64` Tensor.
+    queued_for_secs: Server side time (in seconds) the sample request spent
+      queued in the table worker before the item was sampled.
+    rate_limiter_wait_secs: Portion of `queued_for_secs` during which the table
+      worker was put to sleep by the rate limiter.
+    serialize_time_secs: Server side time (in seconds) spent assembling and
+      serializing the response the sample was sent in.
   """
   key: Union[np.ndarray, tf.Tensor, int]
   probability: Union[np.ndarray, tf.Tensor, float]
   table_size: Union[np.ndarray, tf.Tensor, int]
   priority: Union[np.ndarray, tf.Tensor, float]
+  queued_for_secs: Union[np.ndarray, tf.Tensor, float]
+  rate_limiter_wait_secs: Union[np.ndarray, tf.Tensor, float]
+  serialize_time_secs: Union[np.ndarray, tf.Tensor, float]
 
   @classmethod
   def tf_dtypes(cls):
-    """Info dtypes corresponding to (key, probability, table_size, priority)."""
-    return cls(tf.uint64, tf.double, tf.int64, tf.double)
+    """Info dtypes corresponding to the fields, in field order."""
+    return cls(tf.uint64, tf.double, tf.int64, tf.double, tf.double, tf.double,
+               tf.double)
 
 
 class ReplaySample(NamedTuple):
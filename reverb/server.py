@@ -21,7 +21,7 @@ service.
 
 import abc
 import collections
-from typing import Optional, Sequence, Union
+from typing import Mapping, Optional, Sequence, Union
 
 from absl import logging
 import portpicker
@@ -106,7 +106,9 @@ class Table:
                rate_limiter: rate_limiters.RateLimiter,
                max_times_sampled: int = 0,
                extensions: Sequence[TableExtensionBase] = (),
-               signature: Optional[reverb_types.SpecNest] = None):
+               signature: Optional[reverb_types.SpecNest] = None,
+               max_sample_response_size_bytes: Optional[int] = None,
+               enable_stats: bool = True):
     """Constructor of the Table.
 
     Args:
@@ -125,6 +127,17 @@ class Table:
         the table.
       signature: Optional nested structure containing `tf.TypeSpec` objects,
         describing the schema of items in this table.
+      max_sample_response_size_bytes: Optional size (in bytes) at which sample
+        stream responses of this table are cut and flushed to the client.
+        Tables with tiny items can raise it to amortize the per-message
+        overhead over more samples while tables with jumbo items can lower it
+        to reduce head-of-line blocking. If `None` (default) the server wide
+        default (1MB) is used.
+      enable_stats: Whether to register the built-in stats extension which
+        records latency and priority distributions of table operations into
+        lock free per-thread histograms. The recording overhead is a few
+        nanoseconds per operation so it is enabled by default; a summary is
+        available through `stats_summary()`.
 
     Raises:
       ValueError: If name is empty.
@@ -140,6 +153,11 @@ class Table:
     for extension in extensions:
       internal_extensions += list(extension.build_internal_extensions(name))
 
+    self._stats_extension = None
+    if enable_stats:
+      self._stats_extension = pybind.StatsTableExtension()
+      internal_extensions.append(self._stats_extension)
+
     if signature:
       flat_signature = tree.flatten(signature)
       for s in flat_signature:
@@ -161,6 +179,10 @@ class Table:
         extensions=internal_extensions,
         signature=signature_proto_str)
 
+    if max_sample_response_size_bytes is not None:
+      self.internal_table.set_max_sample_response_size_bytes(
+          max_sample_response_size_bytes)
+
   @classmethod
   def queue(cls,
             name: str,
@@ -224,6 +246,17 @@ class Table:
     proto_string = self.internal_table.info()
     return reverb_types.TableInfo.from_serialized_proto(proto_string)
 
+  def stats_summary(self) -> Optional[str]:
+    """Summary of the stats extension or `None` if `enable_stats=False`.
+
+    The summary contains per operation (insert/delete/update/sample) counts
+    and latency/priority percentiles merged from the lock free per-thread
+    histograms.
+    """
+    if self._stats_extension is None:
+      return None
+    return self._stats_extension.summary()
+
   def can_sample(self, num_samples: int) -> bool:
     """Returns True if a sample operation is permitted at the current state."""
     return self.internal_table.can_sample(num_samples)
@@ -253,7 +286,12 @@ class Server:
   def __init__(self,
                tables: Optional[Sequence[Table]] = None,
                port: Optional[Union[int, None]] = None,
-               checkpointer: Optional[checkpointers.CheckpointerBase] = None):
+               checkpointer: Optional[checkpointers.CheckpointerBase] = None,
+               unix_address: Optional[str] = None,
+               numa_placement: Optional[Mapping[str, int]] = None,
+               num_server_instances: int = 1,
+               http2_stream_window_bytes: int = 0,
+               http2_write_buffer_bytes: int = 0):
     """Constructor of Server serving the ReverbService.
 
     Args:
@@ -263,10 +301,40 @@ class Server:
       checkpointer: Checkpointer used for storing/loading checkpoints. If None
         (default) then `checkpointers.default_checkpointer` is used to
         construct the checkpointer.
+      unix_address: Optional path of a unix domain socket to also serve the
+        gRPC-service on (e.g. '/tmp/reverb.sock'). Clients on the same host
+        can connect to it with `Client(f'unix:{path}')`, which avoids the TCP
+        loopback overhead.
+      numa_placement: Optional mapping from table name to the NUMA node the
+        table should be placed on. The table's worker threads and the memory
+        they allocate are pinned to the node, which avoids cross socket
+        traffic on multi socket hosts. Tables not named in the mapping are
+        left unpinned. Only has an effect on Linux.
+      num_server_instances: Number of gRPC server instances to start (defaults
+        to 1). All instances serve the same tables and chunk data and listen
+        on `port` via SO_REUSEPORT, so the kernel spreads incoming
+        connections across their accept paths. Use this to get the
+        parallelism of running several Reverb servers per host without
+        duplicating data between processes. When greater than 1 an explicit
+        `port` must be provided.
+      http2_stream_window_bytes: When positive, the per-stream HTTP/2
+        flow-control window in bytes offered to clients (gRPC's BDP based
+        autotuning is disabled when a window is forced). Leave at 0 (default)
+        unless the `response_write_stall` metric shows streams blocked on the
+        transport, e.g. on cross-zone links with a large bandwidth-delay
+        product.
+      http2_write_buffer_bytes: When positive, the number of bytes the
+        transport may buffer per write before blocking the sender. Leave at 0
+        (default) to use gRPC's default.
 
     Raises:
       ValueError: If tables is empty.
       ValueError: If multiple Table in tables share names.
+      ValueError: If numa_placement names an unknown table or NUMA node.
+      ValueError: If num_server_instances < 1, or if it is greater than 1
+        and no explicit port was provided.
+      ValueError: If http2_stream_window_bytes or http2_write_buffer_bytes
+        is negative.
     """
     if not tables:
       raise ValueError('At least one table must be provided')
@@ -277,14 +345,24 @@ class Server:
           ', '.join(duplicates)))
 
     if port is None:
+      if num_server_instances > 1:
+        raise ValueError(
+            'An explicit port must be provided when num_server_instances > 1 '
+            'as all instances must bind the same port.')
       port = portpicker.pick_unused_port()
 
     if checkpointer is None:
       checkpointer = checkpointers.default_checkpointer()
 
     self._server = pybind.Server([table.internal_table for table in tables],
-                                 port, checkpointer.internal_checkpointer())
+                                 port, checkpointer.internal_checkpointer(),
+                                 unix_address or '',
+                                 dict(numa_placement or {}),
+                                 num_server_instances,
+                                 http2_stream_window_bytes,
+                                 http2_write_buffer_bytes)
     self._port = port
+    self._unix_address = unix_address
 
   def __del__(self):
     """Stop server and free up the port if was reserved through portpicker."""
@@ -302,6 +380,14 @@ class Server:
     """Port the gRPC service is running at."""
     return self._port
 
+  @property
+  def unix_address(self):
+    """Path of the unix domain socket the gRPC service also listens on.
+
+    `None` unless `unix_address` was provided to the constructor.
+    """
+    return self._unix_address
+
   def stop(self):
     """Request that the ReverbService is terminated and wait for shutdown."""
     return self._server.Stop()
@@ -322,6 +408,55 @@ class Server:
     if self._server.Wait():
       raise KeyboardInterrupt
 
+  def import_checkpoint(self, checkpoint_path: str,
+                        tables: Optional[Sequence[str]] = None):
+    """Imports tables from an existing checkpoint into this server.
+
+    This is a convenience wrapper around `Client.import_checkpoint` using an
+    in-process client; see that method for detailed semantics. It can be used
+    to warm start a subset of the tables (e.g. expert demonstrations) from a
+    checkpoint written by a different server with different companion tables.
+
+    Args:
+      checkpoint_path: Absolute path of the checkpoint directory to import
+        from.
+      tables: Names of the tables to import. If None (default) then all tables
+        present in both the checkpoint and this server are imported.
+
+    Returns:
+      A dict mapping the name of each imported table to the number of items
+      inserted into it.
+    """
+    return self.in_process_client().import_checkpoint(checkpoint_path, tables)
+
+  def fork_table(self, table: str, new_table_name: str) -> int:
+    """Clones a hosted table into a new table on this server.
+
+    This is a convenience wrapper around `Client.fork_table` using an
+    in-process client; see that method for detailed semantics. The new table
+    shares all chunk data with the source, so e.g. freezing a training table
+    into an evaluation table never duplicates the stored trajectories.
+
+    Args:
+      table: Name of the table to fork. Must exist on the server.
+      new_table_name: Name of the new table. Must not collide with an
+        existing table.
+
+    Returns:
+      The number of items copied into the new table.
+    """
+    return self.in_process_client().fork_table(table, new_table_name)
+
   def localhost_client(self):
     """Creates a client connect to the localhost channel."""
     return client.Client(f'localhost:{self._port}')
+
+  def in_process_client(self):
+    """Creates a client that bypasses the network stack entirely.
+
+    The client communicates with the server over an in-process gRPC channel
+    and is therefore only usable from the process hosting the server. It must
+    not be used after the server has been stopped.
+    """
+    return client.Client(f'localhost:{self._port}',
+                         self._server.InProcessClient())
@@ -19,10 +19,12 @@ Note: Most of the functionality is tested through ./client_test.py. This file
 only contains a few extra cases which does not fit well in the client tests.
 """
 
+import os
 import time
 
 from absl.testing import absltest
 from absl.testing import parameterized
+from reverb import client
 from reverb import item_selectors
 from reverb import pybind
 from reverb import rate_limiters
@@ -45,11 +47,63 @@ class ServerTest(absltest.TestCase):
                 rate_limiter=rate_limiters.MinSize(2)),
         ],
         port=None)
-    my_client = my_server.localhost_client()
+    my_client = my_server.in_process_client()
+    my_client.reset(TABLE_NAME)
+    del my_client
+    my_server.stop()
+
+  def test_unix_address_client(self):
+    unix_address = os.path.join(self.create_tempdir().full_path, 'reverb.sock')
+    my_server = server.Server(
+        tables=[
+            server.Table(
+                name=TABLE_NAME,
+                sampler=item_selectors.Prioritized(1),
+                remover=item_selectors.Fifo(),
+                max_size=100,
+                rate_limiter=rate_limiters.MinSize(2)),
+        ],
+        port=None,
+        unix_address=unix_address)
+    my_client = client.Client(f'unix:{unix_address}')
     my_client.reset(TABLE_NAME)
     del my_client
     my_server.stop()
 
+  def test_fork_table(self):
+    my_server = server.Server(
+        tables=[
+            server.Table(
+                name=TABLE_NAME,
+                sampler=item_selectors.Prioritized(1),
+                remover=item_selectors.Fifo(),
+                max_size=100,
+                rate_limiter=rate_limiters.MinSize(1)),
+        ],
+        port=None)
+    my_client = my_server.in_process_client()
+    my_client.insert([1], {TABLE_NAME: 1.0})
+    for _ in range(100):
+      if my_client.server_info()[TABLE_NAME].current_size == 1:
+        break
+      time.sleep(0.01)
+
+    self.assertEqual(my_server.fork_table(TABLE_NAME, 'frozen'), 1)
+
+    # The fork is served like any other table and holds the item.
+    info = my_client.server_info()
+    self.assertIn('frozen', info)
+    self.assertEqual(info['frozen'].current_size, 1)
+    sample = next(my_client.sample('frozen', 1))[0]
+    self.assertEqual(int(sample.data[0]), 1)
+
+    # Forking to an occupied name fails.
+    with self.assertRaises(Exception):
+      my_server.fork_table(TABLE_NAME, 'frozen')
+
+    del my_client
+    my_server.stop()
+
   def test_duplicate_priority_table_name(self):
     with self.assertRaises(ValueError):
       server.Server(
@@ -99,6 +153,34 @@ class ServerTest(absltest.TestCase):
     del my_client
     my_server.stop()
 
+  def test_stats_summary(self):
+    table = server.Table(
+        name=TABLE_NAME,
+        sampler=item_selectors.Prioritized(1),
+        remover=item_selectors.Fifo(),
+        max_size=100,
+        rate_limiter=rate_limiters.MinSize(1))
+    my_server = server.Server(tables=[table], port=None)
+    my_client = my_server.localhost_client()
+    my_client.insert(1, {TABLE_NAME: 1.0})
+    for _ in range(100):
+      if 'insert={count=1' in table.stats_summary():
+        break
+      time.sleep(0.01)
+    self.assertIn('insert={count=1', table.stats_summary())
+    del my_client
+    my_server.stop()
+
+  def test_stats_summary_disabled(self):
+    table = server.Table(
+        name=TABLE_NAME,
+        sampler=item_selectors.Prioritized(1),
+        remover=item_selectors.Fifo(),
+        max_size=100,
+        rate_limiter=rate_limiters.MinSize(1),
+        enable_stats=False)
+    self.assertIsNone(table.stats_summary())
+
 
 class TableTest(parameterized.TestCase):
 
@@ -132,12 +132,10 @@ class StructuredWriter:
 
     try:
       self._writer.Flush(block_until_num_items, timeout_ms)
-    except RuntimeError as e:
-      if 'Timeout exceeded' in str(e) and timeout_ms is not None:
-        raise errors.DeadlineExceededError(
-            f'Flush call did not complete within provided timeout of '
-            f'{datetime.timedelta(milliseconds=timeout_ms)}')
-      raise
+    except TimeoutError:
+      raise errors.DeadlineExceededError(
+          f'Flush call did not complete within provided timeout of '
+          f'{datetime.timedelta(milliseconds=timeout_ms)}')
 
   def end_episode(self,
                   clear_buffers: bool = True,
@@ -163,9 +161,7 @@ class StructuredWriter:
     """
     try:
       self._writer.EndEpisode(clear_buffers, timeout_ms)
-    except RuntimeError as e:
-      if 'Timeout exceeded' in str(e) and timeout_ms is not None:
-        raise errors.DeadlineExceededError(
-            f'End episode call did not complete within provided timeout of '
-            f'{datetime.timedelta(milliseconds=timeout_ms)}')
-      raise
+    except TimeoutError:
+      raise errors.DeadlineExceededError(
+          f'End episode call did not complete within provided timeout of '
+          f'{datetime.timedelta(milliseconds=timeout_ms)}')
@@ -128,7 +128,10 @@ class TimestepDataset(tf.data.Dataset):
             key=tf.TensorShape([]),
             probability=tf.TensorShape([]),
             table_size=tf.TensorShape([]),
-            priority=tf.TensorShape([])),
+            priority=tf.TensorShape([]),
+            queued_for_secs=tf.TensorShape([]),
+            rate_limiter_wait_secs=tf.TensorShape([]),
+            serialize_time_secs=tf.TensorShape([])),
         data=shapes)
 
     # The tf.data API doesn't fully support lists so we convert all uses of
@@ -179,6 +179,9 @@ class TrajectoryDatasetTest(tf.test.TestCase, parameterized.TestCase):
                 probability=1.0,
                 table_size=10,
                 priority=0.5,
+                queued_for_secs=0.0,
+                rate_limiter_wait_secs=0.0,
+                serialize_time_secs=0.0,
             ),
             data=SHAPES))
 
@@ -218,6 +221,9 @@ class TrajectoryDatasetTest(tf.test.TestCase, parameterized.TestCase):
                   probability=1.0,
                   table_size=10,
                   priority=0.5,
+                  queued_for_secs=0.0,
+                  rate_limiter_wait_secs=0.0,
+                  serialize_time_secs=0.0,
               ),
               data={
                   'last': None,
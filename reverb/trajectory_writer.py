@@ -397,12 +397,10 @@ class TrajectoryWriter:
 
     try:
       self._writer.Flush(block_until_num_items, timeout_ms)
-    except RuntimeError as e:
-      if 'Timeout exceeded' in str(e) and timeout_ms is not None:
-        raise errors.DeadlineExceededError(
-            f'Flush call did not complete within provided timeout of '
-            f'{datetime.timedelta(milliseconds=timeout_ms)}')
-      raise
+    except TimeoutError:
+      raise errors.DeadlineExceededError(
+          f'Flush call did not complete within provided timeout of '
+          f'{datetime.timedelta(milliseconds=timeout_ms)}')
 
   def end_episode(self,
                   clear_buffers: bool = True,
@@ -424,12 +422,10 @@ class TrajectoryWriter:
     """
     try:
       self._writer.EndEpisode(clear_buffers, timeout_ms)
-    except RuntimeError as e:
-      if 'Timeout exceeded' in str(e) and timeout_ms is not None:
-        raise errors.DeadlineExceededError(
-            f'End episode call did not complete within provided timeout of '
-            f'{datetime.timedelta(milliseconds=timeout_ms)}')
-      raise
+    except TimeoutError:
+      raise errors.DeadlineExceededError(
+          f'End episode call did not complete within provided timeout of '
+          f'{datetime.timedelta(milliseconds=timeout_ms)}')
 
     if clear_buffers:
       for column in self._column_history: